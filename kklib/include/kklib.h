@@ -64,6 +64,7 @@ typedef enum kk_tag_e {
   KK_TAG_SIZE_T,      // boxed size_t
   KK_TAG_SSIZE_T,     // boxed kk_ssize_t
   KK_TAG_EVV_VECTOR,  // evidence vector (used in std/core/hnd)
+  KK_TAG_UVECTOR,     // a vector of unboxed primitive values (see `uvector.h`)
   // raw tags have a free function together with a `void*` to the data
   KK_TAG_CPTR_RAW,    // full void* (must be first, see kk_tag_is_raw())
   KK_TAG_BYTES_RAW,   // pointer to byte buffer
@@ -86,13 +87,15 @@ static inline bool kk_tag_is_raw(kk_tag_t tag) {
 typedef kk_decl_align(8) struct kk_header_s {
   uint8_t   scan_fsize;       // number of fields that should be scanned when releasing (`scan_fsize <= 0xFF`, if 0xFF, the full scan size is the first field)
   uint8_t   thread_shared : 1;
+  uint8_t   arena : 1;        // allocated in an arena (see `arena.c`)
+  uint8_t   size_class : 4;   // free cache size class: the allocation has at least `8*size_class` bytes (or 0 if not cached, see `kk_block_free`)
   uint16_t  tag;              // header tag
   uint32_t  refcount;         // reference count  (last to reduce code size constants in kk_block_init)
 } kk_header_t;
 
 #define KK_SCAN_FSIZE_MAX (0xFF)
-#define KK_HEADER(scan_fsize,tag)         { scan_fsize, 0, tag, 0}             // start with refcount of 0
-#define KK_HEADER_STATIC(scan_fsize,tag)  { scan_fsize, 0, tag, KU32(0xFF00)}  // start with recognisable refcount (anything > 1 is ok)
+#define KK_HEADER(sfsize,htag)         { .scan_fsize = (sfsize), .tag = (htag), .refcount = 0 }  // start with refcount of 0
+#define KK_HEADER_STATIC(sfsize,htag)  { .scan_fsize = (sfsize), .tag = (htag), .refcount = KU32(0xE0000000) }  // start sticky (never freed and safe to use from any thread, see `refcount.c`)
 
 
 // Polymorphic operations work on boxed values. (We use a struct for extra checks to prevent accidental conversion)
@@ -285,6 +288,13 @@ typedef struct kk_box_any_s {
 //A yield context allows up to 8 continuations to be stored in-place
 #define KK_YIELD_CONT_MAX (8)
 
+// Freed continuation compositions are kept for reuse in a per-context pool of at most this many blocks
+// per capacity class; class `c` has room for `2 << c` continuations (see `compose.c`)
+#ifndef KK_CONT_POOL_MAX
+#define KK_CONT_POOL_MAX  (64)
+#endif
+#define KK_CONT_POOL_CLASSES  (5)
+
 typedef enum kk_yield_kind_e {
   KK_YIELD_NONE,
   KK_YIELD_NORMAL,
@@ -303,6 +313,47 @@ typedef struct kk_yield_s {
 
 extern kk_ptr_t kk_evv_empty_singleton;
 
+
+// Runtime statistics are only counted if kklib is compiled with `KK_STATS=1` (see `--kkstats` and `stats.c`)
+#ifndef KK_STATS
+#define KK_STATS  0
+#endif
+
+#if KK_STATS
+#define KK_STATS_TAGS       (64)   // count constructor tags below this individually
+#define KK_STATS_TAG_COUNT  (KK_STATS_TAGS + (KK_TAG_LAST - KK_TAG_OPEN) + 1)  // constructors, special tags, and other tags
+
+typedef struct kk_stats_s {
+  int64_t  allocs[KK_STATS_TAG_COUNT];  // block allocations per tag
+  int64_t  frees[KK_STATS_TAG_COUNT];   // block frees per tag
+  int64_t  reuses;                      // allocations that reused a block (in `kk_block_alloc_at`)
+  int64_t  bytes_static;                // single ascii byte sequences returned as a static value instead of allocated
+  int64_t  dup_slow;                    // dup's of thread shared or sticky blocks
+  int64_t  drop_slow;                   // drop's of thread shared or sticky blocks
+  int64_t  delayed_len;                 // current length of the delayed free list
+  int64_t  delayed_peak;                // peak length of the delayed free list
+  int64_t  reclaim_jobs;                // structures passed to the reclaimer thread
+  int64_t  reclaim_blocks;              // blocks freed by the reclaimer thread
+  int64_t  reclaim_deferred;            // decrements passed back from the reclaimer thread
+} kk_stats_t;
+#endif
+
+// Small blocks are cached per context when freed (in word size classes, see `kk_block_free`)
+#ifndef KK_FREE_CACHE
+#define KK_FREE_CACHE  1
+#endif
+#define KK_FREE_CACHE_BINS   (8)     // cache blocks of up to `8*8` bytes (at most 15 as the size class has 4 bits)
+#define KK_FREE_CACHE_MAX    (256)   // water mark: maximal number of cached blocks per size class
+
+// Can we get the usable size of an allocation? (see `kk_malloc_usable_size`)
+#ifndef KK_MALLOC_USABLE_SIZE
+#if defined(KK_MIMALLOC) || defined(__GLIBC__) || defined(__APPLE__) || defined(_WIN32)
+#define KK_MALLOC_USABLE_SIZE  1
+#else
+#define KK_MALLOC_USABLE_SIZE  0
+#endif
+#endif
+
      
 // The thread local context.
 // The fields `yielding`, `heap` and `evv` should come first for efficiency
@@ -313,6 +364,19 @@ typedef struct kk_context_s {
   kk_yield_t     yield;            // inlined yield structure (for efficiency)
   int32_t        marker_unique;    // unique marker generation
   kk_block_t*    delayed_free;     // list of blocks that still need to be freed
+  kk_ssize_t     free_budget;      // maximal number of blocks freed per drop (or 0 for unbounded, see `--kkfree-budget`)
+  kk_ssize_t     free_fuel;        // remaining number of blocks that can be freed in the current drop
+  kk_ssize_t     reclaim_threshold; // free drops of more blocks than this on the reclaimer thread (0 to disable, see --kkreclaim)
+  _Atomic(uintptr_t) reclaim_deferred; // decrements passed back by the reclaimer thread
+  _Atomic(uintptr_t) reclaim_pending;  // number of structures still being freed by the reclaimer thread
+  kk_ssize_t     heap_sample_countdown; // allocated bytes until the next heap profile sample (see --kkheapprof)
+  struct kk_arena_s* arena;        // the current arena to allocate blocks in (or NULL, see `kk_arena_enter`)
+#if KK_FREE_CACHE
+  kk_block_t*    free_cache[KK_FREE_CACHE_BINS+1];        // per size class a LIFO list of freed blocks
+  int32_t        free_cache_count[KK_FREE_CACHE_BINS+1];  // the length of each list
+#endif
+  kk_block_t*    cont_pool[KK_CONT_POOL_CLASSES];        // per capacity class a LIFO list of free continuation composition blocks (see `compose.c`)
+  int32_t        cont_pool_count[KK_CONT_POOL_CLASSES];  // the length of each list
   kk_integer_t   unique;           // thread local unique number generation
   uintptr_t      thread_id;        // unique thread id
   kk_box_any_t   kk_box_any;       // used when yielding as a value of any type
@@ -320,6 +384,9 @@ typedef struct kk_context_s {
   kk_function_t  out;              // std output
 
   struct kk_random_ctx_s* srandom_ctx; // strong random using chacha20, initialized on demand
+  struct kk_async_loop_s* async_loop;  // asynchronous I/O event loop, initialized on demand (see `async.c`)
+  struct kk_ref_epoch_s* ref_epoch; // epoch reader and retired values of thread-shared references (see `ref.c`)
+  struct kk_context_local_s* locals; // library state that is freed with the context (see `kk_context_local_set`)
   kk_ssize_t        argc;             // command line argument count 
   const char**   argv;             // command line arguments
   kk_timer_t     process_start;    // time at start of the process
@@ -328,14 +395,30 @@ typedef struct kk_context_s {
   kk_duration_t  timer_delta;      // applied timer delta
   int64_t        time_freq;        // unix time frequency
   kk_duration_t  time_unix_prev;   // last requested unix time
+#if KK_STATS
+  kk_stats_t     stats;            // runtime statistics
+#endif
 } kk_context_t;
 
 // Get the current (thread local) runtime context (should always equal the `_ctx` parameter)
 kk_decl_export kk_context_t* kk_get_context(void);
 
+// Free the context of the current thread (called when a thread terminates)
+kk_decl_export void          kk_free_context(void);
+
 kk_decl_export kk_context_t* kk_main_start(int argc, char** argv);
 kk_decl_export void          kk_main_end(kk_context_t* ctx);
 
+// Library state per context (like a cache), identified by the address of a `key`.
+// The `free_fun` is called when the context is freed (so also when a worker thread terminates).
+typedef void (kk_context_local_free_fun_t)(void* data, kk_context_t* ctx);
+kk_decl_export void*         kk_context_local_get(const void* key, kk_context_t* ctx);
+kk_decl_export bool          kk_context_local_set(const void* key, void* data, kk_context_local_free_fun_t* free_fun, kk_context_t* ctx);
+
+// Called by the generated module initialization to trace the startup time (with `--kkstartup`)
+kk_decl_export void          kk_startup_enter(const char* module);
+kk_decl_export void          kk_startup_leave(void);
+
 kk_decl_export void          kk_debugger_break(kk_context_t* ctx);
 
 // The current context is passed as a _ctx parameter in the generated code
@@ -365,6 +448,56 @@ static inline int32_t kk_marker_unique(kk_context_t* ctx) {
 
 
 
+/*--------------------------------------------------------------------------------------
+  Statistics
+--------------------------------------------------------------------------------------*/
+#if KK_STATS
+static inline kk_ssize_t kk_stats_tag_index(kk_tag_t tag) {
+  if (tag < KK_STATS_TAGS) return (kk_ssize_t)tag;
+  if (tag >= KK_TAG_OPEN && tag < KK_TAG_LAST) return KK_STATS_TAGS + (kk_ssize_t)(tag - KK_TAG_OPEN);
+  return KK_STATS_TAG_COUNT - 1;
+}
+#define kk_stats_count(ctx,field)        ((ctx)->stats.field++)
+#define kk_stats_alloc(tag,ctx)          ((ctx)->stats.allocs[kk_stats_tag_index(tag)]++)
+#define kk_stats_free(tag,ctx)           ((ctx)->stats.frees[kk_stats_tag_index(tag)]++)
+#else
+#define kk_stats_count(ctx,field)        ((void)0)
+#define kk_stats_alloc(tag,ctx)          ((void)0)
+#define kk_stats_free(tag,ctx)           ((void)0)
+#endif
+
+kk_decl_export void kk_stats_enable(const char* fname);
+kk_decl_export void kk_stats_merge(kk_context_t* ctx);
+kk_decl_export void kk_stats_done(void);
+kk_decl_export void kk_tag_name(kk_tag_t tag, char* buf, size_t bufsize);
+
+/*--------------------------------------------------------------------------------------
+  Heap profiling
+  An allocation is sampled every `rate` allocated bytes (see `--kkheapprof` and `heapprof.c`).
+  The fast path is a single decrement of the countdown in the context.
+--------------------------------------------------------------------------------------*/
+
+kk_decl_export kk_decl_noinline void kk_heapprof_sample(kk_ssize_t size, kk_tag_t tag, kk_context_t* ctx);
+kk_decl_export void       kk_heapprof_enable(const char* fname, kk_ssize_t rate);
+kk_decl_export kk_ssize_t kk_heapprof_countdown(void);   // initial countdown for a context
+kk_decl_export bool       kk_heapprof_dump(void);
+kk_decl_export void       kk_heapprof_done(void);
+kk_decl_export void       kk_heapprof_disable(void);
+
+static inline void kk_heapprof_count(kk_ssize_t size, kk_tag_t tag, kk_context_t* ctx) {
+  if (kk_unlikely((ctx->heap_sample_countdown -= size) < 0)) { kk_heapprof_sample(size, tag, ctx); }
+}
+
+/*--------------------------------------------------------------------------------------
+  Allocator options (see `--kkmem` and `mem.c`)
+--------------------------------------------------------------------------------------*/
+
+kk_decl_export bool kk_mem_options(const char* opts);      // apply a comma separated option list
+kk_decl_export bool kk_mem_is_tuned(void);
+kk_decl_export void kk_mem_thread_init(kk_ssize_t worker); // bind a worker thread to its NUMA node (if enabled)
+kk_decl_export void kk_mem_print_text(FILE* out);
+kk_decl_export void kk_mem_print_json(FILE* out);
+
 /*--------------------------------------------------------------------------------------
   Allocation
 --------------------------------------------------------------------------------------*/
@@ -431,22 +564,55 @@ static inline void kk_free_local(const void* p) {
 }
 #endif
 
+#if KK_MALLOC_USABLE_SIZE
+#if defined(KK_MIMALLOC)
+static inline size_t kk_malloc_usable_size(const void* p) {
+  return mi_usable_size(p);
+}
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+static inline size_t kk_malloc_usable_size(const void* p) {
+  return malloc_size(p);
+}
+#elif defined(_WIN32)
+#include <malloc.h>
+static inline size_t kk_malloc_usable_size(const void* p) {
+  return _msize((void*)p);
+}
+#else
+#include <malloc.h>
+static inline size_t kk_malloc_usable_size(const void* p) {
+  return malloc_usable_size((void*)p);
+}
+#endif
+#endif
 
-static inline void kk_block_init(kk_block_t* b, kk_ssize_t size, kk_ssize_t scan_fsize, kk_tag_t tag) {
+
+// The free cache size class of an allocation of `size` bytes (or 0 if it is not cached)
+static inline uint8_t kk_block_size_class(kk_ssize_t size) {
+#if KK_FREE_CACHE
+  return (size >= 8 && size <= 8*KK_FREE_CACHE_BINS ? (uint8_t)(size/8) : 0);
+#else
   KK_UNUSED(size);
+  return 0;
+#endif
+}
+
+static inline void kk_block_init(kk_block_t* b, kk_ssize_t size, kk_ssize_t scan_fsize, kk_tag_t tag) {
   kk_assert_internal(scan_fsize >= 0 && scan_fsize < KK_SCAN_FSIZE_MAX);
 #if (KK_ARCH_LITTLE_ENDIAN)
-  // explicit shifts lead to better codegen
-  *((uint64_t*)b) = ((uint64_t)scan_fsize | (uint64_t)tag << 16);                    
+  // explicit shifts lead to better codegen (and `size` is usually a constant)
+  *((uint64_t*)b) = ((uint64_t)scan_fsize | (uint64_t)kk_block_size_class(size) << 10 | (uint64_t)tag << 16);
+  kk_assert_internal(b->header.size_class == kk_block_size_class(size) && b->header.arena == 0);
 #else
-  kk_header_t header = { (uint8_t)scan_fsize, 0, (uint16_t)tag, 0 };
+  kk_header_t header = { (uint8_t)scan_fsize, 0, 0, kk_block_size_class(size), (uint16_t)tag, 0 };
   b->header = header;
 #endif
 }
 
 static inline void kk_block_large_init(kk_block_large_t* b, kk_ssize_t size, kk_ssize_t scan_fsize, kk_tag_t tag) {
   KK_UNUSED(size);
-  kk_header_t header = { KK_SCAN_FSIZE_MAX, 0, (uint16_t)tag, 0 };
+  kk_header_t header = { KK_SCAN_FSIZE_MAX, 0, 0, 0, (uint16_t)tag, 0 };
   b->_block.header = header;
   b->large_scan_fsize = kk_int_box(scan_fsize);
 }
@@ -455,43 +621,124 @@ typedef kk_block_t* kk_reuse_t;
 
 #define kk_reuse_null  ((kk_reuse_t)NULL)
 
+// Continue freeing blocks on the `delayed_free` list (with a fresh budget)
+kk_decl_export void kk_block_drop_free_pending(kk_context_t* ctx);
+
+// The maximal number of blocks freed per drop for new contexts (0 for unbounded, see `--kkfree-budget`)
+kk_decl_export void       kk_free_set_budget(kk_ssize_t budget);
+kk_decl_export kk_ssize_t kk_free_budget(void);
+
+// Free cached blocks of a size class back to the allocator until at most `keep` blocks are left
+kk_decl_export void kk_block_free_cache_drain(kk_ssize_t bin, kk_ssize_t keep, kk_context_t* ctx);
+
+// Allocate a small block; first try the free cache of the context.
+// (A block in size class `bin` has a usable size of at least `8*bin` bytes.)
+static inline void* kk_block_malloc_small(kk_ssize_t size, kk_context_t* ctx) {
+#if KK_FREE_CACHE
+  const kk_ssize_t bin = (size + 7)/8;
+  if (kk_likely(bin <= KK_FREE_CACHE_BINS)) {
+    kk_block_t* b = ctx->free_cache[bin];
+    if (kk_likely(b != NULL)) {
+      ctx->free_cache[bin] = *((kk_block_t**)b);  // the next block is stored in the header
+      ctx->free_cache_count[bin]--;
+      return b;
+    }
+  }
+#endif
+  return kk_malloc_small(size, ctx);
+}
+
+/*--------------------------------------------------------------------------------------
+  Arenas
+  While an arena is active (after `kk_arena_enter`) all blocks are bump allocated in it and
+  have the `arena` bit set in their header. Freeing such block only marks it as dead;
+  the memory of the arena is released at once when it is left (see `arena.c`).
+--------------------------------------------------------------------------------------*/
+
+#define KK_ARENA_DEAD  KU32(0xFFFFFFFF)  // the reference count of a freed block in an arena
+
+typedef struct kk_arena_s kk_arena_t;
+
+kk_decl_export void        kk_arena_enter(kk_context_t* ctx);
+kk_decl_export kk_box_t    kk_arena_leave(kk_box_t result, kk_context_t* ctx);
+kk_decl_export kk_arena_t* kk_arena_leave_keep(kk_context_t* ctx);
+kk_decl_export void        kk_arena_free(kk_arena_t* arena, kk_context_t* ctx);
+kk_decl_export kk_decl_noinline kk_block_t* kk_arena_block_alloc_at(kk_reuse_t at, kk_ssize_t size, kk_ssize_t scan_fsize, kk_tag_t tag, kk_context_t* ctx);
+kk_decl_export kk_decl_noinline kk_block_large_t* kk_arena_block_large_alloc(kk_ssize_t size, kk_ssize_t scan_fsize, kk_tag_t tag, kk_context_t* ctx);
+kk_decl_export kk_decl_noinline kk_block_t* kk_arena_block_realloc(kk_block_t* b, kk_ssize_t size, kk_context_t* ctx);
+
+static inline bool kk_block_is_arena(const kk_block_t* b) {
+  return (b->header.arena != 0);
+}
+
 static inline kk_block_t* kk_block_alloc_at(kk_reuse_t at, kk_ssize_t size, kk_ssize_t scan_fsize, kk_tag_t tag, kk_context_t* ctx) {
   kk_assert_internal(scan_fsize >= 0 && scan_fsize < KK_SCAN_FSIZE_MAX);
+  if (kk_unlikely(ctx->arena != NULL)) return kk_arena_block_alloc_at(at, size, scan_fsize, tag, ctx);
   kk_block_t* b;
   if (at==kk_reuse_null) {
-    b = (kk_block_t*)kk_malloc_small(size, ctx);
+    if (kk_unlikely(ctx->delayed_free != NULL)) {
+      kk_block_drop_free_pending(ctx);  // only with a `free_budget`: finish freeing incrementally
+    }
+    b = (kk_block_t*)kk_block_malloc_small(size, ctx);
+    kk_heapprof_count(size, tag, ctx);
   }
   else {
     kk_assert_internal(kk_block_is_unique(at)); // TODO: check usable size of `at`
+    if (kk_unlikely(kk_block_is_arena(at))) return kk_arena_block_alloc_at(at, size, scan_fsize, tag, ctx);  // stays in a kept arena
     b = at;
+    kk_stats_count(ctx,reuses);
+    // the tag of `at` may have been cleared already (in which case it was counted as freed)
+    if (kk_block_tag(b) != KK_TAG_INVALID) { kk_stats_free(kk_block_tag(b),ctx); }
   }
+  kk_stats_alloc(tag,ctx);
   kk_block_init(b, size, scan_fsize, tag);
   return b;
 }
 
 static inline kk_block_t* kk_block_alloc(kk_ssize_t size, kk_ssize_t scan_fsize, kk_tag_t tag, kk_context_t* ctx) {
   kk_assert_internal(scan_fsize >= 0 && scan_fsize < KK_SCAN_FSIZE_MAX);
-  kk_block_t* b = (kk_block_t*)kk_malloc_small(size, ctx);
+  if (kk_unlikely(ctx->arena != NULL)) return kk_arena_block_alloc_at(kk_reuse_null, size, scan_fsize, tag, ctx);
+  if (kk_unlikely(ctx->delayed_free != NULL)) {
+    kk_block_drop_free_pending(ctx);  // only with a `free_budget`: finish freeing incrementally
+  }
+  kk_block_t* b = (kk_block_t*)kk_block_malloc_small(size, ctx);
+  kk_heapprof_count(size, tag, ctx);
+  kk_stats_alloc(tag,ctx);
   kk_block_init(b, size, scan_fsize, tag);
   return b;
 }
 
 static inline kk_block_t* kk_block_alloc_any(kk_ssize_t size, kk_ssize_t scan_fsize, kk_tag_t tag, kk_context_t* ctx) {
   kk_assert_internal(scan_fsize >= 0 && scan_fsize < KK_SCAN_FSIZE_MAX);
+  if (kk_unlikely(ctx->arena != NULL)) return kk_arena_block_alloc_at(kk_reuse_null, size, scan_fsize, tag, ctx);
+  if (kk_unlikely(ctx->delayed_free != NULL)) {
+    kk_block_drop_free_pending(ctx);
+  }
   kk_block_t* b = (kk_block_t*)kk_malloc(size, ctx);
+  kk_heapprof_count(size, tag, ctx);
+  kk_stats_alloc(tag,ctx);
   kk_block_init(b, size, scan_fsize, tag);
   return b;
 }
 
 static inline kk_block_large_t* kk_block_large_alloc(kk_ssize_t size, kk_ssize_t scan_fsize, kk_tag_t tag, kk_context_t* ctx) {
+  if (kk_unlikely(ctx->arena != NULL)) return kk_arena_block_large_alloc(size, scan_fsize, tag, ctx);
+  if (kk_unlikely(ctx->delayed_free != NULL)) {
+    kk_block_drop_free_pending(ctx);
+  }
   kk_block_large_t* b = (kk_block_large_t*)kk_malloc(size + 1 /* the scan_large_fsize field */, ctx);
+  kk_heapprof_count(size, tag, ctx);
+  kk_stats_alloc(tag,ctx);
   kk_block_large_init(b, size, scan_fsize, tag);
   return b;
 }
 
 static inline kk_block_t* kk_block_realloc(kk_block_t* b, kk_ssize_t size, kk_context_t* ctx) {
   kk_assert_internal(kk_block_is_unique(b));
-  return (kk_block_t*)kk_realloc(b, size, ctx);
+  if (kk_unlikely(kk_block_is_arena(b))) return kk_arena_block_realloc(b, size, ctx);
+  b = (kk_block_t*)kk_realloc(b, size, ctx);
+  if (b != NULL) { b->header.size_class = kk_block_size_class(size); }
+  return b;
 }
 
 static inline kk_block_t* kk_block_assertx(kk_block_t* b, kk_tag_t tag) {
@@ -500,8 +747,28 @@ static inline kk_block_t* kk_block_assertx(kk_block_t* b, kk_tag_t tag) {
   return b;
 }
 
-static inline void kk_block_free(kk_block_t* b) {
+// Free a block; small blocks are pushed on the free cache of the context (and reused by `kk_block_malloc_small`)
+static inline void kk_block_free(kk_block_t* b, kk_context_t* ctx) {
+#if KK_STATS
+  if (kk_block_tag(b) != KK_TAG_INVALID) { kk_stats_free(kk_block_tag(b), ctx); }  // a cleared tag was counted already
+#endif
   kk_block_set_invalid(b);
+  if (kk_unlikely(kk_block_is_arena(b))) {
+    b->header.refcount = KK_ARENA_DEAD;  // released with the arena
+    return;
+  }
+#if KK_FREE_CACHE
+  const kk_ssize_t bin = b->header.size_class;
+  if (kk_likely(bin != 0)) {
+    if (kk_unlikely(ctx->free_cache_count[bin] >= KK_FREE_CACHE_MAX)) {
+      kk_block_free_cache_drain(bin, KK_FREE_CACHE_MAX/2, ctx);   // past the water mark
+    }
+    *((kk_block_t**)b) = ctx->free_cache[bin];
+    ctx->free_cache[bin] = b;
+    ctx->free_cache_count[bin]++;
+    return;
+  }
+#endif
   kk_free(b);
 }
 
@@ -519,8 +786,31 @@ static inline void kk_block_free(kk_block_t* b) {
 kk_decl_export void        kk_block_check_drop(kk_block_t* b, uint32_t rc, kk_context_t* ctx);
 kk_decl_export void        kk_block_check_decref(kk_block_t* b, uint32_t rc, kk_context_t* ctx);
 kk_decl_export kk_block_t* kk_block_check_dup(kk_block_t* b, uint32_t rc);
+kk_decl_export kk_block_t* kk_block_check_dupn(kk_block_t* b, uint32_t rc, kk_ssize_t n);
 kk_decl_export kk_reuse_t  kk_block_check_drop_reuse(kk_block_t* b, uint32_t rc0, kk_context_t* ctx);
 
+// Drop a block, freeing it on the reclaimer thread if it is unique (see `refcount.c`)
+kk_decl_export void        kk_block_drop_reclaim(kk_block_t* b, kk_context_t* ctx);
+kk_decl_export void        kk_block_free_raw(kk_block_t* b);
+
+typedef void (kk_reclaim_defer_fun_t)(kk_block_t* b, void* arg);
+kk_decl_export kk_ssize_t  kk_block_reclaim_free(kk_block_t* todo, kk_reclaim_defer_fun_t* defer, void* arg, kk_context_t* ctx);
+
+// Mark a block and everything reachable from it as thread shared (so it uses atomic reference counts)
+kk_decl_export void        kk_block_mark_shared(kk_block_t* b, kk_context_t* ctx);
+
+// Freeze a block and everything reachable from it: it becomes immortal (and thread shared) and
+// reference count operations on it no longer write to the header.
+kk_decl_export void        kk_block_freeze(kk_block_t* b, kk_context_t* ctx);
+
+static inline bool kk_block_is_frozen(const kk_block_t* b) {
+  return (b->header.refcount >= KU32(0xE0000000));  // RC_STICKY_HI (see `refcount.c`)
+}
+
+static inline bool kk_block_is_thread_shared(const kk_block_t* b) {
+  return (b->header.thread_shared != 0);
+}
+
 
 static inline kk_block_t* kk_block_dup(kk_block_t* b) {
   kk_assert_internal(kk_block_is_valid(b));
@@ -534,10 +824,24 @@ static inline kk_block_t* kk_block_dup(kk_block_t* b) {
   }
 }
 
+// Increment the reference count by `n >= 0` in one go
+static inline kk_block_t* kk_block_dupn(kk_block_t* b, kk_ssize_t n) {
+  kk_assert_internal(kk_block_is_valid(b));
+  kk_assert_internal(n >= 0);
+  const uint32_t rc = b->header.refcount;
+  if (kk_likely((int32_t)rc >= 0 && (uint64_t)rc + (uint64_t)n < KU64(0x80000000))) {  // stays in the single threaded range
+    b->header.refcount = rc + (uint32_t)n;
+    return b;
+  }
+  else {
+    return kk_block_check_dupn(b, rc, n);  // thread-shared, sticky, or overflows?
+  }
+}
+
 static inline void kk_block_drop(kk_block_t* b, kk_context_t* ctx) {
   kk_assert_internal(kk_block_is_valid(b));
   const uint32_t rc = b->header.refcount;
-  if ((int32_t)(rc > 0)) {          // note: assume two's complement
+  if ((int32_t)rc > 0) {          // note: assume two's complement
     b->header.refcount = rc-1;
   }
   else {
@@ -548,7 +852,7 @@ static inline void kk_block_drop(kk_block_t* b, kk_context_t* ctx) {
 static inline void kk_block_decref(kk_block_t* b, kk_context_t* ctx) {
   kk_assert_internal(kk_block_is_valid(b));
   const uint32_t rc = b->header.refcount;  
-  if (kk_likely((int32_t)(rc > 0))) {     // note: assume two's complement
+  if (kk_likely((int32_t)rc > 0)) {     // note: assume two's complement
     b->header.refcount = rc - 1;
   }
   else {
@@ -581,7 +885,7 @@ static inline void kk_block_dropi(kk_block_t* b, kk_context_t* ctx) {
     for (kk_ssize_t i = 0; i < scan_fsize; i++) {
       kk_box_drop(kk_block_field(b, i), ctx);
     }
-    kk_block_free(b);
+    kk_block_free(b,ctx);
   }
   else if (kk_unlikely((int32_t)rc < 0)) {     // note: assume two's complement
     kk_block_check_drop(b, rc, ctx);           // thread-share or sticky (overflowed) ?    
@@ -617,7 +921,7 @@ static inline void kk_block_dropn(kk_block_t* b, kk_ssize_t scan_fsize, kk_conte
     for (kk_ssize_t i = 0; i < scan_fsize; i++) {
       kk_box_drop(kk_block_field(b, i), ctx);
     }
-    kk_block_free(b);
+    kk_block_free(b,ctx);
   }
   else if (kk_unlikely((int32_t)rc < 0)) {
     kk_block_check_drop(b, rc, ctx); // thread-shared, sticky (overflowed)?
@@ -664,10 +968,9 @@ static inline kk_block_t* kk_block_dup_assert(kk_block_t* b, kk_tag_t tag) {
 }
 
 static inline void kk_reuse_drop(kk_reuse_t r, kk_context_t* ctx) {
-  KK_UNUSED(ctx);
   if (r != NULL) {
     kk_assert_internal(kk_block_is_unique(r));
-    kk_free(r);
+    kk_block_free(r,ctx);
   }
 }
 
@@ -686,7 +989,7 @@ static inline void kk_reuse_drop(kk_reuse_t r, kk_context_t* ctx) {
 #define kk_basetype_has_tag(v,t)               (kk_block_has_tag(&((v)->_block),t))
 #define kk_basetype_is_unique(v)               (kk_block_is_unique(&((v)->_block)))
 #define kk_basetype_as(tp,v)                   (kk_block_as(tp,&((v)->_block)))
-#define kk_basetype_free(v)                    (kk_block_free(&((v)->_block)))
+#define kk_basetype_free(v,ctx)                (kk_block_free(&((v)->_block),ctx))
 #define kk_basetype_decref(v,ctx)              (kk_block_decref(&((v)->_block),ctx))
 #define kk_basetype_dup_as(tp,v)               ((tp)kk_block_dup(&((v)->_block)))
 #define kk_basetype_drop(v,ctx)                (kk_block_dropi(&((v)->_block),ctx))
@@ -700,7 +1003,7 @@ static inline void kk_reuse_drop(kk_reuse_t r, kk_context_t* ctx) {
 
 #define kk_constructor_tag(v)                  (kk_basetype_tag(&((v)->_base)))
 #define kk_constructor_is_unique(v)            (kk_basetype_is_unique(&((v)->_base)))
-#define kk_constructor_free(v)                 (kk_basetype_free(&((v)->_base)))
+#define kk_constructor_free(v,ctx)             (kk_basetype_free(&((v)->_base),ctx))
 #define kk_constructor_dup_as(tp,v)            (kk_basetype_dup_as(tp, &((v)->_base)))
 #define kk_constructor_drop(v,ctx)             (kk_basetype_drop(&((v)->_base),ctx))
 #define kk_constructor_dropn_reuse(v,n,ctx)    (kk_basetype_dropn_reuse(&((v)->_base),n,ctx))
@@ -810,9 +1113,9 @@ static inline kk_reuse_t kk_datatype_reuse(kk_datatype_t d) {
   }
 }
 
-static inline void kk_datatype_free(kk_datatype_t d) {
+static inline void kk_datatype_free(kk_datatype_t d, kk_context_t* ctx) {
   if (kk_datatype_is_ptr(d)) {
-    kk_free(d.ptr);
+    kk_block_free(d.ptr,ctx);
   }
 }
 
@@ -851,7 +1154,7 @@ static inline void kk_datatype_decref(kk_datatype_t d, kk_context_t* ctx) {
 // 2. otherwise, duplicate the used fields, and drop the constructor
 #define kk_drop_match(con,dups,drops,ctx) \
   if (kk_constructor_is_unique(con)) { \
-    do drops while(0); kk_free(con); \
+    do drops while(0); kk_constructor_free(con,ctx); \
   } else { \
     do dups while(0); kk_constructor_drop(con,ctx); \
   }
@@ -885,6 +1188,8 @@ typedef enum kk_unit_e {
 #include "kklib/string.h"
 #include "kklib/random.h"
 #include "kklib/os.h"
+#include "kklib/task.h"
+#include "kklib/async.h"
 
 /*----------------------------------------------------------------------
   TLD operations
@@ -939,6 +1244,11 @@ static inline kk_value_tag_t kk_value_tag(kk_uintx_t tag) {
 kk_function_t kk_function_id(kk_context_t* ctx);
 kk_function_t kk_function_null(kk_context_t* ctx);
 
+// Continuation compositions (see `compose.c`)
+kk_decl_export kk_function_t kk_function_compose(kk_function_t* conts, kk_ssize_t count, kk_context_t* ctx);
+kk_decl_export void          kk_function_compose_done(kk_context_t* ctx);
+kk_decl_export kk_box_t      kk_yield_extend(kk_function_t next, kk_context_t* ctx);
+
 static inline kk_function_t kk_function_unbox(kk_box_t v) {
   return kk_basetype_unbox_as_assert(kk_function_t, v, KK_TAG_FUNCTION);
 }
@@ -1006,6 +1316,7 @@ static inline kk_vector_t kk_vector_alloc_uninit(kk_ssize_t length, kk_box_t** b
 
 kk_decl_export void        kk_vector_init_borrow(kk_vector_t _v, kk_ssize_t start, kk_box_t def, kk_context_t* ctx);
 kk_decl_export kk_vector_t kk_vector_realloc(kk_vector_t vec, kk_ssize_t newlen, kk_box_t def, kk_context_t* ctx);
+kk_decl_export kk_vector_t kk_vector_push(kk_vector_t vec, kk_box_t x, kk_context_t* ctx);  // in-place (amortized) if `vec` is unique
 
 static inline kk_vector_t kk_vector_alloc(kk_ssize_t length, kk_box_t def, kk_context_t* ctx) {
   kk_vector_t v = kk_vector_alloc_uninit(length, NULL, ctx);
@@ -1059,6 +1370,8 @@ static inline kk_vector_t kk_vector_unbox(kk_box_t v, kk_context_t* ctx) {
   return kk_datatype_unbox(v);
 }
 
+#include "kklib/uvector.h"    // Unboxed vectors (uses `kk_vector_t`)
+
 
  
 /*--------------------------------------------------------------------------------------
@@ -1069,8 +1382,15 @@ typedef struct kk_ref_s {
   _Atomic(uintptr_t) value;   // kk_box_t
 } *kk_ref_t;
 
-kk_decl_export kk_box_t  kk_ref_get_thread_shared(kk_ref_t r, kk_context_t* ctx);
-kk_decl_export kk_box_t  kk_ref_swap_thread_shared(kk_ref_t r, kk_box_t value, kk_context_t* ctx);
+// Thread-shared references are read without writing to the reference; replaced values are
+// kept alive until concurrent readers are done (using epoch based reclamation, see `ref.c`)
+kk_decl_export kk_box_t     kk_ref_get_thread_shared(kk_ref_t r, kk_context_t* ctx);
+kk_decl_export kk_box_t     kk_ref_swap_thread_shared(kk_ref_t r, kk_box_t value, kk_context_t* ctx);
+kk_decl_export kk_unit_t    kk_ref_modify_thread_shared(kk_ref_t r, kk_function_t f, kk_context_t* ctx);
+kk_decl_export kk_integer_t kk_ref_fetch_add_thread_shared(kk_ref_t r, kk_integer_t delta, kk_context_t* ctx);
+kk_decl_export kk_unit_t    kk_ref_vector_assign_thread_shared(kk_ref_t r, kk_integer_t idx, kk_box_t value, kk_context_t* ctx);
+kk_decl_export void         kk_ref_collect(kk_context_t* ctx);
+kk_decl_export void         kk_ref_context_done(kk_context_t* ctx);
 
 static inline kk_box_t kk_ref_box(kk_ref_t r, kk_context_t* ctx) {
   KK_UNUSED(ctx);
@@ -1148,9 +1468,43 @@ static inline kk_unit_t kk_ref_vector_assign(kk_ref_t r, kk_integer_t idx, kk_bo
   }
   else {
     // thread shared
-    kk_unsupported_external("kk_ref_vector_assign with a thread-shared reference");
+    return kk_ref_vector_assign_thread_shared(r, idx, value, ctx);
+  }
+}
+
+// Update the value of a reference with a total function; if the reference
+// is thread-shared, `f` may be called more than once (when another thread updated it in between).
+static inline kk_unit_t kk_ref_modify(kk_ref_t r, kk_function_t f, kk_context_t* ctx) {
+  if (kk_likely(r->_block.header.thread_shared == 0)) {
+    // fast path
+    kk_box_t b; b.box = kk_atomic_load_relaxed(&r->value);
+    b = kk_function_call(kk_box_t, (kk_function_t, kk_box_t, kk_context_t*), f, (f, b, ctx));
+    kk_atomic_store_relaxed(&r->value, b.box);
+    kk_ref_drop(r, ctx);
     return kk_Unit;
   }
+  else {
+    // thread shared
+    return kk_ref_modify_thread_shared(r, f, ctx);
+  }
+}
+
+// Add `delta` to a reference holding an integer and return the previous value;
+// atomic (and lock-free for small integers) if the reference is thread-shared.
+static inline kk_integer_t kk_ref_fetch_add(kk_ref_t r, kk_integer_t delta, kk_context_t* ctx) {
+  if (kk_likely(r->_block.header.thread_shared == 0)) {
+    // fast path
+    kk_box_t b; b.box = kk_atomic_load_relaxed(&r->value);
+    kk_integer_t i = kk_integer_unbox(b);
+    kk_integer_t x = kk_integer_add(kk_integer_dup(i), delta, ctx);
+    kk_atomic_store_relaxed(&r->value, kk_integer_box(x).box);
+    kk_ref_drop(r, ctx);
+    return i;
+  }
+  else {
+    // thread shared
+    return kk_ref_fetch_add_thread_shared(r, delta, ctx);
+  }
 }
 
 
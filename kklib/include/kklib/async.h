@@ -0,0 +1,37 @@
+#pragma once
+#ifndef KK_ASYNC_H
+#define KK_ASYNC_H
+
+/*---------------------------------------------------------------------------
+  Copyright 2021, Microsoft Research, Daan Leijen.
+
+  This is free software; you can redistribute it and/or modify it under the
+  terms of the Apache License, Version 2.0. A copy of the License can be
+  found in the LICENSE file at the root of this distribution.
+---------------------------------------------------------------------------*/
+
+/*--------------------------------------------------------------------------------------
+  Asynchronous I/O (see `async.c`)
+  Operations are queued on a per-thread event loop and submitted in batches by `kk_async_poll`:
+  on Linux with io_uring (one `io_uring_enter` call per batch), and otherwise with `poll`.
+  On completion the continuation is called as `cont(result, data)` where `result` is a
+  boxed `int` with the number of bytes transferred (or a negative error code), and `data` is
+  a boxed string with the bytes read (empty for other operations).
+  An `offset` of -1 uses the current file position (as for pipes and sockets).
+--------------------------------------------------------------------------------------*/
+
+#ifndef KK_ASYNC_ENTRIES
+#define KK_ASYNC_ENTRIES  (256)     // submission queue size (more operations are queued until there is room)
+#endif
+
+kk_decl_export void       kk_async_read(int fd, kk_ssize_t len, int64_t offset, kk_function_t cont, kk_context_t* ctx);
+kk_decl_export void       kk_async_write(int fd, kk_string_t data, int64_t offset, kk_function_t cont, kk_context_t* ctx);
+kk_decl_export void       kk_async_sleep(kk_msecs_t msecs, kk_function_t cont, kk_context_t* ctx);
+
+kk_decl_export kk_ssize_t kk_async_poll(bool wait, kk_context_t* ctx);   // submit and run completions; returns the number completed
+kk_decl_export void       kk_async_run(kk_context_t* ctx);               // poll until no operations are pending
+kk_decl_export kk_ssize_t kk_async_pending(kk_context_t* ctx);
+kk_decl_export bool       kk_async_uses_io_uring(kk_context_t* ctx);
+kk_decl_export void       kk_async_loop_done(kk_context_t* ctx);         // called when the context is freed
+
+#endif // include guard
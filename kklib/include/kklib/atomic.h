@@ -48,6 +48,11 @@
 #define kk_atomic_cas_strong_relaxed(p,exp,des) kk_atomic(compare_exchange_strong_explicit)(p,exp,des,kk_memory_order(relaxed),kk_memory_order(relaxed))
 #define kk_atomic_cas_strong_acq_rel(p,exp,des) kk_atomic(compare_exchange_strong_explicit)(p,exp,des,kk_memory_order(acq_rel),kk_memory_order(acquire))
 
+#define kk_atomic_cas_strong_seq_cst(p,exp,des) kk_atomic(compare_exchange_strong_explicit)(p,exp,des,kk_memory_order(seq_cst),kk_memory_order(relaxed))
+
+#define kk_atomic_fence_release()             kk_atomic(thread_fence)(kk_memory_order(release))
+#define kk_atomic_fence_seq_cst()             kk_atomic(thread_fence)(kk_memory_order(seq_cst))
+
 #define kk_atomic_inc32_relaxed(p)            kk_atomic_add32_relaxed(p,1)
 #define kk_atomic_dec32_relaxed(p)            kk_atomic_sub32_relaxed(p,1)
 #define kk_atomic_inc32_acq_rel(p)            kk_atomic_add32_acq_rel(p,1)
@@ -126,6 +131,11 @@ static inline bool kk_atomic_compare_exchange_weak_explicit(_Atomic(uintptr_t)*p
   *expected = prev;
   return false;
 }
+static inline void kk_atomic_thread_fence(kk_memory_order_t mo) {
+  KK_UNUSED(mo);
+  MemoryBarrier();
+}
+
 static inline bool kk_atomic_compare_exchange_strong_explicit(_Atomic(uintptr_t)*p, uintptr_t* expected, uintptr_t desired, kk_memory_order_t mo, kk_memory_order_t mofail) {
   return kk_atomic_compare_exchange_weak_explicit(p, expected, desired, mo, mofail);
 }
@@ -74,23 +74,24 @@ static inline uint64_t kk_bits_rotr64(uint64_t x, uint64_t shift) {
 }
 #else
 // most compilers translate these expressions to a direct rotation instruction
+// (the masks avoid undefined behavior on a full width shift when `shift == 0`)
 static inline uint16_t kk_bits_rotl16(uint16_t x, uint16_t shift) {
-  return (x << shift) | (x >> (16 - shift));
+  return (uint16_t)((x << (shift & 15)) | (x >> ((16 - shift) & 15)));
 }
 static inline uint16_t kk_bits_rotr16(uint16_t x, uint16_t shift) {
-  return (x >> shift) | (x << (16 - shift));
+  return (uint16_t)((x >> (shift & 15)) | (x << ((16 - shift) & 15)));
 }
 static inline uint32_t kk_bits_rotl32(uint32_t x, uint32_t shift) {
-  return (x << shift) | (x >> (32 - shift));
+  return (x << (shift & 31)) | (x >> ((32 - shift) & 31));
 }
 static inline uint32_t kk_bits_rotr32(uint32_t x, uint32_t shift) {
-  return (x >> shift) | (x << (32 - shift));
+  return (x >> (shift & 31)) | (x << ((32 - shift) & 31));
 }
 static inline uint64_t kk_bits_rotl64(uint64_t x, uint64_t shift) {
-  return (x << shift) | (x >> (64 - shift));
+  return (x << (shift & 63)) | (x >> ((64 - shift) & 63));
 }
 static inline uint64_t kk_bits_rotr64(uint64_t x, uint64_t shift) {
-  return (x >> shift) | (x << (64 - shift));
+  return (x >> (shift & 63)) | (x << ((64 - shift) & 63));
 }
 #endif
 
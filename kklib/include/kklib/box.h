@@ -31,6 +31,11 @@ platforms there are 2 strategies:
 Option (B) avoids allocating any double for boxing but has a cost in that 
 scanning memory for recursive free-ing is more expensive (to distinguish 
 pointers from doubles) so we default to option (A).
+It is impossible to encode every double in the 63 bits of a value, so
+option (A) must allocate for some doubles. On a benchmark boxing and unboxing
+signed doubles into a vector (`test_double_box`), (A2) is about 3x faster than (B),
+and (A1) is 7x slower (as it allocates half of them); (B) is only faster when most
+doubles are outside the range of (A2) (below 2^-511 or above 2^512).
 
 Using `x` for bytes, and `b` for bits, with `z` the least significant byte, we have:
 
@@ -80,7 +85,9 @@ On 64-bit, We can encode half of the doubles by saving 1 bit; There are two impl
                 On unboxing, we extend bit 1 to bit 0, which means we may lose up to 1 bit of the NaN payload.
 ----------------------------------------------------------------*/
 
+#ifndef KK_USE_NAN_BOX
 #define KK_USE_NAN_BOX   (0)                  // strategy A2 by default
+#endif
 //#define KK_USE_NAN_BOX   (KK_INTPTR_SIZE==8)  // strategy B is only possible on 64-bit platforms
 //#define KK_BOX_DOUBLE_IF_NEG (1)              // use strategy A1
 
@@ -132,11 +139,11 @@ static inline bool kk_box_is_any(kk_box_t b);
 
 
 #if !(KK_USE_NAN_BOX)
-double   kk_double_unbox_heap(kk_box_t b, kk_context_t* ctx);
-kk_box_t kk_double_box_heap(double d, kk_context_t* ctx);
+kk_decl_export double   kk_double_unbox_heap(kk_box_t b, kk_context_t* ctx);
+kk_decl_export kk_box_t kk_double_box_heap(double d, kk_context_t* ctx);
 #endif
 
-#if (KK_INTPTR_SIZE==8)
+#if (KK_INTPTR_SIZE==8) && (KK_USE_NAN_BOX || defined(KK_BOX_DOUBLE_IF_NEG))
 kk_box_t kk_double_box(double d, kk_context_t* ctx);
 double   kk_double_unbox(kk_box_t b, kk_context_t* ctx);
 #endif
@@ -168,6 +175,41 @@ static inline kk_box_t kk_int32_box(int32_t i, kk_context_t* ctx) {
   return kk_int_box(i);
 }
 
+#if !defined(KK_BOX_DOUBLE_IF_NEG)
+// Strategy (A2): rotate the exponent into the low bits and narrow it to 10 bits; only
+// doubles outside [2^-511,2^512) (that are not zero, subnormal, NaN, or infinity) go to the heap.
+// Inline and branch free except for that range check (which is predictable for most workloads).
+static inline kk_box_t kk_double_box(double d, kk_context_t* ctx) {
+  uint64_t u;
+  memcpy(&u, &d, sizeof(u));  // safe for C aliasing
+  u = kk_bits_rotl64(u, 12);
+  const uint64_t exp = u & 0x7FF;
+  const bool special = (((exp + 1) & 0x7FF) <= 1);  // zero, subnormal, NaN, or infinity: exp is 0 or 0x7FF
+  if (kk_unlikely(!special && (exp - 0x201) >= 0x3FE)) {
+    return kk_double_box_heap(d, ctx);
+  }
+  const uint64_t exp10 = (special ? (exp >> 1) : exp - 0x200);
+  kk_assert_internal(exp10 <= 0x3FF);
+  kk_box_t b = { ((u - exp) | (exp10 << 1) | 1) };
+  return b;
+}
+
+static inline double kk_double_unbox(kk_box_t b, kk_context_t* ctx) {
+  if (kk_unlikely(!kk_box_is_value(b))) {
+    return kk_double_unbox_heap(b, ctx);
+  }
+  // expand the 10-bit exponent to 11-bits again
+  uint64_t u = b.box;
+  const uint64_t exp10 = (u & 0x7FF) >> 1;
+  const bool special = (((exp10 + 1) & 0x3FF) <= 1);
+  const uint64_t exp = (special ? ((exp10 << 1) | (exp10 & 1)) : exp10 + 0x200);
+  u = kk_bits_rotr64((u & ~KU64(0x7FF)) | exp, 12);
+  double d;
+  memcpy(&d, &u, sizeof(d)); // safe for C aliasing: see <https://gist.github.com/shafik/848ae25ee209f698763cffee272a58f8#how-do-we-type-pun-correctly>
+  return d;
+}
+#endif
+
 
 //--------------------------------------------------------------
 // 64 bit, NaN boxing
@@ -341,10 +383,32 @@ static inline kk_box_t kk_box_dup(kk_box_t b) {
   return b;
 }
 
+// Duplicate `n >= 0` times in one go
+static inline kk_box_t kk_box_dupn(kk_box_t b, kk_ssize_t n) {
+  if (kk_box_is_ptr(b)) kk_block_dupn(kk_ptr_unbox(b), n);
+  return b;
+}
+
 static inline void kk_box_drop(kk_box_t b, kk_context_t* ctx) {
   if (kk_box_is_ptr(b)) kk_block_drop(kk_ptr_unbox(b), ctx);
 }
 
+// Mark a boxed value (and everything reachable from it) as thread shared before passing it to another thread.
+static inline void kk_box_mark_shared(kk_box_t b, kk_context_t* ctx) {
+  if (kk_box_is_ptr(b)) kk_block_mark_shared(kk_ptr_unbox(b), ctx);
+}
+
+// Drop a boxed value and free it on the reclaimer thread if this was the last reference.
+static inline void kk_box_drop_reclaim(kk_box_t b, kk_context_t* ctx) {
+  if (kk_box_is_ptr(b)) kk_block_drop_reclaim(kk_ptr_unbox(b), ctx);
+}
+
+// Freeze a boxed value (and everything reachable from it) for the rest of the process (see `refcount.c`).
+static inline kk_box_t kk_box_freeze(kk_box_t b, kk_context_t* ctx) {
+  if (kk_box_is_ptr(b)) kk_block_freeze(kk_ptr_unbox(b), ctx);
+  return b;
+}
+
 
 static inline kk_block_t* kk_block_unbox(kk_box_t v, kk_tag_t kk_expected_tag ) {
   KK_UNUSED_INTERNAL(kk_expected_tag);
@@ -552,7 +616,7 @@ static inline kk_ssize_t kk_ssize_unbox(kk_box_t b, kk_context_t* ctx) {
   else {
     kk_box_ssize_t s = kk_basetype_unbox_as_assert(kk_box_ssize_t, b, KK_TAG_SSIZE_T);
     kk_ssize_t i = s->value;
-    if (ctx != NULL) kk_basetype_free(s);
+    if (ctx != NULL) kk_basetype_free(s,ctx);
     return i;
   }
 }
@@ -581,10 +645,53 @@ static inline size_t kk_size_unbox(kk_box_t b, kk_context_t* ctx) {
   else {
     kk_box_size_t s = kk_basetype_unbox_as_assert(kk_box_size_t, b, KK_TAG_SIZE_T);
     size_t i = s->value;
-    if (ctx != NULL) kk_basetype_free(s);
+    if (ctx != NULL) kk_basetype_free(s,ctx);
+    return i;
+  }
+}
+
+
+// int64_t
+typedef struct kk_box_int64_s {
+  kk_block_t  _block;
+  int64_t     value;
+} *kk_box_int64_t;
+
+static inline kk_box_t kk_int64_box(int64_t i, kk_context_t* ctx) {
+  if (i >= KK_MIN_BOXED_INT && i <= KK_MAX_BOXED_INT) {
+    return kk_int_box((kk_intx_t)i);
+  }
+  else {
+    kk_box_int64_t b = kk_block_alloc_as(struct kk_box_int64_s, 0, KK_TAG_INT64, ctx);
+    b->value = i;
+    return kk_ptr_box(&b->_block);
+  }
+}
+
+static inline int64_t kk_int64_unbox(kk_box_t b, kk_context_t* ctx) {
+  if (kk_likely(_kk_box_is_value_fast(b))) {
+    return (int64_t)kk_int_unbox(b);
+  }
+  else {
+    kk_box_int64_t s = kk_basetype_unbox_as_assert(kk_box_int64_t, b, KK_TAG_INT64);
+    int64_t i = s->value;
+    if (ctx != NULL) kk_basetype_drop(s,ctx);
     return i;
   }
 }
 
+// uint8_t
+static inline uint8_t kk_uint8_unbox(kk_box_t b, kk_context_t* ctx) {
+  KK_UNUSED(ctx);
+  kk_intx_t i = kk_int_unbox(b);
+  kk_assert_internal((i >= 0 && i <= 255) || kk_box_is_any(b));
+  return (uint8_t)i;
+}
+
+static inline kk_box_t kk_uint8_box(uint8_t u, kk_context_t* ctx) {
+  KK_UNUSED(ctx);
+  return kk_int_box(u);
+}
+
 
 #endif // include guard
@@ -47,6 +47,7 @@ typedef struct kk_bytes_small_s {
 typedef struct kk_bytes_normal_s {
   struct kk_bytes_s _base;
   kk_ssize_t  length;
+  uint32_t    hash;                       // cached hash, or 0 if not yet computed (see `kk_bytes_hash_borrow`)
   uint8_t buf[1];                         // bytes in-place of `length+1` bytes ending in 0
 } *kk_bytes_normal_t;
 
@@ -59,8 +60,8 @@ typedef struct kk_bytes_raw_s {
 
 // Define bytes literals
 #define kk_define_bytes_literal(decl,name,len,init) \
-  static struct { struct kk_bytes_s _base; kk_ssize_t length; uint8_t buf[len+1]; } _static_##name = \
-    { { { KK_HEADER_STATIC(0,KK_TAG_BYTES) } }, len, init }; \
+  static struct { struct kk_bytes_s _base; kk_ssize_t length; uint32_t hash; uint8_t buf[len+1]; } _static_##name = \
+    { { { KK_HEADER_STATIC(0,KK_TAG_BYTES) } }, len, 0, init }; \
   decl kk_bytes_t name = { &_static_##name._base._block };  
 
 #define kk_define_bytes_literal_empty(decl,name) \
@@ -120,6 +121,18 @@ static inline kk_bytes_t kk_bytes_alloc_raw_len(kk_ssize_t len, const uint8_t* p
   return kk_datatype_from_base(&br->_base);
 }
 
+// Byte sequences of a single ascii byte are preallocated as static small bytes (see `bytes.c`).
+// These are sticky and never unique, so they are never updated in place.
+kk_decl_export struct kk_bytes_small_s kk_bytes_ascii[128];
+
+// Bytes of a single ascii byte `c` without allocating.
+static inline kk_bytes_t kk_bytes_from_ascii(uint8_t c, kk_context_t* ctx) {
+  kk_assert_internal(c < 0x80);
+  kk_stats_count(ctx, bytes_static);
+  KK_UNUSED(ctx);
+  return kk_datatype_from_base(&kk_bytes_ascii[c]._base);
+}
+
 // Get access to the bytes via a pointer (and retrieve the length as well)
 static inline const uint8_t* kk_bytes_buf_borrow(const kk_bytes_t b, kk_ssize_t* len) {
   static const uint8_t empty[16] = { 0 };
@@ -158,6 +171,49 @@ static inline const char* kk_bytes_cbuf_borrow(const kk_bytes_t b, kk_ssize_t* l
 }
 
 
+/*--------------------------------------------------------------------------------------------------
+  Views
+  A view is raw bytes that points into a part of normal or raw parent bytes which it keeps
+  alive, such that splitting or slicing a large input does not copy it. A view is not zero
+  terminated at its length (but the parent is, so zero terminated scans stay in bounds):
+  use `kk_bytes_ensure_terminated` before passing it as a C string.
+--------------------------------------------------------------------------------------------------*/
+
+typedef struct kk_bytes_view_s {
+  struct kk_bytes_s _base;
+  kk_free_fun_t* free;                    // always `kk_bytes_view_free` (overlaps `kk_bytes_raw_s`)
+  const uint8_t* cbuf;
+  kk_ssize_t     length;
+  kk_bytes_t     parent;                  // marked as thread shared as the view can be freed on any thread
+} *kk_bytes_view_t;
+
+// Parts of at least this many bytes are returned as a view instead of a copy
+#ifndef KK_BYTES_VIEW_MIN
+#define KK_BYTES_VIEW_MIN  (256)
+#endif
+
+kk_decl_export void       kk_bytes_view_free(void* p, kk_block_t* b);
+
+// The `len` bytes at `start` in (borrowed) `parent`: a view for large parts, and a copy otherwise
+// (and always a copy if `parent` is in an arena).
+kk_decl_export kk_bytes_t kk_bytes_alloc_view(kk_bytes_t parent, kk_ssize_t start, kk_ssize_t len, kk_context_t* ctx);
+
+static inline bool kk_bytes_is_view_borrow(kk_bytes_t b) {
+  return (kk_datatype_has_tag(b, KK_TAG_BYTES_RAW) &&
+          kk_datatype_as_assert(kk_bytes_raw_t, b, KK_TAG_BYTES_RAW)->free == &kk_bytes_view_free);
+}
+
+// Copy a view into normal bytes such that the bytes are zero terminated.
+static inline kk_bytes_t kk_bytes_ensure_terminated(kk_bytes_t b, kk_context_t* ctx) {
+  if (kk_likely(!kk_bytes_is_view_borrow(b))) return b;
+  kk_ssize_t len;
+  const uint8_t* p = kk_bytes_buf_borrow(b, &len);
+  kk_bytes_t t = kk_bytes_alloc_dupn(len, p, ctx);
+  kk_bytes_drop(b, ctx);
+  return t;
+}
+
+
 
 /*--------------------------------------------------------------------------------------------------
   Length, compare
@@ -179,8 +235,13 @@ static inline bool kk_bytes_is_empty(kk_bytes_t s, kk_context_t* ctx) {
   return (kk_bytes_len(s, ctx) == 0);
 }
 
+// Can `b` be updated in place? Raw bytes (including views) do not own their buffer.
+static inline bool kk_bytes_is_unique_owned(kk_bytes_t b) {
+  return (kk_datatype_is_unique(b) && !kk_datatype_has_tag(b, KK_TAG_BYTES_RAW));
+}
+
 static inline kk_bytes_t kk_bytes_copy(kk_bytes_t b, kk_context_t* ctx) {
-  if (kk_datatype_is_singleton(b) || kk_datatype_is_unique(b)) {
+  if (kk_datatype_is_singleton(b) || kk_bytes_is_unique_owned(b)) {
     return b;
   }
   else {
@@ -196,6 +257,37 @@ static inline bool kk_bytes_ptr_eq_borrow(kk_bytes_t b1, kk_bytes_t b2) {
   return (kk_datatype_eq(b1, b2));
 }
 
+// Hash of a byte sequence; never 0. The hash of normal bytes is cached in the block
+// so it is only computed once.
+kk_decl_export uint32_t kk_bytes_hash_borrow(kk_bytes_t b);
+
+static inline uint32_t kk_bytes_cached_hash_borrow(kk_bytes_t b) {
+  if (!kk_datatype_has_tag(b, KK_TAG_BYTES)) return 0;
+  kk_bytes_normal_t bn = kk_datatype_as_assert(kk_bytes_normal_t, b, KK_TAG_BYTES);
+  return kk_atomic_load_relaxed((_Atomic(uint32_t)*)&bn->hash);
+}
+
+// Clear the cached hash after updating unique bytes in place.
+static inline void kk_bytes_unsafe_clear_hash(kk_bytes_t b) {
+  if (kk_datatype_has_tag(b, KK_TAG_BYTES)) {
+    kk_assert_internal(kk_datatype_is_unique(b));
+    kk_datatype_as_assert(kk_bytes_normal_t, b, KK_TAG_BYTES)->hash = 0;
+  }
+}
+
+// Reuse the buffer of unique bytes as empty bytes to append to (see `kk_string_builder_t`).
+static inline kk_bytes_t kk_bytes_unsafe_reset(kk_bytes_t b, kk_context_t* ctx) {
+  if (kk_bytes_is_unique_owned(b) && kk_datatype_has_tag(b, KK_TAG_BYTES)) {
+    kk_bytes_normal_t bn = kk_datatype_as_assert(kk_bytes_normal_t, b, KK_TAG_BYTES);
+    bn->length = 0;
+    bn->hash = 0;
+    bn->buf[0] = 0;
+    return b;
+  }
+  kk_bytes_drop(b, ctx);
+  return kk_bytes_empty();
+}
+
 static inline bool kk_bytes_is_empty_borrow(kk_bytes_t b) {
   return (kk_bytes_len_borrow(b) == 0);
 }
@@ -203,25 +295,26 @@ static inline bool kk_bytes_is_empty_borrow(kk_bytes_t b) {
 kk_decl_export int kk_bytes_cmp_borrow(kk_bytes_t str1, kk_bytes_t str2);
 kk_decl_export int kk_bytes_cmp(kk_bytes_t str1, kk_bytes_t str2, kk_context_t* ctx);
 
-static inline bool kk_bytes_is_eq_borrow(kk_bytes_t s1, kk_bytes_t s2) {
-  return (kk_bytes_cmp_borrow(s1, s2) == 0);
-}
-static inline bool kk_bytes_is_neq_borrow(kk_bytes_t s1, kk_bytes_t s2) {
-  return (kk_bytes_cmp_borrow(s1, s2) != 0);
-}
-static inline bool kk_bytes_is_eq(kk_bytes_t s1, kk_bytes_t s2, kk_context_t* ctx) {
-  return (kk_bytes_cmp(s1, s2, ctx) == 0);
-}
-static inline bool kk_bytes_is_neq(kk_bytes_t s1, kk_bytes_t s2, kk_context_t* ctx) {
-  return (kk_bytes_cmp(s1, s2, ctx) != 0);
-}
-
 
 /*--------------------------------------------------------------------------------------------------
   Utilities
 --------------------------------------------------------------------------------------------------*/
 
-const uint8_t* kk_memmem(const uint8_t* p, kk_ssize_t plen, const uint8_t* pat, kk_ssize_t patlen);
+// A search for a pattern that is prepared once (with `kk_memsearch_init`) and used for many searches.
+typedef struct kk_memsearch_s {
+  const uint8_t* pat;
+  kk_ssize_t     patlen;
+  bool           reverse;   // find the last occurrence instead of the first
+  bool           periodic;  // the two-way factorization: `pat = u.v` with `|u| == ell+1`, and period `per`
+  kk_ssize_t     ell;
+  kk_ssize_t     per;
+} kk_memsearch_t;
+
+kk_decl_export void           kk_memsearch_init(kk_memsearch_t* ms, const uint8_t* pat, kk_ssize_t patlen, bool reverse);
+kk_decl_export const uint8_t* kk_memsearch_find(const kk_memsearch_t* ms, const uint8_t* p, kk_ssize_t plen);  // NULL if not found in `[p,p+plen)`
+
+kk_decl_export const uint8_t* kk_memmem(const uint8_t* p, kk_ssize_t plen, const uint8_t* pat, kk_ssize_t patlen);
+kk_decl_export const uint8_t* kk_memrmem(const uint8_t* p, kk_ssize_t plen, const uint8_t* pat, kk_ssize_t patlen);  // last occurrence
 
 static inline void kk_memcpy(void* dest, const void* src, kk_ssize_t len) {
   memcpy(dest, src, kk_to_size_t(len));
@@ -236,6 +329,34 @@ static inline int kk_memcmp(const void* s, const void* t, kk_ssize_t len) {
   return memcmp((const char*)s, (const char*)t, kk_to_size_t(len));
 }
 
+// Equality is a pointer test for shared (or interned) bytes, and if both hashes
+// are cached, bytes with a different hash are not compared.
+static inline bool kk_bytes_is_eq_borrow(kk_bytes_t b1, kk_bytes_t b2) {
+  if (kk_bytes_ptr_eq_borrow(b1, b2)) return true;
+  kk_ssize_t len1;
+  const uint8_t* s1 = kk_bytes_buf_borrow(b1, &len1);
+  kk_ssize_t len2;
+  const uint8_t* s2 = kk_bytes_buf_borrow(b2, &len2);
+  if (len1 != len2) return false;
+  const uint32_t h1 = kk_bytes_cached_hash_borrow(b1);
+  const uint32_t h2 = kk_bytes_cached_hash_borrow(b2);
+  if (h1 != h2 && h1 != 0 && h2 != 0) return false;
+  return (kk_memcmp(s1, s2, len1) == 0);
+}
+
+static inline bool kk_bytes_is_neq_borrow(kk_bytes_t b1, kk_bytes_t b2) {
+  return !kk_bytes_is_eq_borrow(b1, b2);
+}
+static inline bool kk_bytes_is_eq(kk_bytes_t b1, kk_bytes_t b2, kk_context_t* ctx) {
+  const bool eq = kk_bytes_is_eq_borrow(b1, b2);
+  kk_bytes_drop(b1, ctx);
+  kk_bytes_drop(b2, ctx);
+  return eq;
+}
+static inline bool kk_bytes_is_neq(kk_bytes_t b1, kk_bytes_t b2, kk_context_t* ctx) {
+  return !kk_bytes_is_eq(b1, b2, ctx);
+}
+
 
 kk_decl_export kk_ssize_t kk_decl_pure kk_bytes_count_pattern_borrow(kk_bytes_t str, kk_bytes_t pattern);
 
@@ -247,6 +368,7 @@ kk_decl_export kk_vector_t kk_bytes_splitv_atmost(kk_bytes_t s, kk_bytes_t sep,
 
 kk_decl_export kk_bytes_t kk_bytes_replace_all(kk_bytes_t s, kk_bytes_t pat, kk_bytes_t rep, kk_context_t* ctx);
 kk_decl_export kk_bytes_t kk_bytes_replace_atmost(kk_bytes_t s, kk_bytes_t pat, kk_bytes_t rep, kk_ssize_t n, kk_context_t* ctx);
+kk_decl_export kk_bytes_t kk_bytes_replace_many(kk_bytes_t s, kk_vector_t pats, kk_vector_t reps, kk_context_t* ctx);  // in a single pass
 
 kk_decl_export kk_bytes_t kk_bytes_repeat(kk_bytes_t s, kk_ssize_t n, kk_context_t* ctx);
 
@@ -251,6 +251,7 @@ static inline void kk_integer_drop(kk_integer_t i, kk_context_t* ctx) {
   if (kk_unlikely(kk_is_bigint(i))) { kk_block_drop(_kk_as_bigint(i), ctx); }
 }
 
+kk_decl_export void          kk_integer_init(void);  // select the digit kernels for this cpu (called from `kklib_init`)
 kk_decl_export bool          kk_integer_parse(const char* num, kk_integer_t* result, kk_context_t* ctx);
 kk_decl_export bool          kk_integer_hex_parse(const char* s, kk_integer_t* res, kk_context_t* ctx);
 kk_decl_export kk_integer_t  kk_integer_from_str(const char* num, kk_context_t* ctx); // for known correct string number (returns 0 on wrong string)
@@ -22,20 +22,71 @@ kk_decl_export kk_string_t kk_os_temp_dir(kk_context_t* ctx);
 kk_decl_export kk_vector_t kk_os_get_argv(kk_context_t* ctx);
 kk_decl_export kk_vector_t kk_os_get_env(kk_context_t* ctx);
 
+// Text files of at least this size are memory mapped when read (use 0 to never map files).
+#ifndef KK_OS_MMAP_MIN
+#define KK_OS_MMAP_MIN  (1024*1024)
+#endif
+
 kk_decl_export int  kk_os_read_text_file(kk_string_t path, kk_string_t* result, kk_context_t* ctx);
 kk_decl_export int  kk_os_write_text_file(kk_string_t path, kk_string_t content, kk_context_t* ctx);
 
+kk_decl_export int  kk_os_fd_open(kk_string_t path, bool writable, int* fd, kk_context_t* ctx);
+kk_decl_export int  kk_os_fd_close(int fd);
+
+// Buffered file streams
+#ifndef KK_OS_STREAM_BUFSIZE
+#define KK_OS_STREAM_BUFSIZE  (64*1024)
+#endif
+
+typedef struct kk_os_stream_s kk_os_stream_t;
+
+kk_decl_export int  kk_os_stream_open(kk_string_t path, bool writable, bool append, kk_ssize_t bufsize, kk_os_stream_t** stream, kk_context_t* ctx);
+kk_decl_export int  kk_os_stream_read(kk_os_stream_t* s, kk_ssize_t max, kk_string_t* chunk, kk_context_t* ctx);
+kk_decl_export int  kk_os_stream_read_line(kk_os_stream_t* s, kk_string_t* line, bool* eof, kk_context_t* ctx);
+kk_decl_export int  kk_os_stream_write(kk_os_stream_t* s, kk_string_t content, kk_context_t* ctx);
+kk_decl_export int  kk_os_stream_flush(kk_os_stream_t* s);
+kk_decl_export int  kk_os_stream_close(kk_os_stream_t* s, kk_context_t* ctx);
+kk_decl_export void kk_os_stream_free(void* s, kk_block_t* b);   // closes the stream if needed
+
 kk_decl_export int  kk_os_ensure_dir(kk_string_t dir, int mode, kk_context_t* ctx);
 kk_decl_export int  kk_os_copy_file(kk_string_t from, kk_string_t to, bool preserve_mtime, kk_context_t* ctx);
 kk_decl_export bool kk_os_is_directory(kk_string_t path, kk_context_t* ctx);
 kk_decl_export bool kk_os_is_file(kk_string_t path, kk_context_t* ctx);
 kk_decl_export int  kk_os_list_directory(kk_string_t dir, kk_vector_t* contents, kk_context_t* ctx);
 
+// Recursive (parallel) directory walk (see `os.c`)
+#define KK_OS_WALK_DONE   (0)
+#define KK_OS_WALK_FILE   (1)
+#define KK_OS_WALK_DIR    (2)
+#define KK_OS_WALK_LINK   (3)     // symbolic links are not followed
+#define KK_OS_WALK_OTHER  (4)
+
+typedef struct kk_os_walk_s kk_os_walk_t;
+
+kk_decl_export int  kk_os_walk_open(kk_string_t root, kk_ssize_t threads, kk_ssize_t max_depth, kk_os_walk_t** walk, kk_context_t* ctx);
+kk_decl_export int  kk_os_walk_next(kk_os_walk_t* w, kk_string_t* path, int* kind, kk_context_t* ctx);
+kk_decl_export void kk_os_walk_free(void* w, kk_block_t* b);
+
+// Processes
+#define KK_OS_PROCESS_STDIN   (1)   // create a pipe to the standard input of the child 
+#define KK_OS_PROCESS_STDOUT  (2)   // create a pipe from the standard output 
+#define KK_OS_PROCESS_STDERR  (4)   // create a pipe from the standard error (otherwise these are inherited)
+
+typedef struct kk_os_process_s kk_os_process_t;
+
+kk_decl_export int  kk_os_process_spawn(kk_string_t cmd, int pipes, kk_os_process_t** proc, kk_context_t* ctx);
+kk_decl_export int  kk_os_process_write(kk_os_process_t* p, kk_string_t data, kk_context_t* ctx);
+kk_decl_export int  kk_os_process_close_input(kk_os_process_t* p);
+kk_decl_export int  kk_os_process_read(kk_os_process_t* p, kk_ssize_t max, int* from, kk_string_t* chunk, kk_context_t* ctx);  // `*from`: 1 = stdout, 2 = stderr, 0 = done
+kk_decl_export int  kk_os_process_wait(kk_os_process_t* p, int* exitcode);
+kk_decl_export void kk_os_process_free(void* p, kk_block_t* b);
+
 kk_decl_export int  kk_os_run_command(kk_string_t cmd, kk_string_t* output, kk_context_t* ctx);
 kk_decl_export int  kk_os_run_system(kk_string_t cmd, kk_context_t* ctx);
 
 kk_decl_export double kk_timer_ticks(double* secs_frac, kk_context_t* ctx);
 kk_decl_export double kk_timer_resolution(kk_context_t* ctx);
+kk_decl_export bool   kk_timer_is_tsc(kk_context_t* ctx);  // using the (invariant) time stamp counter?
 
 kk_decl_export double kk_time_unix_now(double* secs_frac, kk_context_t* ctx);
 kk_decl_export double kk_time_resolution(kk_context_t* ctx);
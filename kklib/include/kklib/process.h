@@ -19,5 +19,31 @@ kk_usecs_t kk_timer_end(kk_timer_t start);
 void       kk_process_info(kk_msecs_t* utime, kk_msecs_t* stime, 
                            size_t* peak_rss, size_t* page_faults, size_t* page_reclaim, size_t* peak_commit);
 
+// Hardware performance counters (see `--kkperf`)
+typedef enum kk_perf_event_e {
+  KK_PERF_CYCLES,
+  KK_PERF_INSTRUCTIONS,
+  KK_PERF_CACHE_MISSES,
+  KK_PERF_BRANCH_MISSES,
+  KK_PERF_DTLB_MISSES,
+  KK_PERF_EVENT_COUNT
+} kk_perf_event_t;
+
+typedef struct kk_perf_counters_s {
+  int64_t events[KK_PERF_EVENT_COUNT];  // -1 if not available
+  int64_t page_faults;
+  int64_t page_reclaims;
+  int64_t peak_commit;
+  int64_t vol_switches;                 // context switches (-1 if not available)
+  int64_t invol_switches;
+} kk_perf_counters_t;
+
+bool        kk_perf_start(void);        // start counting (returns `false` if no hardware counters are available)
+void        kk_perf_read(kk_perf_counters_t* counters);
+const char* kk_perf_event_name(kk_perf_event_t ev);
+void        kk_perf_enable(const char* fname);
+bool        kk_perf_is_enabled(void);
+void        kk_perf_done(kk_usecs_t wall_time);
+
 
 #endif // include guard
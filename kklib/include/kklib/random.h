@@ -56,5 +56,40 @@ kk_decl_export int32_t  kk_srandom_range_int32(int32_t min, int32_t max, kk_cont
 kk_decl_export uint32_t kk_srandom_range_uint32(uint32_t max, kk_context_t* ctx);             // unbiased range
 kk_decl_export double   kk_srandom_double(kk_context_t* ctx);
 
+// Bulk generation: whole chacha20 blocks are computed several at a time (using SIMD where available)
+kk_decl_export void     kk_srandom_fill(void* buf, kk_ssize_t len, kk_context_t* ctx);             // `len` random bytes
+kk_decl_export void     kk_srandom_fill_double(double* buf, kk_ssize_t n, kk_context_t* ctx);      // `n` doubles in [0,1)
+
+// An explicit chacha20 generator, for example one per parallel task.
+// Split derives an independent child generator deterministically from the stream of its parent.
+kk_decl_export void     kk_chacha_init(kk_random_ctx_t* rnd, const uint8_t key[32], uint64_t nonce);
+kk_decl_export void     kk_chacha_fill(kk_random_ctx_t* rnd, void* buf, kk_ssize_t len);
+kk_decl_export void     kk_chacha_split(kk_random_ctx_t* rnd, kk_random_ctx_t* child);
+kk_decl_export void     kk_srandom_split(kk_random_ctx_t* child, kk_context_t* ctx);             // split from the context generator
+
+
+/*--------------------------------------------------------------------------------------
+  Deterministic pseudo random numbers. Fast but not secure.
+--------------------------------------------------------------------------------------*/
+
+// PCG by Melissa E. O'Neill
+typedef struct kk_pcg_ctx_s {
+  uint64_t state;
+  uint64_t stream; // must be odd
+} kk_pcg_ctx_t;
+
+// sfc32 by Chris Doty-Humphrey
+typedef struct kk_sfc_ctx_s {
+  uint32_t a;
+  uint32_t b;
+  uint32_t c;
+  uint32_t counter;
+} kk_sfc_ctx_t;
+
+kk_decl_export void     kk_pcg_init(uint64_t seed, uint64_t stream, kk_pcg_ctx_t* rnd);
+kk_decl_export void     kk_pcg_fill(kk_pcg_ctx_t* rnd, uint32_t* buf, kk_ssize_t n);
+kk_decl_export void     kk_sfc_init(uint64_t seed, kk_sfc_ctx_t* rnd);
+kk_decl_export void     kk_sfc_fill(kk_sfc_ctx_t* rnd, uint32_t* buf, kk_ssize_t n);
+
 
 #endif // include guard
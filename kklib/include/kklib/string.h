@@ -113,8 +113,8 @@ static inline kk_string_t kk_string_empty(void) {
 
 // Define string literals
 #define kk_define_string_literal(decl,name,len,chars) \
-  static struct { struct kk_bytes_s _base; size_t length; char str[len+1]; } _static_##name = \
-    { { { KK_HEADER_STATIC(0,KK_TAG_STRING) } }, len, chars }; \
+  static struct { struct kk_bytes_s _base; size_t length; uint32_t hash; char str[len+1]; } _static_##name = \
+    { { { KK_HEADER_STATIC(0,KK_TAG_STRING) } }, len, 0, chars }; \
   decl kk_string_t name = { { &_static_##name._base._block } };  
 
 #define kk_define_string_literal_empty(decl,name) \
@@ -200,6 +200,7 @@ static inline kk_string_t kk_unsafe_string_alloc_cbuf(kk_ssize_t len, char** buf
 static inline kk_string_t kk_string_alloc_dupn_valid_utf8(kk_ssize_t len, const uint8_t* s, kk_context_t* ctx) {
   kk_assert_internal(kk_utf8_is_validn(len, s));
   if (s == NULL || len == 0) return kk_string_empty();
+  if (len == 1 && s[0] < 0x80) return kk_unsafe_bytes_as_string(kk_bytes_from_ascii(s[0], ctx));
   return kk_unsafe_bytes_as_string(kk_bytes_alloc_dupn(len, s, ctx));
 }
 
@@ -234,6 +235,20 @@ static inline kk_string_t kk_string_alloc_raw(const char* s, bool free, kk_conte
   return kk_string_alloc_raw_len(kk_sstrlen(s), s, free, ctx);
 }
 
+// The `len` bytes at `start` in (borrowed) `str` as a view or copy (see `kk_bytes_alloc_view`).
+// The part must be valid utf-8.
+static inline kk_string_t kk_string_alloc_view(kk_string_t str, kk_ssize_t start, kk_ssize_t len, kk_context_t* ctx) {
+  kk_ssize_t slen;
+  const uint8_t* s = kk_bytes_buf_borrow(str.bytes, &slen);
+  if (len < KK_BYTES_VIEW_MIN && len < slen) return kk_string_alloc_dupn_valid_utf8(len, s + start, ctx);
+  return kk_unsafe_bytes_as_string(kk_bytes_alloc_view(str.bytes, start, len, ctx));
+}
+
+// Ensure a string is zero terminated at its length (by copying a view)
+static inline kk_string_t kk_string_ensure_terminated(kk_string_t str, kk_context_t* ctx) {
+  return kk_unsafe_bytes_as_string(kk_bytes_ensure_terminated(str.bytes, ctx));
+}
+
 static inline const uint8_t* kk_string_buf_borrow(const kk_string_t str, kk_ssize_t* len) {
   return kk_bytes_buf_borrow(str.bytes, len);  
 }
@@ -242,8 +257,14 @@ static inline const char* kk_string_cbuf_borrow(const kk_string_t str, kk_ssize_
   return (const char*)kk_string_buf_borrow(str, len);
 }
 
+// Compare up to the length of `s` as it may be a view that is not zero terminated
 static inline int kk_string_cmp_cstr_borrow(const kk_string_t s, const char* t) {
-  return strcmp(kk_string_cbuf_borrow(s,NULL), t);
+  kk_ssize_t slen;
+  const uint8_t* p = kk_string_buf_borrow(s, &slen);
+  const kk_ssize_t tlen = kk_sstrlen(t);
+  const int c = kk_memcmp(p, t, (slen < tlen ? slen : tlen));
+  if (c != 0 || slen == tlen) return c;
+  return (slen < tlen ? -1 : 1);
 }
 
 static inline kk_ssize_t kk_decl_pure kk_string_len_borrow(const kk_string_t str) {
@@ -406,6 +427,7 @@ static inline void kk_utf8_write(kk_char_t c, uint8_t* s, kk_ssize_t* count) {
   utf-8 string conversion to qutf8 and qutf16
 --------------------------------------------------------------------------------------------------*/
 
+kk_decl_export void           kk_string_init(void);  // select the utf-8 kernels for this cpu (called from `kklib_init`)
 kk_decl_export kk_string_t    kk_string_alloc_from_qutf8(const char* str, kk_context_t* ctx);
 kk_decl_export kk_string_t    kk_string_alloc_from_qutf8n(kk_ssize_t len, const char* str, kk_context_t* ctx);
 
@@ -447,21 +469,29 @@ static inline int kk_string_cmp(kk_string_t str1, kk_string_t str2, kk_context_t
 }
 
 static inline bool kk_string_is_eq_borrow(kk_string_t s1, kk_string_t s2) {
-  return (kk_string_cmp_borrow(s1, s2) == 0);
+  return kk_bytes_is_eq_borrow(s1.bytes, s2.bytes);
 }
 
 static inline bool kk_string_is_neq_borrow(kk_string_t s1, kk_string_t s2) {
-  return (kk_string_cmp_borrow(s1, s2) != 0);
+  return kk_bytes_is_neq_borrow(s1.bytes, s2.bytes);
 }
 
 static inline bool kk_string_is_eq(kk_string_t s1, kk_string_t s2, kk_context_t* ctx) {
-  return (kk_string_cmp(s1, s2, ctx) == 0);
+  return kk_bytes_is_eq(s1.bytes, s2.bytes, ctx);
 }
 
 static inline bool kk_string_is_neq(kk_string_t s1, kk_string_t s2, kk_context_t* ctx) {
-  return (kk_string_cmp(s1, s2, ctx) != 0);
+  return kk_bytes_is_neq(s1.bytes, s2.bytes, ctx);
+}
+
+static inline uint32_t kk_string_hash_borrow(kk_string_t str) {
+  return kk_bytes_hash_borrow(str.bytes);
 }
 
+// Return the canonical string with the same contents from a process wide intern table.
+// Interned strings are immortal: equal interned strings are pointer equal and their hash is cached.
+kk_decl_export kk_string_t kk_string_intern(kk_string_t str, kk_context_t* ctx);
+
 static inline kk_string_t kk_string_cat(kk_string_t s1, kk_string_t s2, kk_context_t* ctx) {
   return kk_unsafe_bytes_as_string(kk_bytes_cat(s1.bytes, s2.bytes, ctx));
 }
@@ -470,6 +500,9 @@ static inline kk_string_t kk_string_cat_from_valid_utf8(kk_string_t s1, const ch
   return kk_unsafe_bytes_as_string(kk_bytes_cat_from_buf(s1.bytes, kk_sstrlen(s2), (const uint8_t*)s2, ctx));
 }
 
+kk_decl_export kk_string_t kk_string_join(kk_vector_t v, kk_context_t* ctx);
+kk_decl_export kk_string_t kk_string_join_with(kk_vector_t v, kk_string_t sep, kk_context_t* ctx);
+
 static inline kk_string_t kk_string_replace_all(kk_string_t s, kk_string_t pat, kk_string_t rep, kk_context_t* ctx) {
   return kk_unsafe_bytes_as_string(kk_bytes_replace_all(s.bytes, pat.bytes, rep.bytes, ctx));
 }
@@ -478,6 +511,11 @@ static inline kk_string_t kk_string_replace_atmost(kk_string_t s, kk_string_t pa
   return kk_unsafe_bytes_as_string(kk_bytes_replace_atmost(s.bytes, pat.bytes, rep.bytes, n, ctx));
 }
 
+// Replace the strings in vector `pats` with the corresponding ones in `reps` in a single pass (leftmost longest first)
+static inline kk_string_t kk_string_replace_many(kk_string_t s, kk_vector_t pats, kk_vector_t reps, kk_context_t* ctx) {
+  return kk_unsafe_bytes_as_string(kk_bytes_replace_many(s.bytes, pats, reps, ctx));
+}
+
 static inline kk_string_t kk_string_repeat(kk_string_t s, kk_ssize_t n, kk_context_t* ctx) {
   return kk_unsafe_bytes_as_string(kk_bytes_repeat(s.bytes, n, ctx));
 }
@@ -503,6 +541,69 @@ static inline bool   kk_string_contains(kk_string_t str, kk_string_t sub, kk_con
 }
 
 
+/*--------------------------------------------------------------------------------------------------
+  String builder
+  Appending to a unique string (or bytes) is done in place in a buffer that grows geometrically
+  (see `kk_bytes_cat`), so building a string by repeated appending takes linear time.
+  A builder keeps its buffer unique while appending; `kk_string_builder_finish` returns it.
+--------------------------------------------------------------------------------------------------*/
+
+typedef struct kk_string_builder_s {
+  kk_bytes_t buf;
+} kk_string_builder_t;
+
+static inline kk_string_builder_t kk_string_builder_empty(void) {
+  kk_string_builder_t sb = { kk_bytes_empty() };
+  return sb;
+}
+
+// Append `len` bytes; these should be valid utf-8 if the builder is finished as a string.
+static inline void kk_string_builder_append_buf(kk_string_builder_t* sb, kk_ssize_t len, const uint8_t* p, kk_context_t* ctx) {
+  sb->buf = kk_bytes_cat_from_buf(sb->buf, len, p, ctx);
+}
+
+static inline void kk_string_builder_append(kk_string_builder_t* sb, kk_string_t s, kk_context_t* ctx) {
+  if (kk_bytes_is_empty_borrow(sb->buf)) {
+    kk_bytes_drop(sb->buf, ctx);
+    sb->buf = s.bytes;  // start with `s` (and continue in place if it is unique)
+  }
+  else {
+    sb->buf = kk_bytes_cat(sb->buf, s.bytes, ctx);
+  }
+}
+
+static inline void kk_string_builder_append_char(kk_string_builder_t* sb, kk_char_t c, kk_context_t* ctx) {
+  uint8_t buf[4];
+  kk_ssize_t count;
+  kk_utf8_write(c, buf, &count);
+  kk_string_builder_append_buf(sb, count, buf, ctx);
+}
+
+static inline void kk_string_builder_append_valid_utf8(kk_string_builder_t* sb, const char* s, kk_context_t* ctx) {
+  kk_assert_internal(kk_utf8_is_valid(s));
+  kk_string_builder_append_buf(sb, kk_sstrlen(s), (const uint8_t*)s, ctx);
+}
+
+static inline kk_string_t kk_string_builder_finish(kk_string_builder_t* sb) {
+  kk_string_t s = kk_unsafe_bytes_as_string(sb->buf);
+  sb->buf = kk_bytes_empty();
+  return s;
+}
+
+// The `string-builder` of std/core is represented by its buffer as a string.
+static inline kk_string_t kk_string_builder_cat(kk_string_t buf, kk_string_t s, kk_context_t* ctx) {
+  kk_string_builder_t sb = { buf.bytes };
+  kk_string_builder_append(&sb, s, ctx);
+  return kk_string_builder_finish(&sb);
+}
+
+static inline kk_string_t kk_string_builder_cat_char(kk_string_t buf, kk_char_t c, kk_context_t* ctx) {
+  kk_string_builder_t sb = { buf.bytes };
+  kk_string_builder_append_char(&sb, c, ctx);
+  return kk_string_builder_finish(&sb);
+}
+
+
 /*--------------------------------------------------------------------------------------------------
   Utilities that are string specific
 --------------------------------------------------------------------------------------------------*/
@@ -530,15 +631,21 @@ kk_decl_export kk_string_t  kk_string_to_lower(kk_string_t strs, kk_context_t* c
 kk_decl_export kk_string_t  kk_string_trim_left(kk_string_t strs, kk_context_t* ctx);
 kk_decl_export kk_string_t  kk_string_trim_right(kk_string_t strs, kk_context_t* ctx);
 
+#ifndef KK_STDOUT_BUFSIZE
+#define KK_STDOUT_BUFSIZE  (64*1024)   // buffer size of the standard output (see `kk_print`)
+#endif
+
 kk_decl_export kk_unit_t   kk_println(kk_string_t s, kk_context_t* ctx);
 kk_decl_export kk_unit_t   kk_print(kk_string_t s, kk_context_t* ctx);
 kk_decl_export kk_unit_t   kk_trace(kk_string_t s, kk_context_t* ctx);
 kk_decl_export kk_unit_t   kk_trace_any(kk_string_t s, kk_box_t x, kk_context_t* ctx);
+kk_decl_export void        kk_stdout_flush(kk_context_t* ctx);   // write out the buffered output of `kk_print` (of all threads)
 kk_decl_export kk_string_t kk_show_any(kk_box_t x, kk_context_t* ctx);
 
 kk_decl_export kk_string_t kk_double_show_fixed(double d, int32_t prec, kk_context_t* ctx);
 kk_decl_export kk_string_t kk_double_show_exp(double d, int32_t prec, kk_context_t* ctx);
 kk_decl_export kk_string_t kk_double_show(double d, int32_t prec, kk_context_t* ctx);
+kk_decl_export double      kk_double_parse(const char* s, kk_ssize_t len);  // `s` must be zero terminated at `len`
 
 
 #endif // include guard
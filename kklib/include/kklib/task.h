@@ -0,0 +1,40 @@
+#pragma once
+#ifndef KK_TASK_H
+#define KK_TASK_H
+
+/*---------------------------------------------------------------------------
+  Copyright 2021, Microsoft Research, Daan Leijen.
+
+  This is free software; you can redistribute it and/or modify it under the
+  terms of the Apache License, Version 2.0. A copy of the License can be
+  found in the LICENSE file at the root of this distribution.
+---------------------------------------------------------------------------*/
+
+/*--------------------------------------------------------------------------------------
+  Parallel tasks (see `task.c`)
+  A task runs a function `() -> a` on a pool of worker threads. Spawning returns
+  a boxed future that can be awaited for the (thread shared) result.
+  The function and its result are marked as thread shared automatically.
+--------------------------------------------------------------------------------------*/
+
+kk_decl_export kk_box_t   kk_task_spawn(kk_function_t fun, kk_context_t* ctx);
+kk_decl_export kk_box_t   kk_task_await(kk_box_t future, kk_context_t* ctx);
+kk_decl_export bool       kk_task_is_done_borrow(kk_box_t future);
+
+kk_decl_export void       kk_task_set_worker_count(kk_ssize_t count);   // before the first spawn
+kk_decl_export kk_ssize_t kk_task_worker_count(kk_context_t* ctx);
+
+
+/*--------------------------------------------------------------------------------------
+  Background reclamation (see `task.c` and `refcount.c`)
+  Drops that free more than a threshold of blocks (`--kkreclaim=N`) hand the rest of
+  the structure to a dedicated reclaimer thread.
+--------------------------------------------------------------------------------------*/
+
+kk_decl_export void       kk_reclaim_set_threshold(kk_ssize_t threshold);  // in blocks (0 to disable)
+kk_decl_export kk_ssize_t kk_reclaim_threshold(void);
+kk_decl_export void       kk_reclaim_push(kk_block_t* todo, kk_context_t* ctx);
+kk_decl_export void       kk_reclaim_collect(kk_context_t* ctx);
+kk_decl_export void       kk_reclaim_context_done(kk_context_t* ctx);
+
+#endif // include guard
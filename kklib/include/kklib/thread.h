@@ -0,0 +1,74 @@
+#pragma once
+#ifndef KK_THREAD_H
+#define KK_THREAD_H
+
+/*---------------------------------------------------------------------------
+  Copyright 2021, Microsoft Research, Daan Leijen.
+
+  This is free software; you can redistribute it and/or modify it under the
+  terms of the Apache License, Version 2.0. A copy of the License can be
+  found in the LICENSE file at the root of this distribution.
+---------------------------------------------------------------------------*/
+
+/*--------------------------------------------------------------------------------------------------
+  Threads, locks, and condition variables
+  Internal to the runtime (for the task pool and the directory walker) and not included by `kklib.h`.
+--------------------------------------------------------------------------------------------------*/
+#if KK_MULTI_THREADED
+
+#if defined(WIN32)
+#include <Windows.h>
+typedef HANDLE              kk_thread_t;
+typedef SRWLOCK             kk_mutex_t;
+typedef CONDITION_VARIABLE  kk_cond_t;
+typedef DWORD               kk_thread_result_t;
+#define kk_thread_call      WINAPI
+
+static inline bool kk_thread_create(kk_thread_t* thread, kk_thread_result_t (kk_thread_call *start)(void*), void* arg) {
+  *thread = CreateThread(NULL, 0, start, arg, 0, NULL);
+  return (*thread != NULL);
+}
+static inline void kk_thread_join(kk_thread_t thread) {
+  WaitForSingleObject(thread, INFINITE);
+  CloseHandle(thread);
+}
+static inline void kk_mutex_init(kk_mutex_t* m)   { InitializeSRWLock(m); }
+static inline void kk_mutex_lock(kk_mutex_t* m)   { AcquireSRWLockExclusive(m); }
+static inline void kk_mutex_unlock(kk_mutex_t* m) { ReleaseSRWLockExclusive(m); }
+static inline void kk_cond_init(kk_cond_t* c)     { InitializeConditionVariable(c); }
+static inline void kk_cond_broadcast(kk_cond_t* c){ WakeAllConditionVariable(c); }
+static inline void kk_cond_timedwait(kk_cond_t* c, kk_mutex_t* m, long msecs) {
+  SleepConditionVariableSRW(c, m, (DWORD)msecs, 0);
+}
+#else
+#include <pthread.h>
+#include <time.h>
+typedef pthread_t           kk_thread_t;
+typedef pthread_mutex_t     kk_mutex_t;
+typedef pthread_cond_t      kk_cond_t;
+typedef void*               kk_thread_result_t;
+#define kk_thread_call
+
+static inline bool kk_thread_create(kk_thread_t* thread, kk_thread_result_t (*start)(void*), void* arg) {
+  return (pthread_create(thread, NULL, start, arg) == 0);
+}
+static inline void kk_thread_join(kk_thread_t thread) {
+  pthread_join(thread, NULL);
+}
+static inline void kk_mutex_init(kk_mutex_t* m)   { pthread_mutex_init(m, NULL); }
+static inline void kk_mutex_lock(kk_mutex_t* m)   { pthread_mutex_lock(m); }
+static inline void kk_mutex_unlock(kk_mutex_t* m) { pthread_mutex_unlock(m); }
+static inline void kk_cond_init(kk_cond_t* c)     { pthread_cond_init(c, NULL); }
+static inline void kk_cond_broadcast(kk_cond_t* c){ pthread_cond_broadcast(c); }
+static inline void kk_cond_timedwait(kk_cond_t* c, kk_mutex_t* m, long msecs) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_nsec += (msecs % 1000) * 1000000L;
+  ts.tv_sec  += (msecs / 1000) + (ts.tv_nsec / 1000000000L);
+  ts.tv_nsec %= 1000000000L;
+  pthread_cond_timedwait(c, m, &ts);
+}
+#endif
+
+#endif // KK_MULTI_THREADED
+#endif // include guard
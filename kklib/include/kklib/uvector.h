@@ -0,0 +1,125 @@
+#pragma once
+#ifndef KK_UVECTOR_H
+#define KK_UVECTOR_H
+
+/*---------------------------------------------------------------------------
+  Copyright 2021, Microsoft Research, Daan Leijen.
+
+  This is free software; you can redistribute it and/or modify it under the
+  terms of the Apache License, Version 2.0. A copy of the License can be
+  found in the LICENSE file at the root of this distribution.
+---------------------------------------------------------------------------*/
+
+/*--------------------------------------------------------------------------------------
+  Unboxed vectors (see `uvector.c`)
+  A vector of primitive elements (`double`, `int64_t`, `int32_t`, or `uint8_t`) that are
+  stored unboxed in a single block with `scan_fsize == 0`: the elements take no more
+  space than in a C array, and a drop has nothing to scan.
+  Updates are in-place if the vector is unique (and copy the elements otherwise).
+--------------------------------------------------------------------------------------*/
+
+typedef enum kk_uvector_elem_e {
+  KK_UVECTOR_F64,
+  KK_UVECTOR_I64,
+  KK_UVECTOR_I32,
+  KK_UVECTOR_U8
+} kk_uvector_elem_t;
+
+typedef struct kk_uvector_s {
+  kk_block_t  _block;
+  kk_ssize_t  length;
+  int32_t     elem;      // `kk_uvector_elem_t`
+  int32_t     _padding;
+  union {
+    double    f64[1];
+    int64_t   i64[1];
+    int32_t   i32[1];
+    uint8_t   u8[1];
+  } buf;                 // `length` elements
+} *kk_uvector_t;
+
+static inline kk_box_t kk_uvector_box(kk_uvector_t v, kk_context_t* ctx) {
+  KK_UNUSED(ctx);
+  return kk_basetype_box(v);
+}
+
+static inline kk_uvector_t kk_uvector_unbox(kk_box_t b, kk_context_t* ctx) {
+  KK_UNUSED(ctx);
+  return kk_basetype_unbox_as_assert(kk_uvector_t, b, KK_TAG_UVECTOR);
+}
+
+static inline void kk_uvector_drop(kk_uvector_t v, kk_context_t* ctx) {
+  kk_basetype_drop_assert(v, KK_TAG_UVECTOR, ctx);
+}
+
+static inline kk_uvector_t kk_uvector_dup(kk_uvector_t v) {
+  return kk_basetype_dup_assert(kk_uvector_t, v, KK_TAG_UVECTOR);
+}
+
+static inline kk_ssize_t kk_uvector_elem_size(kk_uvector_elem_t elem) {
+  return (elem == KK_UVECTOR_U8 ? 1 : (elem == KK_UVECTOR_I32 ? 4 : 8));
+}
+
+static inline kk_ssize_t kk_uvector_len_borrow(kk_uvector_t v) {
+  return v->length;
+}
+
+static inline kk_ssize_t kk_uvector_len(kk_uvector_t v, kk_context_t* ctx) {
+  kk_ssize_t len = v->length;
+  kk_uvector_drop(v, ctx);
+  return len;
+}
+
+kk_decl_export void         kk_uvector_init(void);  // select the kernels for this cpu (called from `kklib_init`)
+kk_decl_export kk_uvector_t kk_uvector_alloc(kk_uvector_elem_t elem, kk_ssize_t length, kk_context_t* ctx);  // uninitialized
+kk_decl_export kk_uvector_t kk_uvector_copy(kk_uvector_t v, kk_context_t* ctx);
+kk_decl_export bool         kk_uvector_eq(kk_uvector_t v, kk_uvector_t w, kk_context_t* ctx);
+kk_decl_export int          kk_uvector_cmp(kk_uvector_t v, kk_uvector_t w, kk_context_t* ctx);  // lexicographic: -1, 0, or 1
+
+// Return `v` if it is unique, or a fresh copy otherwise
+static inline kk_uvector_t kk_uvector_unique(kk_uvector_t v, kk_context_t* ctx) {
+  return (kk_basetype_is_unique(v) ? v : kk_uvector_copy(v, ctx));
+}
+
+// Element access and the bulk kernels for each element type `tp`.
+// `sum` and `dot` of integer vectors are computed with (wrapping) 64-bit integers;
+// floating point sums use multiple accumulators so the rounding may differ from a sequential sum.
+// The binary operations `add` and `mul` use the length of the shortest argument.
+#define kk_uvector_declare(name,tp,sumtp,elemkind) \
+  static inline tp* kk_uvector_##name##_buf_borrow(kk_uvector_t v) { \
+    kk_assert_internal(v->elem == elemkind); \
+    return &v->buf.name[0]; \
+  } \
+  static inline tp kk_uvector_##name##_at(kk_uvector_t v, kk_ssize_t i, kk_context_t* ctx) { \
+    kk_assert(i >= 0 && i < v->length); \
+    const tp x = kk_uvector_##name##_buf_borrow(v)[i]; \
+    kk_uvector_drop(v, ctx); \
+    return x; \
+  } \
+  static inline kk_uvector_t kk_uvector_##name##_set(kk_uvector_t v, kk_ssize_t i, tp x, kk_context_t* ctx) { \
+    kk_assert(i >= 0 && i < v->length); \
+    v = kk_uvector_unique(v, ctx); \
+    kk_uvector_##name##_buf_borrow(v)[i] = x; \
+    return v; \
+  } \
+  static inline kk_unit_t kk_uvector_##name##_unsafe_assign(kk_uvector_t v, kk_ssize_t i, tp x, kk_context_t* ctx) { \
+    kk_assert(i >= 0 && i < v->length); \
+    kk_uvector_##name##_buf_borrow(v)[i] = x;  /* without a uniqueness check (see `map` in std/core) */ \
+    kk_uvector_drop(v, ctx); \
+    return kk_Unit; \
+  } \
+  kk_decl_export kk_uvector_t kk_uvector_##name##_alloc(kk_ssize_t length, tp x, kk_context_t* ctx); \
+  kk_decl_export kk_uvector_t kk_uvector_##name##_from_vector(kk_vector_t v, kk_context_t* ctx); \
+  kk_decl_export kk_vector_t  kk_uvector_##name##_to_vector(kk_uvector_t v, kk_context_t* ctx); \
+  kk_decl_export sumtp        kk_uvector_##name##_sum(kk_uvector_t v, kk_context_t* ctx); \
+  kk_decl_export sumtp        kk_uvector_##name##_dot(kk_uvector_t v, kk_uvector_t w, kk_context_t* ctx); \
+  kk_decl_export kk_uvector_t kk_uvector_##name##_add(kk_uvector_t v, kk_uvector_t w, kk_context_t* ctx); \
+  kk_decl_export kk_uvector_t kk_uvector_##name##_mul(kk_uvector_t v, kk_uvector_t w, kk_context_t* ctx); \
+  kk_decl_export kk_uvector_t kk_uvector_##name##_scale(kk_uvector_t v, tp x, kk_context_t* ctx);
+
+kk_uvector_declare(f64, double,  double,  KK_UVECTOR_F64)
+kk_uvector_declare(i64, int64_t, int64_t, KK_UVECTOR_I64)
+kk_uvector_declare(i32, int32_t, int64_t, KK_UVECTOR_I32)
+kk_uvector_declare(u8,  uint8_t, int64_t, KK_UVECTOR_U8)
+
+#endif // include guard
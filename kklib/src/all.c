@@ -10,18 +10,27 @@
 
 #include <kklib.h>
 
+#include "arena.c"
+#include "async.c"
 #include "bits.c"
 #include "box.c"
 #include "bytes.c"
+#include "compose.c"
+#include "double.c"
+#include "heapprof.c"
 #include "init.c"
 #include "integer.c"
+#include "mem.c"
 #include "os.c"
 #include "process.c"
 #include "random.c"
 #include "ref.c"
 #include "refcount.c"
+#include "stats.c"
 #include "string.c"
+#include "task.c"
 #include "time.c"
+#include "uvector.c"
 #include "vector.c"
 
 #if defined(KK_MIMALLOC)
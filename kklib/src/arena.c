@@ -0,0 +1,384 @@
+/*---------------------------------------------------------------------------
+  Copyright 2021, Microsoft Research, Daan Leijen.
+
+  This is free software; you can redistribute it and/or modify it under the
+  terms of the Apache License, Version 2.0. A copy of the License can be
+  found in the LICENSE file at the root of this distribution.
+---------------------------------------------------------------------------*/
+#include "kklib.h"
+
+/*--------------------------------------------------------------------------------------------------
+  Arenas
+
+  `kk_arena_enter` starts a fresh arena on the context. Until the matching `kk_arena_leave`,
+  all blocks are bump allocated in chunks of the arena and get the `arena` bit in their header.
+  Reference counting works as usual, but freeing an arena block (in `kk_block_free`) only marks
+  it as dead (with a `KK_ARENA_DEAD` reference count); the chunks are released at once when
+  the arena is left.
+
+  Each block is preceded by its size so we can walk the blocks in a chunk. When an arena is
+  released we walk all blocks that are still alive and drop their references to blocks outside
+  the arena (and free the data of raw blocks); references within the arena need no work.
+
+  Blocks allocated while the arena is active must not escape to older blocks (for example
+  through a mutable reference) or to other threads. A result can be copied out with
+  `kk_arena_leave`, or the arena can be kept alive with `kk_arena_leave_keep` and
+  released later with `kk_arena_free`.
+  Arenas nest: leaving an arena continues allocating in the outer one (if any).
+--------------------------------------------------------------------------------------------------*/
+
+#define KK_ARENA_CHUNK_MIN  (64*1024)           // the first chunk size
+#define KK_ARENA_CHUNK_MAX  (16*1024*1024)      // chunks double in size up to this size
+
+typedef struct kk_arena_chunk_s {
+  struct kk_arena_chunk_s* next;
+  size_t                   used;  // used bytes after the chunk header (only valid if not the current chunk)
+} kk_arena_chunk_t;
+
+struct kk_arena_s {
+  kk_arena_t*        parent;             // the outer arena (or NULL)
+  kk_arena_chunk_t*  chunks;             // the current chunk is first
+  uint8_t*           cur;                // bump pointer in the current chunk
+  uint8_t*           end;                // end of the current chunk
+  size_t             chunk_size;         // size of the next chunk
+  kk_ssize_t         reclaim_threshold;  // saved threshold of the context
+};
+
+typedef int64_t kk_arena_prefix_t;       // the size of a block is stored in front of it
+
+static uint8_t* kk_arena_chunk_data(kk_arena_chunk_t* chunk) {
+  return (uint8_t*)(chunk + 1);
+}
+
+static size_t kk_arena_good_size(kk_ssize_t size) {
+  return (sizeof(kk_arena_prefix_t) + (size_t)size + 7) & ~((size_t)7);
+}
+
+static kk_ssize_t kk_arena_block_size(const kk_block_t* b) {
+  return (kk_ssize_t)(((const kk_arena_prefix_t*)b)[-1]);
+}
+
+// Allocate a new chunk; a large allocation gets a chunk of its own (and the current chunk stays the same)
+static kk_decl_noinline void* kk_arena_malloc_slow(kk_arena_t* arena, kk_ssize_t size) {
+  const size_t need = kk_arena_good_size(size);
+  if (need > arena->chunk_size/4) {
+    kk_arena_chunk_t* chunk = (kk_arena_chunk_t*)malloc(sizeof(kk_arena_chunk_t) + need);
+    if (chunk == NULL) kk_fatal_error(ENOMEM, "out of memory in an arena");
+    chunk->used = need;
+    if (arena->chunks == NULL) { chunk->next = NULL; arena->chunks = chunk; arena->cur = arena->end = kk_arena_chunk_data(chunk) + need; }
+                          else { chunk->next = arena->chunks->next; arena->chunks->next = chunk; }
+    kk_arena_prefix_t* p = (kk_arena_prefix_t*)kk_arena_chunk_data(chunk);
+    *p = size;
+    return (p + 1);
+  }
+  kk_arena_chunk_t* chunk = (kk_arena_chunk_t*)malloc(sizeof(kk_arena_chunk_t) + arena->chunk_size);
+  if (chunk == NULL) kk_fatal_error(ENOMEM, "out of memory in an arena");
+  if (arena->chunks != NULL) {
+    arena->chunks->used = (size_t)(arena->cur - kk_arena_chunk_data(arena->chunks));
+  }
+  chunk->next = arena->chunks;
+  chunk->used = 0;
+  arena->chunks = chunk;
+  arena->cur = kk_arena_chunk_data(chunk);
+  arena->end = arena->cur + arena->chunk_size;
+  if (arena->chunk_size < KK_ARENA_CHUNK_MAX) arena->chunk_size *= 2;
+  kk_arena_prefix_t* p = (kk_arena_prefix_t*)arena->cur;
+  *p = size;
+  arena->cur += need;
+  return (p + 1);
+}
+
+static inline void* kk_arena_malloc(kk_arena_t* arena, kk_ssize_t size) {
+  const size_t need = kk_arena_good_size(size);
+  if (kk_likely((size_t)(arena->end - arena->cur) >= need)) {
+    kk_arena_prefix_t* p = (kk_arena_prefix_t*)arena->cur;
+    *p = size;
+    arena->cur += need;
+    return (p + 1);
+  }
+  return kk_arena_malloc_slow(arena, size);
+}
+
+
+/*--------------------------------------------------------------------------------------------------
+  Allocation in the current arena (called from `kk_block_alloc_at` etc. if `ctx->arena != NULL`)
+--------------------------------------------------------------------------------------------------*/
+
+kk_block_t* kk_arena_block_alloc_at(kk_reuse_t at, kk_ssize_t size, kk_ssize_t scan_fsize, kk_tag_t tag, kk_context_t* ctx) {
+  kk_block_t* b;
+  if (at != kk_reuse_null && kk_block_is_arena(at)) {
+    b = at;     // reuse in place
+    kk_stats_count(ctx,reuses);
+    if (kk_block_tag(b) != KK_TAG_INVALID) { kk_stats_free(kk_block_tag(b),ctx); }
+  }
+  else {
+    kk_assert_internal(ctx->arena != NULL);
+    if (at != kk_reuse_null) { kk_block_free(at, ctx); }  // don't reuse blocks outside the arena
+    b = (kk_block_t*)kk_arena_malloc(ctx->arena, size);
+    kk_heapprof_count(size, tag, ctx);
+  }
+  kk_stats_alloc(tag,ctx);
+  kk_block_init(b, size, scan_fsize, tag);
+  b->header.arena = 1;
+  return b;
+}
+
+kk_block_large_t* kk_arena_block_large_alloc(kk_ssize_t size, kk_ssize_t scan_fsize, kk_tag_t tag, kk_context_t* ctx) {
+  kk_assert_internal(ctx->arena != NULL);
+  kk_block_large_t* b = (kk_block_large_t*)kk_arena_malloc(ctx->arena, size + 1 /* the scan_large_fsize field */);
+  kk_heapprof_count(size, tag, ctx);
+  kk_stats_alloc(tag,ctx);
+  kk_block_large_init(b, size, scan_fsize, tag);
+  b->_block.header.arena = 1;
+  return b;
+}
+
+// Reallocate a unique arena block (in the current arena, or on the heap if there is none)
+kk_block_t* kk_arena_block_realloc(kk_block_t* b, kk_ssize_t size, kk_context_t* ctx) {
+  kk_assert_internal(kk_block_is_arena(b) && kk_block_is_unique(b));
+  const kk_ssize_t oldsize = kk_arena_block_size(b);
+  if (size <= oldsize) return b;  // shrink in place
+  kk_block_t* nb = (kk_block_t*)(ctx->arena != NULL ? kk_arena_malloc(ctx->arena, size) : kk_malloc(size, ctx));
+  if (nb == NULL) return NULL;
+  memcpy(nb, b, (size_t)(size < oldsize ? size : oldsize));
+  nb->header.arena = (ctx->arena != NULL ? 1 : 0);
+  nb->header.size_class = (ctx->arena != NULL ? 0 : kk_block_size_class(size));
+  b->header.refcount = KK_ARENA_DEAD;
+  return nb;
+}
+
+
+/*--------------------------------------------------------------------------------------------------
+  Entering and leaving
+--------------------------------------------------------------------------------------------------*/
+
+// Start allocating all blocks in a fresh arena
+void kk_arena_enter(kk_context_t* ctx) {
+  kk_arena_t* arena = (kk_arena_t*)kk_malloc(kk_ssizeof(kk_arena_t), ctx);
+  if (arena == NULL) kk_fatal_error(ENOMEM, "unable to allocate an arena");
+  arena->parent = ctx->arena;
+  arena->chunks = NULL;
+  arena->cur = NULL;
+  arena->end = NULL;
+  arena->chunk_size = KK_ARENA_CHUNK_MIN;
+  arena->reclaim_threshold = ctx->reclaim_threshold;
+  ctx->reclaim_threshold = 0;    // arena blocks are never freed on the reclaimer thread
+  ctx->arena = arena;
+}
+
+// Stop allocating in the current arena
+static kk_arena_t* kk_arena_pop(kk_context_t* ctx) {
+  kk_arena_t* arena = ctx->arena;
+  kk_assert(arena != NULL);
+  if (ctx->delayed_free != NULL) {
+    // finish pending frees as they may be in the arena
+    const kk_ssize_t budget = ctx->free_budget;
+    ctx->free_budget = 0;
+    kk_block_drop_free_pending(ctx);
+    ctx->free_budget = budget;
+  }
+  ctx->arena = arena->parent;
+  ctx->reclaim_threshold = arena->reclaim_threshold;
+  return arena;
+}
+
+// Release an arena: drop references from live blocks to blocks outside the arena and free all chunks
+void kk_arena_free(kk_arena_t* arena, kk_context_t* ctx) {
+  if (arena == NULL) return;
+  // blocks of a kept arena can be on the delayed free list or in a job of the reclaimer thread;
+  // finish those first, freeing everything directly meanwhile
+  const kk_ssize_t budget = ctx->free_budget;
+  const kk_ssize_t reclaim_threshold = ctx->reclaim_threshold;
+  ctx->free_budget = 0;
+  ctx->reclaim_threshold = 0;
+  if (ctx->delayed_free != NULL) kk_block_drop_free_pending(ctx);
+  kk_reclaim_context_done(ctx);    // waits for the jobs of this context and applies their decrements
+  ctx->free_budget = budget;
+  ctx->reclaim_threshold = reclaim_threshold;
+  if (arena->chunks != NULL) {
+    arena->chunks->used = (size_t)(arena->cur - kk_arena_chunk_data(arena->chunks));
+  }
+  for (kk_arena_chunk_t* chunk = arena->chunks; chunk != NULL; chunk = chunk->next) {
+    uint8_t* p = kk_arena_chunk_data(chunk);
+    uint8_t* const end = p + chunk->used;
+    while (p < end) {
+      const kk_ssize_t size = (kk_ssize_t)(*((kk_arena_prefix_t*)p));
+      kk_block_t* b = (kk_block_t*)(p + sizeof(kk_arena_prefix_t));
+      p += kk_arena_good_size(size);
+      if (b->header.refcount == KK_ARENA_DEAD) continue;
+      kk_stats_free(kk_block_tag(b),ctx);
+      if (kk_tag_is_raw(kk_block_tag(b))) kk_block_free_raw(b);
+      const kk_ssize_t scan_fsize = kk_block_scan_fsize(b);
+      for (kk_ssize_t i = 0; i < scan_fsize; i++) {
+        const kk_box_t v = kk_block_field(b, i);
+        if (kk_box_is_non_null_ptr(v) && !kk_block_is_arena(kk_ptr_unbox(v))) {
+          kk_box_drop(v, ctx);
+        }
+      }
+    }
+  }
+  kk_arena_chunk_t* chunk = arena->chunks;
+  while (chunk != NULL) {
+    kk_arena_chunk_t* next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+  kk_free(arena);
+}
+
+// Leave the current arena and keep it alive: values allocated in it stay valid until `kk_arena_free`
+kk_arena_t* kk_arena_leave_keep(kk_context_t* ctx) {
+  return kk_arena_pop(ctx);
+}
+
+
+/*--------------------------------------------------------------------------------------------------
+  Copying a result out of an arena
+  We copy all arena blocks reachable from the result (keeping sharing with a map from
+  arena blocks to their copies) into the outer arena or the heap. References from the
+  copies to blocks outside the arena are dup'd; the originals are dropped when the arena is
+  released. The data of raw blocks moves to the copy. To test if a block is in the arena
+  we binary search the address ranges of its chunks (sorted once before copying).
+--------------------------------------------------------------------------------------------------*/
+
+typedef struct kk_arena_range_s {
+  const uint8_t* start;
+  const uint8_t* end;
+} kk_arena_range_t;
+
+typedef struct kk_arena_copy_s {
+  kk_arena_range_t* ranges;  // the chunks of the arena we copy out of, sorted by address
+  kk_ssize_t   range_count;
+  kk_block_t** keys;     // open addressing table from arena blocks to their copy
+  kk_block_t** values;
+  kk_ssize_t   size;
+  kk_ssize_t   count;
+  kk_block_t** todo;     // copies whose fields still need to be copied
+  kk_ssize_t   todo_count;
+  kk_ssize_t   todo_size;
+} kk_arena_copy_t;
+
+static int kk_arena_range_cmp(const void* x, const void* y) {
+  const uint8_t* p = ((const kk_arena_range_t*)x)->start;
+  const uint8_t* q = ((const kk_arena_range_t*)y)->start;
+  return (p < q ? -1 : (p > q ? 1 : 0));
+}
+
+static void kk_arena_copy_init_ranges(kk_arena_copy_t* cp, kk_arena_t* arena, kk_context_t* ctx) {
+  kk_ssize_t n = 0;
+  for (kk_arena_chunk_t* chunk = arena->chunks; chunk != NULL; chunk = chunk->next) { n++; }
+  cp->ranges = (kk_arena_range_t*)kk_malloc((n > 0 ? n : 1) * kk_ssizeof(kk_arena_range_t), ctx);
+  if (cp->ranges == NULL) kk_fatal_error(ENOMEM, "out of memory copying out of an arena");
+  kk_ssize_t i = 0;
+  for (kk_arena_chunk_t* chunk = arena->chunks; chunk != NULL; chunk = chunk->next, i++) {
+    const uint8_t* data = kk_arena_chunk_data(chunk);
+    cp->ranges[i].start = data;
+    cp->ranges[i].end = (chunk == arena->chunks ? arena->cur : data + chunk->used);
+  }
+  qsort(cp->ranges, (size_t)n, sizeof(kk_arena_range_t), &kk_arena_range_cmp);
+  cp->range_count = n;
+}
+
+// Is a block allocated in the arena we copy out of? (and not in an outer or kept arena)
+static bool kk_arena_copy_contains(const kk_arena_copy_t* cp, const kk_block_t* b) {
+  const uint8_t* p = (const uint8_t*)b;
+  kk_ssize_t lo = 0;
+  kk_ssize_t hi = cp->range_count;
+  while (lo < hi) {  // find the first range that starts after `p`
+    const kk_ssize_t mid = lo + (hi - lo)/2;
+    if (cp->ranges[mid].start <= p) { lo = mid + 1; } else { hi = mid; }
+  }
+  return (lo > 0 && p < cp->ranges[lo-1].end);
+}
+
+static kk_ssize_t kk_arena_copy_hash(const kk_arena_copy_t* cp, const kk_block_t* b) {
+  return (kk_ssize_t)((((uintptr_t)b >> 3) * KUP(0x9E3779B97F4A7C15)) >> 16) & (cp->size - 1);
+}
+
+static void kk_arena_copy_grow(kk_arena_copy_t* cp, kk_context_t* ctx) {
+  const kk_ssize_t newsize = (cp->size == 0 ? 1024 : 2*cp->size);
+  kk_block_t** keys = (kk_block_t**)kk_zalloc(newsize * kk_ssizeof(kk_block_t*), ctx);
+  kk_block_t** values = (kk_block_t**)kk_malloc(newsize * kk_ssizeof(kk_block_t*), ctx);
+  if (keys == NULL || values == NULL) kk_fatal_error(ENOMEM, "out of memory copying out of an arena");
+  kk_block_t** oldkeys = cp->keys;
+  kk_block_t** oldvalues = cp->values;
+  const kk_ssize_t oldsize = cp->size;
+  cp->keys = keys;
+  cp->values = values;
+  cp->size = newsize;
+  for (kk_ssize_t i = 0; i < oldsize; i++) {
+    if (oldkeys[i] == NULL) continue;
+    kk_ssize_t j = kk_arena_copy_hash(cp, oldkeys[i]);
+    while (keys[j] != NULL) { j = (j + 1) & (newsize - 1); }
+    keys[j] = oldkeys[i];
+    values[j] = oldvalues[i];
+  }
+  kk_free(oldkeys);
+  kk_free(oldvalues);
+}
+
+static void kk_arena_copy_push(kk_arena_copy_t* cp, kk_block_t* b, kk_context_t* ctx) {
+  if (cp->todo_count >= cp->todo_size) {
+    const kk_ssize_t newsize = (cp->todo_size == 0 ? 256 : 2*cp->todo_size);
+    kk_block_t** todo = (kk_block_t**)kk_realloc(cp->todo, newsize * kk_ssizeof(kk_block_t*), ctx);
+    if (todo == NULL) kk_fatal_error(ENOMEM, "out of memory copying out of an arena");
+    cp->todo = todo;
+    cp->todo_size = newsize;
+  }
+  cp->todo[cp->todo_count++] = b;
+}
+
+// Return a reference to the copy of a block (copying it shallowly if needed)
+static kk_block_t* kk_arena_copy_block(kk_arena_copy_t* cp, kk_block_t* b, kk_context_t* ctx) {
+  if (!kk_block_is_arena(b) || !kk_arena_copy_contains(cp, b)) return kk_block_dup(b);
+  if (2*(cp->count + 1) > cp->size) kk_arena_copy_grow(cp, ctx);
+  kk_ssize_t i = kk_arena_copy_hash(cp, b);
+  while (cp->keys[i] != NULL) {
+    if (cp->keys[i] == b) return kk_block_dup(cp->values[i]);
+    i = (i + 1) & (cp->size - 1);
+  }
+  const kk_ssize_t size = kk_arena_block_size(b);
+  kk_block_t* nb = kk_block_alloc_any(size, 0, kk_block_tag(b), ctx);
+  memcpy(nb, b, (size_t)size);
+  nb->header.refcount = 0;
+  nb->header.thread_shared = 0;
+  nb->header.arena = (ctx->arena != NULL ? 1 : 0);
+  if (kk_tag_is_raw(kk_block_tag(b))) {
+    ((struct kk_cptr_raw_s*)b)->free = NULL;  // the data is now owned by the copy
+  }
+  cp->keys[i] = b;
+  cp->values[i] = nb;
+  cp->count++;
+  kk_arena_copy_push(cp, nb, ctx);
+  return nb;
+}
+
+static kk_box_t kk_arena_copy_out(kk_box_t v, kk_arena_t* arena, kk_context_t* ctx) {
+  if (!kk_box_is_non_null_ptr(v) || !kk_block_is_arena(kk_ptr_unbox(v))) return v;  // nothing to copy (and we own `v`)
+  kk_arena_copy_t cp = { NULL, 0, NULL, NULL, 0, 0, NULL, 0, 0 };
+  kk_arena_copy_init_ranges(&cp, arena, ctx);
+  kk_box_t result = kk_ptr_box(kk_arena_copy_block(&cp, kk_ptr_unbox(v), ctx));
+  while (cp.todo_count > 0) {
+    kk_block_t* nb = cp.todo[--cp.todo_count];
+    const kk_ssize_t scan_fsize = kk_block_scan_fsize(nb);
+    for (kk_ssize_t i = 0; i < scan_fsize; i++) {
+      const kk_box_t f = kk_block_field(nb, i);
+      if (kk_box_is_non_null_ptr(f)) {
+        ((kk_block_fields_t*)nb)->fields[i] = kk_ptr_box(kk_arena_copy_block(&cp, kk_ptr_unbox(f), ctx));
+      }
+    }
+  }
+  kk_free(cp.ranges);
+  kk_free(cp.keys);
+  kk_free(cp.values);
+  kk_free(cp.todo);
+  return result;   // the original `v` is released with the arena
+}
+
+// Leave the current arena and release it; the (owned) `result` is copied out of the arena first.
+kk_box_t kk_arena_leave(kk_box_t result, kk_context_t* ctx) {
+  kk_arena_t* arena = kk_arena_pop(ctx);
+  kk_box_t res = kk_arena_copy_out(result, arena, ctx);
+  kk_arena_free(arena, ctx);
+  return res;
+}
@@ -0,0 +1,487 @@
+/*---------------------------------------------------------------------------
+  Copyright 2021, Microsoft Research, Daan Leijen.
+
+  This is free software; you can redistribute it and/or modify it under the
+  terms of the Apache License, Version 2.0. A copy of the License can be
+  found in the LICENSE file at the root of this distribution.
+---------------------------------------------------------------------------*/
+#include "kklib.h"
+
+/*--------------------------------------------------------------------------------------------------
+  Asynchronous I/O event loop.
+  Each thread has an event loop (in `ctx->async_loop`) that is created on demand.
+  Operations are first prepared and then submitted all at once by `kk_async_poll`, which also
+  calls the continuations of the completed operations. A continuation can queue new operations.
+
+  On Linux we use io_uring [1] directly through its system calls: operations are written into
+  the shared submission ring and a single `io_uring_enter` submits the batch and (optionally)
+  waits for completions. If io_uring is not available (older kernels, or disabled in a container)
+  we fall back to `poll` and perform each operation once its file descriptor is ready;
+  regular files are always ready so these operations complete at the next poll.
+  On Windows all operations are currently performed synchronously at the next poll.
+
+  [1] Jens Axboe, "Efficient IO with io_uring", 2019. <https://kernel.dk/io_uring.pdf>
+--------------------------------------------------------------------------------------------------*/
+
+#if defined(__linux__) && !defined(KK_ASYNC_NO_IO_URING) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define KK_ASYNC_IO_URING  1
+#endif
+#endif
+
+#if defined(WIN32)
+#include <io.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <poll.h>
+#endif
+#if KK_ASYNC_IO_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+typedef enum kk_async_kind_e {
+  KK_ASYNC_READ,
+  KK_ASYNC_WRITE,
+  KK_ASYNC_SLEEP
+} kk_async_kind_t;
+
+typedef struct kk_async_op_s {
+  struct kk_async_op_s* next;    // in the queue of operations that are not yet submitted
+  kk_async_kind_t kind;
+  int             fd;
+  int64_t         offset;
+  kk_ssize_t      len;
+  kk_bytes_t      data;          // the bytes to read into, or the bytes to write
+  const uint8_t*  buf;
+  kk_function_t   cont;
+  kk_timer_t      deadline;      // for a sleep in the `poll` loop
+#if KK_ASYNC_IO_URING
+  struct __kernel_timespec ts;   // for a sleep in io_uring
+#endif
+  int64_t         result;
+} kk_async_op_t;
+
+typedef struct kk_async_loop_s {
+  kk_async_op_t* queued;         // not yet submitted (in order)
+  kk_async_op_t* queued_last;
+  kk_ssize_t     pending;        // not yet completed
+#if KK_ASYNC_IO_URING
+  int            ring_fd;        // -1 if io_uring is not used
+  unsigned       sq_entries;
+  unsigned       cq_entries;
+  unsigned       to_submit;      // prepared in the submission ring
+  unsigned       in_flight;      // submitted but not yet reaped
+  _Atomic(uint32_t)* sq_head;
+  _Atomic(uint32_t)* sq_tail;
+  uint32_t*      sq_mask;
+  uint32_t*      sq_array;
+  _Atomic(uint32_t)* cq_head;
+  _Atomic(uint32_t)* cq_tail;
+  uint32_t*      cq_mask;
+  struct io_uring_sqe* sqes;
+  struct io_uring_cqe* cqes;
+  void*          sq_ring;
+  size_t         sq_ring_size;
+  void*          cq_ring;
+  size_t         cq_ring_size;
+  size_t         sqes_size;
+#endif
+} kk_async_loop_t;
+
+
+/*--------------------------------------------------------------------------------------------------
+  io_uring
+--------------------------------------------------------------------------------------------------*/
+#if KK_ASYNC_IO_URING
+
+static void kk_uring_done(kk_async_loop_t* loop) {
+  if (loop->sqes != NULL) munmap(loop->sqes, loop->sqes_size);
+  if (loop->cq_ring != NULL && loop->cq_ring != loop->sq_ring) munmap(loop->cq_ring, loop->cq_ring_size);
+  if (loop->sq_ring != NULL) munmap(loop->sq_ring, loop->sq_ring_size);
+  if (loop->ring_fd >= 0) close(loop->ring_fd);
+  loop->sqes = NULL;
+  loop->sq_ring = loop->cq_ring = NULL;
+  loop->ring_fd = -1;
+}
+
+static void kk_uring_init(kk_async_loop_t* loop) {
+  loop->ring_fd = -1;
+  struct io_uring_params p;
+  kk_memset(&p, 0, sizeof(p));
+  const int fd = (int)syscall(__NR_io_uring_setup, KK_ASYNC_ENTRIES, &p);
+  if (fd < 0) return;
+  loop->ring_fd = fd;
+  // we need IORING_OP_READ/WRITE (Linux 5.6); fast poll (5.7) is a good proxy and makes sockets efficient
+  if ((p.features & IORING_FEAT_FAST_POLL) == 0) {
+    kk_uring_done(loop);
+    return;
+  }
+  loop->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+  loop->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  const bool single = ((p.features & IORING_FEAT_SINGLE_MMAP) != 0);
+  if (single) {
+    if (loop->cq_ring_size > loop->sq_ring_size) loop->sq_ring_size = loop->cq_ring_size;
+    loop->cq_ring_size = loop->sq_ring_size;
+  }
+  void* sq = mmap(NULL, loop->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (sq == MAP_FAILED) { kk_uring_done(loop); return; }
+  loop->sq_ring = sq;
+  void* cq = sq;
+  if (!single) {
+    cq = mmap(NULL, loop->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (cq == MAP_FAILED) { kk_uring_done(loop); return; }
+  }
+  loop->cq_ring = cq;
+  loop->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+  void* sqes = mmap(NULL, loop->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) { kk_uring_done(loop); return; }
+  loop->sqes = (struct io_uring_sqe*)sqes;
+  uint8_t* const sqp = (uint8_t*)sq;
+  uint8_t* const cqp = (uint8_t*)cq;
+  loop->sq_head  = (_Atomic(uint32_t)*)(sqp + p.sq_off.head);
+  loop->sq_tail  = (_Atomic(uint32_t)*)(sqp + p.sq_off.tail);
+  loop->sq_mask  = (uint32_t*)(sqp + p.sq_off.ring_mask);
+  loop->sq_array = (uint32_t*)(sqp + p.sq_off.array);
+  loop->cq_head  = (_Atomic(uint32_t)*)(cqp + p.cq_off.head);
+  loop->cq_tail  = (_Atomic(uint32_t)*)(cqp + p.cq_off.tail);
+  loop->cq_mask  = (uint32_t*)(cqp + p.cq_off.ring_mask);
+  loop->cqes     = (struct io_uring_cqe*)(cqp + p.cq_off.cqes);
+  loop->sq_entries = p.sq_entries;
+  loop->cq_entries = p.cq_entries;
+}
+
+// Prepare an operation in the submission ring; returns `false` if there is no room.
+static bool kk_uring_prepare(kk_async_loop_t* loop, kk_async_op_t* op) {
+  const uint32_t head = kk_atomic_load_acquire(loop->sq_head);
+  const uint32_t tail = kk_atomic_load_relaxed(loop->sq_tail);
+  if (tail - head >= loop->sq_entries) return false;
+  if (loop->in_flight + loop->to_submit >= loop->cq_entries) return false;  // never overflow the completion ring
+  const uint32_t idx = tail & *loop->sq_mask;
+  struct io_uring_sqe* sqe = &loop->sqes[idx];
+  kk_memset(sqe, 0, sizeof(*sqe));
+  sqe->fd = op->fd;
+  if (op->kind == KK_ASYNC_SLEEP) {
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t)(uintptr_t)&op->ts;
+    sqe->len = 1;
+    sqe->off = 0;   // complete on the timeout only
+  }
+  else {
+    sqe->opcode = (op->kind == KK_ASYNC_READ ? IORING_OP_READ : IORING_OP_WRITE);
+    sqe->addr = (uint64_t)(uintptr_t)op->buf;
+    sqe->len = (uint32_t)op->len;
+    sqe->off = (uint64_t)op->offset;  // -1 uses the current position
+  }
+  sqe->user_data = (uint64_t)(uintptr_t)op;
+  loop->sq_array[idx] = idx;
+  kk_atomic_store_release(loop->sq_tail, tail + 1);
+  loop->to_submit++;
+  return true;
+}
+
+// Submit all prepared operations with one system call and collect the completed ones in `done`.
+static void kk_uring_poll(kk_async_loop_t* loop, bool wait, kk_async_op_t** done) {
+  while (loop->queued != NULL && kk_uring_prepare(loop, loop->queued)) {
+    loop->queued = loop->queued->next;
+    if (loop->queued == NULL) loop->queued_last = NULL;
+  }
+  const bool has_completions = (kk_atomic_load_acquire(loop->cq_tail) != kk_atomic_load_relaxed(loop->cq_head));
+  const bool do_wait = (wait && !has_completions && loop->in_flight + loop->to_submit > 0);
+  if (loop->to_submit > 0 || do_wait) {
+    const int n = (int)syscall(__NR_io_uring_enter, loop->ring_fd, loop->to_submit, (do_wait ? 1 : 0),
+                               (do_wait ? IORING_ENTER_GETEVENTS : 0), NULL, 0);
+    if (n >= 0) {
+      loop->to_submit -= (unsigned)n;
+      loop->in_flight += (unsigned)n;
+    }
+    else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+      kk_warning_message("io_uring_enter failed: %s\n", strerror(errno));
+    }
+  }
+  uint32_t head = kk_atomic_load_relaxed(loop->cq_head);
+  const uint32_t tail = kk_atomic_load_acquire(loop->cq_tail);
+  while (head != tail) {
+    const struct io_uring_cqe* cqe = &loop->cqes[head & *loop->cq_mask];
+    kk_async_op_t* op = (kk_async_op_t*)(uintptr_t)cqe->user_data;
+    op->result = cqe->res;
+    if (op->kind == KK_ASYNC_SLEEP && op->result == -ETIME) op->result = 0;
+    op->next = *done;
+    *done = op;
+    loop->in_flight--;
+    head++;
+  }
+  kk_atomic_store_release(loop->cq_head, head);
+}
+
+#endif
+
+
+/*--------------------------------------------------------------------------------------------------
+  Fallback using `poll`
+--------------------------------------------------------------------------------------------------*/
+
+// Perform a read or write directly.
+static void kk_async_perform(kk_async_op_t* op) {
+  kk_assert_internal(op->kind != KK_ASYNC_SLEEP);
+  uint8_t* buf = (uint8_t*)op->buf;
+  const kk_ssize_t len = op->len;
+  int64_t n;
+#if defined(WIN32)
+  if (op->offset >= 0 && _lseeki64(op->fd, op->offset, SEEK_SET) < 0) { op->result = -errno; return; }
+  n = (op->kind == KK_ASYNC_READ ? _read(op->fd, buf, (unsigned)len) : _write(op->fd, buf, (unsigned)len));
+#else
+  do {
+    if (op->offset >= 0) {
+      n = (op->kind == KK_ASYNC_READ ? pread(op->fd, buf, (size_t)len, (off_t)op->offset)
+                                     : pwrite(op->fd, buf, (size_t)len, (off_t)op->offset));
+    }
+    else {
+      n = (op->kind == KK_ASYNC_READ ? read(op->fd, buf, (size_t)len) : write(op->fd, buf, (size_t)len));
+    }
+  } while (n < 0 && errno == EINTR);
+#endif
+  op->result = (n < 0 ? -(int64_t)errno : n);
+}
+
+static void kk_async_fallback_poll(kk_async_loop_t* loop, bool wait, kk_async_op_t** done, kk_context_t* ctx) {
+  if (loop->queued == NULL) return;
+  kk_ssize_t nfds = 0;
+  kk_timer_t deadline = -1;
+  bool invalid = false;
+  for (kk_async_op_t* op = loop->queued; op != NULL; op = op->next) {
+    if (op->kind != KK_ASYNC_SLEEP) { nfds++; if (op->fd < 0) invalid = true; }
+    else if (deadline < 0 || op->deadline < deadline) deadline = op->deadline;
+  }
+  const kk_timer_t now = kk_timer_start();
+  int timeout = 0;
+  if (wait && !invalid) {  // `poll` ignores negative descriptors so we fail those right away
+    timeout = (deadline < 0 ? -1 : (deadline <= now ? 0 : (int)((deadline - now + 999) / 1000)));
+  }
+#if defined(WIN32)
+  // all reads and writes are ready
+  if (nfds == 0 && timeout > 0) Sleep((DWORD)timeout);
+  for (kk_async_op_t* op = loop->queued; op != NULL; op = op->next) {
+    if (op->kind != KK_ASYNC_SLEEP) kk_async_perform(op);
+  }
+  KK_UNUSED(ctx);
+  uint8_t* ready = NULL;
+#else
+  struct pollfd* fds = NULL;
+  if (nfds > 0) {
+    fds = (struct pollfd*)kk_malloc(nfds * kk_ssizeof(struct pollfd), ctx);
+    kk_ssize_t i = 0;
+    for (kk_async_op_t* op = loop->queued; op != NULL; op = op->next) {
+      if (op->kind == KK_ASYNC_SLEEP) continue;
+      fds[i].fd = op->fd;
+      fds[i].events = (op->kind == KK_ASYNC_READ ? POLLIN : POLLOUT);
+      fds[i].revents = 0;
+      i++;
+    }
+  }
+  int r;
+  do {
+    r = poll(fds, (nfds_t)nfds, timeout);
+  } while (r < 0 && errno == EINTR);
+#endif
+  // move completed operations from the queue to `done`
+  const kk_timer_t after = kk_timer_start();
+  kk_async_op_t** prev = &loop->queued;
+  kk_async_op_t* last = NULL;
+  kk_ssize_t i = 0;
+  while (*prev != NULL) {
+    kk_async_op_t* op = *prev;
+    bool complete;
+    if (op->kind == KK_ASYNC_SLEEP) {
+      complete = (op->deadline <= after);
+      if (complete) op->result = 0;
+    }
+    else {
+#if defined(WIN32)
+      complete = true;
+#else
+      complete = (op->fd < 0 || (r > 0 && fds[i].revents != 0));
+      if (complete) kk_async_perform(op);
+      i++;
+#endif
+    }
+    if (complete) {
+      *prev = op->next;
+      op->next = *done;
+      *done = op;
+    }
+    else {
+      last = op;
+      prev = &op->next;
+    }
+  }
+  loop->queued_last = last;
+#if !defined(WIN32)
+  kk_free(fds);
+#endif
+}
+
+
+/*--------------------------------------------------------------------------------------------------
+  Event loop
+--------------------------------------------------------------------------------------------------*/
+
+static kk_async_loop_t* kk_async_loop(kk_context_t* ctx) {
+  kk_async_loop_t* loop = ctx->async_loop;
+  if (kk_likely(loop != NULL)) return loop;
+  loop = (kk_async_loop_t*)kk_zalloc(kk_ssizeof(kk_async_loop_t), ctx);
+  if (loop == NULL) kk_fatal_error(ENOMEM, "unable to allocate the event loop");
+#if KK_ASYNC_IO_URING
+  kk_uring_init(loop);
+#endif
+  ctx->async_loop = loop;
+  return loop;
+}
+
+bool kk_async_uses_io_uring(kk_context_t* ctx) {
+#if KK_ASYNC_IO_URING
+  return (kk_async_loop(ctx)->ring_fd >= 0);
+#else
+  KK_UNUSED(ctx);
+  return false;
+#endif
+}
+
+static void kk_async_enqueue(kk_async_op_t* op, kk_context_t* ctx) {
+  kk_async_loop_t* loop = kk_async_loop(ctx);
+  loop->pending++;
+  op->next = NULL;
+#if KK_ASYNC_IO_URING
+  // prepare directly in the ring if possible (but keep the order of queued operations)
+  if (loop->ring_fd >= 0 && loop->queued == NULL && kk_uring_prepare(loop, op)) return;
+#endif
+  if (loop->queued_last == NULL) { loop->queued = op; }
+                            else { loop->queued_last->next = op; }
+  loop->queued_last = op;
+}
+
+static kk_async_op_t* kk_async_op_alloc(kk_async_kind_t kind, int fd, int64_t offset, kk_function_t cont, kk_context_t* ctx) {
+  kk_async_op_t* op = (kk_async_op_t*)kk_zalloc(kk_ssizeof(kk_async_op_t), ctx);
+  if (op == NULL) kk_fatal_error(ENOMEM, "unable to allocate an asynchronous operation");
+  op->kind = kind;
+  op->fd = fd;
+  op->offset = (offset < 0 ? -1 : offset);
+  op->data = kk_bytes_empty();
+  op->cont = cont;
+  return op;
+}
+
+void kk_async_read(int fd, kk_ssize_t len, int64_t offset, kk_function_t cont, kk_context_t* ctx) {
+  if (len < 0) len = 0;
+  if (len > INT32_MAX) len = INT32_MAX;
+  kk_async_op_t* op = kk_async_op_alloc(KK_ASYNC_READ, fd, offset, cont, ctx);
+  uint8_t* buf;
+  op->data = kk_bytes_alloc_buf(len, &buf, ctx);
+  op->buf = buf;
+  op->len = len;
+  kk_async_enqueue(op, ctx);
+}
+
+void kk_async_write(int fd, kk_string_t data, int64_t offset, kk_function_t cont, kk_context_t* ctx) {
+  kk_async_op_t* op = kk_async_op_alloc(KK_ASYNC_WRITE, fd, offset, cont, ctx);
+  kk_ssize_t len;
+  op->buf = kk_string_buf_borrow(data, &len);
+  op->data = data.bytes;
+  op->len = (len > INT32_MAX ? INT32_MAX : len);
+  kk_async_enqueue(op, ctx);
+}
+
+void kk_async_sleep(kk_msecs_t msecs, kk_function_t cont, kk_context_t* ctx) {
+  if (msecs < 0) msecs = 0;
+  kk_async_op_t* op = kk_async_op_alloc(KK_ASYNC_SLEEP, -1, 0, cont, ctx);
+  op->deadline = kk_timer_start() + 1000*msecs;
+#if KK_ASYNC_IO_URING
+  op->ts.tv_sec = msecs / 1000;
+  op->ts.tv_nsec = (msecs % 1000) * 1000000;
+#endif
+  kk_async_enqueue(op, ctx);
+}
+
+// Call the continuation of a completed operation.
+static void kk_async_complete(kk_async_loop_t* loop, kk_async_op_t* op, kk_context_t* ctx) {
+  kk_string_t data;
+  if (op->kind == KK_ASYNC_READ) {
+    kk_bytes_t b = kk_bytes_adjust_length(op->data, (op->result > 0 ? (kk_ssize_t)op->result : 0), ctx);
+    data = kk_string_convert_from_qutf8(b, ctx);
+  }
+  else {
+    kk_bytes_drop(op->data, ctx);
+    data = kk_string_empty();
+  }
+  kk_function_t cont = op->cont;
+  const int64_t result = op->result;
+  kk_free(op);
+  loop->pending--;
+  kk_box_t res = kk_function_call(kk_box_t, (kk_function_t, kk_box_t, kk_box_t, kk_context_t*), cont,
+                                  (cont, kk_integer_box(kk_integer_from_int64(result, ctx)), kk_string_box(data), ctx));
+  kk_box_drop(res, ctx);
+}
+
+kk_ssize_t kk_async_poll(bool wait, kk_context_t* ctx) {
+  kk_async_loop_t* loop = kk_async_loop(ctx);
+  if (loop->pending == 0) return 0;
+  kk_async_op_t* done = NULL;
+#if KK_ASYNC_IO_URING
+  if (loop->ring_fd >= 0) {
+    kk_uring_poll(loop, wait, &done);
+  }
+  else
+#endif
+  {
+    kk_async_fallback_poll(loop, wait, &done, ctx);
+  }
+  // run the continuations in submission order
+  kk_async_op_t* ordered = NULL;
+  while (done != NULL) {
+    kk_async_op_t* next = done->next;
+    done->next = ordered;
+    ordered = done;
+    done = next;
+  }
+  kk_ssize_t count = 0;
+  while (ordered != NULL) {
+    kk_async_op_t* next = ordered->next;
+    kk_async_complete(loop, ordered, ctx);
+    ordered = next;
+    count++;
+  }
+  return count;
+}
+
+void kk_async_run(kk_context_t* ctx) {
+  while (kk_async_pending(ctx) > 0) {
+    kk_async_poll(true, ctx);
+  }
+}
+
+kk_ssize_t kk_async_pending(kk_context_t* ctx) {
+  return (ctx->async_loop == NULL ? 0 : ctx->async_loop->pending);
+}
+
+void kk_async_loop_done(kk_context_t* ctx) {
+  kk_async_loop_t* loop = ctx->async_loop;
+  if (loop == NULL) return;
+  // drop operations that were never submitted; submitted operations are leaked
+  // since the kernel may still write into their buffers.
+  kk_async_op_t* op = loop->queued;
+  while (op != NULL) {
+    kk_async_op_t* next = op->next;
+    kk_bytes_drop(op->data, ctx);
+    kk_function_drop(op->cont, ctx);
+    kk_free(op);
+    op = next;
+  }
+#if KK_ASYNC_IO_URING
+  if (loop->ring_fd >= 0) kk_uring_done(loop);
+#endif
+  kk_free(loop);
+  ctx->async_loop = NULL;
+}
@@ -60,62 +60,7 @@ double kk_double_unbox(kk_box_t b, kk_context_t* ctx) {
   // if (isnan(d)) { kk_debugger_break(ctx); }
   return d;
 }
-#else
-kk_box_t kk_double_box(double d, kk_context_t* ctx) {
-  KK_UNUSED(ctx);
-  uint64_t u;
-  memcpy(&u, &d, sizeof(u));  // safe for C aliasing
-  u = kk_bits_rotl64(u, 12);
-  uint64_t exp = u & 0x7FF;
-  u -= exp;
-  // adjust to 10-bit exponent (if possible)
-  if (exp==0) {
-    // already good
-  }
-  else if (exp==0x7FF) {
-    exp = 0x3FF;
-  }
-  else if (exp > 0x200 && exp < 0x5FF) {
-    exp -= 0x200;
-  }
-  else {
-    // outside our range, heap allocate (outside [2^-510,2^512) and not 0, subnormal, NaN or Inf)
-    return kk_double_box_heap(d, ctx);
-  }
-  kk_assert_internal(exp <= 0x3FF);
-  kk_box_t b = { (u | (exp<<1) | 1) };
-  return b;
-}
-
-double kk_double_unbox(kk_box_t b, kk_context_t* ctx) {
-  KK_UNUSED(ctx);
-  if (kk_box_is_value(b)) {
-    // expand 10-bit exponent to 11-bits again
-    uint64_t u = b.box;
-    uint64_t exp = u & 0x7FF;
-    u -= exp;    // clear lower 11 bits
-    exp >>= 1;
-    if (exp == 0) {
-      // ok
-    }
-    else if (exp==0x3FF) {
-      exp = 0x7FF;
-    }
-    else {
-      exp += 0x200;
-    }
-    kk_assert_internal(exp <= 0x7FF);
-    u = kk_bits_rotr64(u | exp, 12);
-    double d;
-    memcpy(&d, &u, sizeof(d)); // safe for C aliasing: see <https://gist.github.com/shafik/848ae25ee209f698763cffee272a58f8#how-do-we-type-pun-correctly>
-    return d;
-  }
-  else {
-    // heap allocated
-    return kk_double_unbox_heap(b, ctx);
-  }
-}
-#endif
+#endif  // the default encoding (A2) is inline in `box.h`
 
 #elif (KK_INTPTR_SIZE==8) && KK_USE_NAN_BOX 
 
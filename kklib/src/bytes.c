@@ -12,6 +12,20 @@
 --------------------------------------------------------------------------------------------------*/
 
 
+// Static small bytes for each single ascii byte (see `kk_bytes_from_ascii`):
+// the byte is followed by a zero terminator and 0xFF padding.
+#ifdef KK_ARCH_LITTLE_ENDIAN
+#define KK_BYTES_ASCII1(c)   { { { KK_HEADER_STATIC(0,KK_TAG_BYTES_SMALL) } }, { KU64(0xFFFFFFFFFFFF0000) | (uint64_t)(c) } }
+#else
+#define KK_BYTES_ASCII1(c)   { { { KK_HEADER_STATIC(0,KK_TAG_BYTES_SMALL) } }, { KU64(0x0000FFFFFFFFFFFF) | ((uint64_t)(c) << 56) } }
+#endif
+#define KK_BYTES_ASCII4(c)   KK_BYTES_ASCII1(c), KK_BYTES_ASCII1(c+1), KK_BYTES_ASCII1(c+2), KK_BYTES_ASCII1(c+3)
+#define KK_BYTES_ASCII16(c)  KK_BYTES_ASCII4(c), KK_BYTES_ASCII4(c+4), KK_BYTES_ASCII4(c+8), KK_BYTES_ASCII4(c+12)
+#define KK_BYTES_ASCII64(c)  KK_BYTES_ASCII16(c), KK_BYTES_ASCII16(c+16), KK_BYTES_ASCII16(c+32), KK_BYTES_ASCII16(c+48)
+
+struct kk_bytes_small_s kk_bytes_ascii[128] = { KK_BYTES_ASCII64(0), KK_BYTES_ASCII64(64) };
+
+
 // Allocate `len` bytes.
 // If (p /= NULL) then initialize with at most `min(len,plen)` bytes from `p`, which must point to at least `plen` valid bytes. 
 // Adds a terminating zero at the end. Return the raw buffer pointer in `buf` if non-NULL
@@ -39,6 +53,7 @@ kk_decl_export kk_decl_noinline kk_bytes_t kk_bytes_alloc_len(kk_ssize_t len, kk
       kk_memcpy(&b->buf[0], p, plen);
     }
     b->length = len;
+    b->hash = 0;
     b->buf[len] = 0;
     if (buf != NULL) *buf = &b->buf[0];
     // todo: kk_assert valid utf-8 in debug mode
@@ -47,6 +62,72 @@ kk_decl_export kk_decl_noinline kk_bytes_t kk_bytes_alloc_len(kk_ssize_t len, kk
 }
 
 
+// The capacity to reserve when growing a buffer in place to `len` bytes, rounded up
+// to the top two bits of `len`: growing by appending copies each byte a constant number of times.
+static kk_ssize_t kk_bytes_grow_capacity(kk_ssize_t len) {
+  kk_assert_internal(len > 0);
+  const int bits = (int)(KK_INTX_BITS - 1 - kk_bits_clz((kk_uintx_t)len));
+  if (bits < 4) return 16;
+  const kk_ssize_t unit = ((kk_ssize_t)1 << (bits - 1));
+  return (len + unit - 1) & ~(unit - 1);
+}
+
+// Can we grow `b` in place?
+static bool kk_bytes_can_grow(kk_bytes_t b) {
+  return (kk_datatype_is_unique(b) && kk_datatype_has_tag(b, KK_TAG_BYTES));
+}
+
+// Grow a unique bytes buffer to `newlen` bytes in place (using `realloc`); the new bytes are not initialized.
+static kk_bytes_t kk_bytes_grow(kk_bytes_t b, kk_ssize_t newlen, kk_context_t* ctx) {
+  kk_assert_internal(kk_bytes_can_grow(b));
+  kk_bytes_normal_t nb = kk_datatype_as_assert(kk_bytes_normal_t, b, KK_TAG_BYTES);
+  kk_assert_internal(newlen > nb->length);
+  const kk_ssize_t size = kk_ssizeof(struct kk_bytes_normal_s) - 1 /* char b[1] */ + newlen + 1 /* 0 terminator */;
+  #if KK_MALLOC_USABLE_SIZE
+  const bool fits = (!kk_block_is_arena(&nb->_base._block) && kk_malloc_usable_size(nb) >= (size_t)size);
+  #else
+  const bool fits = false;
+  #endif
+  if (!fits) {
+    const kk_ssize_t cap = kk_bytes_grow_capacity(newlen);
+    nb = (kk_bytes_normal_t)kk_block_realloc(&nb->_base._block, size + (cap - newlen), ctx);
+  }
+  nb->length = newlen;
+  nb->hash = 0;
+  nb->buf[newlen] = 0;
+  return kk_datatype_from_base(&nb->_base);
+}
+
+void kk_bytes_view_free(void* p, kk_block_t* b) {
+  KK_UNUSED(p);
+  kk_bytes_view_t view = (kk_bytes_view_t)b;
+  kk_bytes_drop(view->parent, kk_get_context());
+}
+
+kk_bytes_t kk_bytes_alloc_view(kk_bytes_t parent, kk_ssize_t start, kk_ssize_t len, kk_context_t* ctx) {
+  kk_ssize_t plen;
+  const uint8_t* p = kk_bytes_buf_borrow(parent, &plen);
+  kk_assert_internal(start >= 0 && len >= 0 && start + len <= plen);
+  if (start == 0 && len == plen) {
+    return kk_bytes_dup(parent);
+  }
+  else if (len < KK_BYTES_VIEW_MIN || kk_block_is_arena(kk_datatype_as_ptr(parent))) {
+    // copy short parts, and parts of an arena block (as the arena can be released before the view)
+    return kk_bytes_alloc_dupn(len, p + start, ctx);
+  }
+  if (kk_bytes_is_view_borrow(parent)) {
+    // point directly into the parent of a view
+    parent = kk_datatype_as_assert(kk_bytes_view_t, parent, KK_TAG_BYTES_RAW)->parent;
+  }
+  kk_block_mark_shared(kk_datatype_as_ptr(parent), ctx);
+  kk_bytes_view_t view = kk_block_alloc_as(struct kk_bytes_view_s, 0, KK_TAG_BYTES_RAW, ctx);
+  view->free = &kk_bytes_view_free;
+  view->cbuf = p + start;
+  view->length = len;
+  view->parent = kk_bytes_dup(parent);
+  return kk_datatype_from_base(&view->_base);
+}
+
 kk_bytes_t kk_bytes_adjust_length(kk_bytes_t b, kk_ssize_t newlen, kk_context_t* ctx) {
   if (newlen<=0) {
     kk_bytes_drop(b, ctx);
@@ -63,6 +144,7 @@ kk_bytes_t kk_bytes_adjust_length(kk_bytes_t b, kk_ssize_t newlen, kk_context_t*
     kk_assert_internal(kk_datatype_has_tag(b, KK_TAG_BYTES) && kk_datatype_is_unique(b));
     kk_bytes_normal_t nb = kk_datatype_as_assert(kk_bytes_normal_t, b, KK_TAG_BYTES);
     nb->length = newlen;
+    nb->hash = 0;
     nb->buf[newlen] = 0;
     // kk_assert_internal(kk_bytes_is_valid(kk_bytes_dup(s),ctx));
     return b;
@@ -73,6 +155,12 @@ kk_bytes_t kk_bytes_adjust_length(kk_bytes_t b, kk_ssize_t newlen, kk_context_t*
     kk_bytes_drop(b, ctx);
     return tb;
   }
+  else if (kk_bytes_can_grow(b)) {
+    // grow in place
+    kk_bytes_t tb = kk_bytes_grow(b, newlen, ctx);
+    kk_memset((uint8_t*)kk_bytes_buf_borrow(tb, NULL) + len, 0, newlen - len);
+    return tb;
+  }
   else {
     // full copy
     kk_assert_internal(newlen > len);
@@ -90,17 +178,6 @@ kk_bytes_t kk_bytes_adjust_length(kk_bytes_t b, kk_ssize_t newlen, kk_context_t*
   Compare
 --------------------------------------------------------------------------------------------------*/
 
-const uint8_t* kk_memmem(const uint8_t* p, kk_ssize_t plen, const uint8_t* pat, kk_ssize_t patlen) {
-  // todo: optimize search algo?
-  kk_assert(p != NULL && pat != NULL);
-  if (plen <= 0 || patlen <= 0 || patlen > plen) return NULL;
-  const uint8_t* end = p + (plen - (patlen-1));
-  for (; p < end; p++) {
-    if (kk_memcmp(p, pat, patlen) == 0) return p;
-  }
-  return NULL;
-}
-
 int kk_bytes_cmp_borrow(kk_bytes_t b1, kk_bytes_t b2) {
   if (kk_bytes_ptr_eq_borrow(b1, b2)) return 0;
   kk_ssize_t len1;
@@ -124,6 +201,325 @@ int kk_bytes_cmp(kk_bytes_t b1, kk_bytes_t b2, kk_context_t* ctx) {
 }
 
 
+/*--------------------------------------------------------------------------------------------------
+  Hash
+  A multiply-rotate hash over 8 byte words in two independent lanes, followed by the
+  murmur3 finalizer. The hash is only stable within a single process.
+--------------------------------------------------------------------------------------------------*/
+
+#define KK_HASH_K1  KU64(0x9E3779B97F4A7C15)
+#define KK_HASH_K2  KU64(0xC2B2AE3D27D4EB4F)
+
+static inline uint64_t kk_hash_read64(const uint8_t* p) {
+  uint64_t x;
+  kk_memcpy(&x, p, 8);
+  return x;
+}
+
+static inline uint64_t kk_hash_step(uint64_t h, uint64_t x, uint64_t k) {
+  return kk_bits_rotl64((h ^ x) * k, 31);
+}
+
+static uint32_t kk_hash_buf(const uint8_t* p, kk_ssize_t len) {
+  uint64_t h1 = KK_HASH_K2 ^ ((uint64_t)len * KK_HASH_K1);
+  uint64_t h2 = KK_HASH_K1;
+  kk_ssize_t n = len;
+  for (; n >= 16; n -= 16, p += 16) {
+    h1 = kk_hash_step(h1, kk_hash_read64(p), KK_HASH_K1);
+    h2 = kk_hash_step(h2, kk_hash_read64(p + 8), KK_HASH_K2);
+  }
+  if (n >= 8) {
+    h1 = kk_hash_step(h1, kk_hash_read64(p), KK_HASH_K1);
+    n -= 8; p += 8;
+  }
+  if (n > 0) {
+    uint64_t x = 0;
+    kk_memcpy(&x, p, n);
+    h2 = kk_hash_step(h2, x, KK_HASH_K2);
+  }
+  uint64_t h = h1 ^ kk_bits_rotl64(h2, 17);
+  h ^= (h >> 33);
+  h *= KU64(0xFF51AFD7ED558CCD);
+  h ^= (h >> 33);
+  h *= KU64(0xC4CEB9FE1A85EC53);
+  h ^= (h >> 33);
+  const uint32_t h32 = (uint32_t)h;
+  return (h32 == 0 ? 1 : h32);
+}
+
+uint32_t kk_bytes_hash_borrow(kk_bytes_t b) {
+  const uint32_t cached = kk_bytes_cached_hash_borrow(b);
+  if (cached != 0) return cached;
+  kk_ssize_t len;
+  const uint8_t* p = kk_bytes_buf_borrow(b, &len);
+  const uint32_t h = kk_hash_buf(p, len);
+  if (kk_datatype_has_tag(b, KK_TAG_BYTES)) {
+    // racing threads write the same value
+    kk_bytes_normal_t bn = kk_datatype_as_assert(kk_bytes_normal_t, b, KK_TAG_BYTES);
+    kk_atomic_store_relaxed((_Atomic(uint32_t)*)&bn->hash, h);
+  }
+  return h;
+}
+
+
+/*--------------------------------------------------------------------------------------------------
+  Search
+  We first use a filter on the first and last byte of the pattern (with SSE2 on x64, and
+  `memchr` otherwise) and verify each candidate. When the filter finds too many false
+  candidates we switch to the two-way algorithm of Crochemore and Perrin [1] which is
+  linear in the worst case and needs no extra space. A reverse search is a forward
+  search over the reversed input with the reversed pattern.
+  [1] Maxime Crochemore and Dominique Perrin, "Two-way string-matching", JACM 38(3), 1991.
+--------------------------------------------------------------------------------------------------*/
+
+// index the pattern and input in the direction of the search
+#define KK_PAT(i)   (rev ? pat[m-1-(i)] : pat[i])
+#define KK_TXT(i)   (rev ? y[n-1-(i)] : y[i])
+
+// The maximal suffix of the pattern (for the reversed byte order if `flip`):
+// returns its start minus one and its period in `*period`.
+static kk_ssize_t kk_twoway_max_suffix(const uint8_t* pat, kk_ssize_t m, bool rev, bool flip, kk_ssize_t* period) {
+  kk_ssize_t ms = -1;
+  kk_ssize_t j = 0;
+  kk_ssize_t k = 1;
+  kk_ssize_t p = 1;
+  while (j + k < m) {
+    const uint8_t a = KK_PAT(j + k);
+    const uint8_t b = KK_PAT(ms + k);
+    if (flip ? (a > b) : (a < b)) {
+      j += k;
+      k = 1;
+      p = j - ms;
+    }
+    else if (a == b) {
+      if (k != p) { k++; }
+             else { j += p; k = 1; }
+    }
+    else {
+      ms = j;
+      j = ms + 1;
+      k = p = 1;
+    }
+  }
+  *period = p;
+  return ms;
+}
+
+void kk_memsearch_init(kk_memsearch_t* ms, const uint8_t* pat, kk_ssize_t patlen, bool reverse) {
+  ms->pat = pat;
+  ms->patlen = patlen;
+  ms->reverse = reverse;
+  ms->periodic = false;
+  ms->ell = -1;
+  ms->per = 1;
+  if (patlen <= 0) return;
+  // critical factorization
+  const bool rev = reverse;
+  const kk_ssize_t m = patlen;
+  kk_ssize_t p, q;
+  const kk_ssize_t i = kk_twoway_max_suffix(pat, m, rev, false, &p);
+  const kk_ssize_t j = kk_twoway_max_suffix(pat, m, rev, true, &q);
+  ms->ell = (i > j ? i : j);
+  ms->per = (i > j ? p : q);
+  // periodic if the left part is a suffix of `pat[0 .. per + ell]`
+  kk_assert_internal(ms->per + ms->ell + 1 <= m);
+  bool periodic = true;
+  for (kk_ssize_t k = 0; k <= ms->ell && periodic; k++) {
+    periodic = (KK_PAT(k) == KK_PAT(k + ms->per));
+  }
+  ms->periodic = periodic;
+  if (!periodic) {
+    ms->per = (ms->ell + 1 > m - ms->ell - 1 ? ms->ell + 1 : m - ms->ell - 1) + 1;
+  }
+}
+
+// Two-way search for the pattern in `y[0..n)` (in the search direction) starting from index `j`.
+// Returns the index of the match in the search direction, or -1 if not found.
+static inline kk_ssize_t kk_twoway_search(const kk_memsearch_t* ms, const uint8_t* y, kk_ssize_t n, kk_ssize_t j, const bool rev) {
+  const uint8_t* const pat = ms->pat;
+  const kk_ssize_t m   = ms->patlen;
+  const kk_ssize_t ell = ms->ell;
+  const kk_ssize_t per = ms->per;
+  if (ms->periodic) {
+    kk_ssize_t memory = -1;  // prefix of the pattern known to match
+    while (j <= n - m) {
+      kk_ssize_t i = (ell > memory ? ell : memory) + 1;
+      while (i < m && KK_PAT(i) == KK_TXT(i + j)) { i++; }
+      if (i >= m) {
+        i = ell;
+        while (i > memory && KK_PAT(i) == KK_TXT(i + j)) { i--; }
+        if (i <= memory) return j;
+        j += per;
+        memory = m - per - 1;
+      }
+      else {
+        j += (i - ell);
+        memory = -1;
+      }
+    }
+  }
+  else {
+    while (j <= n - m) {
+      kk_ssize_t i = ell + 1;
+      while (i < m && KK_PAT(i) == KK_TXT(i + j)) { i++; }
+      if (i >= m) {
+        i = ell;
+        while (i >= 0 && KK_PAT(i) == KK_TXT(i + j)) { i--; }
+        if (i < 0) return j;
+        j += per;
+      }
+      else {
+        j += (i - ell);
+      }
+    }
+  }
+  return -1;
+}
+
+static kk_ssize_t kk_twoway_search_fwd(const kk_memsearch_t* ms, const uint8_t* y, kk_ssize_t n, kk_ssize_t j) {
+  return kk_twoway_search(ms, y, n, j, false);
+}
+
+static kk_ssize_t kk_twoway_search_rev(const kk_memsearch_t* ms, const uint8_t* y, kk_ssize_t n, kk_ssize_t j) {
+  return kk_twoway_search(ms, y, n, j, true);
+}
+
+#undef KK_PAT
+#undef KK_TXT
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define KK_MEMSEARCH_SSE2  1
+#include <emmintrin.h>
+#endif
+
+// Verify a candidate where the first and last byte already match.
+static inline bool kk_memsearch_verify(const uint8_t* s, const uint8_t* pat, kk_ssize_t m) {
+  return (m <= 2 || kk_memcmp(s + 1, pat + 1, m - 2) == 0);
+}
+
+// The work allowed for verifying false candidates after `k` bytes before switching to two-way.
+static inline bool kk_memsearch_over_budget(kk_ssize_t work, kk_ssize_t k) {
+  return (work > 4*k + 4096);
+}
+
+// Search forward with the byte filter; returns `false` if there were too many false
+// candidates, in which case the search should continue with two-way from `*next`.
+static bool kk_memsearch_filter_fwd(const kk_memsearch_t* ms, const uint8_t* s, kk_ssize_t n, const uint8_t** found, kk_ssize_t* next) {
+  const uint8_t* const pat = ms->pat;
+  const kk_ssize_t m = ms->patlen;
+  const uint8_t first = pat[0];
+  const uint8_t last  = pat[m-1];
+  const kk_ssize_t kmax = n - m;   // the last candidate
+  kk_ssize_t work = 0;
+  kk_ssize_t i = 0;
+  #if defined(KK_MEMSEARCH_SSE2)
+  const __m128i vfirst = _mm_set1_epi8((char)first);
+  const __m128i vlast  = _mm_set1_epi8((char)last);
+  for (; i + 15 <= kmax; i += 16) {
+    // candidates `i .. i+15`
+    const __m128i a = _mm_cmpeq_epi8(vfirst, _mm_loadu_si128((const __m128i*)(s + i)));
+    const __m128i b = _mm_cmpeq_epi8(vlast, _mm_loadu_si128((const __m128i*)(s + i + m - 1)));
+    uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_and_si128(a, b));
+    while (mask != 0) {
+      const kk_ssize_t k = i + kk_bits_ctz32(mask);
+      if (kk_memsearch_verify(s + k, pat, m)) { *found = s + k; return true; }
+      work += m;
+      if (kk_memsearch_over_budget(work, k)) { *next = k + 1; return false; }
+      mask &= (mask - 1);
+    }
+  }
+  #endif
+  while (i <= kmax) {
+    const uint8_t* p = (const uint8_t*)memchr(s + i, first, kk_to_size_t(kmax - i + 1));
+    if (p == NULL) break;
+    const kk_ssize_t k = (p - s);
+    if (p[m-1] == last) {
+      if (kk_memsearch_verify(p, pat, m)) { *found = p; return true; }
+      work += m;
+    }
+    work += 8;   // account for calling `memchr` on each first byte
+    if (kk_memsearch_over_budget(work, k)) { *next = k + 1; return false; }
+    i = k + 1;
+  }
+  *found = NULL;
+  return true;
+}
+
+// Search backward with the byte filter; returns `false` if there were too many false
+// candidates, in which case the search should continue with two-way from `*next` (in the reversed input).
+static bool kk_memsearch_filter_rev(const kk_memsearch_t* ms, const uint8_t* s, kk_ssize_t n, const uint8_t** found, kk_ssize_t* next) {
+  const uint8_t* const pat = ms->pat;
+  const kk_ssize_t m = ms->patlen;
+  const uint8_t first = pat[0];
+  const uint8_t last  = pat[m-1];
+  kk_ssize_t work = 0;
+  kk_ssize_t i = n - m;   // the last candidate
+  #if defined(KK_MEMSEARCH_SSE2)
+  const __m128i vfirst = _mm_set1_epi8((char)first);
+  const __m128i vlast  = _mm_set1_epi8((char)last);
+  for (; i >= 15; i -= 16) {
+    // candidates `i-15 .. i`
+    const uint8_t* const base = s + i - 15;
+    const __m128i a = _mm_cmpeq_epi8(vfirst, _mm_loadu_si128((const __m128i*)base));
+    const __m128i b = _mm_cmpeq_epi8(vlast, _mm_loadu_si128((const __m128i*)(base + m - 1)));
+    uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_and_si128(a, b));
+    while (mask != 0) {
+      const int bit = 31 - kk_bits_clz32(mask);
+      const uint8_t* const p = base + bit;
+      if (kk_memsearch_verify(p, pat, m)) { *found = p; return true; }
+      work += m;
+      if (kk_memsearch_over_budget(work, n - (p - s))) { *next = n - (p - s) - m + 1; return false; }
+      mask &= ~(KU32(1) << bit);
+    }
+  }
+  #endif
+  for (; i >= 0; i--) {
+    const uint8_t* const p = s + i;
+    if (p[0] == first && p[m-1] == last) {
+      if (kk_memsearch_verify(p, pat, m)) { *found = p; return true; }
+      work += m;
+      if (kk_memsearch_over_budget(work, n - i)) { *next = n - i - m + 1; return false; }
+    }
+  }
+  *found = NULL;
+  return true;
+}
+
+const uint8_t* kk_memsearch_find(const kk_memsearch_t* ms, const uint8_t* p, kk_ssize_t plen) {
+  kk_assert(p != NULL && ms->pat != NULL);
+  const kk_ssize_t m = ms->patlen;
+  if (plen <= 0 || m <= 0 || m > plen) return NULL;
+  if (m == 1 && !ms->reverse) {
+    return (const uint8_t*)memchr(p, ms->pat[0], kk_to_size_t(plen));
+  }
+  kk_ssize_t j = 0;  // start of the two-way search
+  const uint8_t* found;
+  if (ms->reverse ? kk_memsearch_filter_rev(ms, p, plen, &found, &j) : kk_memsearch_filter_fwd(ms, p, plen, &found, &j)) {
+    return found;
+  }
+  if (ms->reverse) {
+    const kk_ssize_t i = kk_twoway_search_rev(ms, p, plen, j);
+    return (i < 0 ? NULL : p + (plen - i - m));
+  }
+  else {
+    const kk_ssize_t i = kk_twoway_search_fwd(ms, p, plen, j);
+    return (i < 0 ? NULL : p + i);
+  }
+}
+
+const uint8_t* kk_memmem(const uint8_t* p, kk_ssize_t plen, const uint8_t* pat, kk_ssize_t patlen) {
+  kk_memsearch_t ms;
+  kk_memsearch_init(&ms, pat, patlen, false);
+  return kk_memsearch_find(&ms, p, plen);
+}
+
+const uint8_t* kk_memrmem(const uint8_t* p, kk_ssize_t plen, const uint8_t* pat, kk_ssize_t patlen) {
+  kk_memsearch_t ms;
+  kk_memsearch_init(&ms, pat, patlen, true);
+  return kk_memsearch_find(&ms, p, plen);
+}
+
+
 /*--------------------------------------------------------------------------------------------------
   Utilities
 --------------------------------------------------------------------------------------------------*/
@@ -136,30 +532,21 @@ kk_ssize_t kk_decl_pure kk_bytes_count_pattern_borrow(kk_bytes_t b, kk_bytes_t p
   if (patlen <= 0)  return kk_bytes_len_borrow(b);
   if (patlen > len) return 0;
   
-  //todo: optimize by doing backward Boyer-Moore? or use forward Knuth-Morris-Pratt?
+  kk_memsearch_t ms;
+  kk_memsearch_init(&ms, pat, patlen, false);
   kk_ssize_t count = 0;
-  const uint8_t* end = s + (len - (patlen - 1));
-  for (const uint8_t* p = s; p < end; p++) {
-    if (kk_memcmp(p, pat, patlen) == 0) {
-      count++;
-      p += (patlen - 1);
-    }    
+  const uint8_t* const end = s + len;
+  for (const uint8_t* p = s; (p = kk_memsearch_find(&ms, p, end - p)) != NULL; p += patlen) {
+    count++;
   }
   return count;
 }
 
 
 kk_bytes_t kk_bytes_cat(kk_bytes_t b1, kk_bytes_t b2, kk_context_t* ctx) {
-  kk_ssize_t len1;
-  const uint8_t* s1 = kk_bytes_buf_borrow(b1, &len1);
   kk_ssize_t len2;
   const uint8_t* s2 = kk_bytes_buf_borrow(b2, &len2);
-  uint8_t* p;
-  kk_bytes_t t = kk_bytes_alloc_buf(len1 + len2, &p, ctx );
-  kk_memcpy(p, s1, len1);
-  kk_memcpy(p+len1, s2, len2);
-  kk_assert_internal(p[len1+len2] == 0);
-  kk_bytes_drop(b1, ctx);
+  kk_bytes_t t = kk_bytes_cat_from_buf(b1, len2, s2, ctx);
   kk_bytes_drop(b2, ctx);
   return t;
 }
@@ -168,6 +555,12 @@ kk_bytes_t kk_bytes_cat_from_buf(kk_bytes_t b1, kk_ssize_t len2, const uint8_t*
   if (b2 == NULL || len2 <= 0) return b1;
   kk_ssize_t len1;
   const uint8_t* s1 = kk_bytes_buf_borrow(b1,&len1);
+  if (kk_bytes_can_grow(b1) && !(b2 >= s1 && b2 <= s1 + len1)) {
+    // append in place (unless `b2` points into `b1`)
+    kk_bytes_t t = kk_bytes_grow(b1, len1 + len2, ctx);
+    kk_memcpy((uint8_t*)kk_bytes_buf_borrow(t, NULL) + len1, b2, len2);
+    return t;
+  }
   uint8_t* p;
   kk_bytes_t t = kk_bytes_alloc_buf(len1 + len2, &p, ctx);
   kk_memcpy(p, s1, len1);
@@ -190,11 +583,14 @@ kk_vector_t kk_bytes_splitv_atmost(kk_bytes_t b, kk_bytes_t sepb, kk_ssize_t n,
   kk_ssize_t seplen;
   const uint8_t* sep = kk_bytes_buf_borrow(sepb, &seplen);
 
+  kk_memsearch_t ms;
+  kk_memsearch_init(&ms, sep, seplen, false);
+
   // count parts
   kk_ssize_t count = 1;
   if (seplen > 0) {    
     const uint8_t* p = s;
-    while (count < n && (p = kk_memmem(p, end - p, sep, seplen)) != NULL) {
+    while (count < n && (p = kk_memsearch_find(&ms, p, end - p)) != NULL) {
       p += seplen;
       count++;
     }
@@ -212,18 +608,18 @@ kk_vector_t kk_bytes_splitv_atmost(kk_bytes_t b, kk_bytes_t sepb, kk_ssize_t n,
   for (kk_ssize_t i = 0; i < (count-1) && p < end; i++) {
     const uint8_t* r;
     if (seplen > 0) {
-      r = kk_memmem(p, end - p,  sep, seplen);
+      r = kk_memsearch_find(&ms, p, end - p);
     }
     else {
       r = p + 1;
     }
     kk_assert_internal(r != NULL && r >= p && r < end);    
     const kk_ssize_t partlen = (r - p);
-    v[i] = kk_bytes_box(kk_bytes_alloc_dupn(partlen, p, ctx));
+    v[i] = kk_bytes_box(kk_bytes_alloc_view(b, p - s, partlen, ctx));
     p = r + seplen;  // advance
   }
   kk_assert_internal(p <= end);
-  v[count-1] = kk_bytes_box(kk_bytes_alloc_dupn(end - p, p, ctx));  // todo: share bytes if p == s ?
+  v[count-1] = kk_bytes_box(kk_bytes_alloc_view(b, p - s, end - p, ctx));
   kk_bytes_drop(b,ctx);
   kk_bytes_drop(sepb, ctx);
   return vec;
@@ -233,6 +629,8 @@ kk_bytes_t kk_bytes_replace_all(kk_bytes_t s, kk_bytes_t pat, kk_bytes_t rep, kk
   return kk_bytes_replace_atmost(s, pat, rep, KK_SSIZE_MAX, ctx);
 }
 
+#define KK_REPLACE_MATCHES_STACK  (64)   // match positions remembered without allocation
+
 kk_bytes_t kk_bytes_replace_atmost(kk_bytes_t s, kk_bytes_t pat, kk_bytes_t rep, kk_ssize_t n, kk_context_t* ctx) {
   kk_bytes_t t = s;
   if (!(n<=0 || kk_bytes_is_empty_borrow(s) || kk_bytes_is_empty_borrow(pat)))
@@ -245,24 +643,47 @@ kk_bytes_t kk_bytes_replace_atmost(kk_bytes_t s, kk_bytes_t pat, kk_bytes_t rep,
     const uint8_t* prep = kk_bytes_buf_borrow(rep, &prep_len);
     
     const uint8_t* const pend = p + plen;
-    // if unique s && |rep| == |pat|, update in-place
-    // TODO: if unique s & |rep| <= |pat|, maybe update in-place if not too much waste?
-    if (kk_datatype_is_unique(s) && ppat_len == prep_len) {
+    kk_memsearch_t ms;
+    kk_memsearch_init(&ms, ppat, ppat_len, false);
+    if (kk_bytes_is_unique_owned(s) && prep_len <= ppat_len) {
+      // if unique s && |rep| <= |pat|, update in-place in a single pass (as the result never overtakes the input)
+      uint8_t* q = (uint8_t*)p;
       kk_ssize_t count = 0;
-      while (count < n && p < pend) {
-        const uint8_t* r = kk_memmem(p, pend - p, ppat, ppat_len);
-        if (r == NULL) break;
-        kk_memcpy((uint8_t*)r, prep, prep_len);
+      const uint8_t* r;
+      while (count < n && (r = kk_memsearch_find(&ms, p, pend - p)) != NULL) {
+        const kk_ssize_t ofs = (r - p);
+        if (q != p) kk_memmove(q, p, ofs);
+        kk_memcpy(q + ofs, prep, prep_len);
+        q += ofs + prep_len;
+        p += ofs + ppat_len;
         count++;
-        p = r + prep_len;
+      }
+      if (count == 0) goto done;  // no pattern found
+      kk_bytes_unsafe_clear_hash(s);
+      if (prep_len < ppat_len) {
+        kk_memmove(q, p, pend - p);
+        q += (pend - p);
+        t = kk_bytes_adjust_length(s, q - kk_bytes_buf_borrow(s, NULL), ctx);  // reuses the buffer unless there is much waste
+        s = t;  // `s` is consumed by `kk_bytes_adjust_length`
       }
     }
     else {
-      // count pat occurrences so we can pre-allocate the result buffer
-      kk_ssize_t count = 0;
+      // find the pattern occurrences so we can pre-allocate the result buffer; remember the first positions
+      kk_ssize_t  matches_stack[KK_REPLACE_MATCHES_STACK];
+      kk_ssize_t* matches = matches_stack;
+      kk_ssize_t  matches_size = KK_REPLACE_MATCHES_STACK;
+      kk_ssize_t  count = 0;
       const uint8_t* r = p;
-      while (count < n && ((r = kk_memmem(r, pend - r, ppat, ppat_len)) != NULL)) {
-        count++;
+      while (count < n && ((r = kk_memsearch_find(&ms, r, pend - r)) != NULL)) {
+        if (count >= matches_size) {
+          kk_ssize_t* m = (kk_ssize_t*)kk_malloc(2 * matches_size * kk_ssizeof(kk_ssize_t), ctx);
+          if (m == NULL) kk_fatal_error(ENOMEM, "out of memory");
+          kk_memcpy(m, matches, matches_size * kk_ssizeof(kk_ssize_t));
+          if (matches != matches_stack) kk_free(matches);
+          matches = m;
+          matches_size *= 2;
+        }
+        matches[count++] = (r - p);
         r += ppat_len;
       }
       if (count == 0) goto done; // no pattern found
@@ -271,19 +692,18 @@ kk_bytes_t kk_bytes_replace_atmost(kk_bytes_t s, kk_bytes_t pat, kk_bytes_t rep,
       kk_ssize_t newlen = plen - (count * ppat_len) + (count * prep_len);
       uint8_t* q;
       t = kk_bytes_alloc_buf(newlen, &q, ctx);
-      while (count > 0) {
-        count--;
-        r = kk_memmem(p, pend - p, ppat, ppat_len);
-        kk_assert_internal(r != NULL);
-        kk_ssize_t ofs = (r - p);
+      const uint8_t* const s0 = p;
+      for (kk_ssize_t i = 0; i < count; i++) {
+        kk_ssize_t ofs = (s0 + matches[i]) - p;
         kk_memcpy(q, p, ofs);
         kk_memcpy(q + ofs, prep, prep_len);
         q += ofs + prep_len;
         p += ofs + ppat_len;
       }
+      if (matches != matches_stack) kk_free(matches);
       kk_ssize_t rest = (pend - p);
       kk_memcpy(q, p, rest);
-      kk_assert_internal(q + rest == kk_bytes_buf_borrow(t,NULL) + newlen);
+      kk_assert_internal(newlen == 0 || q + rest == kk_bytes_buf_borrow(t,NULL) + newlen);
     }
   }
 
@@ -294,28 +714,199 @@ done:
   return t;
 }
 
-
+// Repeat by doubling the already written part with `memcpy` (so we need only `O(log n)` calls)
 kk_bytes_t kk_bytes_repeat(kk_bytes_t b, kk_ssize_t n, kk_context_t* ctx) {
   kk_ssize_t len;
   const uint8_t* s = kk_bytes_buf_borrow(b,&len);  
-  if (len <= 0 || n<=0) return kk_bytes_empty();  
+  if (len <= 0 || n<=0) {
+    kk_bytes_drop(b, ctx);
+    return kk_bytes_empty();
+  }
+  if (n == 1) return b;
+  if (len > KK_SSIZE_MAX / n) {
+    kk_fatal_error(EOVERFLOW, "repeated bytes are too large");
+  }
+  const kk_ssize_t total = len*n;
   uint8_t* t;
-  kk_bytes_t tb = kk_bytes_alloc_buf(len*n, &t, ctx); // TODO: check overflow
+  kk_bytes_t tb = kk_bytes_alloc_buf(total, &t, ctx);
   if (len == 1) {
-    kk_memset(t, *s, n);
-    t += n;
+    kk_memset(t, *s, total);
   }
   else {
-    for (kk_ssize_t i = 0; i < n; i++) {
-      kk_memcpy(t, s, len);
-      t += len;
+    kk_memcpy(t, s, len);
+    kk_ssize_t done = len;
+    while (done < total) {
+      const kk_ssize_t m = (done <= total - done ? done : total - done);
+      kk_memcpy(t + done, t, m);
+      done += m;
     }
   }
-  kk_assert_internal(*t == 0);
+  kk_assert_internal(t[total] == 0);
   kk_bytes_drop(b,ctx);
   return tb;
 }
 
+
+/*--------------------------------------------------------------------------------------------------
+  Replace many patterns at once
+  We build an Aho-Corasick automaton [1] over the patterns as a full transition table on the
+  byte classes that occur in the patterns (all other bytes go back to the root). For each state
+  `match` is the longest pattern that is a suffix of the state. We scan the input once and
+  replace at each position the leftmost, and then longest, match; matches do not overlap:
+  as soon as no pattern starting at or before the leftmost candidate can still end, the
+  candidate is replaced and we restart the automaton right after it. This costs at most
+  an extra `maxlen` steps per replacement.
+
+  [1] Alfred V. Aho and Margaret J. Corasick, "Efficient string matching: an aid to bibliographic search",
+      Communications of the ACM 18(6), 1975.
+--------------------------------------------------------------------------------------------------*/
+
+typedef struct kk_ac_s {
+  int32_t*   delta;        // `state*classes + class` is the next state
+  int32_t*   match;        // longest pattern that is a suffix of the state (or -1)
+  int32_t    classes;
+  uint8_t    class_of[256];
+  kk_ssize_t maxlen;
+} kk_ac_t;
+
+static void kk_ac_done(kk_ac_t* ac) {
+  kk_free(ac->delta);
+  kk_free(ac->match);
+}
+
+static void kk_ac_init(kk_ac_t* ac, kk_ssize_t count, const uint8_t** pats, const kk_ssize_t* patlens, kk_context_t* ctx) {
+  // byte classes
+  kk_memset(ac->class_of, 0, 256);
+  int32_t classes = 1;
+  kk_ssize_t size = 1;
+  ac->maxlen = 0;
+  for (kk_ssize_t i = 0; i < count; i++) {
+    for (kk_ssize_t j = 0; j < patlens[i]; j++) {
+      if (ac->class_of[pats[i][j]] == 0) ac->class_of[pats[i][j]] = (uint8_t)(classes++);
+    }
+    size += patlens[i];
+    if (patlens[i] > ac->maxlen) ac->maxlen = patlens[i];
+  }
+  kk_assert_internal(classes <= 256 && size < INT32_MAX);
+  ac->classes = classes;
+  ac->delta = (int32_t*)kk_malloc(size * classes * kk_ssizeof(int32_t), ctx);
+  ac->match = (int32_t*)kk_malloc(size * kk_ssizeof(int32_t), ctx);
+  int32_t* fail = (int32_t*)kk_malloc(size * kk_ssizeof(int32_t), ctx);
+  int32_t* queue = (int32_t*)kk_malloc(size * kk_ssizeof(int32_t), ctx);
+  if (ac->delta == NULL || ac->match == NULL || fail == NULL || queue == NULL) kk_fatal_error(ENOMEM, "out of memory");
+  for (kk_ssize_t i = 0; i < size * classes; i++) { ac->delta[i] = -1; }
+  // trie
+  int32_t states = 1;
+  ac->match[0] = -1;
+  for (kk_ssize_t i = 0; i < count; i++) {
+    int32_t st = 0;
+    for (kk_ssize_t j = 0; j < patlens[i]; j++) {
+      int32_t* next = &ac->delta[st*classes + ac->class_of[pats[i][j]]];
+      if (*next < 0) { ac->match[states] = -1; *next = states++; }
+      st = *next;
+    }
+    if (ac->match[st] < 0 && patlens[i] > 0) ac->match[st] = (int32_t)i;  // the first of equal patterns wins
+  }
+  // breadth first: fail links, full transitions, and longest suffix matches
+  kk_ssize_t head = 0;
+  kk_ssize_t tail = 0;
+  fail[0] = 0;
+  for (int32_t c = 0; c < classes; c++) {
+    int32_t* next = &ac->delta[c];
+    if (*next < 0) { *next = 0; }
+    else { fail[*next] = 0; queue[tail++] = *next; }
+  }
+  while (head < tail) {
+    const int32_t st = queue[head++];
+    if (ac->match[st] < 0) ac->match[st] = ac->match[fail[st]];
+    for (int32_t c = 0; c < classes; c++) {
+      int32_t* next = &ac->delta[st*classes + c];
+      const int32_t alt = ac->delta[fail[st]*classes + c];
+      if (*next < 0) { *next = alt; }
+      else { fail[*next] = alt; queue[tail++] = *next; }
+    }
+  }
+  kk_free(fail);
+  kk_free(queue);
+}
+
+typedef struct kk_ac_match_s {
+  kk_ssize_t start;
+  int32_t    pat;
+} kk_ac_match_t;
+
+// Find the leftmost longest match in `[s+i, s+len)`; returns `false` if there is none.
+static bool kk_ac_find(const kk_ac_t* ac, const uint8_t* s, kk_ssize_t len, kk_ssize_t i, const kk_ssize_t* patlens, kk_ac_match_t* m) {
+  int32_t st = 0;
+  m->pat = -1;
+  m->start = len;
+  for (; i < len; i++) {
+    if (m->pat >= 0 && i >= m->start + ac->maxlen) break;   // no further match can start at or before `m->start`
+    st = ac->delta[st*ac->classes + ac->class_of[s[i]]];
+    const int32_t pat = ac->match[st];
+    if (pat >= 0) {
+      const kk_ssize_t start = i + 1 - patlens[pat];
+      if (start <= m->start) { m->start = start; m->pat = pat; }  // leftmost, and longer if at the same start
+    }
+  }
+  return (m->pat >= 0);
+}
+
+// Replace all occurrences of the patterns in `pats` with the corresponding bytes in `reps` in a single pass.
+// Both vectors contain bytes (or strings) and `reps` must be at least as long as `pats`; empty patterns are ignored.
+kk_bytes_t kk_bytes_replace_many(kk_bytes_t b, kk_vector_t patv, kk_vector_t repv, kk_context_t* ctx) {
+  kk_ssize_t count;
+  kk_box_t* pbox = kk_vector_buf_borrow(patv, &count);
+  kk_ssize_t rcount;
+  kk_box_t* rbox = kk_vector_buf_borrow(repv, &rcount);
+  if (rcount < count) count = rcount;
+  kk_ssize_t len;
+  const uint8_t* s = kk_bytes_buf_borrow(b, &len);
+  kk_bytes_t t = b;
+  if (count > 0 && len > 0) {
+    const uint8_t** pats    = (const uint8_t**)kk_malloc(count * kk_ssizeof(uint8_t*), ctx);
+    kk_ssize_t*     patlens = (kk_ssize_t*)kk_malloc(count * kk_ssizeof(kk_ssize_t), ctx);
+    if (pats == NULL || patlens == NULL) kk_fatal_error(ENOMEM, "out of memory");
+    for (kk_ssize_t i = 0; i < count; i++) {
+      pats[i] = kk_bytes_buf_borrow(kk_bytes_unbox(pbox[i]), &patlens[i]);
+    }
+    kk_ac_t ac;
+    kk_ac_init(&ac, count, pats, patlens, ctx);
+    // first pass: compute the result length
+    kk_ssize_t newlen = len;
+    kk_ssize_t matches = 0;
+    kk_ac_match_t m;
+    for (kk_ssize_t i = 0; kk_ac_find(&ac, s, len, i, patlens, &m); i = m.start + patlens[m.pat]) {
+      newlen += kk_bytes_len_borrow(kk_bytes_unbox(rbox[m.pat])) - patlens[m.pat];
+      matches++;
+    }
+    if (matches > 0) {
+      // second pass: write the result
+      uint8_t* q;
+      t = kk_bytes_alloc_buf(newlen, &q, ctx);
+      kk_ssize_t i = 0;
+      while (kk_ac_find(&ac, s, len, i, patlens, &m)) {
+        kk_memcpy(q, s + i, m.start - i);
+        q += m.start - i;
+        kk_ssize_t rlen;
+        const uint8_t* r = kk_bytes_buf_borrow(kk_bytes_unbox(rbox[m.pat]), &rlen);
+        kk_memcpy(q, r, rlen);
+        q += rlen;
+        i = m.start + patlens[m.pat];
+      }
+      kk_memcpy(q, s + i, len - i);
+      kk_assert_internal(newlen == 0 || q + (len - i) == kk_bytes_buf_borrow(t, NULL) + newlen);
+    }
+    kk_ac_done(&ac);
+    kk_free(pats);
+    kk_free(patlens);
+  }
+  kk_vector_drop(patv, ctx);
+  kk_vector_drop(repv, ctx);
+  if (!kk_datatype_eq(t, b)) kk_bytes_drop(b, ctx);
+  return t;
+}
+
 // to avoid casting to signed, return 0 for not found, or the index+1
 kk_ssize_t kk_bytes_index_of1(kk_bytes_t b, kk_bytes_t sub, kk_context_t* ctx) {
   kk_ssize_t slen;
@@ -354,11 +945,8 @@ kk_ssize_t kk_bytes_last_index_of1(kk_bytes_t b, kk_bytes_t sub, kk_context_t* c
     idx = (kk_bytes_cmp_borrow(b, sub) == 0 ? 1 : 0);
   }
   else {
-    const uint8_t* p;
-    for (p = s + slen - tlen; p >= s; p--) {  // todo: use reverse Boyer-Moore instead of one character at a time
-      if (kk_memcmp(p, t, tlen) == 0) break;
-    }
-    idx = (p >= s ? (p - s) + 1 : 0);
+    const uint8_t* p = kk_memrmem(s, slen, t, tlen);
+    idx = (p == NULL ? 0 : (p - s) + 1);
   }
   kk_bytes_drop(b, ctx);
   kk_bytes_drop(sub, ctx);
@@ -0,0 +1,202 @@
+/*---------------------------------------------------------------------------
+  Copyright 2020-2021, Microsoft Research, Daan Leijen.
+
+  This is free software; you can redistribute it and/or modify it under the
+  terms of the Apache License, Version 2.0. A copy of the License can be
+  found in the LICENSE file at the root of this distribution.
+---------------------------------------------------------------------------*/
+#include "kklib.h"
+
+/*--------------------------------------------------------------------------------------------------
+  Compose continuations
+  A composition is a flat array of continuations that is applied in a loop.
+  When a composition is unique it is extended and applied in place (moving out its
+  continuations), and its block is returned to a per-context pool once it is done.
+  Blocks are sized by their capacity class: class `c` has room for `2 << c` continuations,
+  and each class has its own pool (`ctx->cont_pool[c]`) so the common composition of just a
+  few continuations stays small.
+--------------------------------------------------------------------------------------------------*/
+
+#define KK_KCOMPOSE_MAX  (2 << (KK_CONT_POOL_CLASSES-1))  // continuations per composition block (beyond that compositions nest)
+
+#if (KK_YIELD_CONT_MAX > KK_KCOMPOSE_MAX)
+#error "KK_CONT_POOL_CLASSES is too small for KK_YIELD_CONT_MAX"
+#endif
+
+struct kcompose_fun_s {
+  struct kk_function_s _base;
+  kk_box_t      count;     // number of continuations (int)
+  kk_box_t      cls;       // capacity class (int)
+  kk_function_t conts[1];  // room for `2 << cls` continuations
+};
+
+static kk_box_t kcompose( kk_function_t fself, kk_box_t x, kk_context_t* ctx);
+
+static bool kk_function_is_kcompose( kk_function_t f ) {
+  return (kk_cfun_ptr_unbox(f->fun) == (kk_cfun_ptr_t)&kcompose);
+}
+
+static kk_ssize_t kcompose_class_of( kk_ssize_t count ) {
+  kk_ssize_t cls = 0;
+  while (((kk_ssize_t)2 << cls) < count) { cls++; }
+  kk_assert_internal(cls < KK_CONT_POOL_CLASSES);
+  return cls;
+}
+
+static kk_ssize_t kcompose_capacity( struct kcompose_fun_s* f ) {
+  return ((kk_ssize_t)2 << kk_int_unbox(f->cls));
+}
+
+static kk_ssize_t kcompose_size( kk_ssize_t cls ) {
+  return kk_ssizeof(struct kcompose_fun_s) + (((kk_ssize_t)2 << cls) - 1)*kk_ssizeof(kk_function_t);
+}
+
+static void kcompose_set_count( struct kcompose_fun_s* f, kk_ssize_t count ) {
+  kk_assert_internal(count >= 0 && count <= kcompose_capacity(f));
+  f->count = kk_int_box(count);
+  f->_base._block.header.scan_fsize = (uint8_t)(3 + count);
+}
+
+// allocate a composition block with room for `count` continuations (that are still to be
+// initialized); reuse a pooled block of the same class if possible
+static struct kcompose_fun_s* kcompose_alloc( kk_ssize_t count, kk_context_t* ctx ) {
+  const kk_ssize_t cls = kcompose_class_of(count);
+  kk_block_t* b = ctx->cont_pool[cls];
+  if (b != NULL && ctx->arena == NULL) {
+    ctx->cont_pool[cls] = *((kk_block_t**)b);
+    ctx->cont_pool_count[cls]--;
+    kk_stats_alloc(KK_TAG_FUNCTION,ctx);
+    kk_block_init(b, kcompose_size(cls), 3, KK_TAG_FUNCTION);
+  }
+  else {
+    b = kk_block_alloc(kcompose_size(cls), 3, KK_TAG_FUNCTION, ctx);
+  }
+  struct kcompose_fun_s* f = kk_block_as(struct kcompose_fun_s*, b);
+  f->_base.fun = kk_cfun_ptr_box(&kcompose,ctx);
+  f->count = kk_int_box(0);
+  f->cls = kk_int_box(cls);
+  return f;
+}
+
+// free a unique composition whose continuations have all been moved out
+static void kcompose_release( struct kcompose_fun_s* f, kk_context_t* ctx ) {
+  kk_block_t* b = &f->_base._block;
+  const kk_ssize_t cls = kk_int_unbox(f->cls);
+  kk_assert_internal(kk_block_is_unique(b));
+  if (kk_block_is_arena(b) || ctx->cont_pool_count[cls] >= KK_CONT_POOL_MAX) {
+    kk_block_free(b,ctx);
+  }
+  else {
+    kk_stats_free(KK_TAG_FUNCTION,ctx);
+    *((kk_block_t**)b) = ctx->cont_pool[cls];
+    ctx->cont_pool[cls] = b;
+    ctx->cont_pool_count[cls]++;
+  }
+}
+
+// Called when the context is freed
+kk_decl_export void kk_function_compose_done( kk_context_t* ctx ) {
+  for (kk_ssize_t cls = 0; cls < KK_CONT_POOL_CLASSES; cls++) {
+    while (ctx->cont_pool[cls] != NULL) {
+      kk_block_t* b = ctx->cont_pool[cls];
+      ctx->cont_pool[cls] = *((kk_block_t**)b);
+      kk_free(b);
+    }
+    ctx->cont_pool_count[cls] = 0;
+  }
+}
+
+// kleisli composition of continuations
+static kk_box_t kcompose( kk_function_t fself, kk_box_t x, kk_context_t* ctx) {
+  struct kcompose_fun_s* self = kk_function_as(struct kcompose_fun_s*,fself);
+  const kk_ssize_t count = kk_int_unbox(self->count);
+  const bool unique = kk_function_is_unique(fself);  // if unique, we move out the continuations
+  kk_function_t* conts = &self->conts[0];
+  // call each continuation in order
+  for(kk_ssize_t i = 0; i < count; i++) {
+    kk_function_t f = (unique ? conts[i] : kk_function_dup(conts[i]));
+    x = kk_function_call(kk_box_t, (kk_function_t, kk_box_t, kk_context_t*), f, (f, x, ctx));
+    if (kk_yielding(ctx)) {
+      // if yielding, `yield_extend` with all continuations that still need to be done
+      const kk_ssize_t rest = count - i - 1;
+      if (!unique) {
+        while(++i < count) {
+          kk_yield_extend(kk_function_dup(conts[i]),ctx);
+        }
+        kk_function_drop(fself,ctx);
+      }
+      else if (rest <= 1) {
+        if (rest == 1) { kk_yield_extend(conts[i+1],ctx); }
+        kcompose_release(self,ctx);
+      }
+      else {
+        // reuse the composition in place for the remaining continuations
+        kk_memmove(conts, conts + i + 1, rest * kk_ssizeof(kk_function_t));
+        kcompose_set_count(self, rest);
+        kk_yield_extend(fself,ctx);
+      }
+      kk_box_drop(x,ctx);     // still drop even though we yield as it may release a boxed value type?
+      return kk_box_any(ctx); // return yielding
+    }
+  }
+  if (unique) {
+    kcompose_release(self,ctx);
+  }
+  else {
+    kk_function_drop(fself,ctx);
+  }
+  return x;
+}
+
+// Compose `conts[count-1] o ... o conts[0]`. If `conts[0]` is itself a unique composition,
+// the others are appended to it: in place if it has room, or otherwise by moving all
+// continuations to a block of a larger class (instead of nesting it).
+kk_decl_export kk_function_t kk_function_compose( kk_function_t* conts, kk_ssize_t count, kk_context_t* ctx ) {
+  kk_assert_internal(count <= KK_KCOMPOSE_MAX);
+  if (count==0) return kk_function_id(ctx);
+  if (count==1) return conts[0];
+  if (kk_function_is_kcompose(conts[0]) && kk_function_is_unique(conts[0])) {
+    struct kcompose_fun_s* g = kk_function_as(struct kcompose_fun_s*, conts[0]);
+    const kk_ssize_t n = kk_int_unbox(g->count);
+    const kk_ssize_t total = n + count - 1;
+    if (total <= KK_KCOMPOSE_MAX) {
+      struct kcompose_fun_s* f = g;
+      if (total > kcompose_capacity(g)) {
+        f = kcompose_alloc(total, ctx);
+        kk_memcpy(f->conts, g->conts, n * kk_ssizeof(kk_function_t));
+        kcompose_release(g, ctx);
+      }
+      kk_memcpy(f->conts + n, conts + 1, (count - 1) * kk_ssizeof(kk_function_t));
+      kcompose_set_count(f, total);
+      return (&f->_base);
+    }
+  }
+  struct kcompose_fun_s* f = kcompose_alloc(count, ctx);
+  kk_memcpy(f->conts, conts, count * kk_ssizeof(kk_function_t));
+  kcompose_set_count(f, count);
+  return (&f->_base);
+}
+
+
+/*--------------------------------------------------------------------------------------------------
+  Yield extension
+--------------------------------------------------------------------------------------------------*/
+
+kk_decl_export kk_box_t kk_yield_extend( kk_function_t next, kk_context_t* ctx ) {
+  kk_yield_t* yield = &ctx->yield;
+  kk_assert_internal(kk_yielding(ctx));  // cannot extend if not yielding
+  if (kk_unlikely(kk_yielding_final(ctx))) {
+    // todo: can we optimize this so `next` is never allocated in the first place?
+    kk_function_drop(next,ctx); // ignore extension if never resuming
+  }
+  else {
+    if (kk_unlikely(yield->conts_count >= KK_YIELD_CONT_MAX)) {
+      // alloc a function to compose all continuations in the array
+      kk_function_t comp = kk_function_compose( yield->conts, yield->conts_count, ctx );
+      yield->conts[0] = comp;
+      yield->conts_count = 1;
+    }
+    yield->conts[yield->conts_count++] = next;
+  }
+  return kk_box_any(ctx);
+}
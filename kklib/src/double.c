@@ -0,0 +1,789 @@
+/*---------------------------------------------------------------------------
+  Copyright 2021, Microsoft Research, Daan Leijen.
+
+  This is free software; you can redistribute it and/or modify it under the
+  terms of the Apache License, Version 2.0. A copy of the License can be
+  found in the LICENSE file at the root of this distribution.
+---------------------------------------------------------------------------*/
+#include "kklib.h"
+#include <float.h>
+
+/*--------------------------------------------------------------------------------------------------
+  Showing doubles.
+  We compute the shortest decimal digits that round-trip with the Ryu algorithm [1] and
+  format those directly. When a fixed number of digits is requested we round the shortest
+  digits, which gives the same result as `printf` except in a few cases where the exact
+  binary value is needed (a rounding tie, more than 15 significant digits, or rounding to
+  zero); in those cases we fall back to `snprintf`.
+
+  [1] Ulf Adams, "Ryū: fast float-to-string conversion", PLDI 2018.
+      <https://github.com/ulfjack/ryu>
+--------------------------------------------------------------------------------------------------*/
+
+#define KK_RYU_MANTISSA_BITS     (52)
+#define KK_RYU_EXPONENT_BITS     (11)
+#define KK_RYU_BIAS              (1023)
+#define KK_RYU_POW5_INV_BITCOUNT (125)
+#define KK_RYU_POW5_BITCOUNT     (125)
+
+// Generated: `kk_ryu_pow5_inv_split[q] == floor(2^(pow5bits(q) - 1 + 125) / 5^q) + 1`
+// and `kk_ryu_pow5_split[i] == floor(5^i / 2^(pow5bits(i) - 125))` as { low, high } 64-bit parts.
+static const uint64_t kk_ryu_pow5_inv_split[292][2] = {
+  { KU64(0x0000000000000001), KU64(0x2000000000000000) }, { KU64(0x999999999999999A), KU64(0x1999999999999999) },
+  { KU64(0x47AE147AE147AE15), KU64(0x147AE147AE147AE1) }, { KU64(0x6C8B4395810624DE), KU64(0x10624DD2F1A9FBE7) },
+  { KU64(0x7A786C226809D496), KU64(0x1A36E2EB1C432CA5) }, { KU64(0x61F9F01B866E43AB), KU64(0x14F8B588E368F084) },
+  { KU64(0xB4C7F34938583622), KU64(0x10C6F7A0B5ED8D36) }, { KU64(0x87A6520EC08D236A), KU64(0x1AD7F29ABCAF4857) },
+  { KU64(0x9FB841A566D74F88), KU64(0x15798EE2308C39DF) }, { KU64(0xE62D01511F12A607), KU64(0x112E0BE826D694B2) },
+  { KU64(0xD6AE6881CB5109A4), KU64(0x1B7CDFD9D7BDBAB7) }, { KU64(0xDEF1ED34A2A73AEA), KU64(0x15FD7FE17964955F) },
+  { KU64(0x7F27F0F6E885C8BB), KU64(0x119799812DEA1119) }, { KU64(0x650CB4BE40D60DF8), KU64(0x1C25C268497681C2) },
+  { KU64(0xEA70909833DE7193), KU64(0x16849B86A12B9B01) }, { KU64(0x21F3A6E0297EC143), KU64(0x1203AF9EE756159B) },
+  { KU64(0x6985D7CD0F313537), KU64(0x1CD2B297D889BC2B) }, { KU64(0x2137DFD73F5A90F9), KU64(0x170EF54646D49689) },
+  { KU64(0xE75FE645CC4873FA), KU64(0x12725DD1D243ABA0) }, { KU64(0xA5663D3C7A0D865D), KU64(0x1D83C94FB6D2AC34) },
+  { KU64(0x511E976394D79EB1), KU64(0x179CA10C9242235D) }, { KU64(0xDA7EDF82DD794BC1), KU64(0x12E3B40A0E9B4F7D) },
+  { KU64(0x2A6498D1625BAC68), KU64(0x1E392010175EE596) }, { KU64(0xEEB6E0A781E2F053), KU64(0x182DB34012B25144) },
+  { KU64(0x58924D52CE4F26A9), KU64(0x1357C299A88EA76A) }, { KU64(0x27507BB7B07EA441), KU64(0x1EF2D0F5DA7DD8AA) },
+  { KU64(0x52A6C95FC0655034), KU64(0x18C240C4AECB13BB) }, { KU64(0x0EEBD44C99EAA690), KU64(0x13CE9A36F23C0FC9) },
+  { KU64(0xB17953ADC3110A80), KU64(0x1FB0F6BE50601941) }, { KU64(0xC12DDC8B02740867), KU64(0x195A5EFEA6B34767) },
+  { KU64(0x3424B06F3529A052), KU64(0x14484BFEEBC29F86) }, { KU64(0x901D59F290EE19DB), KU64(0x1039D66589687F9E) },
+  { KU64(0x4CFBC31DB4B0295F), KU64(0x19F623D5A8A73297) }, { KU64(0x3D9635B15D59BAB2), KU64(0x14C4E977BA1F5BAC) },
+  { KU64(0x97AB5E277DE16228), KU64(0x109D8792FB4C4956) }, { KU64(0xF2ABC9D8C9689D0D), KU64(0x1A95A5B7F87A0EF0) },
+  { KU64(0x5BBCA17A3ABA173E), KU64(0x154484932D2E725A) }, { KU64(0xAFCA1AC82EFB45CB), KU64(0x11039D428A8B8EAE) },
+  { KU64(0xB2DCF7A6B1920945), KU64(0x1B38FB9DAA78E44A) }, { KU64(0xF57D92EBC141A104), KU64(0x15C72FB1552D836E) },
+  { KU64(0xC46475896767B403), KU64(0x116C262777579C58) }, { KU64(0x6D6D88DBD8A5ECD2), KU64(0x1BE03D0BF225C6F4) },
+  { KU64(0x8ABE071646EB23DB), KU64(0x164CFDA3281E38C3) }, { KU64(0x6EFE6C11D255B649), KU64(0x11D7314F534B609C) },
+  { KU64(0xB197134FB6EF8A0E), KU64(0x1C8B821885456760) }, { KU64(0x27AC0F72F8BFA1A5), KU64(0x16D601AD376AB91A) },
+  { KU64(0xB95672C260994E1E), KU64(0x1244CE242C5560E1) }, { KU64(0xF5571E03CDC21695), KU64(0x1D3AE36D13BBCE35) },
+  { KU64(0x2AAC18030B01ABAB), KU64(0x17624F8A762FD82B) }, { KU64(0xBBBCE0026F348956), KU64(0x12B50C6EC4F31355) },
+  { KU64(0x92C7CCD0B1EDA889), KU64(0x1DEE7A4AD4B81EEF) }, { KU64(0xDBD30A408E57BA07), KU64(0x17F1FB6F10934BF2) },
+  { KU64(0x7CA8D50071DFC806), KU64(0x1327FC58DA0F6FF5) }, { KU64(0xFAA7BB33E9660CD6), KU64(0x1EA6608E29B24CBB) },
+  { KU64(0x9552FC298784D711), KU64(0x18851A0B548EA3C9) }, { KU64(0xAAA8C9BAD2D0AC0E), KU64(0x139DAE6F76D88307) },
+  { KU64(0xDDDADC5E1E1AACE3), KU64(0x1F62B0B257C0D1A5) }, { KU64(0x7E48B04B4B488A4F), KU64(0x191BC08EAC9A4151) },
+  { KU64(0xCB6D59D5D5D3A1D9), KU64(0x141633A556E1CDDA) }, { KU64(0x3C577B1177DC817B), KU64(0x1011C2EAABE7D7E2) },
+  { KU64(0xC6F25E825960CF2A), KU64(0x19B604AAACA62636) }, { KU64(0x6BF518684780A5BB), KU64(0x14919D5556EB51C5) },
+  { KU64(0x232A79ED06008496), KU64(0x10747DDDDF22A7D1) }, { KU64(0xD1DD8FE1A3340756), KU64(0x1A53FC9631D10C81) },
+  { KU64(0xA7E4731AE8F66C45), KU64(0x150FFD44F4A73D34) }, { KU64(0x531D28E253F8569E), KU64(0x10D9976A5D52975D) },
+  { KU64(0xEB61DB03B98D5762), KU64(0x1AF5BF109550F22E) }, { KU64(0xBC4E48CFC7A445E8), KU64(0x159165A6DDDA5B58) },
+  { KU64(0x6371D3D96C836B20), KU64(0x11411E1F17E1E2AD) }, { KU64(0x9F1C8628AD9F11CD), KU64(0x1B9B6364F3030448) },
+  { KU64(0xE5B06B53BE18DB0B), KU64(0x1615E91D8F359D06) }, { KU64(0xEAF3890FCB4715A2), KU64(0x11AB20E472914A6B) },
+  { KU64(0x44B8DB4C7871BC37), KU64(0x1C45016D841BAA46) }, { KU64(0x03C715D6C6C1635F), KU64(0x169D9ABE03495505) },
+  { KU64(0x3638DE456BCDE919), KU64(0x1217AEFE69077737) }, { KU64(0x56C163A2461641C1), KU64(0x1CF2B1970E725858) },
+  { KU64(0xDF011C81D1AB67CE), KU64(0x17288E1271F51379) }, { KU64(0x7F3416CE4155ECA5), KU64(0x1286D80EC190DC61) },
+  { KU64(0x6520247D3556476E), KU64(0x1DA48CE468E7C702) }, { KU64(0xEA801D30F7783925), KU64(0x17B6D71D20B96C01) },
+  { KU64(0xBB99B0F3F92CFA84), KU64(0x12F8AC174D612334) }, { KU64(0x5F5C4E532847F739), KU64(0x1E5AACF215683854) },
+  { KU64(0x7F7D0B75B9D32C2E), KU64(0x18488A5B44536043) }, { KU64(0x9930D5F7C7DC2358), KU64(0x136D3B7C36A919CF) },
+  { KU64(0x8EB4898C72F9D226), KU64(0x1F152BF9F10E8FB2) }, { KU64(0x722A07A38F2E41B8), KU64(0x18DDBCC7F40BA628) },
+  { KU64(0xC1BB394FA5BE9AFA), KU64(0x13E497065CD61E86) }, { KU64(0x9C5EC2190930F7F6), KU64(0x1FD424D6FAF030D7) },
+  { KU64(0x49E56814075A5FF8), KU64(0x197683DF2F268D79) }, { KU64(0x6E51201005E1E660), KU64(0x145ECFE5BF520AC7) },
+  { KU64(0xF1DA800CD181851A), KU64(0x104BD984990E6F05) }, { KU64(0x4FC400148268D4F5), KU64(0x1A12F5A0F4E3E4D6) },
+  { KU64(0xD96999AA01ED772B), KU64(0x14DBF7B3F71CB711) }, { KU64(0xADEE1488018AC5BC), KU64(0x10AFF95CC5B09274) },
+  { KU64(0x497CEDA668DE092C), KU64(0x1AB328946F80EA54) }, { KU64(0x3ACA57B853E4D424), KU64(0x155C2076BF9A5510) },
+  { KU64(0x623B7960431D7683), KU64(0x1116805EFFAEAA73) }, { KU64(0x9D2BF566D1C8BD9E), KU64(0x1B5733CB32B110B8) },
+  { KU64(0x7DBCC452416D647F), KU64(0x15DF5CA28EF40D60) }, { KU64(0xCAFD69DB678AB6CC), KU64(0x117F7D4ED8C33DE6) },
+  { KU64(0xAB2F0FC572778ADF), KU64(0x1BFF2EE48E052FD7) }, { KU64(0x88F273045B92D580), KU64(0x1665BF1D3E6A8CAC) },
+  { KU64(0xD3F528D049424466), KU64(0x11EAFF4A98553D56) }, { KU64(0xB988414D4203A0A3), KU64(0x1CAB3210F3BB9557) },
+  { KU64(0x6139CDD76802E6E9), KU64(0x16EF5B40C2FC7779) }, { KU64(0xE761717920025254), KU64(0x125915CD68C9F92D) },
+  { KU64(0xA568B58E999D5086), KU64(0x1D5B561574765B7C) }, { KU64(0x5120913EE14AA6D2), KU64(0x177C44DDF6C515FD) },
+  { KU64(0xA74D40FF1AA21F0E), KU64(0x12C9D0B1923744CA) }, { KU64(0x0BAECE64F769CB4A), KU64(0x1E0FB44F50586E11) },
+  { KU64(0x3C8BD850C5EE3C3B), KU64(0x180C903F7379F1A7) }, { KU64(0xCA0979DA37F1C9C9), KU64(0x133D4032C2C7F485) },
+  { KU64(0xA9A8C2F6BFE942DB), KU64(0x1EC866B79E0CBA6F) }, { KU64(0x2153CF2BCCBA9BE3), KU64(0x18A0522C7E709526) },
+  { KU64(0x1AA9728970954982), KU64(0x13B374F06526DDB8) }, { KU64(0xF775840F1A88759D), KU64(0x1F8587E7083E2F8C) },
+  { KU64(0x5F9136727BA05E17), KU64(0x19379FEC0698260A) }, { KU64(0x1940F85B9619E4DF), KU64(0x142C7FF0054684D5) },
+  { KU64(0xE100C6AFAB47EA4C), KU64(0x1023998CD1053710) }, { KU64(0xCE67A44C453FDD47), KU64(0x19D28F47B4D524E7) },
+  { KU64(0xD852E9D69DCCB106), KU64(0x14A8729FC3DDB71F) }, { KU64(0x79DBEE454B0A2738), KU64(0x1086C219697E2C19) },
+  { KU64(0x295FE3A211A9D859), KU64(0x1A71368F0F30468F) }, { KU64(0xBAB31C81A7BB137A), KU64(0x15275ED8D8F36BA5) },
+  { KU64(0x6228E39AEC95A92F), KU64(0x10EC4BE0AD8F8951) }, { KU64(0x9D0E38F7E0EF7517), KU64(0x1B13AC9AAF4C0EE8) },
+  { KU64(0xB0D82D931A592A79), KU64(0x15A956E225D67253) }, { KU64(0x8D79BE0F4847552E), KU64(0x11544581B7DEC1DC) },
+  { KU64(0x158F967EDA0BBB7C), KU64(0x1BBA08CF8C979C94) }, { KU64(0x77A611FF14D62F97), KU64(0x162E6D72D6DFB076) },
+  { KU64(0xF951A7FF43DE8C79), KU64(0x11BEBDF578B2F391) }, { KU64(0xC21C3FFED2FDAD8E), KU64(0x1C6463225AB7EC1C) },
+  { KU64(0x01B0333242648AD8), KU64(0x16B6B5B5155FF017) }, { KU64(0x0159C28E9B83A246), KU64(0x122BC490DDE659AC) },
+  { KU64(0xCEF604175F3903A3), KU64(0x1D12D41AFCA3C2AC) }, { KU64(0x725E69AC4C2D9C83), KU64(0x17424348CA1C9BBD) },
+  { KU64(0xF5185489D68AE39C), KU64(0x129B69070816E2FD) }, { KU64(0xEE8D540FBDAB05C6), KU64(0x1DC574D80CF16B2F) },
+  { KU64(0xBED77672FE226B05), KU64(0x17D12A4670C1228C) }, { KU64(0xFF12C528CB4EBC04), KU64(0x130DBB6B8D674ED6) },
+  { KU64(0xCB513B74787DF9A0), KU64(0x1E7C5F127BD87E24) }, { KU64(0x090DC929F9FE614D), KU64(0x18637F41FCAD31B7) },
+  { KU64(0xA0D7D42194CB810A), KU64(0x1382CC34CA2427C5) }, { KU64(0x67BFB9CF5478CE77), KU64(0x1F37AD21436D0C6F) },
+  { KU64(0x1FCC94A5DD2D71F9), KU64(0x18F9574DCF8A7059) }, { KU64(0x7FD6DD517DBDF4C7), KU64(0x13FAAC3E3FA1F37A) },
+  { KU64(0xFFBE2EE8C92FEE0B), KU64(0x1FF779FD329CB8C3) }, { KU64(0x6631BF20A0F324D6), KU64(0x1992C7FDC216FA36) },
+  { KU64(0xB827CC1A1A5C1D78), KU64(0x14756CCB01ABFB5E) }, { KU64(0x935309AE7B7CE460), KU64(0x105DF0A267BCC918) },
+  { KU64(0x1EEB42B0C594A099), KU64(0x1A2FE76A3F9474F4) }, { KU64(0xE58902270476E6E1), KU64(0x14F31F8832DD2A5C) },
+  { KU64(0xB7A0CE859D2BEBE7), KU64(0x10C27FA028B0EEB0) }, { KU64(0x59014A6F61DFDFD8), KU64(0x1AD0CC33744E4AB4) },
+  { KU64(0xE0CDD525E7E64CAD), KU64(0x1573D68F903EA229) }, { KU64(0x4D7177518651D6F1), KU64(0x11297872D9CBB4EE) },
+  { KU64(0x7BE8BEE8D6E957E8), KU64(0x1B758D848FAC54B0) }, { KU64(0xFCBA3253DF211320), KU64(0x15F7A46A0C89DD59) },
+  { KU64(0x63C8284318E74280), KU64(0x1192E9EE706E4AAE) }, { KU64(0x060D0D3827D86A66), KU64(0x1C1E43171A4A1117) },
+  { KU64(0x6B3DA42CECAD21EB), KU64(0x167E9C127B6E7412) }, { KU64(0x88FE1CF0BD574E56), KU64(0x11FEE341FC585CDB) },
+  { KU64(0x419694B462254A23), KU64(0x1CCB0536608D615F) }, { KU64(0x67ABAA29E81DD4E9), KU64(0x1708D0F84D3DE77F) },
+  { KU64(0xB95621BB2017DD87), KU64(0x126D73F9D764B932) }, { KU64(0xC223692B668C95A5), KU64(0x1D7BECC2F23AC1EA) },
+  { KU64(0xCE82BA891ED6DE1D), KU64(0x179657025B6234BB) }, { KU64(0xA53562074BDF1818), KU64(0x12DEAC01E2B4F6FC) },
+  { KU64(0x3B889CD87964F359), KU64(0x1E3113363787F194) }, { KU64(0xFC6D4A46C783F5E1), KU64(0x18274291C6065ADC) },
+  { KU64(0x30576E9F06032B1A), KU64(0x13529BA7D19EAF17) }, { KU64(0x1A257DCB3CD1DE90), KU64(0x1EEA92A61C311825) },
+  { KU64(0x481DFE3C30A7E540), KU64(0x18BBA884E35A79B7) }, { KU64(0xD34B31C9C0865100), KU64(0x13C9539D82AEC7C5) },
+  { KU64(0x5211E942CDA3B4CD), KU64(0x1FA885C8D117A609) }, { KU64(0x74DB21023E1C90A4), KU64(0x19539E3A40DFB807) },
+  { KU64(0xF715B401CB4A0D50), KU64(0x1442E4FB67196005) }, { KU64(0xF8DE299B09080AA7), KU64(0x103583FC527AB337) },
+  { KU64(0x8E304291A80CDDD7), KU64(0x19EF3993B72AB859) }, { KU64(0x3E8D020E200A4B13), KU64(0x14BF6142F8EEF9E1) },
+  { KU64(0x653D9B3E80083C0F), KU64(0x10991A9BFA58C7E7) }, { KU64(0x6EC8F864000D2CE4), KU64(0x1A8E90F9908E0CA5) },
+  { KU64(0x8BD3F9E999A423EA), KU64(0x153EDA614071A3B7) }, { KU64(0x3CA994BAE1501CBB), KU64(0x10FF151A99F482F9) },
+  { KU64(0xC775BAC49BB3612B), KU64(0x1B31BB5DC320D18E) }, { KU64(0xD2C4956A16291A89), KU64(0x15C162B168E70E0B) },
+  { KU64(0xDBD0778811BA7BA1), KU64(0x11678227871F3E6F) }, { KU64(0x2C80BF401C5D929B), KU64(0x1BD8D03F3E9863E6) },
+  { KU64(0xBD33CC3349E47549), KU64(0x16470CFF6546B651) }, { KU64(0xCA8FD68F6E505DD4), KU64(0x11D270CC51055EA7) },
+  { KU64(0x4419574BE3B3C953), KU64(0x1C83E7AD4E6EFDD9) }, { KU64(0x0347790982F63AA9), KU64(0x16CFEC8AA52597E1) },
+  { KU64(0xCF6C60D468C4FBBA), KU64(0x123FF06EEA847980) }, { KU64(0xE57A34870E07F92A), KU64(0x1D331A4B10D3F59A) },
+  { KU64(0x512E906C0B399422), KU64(0x175C1508DA432AE2) }, { KU64(0xDA8BA6BCD5C7A9B5), KU64(0x12B010D3E1CF5581) },
+  { KU64(0x90DF712E22D90F87), KU64(0x1DE6815302E5559C) }, { KU64(0xDA4C5A8B4F140C6C), KU64(0x17EB9AA8CF1DDE16) },
+  { KU64(0xAEA37BA2A5A9A38A), KU64(0x1322E220A5B17E78) }, { KU64(0x7DD25F6AA2A905A9), KU64(0x1E9E369AA2B59727) },
+  { KU64(0x97DB7F888220D154), KU64(0x187E92154EF7AC1F) }, { KU64(0x797C6606CE80A777), KU64(0x139874DDD8C6234C) },
+  { KU64(0x8F2D700AE4010BF1), KU64(0x1F5A549627A36BAD) }, { KU64(0x0C2459A25000D65A), KU64(0x191510781FB5EFBE) },
+  { KU64(0x701D1481D99A4515), KU64(0x1410D9F9B2F7F2FE) }, { KU64(0xC017439B147B6A77), KU64(0x100D7B2E28C65BFE) },
+  { KU64(0xCCF205C4ED9243F2), KU64(0x19AF2B7D0E0A2CCA) }, { KU64(0x0A5B37D0BE0E9CC2), KU64(0x148C22CA71A1BD6F) },
+  { KU64(0x0848F973CB3EE3CE), KU64(0x10701BD527B4978C) }, { KU64(0xDA0E5BEC78649FB0), KU64(0x1A4CF9550C5425AC) },
+  { KU64(0x7B3EAFF060507FC0), KU64(0x150A6110D6A9B7BD) }, { KU64(0x95CBBFF380406633), KU64(0x10D51A73DEEE2C97) },
+  { KU64(0xEFAC665266CD7052), KU64(0x1AEE90B964B04758) }, { KU64(0x2623850EB8A459DB), KU64(0x158BA6FAB6F36C47) },
+  { KU64(0x1E82D0D893B6AE49), KU64(0x113C85955F29236C) }, { KU64(0xFD9E1AF41F8AB075), KU64(0x1B9408EEFEA838AC) },
+  { KU64(0x97B1AF29B2D559F7), KU64(0x16100725988693BD) }, { KU64(0xAC8E25BAF5777B2C), KU64(0x11A66C1E139EDC97) },
+  { KU64(0x7A7D092B2258C513), KU64(0x1C3D79C9B8FE2DBF) }, { KU64(0x61FDA0EF4EAD6A76), KU64(0x169794A160CB57CC) },
+  { KU64(0xE7FE1A590BBDEEC5), KU64(0x1212DD4DE7091309) }, { KU64(0xA6635D5B45FCB13A), KU64(0x1CEAFBAFD80E84DC) },
+  { KU64(0x851C4AAF6B308DC8), KU64(0x172262F3133ED0B0) }, { KU64(0xD0E36EF2BC26D7D4), KU64(0x1281E8C275CBDA26) },
+  { KU64(0xB49F17EAC6A48C86), KU64(0x1D9CA79D894629D7) }, { KU64(0x2A18DFEF0550706B), KU64(0x17B08617A104EE46) },
+  { KU64(0x54E0B3259DD9F389), KU64(0x12F39E794D9D8B6B) }, { KU64(0x87CDEB6F62F65274), KU64(0x1E5297287C2F4578) },
+  { KU64(0xD30B22BF825EA85D), KU64(0x18421286C9BF6AC6) }, { KU64(0x0F3C1BCC684BB9E4), KU64(0x13680ED23AFF889F) },
+  { KU64(0x18602C7A4079296D), KU64(0x1F0CE4839198DA98) }, { KU64(0x46B356C833942124), KU64(0x18D71D360E13E213) },
+  { KU64(0x388F78A029434DB6), KU64(0x13DF4A91A4DCB4DC) }, { KU64(0x5A7F2766A86BAF8A), KU64(0x1FCBAA82A1612160) },
+  { KU64(0x153285EBB9EFBFA2), KU64(0x196FBB9BB44DB44D) }, { KU64(0xAA8ED189618C994E), KU64(0x145962E2F6A4903D) },
+  { KU64(0xEED8A7A11AD6E10C), KU64(0x1047824F2BB6D9CA) }, { KU64(0x7E27729B5E249B45), KU64(0x1A0C03B1DF8AF611) },
+  { KU64(0xFE85F549181D4904), KU64(0x14D6695B193BF80D) }, { KU64(0xCB9E5DD4134AA0D0), KU64(0x10AB877C142FF9A4) },
+  { KU64(0xDF63C9535211014D), KU64(0x1AAC0BF9B9E65C3A) }, { KU64(0x191CA10F74DA6771), KU64(0x15566FFAFB1EB02F) },
+  { KU64(0xADB080D92A4852C1), KU64(0x1111F32F2F4BC025) }, { KU64(0x15E7348EAA0D5134), KU64(0x1B4FEB7EB212CD09) },
+  { KU64(0xAB1F5D3EEE710DC4), KU64(0x15D98932280F0A6D) }, { KU64(0xBC1917658B8DA49D), KU64(0x117AD428200C0857) },
+  { KU64(0x2CF4F23C127C3A94), KU64(0x1BF7B9D9CCE00D59) }, { KU64(0xF0C3F4FCDB969543), KU64(0x165FC7E170B33DE0) },
+  { KU64(0x5A365D9716121103), KU64(0x11E6398126F5CB1A) }, { KU64(0x9056FC24F01CE804), KU64(0x1CA38F350B22DE90) },
+  { KU64(0xD9DF301D8CE3ECD0), KU64(0x16E93F5DA2824BA6) }, { KU64(0xE17F59B13D8323DA), KU64(0x125432B14ECEA2EB) },
+  { KU64(0x68CBC2B52F38395C), KU64(0x1D53844EE47DD179) }, { KU64(0x53D6355DBF602DE3), KU64(0x177603725064A794) },
+  { KU64(0xA9782AB165E68B1C), KU64(0x12C4CF8EA6B6EC76) }, { KU64(0x0F26AAB56FD744FA), KU64(0x1E07B27DD78B13F1) },
+  { KU64(0x3F52222ABFDF6A62), KU64(0x18062864AC6F4327) }, { KU64(0x65DB4E88997F884E), KU64(0x1338205089F29C1F) },
+  { KU64(0x6FC54A7428CC0D4A), KU64(0x1EC033B40FEA9365) }, { KU64(0x596AA1F68709A43B), KU64(0x1899C2F673220F84) },
+  { KU64(0xADEEE7F86C07B696), KU64(0x13AE3591F5B4D936) }, { KU64(0x497E3FF3E00C5756), KU64(0x1F7D228322BAF524) },
+  { KU64(0xD464FFF64CD6AC45), KU64(0x1930E868E89590E9) }, { KU64(0x4383FFF83D7889D1), KU64(0x14272053ED4473EE) },
+  { KU64(0xCF9CCCC69793A174), KU64(0x101F4D0FF1038FF1) }, { KU64(0x7F6147A425B90252), KU64(0x19CBAE7FE805B31C) },
+  { KU64(0xCC4DD2E9B7C7350F), KU64(0x14A2F1FFECD15C16) }, { KU64(0x3D0B0F215FD290D9), KU64(0x10825B3323DAB012) },
+  { KU64(0x61AB4B689950E7C1), KU64(0x1A6A2B85062AB350) }, { KU64(0x4E22A2BA1440B967), KU64(0x1521BC6A6B555C40) },
+  { KU64(0x0B4EE894DD009453), KU64(0x10E7C9EEBC4449CD) }, { KU64(0x1217DA87C800ED51), KU64(0x1B0C764AC6D3A948) },
+  { KU64(0xDB46486CA000BDDA), KU64(0x15A391D56BDC876C) }, { KU64(0x490506BD4CCD64AF), KU64(0x114FA7DDEFE39F8A) },
+  { KU64(0xA8080AC87AE23AB1), KU64(0x1BB2A62FE638FF43) }, { KU64(0x5339A239FBE82EF4), KU64(0x162884F31E93FF69) },
+  { KU64(0x75C7B4FB2FECF25D), KU64(0x11BA03F5B20FFF87) }, { KU64(0x22D92191E647EA2E), KU64(0x1C5CD322B67FFF3F) },
+  { KU64(0xB57A8141850654F2), KU64(0x16B0A8E891FFFF65) }, { KU64(0xC4620101373843F5), KU64(0x1226ED86DB3332B7) },
+  { KU64(0x3A366801F1F39FEE), KU64(0x1D0B15A491EB8459) }, { KU64(0xFB5EB99B27F6198B), KU64(0x173C115074BC69E0) },
+  { KU64(0x2F7EFAE2865E7AD6), KU64(0x129674405D6387E7) }, { KU64(0xE597F7D0D6FD9156), KU64(0x1DBD86CD6238D971) },
+  { KU64(0x8479930D78CADAAB), KU64(0x17CAD23DE82D7AC1) }, { KU64(0xD06142712D6F1556), KU64(0x1308A831868AC89A) },
+  { KU64(0x4D686A4EAF182222), KU64(0x1E74404F3DAADA91) }, { KU64(0xA453883EF279B4E8), KU64(0x185D003F6488AEDA) },
+  { KU64(0xE9DC6CFF28615D87), KU64(0x137D99CC506D58AE) }, { KU64(0xA960AE650D6895A4), KU64(0x1F2F5C7A1A488DE4) },
+  { KU64(0xBAB3BEB73DED4483), KU64(0x18F2B061AEA07183) }, { KU64(0x2EF6322C318A9D36), KU64(0x13F559E7BEE6C136) }
+};
+
+static const uint64_t kk_ryu_pow5_split[326][2] = {
+  { KU64(0x0000000000000000), KU64(0x1000000000000000) }, { KU64(0x0000000000000000), KU64(0x1400000000000000) },
+  { KU64(0x0000000000000000), KU64(0x1900000000000000) }, { KU64(0x0000000000000000), KU64(0x1F40000000000000) },
+  { KU64(0x0000000000000000), KU64(0x1388000000000000) }, { KU64(0x0000000000000000), KU64(0x186A000000000000) },
+  { KU64(0x0000000000000000), KU64(0x1E84800000000000) }, { KU64(0x0000000000000000), KU64(0x1312D00000000000) },
+  { KU64(0x0000000000000000), KU64(0x17D7840000000000) }, { KU64(0x0000000000000000), KU64(0x1DCD650000000000) },
+  { KU64(0x0000000000000000), KU64(0x12A05F2000000000) }, { KU64(0x0000000000000000), KU64(0x174876E800000000) },
+  { KU64(0x0000000000000000), KU64(0x1D1A94A200000000) }, { KU64(0x0000000000000000), KU64(0x12309CE540000000) },
+  { KU64(0x0000000000000000), KU64(0x16BCC41E90000000) }, { KU64(0x0000000000000000), KU64(0x1C6BF52634000000) },
+  { KU64(0x0000000000000000), KU64(0x11C37937E0800000) }, { KU64(0x0000000000000000), KU64(0x16345785D8A00000) },
+  { KU64(0x0000000000000000), KU64(0x1BC16D674EC80000) }, { KU64(0x0000000000000000), KU64(0x1158E460913D0000) },
+  { KU64(0x0000000000000000), KU64(0x15AF1D78B58C4000) }, { KU64(0x0000000000000000), KU64(0x1B1AE4D6E2EF5000) },
+  { KU64(0x0000000000000000), KU64(0x10F0CF064DD59200) }, { KU64(0x0000000000000000), KU64(0x152D02C7E14AF680) },
+  { KU64(0x0000000000000000), KU64(0x1A784379D99DB420) }, { KU64(0x0000000000000000), KU64(0x108B2A2C28029094) },
+  { KU64(0x0000000000000000), KU64(0x14ADF4B7320334B9) }, { KU64(0x4000000000000000), KU64(0x19D971E4FE8401E7) },
+  { KU64(0x8800000000000000), KU64(0x1027E72F1F128130) }, { KU64(0xAA00000000000000), KU64(0x1431E0FAE6D7217C) },
+  { KU64(0xD480000000000000), KU64(0x193E5939A08CE9DB) }, { KU64(0xC9A0000000000000), KU64(0x1F8DEF8808B02452) },
+  { KU64(0xBE04000000000000), KU64(0x13B8B5B5056E16B3) }, { KU64(0xAD85000000000000), KU64(0x18A6E32246C99C60) },
+  { KU64(0xD8E6400000000000), KU64(0x1ED09BEAD87C0378) }, { KU64(0x878FE80000000000), KU64(0x13426172C74D822B) },
+  { KU64(0x6973E20000000000), KU64(0x1812F9CF7920E2B6) }, { KU64(0x03D0DA8000000000), KU64(0x1E17B84357691B64) },
+  { KU64(0x8262889000000000), KU64(0x12CED32A16A1B11E) }, { KU64(0x22FB2AB400000000), KU64(0x178287F49C4A1D66) },
+  { KU64(0xABB9F56100000000), KU64(0x1D6329F1C35CA4BF) }, { KU64(0xCB54395CA0000000), KU64(0x125DFA371A19E6F7) },
+  { KU64(0xBE2947B3C8000000), KU64(0x16F578C4E0A060B5) }, { KU64(0x2DB399A0BA000000), KU64(0x1CB2D6F618C878E3) },
+  { KU64(0xFC90400474400000), KU64(0x11EFC659CF7D4B8D) }, { KU64(0x7BB4500591500000), KU64(0x166BB7F0435C9E71) },
+  { KU64(0xDAA16406F5A40000), KU64(0x1C06A5EC5433C60D) }, { KU64(0xA8A4DE8459868000), KU64(0x118427B3B4A05BC8) },
+  { KU64(0xD2CE16256FE82000), KU64(0x15E531A0A1C872BA) }, { KU64(0x87819BAECBE22800), KU64(0x1B5E7E08CA3A8F69) },
+  { KU64(0xF4B1014D3F6D5900), KU64(0x111B0EC57E6499A1) }, { KU64(0x71DD41A08F48AF40), KU64(0x1561D276DDFDC00A) },
+  { KU64(0x0E549208B31ADB10), KU64(0x1ABA4714957D300D) }, { KU64(0x28F4DB456FF0C8EA), KU64(0x10B46C6CDD6E3E08) },
+  { KU64(0x33321216CBECFB24), KU64(0x14E1878814C9CD8A) }, { KU64(0xBFFE969C7EE839ED), KU64(0x1A19E96A19FC40EC) },
+  { KU64(0xF7FF1E21CF512434), KU64(0x105031E2503DA893) }, { KU64(0xF5FEE5AA43256D41), KU64(0x14643E5AE44D12B8) },
+  { KU64(0x337E9F14D3EEC892), KU64(0x197D4DF19D605767) }, { KU64(0x005E46DA08EA7AB6), KU64(0x1FDCA16E04B86D41) },
+  { KU64(0xA03AEC4845928CB2), KU64(0x13E9E4E4C2F34448) }, { KU64(0xC849A75A56F72FDE), KU64(0x18E45E1DF3B0155A) },
+  { KU64(0x7A5C1130ECB4FBD6), KU64(0x1F1D75A5709C1AB1) }, { KU64(0xEC798ABE93F11D65), KU64(0x13726987666190AE) },
+  { KU64(0xA797ED6E38ED64BF), KU64(0x184F03E93FF9F4DA) }, { KU64(0x517DE8C9C728BDEF), KU64(0x1E62C4E38FF87211) },
+  { KU64(0xD2EEB17E1C7976B5), KU64(0x12FDBB0E39FB474A) }, { KU64(0x87AA5DDDA397D462), KU64(0x17BD29D1C87A191D) },
+  { KU64(0xE994F5550C7DC97B), KU64(0x1DAC74463A989F64) }, { KU64(0x11FD195527CE9DED), KU64(0x128BC8ABE49F639F) },
+  { KU64(0xD67C5FAA71C24568), KU64(0x172EBAD6DDC73C86) }, { KU64(0x8C1B77950E32D6C2), KU64(0x1CFA698C95390BA8) },
+  { KU64(0x57912ABD28DFC639), KU64(0x121C81F7DD43A749) }, { KU64(0xAD75756C7317B7C8), KU64(0x16A3A275D494911B) },
+  { KU64(0x98D2D2C78FDDA5BA), KU64(0x1C4C8B1349B9B562) }, { KU64(0x9F83C3BCB9EA8794), KU64(0x11AFD6EC0E14115D) },
+  { KU64(0x0764B4ABE8652979), KU64(0x161BCCA7119915B5) }, { KU64(0x493DE1D6E27E73D7), KU64(0x1BA2BFD0D5FF5B22) },
+  { KU64(0x6DC6AD264D8F0866), KU64(0x1145B7E285BF98F5) }, { KU64(0xC938586FE0F2CA80), KU64(0x159725DB272F7F32) },
+  { KU64(0x7B866E8BD92F7D20), KU64(0x1AFCEF51F0FB5EFF) }, { KU64(0xAD34051767BDAE34), KU64(0x10DE1593369D1B5F) },
+  { KU64(0x9881065D41AD19C1), KU64(0x15159AF804446237) }, { KU64(0x7EA147F492186032), KU64(0x1A5B01B605557AC5) },
+  { KU64(0x6F24CCF8DB4F3C1F), KU64(0x1078E111C3556CBB) }, { KU64(0x4AEE003712230B27), KU64(0x14971956342AC7EA) },
+  { KU64(0xDDA98044D6ABCDF0), KU64(0x19BCDFABC13579E4) }, { KU64(0x0A89F02B062B60B6), KU64(0x10160BCB58C16C2F) },
+  { KU64(0xCD2C6C35C7B638E4), KU64(0x141B8EBE2EF1C73A) }, { KU64(0x8077874339A3C71D), KU64(0x1922726DBAAE3909) },
+  { KU64(0xE0956914080CB8E4), KU64(0x1F6B0F092959C74B) }, { KU64(0x6C5D61AC8507F38E), KU64(0x13A2E965B9D81C8F) },
+  { KU64(0x4774BA17A649F072), KU64(0x188BA3BF284E23B3) }, { KU64(0x1951E89D8FDC6C8F), KU64(0x1EAE8CAEF261ACA0) },
+  { KU64(0x0FD3316279E9C3D9), KU64(0x132D17ED577D0BE4) }, { KU64(0x13C7FDBB186434CF), KU64(0x17F85DE8AD5C4EDD) },
+  { KU64(0x58B9FD29DE7D4203), KU64(0x1DF67562D8B36294) }, { KU64(0xB7743E3A2B0E4942), KU64(0x12BA095DC7701D9C) },
+  { KU64(0xE5514DC8B5D1DB92), KU64(0x17688BB5394C2503) }, { KU64(0xDEA5A13AE3465277), KU64(0x1D42AEA2879F2E44) },
+  { KU64(0x0B2784C4CE0BF38A), KU64(0x1249AD2594C37CEB) }, { KU64(0xCDF165F6018EF06D), KU64(0x16DC186EF9F45C25) },
+  { KU64(0x416DBF7381F2AC88), KU64(0x1C931E8AB871732F) }, { KU64(0x88E497A83137ABD5), KU64(0x11DBF316B346E7FD) },
+  { KU64(0xEB1DBD923D8596CA), KU64(0x1652EFDC6018A1FC) }, { KU64(0x25E52CF6CCE6FC7D), KU64(0x1BE7ABD3781ECA7C) },
+  { KU64(0x97AF3C1A40105DCE), KU64(0x1170CB642B133E8D) }, { KU64(0xFD9B0B20D0147542), KU64(0x15CCFE3D35D80E30) },
+  { KU64(0x3D01CDE904199292), KU64(0x1B403DCC834E11BD) }, { KU64(0x462120B1A28FFB9B), KU64(0x1108269FD210CB16) },
+  { KU64(0xD7A968DE0B33FA82), KU64(0x154A3047C694FDDB) }, { KU64(0xCD93C3158E00F923), KU64(0x1A9CBC59B83A3D52) },
+  { KU64(0xC07C59ED78C09BB6), KU64(0x10A1F5B813246653) }, { KU64(0xB09B7068D6F0C2A3), KU64(0x14CA732617ED7FE8) },
+  { KU64(0xDCC24C830CACF34C), KU64(0x19FD0FEF9DE8DFE2) }, { KU64(0xC9F96FD1E7EC180F), KU64(0x103E29F5C2B18BED) },
+  { KU64(0x3C77CBC661E71E13), KU64(0x144DB473335DEEE9) }, { KU64(0x8B95BEB7FA60E598), KU64(0x1961219000356AA3) },
+  { KU64(0x6E7B2E65F8F91EFE), KU64(0x1FB969F40042C54C) }, { KU64(0xC50CFCFFBB9BB35F), KU64(0x13D3E2388029BB4F) },
+  { KU64(0xB6503C3FAA82A037), KU64(0x18C8DAC6A0342A23) }, { KU64(0xA3E44B4F95234844), KU64(0x1EFB1178484134AC) },
+  { KU64(0xE66EAF11BD360D2B), KU64(0x135CEAEB2D28C0EB) }, { KU64(0xE00A5AD62C839075), KU64(0x183425A5F872F126) },
+  { KU64(0x980CF18BB7A47493), KU64(0x1E412F0F768FAD70) }, { KU64(0x5F0816F752C6C8DC), KU64(0x12E8BD69AA19CC66) },
+  { KU64(0xF6CA1CB527787B13), KU64(0x17A2ECC414A03F7F) }, { KU64(0xF47CA3E2715699D7), KU64(0x1D8BA7F519C84F5F) },
+  { KU64(0xF8CDE66D86D62026), KU64(0x127748F9301D319B) }, { KU64(0xF7016008E88BA830), KU64(0x17151B377C247E02) },
+  { KU64(0xB4C1B80B22AE923C), KU64(0x1CDA62055B2D9D83) }, { KU64(0x50F91306F5AD1B65), KU64(0x12087D4358FC8272) },
+  { KU64(0xE53757C8B318623F), KU64(0x168A9C942F3BA30E) }, { KU64(0x9E852DBADFDE7ACF), KU64(0x1C2D43B93B0A8BD2) },
+  { KU64(0xA3133C94CBEB0CC1), KU64(0x119C4A53C4E69763) }, { KU64(0x8BD80BB9FEE5CFF1), KU64(0x16035CE8B6203D3C) },
+  { KU64(0xAECE0EA87E9F43EE), KU64(0x1B843422E3A84C8B) }, { KU64(0x4D40C9294F238A75), KU64(0x1132A095CE492FD7) },
+  { KU64(0x2090FB73A2EC6D12), KU64(0x157F48BB41DB7BCD) }, { KU64(0x68B53A508BA78856), KU64(0x1ADF1AEA12525AC0) },
+  { KU64(0x417144725748B536), KU64(0x10CB70D24B7378B8) }, { KU64(0x51CD958EED1AE283), KU64(0x14FE4D06DE5056E6) },
+  { KU64(0xE640FAF2A8619B24), KU64(0x1A3DE04895E46C9F) }, { KU64(0xEFE89CD7A93D00F7), KU64(0x1066AC2D5DAEC3E3) },
+  { KU64(0xEBE2C40D938C4134), KU64(0x14805738B51A74DC) }, { KU64(0x26DB7510F86F5181), KU64(0x19A06D06E2611214) },
+  { KU64(0x9849292A9B4592F1), KU64(0x100444244D7CAB4C) }, { KU64(0xBE5B73754216F7AD), KU64(0x1405552D60DBD61F) },
+  { KU64(0xADF25052929CB598), KU64(0x1906AA78B912CBA7) }, { KU64(0x996EE4673743E2FF), KU64(0x1F485516E7577E91) },
+  { KU64(0xFFE54EC0828A6DDF), KU64(0x138D352E5096AF1A) }, { KU64(0xBFDEA270A32D0957), KU64(0x18708279E4BC5AE1) },
+  { KU64(0x2FD64B0CCBF84BAD), KU64(0x1E8CA3185DEB719A) }, { KU64(0x5DE5EEE7FF7B2F4C), KU64(0x1317E5EF3AB32700) },
+  { KU64(0x755F6AA1FF59FB1F), KU64(0x17DDDF6B095FF0C0) }, { KU64(0x92B7454A7F3079E7), KU64(0x1DD55745CBB7ECF0) },
+  { KU64(0x5BB28B4E8F7E4C30), KU64(0x12A5568B9F52F416) }, { KU64(0xF29F2E22335DDF3C), KU64(0x174EAC2E8727B11B) },
+  { KU64(0xEF46F9AAC035570B), KU64(0x1D22573A28F19D62) }, { KU64(0xD58C5C0AB8215667), KU64(0x123576845997025D) },
+  { KU64(0x4AEF730D6629AC01), KU64(0x16C2D4256FFCC2F5) }, { KU64(0x9DAB4FD0BFB41701), KU64(0x1C73892ECBFBF3B2) },
+  { KU64(0xA28B11E277D08E60), KU64(0x11C835BD3F7D784F) }, { KU64(0x8B2DD65B15C4B1F9), KU64(0x163A432C8F5CD663) },
+  { KU64(0x6DF94BF1DB35DE77), KU64(0x1BC8D3F7B3340BFC) }, { KU64(0xC4BBCF772901AB0A), KU64(0x115D847AD000877D) },
+  { KU64(0x35EAC354F34215CD), KU64(0x15B4E5998400A95D) }, { KU64(0x8365742A30129B40), KU64(0x1B221EFFE500D3B4) },
+  { KU64(0xD21F689A5E0BA108), KU64(0x10F5535FEF208450) }, { KU64(0x06A742C0F58E894A), KU64(0x1532A837EAE8A565) },
+  { KU64(0x4851137132F22B9D), KU64(0x1A7F5245E5A2CEBE) }, { KU64(0xED32AC26BFD75B42), KU64(0x108F936BAF85C136) },
+  { KU64(0xA87F57306FCD3212), KU64(0x14B378469B673184) }, { KU64(0xD29F2CFC8BC07E97), KU64(0x19E056584240FDE5) },
+  { KU64(0xA3A37C1DD7584F1E), KU64(0x102C35F729689EAF) }, { KU64(0x8C8C5B254D2E62E6), KU64(0x14374374F3C2C65B) },
+  { KU64(0x6FAF71EEA079FB9F), KU64(0x1945145230B377F2) }, { KU64(0x0B9B4E6A48987A87), KU64(0x1F965966BCE055EF) },
+  { KU64(0x674111026D5F4C94), KU64(0x13BDF7E0360C35B5) }, { KU64(0xC111554308B71FBA), KU64(0x18AD75D8438F4322) },
+  { KU64(0x7155AA93CAE4E7A8), KU64(0x1ED8D34E547313EB) }, { KU64(0x26D58A9C5ECF10C9), KU64(0x13478410F4C7EC73) },
+  { KU64(0xF08AED437682D4FB), KU64(0x1819651531F9E78F) }, { KU64(0xECADA89454238A3A), KU64(0x1E1FBE5A7E786173) },
+  { KU64(0x73EC895CB4963664), KU64(0x12D3D6F88F0B3CE8) }, { KU64(0x90E7ABB3E1BBC3FD), KU64(0x1788CCB6B2CE0C22) },
+  { KU64(0x352196A0DA2AB4FD), KU64(0x1D6AFFE45F818F2B) }, { KU64(0x0134FE24885AB11E), KU64(0x1262DFEEBBB0F97B) },
+  { KU64(0xC1823DADAA715D65), KU64(0x16FB97EA6A9D37D9) }, { KU64(0x31E2CD19150DB4BF), KU64(0x1CBA7DE5054485D0) },
+  { KU64(0x1F2DC02FAD2890F7), KU64(0x11F48EAF234AD3A2) }, { KU64(0xA6F9303B9872B535), KU64(0x1671B25AEC1D888A) },
+  { KU64(0x50B77C4A7E8F6282), KU64(0x1C0E1EF1A724EAAD) }, { KU64(0x5272ADAE8F199D91), KU64(0x1188D357087712AC) },
+  { KU64(0x670F591A32E004F6), KU64(0x15EB082CCA94D757) }, { KU64(0x40D32F60BF980633), KU64(0x1B65CA37FD3A0D2D) },
+  { KU64(0x4883FD9C77BF03E0), KU64(0x111F9E62FE44483C) }, { KU64(0x5AA4FD0395AEC4D8), KU64(0x156785FBBDD55A4B) },
+  { KU64(0x314E3C447B1A760E), KU64(0x1AC1677AAD4AB0DE) }, { KU64(0xDED0E5AACCF089C9), KU64(0x10B8E0ACAC4EAE8A) },
+  { KU64(0x96851F15802CAC3B), KU64(0x14E718D7D7625A2D) }, { KU64(0xFC2666DAE037D74A), KU64(0x1A20DF0DCD3AF0B8) },
+  { KU64(0x9D980048CC22E68E), KU64(0x10548B68A044D673) }, { KU64(0x84FE005AFF2BA032), KU64(0x1469AE42C8560C10) },
+  { KU64(0xA63D8071BEF6883E), KU64(0x198419D37A6B8F14) }, { KU64(0xCFCCE08E2EB42A4E), KU64(0x1FE52048590672D9) },
+  { KU64(0x21E00C58DD309A70), KU64(0x13EF342D37A407C8) }, { KU64(0x2A580F6F147CC10D), KU64(0x18EB0138858D09BA) },
+  { KU64(0xB4EE134AD99BF150), KU64(0x1F25C186A6F04C28) }, { KU64(0x7114CC0EC80176D2), KU64(0x137798F428562F99) },
+  { KU64(0xCD59FF127A01D486), KU64(0x18557F31326BBB7F) }, { KU64(0xC0B07ED7188249A8), KU64(0x1E6ADEFD7F06AA5F) },
+  { KU64(0xD86E4F466F516E09), KU64(0x1302CB5E6F642A7B) }, { KU64(0xCE89E3180B25C98B), KU64(0x17C37E360B3D351A) },
+  { KU64(0x822C5BDE0DEF3BEE), KU64(0x1DB45DC38E0C8261) }, { KU64(0xF15BB96AC8B58575), KU64(0x1290BA9A38C7D17C) },
+  { KU64(0x2DB2A7C57AE2E6D2), KU64(0x1734E940C6F9C5DC) }, { KU64(0x391F51B6D99BA086), KU64(0x1D022390F8B83753) },
+  { KU64(0x03B3931248014454), KU64(0x1221563A9B732294) }, { KU64(0x04A077D6DA019569), KU64(0x16A9ABC9424FEB39) },
+  { KU64(0x45C895CC9081FAC3), KU64(0x1C5416BB92E3E607) }, { KU64(0x8B9D5D9FDA513CBA), KU64(0x11B48E353BCE6FC4) },
+  { KU64(0xAE84B507D0E58BE8), KU64(0x1621B1C28AC20BB5) }, { KU64(0x1A25E249C51EEEE3), KU64(0x1BAA1E332D728EA3) },
+  { KU64(0xF057AD6E1B33554D), KU64(0x114A52DFFC679925) }, { KU64(0x6C6D98C9A2002AA1), KU64(0x159CE797FB817F6F) },
+  { KU64(0x4788FEFC0A803549), KU64(0x1B04217DFA61DF4B) }, { KU64(0x0CB59F5D8690214E), KU64(0x10E294EEBC7D2B8F) },
+  { KU64(0xCFE30734E83429A1), KU64(0x151B3A2A6B9C7672) }, { KU64(0x83DBC9022241340A), KU64(0x1A6208B50683940F) },
+  { KU64(0xB2695DA15568C086), KU64(0x107D457124123C89) }, { KU64(0x1F03B509AAC2F0A7), KU64(0x149C96CD6D16CBAC) },
+  { KU64(0x26C4A24C1573ACD1), KU64(0x19C3BC80C85C7E97) }, { KU64(0x783AE56F8D684C03), KU64(0x101A55D07D39CF1E) },
+  { KU64(0x16499ECB70C25F03), KU64(0x1420EB449C8842E6) }, { KU64(0x9BDC067E4CF2F6C4), KU64(0x19292615C3AA539F) },
+  { KU64(0x82D3081DE02FB476), KU64(0x1F736F9B3494E887) }, { KU64(0xB1C3E512AC1DD0C9), KU64(0x13A825C100DD1154) },
+  { KU64(0xDE34DE57572544FC), KU64(0x18922F31411455A9) }, { KU64(0x55C215ED2CEE963B), KU64(0x1EB6BAFD91596B14) },
+  { KU64(0xB5994DB43C151DE5), KU64(0x133234DE7AD7E2EC) }, { KU64(0xE2FFA1214B1A655E), KU64(0x17FEC216198DDBA7) },
+  { KU64(0xDBBF89699DE0FEB6), KU64(0x1DFE729B9FF15291) }, { KU64(0x2957B5E202AC9F31), KU64(0x12BF07A143F6D39B) },
+  { KU64(0xF3ADA35A8357C6FE), KU64(0x176EC98994F48881) }, { KU64(0x70990C31242DB8BD), KU64(0x1D4A7BEBFA31AAA2) },
+  { KU64(0x865FA79EB69C9376), KU64(0x124E8D737C5F0AA5) }, { KU64(0xE7F791866443B854), KU64(0x16E230D05B76CD4E) },
+  { KU64(0xA1F575E7FD54A669), KU64(0x1C9ABD04725480A2) }, { KU64(0xA53969B0FE54E801), KU64(0x11E0B622C774D065) },
+  { KU64(0x0E87C41D3DEA2202), KU64(0x1658E3AB7952047F) }, { KU64(0xD229B5248D64AA82), KU64(0x1BEF1C9657A6859E) },
+  { KU64(0x435A1136D85EEA91), KU64(0x117571DDF6C81383) }, { KU64(0x143095848E76A536), KU64(0x15D2CE55747A1864) },
+  { KU64(0x193CBAE5B2144E83), KU64(0x1B4781EAD1989E7D) }, { KU64(0x2FC5F4CF8F4CB112), KU64(0x110CB132C2FF630E) },
+  { KU64(0xBBB77203731FDD56), KU64(0x154FDD7F73BF3BD1) }, { KU64(0x2AA54E844FE7D4AC), KU64(0x1AA3D4DF50AF0AC6) },
+  { KU64(0xDAA75112B1F0E4EB), KU64(0x10A6650B926D66BB) }, { KU64(0xD15125575E6D1E26), KU64(0x14CFFE4E7708C06A) },
+  { KU64(0x85A56EAD360865B0), KU64(0x1A03FDE214CAF085) }, { KU64(0x7387652C41C53F8E), KU64(0x10427EAD4CFED653) },
+  { KU64(0x50693E7752368F71), KU64(0x14531E58A03E8BE8) }, { KU64(0x64838E1526C4334E), KU64(0x1967E5EEC84E2EE2) },
+  { KU64(0xFDA4719A70754022), KU64(0x1FC1DF6A7A61BA9A) }, { KU64(0xDE86C70086494815), KU64(0x13D92BA28C7D14A0) },
+  { KU64(0x162878C0A7DB9A1A), KU64(0x18CF768B2F9C59C9) }, { KU64(0x5BB296F0D1D280A1), KU64(0x1F03542DFB83703B) },
+  { KU64(0x194F9E5683239064), KU64(0x1362149CBD322625) }, { KU64(0x5FA385EC23EC747E), KU64(0x183A99C3EC7EAFAE) },
+  { KU64(0xF78C67672CE7919D), KU64(0x1E494034E79E5B99) }, { KU64(0x3AB7C0A07C10BB02), KU64(0x12EDC82110C2F940) },
+  { KU64(0x4965B0C89B14E9C3), KU64(0x17A93A2954F3B790) }, { KU64(0x5BBF1CFAC1DA2433), KU64(0x1D9388B3AA30A574) },
+  { KU64(0xB957721CB92856A0), KU64(0x127C35704A5E6768) }, { KU64(0xE7AD4EA3E7726C48), KU64(0x171B42CC5CF60142) },
+  { KU64(0xA198A24CE14F075A), KU64(0x1CE2137F74338193) }, { KU64(0x44FF65700CD16498), KU64(0x120D4C2FA8A030FC) },
+  { KU64(0x563F3ECC1005BDBE), KU64(0x16909F3B92C83D3B) }, { KU64(0x2BCF0E7F14072D2E), KU64(0x1C34C70A777A4C8A) },
+  { KU64(0x5B61690F6C847C3D), KU64(0x11A0FC668AAC6FD6) }, { KU64(0xF239C35347A59B4C), KU64(0x16093B802D578BCB) },
+  { KU64(0xEEC83428198F021F), KU64(0x1B8B8A6038AD6EBE) }, { KU64(0x553D20990FF96153), KU64(0x1137367C236C6537) },
+  { KU64(0x2A8C68BF53F7B9A8), KU64(0x1585041B2C477E85) }, { KU64(0x752F82EF28F5A812), KU64(0x1AE64521F7595E26) },
+  { KU64(0x093DB1D57999890B), KU64(0x10CFEB353A97DAD8) }, { KU64(0x0B8D1E4AD7FFEB4E), KU64(0x1503E602893DD18E) },
+  { KU64(0x8E7065DD8DFFE622), KU64(0x1A44DF832B8D45F1) }, { KU64(0xF9063FAA78BFEFD5), KU64(0x106B0BB1FB384BB6) },
+  { KU64(0xB747CF9516EFEBCA), KU64(0x1485CE9E7A065EA4) }, { KU64(0xE519C37A5CABE6BD), KU64(0x19A742461887F64D) },
+  { KU64(0xAF301A2C79EB7036), KU64(0x1008896BCF54F9F0) }, { KU64(0xDAFC20B798664C43), KU64(0x140AABC6C32A386C) },
+  { KU64(0x11BB28E57E7FDF54), KU64(0x190D56B873F4C688) }, { KU64(0x1629F31EDE1FD72A), KU64(0x1F50AC6690F1F82A) },
+  { KU64(0x4DDA37F34AD3E67A), KU64(0x13926BC01A973B1A) }, { KU64(0xE150C5F01D88E019), KU64(0x187706B0213D09E0) },
+  { KU64(0x19A4F76C24EB181F), KU64(0x1E94C85C298C4C59) }, { KU64(0xB0071AA39712EF13), KU64(0x131CFD3999F7AFB7) },
+  { KU64(0x9C08E14C7CD7AAD8), KU64(0x17E43C8800759BA5) }, { KU64(0x030B199F9C0D958E), KU64(0x1DDD4BAA0093028F) },
+  { KU64(0x61E6F003C1887D79), KU64(0x12AA4F4A405BE199) }, { KU64(0xBA60AC04B1EA9CD7), KU64(0x1754E31CD072D9FF) },
+  { KU64(0xA8F8D705DE65440D), KU64(0x1D2A1BE4048F907F) }, { KU64(0xC99B8663AAFF4A88), KU64(0x123A516E82D9BA4F) },
+  { KU64(0xBC0267FC95BF1D2A), KU64(0x16C8E5CA239028E3) }, { KU64(0xAB0301FBBB2EE474), KU64(0x1C7B1F3CAC74331C) },
+  { KU64(0xEAE1E13D54FD4EC9), KU64(0x11CCF385EBC89FF1) }, { KU64(0x659A598CAA3CA27B), KU64(0x1640306766BAC7EE) },
+  { KU64(0xFF00EFEFD4CBCB1A), KU64(0x1BD03C81406979E9) }, { KU64(0x3F6095F5E4FF5EF0), KU64(0x116225D0C841EC32) },
+  { KU64(0xCF38BB735E3F36AC), KU64(0x15BAAF44FA52673E) }, { KU64(0x8306EA5035CF0457), KU64(0x1B295B1638E7010E) },
+  { KU64(0x11E4527221A162B6), KU64(0x10F9D8EDE39060A9) }, { KU64(0x565D670EAA09BB64), KU64(0x15384F295C7478D3) },
+  { KU64(0x2BF4C0D2548C2A3D), KU64(0x1A8662F3B3919708) }, { KU64(0x1B78F88374D79A66), KU64(0x1093FDD8503AFE65) },
+  { KU64(0x625736A4520D8100), KU64(0x14B8FD4E6449BDFE) }, { KU64(0xFAED044D6690E140), KU64(0x19E73CA1FD5C2D7D) },
+  { KU64(0xBCD422B0601A8CC8), KU64(0x103085E53E599C6E) }, { KU64(0x6C092B5C78212FFA), KU64(0x143CA75E8DF0038A) },
+  { KU64(0x070B763396297BF8), KU64(0x194BD136316C046D) }, { KU64(0x48CE53C07BB3DAF6), KU64(0x1F9EC583BDC70588) },
+  { KU64(0x2D80F4584D5068DA), KU64(0x13C33B72569C6375) }, { KU64(0x78E1316E60A48310), KU64(0x18B40A4EEC437C52) }
+};
+
+// ceil(log2(5^e)) for `0 <= e <= 3528` (and 1 for e == 0)
+static inline int32_t kk_ryu_pow5bits(int32_t e) {
+  return (int32_t)(((uint32_t)e * 1217359) >> 19) + 1;
+}
+
+// floor(log10(2^e)) for `0 <= e <= 1650`
+static inline uint32_t kk_ryu_log10_pow2(int32_t e) {
+  return ((uint32_t)e * 78913) >> 18;
+}
+
+// floor(log10(5^e)) for `0 <= e <= 2620`
+static inline uint32_t kk_ryu_log10_pow5(int32_t e) {
+  return ((uint32_t)e * 732923) >> 20;
+}
+
+static inline uint32_t kk_ryu_pow5_factor(uint64_t value) {
+  uint32_t count = 0;
+  while (value % 5 == 0) {
+    value /= 5;
+    count++;
+  }
+  return count;
+}
+
+static inline bool kk_ryu_multiple_of_pow5(uint64_t value, uint32_t p) {
+  return (kk_ryu_pow5_factor(value) >= p);
+}
+
+static inline bool kk_ryu_multiple_of_pow2(uint64_t value, uint32_t p) {
+  return ((value & ((KU64(1) << p) - 1)) == 0);
+}
+
+// 64x64 to 128-bit multiply returning the high part in `hi`
+static inline uint64_t kk_ryu_umul128(uint64_t a, uint64_t b, uint64_t* hi) {
+#if defined(__SIZEOF_INT128__)
+  __extension__ unsigned __int128 p = (unsigned __int128)a * b;
+  *hi = (uint64_t)(p >> 64);
+  return (uint64_t)p;
+#else
+  const uint64_t a0 = (uint32_t)a, a1 = a >> 32;
+  const uint64_t b0 = (uint32_t)b, b1 = b >> 32;
+  const uint64_t p00 = a0*b0, p01 = a0*b1, p10 = a1*b0, p11 = a1*b1;
+  const uint64_t mid = (p00 >> 32) + (uint32_t)p01 + (uint32_t)p10;
+  *hi = p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+  return (mid << 32) | (uint32_t)p00;
+#endif
+}
+
+// (m * mul) >> j  where `m` is at most 55 bits and `64 < j < 128`
+static inline uint64_t kk_ryu_mulshift64(uint64_t m, const uint64_t* mul, int32_t j) {
+  uint64_t hi1;
+  const uint64_t lo1 = kk_ryu_umul128(m, mul[1], &hi1);
+  uint64_t hi0;
+  kk_ryu_umul128(m, mul[0], &hi0);
+  const uint64_t sum = hi0 + lo1;
+  if (sum < hi0) hi1++;  // carry
+  const int32_t shift = j - 64;
+  kk_assert_internal(shift > 0 && shift < 64);
+  return ((hi1 << (64 - shift)) | (sum >> shift));
+}
+
+// The shortest decimal `digits * 10^exp10` of a finite positive double that round-trips.
+static void kk_ryu_shortest(uint64_t ieee_mantissa, uint32_t ieee_exponent, uint64_t* digits, int32_t* exp10) {
+  int32_t e2;
+  uint64_t m2;
+  if (ieee_exponent == 0) {
+    e2 = 1 - KK_RYU_BIAS - KK_RYU_MANTISSA_BITS - 2;
+    m2 = ieee_mantissa;
+  }
+  else {
+    e2 = (int32_t)ieee_exponent - KK_RYU_BIAS - KK_RYU_MANTISSA_BITS - 2;
+    m2 = (KU64(1) << KK_RYU_MANTISSA_BITS) | ieee_mantissa;
+  }
+  const bool accept_bounds = ((m2 & 1) == 0);
+
+  // the interval of decimals that round to this double (scaled by 4)
+  const uint64_t mv = 4 * m2;
+  const uint32_t mm_shift = (ieee_mantissa != 0 || ieee_exponent <= 1 ? 1 : 0);
+
+  // compute `vr`, `vp`, `vm` as the decimal scaled `mv`, `mv + 2`, and `mv - 1 - mm_shift`
+  uint64_t vr, vp, vm;
+  int32_t e10;
+  bool vm_is_trailing_zeros = false;
+  bool vr_is_trailing_zeros = false;
+  if (e2 >= 0) {
+    const uint32_t q = kk_ryu_log10_pow2(e2) - (e2 > 3 ? 1 : 0);
+    e10 = (int32_t)q;
+    const int32_t k = KK_RYU_POW5_INV_BITCOUNT + kk_ryu_pow5bits((int32_t)q) - 1;
+    const int32_t i = -e2 + (int32_t)q + k;
+    vr = kk_ryu_mulshift64(4*m2, kk_ryu_pow5_inv_split[q], i);
+    vp = kk_ryu_mulshift64(4*m2 + 2, kk_ryu_pow5_inv_split[q], i);
+    vm = kk_ryu_mulshift64(4*m2 - 1 - mm_shift, kk_ryu_pow5_inv_split[q], i);
+    if (q <= 21) {
+      // only one of mp, mv, and mm can be a multiple of 5, if any
+      if (mv % 5 == 0) {
+        vr_is_trailing_zeros = kk_ryu_multiple_of_pow5(mv, q);
+      }
+      else if (accept_bounds) {
+        vm_is_trailing_zeros = kk_ryu_multiple_of_pow5(mv - 1 - mm_shift, q);
+      }
+      else {
+        vp -= (kk_ryu_multiple_of_pow5(mv + 2, q) ? 1 : 0);
+      }
+    }
+  }
+  else {
+    const uint32_t q = kk_ryu_log10_pow5(-e2) - (-e2 > 1 ? 1 : 0);
+    e10 = (int32_t)q + e2;
+    const int32_t i = -e2 - (int32_t)q;
+    const int32_t k = kk_ryu_pow5bits(i) - KK_RYU_POW5_BITCOUNT;
+    const int32_t j = (int32_t)q - k;
+    vr = kk_ryu_mulshift64(4*m2, kk_ryu_pow5_split[i], j);
+    vp = kk_ryu_mulshift64(4*m2 + 2, kk_ryu_pow5_split[i], j);
+    vm = kk_ryu_mulshift64(4*m2 - 1 - mm_shift, kk_ryu_pow5_split[i], j);
+    if (q <= 1) {
+      // `mv` has at least q trailing 0 bits, so `vr` is a multiple of 10^q
+      vr_is_trailing_zeros = true;
+      if (accept_bounds) {
+        vm_is_trailing_zeros = (mm_shift == 1);
+      }
+      else {
+        vp--;
+      }
+    }
+    else if (q < 63) {
+      vr_is_trailing_zeros = kk_ryu_multiple_of_pow2(mv, q);
+    }
+  }
+
+  // remove digits while the interval allows it
+  int32_t removed = 0;
+  uint8_t last_removed_digit = 0;
+  uint64_t output;
+  if (vm_is_trailing_zeros || vr_is_trailing_zeros) {
+    // general case (rare)
+    while (vp / 10 > vm / 10) {
+      vm_is_trailing_zeros &= (vm % 10 == 0);
+      vr_is_trailing_zeros &= (last_removed_digit == 0);
+      last_removed_digit = (uint8_t)(vr % 10);
+      vr /= 10; vp /= 10; vm /= 10;
+      removed++;
+    }
+    if (vm_is_trailing_zeros) {
+      while (vm % 10 == 0) {
+        vr_is_trailing_zeros &= (last_removed_digit == 0);
+        last_removed_digit = (uint8_t)(vr % 10);
+        vr /= 10; vp /= 10; vm /= 10;
+        removed++;
+      }
+    }
+    if (vr_is_trailing_zeros && last_removed_digit == 5 && vr % 2 == 0) {
+      last_removed_digit = 4;  // round to even on an exact tie
+    }
+    output = vr + (((vr == vm && (!accept_bounds || !vm_is_trailing_zeros)) || last_removed_digit >= 5) ? 1 : 0);
+  }
+  else {
+    // common case
+    bool round_up = false;
+    if (vp / 100 > vm / 100) {
+      round_up = (vr % 100 >= 50);
+      vr /= 100; vp /= 100; vm /= 100;
+      removed += 2;
+    }
+    while (vp / 10 > vm / 10) {
+      round_up = (vr % 10 >= 5);
+      vr /= 10; vp /= 10; vm /= 10;
+      removed++;
+    }
+    output = vr + ((vr == vm || round_up) ? 1 : 0);
+  }
+  *digits = output;
+  *exp10 = e10 + removed;
+}
+
+
+/*--------------------------------------------------------------------------------------------------
+  Decimal digits
+--------------------------------------------------------------------------------------------------*/
+
+// A decimal `d[0].d[1]...d[len-1] * 10^exp` (with `exp` the scientific exponent)
+typedef struct kk_decimal_s {
+  char    d[24];
+  int32_t len;
+  int32_t exp;
+  bool    exact;   // are the digits the exact value of the double?
+  bool    normal;  // is the double normal? (and thus precise to at least 15 digits)
+} kk_decimal_t;
+
+// Shortest decimal of a finite `d` (ignoring the sign).
+static void kk_decimal_shortest(double d, kk_decimal_t* dec) {
+  uint64_t bits;
+  kk_memcpy(&bits, &d, sizeof(bits));
+  const uint64_t ieee_mantissa = bits & ((KU64(1) << KK_RYU_MANTISSA_BITS) - 1);
+  const uint32_t ieee_exponent = (uint32_t)((bits >> KK_RYU_MANTISSA_BITS) & ((1U << KK_RYU_EXPONENT_BITS) - 1));
+  if (ieee_mantissa == 0 && ieee_exponent == 0) {
+    dec->d[0] = '0';
+    dec->len = 1;
+    dec->exp = 0;
+    dec->exact = true;
+    dec->normal = true;
+    return;
+  }
+  uint64_t digits;
+  int32_t exp10;
+  kk_ryu_shortest(ieee_mantissa, ieee_exponent, &digits, &exp10);
+  char tmp[24];
+  int32_t n = 0;
+  do {
+    tmp[n++] = (char)('0' + (digits % 10));
+    digits /= 10;
+  } while (digits != 0);
+  while (n > 1 && tmp[0] == '0') {  // remove trailing zeros
+    kk_memmove(tmp, tmp + 1, n - 1);
+    n--;
+    exp10++;
+  }
+  for (int32_t i = 0; i < n; i++) {
+    dec->d[i] = tmp[n - 1 - i];
+  }
+  dec->len = n;
+  dec->exp = exp10 + n - 1;
+  // integers below 2^53 are exact
+  const double a = (d < 0 ? -d : d);
+  dec->exact = (a < 9007199254740992.0 && a == (double)(int64_t)a);
+  dec->normal = (ieee_exponent != 0);
+}
+
+// Round to `prec` significant digits. Returns `false` if the result may differ from rounding
+// the exact binary value of the double (and `snprintf` should be used instead).
+static bool kk_decimal_round(kk_decimal_t* dec, int32_t prec) {
+  if (prec <= 0) return false;
+  if (dec->len <= prec) {
+    // for normal doubles, the shortest digits are closest to the exact value up to 15 significant digits
+    return (dec->exact || (prec <= 15 && dec->normal));
+  }
+  if (dec->len == prec + 1 && dec->d[prec] == '5') return false;  // a tie in the shortest digits
+  // no decimal of `prec + 1` digits is between the double and its shortest digits
+  const bool up = (dec->d[prec] >= '5');
+  dec->len = prec;
+  if (up) {
+    int32_t i = prec - 1;
+    while (i >= 0 && dec->d[i] == '9') {
+      dec->d[i] = '0';
+      i--;
+    }
+    if (i >= 0) {
+      dec->d[i]++;
+    }
+    else {
+      dec->d[0] = '1';  // 9.99 -> 10.0
+      dec->exp++;
+    }
+  }
+  while (dec->len > 1 && dec->d[dec->len - 1] == '0') { dec->len--; }
+  return true;
+}
+
+static char* kk_decimal_put_exp(char* p, int32_t exp) {
+  *p++ = 'e';
+  if (exp < 0) { *p++ = '-'; exp = -exp; }
+          else { *p++ = '+'; }
+  if (exp >= 100) { *p++ = (char)('0' + exp / 100); exp %= 100; *p++ = (char)('0' + exp / 10); }
+             else { *p++ = (char)('0' + exp / 10); }
+  *p++ = (char)('0' + exp % 10);
+  return p;
+}
+
+// Exponential notation with (at least) `frac` digits after the dot; no exponent if it is 0.
+static char* kk_decimal_put_exponential(char* p, const kk_decimal_t* dec, int32_t frac) {
+  *p++ = dec->d[0];
+  if (frac > 0 || dec->len > 1) {
+    *p++ = '.';
+    for (int32_t i = 1; i < dec->len; i++) { *p++ = dec->d[i]; }
+    for (int32_t i = dec->len - 1; i < frac; i++) { *p++ = '0'; }
+  }
+  if (dec->exp != 0) p = kk_decimal_put_exp(p, dec->exp);
+  return p;
+}
+
+// Fixed notation with (at least) `frac` digits after the dot.
+static char* kk_decimal_put_fixed(char* p, const kk_decimal_t* dec, int32_t frac) {
+  int32_t i = 0;
+  if (dec->exp < 0) {
+    *p++ = '0';
+  }
+  else {
+    for (; i <= dec->exp; i++) { *p++ = (i < dec->len ? dec->d[i] : '0'); }
+  }
+  const int32_t ndigits = dec->len - 1 - dec->exp;  // digits after the dot
+  const int32_t n = (ndigits > frac ? ndigits : frac);
+  if (n > 0) {
+    *p++ = '.';
+    for (int32_t k = 1; k <= n; k++) {
+      const int32_t j = dec->exp + k;
+      *p++ = (j >= 0 && j < dec->len ? dec->d[j] : '0');
+    }
+  }
+  return p;
+}
+
+// Handle sign and special values; returns `NULL` for a finite `d`.
+static const char* kk_double_show_special(double d) {
+  if (isnan(d)) return "nan";
+  if (isinf(d)) return (d < 0 ? "-inf" : "inf");
+  return NULL;
+}
+
+// Like `%.<prec>g` but using the shortest digits that round-trip if `prec >= 17`
+static kk_string_t kk_double_show_general(double d, int32_t prec, kk_context_t* ctx) {
+  const char* special = kk_double_show_special(d);
+  if (special != NULL) return kk_string_alloc_dup_valid_utf8(special, ctx);
+  if (prec <= 0) prec = 1;
+  if (prec > 48) prec = 48;
+  char buf[64];
+  kk_decimal_t dec;
+  kk_decimal_shortest(d, &dec);
+  if ((dec.len > prec || prec < 17) && !kk_decimal_round(&dec, prec)) {
+    snprintf(buf, sizeof(buf), "%.*g", (int)prec, d);
+    return kk_string_alloc_dup_valid_utf8(buf, ctx);
+  }
+  char* p = buf;
+  if (signbit(d)) *p++ = '-';
+  if (dec.exp < -4 || dec.exp >= prec) {
+    p = kk_decimal_put_exponential(p, &dec, 0);
+  }
+  else {
+    p = kk_decimal_put_fixed(p, &dec, 0);
+  }
+  *p = 0;
+  return kk_string_alloc_dup_valid_utf8(buf, ctx);
+}
+
+// Show with `prec` digits after the dot in fixed (`%f`) or exponential (`%e`) notation.
+static kk_string_t kk_double_show_prec(double d, int32_t prec, bool exponential, kk_context_t* ctx) {
+  const char* special = kk_double_show_special(d);
+  if (special != NULL) return kk_string_alloc_dup_valid_utf8(special, ctx);
+  if (prec > 48) prec = 48;
+  char buf[400];   // room for `-1e308` in fixed notation with 48 digits after the dot
+  kk_decimal_t dec;
+  kk_decimal_shortest(d, &dec);
+  const int32_t digits = (exponential ? prec + 1 : dec.exp + 1 + prec);
+  if (!kk_decimal_round(&dec, digits)) {
+    snprintf(buf, sizeof(buf), (exponential ? "%.*e" : "%.*f"), (int)prec, d);
+    if (exponential) {
+      // remove a 0 exponent
+      char* e = strchr(buf, 'e');
+      if (e != NULL && atoi(e + 1) == 0) *e = 0;
+    }
+    return kk_string_alloc_dup_valid_utf8(buf, ctx);
+  }
+  char* p = buf;
+  if (signbit(d)) *p++ = '-';
+  p = (exponential ? kk_decimal_put_exponential(p, &dec, prec) : kk_decimal_put_fixed(p, &dec, prec));
+  *p = 0;
+  return kk_string_alloc_dup_valid_utf8(buf, ctx);
+}
+
+kk_string_t kk_double_show_fixed(double d, int32_t prec, kk_context_t* ctx) {
+  return (prec < 0 ? kk_double_show_general(d, -prec, ctx) : kk_double_show_prec(d, prec, false, ctx));
+}
+
+kk_string_t kk_double_show_exp(double d, int32_t prec, kk_context_t* ctx) {
+  return (prec < 0 ? kk_double_show_general(d, -prec, ctx) : kk_double_show_prec(d, prec, true, ctx));
+}
+
+// With a precision of 0 this uses the shortest digits that round-trip
+kk_string_t kk_double_show(double d, int32_t prec, kk_context_t* ctx) {
+  if (prec < 0) prec = -prec;
+  return kk_double_show_general(d, (prec == 0 ? 17 : prec), ctx);
+}
+
+
+/*--------------------------------------------------------------------------------------------------
+  Parsing doubles.
+  A decimal with at most 15 significant digits and a small exponent is exactly representable
+  after one (correctly rounded) multiplication or division by an exact power of 10 [2].
+  Otherwise we use `strtod`.
+
+  [2] William D. Clinger, "How to read floating point numbers accurately", PLDI 1990.
+--------------------------------------------------------------------------------------------------*/
+
+static const double kk_pow10_exact[23] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+double kk_double_parse(const char* s, kk_ssize_t len) {
+  kk_assert_internal(s[len] == 0);
+#if (FLT_EVAL_METHOD == 0)
+  const char* p = s;
+  const char* const end = s + len;
+  bool neg = false;
+  if (p < end && (*p == '-' || *p == '+')) { neg = (*p == '-'); p++; }
+  uint64_t m = 0;
+  int32_t ndigits = 0;   // significant digits in `m`
+  int32_t exp = 0;
+  const char* const start = p;
+  for (; p < end && *p >= '0' && *p <= '9'; p++) {
+    if (m != 0 || *p != '0') { m = 10*m + (uint64_t)(*p - '0'); ndigits++; }
+    if (ndigits > 15) goto slow;
+  }
+  bool has_digits = (p > start);
+  if (p < end && *p == '.') {
+    p++;
+    const char* const fstart = p;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+      if (m != 0 || *p != '0') { m = 10*m + (uint64_t)(*p - '0'); ndigits++; }
+      exp--;
+      if (ndigits > 15) goto slow;
+    }
+    has_digits = has_digits || (p > fstart);
+  }
+  if (!has_digits) goto slow;
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    p++;
+    bool eneg = false;
+    if (p < end && (*p == '-' || *p == '+')) { eneg = (*p == '-'); p++; }
+    if (p >= end || *p < '0' || *p > '9') goto slow;
+    int32_t e = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+      e = 10*e + (*p - '0');
+      if (e > 1000) goto slow;
+    }
+    exp += (eneg ? -e : e);
+  }
+  if (p != end) goto slow;
+  {
+    double d = (double)m;  // exact as `m < 10^15 < 2^53`
+    if (exp < 0) {
+      if (exp < -22) goto slow;
+      d /= kk_pow10_exact[-exp];
+    }
+    else {
+      if (exp > 22) goto slow;
+      d *= kk_pow10_exact[exp];
+    }
+    return (neg ? -d : d);
+  }
+slow:
+#else
+  KK_UNUSED(len);
+#endif
+  return strtod(s, NULL);
+}
@@ -0,0 +1,460 @@
+/*---------------------------------------------------------------------------
+  Copyright 2021, Microsoft Research, Daan Leijen.
+
+  This is free software; you can redistribute it and/or modify it under the
+  terms of the Apache License, Version 2.0. A copy of the License can be
+  found in the LICENSE file at the root of this distribution.
+---------------------------------------------------------------------------*/
+#include "kklib.h"
+
+#if defined(__GLIBC__) || defined(__APPLE__)
+#include <execinfo.h>
+#define KK_HAS_BACKTRACE  1
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#include <signal.h>
+#define KK_HAS_SIGUSR     1
+#endif
+
+/*--------------------------------------------------------------------------------------------------
+  Sampling heap profiler (`--kkheapprof[=FILE]` and `--kkheapprof-rate=N`)
+
+  Every allocation in `kk_block_alloc_at`, `kk_block_alloc`, `kk_block_alloc_any`, and
+  `kk_block_large_alloc` decrements `ctx->heap_sample_countdown` by its size; only when it
+  drops below zero do we call `kk_heapprof_sample`. That allocation is recorded with its tag,
+  its size, and a short backtrace, weighted by the number of sample points (every `rate`
+  bytes) it covers. When disabled the countdown starts at `KK_SSIZE_MAX`.
+
+  Samples with the same tag and backtrace are aggregated in a process wide table. At exit
+  (and on `SIGUSR2`) the table is written as an (uncompressed) pprof `profile.proto`
+  with `alloc_objects` and `alloc_space` sample values and a `tag` label; use
+  `pprof -top <program> <file>`. On Linux the executable mappings from `/proc/self/maps`
+  are included so `pprof` can symbolize the addresses.
+  Only allocations are profiled (not frees) as that keeps the free path untouched.
+--------------------------------------------------------------------------------------------------*/
+
+#define KK_HEAPPROF_FRAMES        (16)          // maximal backtrace depth
+#define KK_HEAPPROF_RATE_DEFAULT  (512*1024)    // sample every 512KiB by default
+
+typedef struct kk_heapprof_entry_s {
+  uint64_t   hash;       // 0 for an empty entry
+  kk_tag_t   tag;
+  int32_t    frame_count;
+  void*      frames[KK_HEAPPROF_FRAMES];
+  int64_t    objects;    // estimated allocated objects
+  int64_t    bytes;      // estimated allocated bytes
+  int64_t    samples;
+  int64_t    sample_size; // size of the last sampled allocation
+} kk_heapprof_entry_t;
+
+static kk_ssize_t           heapprof_rate;     // 0 if disabled
+static const char*          heapprof_fname;
+static kk_heapprof_entry_t* heapprof_table;
+static kk_ssize_t           heapprof_size;     // always a power of 2 (or 0)
+static kk_ssize_t           heapprof_count;
+static _Atomic(uintptr_t)   heapprof_lock;
+static _Atomic(uintptr_t)   heapprof_dump_request;
+
+static void kk_heapprof_lock(void) {
+  uintptr_t expected = 0;
+  while (!kk_atomic_cas_weak_acq_rel(&heapprof_lock, &expected, 1)) { expected = 0; }
+}
+
+static void kk_heapprof_unlock(void) {
+  kk_atomic_store_release(&heapprof_lock, 0);
+}
+
+kk_ssize_t kk_heapprof_countdown(void) {
+  return (heapprof_rate > 0 ? heapprof_rate : KK_SSIZE_MAX);
+}
+
+#if KK_HAS_SIGUSR
+static void kk_heapprof_signal(int sig) {
+  KK_UNUSED(sig);
+  kk_atomic_store_relaxed(&heapprof_dump_request, 1);   // dumped at the next sample
+}
+#endif
+
+// Enable heap profiling: sample every `rate` bytes (if > 0) and write the profile to `fname`
+// (if not NULL). Can be called more than once; the defaults are 512KiB and `kkheap.pb.out`.
+void kk_heapprof_enable(const char* fname, kk_ssize_t rate) {
+  if (fname != NULL && fname[0] != 0) heapprof_fname = fname;
+  else if (heapprof_fname == NULL) heapprof_fname = "kkheap.pb.out";
+  if (rate > 0) heapprof_rate = rate;
+  else if (heapprof_rate <= 0) heapprof_rate = KK_HEAPPROF_RATE_DEFAULT;
+#if KK_HAS_SIGUSR
+  signal(SIGUSR2, &kk_heapprof_signal);
+#endif
+}
+
+
+/*--------------------------------------------------------------------------------------------------
+  Sampling
+--------------------------------------------------------------------------------------------------*/
+
+static uint64_t kk_heapprof_hash(kk_tag_t tag, void** frames, int32_t count) {
+  uint64_t h = 0xcbf29ce484222325ULL ^ (uint64_t)tag;   // FNV-1a over the frames
+  for (int32_t i = 0; i < count; i++) {
+    h = (h ^ (uint64_t)(uintptr_t)frames[i]) * 0x100000001b3ULL;
+  }
+  return (h == 0 ? 1 : h);
+}
+
+static bool kk_heapprof_grow(void) {
+  const kk_ssize_t newsize = (heapprof_size == 0 ? 256 : 2*heapprof_size);
+  kk_heapprof_entry_t* table = (kk_heapprof_entry_t*)calloc((size_t)newsize, sizeof(kk_heapprof_entry_t));
+  if (table == NULL) return false;
+  for (kk_ssize_t i = 0; i < heapprof_size; i++) {
+    const kk_heapprof_entry_t* e = &heapprof_table[i];
+    if (e->hash == 0) continue;
+    kk_ssize_t j = (kk_ssize_t)(e->hash & (uint64_t)(newsize - 1));
+    while (table[j].hash != 0) { j = (j + 1) & (newsize - 1); }
+    table[j] = *e;
+  }
+  free(heapprof_table);
+  heapprof_table = table;
+  heapprof_size = newsize;
+  return true;
+}
+
+static void kk_heapprof_record(kk_tag_t tag, void** frames, int32_t count, kk_ssize_t size, int64_t weight) {
+  const uint64_t h = kk_heapprof_hash(tag, frames, count);
+  if (2*(heapprof_count + 1) > heapprof_size && !kk_heapprof_grow()) return;
+  kk_ssize_t i = (kk_ssize_t)(h & (uint64_t)(heapprof_size - 1));
+  kk_heapprof_entry_t* e;
+  while (true) {
+    e = &heapprof_table[i];
+    if (e->hash == 0) {
+      e->hash = h;
+      e->tag = tag;
+      e->frame_count = count;
+      memcpy(e->frames, frames, (size_t)count * sizeof(void*));
+      heapprof_count++;
+      break;
+    }
+    if (e->hash == h && e->tag == tag && e->frame_count == count &&
+        memcmp(e->frames, frames, (size_t)count * sizeof(void*)) == 0) break;
+    i = (i + 1) & (heapprof_size - 1);
+  }
+  e->samples++;
+  e->bytes += weight;
+  e->objects += (weight > size ? weight / size : 1);
+  e->sample_size = size;
+}
+
+// Called from `kk_heapprof_count` once the countdown drops below zero
+void kk_heapprof_sample(kk_ssize_t size, kk_tag_t tag, kk_context_t* ctx) {
+  const kk_ssize_t rate = heapprof_rate;
+  if (rate <= 0) {
+    ctx->heap_sample_countdown = KK_SSIZE_MAX;  // not enabled
+    return;
+  }
+  // the allocation covers one or more sample points
+  const kk_ssize_t points = 1 + (-ctx->heap_sample_countdown - 1) / rate;
+  ctx->heap_sample_countdown += points * rate;
+  void* frames[KK_HEAPPROF_FRAMES + 1];
+  int32_t count = 0;
+#if KK_HAS_BACKTRACE
+  count = (int32_t)backtrace(frames, KK_HEAPPROF_FRAMES + 1) - 1;   // skip this function
+  if (count < 0) count = 0;
+#endif
+  kk_heapprof_lock();
+  kk_heapprof_record(tag, frames + 1, count, (size > 0 ? size : 1), (int64_t)points * rate);
+  kk_heapprof_unlock();
+  if (kk_unlikely(kk_atomic_load_relaxed(&heapprof_dump_request) != 0)) {
+    kk_atomic_store_relaxed(&heapprof_dump_request, 0);
+    kk_heapprof_dump();
+  }
+}
+
+
+/*--------------------------------------------------------------------------------------------------
+  Writing a pprof profile (see <https://github.com/google/pprof/blob/master/proto/profile.proto>)
+  We encode the protocol buffer directly; `pprof` accepts both compressed and uncompressed files.
+--------------------------------------------------------------------------------------------------*/
+
+typedef struct kk_pbuf_s {
+  uint8_t* data;
+  size_t   len;
+  size_t   size;
+  bool     failed;
+} kk_pbuf_t;
+
+static void kk_pbuf_put(kk_pbuf_t* pb, const void* p, size_t n) {
+  if (pb->failed) return;
+  if (pb->len + n > pb->size) {
+    size_t newsize = (pb->size == 0 ? 4096 : 2*pb->size);
+    while (newsize < pb->len + n) { newsize *= 2; }
+    uint8_t* data = (uint8_t*)realloc(pb->data, newsize);
+    if (data == NULL) { pb->failed = true; return; }
+    pb->data = data;
+    pb->size = newsize;
+  }
+  memcpy(pb->data + pb->len, p, n);
+  pb->len += n;
+}
+
+static void kk_pbuf_varint(kk_pbuf_t* pb, uint64_t x) {
+  uint8_t buf[10];
+  size_t n = 0;
+  do {
+    uint8_t c = (uint8_t)(x & 0x7F);
+    x >>= 7;
+    buf[n++] = (x != 0 ? (c | 0x80) : c);
+  } while (x != 0);
+  kk_pbuf_put(pb, buf, n);
+}
+
+static void kk_pbuf_uint(kk_pbuf_t* pb, uint32_t field, uint64_t x) {
+  kk_pbuf_varint(pb, ((uint64_t)field << 3) | 0);   // varint wire type
+  kk_pbuf_varint(pb, x);
+}
+
+static void kk_pbuf_bytes(kk_pbuf_t* pb, uint32_t field, const void* p, size_t n) {
+  kk_pbuf_varint(pb, ((uint64_t)field << 3) | 2);   // length delimited wire type
+  kk_pbuf_varint(pb, n);
+  kk_pbuf_put(pb, p, n);
+}
+
+// Write a nested message
+static void kk_pbuf_message(kk_pbuf_t* pb, uint32_t field, kk_pbuf_t* msg) {
+  kk_pbuf_bytes(pb, field, msg->data, msg->len);
+  if (msg->failed) pb->failed = true;
+  msg->len = 0;
+}
+
+// The string table (with linear lookup as we only have few strings)
+typedef struct kk_pstrings_s {
+  char**     strings;
+  kk_ssize_t count;
+  kk_ssize_t size;
+} kk_pstrings_t;
+
+static uint64_t kk_pstrings_index(kk_pstrings_t* st, const char* s) {
+  for (kk_ssize_t i = 0; i < st->count; i++) {
+    if (strcmp(st->strings[i], s) == 0) return (uint64_t)i;
+  }
+  if (st->count >= st->size) {
+    kk_ssize_t newsize = (st->size == 0 ? 64 : 2*st->size);
+    char** strings = (char**)realloc(st->strings, (size_t)newsize * sizeof(char*));
+    if (strings == NULL) return 0;
+    st->strings = strings;
+    st->size = newsize;
+  }
+  const size_t len = strlen(s);
+  char* t = (char*)malloc(len + 1);
+  if (t == NULL) return 0;
+  memcpy(t, s, len + 1);
+  st->strings[st->count] = t;
+  return (uint64_t)(st->count++);
+}
+
+typedef struct kk_pmapping_s {
+  uint64_t start;
+  uint64_t limit;
+  uint64_t offset;
+  uint64_t filename;
+} kk_pmapping_t;
+
+#define KK_HEAPPROF_MAPPINGS  (256)
+
+// Read the executable mappings (Linux only) so `pprof` can find the binaries to symbolize
+static kk_ssize_t kk_heapprof_mappings(kk_pmapping_t* maps, kk_pstrings_t* st) {
+  kk_ssize_t count = 0;
+#if defined(__linux__)
+  FILE* f = fopen("/proc/self/maps", "r");
+  if (f == NULL) return 0;
+  char line[1024];
+  while (count < KK_HEAPPROF_MAPPINGS && fgets(line, sizeof(line), f) != NULL) {
+    unsigned long long start, limit, offset;
+    char perms[8];
+    int pathpos = 0;
+    if (sscanf(line, "%llx-%llx %7s %llx %*s %*s %n", &start, &limit, perms, &offset, &pathpos) < 4) continue;
+    if (strchr(perms, 'x') == NULL || pathpos <= 0) continue;
+    char* path = line + pathpos;
+    path[strcspn(path, "\n")] = 0;
+    if (path[0] != '/') continue;  // skip anonymous and special mappings
+    maps[count].start = start;
+    maps[count].limit = limit;
+    maps[count].offset = offset;
+    maps[count].filename = kk_pstrings_index(st, path);
+    count++;
+  }
+  fclose(f);
+#else
+  KK_UNUSED(maps); KK_UNUSED(st);
+#endif
+  return count;
+}
+
+static uint64_t kk_heapprof_mapping_id(const kk_pmapping_t* maps, kk_ssize_t count, uint64_t addr) {
+  for (kk_ssize_t i = 0; i < count; i++) {
+    if (addr >= maps[i].start && addr < maps[i].limit) return (uint64_t)(i + 1);
+  }
+  return 0;
+}
+
+// Locations are the unique frame addresses; the location id is the index in `addrs` plus one.
+typedef struct kk_plocations_s {
+  uint64_t*  addrs;       // open addressing table of addresses (0 is empty)
+  uint64_t*  ids;
+  kk_ssize_t size;
+  kk_ssize_t count;
+} kk_plocations_t;
+
+static uint64_t kk_plocations_id(kk_plocations_t* locs, uint64_t addr, kk_pbuf_t* pb, kk_pbuf_t* msg,
+                                 const kk_pmapping_t* maps, kk_ssize_t map_count) {
+  kk_ssize_t i = (kk_ssize_t)((addr * 0x9E3779B97F4A7C15ULL) >> 20) & (locs->size - 1);
+  while (locs->addrs[i] != 0) {
+    if (locs->addrs[i] == addr) return locs->ids[i];
+    i = (i + 1) & (locs->size - 1);
+  }
+  const uint64_t id = (uint64_t)(++locs->count);
+  locs->addrs[i] = addr;
+  locs->ids[i] = id;
+  // Location { id = 1, mapping_id = 2, address = 3 }
+  kk_pbuf_uint(msg, 1, id);
+  const uint64_t mid = kk_heapprof_mapping_id(maps, map_count, addr);
+  if (mid != 0) kk_pbuf_uint(msg, 2, mid);
+  kk_pbuf_uint(msg, 3, addr);
+  kk_pbuf_message(pb, 4, msg);
+  return id;
+}
+
+static void kk_heapprof_write_value_type(kk_pbuf_t* pb, uint32_t field, kk_pbuf_t* msg, uint64_t type, uint64_t unit) {
+  kk_pbuf_uint(msg, 1, type);
+  kk_pbuf_uint(msg, 2, unit);
+  kk_pbuf_message(pb, field, msg);
+}
+
+static bool kk_heapprof_encode(kk_pbuf_t* pb, const kk_heapprof_entry_t* table, kk_ssize_t size, kk_ssize_t count) {
+  kk_pstrings_t st = { NULL, 0, 0 };
+  kk_pbuf_t msg = { NULL, 0, 0, false };
+  kk_pbuf_t sub = { NULL, 0, 0, false };
+  kk_pbuf_t packed = { NULL, 0, 0, false };
+  kk_pstrings_index(&st, "");   // index 0 must be the empty string
+  const uint64_t s_objects = kk_pstrings_index(&st, "alloc_objects");
+  const uint64_t s_count   = kk_pstrings_index(&st, "count");
+  const uint64_t s_space   = kk_pstrings_index(&st, "alloc_space");
+  const uint64_t s_bytes   = kk_pstrings_index(&st, "bytes");
+  const uint64_t s_tag     = kk_pstrings_index(&st, "tag");
+  const uint64_t s_size    = kk_pstrings_index(&st, "size");
+
+  // sample types and the period
+  kk_heapprof_write_value_type(pb, 1, &msg, s_objects, s_count);
+  kk_heapprof_write_value_type(pb, 1, &msg, s_space, s_bytes);
+  kk_heapprof_write_value_type(pb, 11, &msg, s_space, s_bytes);
+  kk_pbuf_uint(pb, 12, (uint64_t)heapprof_rate);
+
+  // mappings
+  kk_pmapping_t maps[KK_HEAPPROF_MAPPINGS];
+  const kk_ssize_t map_count = kk_heapprof_mappings(maps, &st);
+  for (kk_ssize_t i = 0; i < map_count; i++) {
+    // Mapping { id = 1, memory_start = 2, memory_limit = 3, file_offset = 4, filename = 5 }
+    kk_pbuf_uint(&msg, 1, (uint64_t)(i + 1));
+    kk_pbuf_uint(&msg, 2, maps[i].start);
+    kk_pbuf_uint(&msg, 3, maps[i].limit);
+    kk_pbuf_uint(&msg, 4, maps[i].offset);
+    kk_pbuf_uint(&msg, 5, maps[i].filename);
+    kk_pbuf_message(pb, 3, &msg);
+  }
+
+  // locations and samples
+  kk_plocations_t locs = { NULL, NULL, 1, 0 };
+  while (locs.size < 4*(count*KK_HEAPPROF_FRAMES + 1)) { locs.size *= 2; }
+  locs.addrs = (uint64_t*)calloc((size_t)locs.size, sizeof(uint64_t));
+  locs.ids = (uint64_t*)calloc((size_t)locs.size, sizeof(uint64_t));
+  if (locs.addrs == NULL || locs.ids == NULL) pb->failed = true;
+  for (kk_ssize_t i = 0; i < size && !pb->failed; i++) {
+    const kk_heapprof_entry_t* e = &table[i];
+    if (e->hash == 0) continue;
+    // Sample { location_id = 1 (packed), value = 2 (packed), label = 3 }
+    for (int32_t j = 0; j < e->frame_count; j++) {
+      uint64_t addr = (uint64_t)(uintptr_t)e->frames[j];
+      if (addr > 0) addr--;   // return address: point into the call instruction
+      kk_pbuf_varint(&packed, kk_plocations_id(&locs, addr, pb, &sub, maps, map_count));
+    }
+    kk_pbuf_message(&msg, 1, &packed);
+    kk_pbuf_varint(&packed, (uint64_t)e->objects);
+    kk_pbuf_varint(&packed, (uint64_t)e->bytes);
+    kk_pbuf_message(&msg, 2, &packed);
+    // Label { key = 1, str = 2, num = 3, num_unit = 4 }
+    char name[32];
+    kk_tag_name(e->tag, name, sizeof(name));
+    kk_pbuf_uint(&sub, 1, s_tag);
+    kk_pbuf_uint(&sub, 2, kk_pstrings_index(&st, name));
+    kk_pbuf_message(&msg, 3, &sub);
+    kk_pbuf_uint(&sub, 1, s_size);
+    kk_pbuf_uint(&sub, 3, (uint64_t)e->sample_size);
+    kk_pbuf_uint(&sub, 4, s_bytes);
+    kk_pbuf_message(&msg, 3, &sub);
+    kk_pbuf_message(pb, 2, &msg);
+  }
+
+  // the string table
+  for (kk_ssize_t i = 0; i < st.count; i++) {
+    kk_pbuf_bytes(pb, 6, st.strings[i], strlen(st.strings[i]));
+    free(st.strings[i]);
+  }
+  free(st.strings);
+  free(locs.addrs);
+  free(locs.ids);
+  free(msg.data);
+  free(sub.data);
+  free(packed.data);
+  return !(pb->failed || msg.failed || sub.failed || packed.failed);
+}
+
+// Write the current profile; returns `true` if successful.
+bool kk_heapprof_dump(void) {
+  if (heapprof_rate <= 0) return false;
+  // copy the table so we don't hold the lock while writing
+  kk_heapprof_lock();
+  const kk_ssize_t size = heapprof_size;
+  const kk_ssize_t count = heapprof_count;
+  kk_heapprof_entry_t* table = NULL;
+  if (size > 0) {
+    table = (kk_heapprof_entry_t*)malloc((size_t)size * sizeof(kk_heapprof_entry_t));
+    if (table != NULL) memcpy(table, heapprof_table, (size_t)size * sizeof(kk_heapprof_entry_t));
+  }
+  kk_heapprof_unlock();
+  if (size > 0 && table == NULL) return false;
+  kk_pbuf_t pb = { NULL, 0, 0, false };
+  bool ok = kk_heapprof_encode(&pb, table, size, count);
+  free(table);
+  if (ok) {
+    FILE* f = fopen(heapprof_fname, "wb");
+    ok = (f != NULL && fwrite(pb.data, 1, pb.len, f) == pb.len);
+    if (f != NULL) fclose(f);
+  }
+  if (!ok) {
+    kk_warning_message("unable to write the heap profile to: %s\n", heapprof_fname);
+  }
+  free(pb.data);
+  return ok;
+}
+
+// Disable heap profiling without writing the profile: the samples so far are discarded
+// (contexts should reset their `heap_sample_countdown` from `kk_heapprof_countdown`).
+void kk_heapprof_disable(void) {
+  kk_heapprof_lock();
+  heapprof_rate = 0;
+  heapprof_fname = NULL;
+  free(heapprof_table);
+  heapprof_table = NULL;
+  heapprof_size = 0;
+  heapprof_count = 0;
+  kk_heapprof_unlock();
+}
+
+// Write the profile at exit (called from `kklib_done`)
+void kk_heapprof_done(void) {
+  if (heapprof_rate <= 0) return;
+  kk_heapprof_dump();
+  kk_heapprof_lock();
+  free(heapprof_table);
+  heapprof_table = NULL;
+  heapprof_size = 0;
+  heapprof_count = 0;
+  kk_heapprof_unlock();
+}
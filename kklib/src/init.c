@@ -12,6 +12,7 @@
 #include <Windows.h>
 #endif
 #include <locale.h>
+#include <time.h>
 
 // identity function
 static kk_box_t _function_id(kk_function_t self, kk_box_t x, kk_context_t* ctx) {
@@ -84,7 +85,8 @@ typedef enum kk_log_level_e {
 } kk_log_level_t;
 
 static void kk_log_message(kk_log_level_t level, const char* msg, kk_context_t* ctx) {
-  KK_UNUSED(ctx); KK_UNUSED(level);
+  KK_UNUSED(level);
+  if (ctx != NULL) kk_stdout_flush(ctx);  // maintain the output order
   fputs(msg,stderr); // TODO: use ctx->log
 }
 
@@ -139,6 +141,8 @@ static bool process_initialized; // = false
 static void kklib_done(void) {
   if (!process_initialized) return;
   free_context();
+  kk_stats_done();
+  kk_heapprof_done();
   process_initialized = false;
 }
 
@@ -148,11 +152,22 @@ bool __has_popcnt = false;
 bool __has_lzcnt = false;
 #endif
 
+// Set the `C.utf8` locale at startup? Every C program starts in the deterministic "C" locale and the
+// runtime uses no locale dependent multibyte functions, so by default we avoid the (relatively expensive) call.
+#ifndef KK_SETLOCALE
+#define KK_SETLOCALE  (0)
+#endif
+
+static void kk_startup_init(void);
+
 static void kklib_init(void) {
   if (process_initialized) return;
   process_initialized = true;
+  kk_startup_init();
   // for Koka, we need to be fully deterministic and careful when using C functionality that depends on global variables
+#if KK_SETLOCALE
   setlocale(LC_ALL, "C.utf8"); 
+#endif
 #if defined(WIN32) && (defined(_CONSOLE) || defined(__MINGW32__))
   SetConsoleOutputCP(65001);   // set the console to unicode instead of OEM page
 #endif
@@ -169,6 +184,9 @@ static void kklib_init(void) {
   __cpuid(cpu_info, (int)(0x80000001));
   __has_lzcnt  = ((cpu_info[2] & (KI32(1)<<5)) != 0);
 #endif
+  kk_integer_init();
+  kk_uvector_init();
+  kk_string_init();
   atexit(&kklib_done);  
 }
 
@@ -197,22 +215,85 @@ kk_context_t* kk_get_context(void) {
 #else
   ctx = (kk_context_t*)kk_zalloc(sizeof(kk_context_t),NULL);
 #endif
+  context = ctx;  // set early as statistics may use the context (see `stats.c`)
   ctx->evv = kk_block_dup(kk_evv_empty_singleton);
   ctx->thread_id = (uintptr_t)(&context);
   ctx->unique = kk_integer_one;
-  context = ctx;
+  ctx->reclaim_threshold = kk_reclaim_threshold();
+  ctx->free_budget = kk_free_budget();
+  ctx->heap_sample_countdown = kk_heapprof_countdown();
   ctx->kk_box_any = kk_block_alloc_as(struct kk_box_any_s, 0, KK_TAG_BOX_ANY, ctx);  
   ctx->kk_box_any->_unused = kk_integer_zero;
   // todo: register a thread_done function to release the context on thread terminatation.
   return ctx;
 }
 
+// Library state is kept in a short list as there are only a few users
+typedef struct kk_context_local_s {
+  struct kk_context_local_s*   next;
+  const void*                  key;
+  void*                        data;
+  kk_context_local_free_fun_t* free;
+} kk_context_local_t;
+
+void* kk_context_local_get(const void* key, kk_context_t* ctx) {
+  for (kk_context_local_t* l = ctx->locals; l != NULL; l = l->next) {
+    if (l->key == key) return l->data;
+  }
+  return NULL;
+}
+
+// Set the state for `key` (without freeing a previous value); returns `false` if out of memory.
+bool kk_context_local_set(const void* key, void* data, kk_context_local_free_fun_t* free_fun, kk_context_t* ctx) {
+  for (kk_context_local_t* l = ctx->locals; l != NULL; l = l->next) {
+    if (l->key == key) {
+      l->data = data;
+      l->free = free_fun;
+      return true;
+    }
+  }
+  kk_context_local_t* l = (kk_context_local_t*)kk_malloc(kk_ssizeof(kk_context_local_t), ctx);
+  if (l == NULL) return false;
+  l->next = ctx->locals;
+  l->key  = key;
+  l->data = data;
+  l->free = free_fun;
+  ctx->locals = l;
+  return true;
+}
+
+static void kk_context_locals_done(kk_context_t* ctx) {
+  while (ctx->locals != NULL) {
+    kk_context_local_t* l = ctx->locals;
+    ctx->locals = l->next;
+    if (l->free != NULL && l->data != NULL) { (*l->free)(l->data, ctx); }
+    kk_free(l);
+  }
+}
+
 static void free_context(void) {
   if (context != NULL) {
+    kk_stdout_flush(context);
+    context->reclaim_threshold = 0;      // free directly from now on
+    kk_reclaim_context_done(context);    // wait for pending background reclamation
+    kk_context_locals_done(context);     // library state (like the regular expression cache)
     kk_block_drop(context->evv, context);
-    kk_basetype_free(context->kk_box_any);
+    kk_basetype_free(context->kk_box_any,context);
+    kk_async_loop_done(context);
+    kk_ref_context_done(context);        // drop values retired by thread-shared references
+    if (context->srandom_ctx != NULL) { kk_free(context->srandom_ctx); }
     // kk_basetype_drop_assert(context->kk_box_any, KK_TAG_BOX_ANY, context);
-    // TODO: process delayed_free
+    if (context->delayed_free != NULL) {
+      context->free_budget = 0;  // unbounded
+      kk_block_drop_free_pending(context);
+    }
+#if KK_FREE_CACHE
+    for (kk_ssize_t bin = 0; bin <= KK_FREE_CACHE_BINS; bin++) {
+      kk_block_free_cache_drain(bin, 0, context);
+    }
+#endif
+    kk_function_compose_done(context);
+    kk_stats_merge(context);
 #ifdef KK_MIMALLOC
     // mi_heap_t* heap = context->heap;
     mi_free(context);
@@ -224,6 +305,95 @@ static void free_context(void) {
   }
 }
 
+void kk_free_context(void) {
+  free_context();
+}
+
+/*--------------------------------------------------------------------------------------------------
+  Startup trace (`--kkstartup`)
+  The generated initialization of each module is bracketed by `kk_startup_enter` and
+  `kk_startup_leave`. With `--kkstartup` we record the total time (including the imports)
+  and the self time of each module init, and print the trace at `kk_main_end`.
+--------------------------------------------------------------------------------------------------*/
+
+#ifndef KK_STARTUP_MAX
+#define KK_STARTUP_MAX  (256)     // maximal number of traced modules
+#endif
+
+typedef struct kk_startup_entry_s {
+  const char* module;
+  int64_t     start;       // in nano-seconds
+  int64_t     total;       // including the initialization of the imports
+  int64_t     imports;     // time spent in the initialization of the imports
+  int         depth;
+} kk_startup_entry_t;
+
+static bool               startup_enabled;    // = false
+static int64_t            startup_process;    // time at `kklib_init`
+static int64_t            startup_runtime;    // runtime initialization time up to the end of `kk_main_start`
+static kk_startup_entry_t startup_entries[KK_STARTUP_MAX];
+static int                startup_count;
+static int                startup_stack[KK_STARTUP_MAX];
+static int                startup_depth;
+
+static int64_t kk_startup_now(void) {
+#if defined(CLOCK_MONOTONIC)
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return ((int64_t)t.tv_sec * 1000000000 + t.tv_nsec);
+#else
+  return (kk_timer_start() * 1000);
+#endif
+}
+
+static void kk_startup_init(void) {
+  startup_process = kk_startup_now();  // a single clock read (and needed as we only know about `--kkstartup` in `kk_main_start`)
+}
+
+static void kk_startup_enable(void) {
+  startup_enabled = true;
+}
+
+kk_decl_export void kk_startup_enter(const char* module) {
+  if (kk_likely(!startup_enabled)) return;
+  if (startup_count >= KK_STARTUP_MAX || startup_depth >= KK_STARTUP_MAX) return;
+  kk_startup_entry_t* e = &startup_entries[startup_count];
+  e->module  = module;
+  e->depth   = startup_depth;
+  e->total   = 0;
+  e->imports = 0;
+  startup_stack[startup_depth++] = startup_count++;
+  e->start   = kk_startup_now();
+}
+
+kk_decl_export void kk_startup_leave(void) {
+  if (kk_likely(!startup_enabled)) return;
+  if (startup_depth <= 0) return;
+  const int64_t now = kk_startup_now();
+  kk_startup_entry_t* e = &startup_entries[startup_stack[--startup_depth]];
+  e->total = now - e->start;
+  if (startup_depth > 0) {
+    startup_entries[startup_stack[startup_depth-1]].imports += e->total;
+  }
+}
+
+static void kk_startup_done(void) {
+  if (!startup_enabled) return;
+  int64_t modules = 0;
+  for (int i = 0; i < startup_count; i++) {
+    if (startup_entries[i].depth == 0) modules += startup_entries[i].total;
+  }
+  kk_info_message("startup: %.3fms (runtime: %.3fms, module init: %.3fms)\n",
+                  (double)(startup_runtime + modules)/1000000.0, (double)startup_runtime/1000000.0, (double)modules/1000000.0);
+  kk_info_message("  %10s %10s  %s\n", "self (us)", "total (us)", "module");
+  for (int i = 0; i < startup_count; i++) {
+    const kk_startup_entry_t* e = &startup_entries[i];
+    kk_info_message("  %10.1f %10.1f  %*s%s\n", (double)(e->total - e->imports)/1000.0, (double)e->total/1000.0,
+                    2*e->depth, "", e->module);
+  }
+}
+
+
 /*--------------------------------------------------------------------------------------------------
   Called from main
 --------------------------------------------------------------------------------------------------*/
@@ -238,6 +408,53 @@ kk_decl_export kk_context_t* kk_main_start(int argc, char** argv) {
       if (strcmp(arg, "--kktime")==0) {
         ctx->process_start = kk_timer_start();
       }
+      else if (strcmp(arg, "--kkperf")==0) {
+        if (ctx->process_start == 0) ctx->process_start = kk_timer_start();
+        kk_perf_enable(NULL);
+      }
+      else if (strncmp(arg, "--kkperf=", 9)==0) {
+        if (ctx->process_start == 0) ctx->process_start = kk_timer_start();
+        kk_perf_enable(arg + 9);  // write the JSON counters to a file
+      }
+      else if (strcmp(arg, "--kkstartup")==0) {
+        kk_startup_enable();
+      }
+      else if (strcmp(arg, "--kkstats")==0) {
+        kk_stats_enable(NULL);
+      }
+      else if (strncmp(arg, "--kkstats=", 10)==0) {
+        kk_stats_enable(arg + 10);  // write the JSON statistics to a file
+      }
+      else if (strncmp(arg, "--kkworkers=", 12)==0) {
+        long n = strtol(arg + 12, NULL, 10);  // number of worker threads for parallel tasks
+        kk_task_set_worker_count((kk_ssize_t)n);
+      }
+      else if (strncmp(arg, "--kkfree-budget=", 16)==0) {
+        long n = strtol(arg + 16, NULL, 10);  // maximal blocks freed per drop (0 is unbounded)
+        kk_free_set_budget(n > 0 ? (kk_ssize_t)n : 0);
+        ctx->free_budget = kk_free_budget();
+      }
+      else if (strcmp(arg, "--kkheapprof")==0) {
+        kk_heapprof_enable(NULL, 0);
+        ctx->heap_sample_countdown = kk_heapprof_countdown();
+      }
+      else if (strncmp(arg, "--kkheapprof=", 13)==0) {
+        kk_heapprof_enable(arg + 13, 0);  // write the heap profile to a file
+        ctx->heap_sample_countdown = kk_heapprof_countdown();
+      }
+      else if (strncmp(arg, "--kkheapprof-rate=", 18)==0) {
+        long n = strtol(arg + 18, NULL, 10);  // sample an allocation every n bytes
+        kk_heapprof_enable(NULL, (kk_ssize_t)n);
+        ctx->heap_sample_countdown = kk_heapprof_countdown();
+      }
+      else if (strncmp(arg, "--kkmem=", 8)==0) {
+        kk_mem_options(arg + 8);  // allocator options (large pages, huge page reservation, etc.)
+      }
+      else if (strncmp(arg, "--kkreclaim=", 12)==0) {
+        long n = strtol(arg + 12, NULL, 10);  // free drops of more than n blocks on the reclaimer thread (0 is off)
+        kk_reclaim_set_threshold(n > 0 ? (kk_ssize_t)n : 0);
+        ctx->reclaim_threshold = kk_reclaim_threshold();
+      }
       else {
         break;
       }
@@ -249,11 +466,13 @@ kk_decl_export kk_context_t* kk_main_start(int argc, char** argv) {
     ctx->argc = argc - i;
     ctx->argv = (const char**)(argv + i);
   }
+  if (startup_enabled) { startup_runtime = kk_startup_now() - startup_process; }
   return ctx;
 }
 
 kk_decl_export void  kk_main_end(kk_context_t* ctx) {
-  if (ctx->process_start != 0) {  // started with --kktime option
+  kk_stdout_flush(ctx);
+  if (ctx->process_start != 0) {  // started with --kktime (or --kkperf) option
     kk_usecs_t wall_time = kk_timer_end(ctx->process_start);
     kk_msecs_t user_time;
     kk_msecs_t sys_time;
@@ -267,7 +486,9 @@ kk_decl_export void  kk_main_end(kk_context_t* ctx) {
                     user_time/1000, user_time%1000, sys_time/1000, sys_time%1000, 
                     (peak_rss > 10*1024*1024 ? peak_rss/(1024*1024) : peak_rss/1024),
                     (peak_rss > 10*1024*1024 ? "mb" : "kb") );
+    kk_perf_done(wall_time);
   }
+  kk_startup_done();
 }
 
 
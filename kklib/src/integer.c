@@ -22,7 +22,7 @@ Big integers. For our purposes, we need an implementation that does not
 have to be the fastest possible; we instead aim for portable, simple,
 well performing, and with fast conversion to/from decimal strings.
 Still, it performs quite respectable and does have various optimizations
-including Karatsuba multiplication.
+including Karatsuba, Toom-3, and NTT multiplication.
 
   Big integers are arrays of `digits` with a `count` and `is_neg` flag.
   For a number `n` we have:
@@ -68,6 +68,19 @@ static inline kk_digit_t ddigit_cdiv(kk_ddigit_t d, kk_digit_t divisor, kk_digit
   return _udiv128(d.hi, d.lo, divisor, rem);
 }
 
+// Divide `d < 2^121` by `BASE`: estimate the quotient from the top 64 bits times
+// `floor(2^121/BASE)` (at most 2 too low) instead of using a (slow) 128-bit division.
+static inline kk_digit_t ddigit_cdiv_base(kk_ddigit_t d, kk_digit_t* rem) {
+  kk_assert_internal(d.hi < (KU64(1) << 57));
+  const uint64_t t = (d.hi << 7) | (d.lo >> 57);
+  uint64_t q;
+  _umul128(t, KU64(0x24E4BBA3A4875741), &q);
+  uint64_t r = d.lo - (q * (uint64_t)BASE);
+  while (r >= (uint64_t)BASE) { r -= BASE; q++; }
+  *rem = r;
+  return q;
+}
+
 static inline kk_ddigit_t ddigit_mul_add(kk_digit_t x, kk_digit_t y, kk_digit_t z) {
   kk_ddigit_t r;
   r.lo = _umul128(x, y, &r.hi);
@@ -104,6 +117,18 @@ static inline kk_digit_t ddigit_cdiv(kk_ddigit_t d, kk_digit_t divisor, kk_digit
   return (kk_digit_t)(d/divisor);
 }
 
+// Divide `d < 2^121` by `BASE`: estimate the quotient from the top 64 bits times
+// `floor(2^121/BASE)` (at most 2 too low) instead of calling the (slow) 128-bit division.
+static inline kk_digit_t ddigit_cdiv_base(kk_ddigit_t d, kk_digit_t* rem) {
+  kk_assert_internal((d >> 121) == 0);
+  const uint64_t t = (uint64_t)(d >> 57);
+  uint64_t q = (uint64_t)(((kk_ddigit_t)t * KU64(0x24E4BBA3A4875741)) >> 64);
+  uint64_t r = (uint64_t)d - (q * (uint64_t)BASE);
+  while (r >= (uint64_t)BASE) { r -= BASE; q++; }
+  *rem = r;
+  return q;
+}
+
 static inline kk_ddigit_t ddigit_mul_add(kk_digit_t x, kk_digit_t y, kk_digit_t z) {
   return ((kk_ddigit_t)x * y) + z;
 }
@@ -138,6 +163,10 @@ static inline kk_digit_t ddigit_cdiv(kk_ddigit_t d, kk_digit_t divisor, kk_digit
   return (kk_digit_t)(d/divisor);
 }
 
+static inline kk_digit_t ddigit_cdiv_base(kk_ddigit_t d, kk_digit_t* rem) {
+  return ddigit_cdiv(d, BASE, rem);
+}
+
 #endif
 
 #define KK_LOG16_DIV_LOG10  (1.20411998266)
@@ -497,6 +526,134 @@ static kk_string_t kk_int_to_string(kk_intx_t n, kk_context_t* ctx) {
   return s;
 }
 
+/*----------------------------------------------------------------------
+  Parse runs of digits
+  On little-endian platforms we check and convert 8 (hex) digits at a time
+  in a 64-bit word (SWAR). For a byte `c < 0x80` we can test `lo <= c <= hi` in
+  every byte at once by adding constants that never carry into the next byte.
+  The decimal conversion combines pairs of digits, then pairs of those, etc.,
+  with a multiply-and-shift at each step.
+----------------------------------------------------------------------*/
+
+static kk_digit_t digit_powers_of_10[LOG_BASE+1] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+#if (LOG_BASE > 9)
+                                          , 10000000000, 100000000000, 1000000000000, 10000000000000, 100000000000000
+                                          , 1000000000000000, 10000000000000000, 100000000000000000, 1000000000000000000
+#endif
+                                          };
+
+#define KK_SWAR_ONES  KU64(0x0101010101010101)
+#define KK_SWAR_HIGH  KU64(0x8080808080808080)
+
+// The high bit is set for each byte `c < 0x80` of `w` with `lo <= c <= hi`.
+static inline uint64_t kk_swar_in_range(uint64_t w, uint8_t lo, uint8_t hi) {
+  const uint64_t x  = w & ~KK_SWAR_HIGH;
+  const uint64_t ge = x + KK_SWAR_ONES*(uint64_t)(0x80 - lo);
+  const uint64_t gt = x + KK_SWAR_ONES*(uint64_t)(0x7F - hi);
+  return (ge & ~gt & ~w & KK_SWAR_HIGH);
+}
+
+static inline uint64_t kk_swar_load8(const char* p) {
+  uint64_t w;
+  memcpy(&w, p, 8);
+  return w;
+}
+
+static inline bool kk_swar_is_digits8(uint64_t w) {
+  return (kk_swar_in_range(w, '0', '9') == KK_SWAR_HIGH);
+}
+
+static inline bool kk_swar_is_hexdigits8(uint64_t w) {
+  return ((kk_swar_in_range(w, '0', '9') | kk_swar_in_range(w | (KK_SWAR_ONES*0x20), 'a', 'f')) == KK_SWAR_HIGH);
+}
+
+// Convert 8 decimal digits (where the first digit is in the lowest byte)
+static inline uint32_t kk_swar_parse_digits8(uint64_t w) {
+  w = ((w & KU64(0x0F0F0F0F0F0F0F0F)) * 2561) >> 8;               // 10*d0 + d1 in every 16-bit lane
+  w = ((w & KU64(0x00FF00FF00FF00FF)) * 6553601) >> 16;           // 100*d01 + d23 in every 32-bit lane
+  return (uint32_t)(((w & KU64(0x0000FFFF0000FFFF)) * KU64(42949672960001)) >> 32);
+}
+
+// Convert 8 hexadecimal digits (where the first digit is in the lowest byte)
+static inline uint32_t kk_swar_parse_hexdigits8(uint64_t w) {
+  const uint64_t n = (w & KU64(0x0F0F0F0F0F0F0F0F)) + 9*((w >> 6) & KK_SWAR_ONES);   // nibble value in every byte
+  const uint64_t x = ((n & KU64(0x000F000F000F000F)) << 4) | ((n & KU64(0x0F000F000F000F00)) >> 8);  // a byte value in every 16-bit lane
+  return (uint32_t)(((x & 0xFF) << 24) | (((x >> 16) & 0xFF) << 16) | (((x >> 32) & 0xFF) << 8) | ((x >> 48) & 0xFF));
+}
+
+// Return the end of the run of decimal digits in `[p,end)`.
+static const char* kk_skip_digits(const char* p, const char* end) {
+#if KK_ARCH_LITTLE_ENDIAN
+  for (; p + 8 <= end && kk_swar_is_digits8(kk_swar_load8(p)); p += 8) {}
+#endif
+  for (; p < end && kk_ascii_is_digit(*p); p++) {}
+  return p;
+}
+
+// Convert a run of at most `max <= LOG_BASE` decimal digits at `p` into `*d`; returns the end of the run.
+static const char* kk_parse_digits(const char* p, const char* end, kk_ssize_t max, kk_digit_t* d) {
+  kk_assert_internal(max <= LOG_BASE);
+  const char* q = (end - p > max ? p + max : end);
+  uint64_t x = 0;
+#if KK_ARCH_LITTLE_ENDIAN
+  for (; p + 8 <= q; p += 8) {
+    const uint64_t w = kk_swar_load8(p);
+    if (!kk_swar_is_digits8(w)) break;
+    x = 100000000*x + kk_swar_parse_digits8(w);
+  }
+#endif
+  for (; p < q && kk_ascii_is_digit(*p); p++) {
+    x = 10*x + (uint64_t)(*p - '0');
+  }
+  *d = (kk_digit_t)x;
+  return p;
+}
+
+// Convert a run of at most `max <= 16` hex digits at `p` into `*d`; returns the end of the run.
+static const char* kk_parse_hexdigits(const char* p, const char* end, kk_ssize_t max, uint64_t* d) {
+  const char* q = (end - p > max ? p + max : end);
+  uint64_t x = 0;
+#if KK_ARCH_LITTLE_ENDIAN
+  for (; p + 8 <= q; p += 8) {
+    const uint64_t w = kk_swar_load8(p);
+    if (!kk_swar_is_hexdigits8(w)) break;
+    x = (x << 32) | kk_swar_parse_hexdigits8(w);
+  }
+#endif
+  for (; p < q && kk_ascii_is_hexdigit(*p); p++) {
+    const char c = *p;
+    x = 16*x + (uint64_t)(kk_ascii_is_digit(c) ? c - '0' : 10 + (kk_ascii_is_lower(c) ? c - 'a' : c - 'A'));
+  }
+  *d = x;
+  return p;
+}
+
+// Read `n <= LOG_BASE` decimal digits at `*pp`, skipping underscores and the fraction dot, and filling out with zeros at `end`.
+static kk_digit_t kk_read_digits(const char** pp, const char* end, kk_ssize_t n) {
+  const char* p = *pp;
+  kk_digit_t d = 0;
+  while (n > 0) {
+    kk_digit_t x;
+    const char* q = kk_parse_digits(p, end, n, &x);
+    if (q > p) {
+      d = d*digit_powers_of_10[q - p] + x;
+      n -= (q - p);
+      p = q;
+    }
+    else if (p < end) {
+      p++;  // skip a non-digit
+    }
+    else {
+      d *= digit_powers_of_10[n];  // zero digits
+      n = 0;
+    }
+  }
+  kk_assert_internal(d < BASE);
+  *pp = p;
+  return d;
+}
+
+
 /*----------------------------------------------------------------------
   Parse an integer
 ----------------------------------------------------------------------*/
@@ -517,11 +674,23 @@ kk_decl_export bool kk_integer_parse(const char* s, kk_integer_t* res, kk_contex
     return kk_integer_hex_parse(s, res, ctx);
   }
   if (!kk_ascii_is_digit(s[i])) return false;  // must start with a digit
+  const char* send = s + i + strlen(s + i);
+  // fast path: at most `LOG_BASE` plain decimal digits always fit an `kk_intx_t`
+  {
+    kk_digit_t d;
+    if (kk_parse_digits(s + i, send, LOG_BASE, &d) == send) {
+      kk_assert_internal(KK_INTX_SIZE >= sizeof(kk_digit_t));
+      *res = kk_integer_from_int(is_neg ? -(kk_intx_t)d : (kk_intx_t)d, ctx);
+      return true;
+    }
+  }
   // significant
   for (; s[i] != 0; i++) {
     char c = s[i];
     if (kk_ascii_is_digit(c)) {
-      sig_digits++;
+      const kk_ssize_t n = kk_skip_digits(s + i, send) - (s + i);  // a run of digits
+      sig_digits += n;
+      i += n - 1;
     }
     else if (c=='_' && kk_ascii_is_digit(s[i+1])) { // skip underscores
     }
@@ -578,20 +747,11 @@ kk_decl_export bool kk_integer_parse(const char* s, kk_integer_t* res, kk_contex
 
   // parsed correctly, ready to construct the number
   // construct an `kk_int_t` if it fits.
+  const char* digits_start = s + (s[0] == '+' || s[0] == '-' ? 1 : 0);
   if (dec_digits < LOG_BASE) {   // must be less than LOG_BASE to avoid overflow
     kk_assert_internal(KK_INTX_SIZE >= sizeof(kk_digit_t));
-    kk_intx_t d = 0;
-    kk_ssize_t digits = 0;
-    for (const char* p = s; p < end && digits < dec_digits; p++) {
-      char c = *p;
-      if (kk_ascii_is_digit(c)) {
-        digits++;
-        d = 10*d + ((kk_intx_t)c - '0');
-      }
-    }
-    for (;  digits < dec_digits; digits++) {  // zero digits
-      d *= 10;
-    }
+    const char* p = digits_start;
+    kk_intx_t d = (kk_intx_t)kk_read_digits(&p, end, dec_digits);
     if (is_neg) d = -d;
     *res = kk_integer_from_int(d,ctx);
     return true;
@@ -602,20 +762,12 @@ kk_decl_export bool kk_integer_parse(const char* s, kk_integer_t* res, kk_contex
   kk_bigint_t* b = bigint_alloc(count, is_neg, ctx);
   kk_ssize_t k     = count;
   kk_ssize_t chunk = dec_digits%LOG_BASE; if (chunk==0) chunk = LOG_BASE; // initial number of digits to read
-  const char* p = s;
+  const char* p = digits_start;
   kk_ssize_t digits = 0;
   while (p < end && digits < dec_digits) {
-    kk_digit_t d = 0;
-    // read a full digit
-    for (kk_ssize_t j = 0; j < chunk; ) {
-      char c = (p < end ? *p++ : '0'); // fill out with zeros
-      if (kk_ascii_is_digit(c)) {
-        digits++;
-        j++;
-        d = 10*d + ((kk_digit_t)c - '0'); kk_assert_internal(d<BASE);
-      }
-    }
-    // and store it
+    // read a full digit (as the base is decimal, it is stored directly)
+    const kk_digit_t d = kk_read_digits(&p, end, chunk);
+    digits += chunk;
     kk_assert_internal(k > 0);
     if (k > 0) { b->digits[--k] = d; }
     chunk = LOG_BASE;  // after the first digit, all chunks are full digits
@@ -642,6 +794,92 @@ kk_integer_t kk_integer_from_str(const char* num, kk_context_t* ctx) {
 static kk_bigint_t* kk_bigint_mul_small(kk_bigint_t* x, kk_digit_t y, kk_context_t* ctx);
 static kk_bigint_t* kk_bigint_add_abs_small(kk_bigint_t* x, kk_digit_t y, kk_context_t* ctx);
 
+// Convert a hex string of `hdigits` digits (ignoring underscores) in chunks of `LOG_BASE_HEX` digits (quadratic).
+static kk_bigint_t* bigint_from_hex_chunks(const char* start, const char* end, kk_ssize_t hdigits, kk_context_t* ctx) {
+  const kk_ssize_t count = (kk_ssize_t)(ceil((double)hdigits * KK_LOG16_DIV_LOG10)) + 1; // conservatively overallocate to max needed.
+  kk_extra_t ecount = (count >= MAX_EXTRA ? MAX_EXTRA-1 : (kk_extra_t)count);
+  kk_bigint_t* b = bigint_alloc(ecount, false, ctx);
+  b->extra += (ecount-1);
+  b->count -= (ecount-1);
+  b->digits[0] = 0;
+
+  // create in chucks of LOG_BASE_HEX digits
+  kk_ssize_t chunk = hdigits%LOG_BASE_HEX; if (chunk==0) chunk = LOG_BASE_HEX; // initial number of digits to read
+  const char* p = start;
+  while (p < end) {
+    kk_digit_t d = 0;
+    // read a full digit
+    for (kk_ssize_t j = 0; j < chunk && p < end; ) {
+      uint64_t x;
+      const char* q = kk_parse_hexdigits(p, end, chunk - j, &x);
+      if (q == p) { p++; continue; }  // skip an underscore
+      d = (kk_digit_t)((d << (4*(q - p))) + x);
+      kk_assert_internal(d<BASE);
+      j += (q - p);
+      p = q;
+    }
+    // and multiply-add
+    b = kk_bigint_mul_small(b, BASE_HEX, ctx);
+    b = kk_bigint_add_abs_small(b, d, ctx);
+    chunk = LOG_BASE_HEX;  // after the first chunk, the chunk is always a full LOG_BASE_HEX
+  }
+  return kk_bigint_trim(b, true, ctx);
+}
+
+/*----------------------------------------------------------------------
+  Divide-and-conquer hexadecimal conversion
+  With `C = KK_HEX_CHUNK` hex digits, we use the cached powers `pows[i] = 16^(C*2^i)`
+  to split a number (or hex string) recursively in halves, so conversion takes
+  `O(M(n) log n)` where `M(n)` is the cost of multiplication (or division) of `n` digits.
+----------------------------------------------------------------------*/
+
+#define KK_HEX_CHUNK   (32*LOG_BASE_HEX)  // hex digits converted directly at the leaves
+#define KK_HEX_LEVELS  (48)
+
+static kk_bigint_t* bigint_sqr_select(kk_bigint_t* x, kk_context_t* ctx);
+static kk_bigint_t* bigint_mul_select(kk_bigint_t* x, kk_bigint_t* y, kk_context_t* ctx);
+static kk_bigint_t* bigint_add(kk_bigint_t* x, kk_bigint_t* y, bool y_isneg, kk_context_t* ctx);
+
+// Compute the powers `pows[i] = 16^(KK_HEX_CHUNK*2^i)` needed for `hdigits` hex digits; returns the number of levels.
+static int bigint_hex_pows(kk_ssize_t hdigits, kk_bigint_t* pows[KK_HEX_LEVELS], kk_context_t* ctx) {
+  int levels = 0;
+  while (levels < KK_HEX_LEVELS && (KK_HEX_CHUNK << levels) < hdigits) {
+    if (levels == 0) {
+      kk_bigint_t* p = bigint_alloc_zero(1, false, ctx);
+      p->digits[0] = 1;
+      for (kk_ssize_t i = 0; i < KK_HEX_CHUNK/LOG_BASE_HEX; i++) {
+        p = kk_bigint_mul_small(p, BASE_HEX, ctx);
+      }
+      pows[0] = p;
+    }
+    else {
+      pows[levels] = bigint_sqr_select(dup_bigint(pows[levels-1]), ctx);
+    }
+    levels++;
+  }
+  return levels;
+}
+
+static void bigint_hex_pows_drop(int levels, kk_bigint_t* pows[KK_HEX_LEVELS], kk_context_t* ctx) {
+  for (int i = 0; i < levels; i++) {
+    if (pows[i] != NULL) { drop_bigint(pows[i], ctx); }
+  }
+}
+
+// Convert `n <= KK_HEX_CHUNK*2^level` hex digits (without underscores).
+static kk_bigint_t* bigint_from_hex_rec(const char* hex, kk_ssize_t n, int level, kk_bigint_t* pows[KK_HEX_LEVELS], kk_context_t* ctx) {
+  if (level == 0 || n <= KK_HEX_CHUNK) {
+    return bigint_from_hex_chunks(hex, hex + n, n, ctx);
+  }
+  const kk_ssize_t nlo = KK_HEX_CHUNK << (level - 1);
+  if (n <= nlo) {
+    return bigint_from_hex_rec(hex, n, level - 1, pows, ctx);
+  }
+  kk_bigint_t* hi = bigint_from_hex_rec(hex, n - nlo, level - 1, pows, ctx);
+  kk_bigint_t* lo = bigint_from_hex_rec(hex + (n - nlo), nlo, level - 1, pows, ctx);
+  return bigint_add(bigint_mul_select(hi, dup_bigint(pows[level-1]), ctx), lo, false, ctx);
+}
+
 bool kk_integer_hex_parse(const char* s, kk_integer_t* res, kk_context_t* ctx) {
   kk_assert_internal(s!=NULL && res != NULL);
   if (res==NULL) return false;
@@ -660,8 +898,18 @@ bool kk_integer_hex_parse(const char* s, kk_integer_t* res, kk_context_t* ctx) {
   }
   if (!kk_ascii_is_hexdigit(s[i])) return false;  // must start with a hex digit
 
-  // significant
+  // fast path: fewer than `LOG_BASE_HEX` plain hex digits
   const char* start = s+i;
+  {
+    const char* send = start + strlen(start);
+    uint64_t d;
+    if (send - start < LOG_BASE_HEX && kk_parse_hexdigits(start, send, LOG_BASE_HEX, &d) == send) {
+      *res = kk_integer_from_int(is_neg ? -(kk_intx_t)d : (kk_intx_t)d, ctx);
+      return true;
+    }
+  }
+
+  // significant
   for (; s[i] != 0; i++) {
     char c = s[i];
     if (kk_ascii_is_hexdigit(c)) {
@@ -681,12 +929,12 @@ bool kk_integer_hex_parse(const char* s, kk_integer_t* res, kk_context_t* ctx) {
   if (hdigits < LOG_BASE_HEX) {   // must be less than LOG_BASE_HEX to avoid overflow
     kk_assert_internal(KK_INTX_SIZE >= sizeof(kk_digit_t));
     kk_intx_t d = 0;
-    for (const char* p = s; p < end;  p++) {
-      char c = *p;
-      if (kk_ascii_is_hexdigit(c)) {
-        const kk_intx_t hd = (kk_intx_t)(kk_ascii_is_digit(c) ? c - '0' : 10 + (kk_ascii_is_lower(c) ? c - 'a' : c - 'A'));
-        d = 16*d + hd;
-      }
+    for (const char* p = start; p < end; ) {
+      uint64_t x;
+      const char* q = kk_parse_hexdigits(p, end, LOG_BASE_HEX, &x);
+      if (q == p) { p++; continue; }  // skip an underscore
+      d = (d << (4*(q - p))) + (kk_intx_t)x;
+      p = q;
     }
     if (is_neg) d = -d;
     *res = kk_integer_from_int(d, ctx);
@@ -694,33 +942,25 @@ bool kk_integer_hex_parse(const char* s, kk_integer_t* res, kk_context_t* ctx) {
   }
   
   // otherwise construct a big int
-  const kk_ssize_t count = (kk_ssize_t)(ceil((double)hdigits * KK_LOG16_DIV_LOG10)) + 1; // conservatively overallocate to max needed.
-  kk_extra_t ecount = (count >= MAX_EXTRA ? MAX_EXTRA-1 : (kk_extra_t)count);
-  kk_bigint_t* b = bigint_alloc(ecount, is_neg, ctx);
-  b->extra += (ecount-1);
-  b->count -= (ecount-1);
-  b->digits[0] = 0;
-
-  // create in chucks of LOG_BASE_HEX digits
-  kk_ssize_t chunk = hdigits%LOG_BASE_HEX; if (chunk==0) chunk = LOG_BASE_HEX; // initial number of digits to read
-  const char* p = start;
-  while (p < end) {
-    kk_digit_t d = 0;
-    // read a full digit
-    for (kk_ssize_t j = 0; j < chunk && p < end; ) {
-      char c = *p++; // fill out with zeros
-      if (kk_ascii_is_hexdigit(c)) {
-        j++;
-        kk_digit_t hd = (kk_digit_t)(kk_ascii_is_digit(c) ? c - '0' : 10 + (kk_ascii_is_lower(c) ? c - 'a' : c - 'A'));
-        d = 16*d + hd; 
-        kk_assert_internal(d<BASE);
-      }
+  kk_bigint_t* b;
+  if (hdigits < 2*KK_HEX_CHUNK) {
+    b = bigint_from_hex_chunks(start, end, hdigits, ctx);
+  }
+  else {
+    // compact the hex digits (without underscores) and convert recursively
+    char* hex = (char*)kk_malloc(hdigits, ctx);
+    kk_ssize_t n = 0;
+    for (const char* p = start; p < end; p++) {
+      if (*p != '_') { hex[n++] = *p; }
     }
-    // and multiply-add
-    b = kk_bigint_mul_small(b, BASE_HEX, ctx);
-    b = kk_bigint_add_abs_small(b, d, ctx);
-    chunk = LOG_BASE_HEX;  // after the first chunk, the chunk is always a full LOG_BASE_HEX
+    kk_assert_internal(n == hdigits);
+    kk_bigint_t* pows[KK_HEX_LEVELS];
+    int levels = bigint_hex_pows(hdigits, pows, ctx);
+    b = bigint_from_hex_rec(hex, hdigits, levels, pows, ctx);
+    bigint_hex_pows_drop(levels, pows, ctx);
+    kk_free(hex);
   }
+  b->is_neg = (is_neg ? 1 : 0);
   *res = integer_bigint(b, ctx);
   return true;
 }
@@ -758,6 +998,90 @@ static int bigint_compare_(kk_bigint_t* x, kk_bigint_t* y) {
   }
 }
 
+/*----------------------------------------------------------------------
+  Digit vector kernels
+  The inner loops of addition, subtraction and multiplication. These are
+  branchless (a carry is taken with probability 1/2 on random digits) and keep
+  the carry in a register. On x64 with BMI2 we use a variant compiled for it
+  (using `mulx`) which is selected at startup by `kk_integer_init`.
+----------------------------------------------------------------------*/
+
+// `z[0..n) = x[0..n) + y[0..n) + carry` and returns the carry (`z` may be `x` or `y`).
+static inline kk_digit_t kk_digits_add_n_body(kk_digit_t* z, const kk_digit_t* x, const kk_digit_t* y, kk_ssize_t n, kk_digit_t carry) {
+  for (kk_ssize_t i = 0; i < n; i++) {
+    const kk_digit_t sum = x[i] + y[i] + carry;
+    carry = (sum >= BASE);
+    z[i]  = sum - (carry ? BASE : 0);
+  }
+  return carry;
+}
+
+// `z[0..n) = x[0..n) - y[0..n) - borrow` and returns the borrow (`z` may be `x` or `y`).
+static inline kk_digit_t kk_digits_sub_n_body(kk_digit_t* z, const kk_digit_t* x, const kk_digit_t* y, kk_ssize_t n, kk_digit_t borrow) {
+  for (kk_ssize_t i = 0; i < n; i++) {
+    const kk_digit_t diff = x[i] - y[i] - borrow;
+    borrow = (diff >= BASE);   // unsigned wrap around
+    z[i]   = diff + (borrow ? BASE : 0);
+  }
+  return borrow;
+}
+
+// `z[0..n) += x[0..n)*d` and returns the carry digit.
+static inline kk_digit_t kk_digits_mul_add_n_body(kk_digit_t* z, const kk_digit_t* x, kk_ssize_t n, kk_digit_t d) {
+  kk_digit_t carry = 0;
+  for (kk_ssize_t i = 0; i < n; i++) {
+    carry = ddigit_cdiv_base(ddigit_mul_add(x[i], d, z[i] + carry), &z[i]);
+  }
+  return carry;
+}
+
+typedef kk_digit_t (kk_digits_add_n_fun_t)(kk_digit_t* z, const kk_digit_t* x, const kk_digit_t* y, kk_ssize_t n, kk_digit_t carry);
+typedef kk_digit_t (kk_digits_mul_add_n_fun_t)(kk_digit_t* z, const kk_digit_t* x, kk_ssize_t n, kk_digit_t d);
+
+static kk_digit_t kk_digits_add_n_generic(kk_digit_t* z, const kk_digit_t* x, const kk_digit_t* y, kk_ssize_t n, kk_digit_t carry) {
+  return kk_digits_add_n_body(z, x, y, n, carry);
+}
+static kk_digit_t kk_digits_sub_n_generic(kk_digit_t* z, const kk_digit_t* x, const kk_digit_t* y, kk_ssize_t n, kk_digit_t borrow) {
+  return kk_digits_sub_n_body(z, x, y, n, borrow);
+}
+static kk_digit_t kk_digits_mul_add_n_generic(kk_digit_t* z, const kk_digit_t* x, kk_ssize_t n, kk_digit_t d) {
+  return kk_digits_mul_add_n_body(z, x, n, d);
+}
+
+#if (DIGIT_BITS==64) && defined(__GNUC__) && defined(__x86_64__)
+#define KK_DIGITS_BMI2  1
+__attribute__((target("bmi2")))
+static kk_digit_t kk_digits_add_n_bmi2(kk_digit_t* z, const kk_digit_t* x, const kk_digit_t* y, kk_ssize_t n, kk_digit_t carry) {
+  return kk_digits_add_n_body(z, x, y, n, carry);
+}
+__attribute__((target("bmi2")))
+static kk_digit_t kk_digits_sub_n_bmi2(kk_digit_t* z, const kk_digit_t* x, const kk_digit_t* y, kk_ssize_t n, kk_digit_t borrow) {
+  return kk_digits_sub_n_body(z, x, y, n, borrow);
+}
+__attribute__((target("bmi2")))
+static kk_digit_t kk_digits_mul_add_n_bmi2(kk_digit_t* z, const kk_digit_t* x, kk_ssize_t n, kk_digit_t d) {
+  return kk_digits_mul_add_n_body(z, x, n, d);
+}
+#endif
+
+static struct {
+  kk_digits_add_n_fun_t*      add_n;
+  kk_digits_add_n_fun_t*      sub_n;
+  kk_digits_mul_add_n_fun_t*  mul_add_n;
+} kk_digits = { &kk_digits_add_n_generic, &kk_digits_sub_n_generic, &kk_digits_mul_add_n_generic };
+
+// Called once from `kklib_init` to select the digit kernels for this cpu.
+void kk_integer_init(void) {
+#if defined(KK_DIGITS_BMI2)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("bmi2")) {
+    kk_digits.add_n     = &kk_digits_add_n_bmi2;
+    kk_digits.sub_n     = &kk_digits_sub_n_bmi2;
+    kk_digits.mul_add_n = &kk_digits_mul_add_n_bmi2;
+  }
+#endif
+}
+
 /*----------------------------------------------------------------------
   add absolute
 ----------------------------------------------------------------------*/
@@ -780,21 +1104,10 @@ static kk_bigint_t* bigint_add_abs(kk_bigint_t* x, kk_bigint_t* y, kk_context_t*
 
   kk_assert_internal(cx>=cy);
   kk_assert_internal(bigint_count_(z) >= cx);
-  kk_digit_t carry = 0;
-  kk_digit_t sum = 0;
   // add y's digits
-  kk_ssize_t i;
-  for (i = 0; i < cy; i++) {
-    sum = x->digits[i] + y->digits[i] + carry;
-    if (kk_unlikely(sum >= BASE)) {
-      carry = 1;
-      sum -= BASE;
-    }
-    else {
-      carry = 0;
-    }
-    z->digits[i] = sum;
-  }
+  kk_digit_t carry = kk_digits.add_n(z->digits, x->digits, y->digits, cy, 0);
+  kk_digit_t sum = 0;
+  kk_ssize_t i = cy;
   // propagate the carry
   for (; carry != 0 && i < cx; i++) {
     sum = x->digits[i] + carry;
@@ -892,21 +1205,10 @@ static kk_bigint_t* kk_bigint_sub_abs(kk_bigint_t* x, kk_bigint_t* y, kk_context
   kk_bigint_t* z = bigint_alloc_reuse_(x, cx, ctx);
   //z->is_neg = x->is_neg;
   kk_assert_internal(bigint_count_(z) >= cx);
-  kk_digit_t borrow = 0;
-  kk_digit_t diff = 0;
   // subtract y digits
-  kk_ssize_t i;
-  for (i = 0; i < cy; i++) {
-    diff = x->digits[i] - borrow - y->digits[i];
-    if (kk_unlikely(diff >= BASE)) {   // unsigned wrap around
-      borrow = 1;
-      diff += BASE; // kk_assert_internal(diff >= 0);
-    }
-    else {
-      borrow = 0;
-    }
-    z->digits[i] = diff;
-  }
+  kk_digit_t borrow = kk_digits.sub_n(z->digits, x->digits, y->digits, cy, 0);
+  kk_digit_t diff = 0;
+  kk_ssize_t i = cy;
   // propagate borrow
   for (; borrow != 0 && i < cx; i++) {
     diff = x->digits[i] - borrow;
@@ -934,7 +1236,7 @@ static kk_bigint_t* kk_bigint_sub_abs(kk_bigint_t* x, kk_bigint_t* y, kk_context
 }
 
 /*----------------------------------------------------------------------
-  Multiply & Sqr. including Karatsuba multiplication
+  Multiply & Sqr. including Karatsuba multiplication and squaring
 ----------------------------------------------------------------------*/
 
 static kk_bigint_t* bigint_mul(kk_bigint_t* x, kk_bigint_t* y, kk_context_t* ctx) {
@@ -944,15 +1246,7 @@ static kk_bigint_t* bigint_mul(kk_bigint_t* x, kk_bigint_t* y, kk_context_t* ctx
   kk_ssize_t cz = cx+cy;
   kk_bigint_t* z = bigint_alloc_zero(cz,is_neg,ctx);
   for (kk_ssize_t i = 0; i < cx; i++) {
-    kk_digit_t dx = x->digits[i];
-    for (kk_ssize_t j = 0; j < cy; j++) {
-      kk_digit_t dy = y->digits[j];
-      kk_ddigit_t prod = ddigit_mul_add(dx,dy,z->digits[i+j]);
-      kk_digit_t rem;
-      kk_digit_t carry = ddigit_cdiv(prod, BASE, &rem);
-      z->digits[i+j]    = rem;
-      z->digits[i+j+1] += carry;
-    }
+    z->digits[i+cy] = kk_digits.mul_add_n(&z->digits[i], y->digits, cy, x->digits[i]);
   }
   drop_bigint(x,ctx);
   drop_bigint(y,ctx);
@@ -970,7 +1264,7 @@ static kk_bigint_t* kk_bigint_mul_small(kk_bigint_t* x, kk_digit_t y, kk_context
   for (i = 0; i < cx; i++) {
     kk_ddigit_t prod = ddigit_mul_add(x->digits[i], y, carry);
     kk_digit_t rem;
-    carry = ddigit_cdiv(prod, BASE, &rem);
+    carry = ddigit_cdiv_base(prod, &rem);
     kk_assert_internal(rem < BASE);
     z->digits[i] = rem;
   }
@@ -984,9 +1278,27 @@ static kk_bigint_t* kk_bigint_mul_small(kk_bigint_t* x, kk_digit_t y, kk_context
   return kk_bigint_trim_to(z, i, true, ctx);
 }
 
-static kk_bigint_t* kk_bigint_sqr(kk_bigint_t* x, kk_context_t* ctx) {
-  dup_bigint(x);
-  return bigint_mul(x, x, ctx);
+// Long squaring: first sum the products below the diagonal, and then double those and add the diagonal squares.
+static kk_bigint_t* bigint_sqr(kk_bigint_t* x, kk_context_t* ctx) {
+  const kk_ssize_t cx = bigint_count_(x);
+  const kk_ssize_t cz = 2*cx;
+  kk_bigint_t* z = bigint_alloc_zero(cz, false, ctx);
+  for (kk_ssize_t i = 0; i + 1 < cx; i++) {
+    z->digits[i+cx] = kk_digits.mul_add_n(&z->digits[2*i+1], &x->digits[i+1], cx - i - 1, x->digits[i]);
+  }
+  kk_digit_t carry = 0;
+  for (kk_ssize_t i = 0; i < cx; i++) {
+    kk_ddigit_t sq = ddigit_mul_add(x->digits[i], x->digits[i], 2*z->digits[2*i] + carry);
+    kk_digit_t rem;
+    carry = ddigit_cdiv_base(sq, &rem);
+    z->digits[2*i] = rem;
+    kk_digit_t hi = 2*z->digits[2*i+1] + carry;  // < 3*BASE
+    carry = hi / BASE;
+    z->digits[2*i+1] = hi % BASE;
+  }
+  kk_assert_internal(carry == 0);
+  drop_bigint(x, ctx);
+  return kk_bigint_trim(z, true, ctx);
 }
 
 static kk_bigint_t* kk_bigint_shift_left(kk_bigint_t* x, kk_ssize_t digits, kk_context_t* ctx) {
@@ -999,11 +1311,11 @@ static kk_bigint_t* kk_bigint_shift_left(kk_bigint_t* x, kk_ssize_t digits, kk_c
 }
 
 static kk_bigint_t* kk_bigint_slice(kk_bigint_t* x, kk_ssize_t lo, kk_ssize_t hi, kk_context_t* ctx) {
+  if (hi > x->count)  hi = x->count;
   if (lo <= 0 && bigint_is_unique_(x)) {
     return kk_bigint_trim_to(x, hi, false, ctx);
   }
   if (lo >= x->count) lo = x->count;
-  if (hi > x->count)  hi = x->count;
   const kk_ssize_t cz = hi - lo;
   kk_bigint_t* z = bigint_alloc(cz, x->is_neg, ctx);
   if (cz==0) {
@@ -1014,9 +1326,12 @@ static kk_bigint_t* kk_bigint_slice(kk_bigint_t* x, kk_ssize_t lo, kk_ssize_t hi
   else if (lo < x->count) {
     kk_memcpy(&z->digits[0], &x->digits[lo], kk_ssizeof(kk_digit_t)*cz);
   }
+  drop_bigint(x, ctx);
   return z;
 }
 
+static kk_bigint_t* bigint_mul_select(kk_bigint_t* x, kk_bigint_t* y, kk_context_t* ctx);
+
 static kk_bigint_t* bigint_mul_karatsuba(kk_bigint_t* x, kk_bigint_t* y, kk_context_t* ctx) {
   kk_ssize_t n = (x->count >= y->count ? x->count : y->count);
   if (n <= 25) return bigint_mul(x, y, ctx);
@@ -1027,9 +1342,9 @@ static kk_bigint_t* bigint_mul_karatsuba(kk_bigint_t* x, kk_bigint_t* y, kk_cont
   kk_bigint_t* d = kk_bigint_slice(dup_bigint(y), n, y->count, ctx);
   kk_bigint_t* c = kk_bigint_slice(y, 0, n, ctx);
 
-  kk_bigint_t* ac = bigint_mul_karatsuba(dup_bigint(a), dup_bigint(c), ctx);
-  kk_bigint_t* bd = bigint_mul_karatsuba(dup_bigint(b), dup_bigint(d), ctx);
-  kk_bigint_t* abcd = bigint_mul_karatsuba( bigint_add(a, b, b->is_neg, ctx),
+  kk_bigint_t* ac = bigint_mul_select(dup_bigint(a), dup_bigint(c), ctx);
+  kk_bigint_t* bd = bigint_mul_select(dup_bigint(b), dup_bigint(d), ctx);
+  kk_bigint_t* abcd = bigint_mul_select( bigint_add(a, b, b->is_neg, ctx),
                                          bigint_add(c, d, d->is_neg, ctx), ctx);
   kk_bigint_t* p1 = kk_bigint_shift_left(kk_bigint_sub(kk_bigint_sub(abcd, dup_bigint(ac), ac->is_neg, ctx),
                                               dup_bigint(bd), bd->is_neg, ctx), n, ctx);
@@ -1038,14 +1353,432 @@ static kk_bigint_t* bigint_mul_karatsuba(kk_bigint_t* x, kk_bigint_t* y, kk_cont
   return kk_bigint_trim(prod,true, ctx);
 }
 
+static kk_bigint_t* bigint_sqr_select(kk_bigint_t* x, kk_context_t* ctx);
+
+// Karatsuba squaring: `(a + b*B^n)^2 = a^2 + ((a+b)^2 - a^2 - b^2)*B^n + b^2*B^2n`
+static kk_bigint_t* bigint_sqr_karatsuba(kk_bigint_t* x, kk_context_t* ctx) {
+  kk_ssize_t n = x->count;
+  if (n <= 25) return bigint_sqr(x, ctx);
+  n = ((n + 1) / 2);
+
+  kk_bigint_t* b = kk_bigint_trim(kk_bigint_slice(dup_bigint(x), n, x->count, ctx), false, ctx);
+  kk_bigint_t* a = kk_bigint_trim(kk_bigint_slice(x, 0, n, ctx), false, ctx);
+  a->is_neg = b->is_neg = 0;
+
+  kk_bigint_t* aa = bigint_sqr_select(dup_bigint(a), ctx);
+  kk_bigint_t* bb = bigint_sqr_select(dup_bigint(b), ctx);
+  kk_bigint_t* ab = bigint_sqr_select(bigint_add(a, b, false, ctx), ctx);
+  kk_bigint_t* p1 = kk_bigint_shift_left(kk_bigint_sub(kk_bigint_sub(ab, dup_bigint(aa), false, ctx),
+                                                       dup_bigint(bb), false, ctx), n, ctx);
+  kk_bigint_t* p2 = kk_bigint_shift_left(bb, 2 * n, ctx);
+  kk_bigint_t* sq = bigint_add(bigint_add(aa, p1, false, ctx), p2, false, ctx);
+  return kk_bigint_trim(sq, true, ctx);
+}
+
+// Add `|y|` into the digits of `z` starting at digit `ofs` (where `z` has room for the final carry).
+static void bigint_add_abs_at(kk_bigint_t* z, kk_ssize_t ofs, const kk_bigint_t* y) {
+  const kk_ssize_t cy = bigint_count_(y);
+  kk_digit_t carry = 0;
+  kk_ssize_t i;
+  for (i = 0; i < cy; i++) {
+    kk_digit_t sum = z->digits[ofs+i] + y->digits[i] + carry;
+    carry = (sum >= BASE ? 1 : 0);
+    z->digits[ofs+i] = (carry ? sum - BASE : sum);
+  }
+  for (i += ofs; carry != 0; i++) {
+    kk_assert_internal(i < bigint_count_(z));
+    kk_digit_t sum = z->digits[i] + carry;
+    carry = (sum >= BASE ? 1 : 0);
+    z->digits[i] = (carry ? sum - BASE : sum);
+  }
+}
+
+// A slice without leading zero digits (so it can be compared and subtracted).
+static kk_bigint_t* bigint_slice_trim(kk_bigint_t* x, kk_ssize_t lo, kk_ssize_t hi, kk_context_t* ctx) {
+  return kk_bigint_trim(kk_bigint_slice(x, lo, hi, ctx), false, ctx);
+}
+
+/*----------------------------------------------------------------------
+  Toom-3 multiplication (using the interpolation sequence of Bodrato)
+  We split `x = x2*B^2k + x1*B^k + x0` (and `y` similarly) and evaluate at
+  0, 1, -1, -2, and infinity, requiring 5 multiplications of size `k` instead
+  of the 9 for long multiplication (or 3*3 = 9 for two Karatsuba levels).
+  All parts keep the sign of their number, and since interpolation is exact
+  all resulting coefficients have the sign of the final product.
+----------------------------------------------------------------------*/
+
+static kk_bigint_t* kk_bigint_cdiv_cmod_small(kk_bigint_t* x, kk_digit_t y, kk_digit_t* pmod, kk_context_t* ctx);
+
+// Evaluate `x = x2*B^2k + x1*B^k + x0` at 0, 1, -1, -2, and infinity.
+static void bigint_toom3_eval(kk_bigint_t* x, kk_ssize_t k, kk_bigint_t* p[5], kk_context_t* ctx) {
+  const kk_ssize_t cx = bigint_count_(x);
+  kk_bigint_t* x2 = bigint_slice_trim(dup_bigint(x), 2*k, cx, ctx);
+  kk_bigint_t* x1 = bigint_slice_trim(dup_bigint(x), k, 2*k, ctx);
+  kk_bigint_t* x0 = bigint_slice_trim(x, 0, k, ctx);
+  // p(1) = x0 + x1 + x2, p(-1) = x0 - x1 + x2, p(-2) = 2*(p(-1) + x2) - x0
+  kk_bigint_t* xp  = bigint_add(dup_bigint(x0), dup_bigint(x2), x2->is_neg, ctx);
+  kk_bigint_t* xp1 = bigint_add(dup_bigint(xp), dup_bigint(x1), x1->is_neg, ctx);
+  kk_bigint_t* xm1 = kk_bigint_sub(xp, x1, x1->is_neg, ctx);
+  kk_bigint_t* xm2 = kk_bigint_sub(kk_bigint_mul_small(bigint_add(dup_bigint(xm1), dup_bigint(x2), x2->is_neg, ctx), 2, ctx),
+                                   dup_bigint(x0), x0->is_neg, ctx);
+  p[0] = x0; p[1] = xp1; p[2] = xm1; p[3] = xm2; p[4] = x2;
+}
+
+static kk_bigint_t* bigint_mul_toom3(kk_bigint_t* x, kk_bigint_t* y, kk_context_t* ctx) {
+  const kk_ssize_t cx = bigint_count_(x);
+  const kk_ssize_t cy = bigint_count_(y);
+  const bool is_neg = (bigint_is_neg_(x) != bigint_is_neg_(y));
+  const kk_ssize_t k = ((cx >= cy ? cx : cy) + 2) / 3;
+
+  // evaluate and multiply pointwise (squaring if `x` and `y` are the same)
+  kk_bigint_t* r[5];
+  kk_bigint_t* px[5];
+  if (x == y) {
+    drop_bigint(y, ctx);
+    bigint_toom3_eval(x, k, px, ctx);
+    for (int i = 0; i < 5; i++) { r[i] = bigint_sqr_select(px[i], ctx); }
+  }
+  else {
+    kk_bigint_t* py[5];
+    bigint_toom3_eval(x, k, px, ctx);
+    bigint_toom3_eval(y, k, py, ctx);
+    for (int i = 0; i < 5; i++) { r[i] = bigint_mul_select(px[i], py[i], ctx); }
+  }
+  kk_bigint_t* r0 = r[0];
+  kk_bigint_t* r1 = r[1];
+  kk_bigint_t* rm1 = r[2];
+  kk_bigint_t* rm2 = r[3];
+  kk_bigint_t* rinf = r[4];
+
+  // interpolate (all divisions are exact)
+  kk_bigint_t* t3 = kk_bigint_cdiv_cmod_small(kk_bigint_sub(rm2, dup_bigint(r1), r1->is_neg, ctx), 3, NULL, ctx);
+  kk_bigint_t* t1 = kk_bigint_cdiv_cmod_small(kk_bigint_sub(r1, dup_bigint(rm1), rm1->is_neg, ctx), 2, NULL, ctx);
+  kk_bigint_t* t2 = kk_bigint_sub(rm1, dup_bigint(r0), r0->is_neg, ctx);
+  t3 = kk_bigint_cdiv_cmod_small(kk_bigint_sub(dup_bigint(t2), t3, t3->is_neg, ctx), 2, NULL, ctx);
+  t3 = bigint_add(t3, kk_bigint_mul_small(dup_bigint(rinf), 2, ctx), rinf->is_neg, ctx);
+  t2 = kk_bigint_sub(bigint_add(t2, dup_bigint(t1), t1->is_neg, ctx), dup_bigint(rinf), rinf->is_neg, ctx);
+  t1 = kk_bigint_sub(t1, dup_bigint(t3), t3->is_neg, ctx);
+
+  // recompose: r0 + t1*B^k + t2*B^2k + t3*B^3k + rinf*B^4k
+  kk_bigint_t* z = bigint_alloc_zero(cx + cy, is_neg, ctx);
+  bigint_add_abs_at(z, 0, r0);
+  bigint_add_abs_at(z, k, t1);
+  bigint_add_abs_at(z, 2*k, t2);
+  bigint_add_abs_at(z, 3*k, t3);
+  bigint_add_abs_at(z, 4*k, rinf);
+  drop_bigint(r0, ctx);
+  drop_bigint(t1, ctx);
+  drop_bigint(t2, ctx);
+  drop_bigint(t3, ctx);
+  drop_bigint(rinf, ctx);
+  return kk_bigint_trim(z, true, ctx);
+}
+
+
+/*----------------------------------------------------------------------
+  NTT multiplication for huge numbers.
+  We split every digit in limbs of base 10^9 and convolve the limbs modulo
+  three NTT primes (of the form `c*2^k + 1`), recombining the exact limb
+  products with the Chinese remainder theorem. A convolution coefficient
+  is at most `n*(10^9)^2 < 2^23 * 10^18` which is below the product of the
+  primes (about 7.9*10^25). The transform length is limited by the smallest
+  `k` (23 for 998244353) and larger products fall back to Toom-3 (whose
+  parts then use NTT again).
+----------------------------------------------------------------------*/
+
+#define NTT_P1          KU32(998244353)   // 119*2^23 + 1
+#define NTT_P2          KU32(167772161)   //   5*2^25 + 1
+#define NTT_P3          KU32(469762049)   //   7*2^26 + 1
+#define NTT_ROOT        (3)               // primitive root for each prime
+#define NTT_MAX_LOG     (23)
+#define NTT_LIMB_BASE   KU32(1000000000)
+#define NTT_LIMBS       (LOG_BASE/9)      // limbs per digit
+
+static uint32_t ntt_pow(uint32_t x, uint64_t e, uint32_t p) {
+  uint64_t r = 1;
+  uint64_t b = x % p;
+  while (e > 0) {
+    if (e & 1) { r = (r * b) % p; }
+    b = (b * b) % p;
+    e >>= 1;
+  }
+  return (uint32_t)r;
+}
+
+// Multiply by a constant `w` using the precomputed `wq = floor(w*2^32/p)` (Shoup)
+static inline uint32_t ntt_mul_shoup(uint32_t a, uint32_t w, uint32_t wq, uint32_t p) {
+  const uint32_t q = (uint32_t)(((uint64_t)a * wq) >> 32);
+  const uint32_t r = (a * w) - (q * p);   // in `[0,2p)`
+  return (r >= p ? r - p : r);
+}
+
+static inline uint32_t ntt_shoup(uint32_t w, uint32_t p) {
+  return (uint32_t)(((uint64_t)w << 32) / p);
+}
+
+// Montgomery reduction: returns `t * 2^-32 mod p`, where `pneg_inv == -p^-1 mod 2^32` and `t < p*2^32`.
+static inline uint32_t ntt_redc(uint64_t t, uint32_t p, uint32_t pneg_inv) {
+  const uint32_t m = (uint32_t)t * pneg_inv;
+  const uint64_t u = (t + ((uint64_t)m * p)) >> 32;
+  return (uint32_t)(u >= p ? u - p : u);
+}
+
+// Roots for each level `h` of a transform of length `n`: `w[h+j] = root_(2h)^j` for `j < h`.
+static void ntt_roots(uint32_t* w, uint32_t* wq, kk_ssize_t n, uint32_t p) {
+  for (kk_ssize_t h = 1; h < n; h *= 2) {
+    const uint64_t wh = ntt_pow(NTT_ROOT, (p - 1) / (uint64_t)(2*h), p);
+    uint64_t wj = 1;
+    for (kk_ssize_t j = 0; j < h; j++) {
+      w[h+j]  = (uint32_t)wj;
+      wq[h+j] = ntt_shoup((uint32_t)wj, p);
+      wj = (wj * wh) % p;
+    }
+  }
+}
+
+// In-place forward transform (decimation in time).
+static void ntt_transform(uint32_t* a, kk_ssize_t n, const uint32_t* w, const uint32_t* wq, uint32_t p) {
+  for (kk_ssize_t i = 1, j = 0; i < n; i++) {
+    kk_ssize_t bit = n >> 1;
+    for (; (j & bit) != 0; bit >>= 1) { j ^= bit; }
+    j ^= bit;
+    if (i < j) { uint32_t t = a[i]; a[i] = a[j]; a[j] = t; }
+  }
+  for (kk_ssize_t h = 1; h < n; h *= 2) {
+    for (kk_ssize_t i = 0; i < n; i += 2*h) {
+      uint32_t* a0 = &a[i];
+      uint32_t* a1 = &a[i+h];
+      for (kk_ssize_t j = 0; j < h; j++) {
+        const uint32_t u = a0[j];
+        const uint32_t v = ntt_mul_shoup(a1[j], w[h+j], wq[h+j], p);
+        const uint32_t s = u + v;
+        a0[j] = (s >= p ? s - p : s);
+        a1[j] = (u >= v ? u - v : u + p - v);
+      }
+    }
+  }
+}
+
+static void ntt_load(uint32_t* a, kk_ssize_t n, const kk_bigint_t* x, uint32_t p) {
+  const kk_ssize_t cx = bigint_count_(x);
+  for (kk_ssize_t i = 0; i < cx; i++) {
+    kk_digit_t d = x->digits[i];
+    for (kk_ssize_t l = 0; l < NTT_LIMBS; l++) {
+      a[i*NTT_LIMBS + l] = (uint32_t)(d % NTT_LIMB_BASE) % p;
+      d /= NTT_LIMB_BASE;
+    }
+  }
+  kk_memset(&a[cx*NTT_LIMBS], 0, (n - cx*NTT_LIMBS)*kk_ssizeof(uint32_t));
+}
+
+// Convolve `x` and `y` modulo `p` into `r` (of length `n`), using `tmp` and the root tables as scratch space.
+static void ntt_convolve(uint32_t* r, uint32_t* tmp, uint32_t* w, uint32_t* wq, kk_ssize_t n,
+                         const kk_bigint_t* x, const kk_bigint_t* y, uint32_t p) {
+  uint32_t pneg_inv = p;                                // Newton iteration for `p^-1 mod 2^32`
+  for (int i = 0; i < 4; i++) { pneg_inv *= 2 - (p * pneg_inv); }
+  pneg_inv = (uint32_t)0 - pneg_inv;
+  ntt_roots(w, wq, n, p);
+  ntt_load(tmp, n, x, p);
+  ntt_transform(tmp, n, w, wq, p);
+  if (x == y) {
+    for (kk_ssize_t i = 0; i < n; i++) { tmp[i] = ntt_redc((uint64_t)tmp[i] * tmp[i], p, pneg_inv); }
+  }
+  else {
+    ntt_load(r, n, y, p);
+    ntt_transform(r, n, w, wq, p);
+    for (kk_ssize_t i = 0; i < n; i++) { tmp[i] = ntt_redc((uint64_t)tmp[i] * r[i], p, pneg_inv); }
+  }
+  // the inverse is the forward transform at reversed indices, scaled by `1/n` (and `2^32` to undo the Montgomery factor)
+  ntt_transform(tmp, n, w, wq, p);
+  const uint32_t scale  = (uint32_t)(((uint64_t)ntt_pow((uint32_t)n, p - 2, p) * ((KU64(1) << 32) % p)) % p);
+  const uint32_t scaleq = ntt_shoup(scale, p);
+  r[0] = ntt_mul_shoup(tmp[0], scale, scaleq, p);
+  for (kk_ssize_t i = 1; i < n; i++) {
+    r[i] = ntt_mul_shoup(tmp[n - i], scale, scaleq, p);
+  }
+}
+
+// Returns `NULL` if the product is too large or if we cannot allocate the buffers.
+static kk_bigint_t* bigint_mul_ntt(kk_bigint_t* x, kk_bigint_t* y, kk_context_t* ctx) {
+  const kk_ssize_t cx = bigint_count_(x);
+  const kk_ssize_t cy = bigint_count_(y);
+  const kk_ssize_t climbs = (cx + cy)*NTT_LIMBS;
+  kk_ssize_t n = 1;
+  while (n < climbs - 1) { n *= 2; }
+  if (n > (KIZ(1) << NTT_MAX_LOG)) return NULL;
+  uint32_t* buf = (uint32_t*)kk_malloc(6*n*kk_ssizeof(uint32_t), ctx);
+  if (buf == NULL) return NULL;
+  uint32_t* r1 = buf;
+  uint32_t* r2 = buf + n;
+  uint32_t* r3 = buf + 2*n;
+  uint32_t* tmp = buf + 3*n;
+  uint32_t* w = buf + 4*n;
+  uint32_t* wq = buf + 5*n;
+  ntt_convolve(r1, tmp, w, wq, n, x, y, NTT_P1);
+  ntt_convolve(r2, tmp, w, wq, n, x, y, NTT_P2);
+  ntt_convolve(r3, tmp, w, wq, n, x, y, NTT_P3);
+
+  // Garner: `v = r1 + P1*(k2 + P2*k3)`, and we propagate the carry in base 10^9 without 128-bit arithmetic
+  const uint64_t inv_p1 = ntt_pow(NTT_P1 % NTT_P2, NTT_P2 - 2, NTT_P2);      // P1^-1 mod P2
+  const uint64_t inv_p12 = ntt_pow((uint32_t)(((uint64_t)NTT_P1 * NTT_P2) % NTT_P3), NTT_P3 - 2, NTT_P3);  // (P1*P2)^-1 mod P3
+  kk_bigint_t* z = bigint_alloc_zero(cx + cy, bigint_is_neg_(x) != bigint_is_neg_(y), ctx);
+  uint64_t carry = 0;
+  for (kk_ssize_t i = 0; i < climbs; i++) {
+    uint64_t v1 = 0, v2 = 0, v3 = 0;
+    if (i < n) { v1 = r1[i]; v2 = r2[i]; v3 = r3[i]; }
+    const uint64_t k2 = ((v2 + NTT_P2 - (v1 % NTT_P2)) * inv_p1) % NTT_P2;
+    const uint64_t u  = (v1 + NTT_P1*k2) % NTT_P3;
+    const uint64_t k3 = (((v3 + NTT_P3 - u) % NTT_P3) * inv_p12) % NTT_P3;
+    const uint64_t t  = k2 + NTT_P2*k3;                  // < P2*P3 < 2^57
+    const uint64_t thi = t / NTT_LIMB_BASE;
+    const uint64_t s  = v1 + NTT_P1*(t % NTT_LIMB_BASE) + (carry % NTT_LIMB_BASE);
+    carry = (s / NTT_LIMB_BASE) + NTT_P1*thi + (carry / NTT_LIMB_BASE);
+    kk_digit_t limb = (kk_digit_t)(s % NTT_LIMB_BASE);
+    for (kk_ssize_t l = 0; l < (i % NTT_LIMBS); l++) { limb *= NTT_LIMB_BASE; }
+    z->digits[i / NTT_LIMBS] += limb;
+  }
+  kk_assert_internal(carry == 0);
+  kk_free(buf);
+  drop_bigint(x, ctx);
+  drop_bigint(y, ctx);
+  return kk_bigint_trim(z, true, ctx);
+}
+
+
+/*----------------------------------------------------------------------
+  Select a multiplication algorithm based on the operand sizes (in digits).
+  The thresholds were measured on x64 (with 64-bit digits)
+  by timing each method on random operands of equal size.
+----------------------------------------------------------------------*/
+
+#ifndef KK_MUL_KARATSUBA_THRESHOLD
+#define KK_MUL_KARATSUBA_THRESHOLD  (30)
+#endif
+#ifndef KK_MUL_TOOM3_THRESHOLD
+#define KK_MUL_TOOM3_THRESHOLD      (100)
+#endif
+#ifndef KK_MUL_NTT_THRESHOLD
+#define KK_MUL_NTT_THRESHOLD        (700)
+#endif
+#ifndef KK_SQR_KARATSUBA_THRESHOLD
+#define KK_SQR_KARATSUBA_THRESHOLD  (60)
+#endif
+#ifndef KK_SQR_TOOM3_THRESHOLD
+#define KK_SQR_TOOM3_THRESHOLD      (400)
+#endif
+#ifndef KK_SQR_NTT_THRESHOLD
+#define KK_SQR_NTT_THRESHOLD        (700)
+#endif
+
+// Multiply a large `x` with a much smaller `y` in chunks of `y`'s size.
+static kk_bigint_t* bigint_mul_unbalanced(kk_bigint_t* x, kk_bigint_t* y, kk_context_t* ctx) {
+  const kk_ssize_t cx = bigint_count_(x);
+  const kk_ssize_t cy = bigint_count_(y);
+  kk_assert_internal(cx >= cy && cy > 0);
+  kk_bigint_t* z = bigint_alloc_zero(cx + cy, bigint_is_neg_(x) != bigint_is_neg_(y), ctx);
+  for (kk_ssize_t lo = 0; lo < cx; lo += cy) {
+    kk_bigint_t* p = bigint_mul_select(bigint_slice_trim(dup_bigint(x), lo, lo + cy, ctx), dup_bigint(y), ctx);
+    bigint_add_abs_at(z, lo, p);
+    drop_bigint(p, ctx);
+  }
+  drop_bigint(x, ctx);
+  drop_bigint(y, ctx);
+  return kk_bigint_trim(z, true, ctx);
+}
+
+static kk_bigint_t* bigint_mul_select(kk_bigint_t* x, kk_bigint_t* y, kk_context_t* ctx) {
+  if (x == y) {
+    drop_bigint(y, ctx);
+    return bigint_sqr_select(x, ctx);
+  }
+  if (bigint_count_(x) < bigint_count_(y)) { kk_bigint_t* t = x; x = y; y = t; }
+  const kk_ssize_t cx = bigint_count_(x);
+  const kk_ssize_t cy = bigint_count_(y);
+  if (cy < KK_MUL_KARATSUBA_THRESHOLD) {
+    return bigint_mul(x, y, ctx);
+  }
+  if (cy >= KK_MUL_NTT_THRESHOLD) {
+    kk_bigint_t* z = bigint_mul_ntt(x, y, ctx);
+    if (z != NULL) return z;
+  }
+  if (cx >= 2*cy) {
+    return bigint_mul_unbalanced(x, y, ctx);
+  }
+  else if (cy >= KK_MUL_TOOM3_THRESHOLD) {
+    return bigint_mul_toom3(x, y, ctx);
+  }
+  else {
+    return bigint_mul_karatsuba(x, y, ctx);
+  }
+}
+
+static kk_bigint_t* bigint_sqr_select(kk_bigint_t* x, kk_context_t* ctx) {
+  const kk_ssize_t cx = bigint_count_(x);
+  if (cx < KK_SQR_KARATSUBA_THRESHOLD) {
+    return bigint_sqr(x, ctx);
+  }
+  if (cx >= KK_SQR_NTT_THRESHOLD) {
+    kk_bigint_t* z = bigint_mul_ntt(dup_bigint(x), x, ctx);
+    if (z != NULL) return z;
+    drop_bigint(x, ctx);
+  }
+  if (cx >= KK_SQR_TOOM3_THRESHOLD) {
+    return bigint_mul_toom3(dup_bigint(x), x, ctx);
+  }
+  else {
+    return bigint_sqr_karatsuba(x, ctx);
+  }
+}
+
 
 /*----------------------------------'------------------------------------
   Pow
 ----------------------------------------------------------------------*/
 
+// Left-to-right sliding window exponentiation for `n > 0`. This needs as many squarings
+// as binary exponentiation, but the multiplications are only with small odd powers of `x`.
+static kk_integer_t integer_pow_window(kk_integer_t x, kk_uintx_t n, kk_context_t* ctx) {
+  kk_assert_internal(n > 0);
+  const int bits = KK_INTX_BITS - kk_bits_clz(n);
+  const int w = (bits <= 8 ? 1 : (bits <= 24 ? 2 : 3));
+  kk_integer_t pows[4];   // odd powers x^1, x^3, ..., x^(2^w - 1)
+  const int npows = 1 << (w - 1);
+  pows[0] = x;
+  if (npows > 1) {
+    kk_integer_t x2 = kk_integer_sqr(kk_integer_dup(x), ctx);
+    for (int k = 1; k < npows; k++) {
+      pows[k] = kk_integer_mul(kk_integer_dup(pows[k-1]), kk_integer_dup(x2), ctx);
+    }
+    kk_integer_drop(x2, ctx);
+  }
+  kk_integer_t y = kk_integer_one;
+  for (int i = bits - 1; i >= 0; ) {
+    if (((n >> i) & 1) == 0) {
+      y = kk_integer_sqr(y, ctx);
+      i--;
+      continue;
+    }
+    // the longest window of at most `w` bits ending in a 1 bit
+    int j = (i - w + 1 < 0 ? 0 : i - w + 1);
+    while (((n >> j) & 1) == 0) { j++; }
+    const kk_uintx_t window = (n >> j) & ((KUX(1) << (i - j + 1)) - 1);
+    for (int k = j; k <= i; k++) {
+      y = kk_integer_sqr(y, ctx);
+    }
+    y = kk_integer_mul(y, kk_integer_dup(pows[window >> 1]), ctx);
+    i = j - 1;
+  }
+  for (int k = 0; k < npows; k++) {
+    kk_integer_drop(pows[k], ctx);
+  }
+  return y;
+}
+
 kk_integer_t kk_integer_pow(kk_integer_t x, kk_integer_t p, kk_context_t* ctx) {
   if (kk_is_smallint(p)) {
-    if (p.value == kk_integer_zero.value) return kk_integer_one;
+    if (p.value == kk_integer_zero.value) {
+      kk_integer_drop(x, ctx);  return kk_integer_one;
+    }
   }
   if (kk_is_smallint(x)) {
     if (x.value == kk_integer_zero.value) {
@@ -1078,18 +1811,11 @@ kk_integer_t kk_integer_pow(kk_integer_t x, kk_integer_t p, kk_context_t* ctx) {
   }
   kk_assert_internal(kk_is_smallint(p));
   kk_intx_t i = kk_smallint_from_integer(p);
-  while (1) {
-    if ((i&1)!=0) {
-      kk_integer_dup(x);
-      y = kk_integer_mul(y, x, ctx);
-      i--;
-    }
-    if (i==0) break;
-    i /= 2;
-    x = kk_integer_sqr(x, ctx);
+  if (i == 0) {
+    kk_integer_drop(x, ctx);
+    return y;
   }
-  kk_integer_drop(x, ctx);
-  return y;
+  return kk_integer_mul(y, integer_pow_window(x, (kk_uintx_t)i, ctx), ctx);
 }
 
 
@@ -1116,7 +1842,8 @@ static kk_bigint_t* kk_bigint_cdiv_cmod_small(kk_bigint_t* x, kk_digit_t y, kk_d
 }
 
 
-static kk_bigint_t* bigint_cdiv_cmod(kk_bigint_t* x, kk_bigint_t* y, kk_bigint_t** pmod, kk_context_t* ctx) {
+// Classic long division; quadratic in the number of digits.
+static kk_bigint_t* bigint_cdiv_cmod_long(kk_bigint_t* x, kk_bigint_t* y, kk_bigint_t** pmod, kk_context_t* ctx) {
   kk_ssize_t cx = bigint_count_(x);
   kk_ssize_t cy = bigint_count_(y);
   kk_assert_internal(cx >= cy);
@@ -1147,7 +1874,7 @@ static kk_bigint_t* bigint_cdiv_cmod(kk_bigint_t* x, kk_bigint_t* y, kk_bigint_t
     for (kk_ssize_t i = 0; i < cd; i++) {
       kk_ddigit_t dcarry = ddigit_mul_add( qd, div->digits[i], carry );
       kk_digit_t carry_rem;
-      carry = ddigit_cdiv(dcarry, BASE, &carry_rem);
+      carry = ddigit_cdiv_base(dcarry, &carry_rem);
       borrow += (rem->digits[shift + i] - carry_rem);
       if (borrow >= BASE) {  // unsigned wrap
         kk_assert_internal(borrow + BASE < BASE);
@@ -1192,6 +1919,163 @@ static kk_bigint_t* bigint_cdiv_cmod(kk_bigint_t* x, kk_bigint_t* y, kk_bigint_t
 }
 
 
+/*----------------------------------------------------------------------
+  Division by a precomputed reciprocal
+  For a divisor `y` of `n` digits we compute `inv = floor(B^2n / y)` using
+  Newton iteration (with the fast multiplication). For any `x < B^2n`, the
+  estimate `floor(x*inv / B^2n)` is then at most 2 below the quotient.
+  This is used for repeated divisions by the same large number, like the
+  powers in the divide-and-conquer radix conversion.
+----------------------------------------------------------------------*/
+
+#define KK_RECIP_THRESHOLD  (32)   // use long division below this many digits
+
+// `B^n`
+static kk_bigint_t* bigint_base_pow(kk_ssize_t n, kk_context_t* ctx) {
+  kk_bigint_t* z = bigint_alloc_zero(n + 1, false, ctx);
+  z->digits[n] = 1;
+  return z;
+}
+
+// `floor(x / B^n)` (truncating towards zero)
+static kk_bigint_t* bigint_shift_right(kk_bigint_t* x, kk_ssize_t n, kk_context_t* ctx) {
+  return bigint_slice_trim(x, n, bigint_count_(x), ctx);
+}
+
+// Returns `floor(B^2n / y)` for a positive `y` of `n` digits.
+static kk_bigint_t* bigint_recip(kk_bigint_t* y, kk_context_t* ctx) {
+  kk_assert_internal(!bigint_is_neg_(y) && bigint_count_(y) > 0);
+  const kk_ssize_t n = bigint_count_(y);
+  if (n <= KK_RECIP_THRESHOLD) {
+    return bigint_cdiv_cmod_long(bigint_base_pow(2*n, ctx), y, NULL, ctx);
+  }
+  // approximate from the reciprocal of the top `k` digits: `floor(B^2k / yhi) * B^(n-k)`;
+  // this has a relative error below `B^(1-k)` which the Newton step squares, so with
+  // a few guard digits over `n/2` only a few corrections are needed at the end.
+  const kk_ssize_t k = n/2 + 2;
+  kk_bigint_t* x = kk_bigint_shift_left(bigint_recip(bigint_shift_right(dup_bigint(y), n - k, ctx), ctx), n - k, ctx);
+  // Newton step: `x + x*(B^2n - y*x)/B^2n`
+  kk_bigint_t* e = kk_bigint_sub(bigint_base_pow(2*n, ctx), bigint_mul_select(dup_bigint(y), dup_bigint(x), ctx), false, ctx);
+  kk_bigint_t* d = bigint_shift_right(bigint_mul_select(dup_bigint(x), e, ctx), 2*n, ctx);
+  x = bigint_add(x, d, d->is_neg, ctx);
+  // and correct the last digit
+  kk_bigint_t* r = kk_bigint_sub(bigint_base_pow(2*n, ctx), bigint_mul_select(dup_bigint(y), dup_bigint(x), ctx), false, ctx);
+  while (bigint_is_neg_(r) && bigint_count_(r) > 0) {
+    x = kk_bigint_sub(x, bigint_from_int(1, ctx), false, ctx);
+    r = bigint_add(r, dup_bigint(y), false, ctx);
+  }
+  while (bigint_compare_abs_(r, y) >= 0) {
+    x = bigint_add(x, bigint_from_int(1, ctx), false, ctx);
+    r = kk_bigint_sub(r, dup_bigint(y), false, ctx);
+  }
+  drop_bigint(r, ctx);
+  drop_bigint(y, ctx);
+  return x;
+}
+
+// Divide a positive `x < B^2n` by a positive `y` of `n` digits where `inv == bigint_recip(y)` (borrowed).
+static kk_bigint_t* bigint_cdiv_cmod_recip(kk_bigint_t* x, kk_bigint_t* y, kk_bigint_t* inv, kk_bigint_t** pmod, kk_context_t* ctx) {
+  const kk_ssize_t n = bigint_count_(y);
+  kk_assert_internal(!bigint_is_neg_(x) && bigint_count_(x) <= 2*n);
+  kk_bigint_t* q = bigint_shift_right(bigint_mul_select(dup_bigint(x), dup_bigint(inv), ctx), 2*n, ctx);
+  kk_bigint_t* r = kk_bigint_sub(x, bigint_mul_select(dup_bigint(q), dup_bigint(y), ctx), false, ctx);
+  while (bigint_compare_abs_(r, y) >= 0) {
+    q = bigint_add(q, bigint_from_int(1, ctx), false, ctx);
+    r = kk_bigint_sub(r, dup_bigint(y), false, ctx);
+  }
+  drop_bigint(y, ctx);
+  if (pmod != NULL) { *pmod = r; }
+               else { drop_bigint(r, ctx); }
+  return q;
+}
+
+
+/*----------------------------------------------------------------------
+  Division of large numbers
+  When both the divisor `y` (of `n` digits) and the quotient are large, we
+  divide blocks of `n` digits of `x` at a time using the Newton reciprocal of
+  `y`. When the quotient is much shorter than `y` (`m` digits), we first divide
+  the top `2m+2` digits of `x` by the top `m+2` digits of `y`; this estimate is
+  off by at most 2 and is corrected using the full divisor.
+----------------------------------------------------------------------*/
+
+#ifndef KK_DIV_TOP_THRESHOLD
+#define KK_DIV_TOP_THRESHOLD     (150)  // divide the top digits first above this many divisor digits (and 32 quotient digits)
+#endif
+#ifndef KK_DIV_BLOCKS_THRESHOLD
+#define KK_DIV_BLOCKS_THRESHOLD  (600)  // divide by blocks above this many divisor digits
+#endif
+
+static kk_bigint_t* bigint_cdiv_cmod(kk_bigint_t* x, kk_bigint_t* y, kk_bigint_t** pmod, kk_context_t* ctx);
+
+// Divide positive `x` by positive `y` of `n` digits, `n` digits of `x` at a time.
+static kk_bigint_t* bigint_cdiv_cmod_blocks(kk_bigint_t* x, kk_bigint_t* y, kk_bigint_t** pmod, kk_context_t* ctx) {
+  const kk_ssize_t cx = bigint_count_(x);
+  const kk_ssize_t n = bigint_count_(y);
+  kk_bigint_t* inv = bigint_recip(dup_bigint(y), ctx);
+  kk_bigint_t* z = bigint_alloc_zero(cx - n + 1, false, ctx);
+  kk_bigint_t* r = bigint_alloc_zero(0, false, ctx);
+  for (kk_ssize_t lo = ((cx - 1)/n)*n; lo >= 0; lo -= n) {
+    // `t = r*B^n + x[lo..lo+n)` where `r < y`, so `t < B^2n`
+    const kk_ssize_t hi = (lo + n < cx ? lo + n : cx);
+    kk_bigint_t* t = bigint_alloc_zero(n + bigint_count_(r), false, ctx);
+    kk_memcpy(t->digits, &x->digits[lo], (hi - lo) * kk_ssizeof(kk_digit_t));
+    kk_memcpy(&t->digits[n], r->digits, bigint_count_(r) * kk_ssizeof(kk_digit_t));
+    drop_bigint(r, ctx);
+    t = kk_bigint_trim(t, false, ctx);
+    kk_bigint_t* q = bigint_cdiv_cmod_recip(t, dup_bigint(y), inv, &r, ctx);
+    kk_assert_internal(bigint_count_(q) == 0 || lo + bigint_count_(q) <= bigint_count_(z));
+    kk_memcpy(&z->digits[lo], q->digits, bigint_count_(q) * kk_ssizeof(kk_digit_t));
+    drop_bigint(q, ctx);
+  }
+  drop_bigint(inv, ctx);
+  drop_bigint(y, ctx);
+  drop_bigint(x, ctx);
+  if (pmod != NULL) { *pmod = r; }
+               else { drop_bigint(r, ctx); }
+  return kk_bigint_trim(z, true, ctx);
+}
+
+// Divide positive `x` by positive `y` where the quotient has `m < n - 2` digits.
+static kk_bigint_t* bigint_cdiv_cmod_top(kk_bigint_t* x, kk_bigint_t* y, kk_bigint_t** pmod, kk_context_t* ctx) {
+  const kk_ssize_t m = bigint_count_(x) - bigint_count_(y);
+  const kk_ssize_t s = bigint_count_(y) - (m + 2);
+  kk_bigint_t* q = bigint_cdiv_cmod(bigint_shift_right(dup_bigint(x), s, ctx), bigint_shift_right(dup_bigint(y), s, ctx), NULL, ctx);
+  kk_bigint_t* r = kk_bigint_sub(x, bigint_mul_select(dup_bigint(q), dup_bigint(y), ctx), false, ctx);
+  while (bigint_is_neg_(r) && bigint_count_(r) > 0) {
+    q = kk_bigint_sub(q, bigint_from_int(1, ctx), false, ctx);
+    r = bigint_add(r, dup_bigint(y), false, ctx);
+  }
+  while (bigint_compare_abs_(r, y) >= 0) {
+    q = bigint_add(q, bigint_from_int(1, ctx), false, ctx);
+    r = kk_bigint_sub(r, dup_bigint(y), false, ctx);
+  }
+  drop_bigint(y, ctx);
+  if (pmod != NULL) { *pmod = r; }
+               else { drop_bigint(r, ctx); }
+  return q;
+}
+
+// Truncated division of `x` by `y` (with `|x| >= |y|`); the quotient gets the xor of the signs and the modulus the sign of `x`.
+static kk_bigint_t* bigint_cdiv_cmod(kk_bigint_t* x, kk_bigint_t* y, kk_bigint_t** pmod, kk_context_t* ctx) {
+  const kk_ssize_t cx = bigint_count_(x);
+  const kk_ssize_t cy = bigint_count_(y);
+  kk_assert_internal(cx >= cy);
+  const bool use_top = (cx - cy < cy - 2);
+  if (use_top ? (cy < KK_DIV_TOP_THRESHOLD || cx - cy < 32) : (cy < KK_DIV_BLOCKS_THRESHOLD)) {
+    return bigint_cdiv_cmod_long(x, y, pmod, ctx);
+  }
+  const bool xneg = bigint_is_neg_(x);
+  const bool qneg = (xneg != bigint_is_neg_(y));
+  if (xneg) { x = bigint_neg(x, ctx); }
+  if (bigint_is_neg_(y)) { y = bigint_neg(y, ctx); }
+  kk_bigint_t* q = (use_top ? bigint_cdiv_cmod_top(x, y, pmod, ctx) : bigint_cdiv_cmod_blocks(x, y, pmod, ctx));
+  if (qneg && bigint_count_(q) > 0) { q = bigint_neg(q, ctx); }
+  if (pmod != NULL && xneg && bigint_count_(*pmod) > 0) { *pmod = bigint_neg(*pmod, ctx); }
+  return q;
+}
+
+
 /*----------------------------------------------------------------------
   Addition and substraction
 ----------------------------------------------------------------------*/
@@ -1242,7 +2126,7 @@ static kk_bigint_t* kk_bigint_sub(kk_bigint_t* x, kk_bigint_t* y, bool yneg, kk_
  kk_integer_t kk_integer_sqr_generic(kk_integer_t x, kk_context_t* ctx) {
   kk_assert_internal(kk_is_integer(x));
   kk_bigint_t* bx = kk_integer_to_bigint(x,ctx);
-  return integer_bigint(kk_bigint_sqr(bx, ctx), ctx);
+  return integer_bigint(bigint_sqr_select(bx, ctx), ctx);
 }
 
  int kk_integer_signum_generic(kk_integer_t x, kk_context_t* ctx) {
@@ -1286,16 +2170,11 @@ kk_integer_t kk_integer_sub_generic(kk_integer_t x, kk_integer_t y, kk_context_t
   return integer_bigint(kk_bigint_sub(bx, by, by->is_neg, ctx), ctx);
 }
 
-static bool use_karatsuba(kk_ssize_t i, kk_ssize_t j) {
-  return ((0.000012*(double)(i*j) - 0.0025*(double)(i+j)) >= 0.0);
-}
-
 kk_integer_t kk_integer_mul_generic(kk_integer_t x, kk_integer_t y, kk_context_t* ctx) {
   kk_assert_internal(kk_is_integer(x)&&kk_is_integer(y));
   kk_bigint_t* bx = kk_integer_to_bigint(x, ctx);
   kk_bigint_t* by = kk_integer_to_bigint(y, ctx);
-  bool usek = use_karatsuba(bx->count, by->count);
-  return integer_bigint((usek ? bigint_mul_karatsuba(bx,by, ctx) : bigint_mul(bx, by, ctx)), ctx);
+  return integer_bigint(bigint_mul_select(bx, by, ctx), ctx);
 }
 
 
@@ -1405,11 +2284,11 @@ if (kk_integer_is_zero(kk_integer_dup(y),ctx)) {
     if (kk_integer_is_neg(kk_integer_dup(m), ctx)) {
       if (kk_integer_is_neg(kk_integer_dup(y), ctx)) {
         d = kk_integer_inc(d, ctx);
-        if (mod!=NULL) { m = kk_integer_sub(m, y, ctx); }      
+        if (mod!=NULL) { m = kk_integer_sub(m, kk_integer_dup(y), ctx); }
       }
       else {
         d = kk_integer_dec(d, ctx);
-        if (mod!=NULL) { m = kk_integer_add(m, y, ctx); } 
+        if (mod!=NULL) { m = kk_integer_add(m, kk_integer_dup(y), ctx); }
       }
     }
     kk_integer_drop(y,ctx);
@@ -1460,40 +2339,90 @@ static kk_string_t kk_int_to_hex_string(kk_intx_t i, bool use_capitals, kk_conte
   return kk_string_alloc_dup_valid_utf8(buf, ctx);
 }
 
-static kk_ssize_t kk_bigint_to_hex_buf(kk_bigint_t* b, char* buf, kk_ssize_t size, bool use_capitals, kk_context_t* ctx) {
-  // TODO: can we improve the performance using the Chinese remainder theorem? 
-  // and avoid the reversal? and per digit divide?
-  kk_assert_internal(!b->is_neg);
-  const char baseA = (use_capitals ? 'A' : 'a');
-  kk_ssize_t len = 0;
-  while (len < size && ((b->count > 1) || (b->digits[0] != 0))) {
+// Write exactly `width` hex digits of `b < 16^width` from the end of `buf` backwards (quadratic).
+static void bigint_to_hex_chunks(kk_bigint_t* b, char* buf, kk_ssize_t width, char baseA, kk_context_t* ctx) {
+  kk_ssize_t len = width;
+  while (len > 0 && bigint_count_(b) > 0 && ((b->count > 1) || (b->digits[0] != 0))) {
     // convert per BASE_HEX chunk in reverse order
     kk_digit_t mod;
     b = kk_bigint_cdiv_cmod_small(b, BASE_HEX, &mod, ctx);
-    for (kk_ssize_t i = 0; i < LOG_BASE_HEX && len < size; i++) {
+    for (kk_ssize_t i = 0; i < LOG_BASE_HEX && len > 0; i++) {
       // convert the mod per hex digit in reverse order
       kk_digit_t d = mod % 16;
       mod /= 16;
-      buf[len++] = (char)(d < 10 ? d + '0' : d - 10 + (kk_digit_t)baseA);
+      buf[--len] = (char)(d < 10 ? d + '0' : d - 10 + (kk_digit_t)baseA);
     }
   }
-  if (len == 0) {
-    buf[len++] = '0';
-  }
-  while (len > 0 && buf[len - 1] == '0') { // remove trailing zeros  
-    len--;  
+  while (len > 0) {
+    buf[--len] = '0';
   }
-  buf[len] = 0;
+  drop_bigint(b, ctx);
+}
+
+// Division by a single digit is so cheap that showing is only faster by
+// divide-and-conquer above `KK_HEX_CHUNK*2^KK_HEX_SHOW_LEVEL` hex digits.
+#ifndef KK_HEX_SHOW_LEVEL
+#define KK_HEX_SHOW_LEVEL  (5)
+#endif
 
-  // reverse the digits (careful with alignment restrictions if trying optimizing this)
-  for (kk_ssize_t i = 0; i < len/2; i++) {
-    char c = buf[i];
-    char d = buf[len - 1 - i];
-    buf[len - 1 - i] = c;
-    buf[i] = d;
+// Write exactly `KK_HEX_CHUNK*2^level` hex digits of `b` (zero padded) to `buf`.
+static void bigint_to_hex_rec(kk_bigint_t* b, int level, kk_bigint_t* pows[KK_HEX_LEVELS], kk_bigint_t* invs[KK_HEX_LEVELS], char* buf, char baseA, kk_context_t* ctx) {
+  const kk_ssize_t width = KK_HEX_CHUNK << level;
+  if (level <= KK_HEX_SHOW_LEVEL) {
+    bigint_to_hex_chunks(b, buf, width, baseA, ctx);
+    return;
+  }
+  kk_bigint_t* p = pows[level-1];
+  kk_bigint_t* hi;
+  kk_bigint_t* lo;
+  const int cmp = bigint_compare_abs_(b, p);
+  if (cmp < 0) {
+    kk_memset(buf, '0', width/2);
+    bigint_to_hex_rec(b, level - 1, pows, invs, buf + width/2, baseA, ctx);
+    return;
+  }
+  else if (cmp == 0) {
+    hi = bigint_alloc_zero(1, false, ctx);
+    hi->digits[0] = 1;
+    lo = bigint_alloc_zero(1, false, ctx);
+    drop_bigint(b, ctx);
   }
+  else {
+    hi = bigint_cdiv_cmod_recip(b, dup_bigint(p), invs[level-1], &lo, ctx);
+  }
+  bigint_to_hex_rec(hi, level - 1, pows, invs, buf, baseA, ctx);
+  bigint_to_hex_rec(lo, level - 1, pows, invs, buf + width/2, baseA, ctx);
+}
 
-  drop_bigint(b,ctx);
+static kk_ssize_t kk_bigint_to_hex_buf(kk_bigint_t* b, char* buf, kk_ssize_t size, bool use_capitals, kk_context_t* ctx) {
+  kk_assert_internal(!b->is_neg);
+  const char baseA = (use_capitals ? 'A' : 'a');
+  // the number of hex digits is at most `needed`; for large numbers we round up to a power of two number of chunks
+  const kk_ssize_t needed = (kk_ssize_t)(ceil((double)(bigint_count_(b)*LOG_BASE) * KK_LOG10_DIV_LOG16)) + 1;
+  kk_bigint_t* pows[KK_HEX_LEVELS];
+  const int levels = (needed > (KK_HEX_CHUNK << (KK_HEX_SHOW_LEVEL+1)) ? bigint_hex_pows(needed, pows, ctx) : 0);
+  const kk_ssize_t width = (levels == 0 ? needed : KK_HEX_CHUNK << levels);
+  char* tmp = (width < size ? buf : (char*)kk_malloc(width + 1, ctx));
+  if (levels == 0) {
+    bigint_to_hex_chunks(b, tmp, width, baseA, ctx);
+  }
+  else {
+    kk_bigint_t* invs[KK_HEX_LEVELS];
+    for (int i = 0; i < levels; i++) {
+      invs[i] = (i < KK_HEX_SHOW_LEVEL ? NULL : bigint_recip(dup_bigint(pows[i]), ctx));
+    }
+    bigint_to_hex_rec(b, levels, pows, invs, tmp, baseA, ctx);
+    bigint_hex_pows_drop(levels, invs, ctx);
+    bigint_hex_pows_drop(levels, pows, ctx);
+  }
+  // remove leading zeros
+  kk_ssize_t start = 0;
+  while (start < width - 1 && tmp[start] == '0') { start++; }
+  kk_ssize_t len = width - start;
+  if (len >= size) { len = size - 1; }
+  kk_memmove(buf, tmp + start, len);
+  buf[len] = 0;
+  if (tmp != buf) { kk_free(tmp); }
   return len;
 }
 
@@ -1523,6 +2452,7 @@ void kk_integer_fprint(FILE* f, kk_integer_t x, kk_context_t* ctx) {
 }
 
 void kk_integer_print(kk_integer_t x, kk_context_t* ctx) {
+  kk_stdout_flush(ctx);
   kk_integer_fprint(stdout, x, ctx);
 }
 
@@ -1593,13 +2523,6 @@ kk_integer_t kk_integer_count_digits(kk_integer_t x, kk_context_t* ctx) {
   }
 }
 
-static kk_digit_t digit_powers_of_10[LOG_BASE+1] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
-#if (LOG_BASE > 9)
-                                          , 10000000000, 100000000000, 1000000000000, 10000000000000, 100000000000000
-                                          , 1000000000000000, 10000000000000000, 100000000000000000, 1000000000000000000
-#endif
-                                          };
-
 kk_integer_t kk_integer_mul_pow10(kk_integer_t x, kk_integer_t p, kk_context_t* ctx) {
   if (kk_integer_is_zero(kk_integer_dup(p),ctx)) {
     kk_integer_drop(p, ctx);
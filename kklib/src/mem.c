@@ -0,0 +1,190 @@
+/*---------------------------------------------------------------------------
+  Copyright 2021, Microsoft Research, Daan Leijen.
+
+  This is free software; you can redistribute it and/or modify it under the
+  terms of the Apache License, Version 2.0. A copy of the License can be
+  found in the LICENSE file at the root of this distribution.
+---------------------------------------------------------------------------*/
+#include "kklib.h"
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+/*--------------------------------------------------------------------------------------------------
+  Allocator options (`--kkmem=OPT[,OPT]*`)
+
+  Tune the (statically linked) mimalloc allocator of a deployed binary:
+  - `large`           : use large OS pages (2MiB) where possible.
+  - `reserve=N`       : reserve N GiB of huge OS pages (1GiB) at startup, interleaved over the NUMA nodes.
+  - `eager`           : commit segments eagerly.
+  - `purge-delay=MS`  : delay in milli-seconds before unused memory is returned to the OS.
+  - `numa` / `numa=N` : bind each worker thread (and thus its context and heap) to a NUMA node,
+                        round-robin over all (or the first N) nodes.
+  The same settings are available through the `MIMALLOC_` environment variables but those are
+  easy to lose in a deployment. The NUMA binding is also done without mimalloc as the
+  first-touch policy of the OS then places the memory of each worker on its node.
+  The settings are summarized with `--kkstats`.
+--------------------------------------------------------------------------------------------------*/
+
+#define KK_MEM_RESERVE_TIMEOUT  (1000)   // maximal milli-seconds per NUMA node to reserve huge pages
+
+static bool        mem_tuned;             // = false
+static bool        mem_large_pages;
+static bool        mem_eager_commit;
+static long        mem_purge_delay = -1;  // -1 if not set
+static long        mem_reserve_gib;
+static long        mem_reserved_gib;      // actually reserved
+static long        mem_numa_nodes;        // > 0 if workers are bound to nodes
+
+#if defined(__linux__)
+// Parse a Linux cpu (or node) list like `0-3,8-11` into `set` (if not NULL); returns the highest entry (or -1)
+static long kk_mem_parse_list(const char* s, cpu_set_t* set) {
+  long max = -1;
+  while (*s >= '0' && *s <= '9') {
+    char* end;
+    long lo = strtol(s, &end, 10);
+    long hi = lo;
+    if (*end == '-') { hi = strtol(end + 1, &end, 10); }
+    for (long i = lo; i <= hi && set != NULL && i < CPU_SETSIZE; i++) { CPU_SET((int)i, set); }
+    if (hi > max) max = hi;
+    s = (*end == ',' ? end + 1 : end);
+  }
+  return max;
+}
+
+static bool kk_mem_read_list(const char* fname, char* buf, size_t bufsize) {
+  FILE* f = fopen(fname, "r");
+  if (f == NULL) return false;
+  const size_t n = fread(buf, 1, bufsize - 1, f);
+  fclose(f);
+  buf[n] = 0;
+  return (n > 0);
+}
+
+static long kk_mem_os_numa_nodes(void) {
+  char buf[256];
+  if (!kk_mem_read_list("/sys/devices/system/node/online", buf, sizeof(buf))) return 1;
+  return kk_mem_parse_list(buf, NULL) + 1;
+}
+
+static void kk_mem_bind_node(long node) {
+  char fname[64];
+  char buf[1024];
+  snprintf(fname, sizeof(fname), "/sys/devices/system/node/node%ld/cpulist", node);
+  if (!kk_mem_read_list(fname, buf, sizeof(buf))) return;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (kk_mem_parse_list(buf, &set) < 0) return;
+  if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+    kk_warning_message("unable to bind a worker thread to NUMA node %ld\n", node);
+  }
+}
+#else
+static long kk_mem_os_numa_nodes(void) {
+  return 1;
+}
+
+static void kk_mem_bind_node(long node) {
+  KK_UNUSED(node);
+}
+#endif
+
+// Called at the start of each worker thread (before its context is created)
+void kk_mem_thread_init(kk_ssize_t worker) {
+  if (mem_numa_nodes <= 0) return;
+  kk_mem_bind_node((long)(worker % mem_numa_nodes));
+}
+
+static bool kk_mem_option_value(const char* opt, const char* name, long* value) {
+  const size_t n = strlen(name);
+  if (strncmp(opt, name, n) != 0 || opt[n] != '=') return false;
+  char* end;
+  *value = strtol(opt + n + 1, &end, 10);
+  return (end != opt + n + 1 && (*end == 0 || *end == ',') && *value >= 0);
+}
+
+static bool kk_mem_option_is(const char* opt, const char* name) {
+  const size_t n = strlen(name);
+  return (strncmp(opt, name, n) == 0 && (opt[n] == 0 || opt[n] == ','));
+}
+
+#if defined(KK_MIMALLOC)
+static void kk_mem_apply(void) {
+  if (mem_large_pages)     { mi_option_set(mi_option_large_os_pages, 1); }
+  if (mem_eager_commit)    { mi_option_set(mi_option_eager_commit, 1); }
+  if (mem_purge_delay >= 0) {
+#if (MI_MALLOC_VERSION >= 210) || (MI_MALLOC_VERSION >= 180 && MI_MALLOC_VERSION < 200)
+    mi_option_set(mi_option_purge_delay, mem_purge_delay);
+#else
+    mi_option_set(mi_option_reset_delay, mem_purge_delay);
+#endif
+  }
+  if (mem_numa_nodes > 0) { mi_option_set(mi_option_use_numa_nodes, mem_numa_nodes); }
+  if (mem_reserve_gib > 0 && mem_reserved_gib == 0) {
+    const long nodes = (mem_numa_nodes > 0 ? mem_numa_nodes : kk_mem_os_numa_nodes());
+    if (mi_reserve_huge_os_pages_interleave((size_t)mem_reserve_gib, (size_t)nodes, (size_t)(nodes * KK_MEM_RESERVE_TIMEOUT)) == 0) {
+      mem_reserved_gib = mem_reserve_gib;
+    }
+    else {
+      kk_warning_message("unable to reserve %ld GiB of huge OS pages\n", mem_reserve_gib);
+    }
+  }
+}
+#else
+static void kk_mem_apply(void) {
+  if (mem_large_pages || mem_eager_commit || mem_purge_delay >= 0 || mem_reserve_gib > 0) {
+    kk_warning_message("--kkmem allocator options are ignored: rebuild the runtime with KK_MIMALLOC defined to use them\n");
+  }
+}
+#endif
+
+// Parse and apply a comma separated list of `--kkmem` options (returns `false` on an invalid option)
+bool kk_mem_options(const char* opts) {
+  bool ok = true;
+  const char* opt = opts;
+  while (*opt != 0) {
+    long n;
+    if (kk_mem_option_is(opt, "large"))                    { mem_large_pages = true; }
+    else if (kk_mem_option_is(opt, "eager"))               { mem_eager_commit = true; }
+    else if (kk_mem_option_value(opt, "reserve", &n))      { mem_reserve_gib = n; }
+    else if (kk_mem_option_value(opt, "purge-delay", &n))  { mem_purge_delay = n; }
+    else if (kk_mem_option_is(opt, "numa"))                { mem_numa_nodes = kk_mem_os_numa_nodes(); }
+    else if (kk_mem_option_value(opt, "numa", &n) && n > 0) {
+      const long nodes = kk_mem_os_numa_nodes();
+      mem_numa_nodes = (n < nodes ? n : nodes);
+    }
+    else {
+      const char* end = strchr(opt, ',');
+      kk_warning_message("unknown --kkmem option: %.*s\n", (int)(end == NULL ? strlen(opt) : (size_t)(end - opt)), opt);
+      ok = false;
+    }
+    const char* next = strchr(opt, ',');
+    if (next == NULL) break;
+    opt = next + 1;
+  }
+  mem_tuned = true;
+  kk_mem_apply();
+  return ok;
+}
+
+bool kk_mem_is_tuned(void) {
+  return mem_tuned;
+}
+
+// Print a summary of the allocator settings (for `--kkstats`)
+void kk_mem_print_text(FILE* out) {
+  if (!mem_tuned) return;
+  fprintf(out, "stats: mem: large pages: %s, eager commit: %s, purge delay: ",
+          (mem_large_pages ? "on" : "off"), (mem_eager_commit ? "on" : "off"));
+  if (mem_purge_delay >= 0) fprintf(out, "%ldms", mem_purge_delay);
+                       else fprintf(out, "default");
+  fprintf(out, ", reserved: %ld/%ld GiB, numa: ", mem_reserved_gib, mem_reserve_gib);
+  if (mem_numa_nodes > 0) fprintf(out, "workers bound to %ld node%s\n", mem_numa_nodes, (mem_numa_nodes == 1 ? "" : "s"));
+                     else fprintf(out, "off\n");
+}
+
+void kk_mem_print_json(FILE* out) {
+  fprintf(out, "{\"large_pages\":%s,\"eager_commit\":%s,\"purge_delay\":%ld,\"reserve_gib\":%ld,\"reserved_gib\":%ld,\"numa_nodes\":%ld}",
+          (mem_large_pages ? "true" : "false"), (mem_eager_commit ? "true" : "false"),
+          mem_purge_delay, mem_reserve_gib, mem_reserved_gib, mem_numa_nodes);
+}
@@ -29,6 +29,8 @@
 #include <sys/time.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/mman.h>
+#define KK_OS_HAS_MMAP 1
 #endif
 
 typedef int kk_file_t;
@@ -107,6 +109,7 @@ static int kk_posix_stat(kk_string_t path, kk_stat_t* st, kk_context_t* ctx) {
     if (stat(cpath, st) < 0) err = errno;
   }
 #endif
+  kk_string_drop(path, ctx);
   if (err < 0) err = errno;
   return err;
 }
@@ -186,6 +189,32 @@ static int kk_posix_write_retry(const kk_file_t out, const uint8_t* buf, const k
   Text files
 --------------------------------------------------------------------------------------------------*/
 
+#if defined(KK_OS_HAS_MMAP)
+static void kk_os_munmap_free(void* p, kk_block_t* b) {
+  struct kk_bytes_raw_s* br = (struct kk_bytes_raw_s*)b;
+  munmap(p, (size_t)br->length);
+}
+
+// Map a regular file read-only as raw bytes. Since the bytes must be zero terminated, we only
+// map a file if its size is not a multiple of the page size (as the rest of the last page is zeroed).
+// Note: the file should not be truncated while the bytes are alive.
+static bool kk_os_mmap_file(kk_file_t f, kk_ssize_t len, kk_bytes_t* result, kk_context_t* ctx) {
+  if (KK_OS_MMAP_MIN <= 0 || len < KK_OS_MMAP_MIN) return false;
+  kk_stat_t st;
+  if (kk_posix_fstat(f, &st) != 0 || !S_ISREG(st.st_mode)) return false;
+  const long page_size = sysconf(_SC_PAGESIZE);
+  if (page_size <= 0 || (len % page_size) == 0) return false;
+  void* p = mmap(NULL, (size_t)len, PROT_READ, MAP_PRIVATE, f, 0);
+  if (p == MAP_FAILED) return false;
+  #if defined(MADV_SEQUENTIAL)
+  madvise(p, (size_t)len, MADV_SEQUENTIAL);  // we first validate the utf-8
+  #endif
+  *result = kk_bytes_alloc_raw_len(len, (const uint8_t*)p, false, ctx);
+  kk_datatype_as_assert(kk_bytes_raw_t, *result, KK_TAG_BYTES_RAW)->free = &kk_os_munmap_free;
+  return true;
+}
+#endif
+
 kk_decl_export int kk_os_read_text_file(kk_string_t path, kk_string_t* result, kk_context_t* ctx)
 {
   kk_file_t f;
@@ -198,6 +227,15 @@ kk_decl_export int kk_os_read_text_file(kk_string_t path, kk_string_t* result, k
     kk_posix_close(f);
     return err;
   }
+  #if defined(KK_OS_HAS_MMAP)
+  kk_bytes_t mbuf;
+  if (kk_os_mmap_file(f, len, &mbuf, ctx)) {
+    kk_posix_close(f);
+    // valid utf-8 is returned as is; otherwise it is copied (and unmapped)
+    *result = kk_string_convert_from_qutf8(mbuf, ctx);
+    return 0;
+  }
+  #endif
   uint8_t* cbuf;
   kk_bytes_t buf = kk_bytes_alloc_buf(len, &cbuf, ctx);
 
@@ -239,6 +277,219 @@ kk_decl_export int kk_os_write_text_file(kk_string_t path, kk_string_t content,
 
 
 
+/*--------------------------------------------------------------------------------------------------
+  File descriptors (for asynchronous I/O, see `async.c`)
+--------------------------------------------------------------------------------------------------*/
+
+kk_decl_export int kk_os_fd_open(kk_string_t path, bool writable, int* fd, kk_context_t* ctx) {
+  kk_file_t f;
+  const int err = kk_posix_open(path, (writable ? (O_WRONLY | O_CREAT | O_TRUNC) : O_RDONLY), 0644, &f, ctx);
+  *fd = (err != 0 ? -1 : f);
+  return err;
+}
+
+kk_decl_export int kk_os_fd_close(int fd) {
+  return kk_posix_close(fd);
+}
+
+/*--------------------------------------------------------------------------------------------------
+  Buffered streams
+  A stream reads or writes a file incrementally through a buffer, so files can be processed in
+  constant memory. Lines are read into the buffer of the previous line if the caller dropped it.
+--------------------------------------------------------------------------------------------------*/
+
+struct kk_os_stream_s {
+  kk_file_t   f;          // -1 once closed
+  bool        writable;
+  bool        eof;
+  uint8_t*    buf;
+  kk_ssize_t  bufsize;
+  kk_ssize_t  pos;        // reading: the next unread byte in `buf`
+  kk_ssize_t  end;        // reading: the end of the bytes read; writing: the end of the pending bytes
+  kk_bytes_t  line;       // the last line read (reused if it becomes unique)
+};
+
+kk_decl_export int kk_os_stream_open(kk_string_t path, bool writable, bool append, kk_ssize_t bufsize, kk_os_stream_t** stream, kk_context_t* ctx) {
+  *stream = NULL;
+  const int flags = (!writable ? O_RDONLY : (O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC)));
+  kk_file_t f;
+  int err = kk_posix_open(path, flags, 0644, &f, ctx);
+  if (err != 0) return err;
+  if (bufsize < 64) bufsize = 64;
+  kk_os_stream_t* s = (kk_os_stream_t*)kk_malloc(kk_ssizeof(kk_os_stream_t), ctx);
+  uint8_t* buf = (uint8_t*)kk_malloc(bufsize, ctx);
+  if (s == NULL || buf == NULL) {
+    kk_free(s);
+    kk_free(buf);
+    kk_posix_close(f);
+    return ENOMEM;
+  }
+  s->f = f;
+  s->writable = writable;
+  s->eof = false;
+  s->buf = buf;
+  s->bufsize = bufsize;
+  s->pos = 0;
+  s->end = 0;
+  s->line = kk_bytes_empty();
+  *stream = s;
+  return 0;
+}
+
+static int kk_os_stream_fill(kk_os_stream_t* s) {
+  kk_assert_internal(s->pos == s->end);
+  s->pos = s->end = 0;
+  if (s->eof || s->f < 0) return 0;
+  kk_ssize_t nread;
+  const int err = kk_posix_read_retry(s->f, s->buf, s->bufsize, &nread);
+  if (err != 0) return err;
+  s->end = nread;
+  if (nread < s->bufsize) s->eof = true;
+  return 0;
+}
+
+// Read at most `max` bytes (but at least 4) up to a code point boundary; empty at the end of the file.
+kk_decl_export int kk_os_stream_read(kk_os_stream_t* s, kk_ssize_t max, kk_string_t* chunk, kk_context_t* ctx) {
+  *chunk = kk_string_empty();
+  if (s->writable) return EBADF;
+  if (max < 4) max = 4;
+  kk_string_builder_t sb = kk_string_builder_empty();
+  kk_ssize_t n = 0;
+  while (n < max) {
+    if (s->pos == s->end) {
+      const int err = kk_os_stream_fill(s);
+      if (err != 0) {
+        kk_bytes_drop(sb.buf, ctx);
+        return err;
+      }
+      if (s->end == 0) break; // eof
+    }
+    kk_ssize_t avail = s->end - s->pos;
+    if (avail > max - n) avail = max - n;
+    kk_string_builder_append_buf(&sb, avail, s->buf + s->pos, ctx);
+    s->pos += avail;
+    n += avail;
+  }
+  // leave an incomplete utf-8 sequence at the end for the next read
+  kk_ssize_t len;
+  const uint8_t* p = kk_bytes_buf_borrow(sb.buf, &len);
+  kk_ssize_t i = len;
+  while (i > 0 && len - i < 4 && (p[i-1] & 0xC0) == 0x80) { i--; }
+  if (i > 0 && p[i-1] >= 0xC0) {
+    const uint8_t b = p[i-1];
+    const kk_ssize_t count = (b >= 0xF0 ? 4 : (b >= 0xE0 ? 3 : 2));
+    if (len - (i - 1) < count && (s->pos != s->end || !s->eof)) {
+      const kk_ssize_t extra = len - (i - 1);
+      if (s->pos >= extra) {
+        s->pos -= extra;  // the bytes are still in the buffer
+        sb.buf = kk_bytes_adjust_length(sb.buf, len - extra, ctx);
+      }
+    }
+  }
+  *chunk = kk_string_convert_from_qutf8(sb.buf, ctx);
+  return 0;
+}
+
+// Read a line (without the `\n` or `\r\n`) and set `eof` if there are no more lines.
+kk_decl_export int kk_os_stream_read_line(kk_os_stream_t* s, kk_string_t* line, bool* eof, kk_context_t* ctx) {
+  *line = kk_string_empty();
+  *eof = false;
+  if (s->writable) return EBADF;
+  kk_string_builder_t sb = { kk_bytes_unsafe_reset(s->line, ctx) };
+  s->line = kk_bytes_empty();
+  bool found = false;
+  bool any = false;
+  while (!found) {
+    if (s->pos == s->end) {
+      const int err = kk_os_stream_fill(s);
+      if (err != 0) {
+        kk_bytes_drop(sb.buf, ctx);
+        return err;
+      }
+      if (s->end == 0) break; // eof
+    }
+    const uint8_t* start = s->buf + s->pos;
+    const uint8_t* nl = (const uint8_t*)memchr(start, '\n', (size_t)(s->end - s->pos));
+    const kk_ssize_t n = (nl == NULL ? s->end - s->pos : nl - start);
+    kk_string_builder_append_buf(&sb, n, start, ctx);
+    s->pos += n;
+    any = true;
+    if (nl != NULL) {
+      s->pos++;
+      found = true;
+    }
+  }
+  kk_ssize_t len;
+  const uint8_t* p = kk_bytes_buf_borrow(sb.buf, &len);
+  if (!any) {
+    *eof = true;
+    kk_bytes_drop(sb.buf, ctx);
+    return 0;
+  }
+  if (len > 0 && p[len-1] == '\r') {
+    sb.buf = kk_bytes_adjust_length(sb.buf, len - 1, ctx);
+  }
+  *line = kk_string_convert_from_qutf8(sb.buf, ctx);
+  s->line = kk_bytes_dup(line->bytes);
+  return 0;
+}
+
+kk_decl_export int kk_os_stream_flush(kk_os_stream_t* s) {
+  if (!s->writable || s->f < 0 || s->end == 0) return 0;
+  kk_ssize_t nwritten;
+  int err = kk_posix_write_retry(s->f, s->buf, s->end, &nwritten);
+  if (err == 0 && nwritten < s->end) err = EIO;
+  s->end = 0;
+  return err;
+}
+
+kk_decl_export int kk_os_stream_write(kk_os_stream_t* s, kk_string_t content, kk_context_t* ctx) {
+  int err = 0;
+  if (!s->writable || s->f < 0) {
+    err = EBADF;
+  }
+  else {
+    kk_ssize_t len;
+    const uint8_t* p = kk_string_buf_borrow(content, &len);
+    if (s->end + len > s->bufsize) err = kk_os_stream_flush(s);
+    if (err == 0 && len >= s->bufsize) {
+      // write large content directly
+      kk_ssize_t nwritten;
+      err = kk_posix_write_retry(s->f, p, len, &nwritten);
+      if (err == 0 && nwritten < len) err = EIO;
+    }
+    else if (err == 0) {
+      kk_memcpy(s->buf + s->end, p, len);
+      s->end += len;
+    }
+  }
+  kk_string_drop(content, ctx);
+  return err;
+}
+
+// Flush and close the file; the stream itself is freed by `kk_os_stream_free`.
+kk_decl_export int kk_os_stream_close(kk_os_stream_t* s, kk_context_t* ctx) {
+  if (s->f < 0) return 0;
+  int err = kk_os_stream_flush(s);
+  const int cerr = kk_posix_close(s->f);
+  if (err == 0) err = cerr;
+  s->f = -1;
+  s->pos = s->end = 0;
+  kk_bytes_drop(s->line, ctx);
+  s->line = kk_bytes_empty();
+  return err;
+}
+
+kk_decl_export void kk_os_stream_free(void* p, kk_block_t* b) {
+  KK_UNUSED(b);
+  kk_os_stream_t* s = (kk_os_stream_t*)p;
+  if (s == NULL) return;
+  kk_os_stream_close(s, kk_get_context());
+  kk_free(s->buf);
+  kk_free(s);
+}
+
+
 /*--------------------------------------------------------------------------------------------------
   Directories
 --------------------------------------------------------------------------------------------------*/
@@ -339,19 +590,63 @@ kk_decl_export int kk_os_copy_file(kk_string_t from, kk_string_t to, bool preser
 #include <copyfile.h>
 
 #else
+#if defined(__linux__)
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>       // FICLONE
+
+#define KK_COPY_MAX_CHUNK  (0x7FFFF000)   // maximal transfer of a single `copy_file_range`/`sendfile` call
+
+static bool kk_linux_copy_unsupported(int err) {
+  return (err == EXDEV || err == EINVAL || err == ENOSYS || err == EOPNOTSUPP || err == ENOTSUP || err == EBADF || err == EPERM);
+}
+
+// Copy inside the kernel; returns `true` if the copy is done (with the result in `*err`),
+// or `false` if the caller should transfer the rest (from the current file positions).
+static bool kk_linux_copy_file(const int inp, const int out, const kk_ssize_t estimated_len, int* err) {
+  *err = 0;
+  #if defined(FICLONE)
+  // a reflink shares the data blocks (btrfs, xfs, ...); this only works on whole files
+  if (ioctl(out, FICLONE, inp) == 0) return true;
+  #endif
+  // use the estimated length as the chunk size so a regular file is transferred in one call;
+  // we continue until EOF though as the file may have grown.
+  size_t chunk = (estimated_len >= KK_COPY_MAX_CHUNK ? KK_COPY_MAX_CHUNK : (size_t)estimated_len + 1);
+  bool copied = false;
+  #if defined(SYS_copy_file_range)
+  // `copy_file_range` copies on the server for NFS/SMB, and can reflink on other file systems
+  // (we call it through `syscall` as glibc only provides it since 2.27)
+  while (true) {
+    const ssize_t n = syscall(SYS_copy_file_range, inp, NULL, out, NULL, chunk, 0 /* flags */);
+    if (n > 0) { copied = true; continue; }
+    if (n == 0) return true;  // EOF
+    if (errno == EINTR) continue;
+    if (copied || !kk_linux_copy_unsupported(errno)) { *err = errno; return true; }
+    break;  // not supported between these files (pre 5.3 kernels do not copy across file systems)
+  }
+  #endif
+  // `sendfile` can transfer between most files since Linux 2.6.33
+  while (true) {
+    const ssize_t n = sendfile(out, inp, NULL, chunk);
+    if (n > 0) { copied = true; continue; }
+    if (n == 0) return true;  // EOF
+    if (errno == EINTR) continue;
+    if (copied || !kk_linux_copy_unsupported(errno)) { *err = errno; return true; }
+    break;
+  }
+  return false;
+}
+#endif
+
 static int kk_posix_copy_file(const int inp, const int out, const kk_ssize_t estimated_len, kk_context_t* ctx) {
   int err = 0;
 
-#if defined(COPY_FR_COPY)
-  // try copy_file_range first
-  if (estimated_len > 0 && estimated_len < KK_SSIZE_MAX) {  // non-regular files can report zero length but can be read anyways
-    loff_t off_in = 0;
-    loff_t off_out = 0;
-    if (copy_file_range(inp, &off_in, out, &off_out, KK_SSIZE_MAX, 0 /* flags */) < 0) {
-      err = errno;
-    };
-    if (err != EINVAL) return err;
-    // fall through if `copy_file_range` failed immediately with `EINVAL` (might be a non-seekable device?)
+#if defined(__linux__)
+  // try to copy in the kernel first
+  if (estimated_len > 0) {  // non-regular files can report zero length but can be read anyways
+    if (kk_linux_copy_file(inp, out, estimated_len, &err)) return err;
+    // fall through if the kernel cannot copy between these files
     err = 0;
   }  
 #endif
@@ -377,6 +672,22 @@ static int kk_posix_copy_file(const int inp, const int out, const kk_ssize_t est
 #endif  // not __APPLE__ 
 
 kk_decl_export int  kk_os_copy_file(kk_string_t from, kk_string_t to, bool preserve_mtime, kk_context_t* ctx) {
+#if defined(__APPLE__) && defined(COPYFILE_CLONE)
+  // macOS: clone on APFS (sharing the data blocks), and fall back to a regular copy otherwise.
+  // (this uses the path based `copyfile` as `fcopyfile` cannot clone, and this always preserves the times) 
+  KK_UNUSED(preserve_mtime);
+  int err = 0;
+  kk_with_string_as_qutf8_borrow(from, cfrom, ctx) {
+    kk_with_string_as_qutf8_borrow(to, cto, ctx) {
+      if (copyfile(cfrom, cto, NULL, COPYFILE_ALL | COPYFILE_CLONE) != 0) {
+        err = errno;
+      }
+    }
+  }
+  kk_string_drop(from, ctx);
+  kk_string_drop(to, ctx);
+  return err;
+#else
   int inp = 0;
   int out = 0;
 
@@ -428,6 +739,7 @@ kk_decl_export int  kk_os_copy_file(kk_string_t from, kk_string_t to, bool prese
   };
 
   return err;
+#endif
 }
 #endif
 
@@ -559,40 +871,768 @@ kk_decl_export int kk_os_list_directory(kk_string_t dir, kk_vector_t* contents,
 
 
 /*--------------------------------------------------------------------------------------------------
-  Run system command
+  Parallel directory walk
+  Directories are listed by a number of worker threads (each with its own context) that share
+  a stack of directories still to be listed. Each listed directory produces a batch of entries
+  (in the C heap) that the walker returns one by one through `kk_os_walk_next`, so results are
+  streamed while the walk proceeds (and workers pause if too many batches are pending).
+  On Linux we read entries with batched `getdents64` calls and use the entry type it returns
+  so no `stat` is needed (except on file systems that do not report it).
+  The caller also lists directories itself while no batch is ready (and with zero threads, or
+  when single threaded, it lists all of them).
 --------------------------------------------------------------------------------------------------*/
 
-kk_decl_export int kk_os_run_command(kk_string_t cmd, kk_string_t* output, kk_context_t* ctx) {
-  FILE* f = NULL;
 #if defined(WIN32)
-  kk_with_string_as_qutf16_borrow(cmd, wcmd, ctx) {
-    f = _wpopen(wcmd, L"rt"); // todo: maybe open as binary?
+#include <io.h>
+#elif defined(__linux__)
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+#include "kklib/thread.h"
+
+#ifndef KK_WALK_MAX_BATCHES
+#define KK_WALK_MAX_BATCHES  (256)   // workers wait while this many batches are pending
+#endif
+
+typedef struct kk_walk_dir_s {
+  struct kk_walk_dir_s* next;
+  kk_ssize_t            depth;
+  kk_ssize_t            len;
+  char                  path[1];   // zero terminated
+} kk_walk_dir_t;
+
+// A batch of entries; each entry is a kind byte followed by a zero terminated path.
+typedef struct kk_walk_batch_s {
+  struct kk_walk_batch_s* next;
+  kk_ssize_t              len;
+  kk_ssize_t              pos;     // the next entry to return
+  kk_ssize_t              cap;
+  char*                   data;
+} kk_walk_batch_t;
+
+struct kk_os_walk_s {
+  kk_ssize_t       max_depth;
+  kk_walk_dir_t*   dirs;           // stack of directories to list
+  kk_walk_batch_t* first;          // queue of listed batches
+  kk_walk_batch_t* last;
+  kk_walk_batch_t* current;        // the batch being returned (owned by the caller of `kk_os_walk_next`)
+  kk_ssize_t       batch_count;
+  kk_ssize_t       active;         // number of directories being listed
+  bool             stop;
+  kk_ssize_t       thread_count;
+#if KK_MULTI_THREADED
+  kk_mutex_t       lock;
+  kk_cond_t        work;           // signaled when there are directories to list (or on `stop`)
+  kk_cond_t        ready;          // signaled when a batch is ready (or the walk is done)
+  kk_thread_t*     threads;
+#endif
+};
+
+#if KK_MULTI_THREADED
+static void kk_walk_lock(kk_os_walk_t* w)   { if (w->thread_count > 0) kk_mutex_lock(&w->lock); }
+static void kk_walk_unlock(kk_os_walk_t* w) { if (w->thread_count > 0) kk_mutex_unlock(&w->lock); }
+#else
+static void kk_walk_lock(kk_os_walk_t* w)   { KK_UNUSED(w); }
+static void kk_walk_unlock(kk_os_walk_t* w) { KK_UNUSED(w); }
+#endif
+
+static bool kk_walk_is_done(kk_os_walk_t* w) {
+  return (w->dirs == NULL && w->active == 0);
+}
+
+static kk_walk_dir_t* kk_walk_dir_alloc(const char* dir, kk_ssize_t dirlen, const char* name, kk_ssize_t namelen, kk_ssize_t depth, kk_context_t* ctx) {
+  const bool sep = (dirlen > 0 && dir[dirlen-1] != '/' && dir[dirlen-1] != '\\' && namelen > 0);
+  const kk_ssize_t len = dirlen + (sep ? 1 : 0) + namelen;
+  kk_walk_dir_t* d = (kk_walk_dir_t*)kk_malloc(kk_ssizeof(kk_walk_dir_t) + len, ctx);
+  if (d == NULL) return NULL;
+  kk_memcpy(d->path, dir, dirlen);
+  if (sep) d->path[dirlen] = '/';
+  kk_memcpy(d->path + dirlen + (sep ? 1 : 0), name, namelen);
+  d->path[len] = 0;
+  d->len = len;
+  d->depth = depth;
+  d->next = NULL;
+  return d;
+}
+
+static bool kk_walk_batch_add(kk_walk_batch_t* b, int kind, const kk_walk_dir_t* dir, const char* name, kk_ssize_t namelen, kk_context_t* ctx) {
+  const kk_ssize_t needed = 1 + dir->len + 1 + namelen + 1;
+  if (b->len + needed > b->cap) {
+    kk_ssize_t newcap = (b->cap == 0 ? 4096 : 2*b->cap);
+    if (newcap < b->len + needed) newcap = b->len + needed;
+    char* data = (char*)kk_realloc(b->data, newcap, ctx);
+    if (data == NULL) return false;
+    b->data = data;
+    b->cap = newcap;
+  }
+  char* p = b->data + b->len;
+  *p++ = (char)kind;
+  kk_memcpy(p, dir->path, dir->len);
+  p += dir->len;
+  if (dir->len > 0 && dir->path[dir->len-1] != '/' && dir->path[dir->len-1] != '\\') *p++ = '/';
+  kk_memcpy(p, name, namelen);
+  p += namelen;
+  *p++ = 0;
+  b->len = (p - b->data);
+  return true;
+}
+
+// List one directory into a batch and a list of subdirectories.
+static void kk_walk_list(kk_walk_dir_t* dir, kk_walk_batch_t* batch, kk_walk_dir_t** subdirs, bool recurse, kk_context_t* ctx) {
+  #define KK_WALK_ADD(kind,name,namelen)  \
+    { if ((kind) == KK_OS_WALK_DIR && recurse) { \
+        kk_walk_dir_t* sub = kk_walk_dir_alloc(dir->path, dir->len, name, namelen, dir->depth + 1, ctx); \
+        if (sub != NULL) { sub->next = *subdirs; *subdirs = sub; } \
+      } \
+      kk_walk_batch_add(batch, kind, dir, name, namelen, ctx); }
+#if defined(WIN32)
+  kk_string_t spath = kk_string_cat_from_valid_utf8(kk_string_alloc_from_qutf8(dir->path, ctx), "\\*", ctx);
+  struct _wfinddata64_t entry;
+  intptr_t h = -1;
+  kk_with_string_as_qutf16_borrow(spath, wpath, ctx) {
+    h = _wfindfirsti64(wpath, &entry);
+  }
+  kk_string_drop(spath, ctx);
+  if (h == -1) return;
+  do {
+    if (wcscmp(entry.name, L".") == 0 || wcscmp(entry.name, L"..") == 0) continue;
+    kk_string_t name = kk_string_alloc_from_qutf16(entry.name, ctx);
+    kk_with_string_as_qutf8_borrow(name, cname, ctx) {
+      const int kind = ((entry.attrib & _A_SUBDIR) != 0 ? KK_OS_WALK_DIR : KK_OS_WALK_FILE);
+      KK_WALK_ADD(kind, cname, kk_sstrlen(cname));
+    }
+    kk_string_drop(name, ctx);
+  } while (_wfindnexti64(h, &entry) == 0);
+  _findclose(h);
+#elif defined(__linux__) && defined(SYS_getdents64)
+  struct kk_linux_dirent64 {
+    uint64_t       d_ino;
+    int64_t        d_off;
+    unsigned short d_reclen;
+    unsigned char  d_type;
+    char           d_name[];
+  };
+  const int fd = open(dir->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) return;
+  char buf[64*1024];
+  while (true) {
+    const long n = syscall(SYS_getdents64, fd, buf, sizeof(buf));
+    if (n <= 0) {
+      if (n < 0 && errno == EINTR) continue;
+      break;
+    }
+    for (long ofs = 0; ofs < n; ) {
+      const struct kk_linux_dirent64* d = (const struct kk_linux_dirent64*)(buf + ofs);
+      ofs += d->d_reclen;
+      const char* name = d->d_name;
+      if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0))) continue;
+      int type = d->d_type;
+      if (type == DT_UNKNOWN) {
+        struct stat st;
+        if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+          type = (S_ISDIR(st.st_mode) ? DT_DIR : (S_ISREG(st.st_mode) ? DT_REG : (S_ISLNK(st.st_mode) ? DT_LNK : DT_UNKNOWN)));
+        }
+      }
+      const int kind = (type == DT_DIR ? KK_OS_WALK_DIR : (type == DT_REG ? KK_OS_WALK_FILE : (type == DT_LNK ? KK_OS_WALK_LINK : KK_OS_WALK_OTHER)));
+      KK_WALK_ADD(kind, name, kk_sstrlen(name));
+    }
   }
+  close(fd);
 #else
-  kk_with_string_as_qutf8_borrow(cmd, ccmd, ctx) {
-    f = popen(ccmd, "r");
+  DIR* d = opendir(dir->path);
+  if (d == NULL) return;
+  struct dirent* entry;
+  while ((entry = readdir(d)) != NULL) {
+    const char* name = entry->d_name;
+    if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0))) continue;
+    int kind = KK_OS_WALK_OTHER;
+    #if defined(DT_DIR)
+    if (entry->d_type == DT_DIR) kind = KK_OS_WALK_DIR;
+    else if (entry->d_type == DT_REG) kind = KK_OS_WALK_FILE;
+    else if (entry->d_type == DT_LNK) kind = KK_OS_WALK_LINK;
+    else if (entry->d_type == DT_UNKNOWN)
+    #endif
+    {
+      struct stat st;
+      if (fstatat(dirfd(d), name, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+        kind = (S_ISDIR(st.st_mode) ? KK_OS_WALK_DIR : (S_ISREG(st.st_mode) ? KK_OS_WALK_FILE : (S_ISLNK(st.st_mode) ? KK_OS_WALK_LINK : KK_OS_WALK_OTHER)));
+      }
+    }
+    KK_WALK_ADD(kind, name, kk_sstrlen(name));
   }
+  closedir(d);
 #endif
-  kk_string_drop(cmd, ctx);
-  if (f == NULL) return errno;
-  kk_string_t out = kk_string_empty();
-  char buf[1025];
-  while (fgets(buf, 1024, f) != NULL) {
-    buf[1024] = 0; // paranoia
-    out = kk_string_cat(out, kk_string_alloc_from_qutf8(buf,ctx), ctx);  // todo: avoid allocation
-  }
-  if (feof(f)) errno = 0;
+  #undef KK_WALK_ADD
+}
+
+// Pop a directory and list it; returns `false` if there was no directory to list.
+// Called with the lock held (and returns with the lock held).
+static bool kk_walk_step(kk_os_walk_t* w, kk_context_t* ctx) {
+  kk_walk_dir_t* dir = w->dirs;
+  if (dir == NULL) return false;
+  w->dirs = dir->next;
+  w->active++;
+  kk_walk_unlock(w);
+  kk_walk_batch_t* batch = (kk_walk_batch_t*)kk_zalloc(kk_ssizeof(kk_walk_batch_t), ctx);
+  kk_walk_dir_t* subdirs = NULL;
+  if (batch != NULL) {
+    kk_walk_list(dir, batch, &subdirs, dir->depth < w->max_depth, ctx);
+  }
+  kk_free(dir);
+  kk_walk_lock(w);
+  while (subdirs != NULL) {
+    kk_walk_dir_t* next = subdirs->next;
+    subdirs->next = w->dirs;
+    w->dirs = subdirs;
+    subdirs = next;
+  }
+  if (batch != NULL && batch->len == 0) {
+    kk_free(batch->data);
+    kk_free(batch);
+  }
+  else if (batch != NULL) {
+    if (w->last == NULL) { w->first = batch; }
+                    else { w->last->next = batch; }
+    w->last = batch;
+    w->batch_count++;
+  }
+  w->active--;
+  #if KK_MULTI_THREADED
+  if (w->thread_count > 0) {
+    if (w->batch_count == 1 || kk_walk_is_done(w)) kk_cond_broadcast(&w->ready);
+    if (w->dirs != NULL) kk_cond_broadcast(&w->work);
+  }
+  #endif
+  return true;
+}
+
+#if KK_MULTI_THREADED
+static kk_thread_result_t kk_thread_call kk_walk_worker_start(void* arg) {
+  kk_os_walk_t* w = (kk_os_walk_t*)arg;
+  kk_context_t* ctx = kk_get_context();  // initialize a fresh context for this thread
+  kk_mutex_lock(&w->lock);
+  while (!w->stop && !kk_walk_is_done(w)) {
+    if (w->dirs == NULL || w->batch_count >= KK_WALK_MAX_BATCHES) {
+      kk_cond_timedwait(&w->work, &w->lock, 100);
+    }
+    else {
+      kk_walk_step(w, ctx);
+    }
+  }
+  kk_cond_broadcast(&w->work);   // wake up the other workers once done
+  kk_mutex_unlock(&w->lock);
+  kk_free_context();
+  return 0;
+}
+#endif
+
+// Start walking the directory tree under `root` (up to `max_depth` levels) using `threads` workers
+// (or one less than the cpu count if negative). Entries are returned in no particular order (unless `threads` is 0).
+kk_decl_export int kk_os_walk_open(kk_string_t root, kk_ssize_t threads, kk_ssize_t max_depth, kk_os_walk_t** walk, kk_context_t* ctx) {
+  *walk = NULL;
+  kk_ssize_t rootlen;
+  const char* croot = kk_string_cbuf_borrow(root, &rootlen);
+  while (rootlen > 1 && (croot[rootlen-1] == '/' || croot[rootlen-1] == '\\')) { rootlen--; }
+  // check the root first so we can report an error
+  if (!kk_os_is_directory(kk_string_dup(root), ctx)) {
+    kk_string_drop(root, ctx);
+    return ENOTDIR;
+  }
+  kk_os_walk_t* w = (kk_os_walk_t*)kk_zalloc(kk_ssizeof(kk_os_walk_t), ctx);
+  kk_walk_dir_t* dir = (w == NULL ? NULL : kk_walk_dir_alloc(croot, rootlen, "", 0, 0, ctx));
+  kk_string_drop(root, ctx);
+  if (dir == NULL) {
+    kk_free(w);
+    return ENOMEM;
+  }
+  w->dirs = dir;
+  w->max_depth = max_depth;
+#if KK_MULTI_THREADED
+  if (threads < 0) threads = kk_cpu_count(ctx) - 1;  // as the caller helps listing
+  if (threads < 0) threads = 0;
+  if (threads > 0) {
+    kk_mutex_init(&w->lock);
+    kk_cond_init(&w->work);
+    kk_cond_init(&w->ready);
+    w->threads = (kk_thread_t*)kk_malloc(threads * kk_ssizeof(kk_thread_t), ctx);
+    if (w->threads == NULL) threads = 0;
+  }
+  w->thread_count = threads;
+  for (kk_ssize_t i = 0; i < threads; i++) {
+    if (!kk_thread_create(&w->threads[i], &kk_walk_worker_start, w)) {
+      kk_mutex_lock(&w->lock);
+      w->thread_count = i;   // continue with the threads we have
+      kk_mutex_unlock(&w->lock);
+      break;
+    }
+  }
+  if (w->thread_count == 0) { kk_free(w->threads); w->threads = NULL; }
+#else
+  KK_UNUSED(threads);
+#endif
+  *walk = w;
+  return 0;
+}
+
+// Return the next entry with its `kind` (`KK_OS_WALK_FILE`, ...), or `KK_OS_WALK_DONE` at the end of the walk.
+kk_decl_export int kk_os_walk_next(kk_os_walk_t* w, kk_string_t* path, int* kind, kk_context_t* ctx) {
+  *path = kk_string_empty();
+  *kind = KK_OS_WALK_DONE;
+  kk_walk_batch_t* b = w->current;
+  if (b == NULL || b->pos >= b->len) {
+    // take the next batch
+    if (b != NULL) {
+      kk_free(b->data);
+      kk_free(b);
+      w->current = b = NULL;
+    }
+    kk_walk_lock(w);
+    while (w->first == NULL && !kk_walk_is_done(w)) {
+      // help out by listing a directory ourselves (and only wait if the workers list the last ones)
+      if (!kk_walk_step(w, ctx)) {
+        #if KK_MULTI_THREADED
+        kk_cond_timedwait(&w->ready, &w->lock, 100);
+        #endif
+      }
+    }
+    b = w->first;
+    if (b != NULL) {
+      w->first = b->next;
+      if (w->first == NULL) w->last = NULL;
+      w->batch_count--;
+      #if KK_MULTI_THREADED
+      if (w->thread_count > 0 && w->batch_count == KK_WALK_MAX_BATCHES - 1) kk_cond_broadcast(&w->work);
+      #endif
+    }
+    kk_walk_unlock(w);
+    if (b == NULL) return 0;   // done
+    w->current = b;
+  }
+  const char* entry = b->data + b->pos;
+  *kind = entry[0];
+  b->pos += kk_sstrlen(entry + 1) + 2;
+  *path = kk_string_alloc_from_qutf8(entry + 1, ctx);
+  return 0;
+}
+
+// Stop the walk (if needed) and free it.
+kk_decl_export void kk_os_walk_free(void* p, kk_block_t* b) {
+  KK_UNUSED(b);
+  kk_os_walk_t* w = (kk_os_walk_t*)p;
+  if (w == NULL) return;
+#if KK_MULTI_THREADED
+  if (w->thread_count > 0) {
+    kk_mutex_lock(&w->lock);
+    w->stop = true;
+    kk_cond_broadcast(&w->work);
+    kk_mutex_unlock(&w->lock);
+    for (kk_ssize_t i = 0; i < w->thread_count; i++) {
+      kk_thread_join(w->threads[i]);
+    }
+    kk_free(w->threads);
+  }
+#endif
+  while (w->dirs != NULL) {
+    kk_walk_dir_t* next = w->dirs->next;
+    kk_free(w->dirs);
+    w->dirs = next;
+  }
+  if (w->current != NULL) {
+    kk_free(w->current->data);
+    kk_free(w->current);
+  }
+  while (w->first != NULL) {
+    kk_walk_batch_t* next = w->first->next;
+    kk_free(w->first->data);
+    kk_free(w->first);
+    w->first = next;
+  }
+  kk_free(w);
+}
+
+
+/*--------------------------------------------------------------------------------------------------
+  Processes
+  A command is run by the shell in a child process with pipes to its standard input, output, and
+  error (as requested by `pipes`; others are inherited). We use `posix_spawn` which (unlike
+  `fork`) does not copy the page tables of the parent, so spawning stays cheap for a parent with
+  a large resident set. The output is read incrementally as it arrives, from both stdout and stderr
+  so a child can never block on a full pipe we are not reading.
+--------------------------------------------------------------------------------------------------*/
+
+#if defined(WIN32)
+#include <Windows.h>
+#else
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#if defined(O_CLOEXEC) && (defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__DragonFly__))
+#define KK_OS_HAS_PIPE2 1
+#endif
+#if defined(__APPLE__)
+#include <crt_externs.h>
+#define environ (*_NSGetEnviron())
+#else
+extern char** environ;
+#endif
+#endif
+
+struct kk_os_process_s {
+#if defined(WIN32)
+  HANDLE     handle;
+#else
+  pid_t      pid;
+#endif
+  kk_file_t  fds[3];        // parent ends of the pipes to the stdin, stdout, and stderr of the child (or -1)
+  uint8_t    pending[3][4]; // incomplete utf-8 sequence at the end of the last chunk read from stdout/stderr
+  kk_ssize_t pending_len[3];
+  int        next;          // read from this pipe first if both have output (alternates for fairness)
+  bool       waited;
+  int        exitcode;
+};
+
+static void kk_os_process_close_fd(kk_os_process_t* p, int i) {
+  if (p->fds[i] >= 0) {
+    kk_posix_close(p->fds[i]);
+    p->fds[i] = -1;
+  }
+}
+
 #if defined(WIN32)
-  _pclose(f);
+kk_decl_export int kk_os_process_spawn(kk_string_t cmd, int pipes, kk_os_process_t** proc, kk_context_t* ctx) {
+  *proc = NULL;
+  kk_os_process_t* p = (kk_os_process_t*)kk_zalloc(kk_ssizeof(kk_os_process_t), ctx);
+  if (p == NULL) { kk_string_drop(cmd, ctx); return ENOMEM; }
+  p->fds[0] = p->fds[1] = p->fds[2] = -1;
+  SECURITY_ATTRIBUTES sa = { sizeof(SECURITY_ATTRIBUTES), NULL, TRUE };
+  HANDLE child[3] = { GetStdHandle(STD_INPUT_HANDLE), GetStdHandle(STD_OUTPUT_HANDLE), GetStdHandle(STD_ERROR_HANDLE) };
+  bool owned[3] = { false, false, false };
+  int err = 0;
+  for (int i = 0; i < 3 && err == 0; i++) {
+    if ((pipes & (1 << i)) == 0) continue;
+    HANDLE rd, wr;
+    if (!CreatePipe(&rd, &wr, &sa, 0)) { err = EMFILE; break; }
+    HANDLE parent = (i == 0 ? wr : rd);
+    child[i] = (i == 0 ? rd : wr);
+    owned[i] = true;
+    SetHandleInformation(parent, HANDLE_FLAG_INHERIT, 0);
+    p->fds[i] = _open_osfhandle((intptr_t)parent, (i == 0 ? _O_WRONLY : _O_RDONLY) | _O_BINARY);
+  }
+  if (err == 0) {
+    kk_with_string_as_qutf16_borrow(cmd, wcmd, ctx) {
+      const size_t n = wcslen(wcmd);
+      wchar_t* cmdline = (wchar_t*)kk_malloc((kk_ssize_t)((n + 16) * sizeof(wchar_t)), ctx);
+      if (cmdline == NULL) { err = ENOMEM; }
+      else {
+        wcscpy(cmdline, L"cmd.exe /c ");
+        wcscat(cmdline, wcmd);
+        STARTUPINFOW si = { 0 };
+        si.cb = sizeof(si);
+        si.dwFlags = STARTF_USESTDHANDLES;
+        si.hStdInput = child[0];
+        si.hStdOutput = child[1];
+        si.hStdError = child[2];
+        PROCESS_INFORMATION pi = { 0 };
+        if (!CreateProcessW(NULL, cmdline, NULL, NULL, TRUE, 0, NULL, NULL, &si, &pi)) {
+          err = (GetLastError() == ERROR_FILE_NOT_FOUND ? ENOENT : EINVAL);
+        }
+        else {
+          CloseHandle(pi.hThread);
+          p->handle = pi.hProcess;
+        }
+        kk_free(cmdline);
+      }
+    }
+  }
+  kk_string_drop(cmd, ctx);
+  for (int i = 0; i < 3; i++) {
+    if (owned[i]) CloseHandle(child[i]);
+  }
+  if (err != 0) {
+    for (int i = 0; i < 3; i++) { kk_os_process_close_fd(p, i); }
+    kk_free(p);
+    return err;
+  }
+  p->next = 1;
+  *proc = p;
+  return 0;
+}
 #else
-  pclose(f);
+kk_decl_export int kk_os_process_spawn(kk_string_t cmd, int pipes, kk_os_process_t** proc, kk_context_t* ctx) {
+  *proc = NULL;
+  kk_os_process_t* p = (kk_os_process_t*)kk_zalloc(kk_ssizeof(kk_os_process_t), ctx);
+  if (p == NULL) { kk_string_drop(cmd, ctx); return ENOMEM; }
+  p->fds[0] = p->fds[1] = p->fds[2] = -1;
+  int child[3] = { -1, -1, -1 };
+  posix_spawn_file_actions_t actions;
+  int err = posix_spawn_file_actions_init(&actions);
+  for (int i = 0; i < 3 && err == 0; i++) {
+    if ((pipes & (1 << i)) == 0) continue;
+    int fd[2];
+    // close-on-exec so other children (spawned by other threads) do not inherit our ends;
+    // `dup2` clears the flag on the child end
+    #if KK_OS_HAS_PIPE2
+    if (pipe2(fd, O_CLOEXEC) != 0) { err = errno; break; }
+    #else
+    if (pipe(fd) != 0) { err = errno; break; }  // not atomic: a concurrent spawn may still inherit
+    fcntl(fd[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fd[1], F_SETFD, FD_CLOEXEC);
+    #endif
+    p->fds[i] = (i == 0 ? fd[1] : fd[0]);
+    child[i]  = (i == 0 ? fd[0] : fd[1]);
+    #if defined(F_SETNOSIGPIPE)
+    if (i == 0) fcntl(p->fds[0], F_SETNOSIGPIPE, 1);
+    #endif
+    err = posix_spawn_file_actions_adddup2(&actions, child[i], i);
+  }
+  if (err == 0) {
+    kk_with_string_as_qutf8_borrow(cmd, ccmd, ctx) {
+      char* argv[4] = { (char*)"sh", (char*)"-c", (char*)ccmd, NULL };
+      err = posix_spawn(&p->pid, "/bin/sh", &actions, NULL, argv, environ);
+    }
+  }
+  posix_spawn_file_actions_destroy(&actions);
+  kk_string_drop(cmd, ctx);
+  for (int i = 0; i < 3; i++) {
+    if (child[i] >= 0) close(child[i]);
+  }
+  if (err != 0) {
+    for (int i = 0; i < 3; i++) { kk_os_process_close_fd(p, i); }
+    kk_free(p);
+    return err;
+  }
+  p->next = 1;
+  *proc = p;
+  return 0;
+}
 #endif
-  *output = out;
-  return errno;
+
+// Write to the standard input of the child; returns `EPIPE` if the child closed it.
+kk_decl_export int kk_os_process_write(kk_os_process_t* p, kk_string_t data, kk_context_t* ctx) {
+  int err = 0;
+  if (p->fds[0] < 0) {
+    err = EBADF;
+  }
+  else {
+    kk_ssize_t len;
+    const uint8_t* buf = kk_string_buf_borrow(data, &len);
+    kk_ssize_t nwritten = 0;
+    #if defined(__linux__)
+    // block SIGPIPE (for this thread) so a closed pipe is reported as `EPIPE`
+    sigset_t sigpipe, old;
+    sigemptyset(&sigpipe);
+    sigaddset(&sigpipe, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &sigpipe, &old);
+    err = kk_posix_write_retry(p->fds[0], buf, len, &nwritten);
+    if (err == EPIPE) {
+      const struct timespec zero = { 0, 0 };
+      sigtimedwait(&sigpipe, NULL, &zero);  // consume the pending signal
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    #else
+    err = kk_posix_write_retry(p->fds[0], buf, len, &nwritten);
+    #endif
+    if (err == 0 && nwritten < len) err = EIO;
+  }
+  kk_string_drop(data, ctx);
+  return err;
+}
+
+// Close the standard input of the child (so it sees the end of its input).
+kk_decl_export int kk_os_process_close_input(kk_os_process_t* p) {
+  if (p->fds[0] < 0) return 0;
+  const int err = kk_posix_close(p->fds[0]);
+  p->fds[0] = -1;
+  return err;
+}
+
+// Wait until stdout (`*from == 1`) or stderr (`*from == 2`) has output and read at most `max` bytes of it;
+// `*nread == 0` if that pipe was closed. Returns with `*from == 0` if both pipes are closed.
+static int kk_os_process_read_raw(kk_os_process_t* p, uint8_t* buf, kk_ssize_t max, int* from, kk_ssize_t* nread) {
+  *from = 0;
+  *nread = 0;
+  while (p->fds[1] >= 0 || p->fds[2] >= 0) {
+    int ready = 0;
+    if (p->fds[1] < 0 || p->fds[2] < 0) {
+      ready = (p->fds[1] >= 0 ? 1 : 2);  // just block on the read
+    }
+    else {
+      #if defined(WIN32)
+      // anonymous pipes cannot be waited on; peek for available output instead
+      for (int k = 0; k < 2 && ready == 0; k++) {
+        const int i = (k == 0 ? p->next : 3 - p->next);
+        DWORD avail = 0;
+        if (!PeekNamedPipe((HANDLE)_get_osfhandle(p->fds[i]), NULL, 0, NULL, &avail, NULL) || avail > 0) ready = i;
+      }
+      if (ready == 0) { Sleep(1); continue; }
+      #else
+      struct pollfd pfds[2] = { { p->fds[1], POLLIN, 0 }, { p->fds[2], POLLIN, 0 } };
+      if (poll(pfds, 2, -1) < 0) {
+        if (errno == EINTR || errno == EAGAIN) continue;
+        return errno;
+      }
+      const bool ready1 = (pfds[0].revents != 0);
+      const bool ready2 = (pfds[1].revents != 0);
+      if (ready1 && ready2) ready = p->next;
+      else if (ready1) ready = 1;
+      else if (ready2) ready = 2;
+      else continue;
+      #endif
+      p->next = 3 - ready;
+    }
+    #if defined(WIN32)
+    const kk_ssize_t todo = (max > INT32_MAX ? INT32_MAX : max);
+    const kk_ssize_t n = _read(p->fds[ready], buf, (unsigned)todo);
+    #else
+    const kk_ssize_t n = read(p->fds[ready], buf, (size_t)max);
+    #endif
+    if (n < 0) {
+      if (errno == EINTR || errno == EAGAIN) continue;
+      #if defined(WIN32)
+      if (errno == EPIPE) { kk_os_process_close_fd(p, ready); *from = ready; return 0; }  // broken pipe is the end of the output
+      #endif
+      return errno;
+    }
+    if (n == 0) kk_os_process_close_fd(p, ready);
+    *from = ready;
+    *nread = n;
+    return 0;
+  }
+  return 0;
+}
+
+// Read a chunk of at most `max` bytes (but at least 4) of output from either stdout (`*from == 1`)
+// or stderr (`*from == 2`) as it becomes available. A chunk always ends at a code point boundary.
+// Returns with `*from == 0` and an empty chunk once both pipes are closed.
+kk_decl_export int kk_os_process_read(kk_os_process_t* p, kk_ssize_t max, int* from, kk_string_t* chunk, kk_context_t* ctx) {
+  *chunk = kk_string_empty();
+  *from = 0;
+  if (max < 4) max = 4;
+  while (true) {
+    uint8_t* buf;
+    kk_bytes_t b = kk_bytes_alloc_buf(max + 4, &buf, ctx);
+    int src;
+    kk_ssize_t n;
+    const kk_ssize_t plenmax = (p->pending_len[1] > p->pending_len[2] ? p->pending_len[1] : p->pending_len[2]);
+    const int err = kk_os_process_read_raw(p, buf + 4, max - plenmax, &src, &n);
+    if (err != 0 || src == 0) {
+      kk_bytes_drop(b, ctx);
+      return err;
+    }
+    // prepend the incomplete sequence of the previous chunk
+    const kk_ssize_t plen = p->pending_len[src];
+    uint8_t* start = buf + 4 - plen;
+    kk_memcpy(start, p->pending[src], plen);
+    kk_ssize_t len = plen + n;
+    p->pending_len[src] = 0;
+    if (n > 0) {
+      // keep an incomplete utf-8 sequence at the end for the next read
+      kk_ssize_t i = len;
+      while (i > 0 && len - i < 4 && (start[i-1] & 0xC0) == 0x80) { i--; }
+      if (i > 0 && start[i-1] >= 0xC0) {
+        const uint8_t c = start[i-1];
+        const kk_ssize_t count = (c >= 0xF0 ? 4 : (c >= 0xE0 ? 3 : 2));
+        const kk_ssize_t extra = len - (i - 1);
+        if (extra < count) {
+          kk_memcpy(p->pending[src], start + len - extra, extra);
+          p->pending_len[src] = extra;
+          len -= extra;
+        }
+      }
+    }
+    if (len == 0) {
+      kk_bytes_drop(b, ctx);
+      continue;
+    }
+    if (start != buf) memmove(buf, start, (size_t)len);
+    b = kk_bytes_adjust_length(b, len, ctx);
+    *from = src;
+    *chunk = kk_string_convert_from_qutf8(b, ctx);
+    return 0;
+  }
+}
+
+// Wait for the child to exit and return its exit code (or `128 + signal` if it was terminated by a signal).
+// This closes our ends of the pipes first so read all output before waiting.
+kk_decl_export int kk_os_process_wait(kk_os_process_t* p, int* exitcode) {
+  for (int i = 0; i < 3; i++) { kk_os_process_close_fd(p, i); }
+  if (!p->waited) {
+    #if defined(WIN32)
+    WaitForSingleObject(p->handle, INFINITE);
+    DWORD code = 0;
+    GetExitCodeProcess(p->handle, &code);
+    CloseHandle(p->handle);
+    p->exitcode = (int)code;
+    #else
+    int status = 0;
+    while (waitpid(p->pid, &status, 0) < 0) {
+      if (errno != EINTR) return errno;
+    }
+    p->exitcode = (WIFEXITED(status) ? WEXITSTATUS(status) : (WIFSIGNALED(status) ? 128 + WTERMSIG(status) : 255));
+    #endif
+    p->waited = true;
+  }
+  *exitcode = p->exitcode;
+  return 0;
+}
+
+// Close the pipes and free the process; a child that is still running is not waited for.
+kk_decl_export void kk_os_process_free(void* vp, kk_block_t* b) {
+  KK_UNUSED(b);
+  kk_os_process_t* p = (kk_os_process_t*)vp;
+  if (p == NULL) return;
+  for (int i = 0; i < 3; i++) { kk_os_process_close_fd(p, i); }
+  if (!p->waited) {
+    #if defined(WIN32)
+    CloseHandle(p->handle);
+    #else
+    waitpid(p->pid, NULL, WNOHANG);  // reap if it already exited
+    #endif
+  }
+  kk_free(p);
+}
+
+
+/*--------------------------------------------------------------------------------------------------
+  Run system command
+--------------------------------------------------------------------------------------------------*/
+
+kk_decl_export int kk_os_run_command(kk_string_t cmd, kk_string_t* output, kk_context_t* ctx) {
+  *output = kk_string_empty();
+  kk_stdout_flush(ctx);  // the command shares our stdout
+  kk_os_process_t* p;
+  int err = kk_os_process_spawn(cmd, KK_OS_PROCESS_STDOUT, &p, ctx);
+  if (err != 0) return err;
+  // read all bytes first and convert at once (so no sequence is split between reads)
+  kk_string_builder_t out = kk_string_builder_empty();
+  uint8_t buf[4096];
+  while (true) {
+    int from;
+    kk_ssize_t n;
+    err = kk_os_process_read_raw(p, buf, kk_ssizeof(buf), &from, &n);
+    if (err != 0 || from == 0) break;
+    kk_string_builder_append_buf(&out, n, buf, ctx);
+  }
+  int exitcode;
+  const int werr = kk_os_process_wait(p, &exitcode);
+  if (err == 0) err = werr;
+  kk_os_process_free(p, NULL);
+  *output = kk_string_convert_from_qutf8(out.buf, ctx);
+  return err;
 }
 
 kk_decl_export int kk_os_run_system(kk_string_t cmd, kk_context_t* ctx) {
   int exitcode = 0;
+  kk_stdout_flush(ctx);  // the command shares our stdout
   #if defined(WIN32)
   kk_with_string_as_qutf16_borrow(cmd, wcmd, ctx) {
     exitcode = _wsystem(wcmd);
@@ -957,7 +1997,7 @@ kk_string_t kk_os_app_path(kk_context_t* ctx) {
 
 kk_string_t kk_os_app_path(kk_context_t* ctx) {
   kk_string_t s = kk_os_realpath(kk_string_alloc_dup_valid_utf8(KK_PROC_SELF,ctx),ctx);
-  if (strcmp(kk_string_cbuf_borrow(s,NULL), KK_PROC_SELF)==0) {
+  if (kk_string_cmp_cstr_borrow(s, KK_PROC_SELF)==0) {
     // failed? try generic search
     kk_string_drop(s, ctx);
     return kk_os_app_path_generic(ctx);
@@ -168,3 +168,178 @@ static kk_process_info(kk_msecs_t* utime, kk_msecs_t* stime, size_t* peak_rss, s
   *stime = 0;
 }
 #endif
+
+
+// --------------------------------------------------------
+// Hardware performance counters (`--kkperf`)
+// On Linux these are counted with `perf_event_open` for the whole 
+// process (including threads created later); on other platforms, or
+// if the kernel does not allow it, only the `rusage` counters are reported.
+// --------------------------------------------------------
+
+static bool        perf_enabled;   // = false
+static const char* perf_fname;     // if not NULL, write the JSON output to this file
+
+static const char* kk_perf_event_names[KK_PERF_EVENT_COUNT] = {
+  "cycles", "instructions", "cache_misses", "branch_misses", "dtlb_misses"
+};
+
+const char* kk_perf_event_name(kk_perf_event_t ev) {
+  return ((int)ev >= 0 && (int)ev < KK_PERF_EVENT_COUNT ? kk_perf_event_names[ev] : "unknown");
+}
+
+#if defined(__linux__)
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+static int perf_fds[KK_PERF_EVENT_COUNT] = { -1, -1, -1, -1, -1 };
+
+static int kk_perf_event_open(uint32_t type, uint64_t config) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.inherit = 1;          // count threads that are created later as well
+  attr.exclude_kernel = 1;   // allowed with perf_event_paranoid <= 2
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return (int)syscall(__NR_perf_event_open, &attr, 0 /* this process */, -1 /* any cpu */, -1 /* no group */, 0);
+}
+
+bool kk_perf_start(void) {
+  static const uint32_t types[KK_PERF_EVENT_COUNT] = {
+    PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE
+  };
+  static const uint64_t configs[KK_PERF_EVENT_COUNT] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES,
+    PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+  };
+  bool any = false;
+  for (int i = 0; i < KK_PERF_EVENT_COUNT; i++) {
+    if (perf_fds[i] < 0) perf_fds[i] = kk_perf_event_open(types[i], configs[i]);
+    if (perf_fds[i] >= 0) any = true;
+  }
+  return any;
+}
+
+static void kk_perf_read_events(kk_perf_counters_t* counters) {
+  for (int i = 0; i < KK_PERF_EVENT_COUNT; i++) {
+    counters->events[i] = -1;
+    if (perf_fds[i] < 0) continue;
+    uint64_t values[3];   // value, time enabled, time running
+    if (read(perf_fds[i], values, sizeof(values)) != (ssize_t)sizeof(values)) continue;
+    if (values[2] == 0) continue;  // never scheduled
+    double v = (double)values[0];
+    if (values[2] < values[1]) v = v * ((double)values[1] / (double)values[2]);  // scale if the counters were multiplexed
+    counters->events[i] = (int64_t)v;
+  }
+}
+
+#else
+
+bool kk_perf_start(void) {
+  return false;
+}
+
+static void kk_perf_read_events(kk_perf_counters_t* counters) {
+  for (int i = 0; i < KK_PERF_EVENT_COUNT; i++) {
+    counters->events[i] = -1;
+  }
+}
+#endif
+
+#if !defined(WIN32) && (defined(__unix__) || defined(__unix) || defined(unix) || (defined(__APPLE__) && defined(__MACH__)))
+static void kk_perf_read_switches(kk_perf_counters_t* counters) {
+  struct rusage rusage;
+  getrusage(RUSAGE_SELF, &rusage);
+  counters->vol_switches = rusage.ru_nvcsw;
+  counters->invol_switches = rusage.ru_nivcsw;
+}
+#else
+static void kk_perf_read_switches(kk_perf_counters_t* counters) {
+  counters->vol_switches = -1;
+  counters->invol_switches = -1;
+}
+#endif
+
+void kk_perf_read(kk_perf_counters_t* counters) {
+  kk_perf_read_events(counters);
+  kk_perf_read_switches(counters);
+  kk_msecs_t utime;
+  kk_msecs_t stime;
+  size_t peak_rss;
+  size_t page_faults;
+  size_t page_reclaim;
+  size_t peak_commit;
+  kk_process_info(&utime, &stime, &peak_rss, &page_faults, &page_reclaim, &peak_commit);
+  counters->page_faults = (int64_t)page_faults;
+  counters->page_reclaims = (int64_t)page_reclaim;
+  counters->peak_commit = (int64_t)peak_commit;
+}
+
+// Enable the performance counters (with an optional file name for the JSON output)
+void kk_perf_enable(const char* fname) {
+  perf_enabled = true;
+  perf_fname = fname;
+  if (!kk_perf_start()) {
+    kk_warning_message("--kkperf: hardware performance counters are not available (only reporting faults and context switches)\n");
+  }
+}
+
+bool kk_perf_is_enabled(void) {
+  return perf_enabled;
+}
+
+static void kk_perf_print_text(FILE* out, const kk_perf_counters_t* c) {
+  fprintf(out, "perf:");
+  const char* sep = " ";
+  for (int i = 0; i < KK_PERF_EVENT_COUNT; i++) {
+    if (c->events[i] < 0) continue;
+    fprintf(out, "%s%s: %lld", sep, kk_perf_event_names[i], (long long)c->events[i]);
+    sep = ", ";
+  }
+  const int64_t cycles = c->events[KK_PERF_CYCLES];
+  const int64_t instrs = c->events[KK_PERF_INSTRUCTIONS];
+  if (cycles > 0 && instrs >= 0) {
+    fprintf(out, " (ipc %.2f)", (double)instrs / (double)cycles);
+  }
+  if (cycles < 0 && instrs < 0) {
+    fprintf(out, " no hardware counters");
+  }
+  fprintf(out, "\nperf: page faults: %lld, page reclaims: %lld, peak commit: %lld, context switches: %lld voluntary, %lld involuntary\n",
+          (long long)c->page_faults, (long long)c->page_reclaims, (long long)c->peak_commit,
+          (long long)c->vol_switches, (long long)c->invol_switches);
+}
+
+static void kk_perf_print_json(FILE* out, const kk_perf_counters_t* c, kk_usecs_t wall_time) {
+  fprintf(out, "{\"elapsed_us\":%lld", (long long)wall_time);
+  for (int i = 0; i < KK_PERF_EVENT_COUNT; i++) {
+    if (c->events[i] < 0) fprintf(out, ",\"%s\":null", kk_perf_event_names[i]);
+                     else fprintf(out, ",\"%s\":%lld", kk_perf_event_names[i], (long long)c->events[i]);
+  }
+  fprintf(out, ",\"page_faults\":%lld,\"page_reclaims\":%lld,\"peak_commit\":%lld,\"vol_switches\":%lld,\"invol_switches\":%lld}\n",
+          (long long)c->page_faults, (long long)c->page_reclaims, (long long)c->peak_commit,
+          (long long)c->vol_switches, (long long)c->invol_switches);
+}
+
+// Print the counters for the whole run (called from `kk_main_end`)
+void kk_perf_done(kk_usecs_t wall_time) {
+  if (!perf_enabled) return;
+  kk_perf_counters_t counters;
+  kk_perf_read(&counters);
+  kk_perf_print_text(stderr, &counters);
+  FILE* out = stderr;
+  if (perf_fname != NULL) {
+    out = fopen(perf_fname, "w");
+    if (out == NULL) {
+      fprintf(stderr, "warning: unable to write performance counters to: %s\n", perf_fname);
+      return;
+    }
+  }
+  kk_perf_print_json(out, &counters, wall_time);
+  if (out != stderr) fclose(out);
+}
@@ -15,12 +15,6 @@
   Deterministic pseudo random number generation. Fast but not secure.
 ----------------------------------------------------------- */
 
-// pseudo random number context (using pcg)
-typedef struct kk_pcg_ctx_s {
-  uint64_t state;
-  uint64_t stream; // must be odd
-} kk_pcg_ctx_t;
-
 // Pseudo random number using PCG by Melissa E. O'Neill.
 // It combines a linear congruential generator (CG) with an output permutation
 // function (P) and has good statictical properties (and passes PractRand and Big-crush[2]).
@@ -45,15 +39,18 @@ static void pcg_init(uint64_t init, uint64_t stream, kk_pcg_ctx_t* rnd) {
   for (int i = 0; i < 8; i++) { pcg_uint32(rnd); }
 }
 
+void kk_pcg_init(uint64_t seed, uint64_t stream, kk_pcg_ctx_t* rnd) {
+  pcg_init(seed, stream, rnd);
+}
 
-/*
-// pseudo random number context (using sfc32)
-typedef struct kk_sfc_ctx_s {
-  uint32_t a;
-  uint32_t b;
-  uint32_t c;
-  uint32_t counter;
-} kk_sfc_ctx_t;
+// Bulk generation keeps the state in registers
+void kk_pcg_fill(kk_pcg_ctx_t* rnd, uint32_t* buf, kk_ssize_t n) {
+  kk_pcg_ctx_t pcg = *rnd;
+  for (kk_ssize_t i = 0; i < n; i++) {
+    buf[i] = pcg_uint32(&pcg);
+  }
+  *rnd = pcg;
+}
 
 // Pseudo random number using sfc32 by Chris Doty-Humphrey.
 // It is a "chaotic" pseudo random generator that uses 32-bit operations only
@@ -82,7 +79,18 @@ static void sfc_init(uint64_t seed, kk_sfc_ctx_t* rnd) {
     sfc_uint32(rnd);
   }
 }
-*/
+
+void kk_sfc_init(uint64_t seed, kk_sfc_ctx_t* rnd) {
+  sfc_init(seed, rnd);
+}
+
+void kk_sfc_fill(kk_sfc_ctx_t* rnd, uint32_t* buf, kk_ssize_t n) {
+  kk_sfc_ctx_t sfc = *rnd;
+  for (kk_ssize_t i = 0; i < n; i++) {
+    buf[i] = sfc_uint32(&sfc);
+  }
+  *rnd = sfc;
+}
 
 
 /* ----------------------------------------------------------------------------
@@ -163,12 +171,76 @@ static kk_decl_noinline void chacha8(kk_random_ctx_t* rnd) {
 }
 */
 
+/* ----------------------------------------------------------------------------
+Four consecutive blocks at once for bulk generation. With SSE2 we keep each of
+the sixteen state words of the four blocks in one vector register (one block
+per lane). The output is identical to four calls to `kk_chacha_block`.
+-----------------------------------------------------------------------------*/
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+
+#define kk_rotl_sse2(x,n)  _mm_or_si128(_mm_slli_epi32(x,n), _mm_srli_epi32(x,32-(n)))
+#define kk_rotl16_sse2(x)  _mm_shufflehi_epi16(_mm_shufflelo_epi16(x,0xB1),0xB1)
+
+#define kk_qround_sse2(x,a,b,c,d) \
+  x[a] = _mm_add_epi32(x[a],x[b]); x[d] = kk_rotl16_sse2(_mm_xor_si128(x[d],x[a])); \
+  x[c] = _mm_add_epi32(x[c],x[d]); x[b] = kk_rotl_sse2(_mm_xor_si128(x[b],x[c]),12); \
+  x[a] = _mm_add_epi32(x[a],x[b]); x[d] = kk_rotl_sse2(_mm_xor_si128(x[d],x[a]),8); \
+  x[c] = _mm_add_epi32(x[c],x[d]); x[b] = kk_rotl_sse2(_mm_xor_si128(x[b],x[c]),7);
+
+static void kk_chacha_block4(const size_t rounds, uint32_t* input, uint32_t* output) {
+  kk_assert_internal(input[12] <= UINT32_MAX - 4);
+  __m128i in[16];
+  __m128i x[16];
+  for (size_t i = 0; i < 16; i++) {
+    in[i] = _mm_set1_epi32((int)input[i]);
+  }
+  in[12] = _mm_add_epi32(in[12], _mm_set_epi32(3, 2, 1, 0));  // the counter of each block
+  for (size_t i = 0; i < 16; i++) {
+    x[i] = in[i];
+  }
+  for (size_t i = 0; i < rounds; i += 2) {
+    kk_qround_sse2(x, 0, 4, 8, 12);
+    kk_qround_sse2(x, 1, 5, 9, 13);
+    kk_qround_sse2(x, 2, 6, 10, 14);
+    kk_qround_sse2(x, 3, 7, 11, 15);
+    kk_qround_sse2(x, 0, 5, 10, 15);
+    kk_qround_sse2(x, 1, 6, 11, 12);
+    kk_qround_sse2(x, 2, 7, 8, 13);
+    kk_qround_sse2(x, 3, 4, 9, 14);
+  }
+  // add the input and transpose 4x4 words at a time into the four output blocks
+  for (size_t j = 0; j < 16; j += 4) {
+    const __m128i x0 = _mm_add_epi32(x[j], in[j]);
+    const __m128i x1 = _mm_add_epi32(x[j+1], in[j+1]);
+    const __m128i x2 = _mm_add_epi32(x[j+2], in[j+2]);
+    const __m128i x3 = _mm_add_epi32(x[j+3], in[j+3]);
+    const __m128i t0 = _mm_unpacklo_epi32(x0, x1);
+    const __m128i t1 = _mm_unpacklo_epi32(x2, x3);
+    const __m128i t2 = _mm_unpackhi_epi32(x0, x1);
+    const __m128i t3 = _mm_unpackhi_epi32(x2, x3);
+    _mm_storeu_si128((__m128i*)(output + j),      _mm_unpacklo_epi64(t0, t1));
+    _mm_storeu_si128((__m128i*)(output + 16 + j), _mm_unpackhi_epi64(t0, t1));
+    _mm_storeu_si128((__m128i*)(output + 32 + j), _mm_unpacklo_epi64(t2, t3));
+    _mm_storeu_si128((__m128i*)(output + 48 + j), _mm_unpackhi_epi64(t2, t3));
+  }
+  input[12] += 4;
+}
+#else
+static void kk_chacha_block4(const size_t rounds, uint32_t* input, uint32_t* output) {
+  for (size_t i = 0; i < 4; i++) {
+    kk_chacha_block(rounds, input, output + 16*i);
+  }
+}
+#endif
+
 static inline uint32_t kk_read32(const uint8_t* p, size_t idx32) {
   const size_t i = 4*idx32;
   return ((uint32_t)p[i+0] | (uint32_t)p[i+1] << 8 | (uint32_t)p[i+2] << 16 | (uint32_t)p[i+3] << 24);
 }
 
-static void kk_chacha_init(kk_random_ctx_t* rnd, const uint8_t key[32], uint64_t nonce)
+void kk_chacha_init(kk_random_ctx_t* rnd, const uint8_t key[32], uint64_t nonce)
 {
   // read the 32-bit values as little-endian
   memset(rnd, 0, sizeof(*rnd));
@@ -186,21 +258,8 @@ static void kk_chacha_init(kk_random_ctx_t* rnd, const uint8_t key[32], uint64_t
   rnd->used = 128;
 }
 
-/*
-static void kk_chacha_split(kk_random_ctx_t* rnd, uint64_t nonce, kk_random_ctx_t* ctx_new) {
-  memset(ctx_new, 0, sizeof(*ctx_new));
-  memcpy(ctx_new->input, rnd->input, sizeof(ctx_new->input));
-  ctx_new->input[12] = 0;
-  ctx_new->input[13] = 0;
-  ctx_new->input[14] = (uint32_t)nonce;
-  ctx_new->input[15] = (uint32_t)(nonce >> 32);
-  kk_assert_internal(rnd->input[14] != ctx_new->input[14] || rnd->input[15] != ctx_new->input[15]); // do not reuse nonces!
-  chacha20(ctx_new);
-}
-*/
-
 /* ----------------------------------------------------------------------------
-Secure random: split
+Secure random: bulk generation and split
 -----------------------------------------------------------------------------*/
 #if !defined(NDEBUG) && defined(KK_DEBUG_FULL)
 static bool kk_random_is_initialized(kk_random_ctx_t* rnd) {
@@ -208,13 +267,41 @@ static bool kk_random_is_initialized(kk_random_ctx_t* rnd) {
 }
 #endif
 
-/*
-static void kk_random_split(kk_random_ctx_t* rnd, kk_random_ctx_t* ctx_new) {
-  kk_assert_internal(random_is_initialized(rnd));
-  kk_assert_internal(rnd != ctx_new);
-  kk_chacha_split(rnd, (uintptr_t)ctx_new, ctx_new); // nonce = ctx_new
+// Fill `buf` with `len` random bytes from the chacha20 stream of `rnd`.
+// Whole blocks are generated four at a time; the current output of `rnd` is not used.
+void kk_chacha_fill(kk_random_ctx_t* rnd, void* buf, kk_ssize_t len) {
+  uint8_t* p = (uint8_t*)buf;
+  uint32_t out[64];
+  while (len >= kk_ssizeof(out) && rnd->input[12] <= UINT32_MAX - 4) {
+    kk_chacha_block4(20, rnd->input, out);
+    memcpy(p, out, sizeof(out));
+    p += sizeof(out);
+    len -= kk_ssizeof(out);
+  }
+  while (len > 0) {
+    kk_chacha_block(20, rnd->input, out);
+    const size_t n = (len < 64 ? (size_t)len : 64);
+    memcpy(p, out, n);
+    p += n;
+    len -= (kk_ssize_t)n;
+  }
+  memset(out, 0, sizeof(out));  // clear after use
 }
-*/
+
+// Initialize `child` as an independent generator with a key and nonce taken from the stream of `rnd`.
+// This is deterministic: the same `rnd` state always gives the same sequence of children.
+void kk_chacha_split(kk_random_ctx_t* rnd, kk_random_ctx_t* child) {
+  kk_assert_internal(kk_random_is_initialized(rnd));
+  kk_assert_internal(rnd != child);
+  uint8_t seed[40];
+  kk_chacha_fill(rnd, seed, kk_ssizeof(seed));
+  const bool strong = rnd->is_strong;
+  kk_chacha_init(child, seed, (uint64_t)kk_read32(seed, 8) | ((uint64_t)kk_read32(seed, 9) << 32));
+  child->is_strong = strong;
+  memset(seed, 0, sizeof(seed));
+}
+
+
 
 
 /*--------------------------------------------------------------------------------------
@@ -405,16 +492,42 @@ static kk_random_ctx_t* random_init(kk_context_t* ctx) {
   return rnd;
 }
 
-kk_random_ctx_t* kk_srandom_round(kk_context_t* ctx) {
-  // initialize on demand
+// initialize on demand
+static kk_random_ctx_t* kk_srandom_get(kk_context_t* ctx) {
   kk_random_ctx_t* rnd = ctx->srandom_ctx;
   if (rnd == NULL) {
     ctx->srandom_ctx = rnd = random_init(ctx);
   }
+  return rnd;
+}
+
+kk_random_ctx_t* kk_srandom_round(kk_context_t* ctx) {
+  kk_random_ctx_t* rnd = kk_srandom_get(ctx);
   kk_chacha20(rnd);
   return rnd;
 }
 
+void kk_srandom_fill(void* buf, kk_ssize_t len, kk_context_t* ctx) {
+  kk_chacha_fill(kk_srandom_get(ctx), buf, len);
+}
+
+// Doubles in the range [0,1) using 52 random bits each (as `kk_srandom_double`)
+void kk_srandom_fill_double(double* buf, kk_ssize_t n, kk_context_t* ctx) {
+  kk_srandom_fill(buf, n*kk_ssizeof(double), ctx);
+  for (kk_ssize_t i = 0; i < n; i++) {
+    uint64_t x;
+    memcpy(&x, &buf[i], sizeof(x));
+    x = KU64(0x3FF0000000000000) | kk_shr64(x, 12);
+    double d;
+    memcpy(&d, &x, sizeof(double));
+    buf[i] = d - 1.0;
+  }
+}
+
+void kk_srandom_split(kk_random_ctx_t* child, kk_context_t* ctx) {
+  kk_chacha_split(kk_srandom_get(ctx), child);
+}
+
 bool kk_srandom_is_strong(kk_context_t* ctx) {
   kk_random_ctx_t* rnd = ctx->srandom_ctx;
   if (rnd == NULL) {
@@ -7,45 +7,257 @@
 ---------------------------------------------------------------------------*/
 #include "kklib.h"
 
+/*--------------------------------------------------------------------------------------
+  Epoch based reclamation for thread-shared references.
+  We cannot first read and then dup the value of a reference as it may be overwritten
+  and _dropped_ by another thread in between. Instead, a reader announces the global
+  epoch in its own slot while it reads and dups the value, and a writer does not drop
+  a value it replaced directly but _retires_ a reference to it. Retired values are
+  dropped once the global epoch advanced twice, which is only possible after every
+  reader that could still see the old value has left its (short) read section.
+  Readers thus never write to the reference itself and do not contend with each other.
+--------------------------------------------------------------------------------------*/
 
-// Atomic path for mutable references
-kk_decl_export kk_box_t kk_ref_get_thread_shared(kk_ref_t r, kk_context_t* ctx) {
-  // careful: we cannot first read and then dup the read value as it may be 
-  // overwritten and _dropped_ by another thread in between. To avoid this
-  // situation we first atomically swap with a guard value 0, then dup, and 
-  // write back the old value again.
-again: ;
-  kk_box_t b; 
-  b.box = kk_atomic_load_relaxed(&r->value);
+#ifndef KK_REF_RETIRE_MAX
+#define KK_REF_RETIRE_MAX  (64)  // retired values per context before we try to advance the epoch
+#endif
+
+typedef struct kk_ref_reader_s {
+  _Atomic(uintptr_t)      epoch;   // announced epoch while reading (or 0 when not reading)
+  _Atomic(uintptr_t)      in_use;  // owned by a context?
+  struct kk_ref_reader_s* next;    // readers are never unlinked (but are reused)
+} kk_ref_reader_t;
+
+typedef struct kk_ref_retired_s {
+  kk_box_t  value;
+  uintptr_t epoch;
+} kk_ref_retired_t;
+
+typedef struct kk_ref_epoch_s {
+  kk_ref_reader_t*  reader;
+  kk_ssize_t        count;
+  kk_ref_retired_t  retired[KK_REF_RETIRE_MAX];
+} kk_ref_epoch_t;
+
+static _Atomic(uintptr_t) kk_ref_global_epoch = ATOMIC_VAR_INIT(1);  // never 0
+static _Atomic(uintptr_t) kk_ref_readers;                            // kk_ref_reader_t*
+
+static kk_ref_reader_t* kk_ref_reader_acquire(void) {
+  // reuse a reader of a context that is done
+  uintptr_t head = kk_atomic_load_acquire(&kk_ref_readers);
+  for (kk_ref_reader_t* rd = (kk_ref_reader_t*)head; rd != NULL; rd = rd->next) {
+    uintptr_t expected = 0;
+    if (kk_atomic_load_relaxed(&rd->in_use) == 0 && kk_atomic_cas_strong_acq_rel(&rd->in_use, &expected, 1)) {
+      return rd;
+    }
+  }
+  // or push a fresh one
+  kk_ref_reader_t* rd = (kk_ref_reader_t*)kk_zalloc(kk_ssizeof(kk_ref_reader_t), NULL);
+  if (rd == NULL) kk_fatal_error(ENOMEM, "unable to allocate a reference reader");
+  kk_atomic_store_relaxed(&rd->in_use, 1);
   do {
-    if (kk_box_is_value(b)) return b;  // optimize: if it is a raw value (that is not heap allocated), we can immediately return
-    if (b.box == 0) { b.box = 1; }     // expect any value but 0
-  } while (!kk_atomic_cas_weak_relaxed(&r->value, &b.box, 0));
-  // we got it, and hold the "locked" reference (`r->value == 0`)
+    rd->next = (kk_ref_reader_t*)head;
+  } while (!kk_atomic_cas_weak_acq_rel(&kk_ref_readers, &head, (uintptr_t)rd));
+  return rd;
+}
+
+static kk_ref_epoch_t* kk_ref_epoch(kk_context_t* ctx) {
+  kk_ref_epoch_t* re = ctx->ref_epoch;
+  if (kk_unlikely(re == NULL)) {
+    re = (kk_ref_epoch_t*)kk_zalloc(kk_ssizeof(kk_ref_epoch_t), ctx);
+    if (re == NULL) kk_fatal_error(ENOMEM, "unable to allocate reference epochs");
+    re->reader = kk_ref_reader_acquire();
+    ctx->ref_epoch = re;
+  }
+  return re;
+}
+
+// Advance the global epoch if all active readers announced the current one; returns the global epoch.
+static uintptr_t kk_ref_epoch_try_advance(void) {
+  kk_atomic_fence_seq_cst();
+  uintptr_t epoch = kk_atomic_load_relaxed(&kk_ref_global_epoch);
+  for (kk_ref_reader_t* rd = (kk_ref_reader_t*)kk_atomic_load_acquire(&kk_ref_readers); rd != NULL; rd = rd->next) {
+    const uintptr_t e = kk_atomic_load_acquire(&rd->epoch);
+    if (e != 0 && e != epoch) return epoch;  // still reading in an older epoch
+  }
+  if (kk_atomic_cas_strong_acq_rel(&kk_ref_global_epoch, &epoch, epoch + 1)) {
+    epoch++;
+  }
+  return epoch;
+}
+
+// Drop all retired values that can no longer be seen by any reader.
+static void kk_ref_epoch_collect(kk_ref_epoch_t* re, kk_context_t* ctx) {
+  const uintptr_t epoch = kk_ref_epoch_try_advance();
+  kk_ssize_t n = 0;
+  for (kk_ssize_t i = 0; i < re->count; i++) {
+    if (re->retired[i].epoch + 2 <= epoch) {
+      kk_box_drop(re->retired[i].value, ctx);
+    }
+    else {
+      re->retired[n++] = re->retired[i];
+    }
+  }
+  re->count = n;
+}
+
+// Retire a reference to a value that was replaced in a thread-shared reference.
+static void kk_ref_retire(kk_box_t b, kk_context_t* ctx) {
+  if (kk_box_is_value(b)) return;  // not heap allocated
+  kk_ref_epoch_t* re = kk_ref_epoch(ctx);
+  while (kk_unlikely(re->count >= KK_REF_RETIRE_MAX)) {
+    kk_ref_epoch_collect(re, ctx);  // spins only if another thread is in the middle of a read
+  }
+  kk_atomic_fence_seq_cst();
+  re->retired[re->count].value = b;
+  re->retired[re->count].epoch = kk_atomic_load_relaxed(&kk_ref_global_epoch);
+  re->count++;
+}
+
+// Called at safe points (after a thread-shared update, or when a worker is idle) to drop
+// retired values without waiting for `KK_REF_RETIRE_MAX` of them; cheap if there are none.
+kk_decl_export void kk_ref_collect(kk_context_t* ctx) {
+  kk_ref_epoch_t* re = ctx->ref_epoch;
+  if (re != NULL && re->count > 0) {
+    kk_ref_epoch_collect(re, ctx);
+  }
+}
+
+// Read the value of a thread-shared reference (borrowing `r`) and return it dup'd.
+static kk_box_t kk_ref_load_thread_shared(kk_ref_t r, kk_context_t* ctx) {
+  kk_box_t b;
+  b.box = kk_atomic_load_acquire(&r->value);
+  if (kk_box_is_value(b)) return b;  // optimize: if it is a raw value (that is not heap allocated), we can immediately return
+  kk_ref_reader_t* rd = kk_ref_epoch(ctx)->reader;
+  kk_atomic_store_relaxed(&rd->epoch, kk_atomic_load_relaxed(&kk_ref_global_epoch));
+  kk_atomic_fence_seq_cst();
+  b.box = kk_atomic_load_acquire(&r->value);  // reload now that we are protected
   kk_box_dup(b);
-  // and release our lock by writing back `b`    
-  uintptr_t guard = 0;
-  while (!kk_atomic_cas_strong_relaxed(&r->value, &guard, b.box)) { 
-    assert(false); 
-    // should never happen! as a last resort, restart the operation
-    kk_box_drop(b,ctx);
-    goto again;
+  kk_atomic_store_release(&rd->epoch, 0);
+  return b;
+}
+
+// Called when the context is freed: wait until all retired values can be dropped.
+kk_decl_export void kk_ref_context_done(kk_context_t* ctx) {
+  kk_ref_epoch_t* re = ctx->ref_epoch;
+  if (re == NULL) return;
+  while (re->count > 0) {
+    kk_ref_epoch_collect(re, ctx);
   }
+  kk_atomic_store_release(&re->reader->in_use, 0);
+  ctx->ref_epoch = NULL;
+  kk_free(re);
+}
+
+
+/*--------------------------------------------------------------------------------------
+  Atomic path for mutable references
+--------------------------------------------------------------------------------------*/
+
+kk_decl_export kk_box_t kk_ref_get_thread_shared(kk_ref_t r, kk_context_t* ctx) {
+  kk_box_t b = kk_ref_load_thread_shared(r, ctx);
   kk_ref_drop(r, ctx);
   return b;
 }
 
 kk_decl_export kk_box_t kk_ref_swap_thread_shared(kk_ref_t r, kk_box_t value, kk_context_t* ctx) {
-  KK_UNUSED(ctx);
-  // atomically swap, but not if guarded with 0 (to not interfere with a `ref_get`)
-  kk_box_t b; 
+  // the new value becomes visible to other threads so it must be thread shared as well
+  kk_box_mark_shared(value, ctx);
+  kk_box_t b;
   b.box = kk_atomic_load_relaxed(&r->value);
-  //uintptr_t exp = kk_atomic_load_relaxed(&r->value);
-  do {
-    if (b.box==0) { b.box = 1; }  // any value but 0
-  } while (!kk_atomic_cas_weak_relaxed(&r->value, &b.box, value.box));
+  while (!kk_atomic_cas_weak_acq_rel(&r->value, &b.box, value.box)) { };
+  // concurrent readers may still dup the old value, so keep it alive until they are done
+  if (!kk_box_is_value(b)) {
+    kk_box_dup(b);
+    kk_ref_retire(b, ctx);
+  }
   kk_ref_drop(r, ctx);
+  kk_ref_collect(ctx);
   return b;
 }
 
+// Try to replace `expected` (that we own) with `value`; on success `expected` is released.
+static bool kk_ref_cas_thread_shared(kk_ref_t r, kk_box_t expected, kk_box_t value, kk_context_t* ctx) {
+  kk_box_mark_shared(value, ctx);
+  uintptr_t exp = expected.box;
+  if (kk_atomic_cas_strong_acq_rel(&r->value, &exp, value.box)) {
+    // release the reference held by `r` directly (as we still own one), and retire ours
+    kk_box_drop(expected, ctx);
+    kk_ref_retire(expected, ctx);
+    return true;
+  }
+  else {
+    kk_box_drop(value, ctx);
+    kk_box_drop(expected, ctx);
+    return false;
+  }
+}
 
+kk_decl_export kk_unit_t kk_ref_modify_thread_shared(kk_ref_t r, kk_function_t f, kk_context_t* ctx) {
+  while (true) {
+    kk_box_t b = kk_ref_load_thread_shared(r, ctx);
+    kk_box_dup(b);  // keep a reference so the block cannot be reused while we call `f` (avoiding ABA)
+    kk_function_dup(f);
+    kk_box_t x = kk_function_call(kk_box_t, (kk_function_t, kk_box_t, kk_context_t*), f, (f, b, ctx));
+    if (kk_ref_cas_thread_shared(r, b, x, ctx)) break;
+  }
+  kk_function_drop(f, ctx);
+  kk_ref_drop(r, ctx);
+  kk_ref_collect(ctx);
+  return kk_Unit;
+}
+
+kk_decl_export kk_integer_t kk_ref_fetch_add_thread_shared(kk_ref_t r, kk_integer_t delta, kk_context_t* ctx) {
+  kk_box_t b;
+  b.box = kk_atomic_load_relaxed(&r->value);
+  // fast path: add small integers in place
+  while (kk_box_is_value(b) && kk_is_smallint(delta)) {
+    kk_integer_t i = kk_integer_unbox(b);
+    if (!kk_is_smallint(i)) break;
+    const intptr_t sum = kk_smallint_from_integer(i) + kk_smallint_from_integer(delta);
+    if (sum < KK_SMALLINT_MIN || sum > KK_SMALLINT_MAX) break;
+    if (kk_atomic_cas_weak_acq_rel(&r->value, &b.box, kk_integer_box(kk_integer_from_small(sum)).box)) {
+      kk_ref_drop(r, ctx);
+      return i;
+    }
+  }
+  // otherwise compute the sum outside the reference
+  while (true) {
+    b = kk_ref_load_thread_shared(r, ctx);
+    kk_box_dup(b);
+    kk_integer_t i = kk_integer_unbox(b);
+    kk_integer_t x = kk_integer_add(kk_integer_dup(i), kk_integer_dup(delta), ctx);
+    if (kk_ref_cas_thread_shared(r, b, kk_integer_box(x), ctx)) {
+      kk_integer_drop(delta, ctx);
+      kk_ref_drop(r, ctx);
+      kk_ref_collect(ctx);
+      return i;
+    }
+    kk_integer_drop(i, ctx);
+  }
+}
+
+// Elements of a thread-shared vector are read without announcing an epoch, so we never replace
+// an element in place (as a reader may still dup it) but swap in an updated copy of the whole vector.
+kk_decl_export kk_unit_t kk_ref_vector_assign_thread_shared(kk_ref_t r, kk_integer_t idx, kk_box_t value, kk_context_t* ctx) {
+  const kk_ssize_t i = kk_integer_clamp_ssize_t(idx, ctx);
+  while (true) {
+    kk_box_t b = kk_ref_load_thread_shared(r, ctx);
+    kk_ssize_t len;
+    const kk_box_t* src = kk_vector_buf_borrow(kk_vector_unbox(b, ctx), &len);
+    if (i >= len) {  // TODO: return status for out-of-bounds access
+      kk_box_drop(b, ctx);
+      break;
+    }
+    kk_box_t* dest;
+    kk_vector_t w = kk_vector_alloc_uninit(len, &dest, ctx);
+    for (kk_ssize_t j = 0; j < len; j++) {
+      dest[j] = kk_box_dup(j == i ? value : src[j]);
+    }
+    if (kk_ref_cas_thread_shared(r, b, kk_vector_box(w, ctx), ctx)) break;
+  }
+  kk_box_drop(value, ctx);
+  kk_ref_drop(r, ctx);
+  kk_ref_collect(ctx);
+  return kk_Unit;
+}
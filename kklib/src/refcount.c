@@ -10,7 +10,7 @@
 static void kk_block_drop_free_delayed(kk_context_t* ctx);
 static kk_decl_noinline void kk_block_drop_free_rec(kk_block_t* b, kk_ssize_t scan_fsize, const kk_ssize_t depth, kk_context_t* ctx);
 
-static void kk_block_free_raw(kk_block_t* b) {
+void kk_block_free_raw(kk_block_t* b) {
   kk_assert_internal(kk_tag_is_raw(kk_block_tag(b)));
   struct kk_cptr_raw_s* raw = (struct kk_cptr_raw_s*)b;  // all raw structures must overlap this!
   if (raw->free != NULL) {
@@ -18,20 +18,69 @@ static void kk_block_free_raw(kk_block_t* b) {
   }
 }
 
+static kk_ssize_t kk_free_budget_default;  // = 0 (unbounded)
+
+void kk_free_set_budget(kk_ssize_t budget) {
+  kk_free_budget_default = (budget < 0 ? 0 : budget);
+}
+
+kk_ssize_t kk_free_budget(void) {
+  return kk_free_budget_default;
+}
+
+// Reset the number of blocks we can free in one go (see `--kkfree-budget` and `--kkreclaim`)
+static void kk_block_free_fuel_reset(kk_context_t* ctx) {
+  ctx->free_fuel = (ctx->reclaim_threshold > 0 ? ctx->reclaim_threshold
+                    : (ctx->free_budget > 0 ? ctx->free_budget : KK_SSIZE_MAX));
+}
+
+static void kk_block_drop_free_reclaim(kk_context_t* ctx);
+
 // Free a block and recursively decrement reference counts on children.
 static void kk_block_drop_free(kk_block_t* b, kk_context_t* ctx) {
   kk_assert_internal(b->header.refcount == 0);
   const kk_ssize_t scan_fsize = b->header.scan_fsize;
   if (scan_fsize==0) {
     if (kk_tag_is_raw(kk_block_tag(b))) { kk_block_free_raw(b); }
-    kk_block_free(b); // deallocate directly if nothing to scan
+    kk_block_free(b,ctx); // deallocate directly if nothing to scan
   }
   else {
+    if (kk_unlikely(kk_atomic_load_relaxed(&ctx->reclaim_deferred) != 0)) {
+      kk_reclaim_collect(ctx);           // decrements passed back by the reclaimer thread
+    }
+    kk_block_free_fuel_reset(ctx);
     kk_block_drop_free_rec(b, scan_fsize, 0 /* depth */, ctx);  // free recursively
     kk_block_drop_free_delayed(ctx);     // process delayed frees
+    if (ctx->reclaim_threshold > 0 && ctx->delayed_free != NULL) {
+      kk_block_drop_free_reclaim(ctx);   // too large: free the rest on the reclaimer thread
+    }
   }
 }
 
+// Called from the block allocation functions (like `kk_block_alloc_at`) when there are blocks left on the delayed free list.
+// This only happens with a `free_budget` where we free large structures incrementally.
+kk_decl_noinline void kk_block_drop_free_pending(kk_context_t* ctx) {
+  kk_block_free_fuel_reset(ctx);
+  kk_block_drop_free_delayed(ctx);
+}
+
+// Called from `kk_block_free` when a size class in the free cache is past the water mark,
+// and when the context is freed (with `keep == 0`).
+kk_decl_noinline void kk_block_free_cache_drain(kk_ssize_t bin, kk_ssize_t keep, kk_context_t* ctx) {
+#if KK_FREE_CACHE
+  kk_assert_internal(bin >= 0 && bin <= KK_FREE_CACHE_BINS);
+  while (ctx->free_cache_count[bin] > keep) {
+    kk_block_t* b = ctx->free_cache[bin];
+    kk_assert_internal(b != NULL);
+    ctx->free_cache[bin] = *((kk_block_t**)b);
+    ctx->free_cache_count[bin]--;
+    kk_free(b);
+  }
+#else
+  KK_UNUSED(bin); KK_UNUSED(keep); KK_UNUSED(ctx);
+#endif
+}
+
 
 
 /*--------------------------------------------------------------------------------------
@@ -71,8 +120,10 @@ kk_decl_noinline void kk_block_check_drop(kk_block_t* b, uint32_t rc0, kk_contex
   kk_assert_internal(rc0 == 0 || (rc0 >= RC_SHARED && rc0 < RC_INVALID));
   if (kk_likely(rc0==0)) {
     kk_block_drop_free(b, ctx);  // no more references, free it.
+    return;
   }
-  else if (kk_unlikely(rc0 >= RC_STICKY_LO)) {
+  kk_stats_count(ctx,drop_slow);
+  if (kk_unlikely(rc0 >= RC_STICKY_LO)) {
     // sticky: do not decrement further
   }
   else {
@@ -96,7 +147,12 @@ kk_decl_noinline kk_reuse_t kk_block_check_drop_reuse(kk_block_t* b, uint32_t rc
     for (kk_ssize_t i = 0; i < scan_fsize; i++) {
       kk_box_drop(kk_block_field(b, i), ctx);
     }
+    kk_stats_free(kk_block_tag(b),ctx);         // count now as the tag is cleared
+    const uint8_t arena = b->header.arena;
+    const uint8_t size_class = b->header.size_class;
     memset(&b->header, 0, sizeof(kk_header_t)); // not really necessary
+    b->header.arena = arena;                    // but an arena block stays in the arena
+    b->header.size_class = size_class;          // and can still be cached if the reuse is dropped
     return b;
   }
   else {
@@ -108,12 +164,11 @@ kk_decl_noinline kk_reuse_t kk_block_check_drop_reuse(kk_block_t* b, uint32_t rc
 
 // Check if a reference decrement caused the block to be freed shallowly or needs atomic operations
 kk_decl_noinline void kk_block_check_decref(kk_block_t* b, uint32_t rc0, kk_context_t* ctx) {
-  KK_UNUSED(ctx);
   kk_assert_internal(b!=NULL);
   kk_assert_internal(b->header.refcount == rc0);
   kk_assert_internal(rc0 == 0 || (rc0 >= RC_SHARED && rc0 < RC_INVALID));
   if (kk_likely(rc0==0)) {
-    kk_free(b);  // no more references, free it (without dropping children!)
+    kk_block_free(b,ctx);  // no more references, free it (without dropping children!)
   }
   else if (kk_unlikely(rc0 >= RC_STICKY_LO)) {
     // sticky: do not decrement further
@@ -123,7 +178,7 @@ kk_decl_noinline void kk_block_check_decref(kk_block_t* b, uint32_t rc0, kk_cont
     if (rc == RC_SHARED && b->header.thread_shared) {  // with a shared reference dropping to RC_SHARED means no more references
       b->header.refcount = 0;        // no longer shared
       b->header.thread_shared = 0;
-      kk_free(b);               // no more references, free it.
+      kk_block_free(b,ctx);         // no more references, free it.
     }
   }
 }
@@ -131,11 +186,36 @@ kk_decl_noinline void kk_block_check_decref(kk_block_t* b, uint32_t rc0, kk_cont
 
 kk_decl_noinline kk_block_t* kk_block_check_dup(kk_block_t* b, uint32_t rc0) {
   kk_assert_internal(b!=NULL);
+#if KK_STATS
+  kk_stats_count(kk_get_context(),dup_slow);
+#endif
   kk_assert_internal(b->header.refcount == rc0 && rc0 >= RC_SHARED);
   if (kk_likely(rc0 < RC_STICKY_HI)) {
     kk_atomic_incr(b);
   }
-  // else sticky: no longer increment (or decrement)
+  // else sticky (or frozen): no longer increment (or decrement)
+  return b;
+}
+
+// Increment with `n` on overflow, or for thread-shared and sticky blocks.
+// Instead of going beyond `RC_STICKY_LO` we clamp and the block becomes sticky.
+kk_decl_noinline kk_block_t* kk_block_check_dupn(kk_block_t* b, uint32_t rc0, kk_ssize_t n) {
+  kk_assert_internal(b!=NULL);
+  kk_assert_internal(b->header.refcount == rc0 && n >= 0);
+  if (rc0 < RC_SHARED) {
+    // overflow of a single threaded reference count: continue in the atomic range
+    const uint64_t rc = (uint64_t)rc0 + (uint64_t)n;
+    b->header.refcount = (rc < RC_STICKY_LO ? (uint32_t)rc : RC_STICKY_LO);
+  }
+  else {
+    uint32_t expected = rc0;
+    while (expected < RC_STICKY_LO) {
+      const uint64_t rc = (uint64_t)expected + (uint64_t)n;
+      const uint32_t desired = (rc < RC_STICKY_LO ? (uint32_t)rc : RC_STICKY_LO);
+      if (kk_atomic_cas_weak_relaxed((_Atomic(uint32_t)*)&b->header.refcount, &expected, desired)) break;
+    }
+    // else sticky: no longer increment
+  }
   return b;
 }
 
@@ -172,40 +252,59 @@ static bool kk_block_decref_no_free(kk_block_t* b) {
   return false;
 }
 
+// Encode the next pointer of a delayed free list into the block header (while keeping `scan_fsize` valid)
+static void kk_block_delayed_link(kk_block_t* b, kk_block_t* next) {
+  b->header.refcount = (uint32_t)((kk_uintx_t)next);
+#if (KK_INTPTR_SIZE > 4)
+  b->header.tag = (uint16_t)(kk_shr((kk_uintx_t)next,32));
+  kk_assert_internal(kk_shr((kk_uintx_t)next,48) == 0);
+#endif
+}
+
+// Decode the next element of a delayed free list from the block header
+static kk_block_t* kk_block_delayed_next(kk_block_t* b) {
+  kk_intx_t next = (kk_intx_t)b->header.refcount;
+#if (KK_INTPTR_SIZE>4)
+  next += (kk_intx_t)(b->header.tag) << 32;
+#endif
+  return (kk_block_t*)next;
+}
+
 // Push a block on the delayed-free list
 static void kk_block_push_delayed_drop_free(kk_block_t* b, kk_context_t* ctx) {
   kk_assert_internal(b->header.refcount == 0);
-  kk_block_t* delayed = ctx->delayed_free;
-  // encode the next pointer into the block header (while keeping `scan_fsize` valid)
-  b->header.refcount = (uint32_t)((kk_uintx_t)delayed);
-#if (KK_INTPTR_SIZE > 4)
-  b->header.tag = (uint16_t)(kk_shr((kk_uintx_t)delayed,32));
-  kk_assert_internal(kk_shr((kk_uintx_t)delayed,48) == 0);
+#if KK_STATS
+  kk_stats_free(kk_block_tag(b),ctx);  // count now as the tag is overwritten
+  ctx->stats.delayed_len++;
+  if (ctx->stats.delayed_len > ctx->stats.delayed_peak) ctx->stats.delayed_peak = ctx->stats.delayed_len;
 #endif
+  kk_block_delayed_link(b, ctx->delayed_free);
   ctx->delayed_free = b;
 }
 
 
-// Free all delayed free blocks.
-// TODO: limit to a certain number to limit worst-case free times?
-static void kk_block_drop_free_delayed(kk_context_t* ctx) {
-  kk_block_t* delayed;
-  while ((delayed = ctx->delayed_free) != NULL) {
-    ctx->delayed_free = NULL;
-    do {
-      kk_block_t* b = delayed;
-      // decode the next element in the delayed list from the block header
-      kk_intx_t next = (kk_intx_t)b->header.refcount;
-#if (KK_INTPTR_SIZE>4)
-      next += (kk_intx_t)(b->header.tag) << 32; 
-#endif
+// Pop a block from the delayed-free list
+static kk_block_t* kk_block_pop_delayed_drop_free(kk_context_t* ctx) {
+  kk_block_t* b = ctx->delayed_free;
+  kk_assert_internal(b != NULL);
+  kk_block_t* next = kk_block_delayed_next(b);
 #ifndef NDEBUG
-      b->header.refcount = 0;
+  b->header.refcount = 0;
+#endif
+#if KK_STATS
+  b->header.tag = KK_TAG_INVALID;      // already counted as freed
+  ctx->stats.delayed_len--;
 #endif
-      delayed = (kk_block_t*)next;
-      // and free the block
-      kk_block_drop_free_rec(b, b->header.scan_fsize, 0, ctx);
-    } while (delayed != NULL);
+  ctx->delayed_free = next;
+  return b;
+}
+
+// Free delayed free blocks until the list is empty, or until we run out of fuel
+// (in which case the remaining blocks are freed on later allocations).
+static void kk_block_drop_free_delayed(kk_context_t* ctx) {
+  while (ctx->delayed_free != NULL && ctx->free_fuel > 0) {
+    kk_block_t* b = kk_block_pop_delayed_drop_free(ctx);
+    kk_block_drop_free_rec(b, b->header.scan_fsize, 0, ctx);
   }
 }
 
@@ -214,19 +313,26 @@ static void kk_block_drop_free_delayed(kk_context_t* ctx) {
 // Free recursively a block -- if the recursion becomes too deep, push
 // blocks on the delayed free list to free them later. The delayed free list
 // is encoded in the headers and needs no further space.
+// With a `free_budget`, we also push a block on the delayed list once the fuel runs out.
 static kk_decl_noinline void kk_block_drop_free_rec(kk_block_t* b, kk_ssize_t scan_fsize, const kk_ssize_t depth, kk_context_t* ctx) {
   while(true) {
     kk_assert_internal(b->header.refcount == 0);
+    if (kk_unlikely(ctx->free_fuel <= 0) && scan_fsize > 0) {
+      // out of fuel: free the rest later (only blocks with fields as the tag is overwritten)
+      kk_block_push_delayed_drop_free(b, ctx);
+      return;
+    }
+    ctx->free_fuel--;
     if (scan_fsize == 0) {
       // nothing to scan, just free
       if (kk_tag_is_raw(kk_block_tag(b))) kk_block_free_raw(b); // potentially call custom `free` function on the data
-      kk_block_free(b);
+      kk_block_free(b,ctx);
       return;
     }
     else if (scan_fsize == 1) {
       // if just one field, we can recursively free without using stack space
       const kk_box_t v = kk_block_field(b, 0);
-      kk_block_free(b);
+      kk_block_free(b,ctx);
       if (kk_box_is_non_null_ptr(v)) {
         // try to free the child now
         b = kk_ptr_unbox(v);
@@ -258,7 +364,7 @@ static kk_decl_noinline void kk_block_drop_free_rec(kk_block_t* b, kk_ssize_t sc
         }
         // and recurse into the last one
         kk_box_t v = kk_block_field(b,scan_fsize - 1);
-        kk_block_free(b);
+        kk_block_free(b,ctx);
         if (kk_box_is_non_null_ptr(v)) {
           b = kk_ptr_unbox(v);
           if (kk_block_decref_no_free(b)) {
@@ -277,3 +383,192 @@ static kk_decl_noinline void kk_block_drop_free_rec(kk_block_t* b, kk_ssize_t sc
   }
 }
 
+
+/*--------------------------------------------------------------------------------------
+  Background reclamation
+  With a `reclaim_threshold`, a drop that frees more blocks than the threshold passes the
+  remaining blocks (on the delayed free list) to the reclaimer thread (see `task.c`).
+  The reclaimer frees them with the same semantics as `kk_block_drop_free_rec`, except that
+  a child that is still referenced and not thread shared can only be decremented by its
+  owning thread: such decrements are passed back to the owner with `defer`, and the owner
+  applies them on a later drop (in `kk_reclaim_collect`).
+--------------------------------------------------------------------------------------*/
+
+static void kk_block_drop_free_reclaim(kk_context_t* ctx) {
+  kk_block_t* todo = ctx->delayed_free;
+  ctx->delayed_free = NULL;
+#if KK_STATS
+  ctx->stats.delayed_len = 0;
+#endif
+  kk_reclaim_push(todo, ctx);
+}
+
+// Drop a block; if it is unique, it is freed on the reclaimer thread (regardless of its size).
+void kk_block_drop_reclaim(kk_block_t* b, kk_context_t* ctx) {
+  if (b->header.refcount != 0 || b->header.scan_fsize == 0 || kk_block_is_arena(b)) {
+    kk_block_drop(b, ctx);
+    return;
+  }
+  kk_block_t* delayed = ctx->delayed_free;
+  ctx->delayed_free = NULL;
+  kk_block_push_delayed_drop_free(b, ctx);
+  kk_block_drop_free_reclaim(ctx);
+  ctx->delayed_free = delayed;
+}
+
+// Release the memory of a block on the reclaimer thread (arena blocks are released with their arena)
+static void kk_block_reclaim_release(kk_block_t* b) {
+  if (kk_block_is_arena(b)) { b->header.refcount = KK_ARENA_DEAD; }
+                       else { kk_free(b); }
+}
+
+// Free a list of unreachable blocks (linked like the delayed free list) on the reclaimer thread.
+// Returns the number of freed blocks.
+kk_ssize_t kk_block_reclaim_free(kk_block_t* todo, kk_reclaim_defer_fun_t* defer, void* arg, kk_context_t* ctx) {
+  kk_ssize_t count = 0;
+  while (todo != NULL) {
+    kk_block_t* b = todo;
+    todo = kk_block_delayed_next(b);
+    const kk_ssize_t scan_fsize = kk_block_scan_fsize(b);
+    for (kk_ssize_t i = 0; i < scan_fsize; i++) {
+      const kk_box_t v = kk_block_field(b, i);
+      if (!kk_box_is_non_null_ptr(v)) continue;
+      kk_block_t* vb = kk_ptr_unbox(v);
+      // the owner may still use the block (if it has references) so read the count atomically
+      const uint32_t rc = kk_atomic_load_relaxed((_Atomic(uint32_t)*)&vb->header.refcount);
+      if (rc == 0 || (rc >= RC_SHARED && block_check_decref_no_free(vb))) {
+        // no more references
+        kk_stats_free(kk_block_tag(vb), ctx);
+        if (kk_block_scan_fsize(vb) == 0) {
+          if (kk_tag_is_raw(kk_block_tag(vb))) { kk_block_free_raw(vb); }
+          kk_block_reclaim_release(vb);
+          count++;
+        }
+        else {
+          kk_block_delayed_link(vb, todo);
+          todo = vb;
+        }
+      }
+      else if (rc < RC_SHARED) {
+        (*defer)(vb, arg);   // only the owner can decrement a single threaded reference count
+      }
+    }
+    kk_block_reclaim_release(b);
+    count++;
+  }
+  return count;
+}
+
+
+/*--------------------------------------------------------------------------------------
+  Thread shared marking
+  Before a value can be passed to another thread, it must be marked as thread shared
+  such that all reference count operations on it become atomic. We traverse the
+  reachable graph with an explicit stack and move the reference counts into the
+  atomic range: a reference count `rc` becomes `RC_SHARED + rc`.
+  Already shared blocks are skipped as everything reachable from them is shared
+  already; this makes marking cheap when done again. Marking must happen before
+  the value is published to another thread.
+--------------------------------------------------------------------------------------*/
+
+#define MARK_STACK_INLINE  (64)
+
+typedef struct mark_stack_s {
+  kk_block_t** blocks;
+  kk_ssize_t   count;
+  kk_ssize_t   size;
+  kk_block_t*  inline_blocks[MARK_STACK_INLINE];
+} mark_stack_t;
+
+static void mark_stack_push(mark_stack_t* st, kk_block_t* b, kk_context_t* ctx) {
+  if (kk_unlikely(st->count >= st->size)) {
+    const kk_ssize_t newsize = 2*st->size;
+    kk_block_t** newblocks;
+    if (st->blocks == st->inline_blocks) {
+      newblocks = (kk_block_t**)kk_malloc(newsize * kk_ssizeof(kk_block_t*), ctx);
+      if (newblocks != NULL) memcpy(newblocks, st->blocks, st->count * kk_ssizeof(kk_block_t*));
+    }
+    else {
+      newblocks = (kk_block_t**)kk_realloc(st->blocks, newsize * kk_ssizeof(kk_block_t*), ctx);
+    }
+    if (newblocks == NULL) kk_fatal_error(ENOMEM, "out of memory while marking a value as thread shared");
+    st->blocks = newblocks;
+    st->size = newsize;
+  }
+  st->blocks[st->count++] = b;
+}
+
+// Mark a single block as shared; returns `false` if it was already shared.
+static bool kk_block_mark_shared_one(kk_block_t* b) {
+  if (b->header.thread_shared) return false;
+  const uint32_t rc = b->header.refcount;
+  if (rc >= RC_STICKY_HI) return false;  // static or frozen: never freed and everything reachable is sticky as well
+  if (rc < RC_SHARED) {
+    const uint32_t rcs = rc + RC_SHARED;
+    b->header.refcount = (rcs < RC_STICKY_LO ? rcs : RC_STICKY_LO);
+  }
+  else if (rc < RC_STICKY_LO) {
+    // an overflowed (non-shared) reference count: we cannot know the exact count anymore so make it sticky
+    b->header.refcount = RC_STICKY_LO;
+  }
+  // else: already sticky (by overflow), leave it as is but still visit its children
+  b->header.thread_shared = 1;
+  return true;
+}
+
+// Mark all blocks reachable from `b` using `mark_one` (which returns `false` if a block does not need to be visited)
+static void kk_block_mark(kk_block_t* b, bool (*mark_one)(kk_block_t* b), kk_context_t* ctx) {
+  if (!mark_one(b)) return;
+  mark_stack_t st;
+  st.blocks = st.inline_blocks;
+  st.count = 0;
+  st.size = MARK_STACK_INLINE;
+  while (true) {
+    const kk_ssize_t scan_fsize = kk_block_scan_fsize(b);
+    for (kk_ssize_t i = 0; i < scan_fsize; i++) {
+      kk_box_t v = kk_block_field(b, i);
+      if (kk_box_is_non_null_ptr(v)) {
+        kk_block_t* vb = kk_ptr_unbox(v);
+        if (mark_one(vb) && kk_block_scan_fsize(vb) > 0) {
+          mark_stack_push(&st, vb, ctx);
+        }
+      }
+    }
+    if (st.count == 0) break;
+    b = st.blocks[--st.count];
+  }
+  if (st.blocks != st.inline_blocks) {
+    kk_free(st.blocks);
+  }
+}
+
+void kk_block_mark_shared(kk_block_t* b, kk_context_t* ctx) {
+  kk_block_mark(b, &kk_block_mark_shared_one, ctx);
+}
+
+
+/*--------------------------------------------------------------------------------------
+  Freezing
+  Long lived data can be frozen: all reachable blocks get a reference count of
+  `RC_STICKY_HI` and are never incremented, decremented, or freed anymore. This avoids
+  writes to the headers (and cache line traffic) when the data is used by many threads.
+  Frozen blocks are also thread shared and can be passed to other threads directly.
+--------------------------------------------------------------------------------------*/
+
+// Freeze a single block; returns `false` if it was already frozen (or static).
+static bool kk_block_freeze_one(kk_block_t* b) {
+  if (b->header.refcount >= RC_STICKY_HI) return false;
+  if (b->header.thread_shared) {
+    // concurrent increments or decrements stay in the sticky range
+    kk_atomic_store_relaxed((_Atomic(uint32_t)*)&b->header.refcount, RC_STICKY_HI);
+  }
+  else {
+    b->header.refcount = RC_STICKY_HI;
+    b->header.thread_shared = 1;
+  }
+  return true;
+}
+
+void kk_block_freeze(kk_block_t* b, kk_context_t* ctx) {
+  kk_block_mark(b, &kk_block_freeze_one, ctx);
+}
@@ -0,0 +1,169 @@
+/*---------------------------------------------------------------------------
+  Copyright 2021, Microsoft Research, Daan Leijen.
+
+  This is free software; you can redistribute it and/or modify it under the
+  terms of the Apache License, Version 2.0. A copy of the License can be
+  found in the LICENSE file at the root of this distribution.
+---------------------------------------------------------------------------*/
+#include "kklib.h"
+
+/*--------------------------------------------------------------------------------------------------
+  Runtime statistics (`--kkstats`)
+  Counters are kept per context (see `kk_stats_t`) and only if compiled with `KK_STATS=1`.
+  When a context is freed its counters are added to the process totals which are
+  printed at exit, both human readable and as JSON.
+--------------------------------------------------------------------------------------------------*/
+
+static const char* kk_special_tag_names[KK_TAG_LAST - KK_TAG_OPEN] = {
+  "open", "box", "box-any", "ref", "function", "bigint", "bytes-small", "bytes", "vector",
+  "int64", "double", "int32", "float", "cfunptr", "size_t", "ssize_t", "evv-vector",
+  "uvector", "cptr-raw", "bytes-raw"
+};
+
+// A readable name for a tag (also used by the heap profiler)
+void kk_tag_name(kk_tag_t tag, char* buf, size_t bufsize) {
+  if (tag >= KK_TAG_OPEN && tag < KK_TAG_LAST) snprintf(buf, bufsize, "%s", kk_special_tag_names[tag - KK_TAG_OPEN]);
+  else snprintf(buf, bufsize, "con%u", (unsigned)tag);
+}
+
+static bool        stats_enabled;   // = false
+static const char* stats_fname;     // if not NULL, write the JSON output to this file
+
+#if KK_STATS
+
+static kk_stats_t          stats_total;
+static _Atomic(uintptr_t)  stats_lock;
+
+static void kk_stats_lock(void) {
+  uintptr_t expected = 0;
+  while (!kk_atomic_cas_weak_acq_rel(&stats_lock, &expected, 1)) { expected = 0; }
+}
+
+static void kk_stats_unlock(void) {
+  kk_atomic_store_release(&stats_lock, 0);
+}
+
+// Add the statistics of a context to the process totals (called when a context is freed)
+void kk_stats_merge(kk_context_t* ctx) {
+  const kk_stats_t* st = &ctx->stats;
+  kk_stats_lock();
+  for (kk_ssize_t i = 0; i < KK_STATS_TAG_COUNT; i++) {
+    stats_total.allocs[i] += st->allocs[i];
+    stats_total.frees[i]  += st->frees[i];
+  }
+  stats_total.reuses    += st->reuses;
+  stats_total.bytes_static += st->bytes_static;
+  stats_total.dup_slow  += st->dup_slow;
+  stats_total.drop_slow += st->drop_slow;
+  stats_total.reclaim_jobs     += st->reclaim_jobs;
+  stats_total.reclaim_blocks   += st->reclaim_blocks;
+  stats_total.reclaim_deferred += st->reclaim_deferred;
+  if (st->delayed_peak > stats_total.delayed_peak) stats_total.delayed_peak = st->delayed_peak;
+  kk_stats_unlock();
+}
+
+static void kk_stats_tag_name(kk_ssize_t i, char* buf, size_t bufsize) {
+  if (i < KK_STATS_TAGS) kk_tag_name((kk_tag_t)i, buf, bufsize);
+  else if (i < KK_STATS_TAG_COUNT - 1) kk_tag_name((kk_tag_t)(KK_TAG_OPEN + (i - KK_STATS_TAGS)), buf, bufsize);
+  else snprintf(buf, bufsize, "other");
+}
+
+static void kk_stats_totals(const kk_stats_t* st, int64_t* allocs, int64_t* frees) {
+  *allocs = 0;
+  *frees = 0;
+  for (kk_ssize_t i = 0; i < KK_STATS_TAG_COUNT; i++) {
+    *allocs += st->allocs[i];
+    *frees += st->frees[i];
+  }
+}
+
+static void kk_stats_print_text(FILE* out, const kk_stats_t* st) {
+  int64_t allocs, frees;
+  kk_stats_totals(st, &allocs, &frees);
+  fprintf(out, "stats: allocs: %lld, frees: %lld, live: %lld, reuses: %lld (%.1f%%)\n",
+          (long long)allocs, (long long)frees, (long long)(allocs - frees), (long long)st->reuses,
+          (allocs > 0 ? (100.0 * (double)st->reuses) / (double)allocs : 0.0));
+  fprintf(out, "stats: dup slow: %lld, drop slow: %lld, delayed free peak: %lld\n",
+          (long long)st->dup_slow, (long long)st->drop_slow, (long long)st->delayed_peak);
+  if (st->bytes_static > 0) {
+    fprintf(out, "stats: static single byte strings: %lld (not allocated)\n", (long long)st->bytes_static);
+  }
+  if (st->reclaim_jobs > 0) {
+    fprintf(out, "stats: reclaimed: %lld jobs, %lld blocks, %lld deferred decrements\n",
+            (long long)st->reclaim_jobs, (long long)st->reclaim_blocks, (long long)st->reclaim_deferred);
+  }
+  kk_mem_print_text(out);
+  fprintf(out, "stats: %-12s %14s %14s\n", "tag", "allocs", "frees");
+  for (kk_ssize_t i = 0; i < KK_STATS_TAG_COUNT; i++) {
+    if (st->allocs[i] == 0 && st->frees[i] == 0) continue;
+    char name[32];
+    kk_stats_tag_name(i, name, sizeof(name));
+    fprintf(out, "stats: %-12s %14lld %14lld\n", name, (long long)st->allocs[i], (long long)st->frees[i]);
+  }
+}
+
+static void kk_stats_print_json(FILE* out, const kk_stats_t* st) {
+  int64_t allocs, frees;
+  kk_stats_totals(st, &allocs, &frees);
+  fprintf(out, "{\"allocs\":%lld,\"frees\":%lld,\"reuses\":%lld,\"dup_slow\":%lld,\"drop_slow\":%lld,\"delayed_peak\":%lld,"
+               "\"reclaim_jobs\":%lld,\"reclaim_blocks\":%lld,\"reclaim_deferred\":%lld,\"bytes_static\":%lld,\"tags\":[",
+          (long long)allocs, (long long)frees, (long long)st->reuses,
+          (long long)st->dup_slow, (long long)st->drop_slow, (long long)st->delayed_peak,
+          (long long)st->reclaim_jobs, (long long)st->reclaim_blocks, (long long)st->reclaim_deferred,
+          (long long)st->bytes_static);
+  bool first = true;
+  for (kk_ssize_t i = 0; i < KK_STATS_TAG_COUNT; i++) {
+    if (st->allocs[i] == 0 && st->frees[i] == 0) continue;
+    char name[32];
+    kk_stats_tag_name(i, name, sizeof(name));
+    fprintf(out, "%s{\"tag\":\"%s\",\"allocs\":%lld,\"frees\":%lld}", (first ? "" : ","), name,
+            (long long)st->allocs[i], (long long)st->frees[i]);
+    first = false;
+  }
+  fprintf(out, "]");
+  if (kk_mem_is_tuned()) {
+    fprintf(out, ",\"mem\":");
+    kk_mem_print_json(out);
+  }
+  fprintf(out, "}\n");
+}
+
+// Print the process totals (called at exit after all contexts are freed)
+void kk_stats_done(void) {
+  if (!stats_enabled) return;
+  kk_stats_lock();
+  kk_stats_t st = stats_total;
+  kk_stats_unlock();
+  kk_stats_print_text(stderr, &st);
+  FILE* out = stderr;
+  if (stats_fname != NULL) {
+    out = fopen(stats_fname, "w");
+    if (out == NULL) {
+      fprintf(stderr, "warning: unable to write statistics to: %s\n", stats_fname);
+      return;
+    }
+  }
+  kk_stats_print_json(out, &st);
+  if (out != stderr) fclose(out);
+}
+
+#else
+
+void kk_stats_merge(kk_context_t* ctx) {
+  KK_UNUSED(ctx);
+}
+
+void kk_stats_done(void) {
+  if (stats_enabled) kk_mem_print_text(stderr);  // the allocator settings are shown even without statistics
+}
+
+#endif
+
+// Enable statistics output at exit (with an optional file name for the JSON output)
+void kk_stats_enable(const char* fname) {
+#if !KK_STATS
+  kk_warning_message("--kkstats is ignored as the runtime is compiled without statistics (KK_STATS=1)\n");
+#endif
+  stats_enabled = true;
+  stats_fname = fname;
+}
@@ -15,9 +15,6 @@
 // Allow reading aligned words as long as some bytes in it are part of a valid C object
 #define ARCH_ALLOW_WORD_READS  (1)  
 
-static uint8_t kk_ascii_toupper(uint8_t c) {
-  return (c >= 'a' && c <= 'z' ? c - 'a' + 'A' : c);
-}
 static uint8_t kk_ascii_tolower(uint8_t c) {
   return (c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c);
 }
@@ -25,15 +22,7 @@ static uint8_t kk_ascii_iswhite(uint8_t c) {
   return (c == ' ' || c == '\t' || c == '\n' || c == '\r');
 }
 
-static int kk_memicmp(const uint8_t* s, const uint8_t* t, kk_ssize_t len) {
-  if (s==t) return 0;
-  for(kk_ssize_t i = 0; i < len; i++) {
-    uint8_t c = kk_ascii_tolower(*s); s++;
-    uint8_t d = kk_ascii_tolower(*t); t++;
-    if (c != d) return (c < d ? -1 : 1);
-  }
-  return 0;
-}
+static int kk_memicmp(const uint8_t* s, const uint8_t* t, kk_ssize_t len);  // see below
 
 static kk_ssize_t kk_wcslen(const uint16_t* wstr) {
   if (wstr == NULL) return 0;
@@ -65,18 +54,36 @@ int kk_string_icmp(kk_string_t str1, kk_string_t str2, kk_context_t* ctx) {
 }
 
 
-// Count code points in a valid utf-8 string.
-kk_ssize_t kk_decl_pure kk_string_count_borrow(kk_string_t str) {
-  kk_ssize_t len;
-  const uint8_t* s = kk_string_buf_borrow(str,&len);
-  kk_ssize_t cont = 0;      // continuation character counts
-  const uint8_t* t = s; // current position 
-  const uint8_t* end = t + len;
-  kk_assert_internal(*end == 0);
+/*--------------------------------------------------------------------------------------------------
+  UTF-8/16 kernels
+  The inner loops of counting, validating, and transcoding. We select variants for the
+  current cpu at startup in `kk_string_init`. On x64 we use SSE2 by default and AVX2 when
+  available; validation uses the lookup algorithm of Keiser and Lemire [1] (as in simdutf)
+  with SSSE3. Other platforms use word reads (SWAR) for the ascii fast paths.
+  [1] John Keiser and Daniel Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte", 2021.
+--------------------------------------------------------------------------------------------------*/
+
+// Return the first non-ascii byte in `[s,end)` (or `end`).
+static const uint8_t* kk_utf8_skip_ascii_generic(const uint8_t* s, const uint8_t* end) {
+  const uint8_t* p = s;
+  // advance per byte until aligned
+  for (; (((uintptr_t)p) % sizeof(kk_uintx_t)) != 0 && p < end; p++) {
+    if (*p >= 0x80) return p;
+  }
+  // advance per word
+  for (; p + sizeof(kk_uintx_t) <= end; p += sizeof(kk_uintx_t)) {
+    if ((*((const kk_uintx_t*)p) & kk_bits_high_mask) != 0) break;
+  }
+  for (; p < end && *p < 0x80; p++) {}
+  return p;
+}
 
+// Count the continuation bytes in `[s,end)`.
+static kk_ssize_t kk_utf8_count_cont_generic(const uint8_t* s, const uint8_t* end) {
+  kk_ssize_t cont = 0;
+  const uint8_t* t = s;
   // advance per byte until aligned
   for ( ; ((((uintptr_t)t) % sizeof(kk_uintx_t)) != 0) && (t < end); t++) {
-    // count continuation bytes
     if (kk_utf8_is_cont(*t)) cont++;
   }  
   // advance per sizeof(kk_uintx_t). 
@@ -92,14 +99,290 @@ kk_ssize_t kk_decl_pure kk_string_count_borrow(kk_string_t str) {
     }
     t = (const uint8_t*)p; // restore t
   }
-
   // advance per byte until reaching the end
   for (; t < end; t++) {
-    // count continuation characters
     if (kk_utf8_is_cont(*t)) cont++;
   }
-  kk_assert_internal(t == end);
-  kk_assert_internal(len == (t - s));
+  return cont;
+}
+
+// Return a character boundary `q` such that `[s,q)` is valid (q)utf-8 (and contains no code points in
+// the raw range if `qutf8_identity` is set). The generic version just skips ascii.
+static const uint8_t* kk_utf8_validate_generic(const uint8_t* s, const uint8_t* end, bool qutf8_identity) {
+  KK_UNUSED(qutf8_identity);
+  return kk_utf8_skip_ascii_generic(s, end);
+}
+
+// Return the first utf-16 unit in `[s,end)` that is not ascii (or `end`).
+static const uint16_t* kk_utf16_skip_ascii_generic(const uint16_t* s, const uint16_t* end) {
+  const uint16_t* p = s;
+  for (; p < end && *p <= 0x7F; p++) {}
+  return p;
+}
+
+// Copy the ascii prefix of `[s,end)` to `t` (narrowing) and return the end of the prefix.
+static const uint16_t* kk_utf16_narrow_ascii_generic(uint8_t* t, const uint16_t* s, const uint16_t* end) {
+  const uint16_t* p = s;
+  for (; p < end && *p <= 0x7F; p++) { *t++ = (uint8_t)*p; }
+  return p;
+}
+
+// Copy the ascii prefix of `[s,end)` to `t` (widening) and return the end of the prefix.
+static const uint8_t* kk_utf8_widen_ascii_generic(uint16_t* t, const uint8_t* s, const uint8_t* end) {
+  const uint8_t* p = s;
+  for (; p < end && *p <= 0x7F; p++) { *t++ = *p; }
+  return p;
+}
+
+// Back up from a block boundary `q` to a character boundary, given that `[s,q)` is valid 
+// up to a possibly incomplete sequence at the end.
+static const uint8_t* kk_utf8_boundary_before(const uint8_t* s, const uint8_t* q) {
+  const uint8_t* r = q;
+  while (r > s && r > q - 3 && kk_utf8_is_cont(r[-1])) { r--; }
+  if (r > s && r[-1] >= 0xC0) {
+    const uint8_t lead = r[-1];
+    const kk_ssize_t n = (lead >= 0xF0 ? 4 : (lead >= 0xE0 ? 3 : 2));
+    if (r - 1 + n > q) return (r - 1);  // incomplete
+  }
+  return q;
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define KK_UTF8_SIMD  1
+#include <immintrin.h>
+
+static const uint8_t* kk_utf8_skip_ascii_sse2(const uint8_t* s, const uint8_t* end) {
+  const uint8_t* p = s;
+  for (; p + 16 <= end; p += 16) {
+    const int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)p));
+    if (mask != 0) return (p + kk_bits_ctz32((uint32_t)mask));
+  }
+  for (; p < end && *p < 0x80; p++) {}
+  return p;
+}
+
+static kk_ssize_t kk_utf8_count_cont_sse2(const uint8_t* s, const uint8_t* end) {
+  const __m128i lim = _mm_set1_epi8(-64);  // continuation bytes are < -64 as a signed byte
+  kk_ssize_t cont = 0;
+  const uint8_t* p = s;
+  while (p + 16 <= end) {
+    // count per byte in `acc` for at most 255 iterations
+    __m128i acc = _mm_setzero_si128();
+    const kk_ssize_t n = ((end - p) / 16 < 255 ? (end - p) / 16 : 255);
+    for (kk_ssize_t i = 0; i < n; i++, p += 16) {
+      acc = _mm_sub_epi8(acc, _mm_cmpgt_epi8(lim, _mm_loadu_si128((const __m128i*)p)));
+    }
+    const __m128i sum = _mm_sad_epu8(acc, _mm_setzero_si128());
+    cont += _mm_cvtsi128_si32(sum) + _mm_extract_epi16(sum, 4);
+  }
+  return cont + kk_utf8_count_cont_generic(p, end);
+}
+
+static const uint16_t* kk_utf16_skip_ascii_sse2(const uint16_t* s, const uint16_t* end) {
+  const __m128i hi = _mm_set1_epi16((short)0xFF80);
+  const uint16_t* p = s;
+  for (; p + 8 <= end; p += 8) {
+    const __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i*)p), hi);
+    const int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(v, _mm_setzero_si128()));
+    if (mask != 0xFFFF) return (p + kk_bits_ctz32((uint32_t)~mask)/2);
+  }
+  return kk_utf16_skip_ascii_generic(p, end);
+}
+
+static const uint16_t* kk_utf16_narrow_ascii_sse2(uint8_t* t, const uint16_t* s, const uint16_t* end) {
+  const uint16_t* p = s;
+  for (; p + 16 <= end; p += 16, t += 16) {
+    const __m128i v1 = _mm_loadu_si128((const __m128i*)p);
+    const __m128i v2 = _mm_loadu_si128((const __m128i*)(p + 8));
+    // note: the output has room for at least as many bytes as there are units
+    _mm_storeu_si128((__m128i*)t, _mm_packus_epi16(v1, v2));
+    const __m128i v = _mm_packs_epi16(_mm_srli_epi16(v1, 7), _mm_srli_epi16(v2, 7));  // non-zero iff not ascii
+    const int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128()));
+    if (mask != 0xFFFF) return (p + kk_bits_ctz32((uint32_t)~mask));
+  }
+  return kk_utf16_narrow_ascii_generic(t, p, end);
+}
+
+static const uint8_t* kk_utf8_widen_ascii_sse2(uint16_t* t, const uint8_t* s, const uint8_t* end) {
+  const uint8_t* p = s;
+  for (; p + 16 <= end; p += 16, t += 16) {
+    const __m128i v = _mm_loadu_si128((const __m128i*)p);
+    const int mask = _mm_movemask_epi8(v);
+    if (mask != 0) {
+      const uint8_t* q = p + kk_bits_ctz32((uint32_t)mask);
+      for (; p < q; p++) { *t++ = *p; }
+      return q;
+    }
+    _mm_storeu_si128((__m128i*)t, _mm_unpacklo_epi8(v, _mm_setzero_si128()));
+    _mm_storeu_si128((__m128i*)(t + 8), _mm_unpackhi_epi8(v, _mm_setzero_si128()));
+  }
+  return kk_utf8_widen_ascii_generic(t, p, end);
+}
+
+__attribute__((target("avx2")))
+static const uint8_t* kk_utf8_skip_ascii_avx2(const uint8_t* s, const uint8_t* end) {
+  const uint8_t* p = s;
+  for (; p + 32 <= end; p += 32) {
+    const int mask = _mm256_movemask_epi8(_mm256_loadu_si256((const __m256i*)p));
+    if (mask != 0) return (p + kk_bits_ctz32((uint32_t)mask));
+  }
+  return kk_utf8_skip_ascii_sse2(p, end);
+}
+
+__attribute__((target("avx2")))
+static kk_ssize_t kk_utf8_count_cont_avx2(const uint8_t* s, const uint8_t* end) {
+  const __m256i lim = _mm256_set1_epi8(-64);
+  kk_ssize_t cont = 0;
+  const uint8_t* p = s;
+  while (p + 32 <= end) {
+    __m256i acc = _mm256_setzero_si256();
+    const kk_ssize_t n = ((end - p) / 32 < 255 ? (end - p) / 32 : 255);
+    for (kk_ssize_t i = 0; i < n; i++, p += 32) {
+      acc = _mm256_sub_epi8(acc, _mm256_cmpgt_epi8(lim, _mm256_loadu_si256((const __m256i*)p)));
+    }
+    const __m256i sum = _mm256_sad_epu8(acc, _mm256_setzero_si256());
+    cont += (kk_ssize_t)(_mm256_extract_epi64(sum, 0) + _mm256_extract_epi64(sum, 1) + _mm256_extract_epi64(sum, 2) + _mm256_extract_epi64(sum, 3));
+  }
+  return cont + kk_utf8_count_cont_sse2(p, end);
+}
+
+// Error bits of the lookup tables; an error is detected if the lookups for the high and low nibble
+// of the first byte and the high nibble of the second byte of each pair of bytes have a bit in common.
+#define KK_U8_TOO_SHORT   (1<<0)  // a lead byte followed by a lead byte or ascii
+#define KK_U8_TOO_LONG    (1<<1)  // ascii followed by a continuation byte
+#define KK_U8_OVERLONG_3  (1<<2)  // 0xE0 followed by 0x80-0x9F
+#define KK_U8_TOO_LARGE   (1<<3)  // 0xF4 followed by 0x90 or larger, or 0xF5 and larger
+#define KK_U8_SURROGATE   (1<<4)  // 0xED followed by 0xA0-0xBF
+#define KK_U8_OVERLONG_2  (1<<5)  // 0xC0 or 0xC1
+#define KK_U8_TOO_LARGE_1000 (1<<6)  // 0xF5 and larger followed by 0x80-0x8F
+#define KK_U8_OVERLONG_4  (1<<6)  // 0xF0 followed by 0x80-0x8F
+#define KK_U8_TWO_CONTS   (1<<7)  // two continuation bytes (only valid in 3 and 4 byte sequences)
+#define KK_U8_CARRY       (KK_U8_TOO_SHORT | KK_U8_TOO_LONG | KK_U8_TWO_CONTS)
+
+__attribute__((target("ssse3")))
+static const uint8_t* kk_utf8_validate_ssse3(const uint8_t* s, const uint8_t* end, bool qutf8_identity) {
+  const __m128i byte_1_high = _mm_setr_epi8(
+    // 0_______ : ascii
+    KK_U8_TOO_LONG, KK_U8_TOO_LONG, KK_U8_TOO_LONG, KK_U8_TOO_LONG,
+    KK_U8_TOO_LONG, KK_U8_TOO_LONG, KK_U8_TOO_LONG, KK_U8_TOO_LONG,
+    // 10______ : continuation
+    (char)KK_U8_TWO_CONTS, (char)KK_U8_TWO_CONTS, (char)KK_U8_TWO_CONTS, (char)KK_U8_TWO_CONTS,
+    // 1100____, 1101____ : 2 byte lead
+    KK_U8_TOO_SHORT | KK_U8_OVERLONG_2,
+    KK_U8_TOO_SHORT,
+    // 1110____ : 3 byte lead
+    KK_U8_TOO_SHORT | KK_U8_OVERLONG_3 | KK_U8_SURROGATE,
+    // 1111____ : 4 byte lead
+    KK_U8_TOO_SHORT | KK_U8_TOO_LARGE | KK_U8_TOO_LARGE_1000 | KK_U8_OVERLONG_4
+  );
+  const __m128i byte_1_low = _mm_setr_epi8(
+    (char)(KK_U8_CARRY | KK_U8_OVERLONG_3 | KK_U8_OVERLONG_2 | KK_U8_OVERLONG_4),  // ____0000
+    (char)(KK_U8_CARRY | KK_U8_OVERLONG_2),                                         // ____0001
+    (char)KK_U8_CARRY, (char)KK_U8_CARRY,                                           // ____001_
+    (char)(KK_U8_CARRY | KK_U8_TOO_LARGE),                                          // ____0100
+    (char)(KK_U8_CARRY | KK_U8_TOO_LARGE | KK_U8_TOO_LARGE_1000),                   // ____0101 
+    (char)(KK_U8_CARRY | KK_U8_TOO_LARGE | KK_U8_TOO_LARGE_1000),
+    (char)(KK_U8_CARRY | KK_U8_TOO_LARGE | KK_U8_TOO_LARGE_1000),
+    (char)(KK_U8_CARRY | KK_U8_TOO_LARGE | KK_U8_TOO_LARGE_1000),                   // ____1___
+    (char)(KK_U8_CARRY | KK_U8_TOO_LARGE | KK_U8_TOO_LARGE_1000),
+    (char)(KK_U8_CARRY | KK_U8_TOO_LARGE | KK_U8_TOO_LARGE_1000),
+    (char)(KK_U8_CARRY | KK_U8_TOO_LARGE | KK_U8_TOO_LARGE_1000),
+    (char)(KK_U8_CARRY | KK_U8_TOO_LARGE | KK_U8_TOO_LARGE_1000),
+    (char)(KK_U8_CARRY | KK_U8_TOO_LARGE | KK_U8_TOO_LARGE_1000 | KK_U8_SURROGATE),  // ____1101
+    (char)(KK_U8_CARRY | KK_U8_TOO_LARGE | KK_U8_TOO_LARGE_1000),
+    (char)(KK_U8_CARRY | KK_U8_TOO_LARGE | KK_U8_TOO_LARGE_1000)
+  );
+  const __m128i byte_2_high = _mm_setr_epi8(
+    // 0_______ : ascii
+    KK_U8_TOO_SHORT, KK_U8_TOO_SHORT, KK_U8_TOO_SHORT, KK_U8_TOO_SHORT,
+    KK_U8_TOO_SHORT, KK_U8_TOO_SHORT, KK_U8_TOO_SHORT, KK_U8_TOO_SHORT,
+    // 1000____, 1001____, 101_____ : continuation
+    (char)(KK_U8_TOO_LONG | KK_U8_OVERLONG_2 | KK_U8_TWO_CONTS | KK_U8_OVERLONG_3 | KK_U8_TOO_LARGE_1000 | KK_U8_OVERLONG_4),
+    (char)(KK_U8_TOO_LONG | KK_U8_OVERLONG_2 | KK_U8_TWO_CONTS | KK_U8_OVERLONG_3 | KK_U8_TOO_LARGE),
+    (char)(KK_U8_TOO_LONG | KK_U8_OVERLONG_2 | KK_U8_TWO_CONTS | KK_U8_SURROGATE | KK_U8_TOO_LARGE),
+    (char)(KK_U8_TOO_LONG | KK_U8_OVERLONG_2 | KK_U8_TWO_CONTS | KK_U8_SURROGATE | KK_U8_TOO_LARGE),
+    // 11______ : lead
+    KK_U8_TOO_SHORT, KK_U8_TOO_SHORT, KK_U8_TOO_SHORT, KK_U8_TOO_SHORT
+  );
+  const __m128i nibble = _mm_set1_epi8(0x0F);
+  const __m128i zero   = _mm_setzero_si128();
+  const __m128i raw_lead = _mm_set1_epi8((char)0xF3);  // raw code points are encoded as F3 AD A0 80 .. F3 AE 83 BF
+  __m128i prev_input = zero;
+  __m128i prev_incomplete = zero;
+  const uint8_t* p = s;
+  for (; p + 16 <= end; p += 16) {
+    const __m128i input = _mm_loadu_si128((const __m128i*)p);
+    if (qutf8_identity && _mm_movemask_epi8(_mm_cmpeq_epi8(input, raw_lead)) != 0) break;
+    if (_mm_movemask_epi8(input) == 0) {
+      // all ascii: only check that we did not end in the middle of a sequence
+      if (_mm_movemask_epi8(_mm_cmpeq_epi8(prev_incomplete, zero)) != 0xFFFF) break;
+    }
+    else {
+      const __m128i prev1 = _mm_alignr_epi8(input, prev_input, 15);
+      const __m128i b1h = _mm_shuffle_epi8(byte_1_high, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble));
+      const __m128i b1l = _mm_shuffle_epi8(byte_1_low, _mm_and_si128(prev1, nibble));
+      const __m128i b2h = _mm_shuffle_epi8(byte_2_high, _mm_and_si128(_mm_srli_epi16(input, 4), nibble));
+      const __m128i special = _mm_and_si128(_mm_and_si128(b1h, b1l), b2h);
+      // the third and fourth byte of 3 and 4 byte sequences must be continuation bytes (and have TWO_CONTS set)
+      const __m128i prev2 = _mm_alignr_epi8(input, prev_input, 14);
+      const __m128i prev3 = _mm_alignr_epi8(input, prev_input, 13);
+      const __m128i is_third  = _mm_subs_epu8(prev2, _mm_set1_epi8((char)(0xE0 - 0x80)));
+      const __m128i is_fourth = _mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xF0 - 0x80)));
+      const __m128i must23 = _mm_and_si128(_mm_or_si128(is_third, is_fourth), _mm_set1_epi8((char)0x80));
+      const __m128i err = _mm_xor_si128(must23, special);
+      if (_mm_movemask_epi8(_mm_cmpeq_epi8(err, zero)) != 0xFFFF) break;
+    }
+    // lead bytes at the end that need more bytes
+    const __m128i max_value = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+    prev_incomplete = _mm_subs_epu8(input, max_value);
+    prev_input = input;
+  }
+  return kk_utf8_boundary_before(s, p);
+}
+#endif
+
+typedef const uint8_t* (kk_utf8_skip_ascii_fun_t)(const uint8_t* s, const uint8_t* end);
+typedef kk_ssize_t     (kk_utf8_count_cont_fun_t)(const uint8_t* s, const uint8_t* end);
+typedef const uint8_t* (kk_utf8_validate_fun_t)(const uint8_t* s, const uint8_t* end, bool qutf8_identity);
+
+static struct {
+  kk_utf8_skip_ascii_fun_t*  skip_ascii;
+  kk_utf8_count_cont_fun_t*  count_cont;
+  kk_utf8_validate_fun_t*    validate;
+} kk_utf8_kernels = 
+#if defined(KK_UTF8_SIMD)
+  { &kk_utf8_skip_ascii_sse2, &kk_utf8_count_cont_sse2, &kk_utf8_validate_generic };
+#define kk_utf16_skip_ascii(s,end)      kk_utf16_skip_ascii_sse2(s,end)
+#define kk_utf16_narrow_ascii(t,s,end)  kk_utf16_narrow_ascii_sse2(t,s,end)
+#define kk_utf8_widen_ascii(t,s,end)    kk_utf8_widen_ascii_sse2(t,s,end)
+#else
+  { &kk_utf8_skip_ascii_generic, &kk_utf8_count_cont_generic, &kk_utf8_validate_generic };
+#define kk_utf16_skip_ascii(s,end)      kk_utf16_skip_ascii_generic(s,end)
+#define kk_utf16_narrow_ascii(t,s,end)  kk_utf16_narrow_ascii_generic(t,s,end)
+#define kk_utf8_widen_ascii(t,s,end)    kk_utf8_widen_ascii_generic(t,s,end)
+#endif
+
+// Called once from `kklib_init` to select the utf-8 kernels for this cpu.
+void kk_string_init(void) {
+#if defined(KK_UTF8_SIMD)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("ssse3")) {
+    kk_utf8_kernels.validate   = &kk_utf8_validate_ssse3;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    kk_utf8_kernels.skip_ascii = &kk_utf8_skip_ascii_avx2;
+    kk_utf8_kernels.count_cont = &kk_utf8_count_cont_avx2;
+  }
+#endif
+}
+
+
+// Count code points in a valid utf-8 string.
+kk_ssize_t kk_decl_pure kk_string_count_borrow(kk_string_t str) {
+  kk_ssize_t len;
+  const uint8_t* s = kk_string_buf_borrow(str,&len);
+  kk_assert_internal(s[len] == 0);
+  const kk_ssize_t cont = kk_utf8_kernels.count_cont(s, s + len);
   kk_assert_internal(len == 0 || len > cont);
   return (len - cont);
 }
@@ -140,7 +423,8 @@ kk_char_t kk_utf8_read_validate(const uint8_t* s, kk_ssize_t* count, kk_ssize_t*
   }
   // 3 byte encoding; reject overlong and utf-16 surrogate halves (0xD800 - 0xDFFF)
   if ((b == 0xE0 && s[1] >= 0xA0 && s[1] <= 0xBF && kk_utf8_is_cont(s[2]))
-    || (b >= 0xE1 && b <= 0xEC && kk_utf8_is_cont(s[1]) && kk_utf8_is_cont(s[2])))
+    || (b == 0xED && s[1] >= 0x80 && s[1] <= 0x9F && kk_utf8_is_cont(s[2]))
+    || (((b >= 0xE1 && b <= 0xEC) || b == 0xEE || b == 0xEF) && kk_utf8_is_cont(s[1]) && kk_utf8_is_cont(s[2])))
   {
     *count = 3;
     kk_char_t c = (((b & 0x0F) << 12) | ((s[1] & 0x3F) << 6) | (s[2] & 0x3F));
@@ -176,23 +460,29 @@ static kk_string_t  kk_string_convert_from_qutf8_prim(kk_bytes_t str, bool qutf8
   kk_ssize_t vlen = 0;
   const uint8_t* p = s;
   while (p < end) {
-    // optimize for ascii
-    // todo: optimize further with word reads?
-    if (kk_likely(*p < 0x80)) {
-      p++;
-      vlen++;
-    }
-    else {
-      kk_ssize_t count;
-      kk_ssize_t vcount = 0;
-      kk_utf8_read_validate(p, &count, &vcount, qutf8_identity);
-      p += count;
-      if (vcount == 0) {
-        vlen += count;
+    // validate as much as possible at once
+    const uint8_t* q = kk_utf8_kernels.validate(p, end, qutf8_identity);
+    vlen += (q - p);
+    p = q;
+    // and continue per code point for a while (past an invalid sequence or raw code point)
+    const uint8_t* const pend = (end - p > 64 ? p + 64 : end);
+    while (p < pend) {
+      if (kk_likely(*p < 0x80)) {
+        p++;
+        vlen++;
       }
       else {
-        kk_assert_internal(count != vcount);
-        vlen += vcount;
+        kk_ssize_t count;
+        kk_ssize_t vcount = 0;
+        kk_utf8_read_validate(p, &count, &vcount, qutf8_identity);
+        p += count;
+        if (vcount == 0) {
+          vlen += count;
+        }
+        else {
+          kk_assert_internal(count != vcount);
+          vlen += vcount;
+        }
       }
     }
   }
@@ -206,11 +496,14 @@ static kk_string_t  kk_string_convert_from_qutf8_prim(kk_bytes_t str, bool qutf8
   p = s;
   while (p < end) {    
     if (kk_likely(*p < 0x80)) {
-      *t++ = *p++;
+      // copy ascii
+      const uint8_t* q = kk_utf8_kernels.skip_ascii(p, end);
+      kk_memcpy(t, p, q - p);
+      t += (q - p);
+      p = q;
     }
     else {
       // copy sequence    
-      // todo: this can be optimized a lot more..
       kk_ssize_t count;
       kk_char_t c = kk_utf8_read_validate(p, &count, NULL, qutf8_identity);
       p += count;
@@ -255,27 +548,23 @@ const char* kk_string_to_qutf8_borrow(kk_string_t str, bool* should_free, kk_con
   kk_ssize_t extra_count = 0;
   const uint8_t* p = s;
   while (p < end) {
-    // optimize for ascii
-    // todo: optimize further with word reads?
-    if (kk_likely(*p < 0x80)) {
-      p++;
-    }
-    else {
-      kk_ssize_t count;
-      kk_char_t c = kk_utf8_read(p, &count);
-      p += count;
-      if (c >= KK_RAW_UTF8_OFS && c <= KK_RAW_UTF8_OFS + 0x7F) {
-        extra_count += 3;  // encoded as 4 utf bytes but just 1 output byte needed
-      }
+    // raw code points are encoded as F3 AE 82 80 .. F3 AE 83 BF; since the string is valid
+    // utf-8 we can search for the lead byte.
+    p = (const uint8_t*)memchr(p, 0xF3, (size_t)(end - p));
+    if (p == NULL) break;
+    kk_ssize_t count;
+    kk_char_t c = kk_utf8_read(p, &count);
+    p += count;
+    if (c >= KK_RAW_UTF8_OFS + 0x80 && c <= KK_RAW_UTF8_OFS + 0xFF) {
+      extra_count += 3;  // encoded as 4 utf bytes but just 1 output byte needed
     }
   }
-  kk_assert_internal(p == end);
-  if (extra_count == 0) {
+  if (extra_count == 0 && !kk_bytes_is_view_borrow(str.bytes)) {
     *should_free = false;
     return (const char*)s;
   }
 
-  // contains raw bytes, allocate a buffer;
+  // contains raw bytes (or is a view), allocate a buffer;
   kk_assert_internal(extra_count < len);
   const kk_ssize_t blen = len - extra_count;
   uint8_t* bstr = (uint8_t*)kk_malloc(blen + 1, ctx);
@@ -283,16 +572,18 @@ const char* kk_string_to_qutf8_borrow(kk_string_t str, bool* should_free, kk_con
   uint8_t* q = bstr;
   p = s;
   while (p < end) {
-    // optimize for ascii
-    // todo: optimize further with word reads?
     if (kk_likely(*p < 0x80)) {
-      *q++ = *p++;
+      // copy ascii
+      const uint8_t* r = kk_utf8_kernels.skip_ascii(p, end);
+      kk_memcpy(q, p, r - p);
+      q += (r - p);
+      p = r;
     }
     else {
       kk_ssize_t count;
       kk_char_t c = kk_utf8_read(p, &count);
       p += count;
-      if (c >= KK_RAW_UTF8_OFS && c <= KK_RAW_UTF8_OFS + 0x7F) {
+      if (c >= KK_RAW_UTF8_OFS + 0x80 && c <= KK_RAW_UTF8_OFS + 0xFF) {
         *q++ = (uint8_t)(c - KK_RAW_UTF8_OFS);
       }
       else {
@@ -320,6 +611,12 @@ uint16_t* kk_string_to_qutf16_borrow(kk_string_t str, kk_context_t* ctx) {
   // count utf-16 length (in 16-bit units)
   kk_ssize_t wlen = 0;
   for (const uint8_t* p = s; p < end; ) {
+    if (*p < 0x80 && p[1] < 0x80) {  // ascii run (and `p[1]` may be the zero terminator)
+      const uint8_t* q = kk_utf8_kernels.skip_ascii(p, end);
+      wlen += (q - p);
+      p = q;
+      continue;
+    }
     kk_ssize_t count;
     kk_char_t c = kk_utf8_read(p, &count);
     p += count;
@@ -334,6 +631,12 @@ uint16_t* kk_string_to_qutf16_borrow(kk_string_t str, kk_context_t* ctx) {
   uint16_t* wstr = (uint16_t*)kk_malloc((wlen + 1) * kk_ssizeof(uint16_t), ctx);
   uint16_t* q = wstr;
   for (const uint8_t* p = s; p < end; ) {
+    if (*p < 0x80 && p[1] < 0x80) {  // ascii run
+      const uint8_t* r = kk_utf8_widen_ascii(q, p, end);
+      q += (r - p);
+      p = r;
+      continue;
+    }
     kk_ssize_t count;
     kk_char_t c = kk_utf8_read(p, &count);
     p += count;
@@ -364,12 +667,19 @@ static kk_string_t kk_string_alloc_from_qutf16n_prim(kk_ssize_t wlen, const uint
   const uint16_t* const end = wstr + wlen;
   for (const uint16_t* p = wstr; p < end; p++) {
     if (*p <= 0x7F) {
-      len++;
+      if (p+1 < end && p[1] <= 0x7F) {  // ascii run
+        const uint16_t* q = kk_utf16_skip_ascii(p, end);
+        len += (q - p);
+        p = q - 1;
+      }
+      else {
+        len++;
+      }
     }
     else if (*p <= 0x7FF) {
       len += 2;
     }
-    else if (*p <= 0xD800 || *p > 0xDFFF) {
+    else if (*p < 0xD800 || *p > 0xDFFF) {
       len += 3;
     }
     else if (*p <= 0xDBFF && p+1 < end && (p[1] >= 0xDC00 && p[1] <= 0xDFFF)) {
@@ -397,13 +707,19 @@ static kk_string_t kk_string_alloc_from_qutf16n_prim(kk_ssize_t wlen, const uint
   kk_string_t str = kk_unsafe_string_alloc_buf(len, &s, ctx);  
   uint8_t* q = s;
   for (const uint16_t* p = wstr; p < end; p++) {
-    // optimize for ascii
     if (*p <= 0x7F) {
-      *q++ = (uint8_t)*p;
+      if (p+1 < end && p[1] <= 0x7F) {  // ascii run
+        const uint16_t* r = kk_utf16_narrow_ascii(q, p, end);
+        q += (r - p);
+        p = r - 1;
+      }
+      else {
+        *q++ = (uint8_t)*p;
+      }
     }
     else {
       kk_char_t c;
-      if (*p <= 0xD800) {
+      if (*p < 0xD800 || *p > 0xDFFF) {
         c = *p;
       }
       else if (*p <= 0xDBFF && p+1 < end && (p[1] >= 0xDC00 && p[1] <= 0xDFFF)) {
@@ -516,20 +832,19 @@ kk_ssize_t kk_decl_pure kk_string_count_pattern_borrow(kk_string_t str, kk_strin
   if (patlen <= 0)  return kk_string_count_borrow(str);
   if (patlen > len) return 0;
   
-  //todo: optimize by doing backward Boyer-Moore? or use forward Knuth-Morris-Pratt?
+  kk_memsearch_t ms;
+  kk_memsearch_init(&ms, pat, patlen, false);
   kk_ssize_t count = 0;
-  const uint8_t* end = s + (len - (patlen - 1));
-  for (const uint8_t* p = s; p < end; p++) {
-    if (kk_memcmp(p, pat, patlen) == 0) {
-      count++;
-      p += (patlen - 1);
-    }    
+  const uint8_t* const end = s + len;
+  for (const uint8_t* p = s; (p = kk_memsearch_find(&ms, p, end - p)) != NULL; p += patlen) {
+    count++;
   }
   return count;
 }
 
 
 kk_string_t kk_string_from_char(kk_char_t c, kk_context_t* ctx) {
+  if (c >= 0 && c < 0x80) return kk_unsafe_bytes_as_string(kk_bytes_from_ascii((uint8_t)c, ctx));
   uint8_t buf[16];
   kk_ssize_t count;
   kk_utf8_write(c, buf, &count);
@@ -585,11 +900,14 @@ kk_vector_t kk_string_splitv_atmost(kk_string_t str, kk_string_t sepstr, kk_ssiz
   kk_ssize_t seplen;
   const uint8_t* sep = kk_string_buf_borrow(sepstr, &seplen);
 
+  kk_memsearch_t ms;
+  kk_memsearch_init(&ms, sep, seplen, false);
+
   // count parts
   kk_ssize_t count = 1;
   if (seplen > 0) {    
     const uint8_t* p = s;
-    while (count < n && (p = kk_memmem(p, end - p, sep, seplen)) != NULL) {
+    while (count < n && (p = kk_memsearch_find(&ms, p, end - p)) != NULL) {
       p += seplen;
       count++;
     }
@@ -607,77 +925,351 @@ kk_vector_t kk_string_splitv_atmost(kk_string_t str, kk_string_t sepstr, kk_ssiz
   for (kk_ssize_t i = 0; i < (count-1) && p < end; i++) {
     const uint8_t* r;
     if (seplen > 0) {
-      r = kk_memmem(p, end - p,  sep, seplen);
+      r = kk_memsearch_find(&ms, p, end - p);
     }
     else {
       r = kk_utf8_next(p);
     }
     kk_assert_internal(r != NULL && r >= p && r < end);    
     const kk_ssize_t partlen = (r - p);
-    v[i] = kk_string_box(kk_string_alloc_dupn_valid_utf8(partlen, p, ctx));
+    v[i] = kk_string_box(kk_string_alloc_view(str, p - s, partlen, ctx));
     p = r + seplen;  // advance
   }
   kk_assert_internal(p <= end);
-  v[count-1] = kk_string_box(kk_string_alloc_dupn_valid_utf8(end - p, p, ctx));  // todo: share string if p == s ?
+  v[count-1] = kk_string_box(kk_string_alloc_view(str, p - s, end - p, ctx));
   kk_string_drop(str,ctx);
   kk_string_drop(sepstr, ctx);
   return vec;
 }
 
+kk_string_t kk_string_join(kk_vector_t v, kk_context_t* ctx) {
+  return kk_string_join_with(v, kk_string_empty(), ctx);
+}
+
+// Concatenate with a separator: we first compute the total length so we copy each part just once.
+kk_string_t kk_string_join_with(kk_vector_t v, kk_string_t sep, kk_context_t* ctx) {
+  kk_ssize_t n;
+  kk_box_t* vs = kk_vector_buf_borrow(v, &n);
+  kk_string_t s;
+  if (n == 1) {
+    s = kk_string_dup(kk_string_unbox(vs[0]));
+  }
+  else {
+    kk_ssize_t seplen;
+    const uint8_t* psep = kk_string_buf_borrow(sep, &seplen);
+    kk_ssize_t len = (n > 0 ? (n - 1)*seplen : 0);
+    for (kk_ssize_t i = 0; i < n; i++) {
+      kk_ssize_t xlen;
+      kk_string_buf_borrow(kk_string_unbox(vs[i]), &xlen);
+      len += xlen;
+    }
+    uint8_t* p;
+    s = kk_unsafe_string_alloc_buf(len, &p, ctx);
+    for (kk_ssize_t i = 0; i < n; i++) {
+      if (i > 0) {
+        kk_memcpy(p, psep, seplen);
+        p += seplen;
+      }
+      kk_ssize_t xlen;
+      const uint8_t* x = kk_string_buf_borrow(kk_string_unbox(vs[i]), &xlen);
+      kk_memcpy(p, x, xlen);
+      p += xlen;
+    }
+    kk_assert_internal(p == kk_string_buf_borrow(s, NULL) + len);
+  }
+  kk_vector_drop(v, ctx);
+  kk_string_drop(sep, ctx);
+  return s;
+}
 
 
 /*--------------------------------------------------------------------------------------------------
-
+  Interning
+  A process wide open addressing table (with linear probing) of frozen strings.
 --------------------------------------------------------------------------------------------------*/
 
-kk_string_t kk_string_to_upper(kk_string_t str, kk_context_t* ctx) {
+static struct {
+  kk_bytes_t* entries;       // kk_bytes_empty() for free entries
+  kk_ssize_t  capacity;      // power of 2 (or 0)
+  kk_ssize_t  count;
+} kk_intern_table;
+
+static _Atomic(uintptr_t) kk_intern_lock;
+
+static void kk_intern_table_lock(void) {
+  uintptr_t expected = 0;
+  while (!kk_atomic_cas_weak_acq_rel(&kk_intern_lock, &expected, 1)) { expected = 0; }
+}
+
+static void kk_intern_table_unlock(void) {
+  kk_atomic_store_release(&kk_intern_lock, 0);
+}
+
+static kk_ssize_t kk_intern_table_find(kk_bytes_t b, uint32_t hash) {
+  kk_ssize_t i = (kk_ssize_t)hash & (kk_intern_table.capacity - 1);
+  while (true) {
+    kk_bytes_t e = kk_intern_table.entries[i];
+    if (kk_datatype_is_singleton(e)) return i;
+    if (kk_bytes_hash_borrow(e) == hash && kk_bytes_is_eq_borrow(e, b)) return i;
+    i = (i + 1) & (kk_intern_table.capacity - 1);
+  }
+}
+
+static bool kk_intern_table_grow(void) {
+  const kk_ssize_t oldcap = kk_intern_table.capacity;
+  kk_bytes_t* const old = kk_intern_table.entries;
+  const kk_ssize_t newcap = (oldcap == 0 ? 256 : 2*oldcap);
+  kk_bytes_t* entries = (kk_bytes_t*)malloc((size_t)newcap * sizeof(kk_bytes_t));
+  if (entries == NULL) return false;
+  for (kk_ssize_t i = 0; i < newcap; i++) { entries[i] = kk_bytes_empty(); }
+  kk_intern_table.entries = entries;
+  kk_intern_table.capacity = newcap;
+  for (kk_ssize_t i = 0; i < oldcap; i++) {
+    kk_bytes_t e = old[i];
+    if (!kk_datatype_is_singleton(e)) {
+      entries[kk_intern_table_find(e, kk_bytes_hash_borrow(e))] = e;
+    }
+  }
+  free(old);
+  return true;
+}
+
+kk_string_t kk_string_intern(kk_string_t str, kk_context_t* ctx) {
   kk_ssize_t len;
-  const uint8_t* s = kk_string_buf_borrow(str,&len);
-  kk_string_t tstr; 
-  if (kk_datatype_is_unique(str.bytes)) {
-    tstr = str;  // update in-place
+  const uint8_t* p = kk_string_buf_borrow(str, &len);
+  if (len == 0) return str;
+  if (len == 1 && p[0] < 0x80) {
+    // single ascii characters are already static
+    const uint8_t c = p[0];
+    kk_string_drop(str, ctx);
+    return kk_unsafe_bytes_as_string(kk_bytes_from_ascii(c, ctx));
   }
-  else {
-    kk_string_dup(str);  // multi-thread safe as we still reference str with s
-    tstr = kk_string_copy(str, ctx);
-    kk_assert_internal(!kk_datatype_eq(str.bytes, tstr.bytes));
+  // we freeze the string in place if we own it
+  kk_bytes_t b = str.bytes;
+  if (!kk_datatype_is_unique(b) || kk_datatype_has_tag(b, KK_TAG_BYTES_RAW)) {
+    b = kk_bytes_alloc_dupn(len, p, ctx);
   }
-  uint8_t* t = (uint8_t*)kk_string_buf_borrow(tstr,NULL);   // t & s may alias!
-  for (kk_ssize_t i = 0; i < len; i++) {
-    t[i] = kk_ascii_toupper(s[i]);
+  const uint32_t hash = kk_bytes_hash_borrow(b);
+  kk_intern_table_lock();
+  if (4*(kk_intern_table.count + 1) > 3*kk_intern_table.capacity && !kk_intern_table_grow()) {
+    kk_intern_table_unlock();
+    if (!kk_datatype_eq(b, str.bytes)) kk_bytes_drop(b, ctx);
+    return str;  // out of memory: return the string as is
   }
-  if (!kk_datatype_eq(str.bytes,tstr.bytes)) kk_string_drop(str, ctx);  // drop if not reused in-place
-  return tstr;
+  const kk_ssize_t i = kk_intern_table_find(b, hash);
+  kk_bytes_t e = kk_intern_table.entries[i];
+  if (kk_datatype_is_singleton(e)) {
+    kk_block_freeze(kk_datatype_as_ptr(b), ctx);
+    kk_intern_table.entries[i] = e = b;
+    kk_intern_table.count++;
+  }
+  kk_intern_table_unlock();
+  if (!kk_datatype_eq(e, b)) kk_bytes_drop(b, ctx);    // already interned
+  if (!kk_datatype_eq(b, str.bytes)) kk_string_drop(str, ctx);
+  return kk_unsafe_bytes_as_string(e);                  // frozen, so no need to dup
 }
 
-kk_string_t  kk_string_to_lower(kk_string_t str, kk_context_t* ctx) {
-  kk_ssize_t len;
-  const uint8_t* s = kk_string_buf_borrow(str, &len);
-  kk_string_t tstr;
-  if (kk_datatype_is_unique(str.bytes)) {
-    tstr = str;  // update in-place
+
+
+/*--------------------------------------------------------------------------------------------------
+  ASCII case conversion, trimming, and case insensitive comparison
+  Upper and lower case ascii letters differ only in bit 5 (0x20), so both conversions flip
+  that bit for the letters in a range `[lo,hi]`. The kernels process 16 bytes at a time with
+  SSE2, and otherwise a word at a time: in a word we compute for the bytes below 0x80 whether
+  they are at least `lo` and larger than `hi` by adding constants that never carry into the
+  next byte. Bytes of multi-byte utf-8 sequences (0x80 and above) are never changed.
+--------------------------------------------------------------------------------------------------*/
+
+// For each byte `c < 0x80` of `w` with `lo <= c <= hi`, the corresponding byte in the result is 0x20.
+static inline kk_uintx_t kk_ascii_range_bits(kk_uintx_t w, uint8_t lo, uint8_t hi) {
+  const kk_uintx_t x  = w & ~kk_bits_high_mask;
+  const kk_uintx_t ge = x + kk_bits_one_mask*(kk_uintx_t)(0x80 - lo);   // high bit set iff `x >= lo`
+  const kk_uintx_t gt = x + kk_bits_one_mask*(kk_uintx_t)(0x7F - hi);   // high bit set iff `x > hi`
+  return ((ge & ~gt & ~w & kk_bits_high_mask) >> 2);
+}
+
+static inline kk_uintx_t kk_ascii_load_word(const uint8_t* p) {
+  kk_uintx_t w;
+  kk_memcpy(&w, p, sizeof(w));
+  return w;
+}
+
+// Return the first byte in `[s,end)` in the range `[lo,hi]` (or `end`).
+static const uint8_t* kk_ascii_find_range_generic(const uint8_t* s, const uint8_t* end, uint8_t lo, uint8_t hi) {
+  const uint8_t* p = s;
+  for (; p + sizeof(kk_uintx_t) <= end; p += sizeof(kk_uintx_t)) {
+    if (kk_ascii_range_bits(kk_ascii_load_word(p), lo, hi) != 0) break;
   }
-  else {
-    kk_string_dup(str);  // multi-thread safe as we still reference str with s
-    tstr = kk_string_copy(str, ctx);
-    kk_assert_internal(!kk_datatype_eq(str.bytes, tstr.bytes));
+  for (; p < end && (*p < lo || *p > hi); p++) {}
+  return p;
+}
+
+// Flip the case bit of every byte in the range `[lo,hi]` while copying `[s,end)` to `t` (which can be equal to `s`).
+static void kk_ascii_flip_range_generic(uint8_t* t, const uint8_t* s, const uint8_t* end, uint8_t lo, uint8_t hi) {
+  const uint8_t* p = s;
+  for (; p + sizeof(kk_uintx_t) <= end; p += sizeof(kk_uintx_t), t += sizeof(kk_uintx_t)) {
+    const kk_uintx_t w = kk_ascii_load_word(p);
+    const kk_uintx_t v = w ^ kk_ascii_range_bits(w, lo, hi);
+    kk_memcpy(t, &v, sizeof(v));
+  }
+  for (; p < end; p++, t++) {
+    *t = (*p >= lo && *p <= hi ? (*p ^ 0x20) : *p);
+  }
+}
+
+static const uint8_t* kk_ascii_skip_white_generic(const uint8_t* s, const uint8_t* end) {
+  const uint8_t* p = s;
+  for (; p < end && kk_ascii_iswhite(*p); p++) {}
+  return p;
+}
+
+// Return the end of `[s,end)` without the trailing white space.
+static const uint8_t* kk_ascii_skip_white_rev_generic(const uint8_t* s, const uint8_t* end) {
+  const uint8_t* p = end;
+  for (; p > s && kk_ascii_iswhite(p[-1]); p--) {}
+  return p;
+}
+
+static int kk_memicmp_generic(const uint8_t* s, const uint8_t* t, kk_ssize_t len) {
+  kk_ssize_t i = 0;
+  for (; i + kk_ssizeof(kk_uintx_t) <= len; i += kk_ssizeof(kk_uintx_t)) {
+    const kk_uintx_t v = kk_ascii_load_word(s + i);
+    const kk_uintx_t w = kk_ascii_load_word(t + i);
+    if (v == w) continue;
+    if ((v ^ kk_ascii_range_bits(v, 'A', 'Z')) != (w ^ kk_ascii_range_bits(w, 'A', 'Z'))) break;
+  }
+  for (; i < len; i++) {
+    const uint8_t c = kk_ascii_tolower(s[i]);
+    const uint8_t d = kk_ascii_tolower(t[i]);
+    if (c != d) return (c < d ? -1 : 1);
+  }
+  return 0;
+}
+
+#if defined(KK_UTF8_SIMD)
+// 0xFF for each byte in the range `[lo,hi]` (with `lo,hi < 0x80` such that we can use signed comparisons)
+static inline __m128i kk_ascii_range_mask_sse2(__m128i v, uint8_t lo, uint8_t hi) {
+  return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8((char)(lo - 1))), _mm_cmpgt_epi8(_mm_set1_epi8((char)(hi + 1)), v));
+}
+
+static inline __m128i kk_ascii_tolower_sse2(__m128i v) {
+  return _mm_xor_si128(v, _mm_and_si128(kk_ascii_range_mask_sse2(v, 'A', 'Z'), _mm_set1_epi8(0x20)));
+}
+
+static const uint8_t* kk_ascii_find_range_sse2(const uint8_t* s, const uint8_t* end, uint8_t lo, uint8_t hi) {
+  const uint8_t* p = s;
+  for (; p + 16 <= end; p += 16) {
+    const int mask = _mm_movemask_epi8(kk_ascii_range_mask_sse2(_mm_loadu_si128((const __m128i*)p), lo, hi));
+    if (mask != 0) return (p + kk_bits_ctz32((uint32_t)mask));
+  }
+  return kk_ascii_find_range_generic(p, end, lo, hi);
+}
+
+static void kk_ascii_flip_range_sse2(uint8_t* t, const uint8_t* s, const uint8_t* end, uint8_t lo, uint8_t hi) {
+  const __m128i bit = _mm_set1_epi8(0x20);
+  const uint8_t* p = s;
+  for (; p + 16 <= end; p += 16, t += 16) {
+    const __m128i v = _mm_loadu_si128((const __m128i*)p);
+    _mm_storeu_si128((__m128i*)t, _mm_xor_si128(v, _mm_and_si128(kk_ascii_range_mask_sse2(v, lo, hi), bit)));
+  }
+  kk_ascii_flip_range_generic(t, p, end, lo, hi);
+}
+
+static inline int kk_ascii_white_mask_sse2(__m128i v) {
+  const __m128i w = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+                                 _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+  return _mm_movemask_epi8(w);
+}
+
+static const uint8_t* kk_ascii_skip_white_sse2(const uint8_t* s, const uint8_t* end) {
+  const uint8_t* p = s;
+  for (; p + 16 <= end; p += 16) {
+    const int mask = kk_ascii_white_mask_sse2(_mm_loadu_si128((const __m128i*)p));
+    if (mask != 0xFFFF) return (p + kk_bits_ctz32((uint32_t)~mask));
   }
-  uint8_t* t = (uint8_t*)kk_string_buf_borrow(tstr, NULL);   // t & s may alias!
-  for (kk_ssize_t i = 0; i < len; i++) {
-    t[i] = kk_ascii_tolower(s[i]);
+  return kk_ascii_skip_white_generic(p, end);
+}
+
+static const uint8_t* kk_ascii_skip_white_rev_sse2(const uint8_t* s, const uint8_t* end) {
+  const uint8_t* p = end;
+  for (; p - 16 >= s; p -= 16) {
+    const int mask = kk_ascii_white_mask_sse2(_mm_loadu_si128((const __m128i*)(p - 16)));
+    if (mask != 0xFFFF) return (p - 16 + 32 - kk_bits_clz32((uint32_t)(~mask & 0xFFFF)));
+  }
+  return kk_ascii_skip_white_rev_generic(s, p);
+}
+
+static int kk_memicmp_sse2(const uint8_t* s, const uint8_t* t, kk_ssize_t len) {
+  kk_ssize_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    const __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+    const __m128i w = _mm_loadu_si128((const __m128i*)(t + i));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, w)) == 0xFFFF) continue;
+    const int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(kk_ascii_tolower_sse2(v), kk_ascii_tolower_sse2(w)));
+    if (mask != 0xFFFF) {
+      const kk_ssize_t j = i + kk_bits_ctz32((uint32_t)~mask);
+      const uint8_t c = kk_ascii_tolower(s[j]);
+      const uint8_t d = kk_ascii_tolower(t[j]);
+      return (c < d ? -1 : 1);
+    }
+  }
+  return kk_memicmp_generic(s + i, t + i, len - i);
+}
+
+#define kk_ascii_find_range(s,end,lo,hi)    kk_ascii_find_range_sse2(s,end,lo,hi)
+#define kk_ascii_flip_range(t,s,end,lo,hi)  kk_ascii_flip_range_sse2(t,s,end,lo,hi)
+#define kk_ascii_skip_white(s,end)          kk_ascii_skip_white_sse2(s,end)
+#define kk_ascii_skip_white_rev(s,end)      kk_ascii_skip_white_rev_sse2(s,end)
+#define kk_memicmp_kernel(s,t,len)          kk_memicmp_sse2(s,t,len)
+#else
+#define kk_ascii_find_range(s,end,lo,hi)    kk_ascii_find_range_generic(s,end,lo,hi)
+#define kk_ascii_flip_range(t,s,end,lo,hi)  kk_ascii_flip_range_generic(t,s,end,lo,hi)
+#define kk_ascii_skip_white(s,end)          kk_ascii_skip_white_generic(s,end)
+#define kk_ascii_skip_white_rev(s,end)      kk_ascii_skip_white_rev_generic(s,end)
+#define kk_memicmp_kernel(s,t,len)          kk_memicmp_generic(s,t,len)
+#endif
+
+static int kk_memicmp(const uint8_t* s, const uint8_t* t, kk_ssize_t len) {
+  if (s==t) return 0;
+  return kk_memicmp_kernel(s, t, len);
+}
+
+// Convert the letters in `[lo,hi]` to the other case: in-place if `str` is unique, and
+// otherwise only allocate a new string if there is any letter to convert.
+static kk_string_t kk_string_flip_ascii_range(kk_string_t str, uint8_t lo, uint8_t hi, kk_context_t* ctx) {
+  kk_ssize_t len;
+  const uint8_t* s = kk_string_buf_borrow(str, &len);
+  const uint8_t* p = kk_ascii_find_range(s, s + len, lo, hi);
+  if (p == s + len) return str;  // nothing to convert
+  if (kk_bytes_is_unique_owned(str.bytes)) {
+    uint8_t* t = (uint8_t*)p;    // update in-place
+    kk_ascii_flip_range(t, p, s + len, lo, hi);
+    kk_bytes_unsafe_clear_hash(str.bytes);
+    return str;
   }
-  if (!kk_datatype_eq(str.bytes, tstr.bytes)) kk_string_drop(str, ctx);  // drop if not reused in-place
+  uint8_t* t;
+  kk_string_t tstr = kk_unsafe_string_alloc_buf(len, &t, ctx);
+  kk_memcpy(t, s, p - s);
+  kk_ascii_flip_range(t + (p - s), p, s + len, lo, hi);
+  kk_string_drop(str, ctx);
   return tstr;
 }
 
+kk_string_t kk_string_to_upper(kk_string_t str, kk_context_t* ctx) {
+  return kk_string_flip_ascii_range(str, 'a', 'z', ctx);
+}
+
+kk_string_t  kk_string_to_lower(kk_string_t str, kk_context_t* ctx) {
+  return kk_string_flip_ascii_range(str, 'A', 'Z', ctx);
+}
+
 kk_string_t  kk_string_trim_left(kk_string_t str, kk_context_t* ctx) {
   kk_ssize_t len;
   const uint8_t* s = kk_string_buf_borrow(str, &len);
-  const uint8_t* p = s;
-  for ( ; *p != 0 && kk_ascii_iswhite(*p); p++) { }
+  const uint8_t* p = kk_ascii_skip_white(s, s + len);
   if (p == s) return str;           // no trim needed
   const kk_ssize_t tlen = len - (p - s);      // todo: if s is unique and tlen close to slen, move inplace?
-  kk_string_t tstr = kk_string_alloc_dupn_valid_utf8(tlen, p, ctx);
+  kk_string_t tstr = kk_string_alloc_view(str, p - s, tlen, ctx);
   kk_string_drop(str, ctx);
   return tstr;
 }
@@ -685,82 +1277,135 @@ kk_string_t  kk_string_trim_left(kk_string_t str, kk_context_t* ctx) {
 kk_string_t  kk_string_trim_right(kk_string_t str, kk_context_t* ctx) {
   kk_ssize_t len;
   const uint8_t* s = kk_string_buf_borrow(str, &len);
-  const uint8_t* p = s + len - 1;
-  for (; p >= s && kk_ascii_iswhite(*p); p--) {}
-  const kk_ssize_t tlen = (p - s) + 1;
+  const kk_ssize_t tlen = kk_ascii_skip_white_rev(s, s + len) - s;
   if (len == tlen) return str;  // no trim needed
-  kk_string_t tstr = kk_string_alloc_dupn_valid_utf8(tlen, s, ctx);
+  kk_string_t tstr = kk_string_alloc_view(str, 0, tlen, ctx);
   kk_string_drop(str, ctx);
   return tstr;
 }
 
 /*--------------------------------------------------------------------------------------------------
-
+  Buffered standard output
+  `kk_print` and `kk_println` append to a process-wide buffer that is written to `stdout` as a
+  whole when it is full, at every newline if `stdout` is a terminal, at `kk_main_end`, when a
+  parallel task completes, and before any write to `stderr`, so the output order is maintained
+  across threads. The buffer is protected by a spin lock as appends are short. A single print is
+  never split over two flushes (unless it is larger than the buffer) such that output of
+  concurrent threads does not interleave within a line.
 --------------------------------------------------------------------------------------------------*/
 
+#if defined(WIN32)
+#include <io.h>
+#define kk_isatty(f)  _isatty(_fileno(f))
+#else
+#include <unistd.h>
+#define kk_isatty(f)  isatty(fileno(f))
+#endif
+
+static struct {
+  kk_ssize_t len;
+  int        tty;   // 0: unknown, 1: yes, 2: no
+  uint8_t    buf[KK_STDOUT_BUFSIZE];
+} kk_outbuf;
+
+static _Atomic(uintptr_t) kk_outbuf_lock;
+
+static void kk_stdout_lock(void) {
+  uintptr_t expected = 0;
+  while (!kk_atomic_cas_weak_acq_rel(&kk_outbuf_lock, &expected, 1)) { expected = 0; }
+}
+
+static void kk_stdout_unlock(void) {
+  kk_atomic_store_release(&kk_outbuf_lock, 0);
+}
+
+// Called with the lock held
+static void kk_stdout_flush_locked(void) {
+  if (kk_outbuf.len == 0) return;
+  fwrite(kk_outbuf.buf, 1, (size_t)kk_outbuf.len, stdout);
+  fflush(stdout);
+  kk_outbuf.len = 0;
+}
+
+kk_decl_export void kk_stdout_flush(kk_context_t* ctx) {
+  KK_UNUSED(ctx);
+  kk_stdout_lock();
+  kk_stdout_flush_locked();
+  kk_outbuf.tty = 0;  // re-detect on the next write as `stdout` may have been redirected
+  kk_stdout_unlock();
+}
+
+static void kk_stdout_write(const uint8_t* s, kk_ssize_t len, bool newline, kk_context_t* ctx) {
+  KK_UNUSED(ctx);
+  const kk_ssize_t total = len + (newline ? 1 : 0);
+  kk_stdout_lock();
+  if (kk_unlikely(kk_outbuf.tty == 0)) {
+    kk_outbuf.tty = (kk_isatty(stdout) != 0 ? 1 : 2);
+  }
+  if (kk_outbuf.len + total > KK_STDOUT_BUFSIZE) {
+    kk_stdout_flush_locked();
+    if (total > KK_STDOUT_BUFSIZE) {
+      // too large to buffer
+      fwrite(s, 1, (size_t)len, stdout);
+      if (newline) fputc('\n', stdout);
+      fflush(stdout);
+      kk_stdout_unlock();
+      return;
+    }
+  }
+  kk_memcpy(kk_outbuf.buf + kk_outbuf.len, s, len);
+  kk_outbuf.len += len;
+  if (newline) { kk_outbuf.buf[kk_outbuf.len++] = '\n'; }
+  if (kk_outbuf.tty == 1 && (newline || memchr(s, '\n', (size_t)len) != NULL)) {
+    kk_stdout_flush_locked();
+  }
+  kk_stdout_unlock();
+}
+
+// Write to `stderr` (after flushing `stdout`)
+static void kk_stderr_write(const uint8_t* s, kk_ssize_t len, bool newline, kk_context_t* ctx) {
+  kk_stdout_flush(ctx);
+  fwrite(s, 1, (size_t)len, stderr);
+  if (newline) fputc('\n', stderr);
+}
+
 kk_unit_t kk_println(kk_string_t s, kk_context_t* ctx) {
   // TODO: set locale to utf-8?
-  puts(kk_string_cbuf_borrow(s,NULL));  // todo: allow printing embedded 0 characters?
+  kk_ssize_t len;
+  const uint8_t* buf = kk_string_buf_borrow(s, &len);
+  kk_stdout_write(buf, len, true, ctx);
   kk_string_drop(s,ctx);
   return kk_Unit;
 }
 
 kk_unit_t kk_print(kk_string_t s, kk_context_t* ctx) {
   // TODO: set locale to utf-8?
-  fputs(kk_string_cbuf_borrow(s,NULL), stdout); // todo: allow printing embedded 0 characters?
+  kk_ssize_t len;
+  const uint8_t* buf = kk_string_buf_borrow(s, &len);
+  kk_stdout_write(buf, len, false, ctx);
   kk_string_drop(s,ctx);
   return kk_Unit;
 }
 
 kk_unit_t kk_trace(kk_string_t s, kk_context_t* ctx) {
-  fputs(kk_string_cbuf_borrow(s,NULL), stderr); // todo: allow printing embedded 0 characters?
-  fputs("\n", stderr);
+  kk_ssize_t len;
+  const uint8_t* buf = kk_string_buf_borrow(s, &len);
+  kk_stderr_write(buf, len, true, ctx);
   kk_string_drop(s, ctx);
   return kk_Unit;
 }
 
 kk_unit_t kk_trace_any(kk_string_t s, kk_box_t x, kk_context_t* ctx) {
-  fprintf(stderr, "%s: ", kk_string_cbuf_borrow(s,NULL));
+  kk_ssize_t len;
+  const uint8_t* buf = kk_string_buf_borrow(s, &len);
+  kk_stderr_write(buf, len, false, ctx);
+  fputs(": ", stderr);
   kk_string_drop(s, ctx);
   kk_trace(kk_show_any(x,ctx),ctx);
   return kk_Unit;
 }
 
 
-static kk_string_t kk_double_show_spec(double d, int32_t prec, char spec, kk_context_t* ctx) {
-  char buf[64];
-  char fmt[16];
-  if (prec < 0)  prec = -prec;
-  if (prec > 48) prec = 48;
-  snprintf(fmt, 16, "%%.%i%c", (int)prec, spec);
-  snprintf(buf, 64, fmt, d);
-  // check if it ends with a 0 exponent and remove if so. 
-  char* p = buf;
-  while (*p != 'e' && *p != 0) { p++; }
-  if (p[0] == 'e'
-      && (p[1] == '+' || p[1] == '-')
-      && (p[2] == '0')
-      && (p[3] == 0 || (p[3] == '0' && (p[4] == 0 || (p[4] == '0' && p[5] == 0))))) 
-  {
-    *p = 0; // remove exponent
-  }
-  return kk_string_alloc_dup_valid_utf8(buf, ctx);
-}
-
-kk_string_t kk_double_show_fixed(double d, int32_t prec, kk_context_t* ctx) {
-  return kk_double_show_spec(d, prec, prec < 0 ? 'g' : 'f', ctx);
-}
-
-kk_string_t kk_double_show_exp(double d, int32_t prec, kk_context_t* ctx) {
-  return kk_double_show_spec(d, prec, prec < 0 ? 'g' : 'e', ctx);
-}
-
-kk_string_t kk_double_show(double d, int32_t prec, kk_context_t* ctx) {
-  return kk_double_show_spec(d, prec, 'g', ctx);
-}
-
-
-
 kk_string_t kk_show_any(kk_box_t b, kk_context_t* ctx) {
   char buf[128];
 #if KK_USE_NAN_BOX
@@ -0,0 +1,623 @@
+/*---------------------------------------------------------------------------
+  Copyright 2021, Microsoft Research, Daan Leijen.
+
+  This is free software; you can redistribute it and/or modify it under the
+  terms of the Apache License, Version 2.0. A copy of the License can be
+  found in the LICENSE file at the root of this distribution.
+---------------------------------------------------------------------------*/
+#include "kklib.h"
+
+/*--------------------------------------------------------------------------------------------------
+  Parallel tasks
+
+  We use a pool of worker threads where each worker has its own `kk_context_t` (and heap).
+  Each worker owns a Chase-Lev work-stealing deque: it pushes and pops tasks at the bottom
+  while idle workers steal from the top. Threads that are not a worker (like the main thread)
+  push new tasks on a shared `inject` queue instead.
+
+  A task is represented by a `kk_task_t` in the C heap that is referenced by the future
+  (a raw block) and by the pool (while the task is queued). On `kk_task_await` we help by
+  running other tasks until the awaited task is done. Since work is always stolen and
+  never blocked on, the main thread can await even if the pool has no workers at all.
+
+  The spawned function and its result are marked as thread shared (`kk_block_mark_shared`)
+  so all further reference count operations on them are atomic.
+
+  See: "Correct and efficient work-stealing for weak memory models", Nhat Minh Lê et al., PPoPP'13.
+--------------------------------------------------------------------------------------------------*/
+
+typedef struct kk_task_s {
+  _Atomic(uint32_t)  rc;       // number of references - 1 (the future and the pool)
+  _Atomic(uintptr_t) done;     // set to 1 (with release) once `result` is available
+  kk_function_t      fun;      // the (thread shared) function to run (or `NULL` once started)
+  kk_box_t           result;   // the (thread shared) result
+  struct kk_task_s*  next;     // next task in the inject queue
+} kk_task_t;
+
+static kk_task_t* kk_task_alloc(kk_function_t fun, kk_context_t* ctx) {
+  kk_task_t* t = (kk_task_t*)kk_malloc(kk_ssizeof(kk_task_t), ctx);
+  if (t == NULL) kk_fatal_error(ENOMEM, "unable to allocate a task");
+  kk_atomic_store_relaxed(&t->rc, 1);  // referenced by the future and the pool
+  kk_atomic_store_relaxed(&t->done, 0);
+  t->fun = fun;
+  t->result = kk_box_null;
+  t->next = NULL;
+  return t;
+}
+
+static void kk_task_release(kk_task_t* t, kk_context_t* ctx) {
+  if (kk_atomic_dec32_acq_rel(&t->rc) != 0) return;
+  if (t->fun != NULL) kk_function_drop(t->fun, ctx);
+  if (kk_atomic_load_relaxed(&t->done) != 0) kk_box_drop(t->result, ctx);
+  kk_free(t);
+}
+
+static void kk_task_free_fun(void* p, kk_block_t* b) {
+  KK_UNUSED(b);
+  kk_task_release((kk_task_t*)p, kk_get_context());
+}
+
+// Run a task and publish its result.
+static void kk_task_run(kk_task_t* t, kk_context_t* ctx) {
+  kk_function_t fun = t->fun;
+  t->fun = NULL;
+  kk_box_t res = kk_function_call(kk_box_t, (kk_function_t, kk_context_t*), fun, (fun, ctx));
+  if (kk_yielding(ctx)) {
+    kk_fatal_error(ENOTSUP, "a parallel task performed an effect operation that was not handled inside the task");
+  }
+  kk_box_mark_shared(res, ctx);
+  kk_stdout_flush(ctx);  // make the output of the task visible before its result
+  t->result = res;
+  kk_atomic_store_release(&t->done, 1);
+}
+
+
+#if KK_MULTI_THREADED
+#include "kklib/thread.h"
+
+/*--------------------------------------------------------------------------------------------------
+  Chase-Lev work-stealing deque
+  We use a fixed size buffer; if it is full the spawning thread runs the task directly.
+  The `top` and `bottom` indices are unsigned and only ever increase (modulo wrap
+  around) so we compare them using their signed difference.
+--------------------------------------------------------------------------------------------------*/
+
+#define KK_TASK_DEQUE_SIZE  (4096)   // must be a power of 2
+
+typedef struct kk_task_deque_s {
+  _Atomic(uintptr_t) top;
+  _Atomic(uintptr_t) bottom;
+  _Atomic(uintptr_t) tasks[KK_TASK_DEQUE_SIZE];  // kk_task_t*
+} kk_task_deque_t;
+
+// Push at the bottom (only called by the owner)
+static bool kk_deque_push(kk_task_deque_t* dq, kk_task_t* task) {
+  const uintptr_t b = kk_atomic_load_relaxed(&dq->bottom);
+  const uintptr_t t = kk_atomic_load_acquire(&dq->top);
+  if ((intptr_t)(b - t) >= KK_TASK_DEQUE_SIZE) return false;  // full
+  kk_atomic_store_relaxed(&dq->tasks[b % KK_TASK_DEQUE_SIZE], (uintptr_t)task);
+  kk_atomic_fence_release();
+  kk_atomic_store_relaxed(&dq->bottom, b + 1);
+  return true;
+}
+
+// Pop from the bottom (only called by the owner)
+static kk_task_t* kk_deque_pop(kk_task_deque_t* dq) {
+  const uintptr_t b = kk_atomic_load_relaxed(&dq->bottom) - 1;
+  kk_atomic_store_relaxed(&dq->bottom, b);
+  kk_atomic_fence_seq_cst();
+  uintptr_t t = kk_atomic_load_relaxed(&dq->top);
+  kk_task_t* task = NULL;
+  if ((intptr_t)(b - t) >= 0) {
+    task = (kk_task_t*)kk_atomic_load_relaxed(&dq->tasks[b % KK_TASK_DEQUE_SIZE]);
+    if (b == t) {
+      // the last element: race against thieves
+      if (!kk_atomic_cas_strong_seq_cst(&dq->top, &t, t + 1)) task = NULL;
+      kk_atomic_store_relaxed(&dq->bottom, b + 1);
+    }
+  }
+  else {
+    kk_atomic_store_relaxed(&dq->bottom, b + 1);  // empty
+  }
+  return task;
+}
+
+// Steal from the top (called by any thread); returns NULL if empty or if we lost a race.
+static kk_task_t* kk_deque_steal(kk_task_deque_t* dq) {
+  uintptr_t t = kk_atomic_load_acquire(&dq->top);
+  kk_atomic_fence_seq_cst();
+  const uintptr_t b = kk_atomic_load_acquire(&dq->bottom);
+  if ((intptr_t)(b - t) <= 0) return NULL;
+  kk_task_t* task = (kk_task_t*)kk_atomic_load_relaxed(&dq->tasks[t % KK_TASK_DEQUE_SIZE]);
+  if (!kk_atomic_cas_strong_seq_cst(&dq->top, &t, t + 1)) return NULL;
+  return task;
+}
+
+
+/*--------------------------------------------------------------------------------------------------
+  The worker pool
+--------------------------------------------------------------------------------------------------*/
+
+typedef struct kk_task_worker_s {
+  kk_task_deque_t  deque;
+  kk_thread_t      thread;
+  kk_ssize_t       index;
+  bool             started;
+  uint32_t         rnd;     // for choosing a victim to steal from
+} kk_task_worker_t;
+
+typedef struct kk_task_pool_s {
+  kk_ssize_t          worker_count;
+  kk_task_worker_t**  workers;
+  kk_mutex_t          lock;          // protects the inject queue and sleeping
+  kk_cond_t           wakeup;
+  kk_task_t*          inject_first;  // tasks spawned from non-worker threads
+  kk_task_t*          inject_last;
+  _Atomic(uintptr_t)  inject_count;
+  _Atomic(uintptr_t)  sleepers;      // number of threads waiting on `wakeup`
+  _Atomic(uintptr_t)  stop;
+} kk_task_pool_t;
+
+static kk_task_pool_t            kk_pool;
+static _Atomic(uintptr_t)        kk_pool_state;             // 0: uninitialized, 1: initializing, 2: ready
+static kk_ssize_t                kk_pool_requested = -1;    // requested worker count (or -1 for the default)
+static kk_decl_thread kk_task_worker_t* kk_task_current_worker;  // the worker of this thread (or NULL)
+
+void kk_task_set_worker_count(kk_ssize_t count) {
+  kk_pool_requested = (count < 0 ? 0 : count);
+}
+
+static void kk_pool_inject(kk_task_pool_t* pool, kk_task_t* t) {
+  kk_mutex_lock(&pool->lock);
+  t->next = NULL;
+  if (pool->inject_last == NULL) { pool->inject_first = t; }
+                            else { pool->inject_last->next = t; }
+  pool->inject_last = t;
+  kk_atomic_store_relaxed(&pool->inject_count, kk_atomic_load_relaxed(&pool->inject_count) + 1);
+  kk_mutex_unlock(&pool->lock);
+}
+
+static kk_task_t* kk_pool_take_injected(kk_task_pool_t* pool) {
+  if (kk_atomic_load_relaxed(&pool->inject_count) == 0) return NULL;
+  kk_mutex_lock(&pool->lock);
+  kk_task_t* t = pool->inject_first;
+  if (t != NULL) {
+    pool->inject_first = t->next;
+    if (pool->inject_first == NULL) pool->inject_last = NULL;
+    kk_atomic_store_relaxed(&pool->inject_count, kk_atomic_load_relaxed(&pool->inject_count) - 1);
+  }
+  kk_mutex_unlock(&pool->lock);
+  return t;
+}
+
+static void kk_pool_wakeup(kk_task_pool_t* pool) {
+  if (kk_atomic_load_relaxed(&pool->sleepers) == 0) return;
+  kk_mutex_lock(&pool->lock);
+  kk_cond_broadcast(&pool->wakeup);
+  kk_mutex_unlock(&pool->lock);
+}
+
+// Sleep until woken up (on new tasks or a finished task), or until a timeout.
+// The timeout ensures progress even if we miss a wakeup.
+static void kk_pool_sleep(kk_task_pool_t* pool, long msecs) {
+  kk_mutex_lock(&pool->lock);
+  kk_atomic_store_relaxed(&pool->sleepers, kk_atomic_load_relaxed(&pool->sleepers) + 1);
+  if (pool->inject_first == NULL && kk_atomic_load_relaxed(&pool->stop) == 0) {
+    kk_cond_timedwait(&pool->wakeup, &pool->lock, msecs);
+  }
+  kk_atomic_store_relaxed(&pool->sleepers, kk_atomic_load_relaxed(&pool->sleepers) - 1);
+  kk_mutex_unlock(&pool->lock);
+}
+
+// Find a task to run: first from our own deque, then the inject queue, and finally steal one.
+static kk_task_t* kk_pool_find_task(kk_task_pool_t* pool, kk_task_worker_t* self) {
+  kk_task_t* t = NULL;
+  if (self != NULL) {
+    t = kk_deque_pop(&self->deque);
+    if (t != NULL) return t;
+  }
+  t = kk_pool_take_injected(pool);
+  if (t != NULL) return t;
+  const kk_ssize_t n = pool->worker_count;
+  if (n == 0) return NULL;
+  kk_ssize_t start;
+  if (self != NULL) {
+    self->rnd ^= self->rnd << 13; self->rnd ^= self->rnd >> 17; self->rnd ^= self->rnd << 5;  // xorshift32
+    start = (kk_ssize_t)(self->rnd % (uint32_t)n);
+  }
+  else {
+    start = 0;
+  }
+  for (kk_ssize_t i = 0; i < n; i++) {
+    kk_task_worker_t* victim = pool->workers[(start + i) % n];
+    if (victim == self) continue;
+    t = kk_deque_steal(&victim->deque);
+    if (t != NULL) return t;
+  }
+  return NULL;
+}
+
+static void kk_pool_run(kk_task_pool_t* pool, kk_task_t* t, kk_context_t* ctx) {
+  kk_task_run(t, ctx);
+  kk_task_release(t, ctx);  // the reference of the pool
+  kk_pool_wakeup(pool);     // wake up threads awaiting this task
+}
+
+static kk_thread_result_t kk_thread_call kk_worker_start(void* arg) {
+  kk_task_worker_t* self = (kk_task_worker_t*)arg;
+  kk_task_current_worker = self;
+  kk_mem_thread_init(self->index);       // bind to a NUMA node first so the context and heap are local
+  kk_context_t* ctx = kk_get_context();  // initialize a fresh context for this thread
+  kk_task_pool_t* pool = &kk_pool;
+  while (kk_atomic_load_relaxed(&pool->stop) == 0) {
+    kk_task_t* t = kk_pool_find_task(pool, self);
+    if (t != NULL) {
+      kk_pool_run(pool, t, ctx);
+    }
+    else {
+      kk_ref_collect(ctx);  // drop values retired by thread-shared references while idle
+      kk_pool_sleep(pool, 10);
+    }
+  }
+  kk_free_context();
+  return 0;
+}
+
+static void kk_pool_done(void) {
+  kk_task_pool_t* pool = &kk_pool;
+  kk_atomic_store_release(&pool->stop, 1);
+  kk_mutex_lock(&pool->lock);
+  kk_cond_broadcast(&pool->wakeup);
+  kk_mutex_unlock(&pool->lock);
+  for (kk_ssize_t i = 0; i < pool->worker_count; i++) {
+    if (pool->workers[i]->started) kk_thread_join(pool->workers[i]->thread);
+    kk_free(pool->workers[i]);
+  }
+  kk_free(pool->workers);
+  pool->worker_count = 0;
+}
+
+static void kk_pool_init(kk_context_t* ctx) {
+  kk_task_pool_t* pool = &kk_pool;
+  kk_mutex_init(&pool->lock);
+  kk_cond_init(&pool->wakeup);
+  // by default use one worker less than the cpu count as the main thread helps when awaiting
+  kk_ssize_t n = kk_pool_requested;
+  if (n < 0) { n = kk_cpu_count(ctx) - 1; }
+  if (n < 0) { n = 0; }
+  pool->workers = (kk_task_worker_t**)kk_malloc((n > 0 ? n : 1) * kk_ssizeof(kk_task_worker_t*), ctx);
+  if (pool->workers == NULL) { n = 0; }
+  for (kk_ssize_t i = 0; i < n; i++) {
+    kk_task_worker_t* w = (kk_task_worker_t*)kk_zalloc(kk_ssizeof(kk_task_worker_t), ctx);
+    if (w == NULL) { n = i; break; }
+    w->index = i;
+    w->rnd = (uint32_t)(2*i + 1);
+    pool->workers[i] = w;
+  }
+  pool->worker_count = n;  // set before starting any worker
+  for (kk_ssize_t i = 0; i < n; i++) {
+    kk_task_worker_t* w = pool->workers[i];
+    w->started = kk_thread_create(&w->thread, &kk_worker_start, w);
+    if (!w->started) {
+      // the remaining workers have an empty deque and are never stolen from
+      kk_warning_message("unable to create more than %zd worker threads\n", i);
+      break;
+    }
+  }
+  atexit(&kk_pool_done);
+}
+
+static kk_task_pool_t* kk_pool_get(kk_context_t* ctx) {
+  uintptr_t state = kk_atomic_load_acquire(&kk_pool_state);
+  if (kk_likely(state == 2)) return &kk_pool;
+  state = 0;
+  if (kk_atomic_cas_strong_acq_rel(&kk_pool_state, &state, 1)) {
+    kk_pool_init(ctx);
+    kk_atomic_store_release(&kk_pool_state, 2);
+  }
+  else {
+    while (kk_atomic_load_acquire(&kk_pool_state) != 2) { /* spin while another thread initializes */ }
+  }
+  return &kk_pool;
+}
+
+kk_ssize_t kk_task_worker_count(kk_context_t* ctx) {
+  return kk_pool_get(ctx)->worker_count;
+}
+
+#else
+
+void kk_task_set_worker_count(kk_ssize_t count) {
+  KK_UNUSED(count);
+}
+
+kk_ssize_t kk_task_worker_count(kk_context_t* ctx) {
+  KK_UNUSED(ctx);
+  return 0;
+}
+
+#endif
+
+
+/*--------------------------------------------------------------------------------------------------
+  Spawn and await
+--------------------------------------------------------------------------------------------------*/
+
+kk_box_t kk_task_spawn(kk_function_t fun, kk_context_t* ctx) {
+  kk_block_mark_shared(&fun->_block, ctx);
+  kk_task_t* t = kk_task_alloc(fun, ctx);
+  kk_box_t future = kk_cptr_raw_box(&kk_task_free_fun, t, ctx);
+#if KK_MULTI_THREADED
+  kk_task_pool_t* pool = kk_pool_get(ctx);
+  kk_task_worker_t* self = kk_task_current_worker;
+  if (self != NULL) {
+    if (!kk_deque_push(&self->deque, t)) {
+      kk_pool_run(pool, t, ctx);   // our deque is full: run the task directly
+      return future;
+    }
+  }
+  else if (pool->worker_count > 0) {
+    kk_pool_inject(pool, t);
+  }
+  else {
+    kk_pool_run(pool, t, ctx);     // no workers: run directly
+    return future;
+  }
+  kk_pool_wakeup(pool);
+#else
+  kk_task_run(t, ctx);
+  kk_task_release(t, ctx);
+#endif
+  return future;
+}
+
+bool kk_task_is_done_borrow(kk_box_t future) {
+  kk_task_t* t = (kk_task_t*)kk_cptr_raw_unbox(future);
+  return (kk_atomic_load_acquire(&t->done) != 0);
+}
+
+kk_box_t kk_task_await(kk_box_t future, kk_context_t* ctx) {
+  kk_task_t* t = (kk_task_t*)kk_cptr_raw_unbox(future);
+#if KK_MULTI_THREADED
+  if (kk_atomic_load_acquire(&t->done) == 0) {
+    kk_task_pool_t* pool = kk_pool_get(ctx);
+    kk_task_worker_t* self = kk_task_current_worker;
+    while (kk_atomic_load_acquire(&t->done) == 0) {
+      // help out while waiting
+      kk_task_t* other = kk_pool_find_task(pool, self);
+      if (other != NULL) {
+        kk_pool_run(pool, other, ctx);
+      }
+      else {
+        kk_pool_sleep(pool, 1);
+      }
+    }
+  }
+#endif
+  kk_assert_internal(kk_atomic_load_relaxed(&t->done) != 0);
+  kk_box_t res = kk_box_dup(t->result);
+  kk_box_drop(future, ctx);
+  return res;
+}
+
+
+/*--------------------------------------------------------------------------------------------------
+  The reclaimer thread
+  Frees large structures that are handed over by `kk_block_drop_free` (see `refcount.c`).
+  The thread is started on the first hand over. Each job is a delayed free list; decrements
+  that only the owner can do are collected per job and passed back to the owning context
+  once the job is done. A context waits for its pending jobs when it is freed.
+--------------------------------------------------------------------------------------------------*/
+
+static kk_ssize_t kk_reclaim_threshold_default;  // = 0 (disabled)
+
+void kk_reclaim_set_threshold(kk_ssize_t threshold) {
+  kk_reclaim_threshold_default = (threshold < 0 ? 0 : threshold);
+}
+
+kk_ssize_t kk_reclaim_threshold(void) {
+  return kk_reclaim_threshold_default;
+}
+
+#define KK_RECLAIM_DEFERRED_SIZE  (254)
+
+typedef struct kk_reclaim_deferred_s {
+  struct kk_reclaim_deferred_s* next;
+  kk_ssize_t   count;
+  kk_block_t*  blocks[KK_RECLAIM_DEFERRED_SIZE];  // each needs one decrement by the owner
+} kk_reclaim_deferred_t;
+
+// Apply the decrements passed back by the reclaimer thread (called by the owner)
+void kk_reclaim_collect(kk_context_t* ctx) {
+  uintptr_t expected = kk_atomic_load_relaxed(&ctx->reclaim_deferred);
+  while (expected != 0 && !kk_atomic_cas_weak_acq_rel(&ctx->reclaim_deferred, &expected, 0)) { };
+  kk_reclaim_deferred_t* d = (kk_reclaim_deferred_t*)expected;
+  while (d != NULL) {
+    kk_reclaim_deferred_t* next = d->next;
+    for (kk_ssize_t i = 0; i < d->count; i++) {
+      kk_block_drop(d->blocks[i], ctx);
+    }
+    kk_free(d);
+    d = next;
+  }
+}
+
+// Free on the current (owning) thread where we can decrement directly
+static void kk_reclaim_defer_local(kk_block_t* b, void* arg) {
+  kk_block_drop(b, (kk_context_t*)arg);
+}
+
+static void kk_reclaim_free_local(kk_block_t* todo, kk_context_t* ctx) {
+  kk_block_reclaim_free(todo, &kk_reclaim_defer_local, ctx, ctx);
+}
+
+#if KK_MULTI_THREADED
+
+typedef struct kk_reclaim_job_s {
+  struct kk_reclaim_job_s* next;
+  kk_block_t*             todo;      // delayed free list of unreachable blocks
+  kk_context_t*           owner;
+  kk_reclaim_deferred_t*  deferred;  // decrements to pass back to the owner
+  kk_context_t*           ctx;       // the context of the reclaimer
+} kk_reclaim_job_t;
+
+typedef struct kk_reclaimer_s {
+  kk_thread_t         thread;
+  kk_mutex_t          lock;          // protects the job queue and `stop`
+  kk_cond_t           wakeup;
+  kk_reclaim_job_t*   first;
+  kk_reclaim_job_t*   last;
+  bool                started;
+  bool                stop;
+} kk_reclaimer_t;
+
+static kk_reclaimer_t      kk_reclaimer;
+static _Atomic(uintptr_t)  kk_reclaimer_state;  // 0: uninitialized, 1: initializing, 2: ready
+
+static void kk_reclaim_defer(kk_block_t* b, void* arg) {
+  kk_reclaim_job_t* job = (kk_reclaim_job_t*)arg;
+  kk_reclaim_deferred_t* d = job->deferred;
+  if (d == NULL || d->count >= KK_RECLAIM_DEFERRED_SIZE) {
+    d = (kk_reclaim_deferred_t*)kk_malloc(kk_ssizeof(kk_reclaim_deferred_t), job->ctx);
+    if (d == NULL) kk_fatal_error(ENOMEM, "out of memory in the reclaimer thread");
+    d->next = job->deferred;
+    d->count = 0;
+    job->deferred = d;
+  }
+  d->blocks[d->count++] = b;
+  kk_stats_count(job->ctx, reclaim_deferred);
+}
+
+static void kk_reclaim_run(kk_reclaim_job_t* job, kk_context_t* ctx) {
+  job->ctx = ctx;
+  const kk_ssize_t n = kk_block_reclaim_free(job->todo, &kk_reclaim_defer, job, ctx);
+  KK_UNUSED(n);
+#if KK_STATS
+  ctx->stats.reclaim_jobs++;
+  ctx->stats.reclaim_blocks += n;
+#endif
+  kk_context_t* owner = job->owner;
+  if (job->deferred != NULL) {
+    // pass the decrements back to the owner
+    kk_reclaim_deferred_t* last = job->deferred;
+    while (last->next != NULL) { last = last->next; }
+    uintptr_t expected = kk_atomic_load_relaxed(&owner->reclaim_deferred);
+    do {
+      last->next = (kk_reclaim_deferred_t*)expected;
+    } while (!kk_atomic_cas_weak_acq_rel(&owner->reclaim_deferred, &expected, (uintptr_t)job->deferred));
+  }
+  kk_free(job);
+  kk_atomic(fetch_sub_explicit)(&owner->reclaim_pending, 1, kk_memory_order(acq_rel));  // after this the owner may be freed
+}
+
+// Take the next job; returns NULL once stopped and all jobs are done.
+static kk_reclaim_job_t* kk_reclaimer_take(kk_reclaimer_t* rc) {
+  kk_mutex_lock(&rc->lock);
+  while (rc->first == NULL && !rc->stop) {
+    kk_cond_timedwait(&rc->wakeup, &rc->lock, 100);
+  }
+  kk_reclaim_job_t* job = rc->first;
+  if (job != NULL) {
+    rc->first = job->next;
+    if (rc->first == NULL) rc->last = NULL;
+  }
+  kk_mutex_unlock(&rc->lock);
+  return job;
+}
+
+static kk_thread_result_t kk_thread_call kk_reclaimer_start(void* arg) {
+  kk_reclaimer_t* rc = (kk_reclaimer_t*)arg;
+  kk_context_t* ctx = kk_get_context();
+  ctx->reclaim_threshold = 0;
+  kk_reclaim_job_t* job;
+  while ((job = kk_reclaimer_take(rc)) != NULL) {
+    kk_reclaim_run(job, ctx);
+  }
+  kk_free_context();
+  return 0;
+}
+
+static void kk_reclaimer_done(void) {
+  kk_reclaimer_t* rc = &kk_reclaimer;
+  kk_mutex_lock(&rc->lock);
+  rc->stop = true;
+  kk_cond_broadcast(&rc->wakeup);
+  kk_mutex_unlock(&rc->lock);
+  if (rc->started) kk_thread_join(rc->thread);  // finishes all pending jobs first
+  rc->started = false;
+}
+
+static kk_reclaimer_t* kk_reclaimer_get(void) {
+  uintptr_t state = kk_atomic_load_acquire(&kk_reclaimer_state);
+  if (kk_likely(state == 2)) return &kk_reclaimer;
+  state = 0;
+  if (kk_atomic_cas_strong_acq_rel(&kk_reclaimer_state, &state, 1)) {
+    kk_reclaimer_t* rc = &kk_reclaimer;
+    kk_mutex_init(&rc->lock);
+    kk_cond_init(&rc->wakeup);
+    rc->started = kk_thread_create(&rc->thread, &kk_reclaimer_start, rc);
+    if (!rc->started) {
+      rc->stop = true;
+      kk_warning_message("unable to create the reclaimer thread (large structures are freed directly)\n");
+    }
+    atexit(&kk_reclaimer_done);
+    kk_atomic_store_release(&kk_reclaimer_state, 2);
+  }
+  else {
+    while (kk_atomic_load_acquire(&kk_reclaimer_state) != 2) { /* spin while another thread initializes */ }
+  }
+  return &kk_reclaimer;
+}
+
+// Hand a delayed free list of unreachable blocks to the reclaimer thread
+void kk_reclaim_push(kk_block_t* todo, kk_context_t* ctx) {
+  kk_reclaimer_t* rc = kk_reclaimer_get();
+  kk_reclaim_job_t* job = (kk_reclaim_job_t*)kk_malloc(kk_ssizeof(kk_reclaim_job_t), ctx);
+  if (job == NULL) {
+    kk_reclaim_free_local(todo, ctx);
+    return;
+  }
+  job->next = NULL;
+  job->todo = todo;
+  job->owner = ctx;
+  job->deferred = NULL;
+  job->ctx = NULL;
+  kk_mutex_lock(&rc->lock);
+  if (rc->stop) {
+    // stopped (at exit) or no reclaimer thread: free on this thread
+    kk_mutex_unlock(&rc->lock);
+    kk_free(job);
+    kk_reclaim_free_local(todo, ctx);
+    return;
+  }
+  kk_atomic(fetch_add_explicit)(&ctx->reclaim_pending, 1, kk_memory_order(acq_rel));
+  if (rc->last == NULL) { rc->first = job; }
+                   else { rc->last->next = job; }
+  rc->last = job;
+  kk_cond_broadcast(&rc->wakeup);
+  kk_mutex_unlock(&rc->lock);
+}
+
+// Wait until the jobs of this context are done and apply the decrements passed back.
+// Called when a context is freed (with a zero `reclaim_threshold` so no new jobs are added).
+void kk_reclaim_context_done(kk_context_t* ctx) {
+  while (kk_atomic_load_acquire(&ctx->reclaim_pending) != 0) {
+    kk_reclaimer_t* rc = &kk_reclaimer;
+    kk_mutex_lock(&rc->lock);
+    kk_cond_timedwait(&rc->wakeup, &rc->lock, 1);
+    kk_mutex_unlock(&rc->lock);
+  }
+  kk_reclaim_collect(ctx);
+}
+
+#else
+
+void kk_reclaim_push(kk_block_t* todo, kk_context_t* ctx) {
+  kk_reclaim_free_local(todo, ctx);   // single threaded: free directly
+}
+
+void kk_reclaim_context_done(kk_context_t* ctx) {
+  kk_reclaim_collect(ctx);
+}
+
+#endif
@@ -19,7 +19,7 @@ kk_decl_export double kk_timer_resolution(kk_context_t* ctx);
 
 #ifdef WIN32
 #include <Windows.h>
-static double kk_timer_ticks_prim(double* secs_frac, kk_context_t* ctx) {
+static double kk_timer_ticks_os(double* secs_frac, kk_context_t* ctx) {
   LARGE_INTEGER t;
   QueryPerformanceCounter(&t);
   if (ctx->timer_freq == 0) {
@@ -50,7 +50,7 @@ static double kk_timer_ticks_prim(double* secs_frac, kk_context_t* ctx) {
 #endif
 
 // high res timer
-static double kk_timer_ticks_prim(double* secs_frac, kk_context_t* ctx) {
+static double kk_timer_ticks_os(double* secs_frac, kk_context_t* ctx) {
   if (ctx->timer_freq == 0) {
     struct timespec tres = { 0, 0 };
     clock_getres(CLOCK_MONOTONIC, &tres);
@@ -72,7 +72,7 @@ static double kk_timer_ticks_prim(double* secs_frac, kk_context_t* ctx) {
 #else
 // low resolution timer
 #pragma message("using low-res timer on this platform")
-static double kk_timer_ticks_prim(double* secs_frac, kk_context_t* ctx) {
+static double kk_timer_ticks_os(double* secs_frac, kk_context_t* ctx) {
   if (ctx->timer_freq == 0) {
     ctx->timer_freq = (int64_t)CLOCKS_PER_SEC;
     if (ctx->timer_freq <= 0) ctx->timer_freq = 1000;
@@ -89,6 +89,182 @@ static double kk_timer_ticks_prim(double* secs_frac, kk_context_t* ctx) {
 #endif
 #endif
 
+
+/*--------------------------------------------------------------------------------------------------
+  Invariant time stamp counter (`rdtsc` on x64, `cntvct_el0` on arm64).
+  Reading the counter costs a few cycles instead of a call into the OS. It is only used
+  if the CPU guarantees a constant rate (across power states and cores) and if it is
+  consistent with the OS monotonic clock over two calibration intervals.
+  The calibration is done once per process on the first use of the timer.
+--------------------------------------------------------------------------------------------------*/
+
+#ifndef KK_TIMER_TSC
+#if (defined(__GNUC__) || defined(_MSC_VER)) && (defined(__x86_64__) || defined(_M_X64) || defined(__aarch64__) || defined(_M_ARM64))
+#define KK_TIMER_TSC  1
+#else
+#define KK_TIMER_TSC  0
+#endif
+#endif
+
+#ifndef KK_TIMER_TSC_CALIBRATE
+#define KK_TIMER_TSC_CALIBRATE  (0.005)   // seconds (in two halves)
+#endif
+
+#if KK_TIMER_TSC
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__)
+#include <x86intrin.h>
+#include <cpuid.h>
+#endif
+
+static inline uint64_t kk_tsc_read(void) {
+  #if defined(_M_ARM64)
+  return (uint64_t)_ReadStatusReg(ARM64_CNTVCT);
+  #elif defined(__aarch64__)
+  uint64_t t;
+  __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(t));
+  return t;
+  #else
+  return (uint64_t)__rdtsc();
+  #endif
+}
+
+// The counter frequency if it is given by the hardware (or 0 if it must be calibrated)
+static int64_t kk_tsc_hw_freq(void) {
+  #if defined(_M_ARM64)
+  return (int64_t)_ReadStatusReg(ARM64_CNTFRQ);
+  #elif defined(__aarch64__)
+  uint64_t f;
+  __asm__ __volatile__("mrs %0, cntfrq_el0" : "=r"(f));
+  return (int64_t)f;
+  #else
+  return 0;
+  #endif
+}
+
+static bool kk_tsc_is_invariant(void) {
+  #if defined(__aarch64__) || defined(_M_ARM64)
+  return true;  // the generic timer always has a constant frequency
+  #elif defined(_MSC_VER)
+  int32_t cpu_info[4];
+  __cpuid(cpu_info, (int)(0x80000000));
+  if ((uint32_t)cpu_info[0] < KU32(0x80000007)) return false;
+  __cpuid(cpu_info, (int)(0x80000007));
+  return ((cpu_info[3] & (KI32(1)<<8)) != 0);  // edx bit 8: invariant TSC
+  #else
+  unsigned int eax, ebx, ecx, edx;
+  if (__get_cpuid_max(0x80000000, NULL) < 0x80000007) return false;
+  if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) return false;
+  return ((edx & (1U<<8)) != 0);  // invariant TSC
+  #endif
+}
+
+static _Atomic(intptr_t) kk_tsc_state;  // 0: uninitialized, 1: calibrating, 2: available, 3: not available
+static int64_t  kk_tsc_freq;            // counts per second
+static double   kk_tsc_inv_freq;        // 1.0 / kk_tsc_freq
+static uint64_t kk_tsc_base;            // counter at `kk_tsc_base_secs + kk_tsc_base_frac`
+static double   kk_tsc_base_secs;
+static double   kk_tsc_base_frac;
+
+// Read the OS clock together with the counter; we take the tightest of a few samples
+// so a preemption in between does not skew the calibration.
+static double kk_tsc_sample(uint64_t* tsc, kk_context_t* ctx) {
+  double best = 0.0;
+  uint64_t best_span = UINT64_MAX;
+  for (int i = 0; i < 5; i++) {
+    double frac;
+    const uint64_t before = kk_tsc_read();
+    const double now = kk_timer_ticks_os(&frac, ctx) + frac;
+    const uint64_t after = kk_tsc_read();
+    if (after - before < best_span) {
+      best_span = after - before;
+      best = now;
+      *tsc = before + (after - before)/2;
+    }
+  }
+  return best;
+}
+
+// Wait until the OS clock advanced `secs` from `start` and return the elapsed time together with the counter
+static double kk_tsc_wait(double start, double secs, uint64_t* tsc, kk_context_t* ctx) {
+  double elapsed;
+  do {
+    elapsed = kk_tsc_sample(tsc, ctx) - start;
+  } while (elapsed < secs);
+  return elapsed;
+}
+
+static bool kk_tsc_calibrate_once(kk_context_t* ctx) {
+  uint64_t tsc0, tsc1, tsc2;
+  const double start = kk_tsc_sample(&tsc0, ctx);
+  const double e1 = kk_tsc_wait(start, KK_TIMER_TSC_CALIBRATE/2, &tsc1, ctx);
+  const double e2 = kk_tsc_wait(start, KK_TIMER_TSC_CALIBRATE, &tsc2, ctx);
+  if (tsc1 <= tsc0 || tsc2 <= tsc1 || e2 <= e1) return false;
+  const double f1 = (double)(tsc1 - tsc0) / e1;
+  const double f2 = (double)(tsc2 - tsc1) / (e2 - e1);
+  if (f1 < 1.0e6 || f1 > 1.0e11 || fabs(f1 - f2) > 0.005*f1) return false;  // implausible or unstable rate
+  const int64_t hw = kk_tsc_hw_freq();
+  kk_tsc_freq = (hw > 0 ? hw : (int64_t)((double)(tsc2 - tsc0) / e2));
+  kk_tsc_inv_freq = 1.0 / (double)kk_tsc_freq;
+  kk_tsc_base = tsc0;
+  kk_tsc_base_secs = floor(start);
+  kk_tsc_base_frac = start - kk_tsc_base_secs;
+  return true;
+}
+
+static bool kk_tsc_calibrate(kk_context_t* ctx) {
+  if (!kk_tsc_is_invariant()) return false;
+  for (int i = 0; i < 3; i++) {  // retry in case we were interrupted
+    if (kk_tsc_calibrate_once(ctx)) return true;
+  }
+  return false;
+}
+
+// Is the time stamp counter available? (calibrates on the first call)
+static bool kk_tsc_available(kk_context_t* ctx) {
+  intptr_t state = kk_atomic_load_acquire(&kk_tsc_state);
+  if (kk_likely(state >= 2)) return (state == 2);
+  intptr_t expected = 0;
+  if (kk_atomic_cas_strong_acq_rel(&kk_tsc_state, &expected, 1)) {
+    state = (kk_tsc_calibrate(ctx) ? 2 : 3);
+    kk_atomic_store_release(&kk_tsc_state, state);
+  }
+  else {
+    while ((state = kk_atomic_load_acquire(&kk_tsc_state)) < 2) { /* spin while another thread calibrates */ }
+  }
+  return (state == 2);
+}
+
+static double kk_timer_ticks_tsc(double* secs_frac) {
+  // multiply instead of divide: a double is exact for counts below 2^53 (over a month at 3GHz)
+  // and precise to the nanosecond in the fraction well beyond that
+  const double x = kk_tsc_base_frac + ((double)(kk_tsc_read() - kk_tsc_base) * kk_tsc_inv_freq);
+  const double secs = (double)((int64_t)x);
+  if (secs_frac != NULL) *secs_frac = x - secs;
+  return (kk_tsc_base_secs + secs);
+}
+#endif
+
+static double kk_timer_ticks_prim(double* secs_frac, kk_context_t* ctx) {
+  #if KK_TIMER_TSC
+  if (kk_likely(kk_tsc_available(ctx))) {
+    ctx->timer_freq = kk_tsc_freq;
+    return kk_timer_ticks_tsc(secs_frac);
+  }
+  #endif
+  return kk_timer_ticks_os(secs_frac, ctx);
+}
+
+kk_decl_export bool kk_timer_is_tsc(kk_context_t* ctx) {
+  #if KK_TIMER_TSC
+  return kk_tsc_available(ctx);
+  #else
+  KK_UNUSED(ctx);
+  return false;
+  #endif
+}
+
 kk_decl_export double kk_timer_ticks(double* secs_frac, kk_context_t* ctx) {
   double frac;
   double secs = kk_timer_ticks_prim(&frac, ctx);
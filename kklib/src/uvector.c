@@ -0,0 +1,346 @@
+/*---------------------------------------------------------------------------
+  Copyright 2021, Microsoft Research, Daan Leijen.
+
+  This is free software; you can redistribute it and/or modify it under the
+  terms of the Apache License, Version 2.0. A copy of the License can be
+  found in the LICENSE file at the root of this distribution.
+---------------------------------------------------------------------------*/
+#include "kklib.h"
+
+/*--------------------------------------------------------------------------------------------------
+  Unboxed vectors
+  Explicit SIMD kernels are used for double sums, dot products and equality, and for byte sums
+  (SSE2, and AVX for double sums and dot products). The other kernels are plain loops that are
+  left to the C compiler, and there are no NEON kernels yet.
+--------------------------------------------------------------------------------------------------*/
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define KK_UVECTOR_SSE2  1
+#include <emmintrin.h>
+#endif
+
+#if defined(KK_UVECTOR_SSE2) && defined(__GNUC__) && defined(__x86_64__)
+#define KK_UVECTOR_AVX   1
+#include <immintrin.h>
+#endif
+
+static kk_ssize_t kk_uvector_size(kk_uvector_elem_t elem, kk_ssize_t length) {
+  const kk_ssize_t size = kk_ssizeof(struct kk_uvector_s) - kk_ssizeof(((kk_uvector_t)NULL)->buf) + length*kk_uvector_elem_size(elem);
+  return (size < kk_ssizeof(struct kk_uvector_s) ? kk_ssizeof(struct kk_uvector_s) : size);
+}
+
+kk_uvector_t kk_uvector_alloc(kk_uvector_elem_t elem, kk_ssize_t length, kk_context_t* ctx) {
+  if (length < 0) length = 0;
+  kk_uvector_t v = (kk_uvector_t)kk_block_alloc_any(kk_uvector_size(elem, length), 0 /* nothing to scan */, KK_TAG_UVECTOR, ctx);
+  v->length = length;
+  v->elem = (int32_t)elem;
+  v->_padding = 0;
+  return v;
+}
+
+kk_uvector_t kk_uvector_copy(kk_uvector_t v, kk_context_t* ctx) {
+  const kk_uvector_elem_t elem = (kk_uvector_elem_t)v->elem;
+  kk_uvector_t w = kk_uvector_alloc(elem, v->length, ctx);
+  kk_memcpy(&w->buf, &v->buf, v->length * kk_uvector_elem_size(elem));
+  kk_uvector_drop(v, ctx);
+  return w;
+}
+
+// Doubles are compared with `==` (so a NaN is never equal and `-0.0 == 0.0`), two at a time
+static bool kk_f64_eq(const double* p, const double* q, kk_ssize_t n) {
+  kk_ssize_t i = 0;
+  #if defined(KK_UVECTOR_SSE2)
+  for (; i + 2 <= n; i += 2) {
+    if (_mm_movemask_pd(_mm_cmpeq_pd(_mm_loadu_pd(p + i), _mm_loadu_pd(q + i))) != 3) return false;
+  }
+  #endif
+  for (; i < n; i++) {
+    if (!(p[i] == q[i])) return false;
+  }
+  return true;
+}
+
+// Compare the first `n` elements; returns -1, 0, or 1 (and NaN's compare equal to anything)
+static int kk_uvector_cmp_elems(kk_uvector_t v, kk_uvector_t w, kk_ssize_t n) {
+  #define KK_CMP_LOOP(name) \
+    for (kk_ssize_t i = 0; i < n; i++) { \
+      if (v->buf.name[i] < w->buf.name[i]) return -1; \
+      if (v->buf.name[i] > w->buf.name[i]) return 1; \
+    }
+  switch ((kk_uvector_elem_t)v->elem) {
+    case KK_UVECTOR_F64: KK_CMP_LOOP(f64); break;
+    case KK_UVECTOR_I64: KK_CMP_LOOP(i64); break;
+    case KK_UVECTOR_I32: KK_CMP_LOOP(i32); break;
+    case KK_UVECTOR_U8: {
+      const int c = kk_memcmp(v->buf.u8, w->buf.u8, n);
+      return (c < 0 ? -1 : (c > 0 ? 1 : 0));
+    }
+  }
+  #undef KK_CMP_LOOP
+  return 0;
+}
+
+bool kk_uvector_eq(kk_uvector_t v, kk_uvector_t w, kk_context_t* ctx) {
+  kk_assert_internal(v->elem == w->elem);
+  bool eq;
+  if (v->length != w->length) {
+    eq = false;
+  }
+  else if (v->elem == KK_UVECTOR_F64) {
+    eq = kk_f64_eq(v->buf.f64, w->buf.f64, v->length);
+  }
+  else {
+    eq = (kk_memcmp(&v->buf, &w->buf, v->length * kk_uvector_elem_size((kk_uvector_elem_t)v->elem)) == 0);
+  }
+  kk_uvector_drop(v, ctx);
+  kk_uvector_drop(w, ctx);
+  return eq;
+}
+
+int kk_uvector_cmp(kk_uvector_t v, kk_uvector_t w, kk_context_t* ctx) {
+  kk_assert_internal(v->elem == w->elem);
+  const kk_ssize_t n = (v->length < w->length ? v->length : w->length);
+  int c = kk_uvector_cmp_elems(v, w, n);
+  if (c == 0) {
+    c = (v->length < w->length ? -1 : (v->length > w->length ? 1 : 0));
+  }
+  kk_uvector_drop(v, ctx);
+  kk_uvector_drop(w, ctx);
+  return c;
+}
+
+
+/*--------------------------------------------------------------------------------------------------
+  Sums and dot products.
+  Floating point uses four accumulators (`i % 4`) that are summed as `(s0 + s2) + (s1 + s3)`;
+  the SSE2 and AVX versions use the same lanes so the results are identical on every platform.
+  On x64 with AVX the 256-bit variants are selected at startup by `kk_uvector_init`.
+--------------------------------------------------------------------------------------------------*/
+
+static double kk_f64_sum_generic(const double* p, kk_ssize_t n) {
+  kk_ssize_t i = 0;
+  double s0, s1, s2, s3;
+  #if defined(KK_UVECTOR_SSE2)
+  __m128d a = _mm_setzero_pd();
+  __m128d b = _mm_setzero_pd();
+  for (; i + 4 <= n; i += 4) {
+    a = _mm_add_pd(a, _mm_loadu_pd(p + i));
+    b = _mm_add_pd(b, _mm_loadu_pd(p + i + 2));
+  }
+  double la[2], lb[2];
+  _mm_storeu_pd(la, a);
+  _mm_storeu_pd(lb, b);
+  s0 = la[0]; s1 = la[1]; s2 = lb[0]; s3 = lb[1];
+  #else
+  s0 = s1 = s2 = s3 = 0.0;
+  for (; i + 4 <= n; i += 4) {
+    s0 += p[i]; s1 += p[i+1]; s2 += p[i+2]; s3 += p[i+3];
+  }
+  #endif
+  double s = (s0 + s2) + (s1 + s3);
+  for (; i < n; i++) { s += p[i]; }
+  return s;
+}
+
+static double kk_f64_dot_generic(const double* p, const double* q, kk_ssize_t n) {
+  kk_ssize_t i = 0;
+  double s0, s1, s2, s3;
+  #if defined(KK_UVECTOR_SSE2)
+  __m128d a = _mm_setzero_pd();
+  __m128d b = _mm_setzero_pd();
+  for (; i + 4 <= n; i += 4) {
+    a = _mm_add_pd(a, _mm_mul_pd(_mm_loadu_pd(p + i), _mm_loadu_pd(q + i)));
+    b = _mm_add_pd(b, _mm_mul_pd(_mm_loadu_pd(p + i + 2), _mm_loadu_pd(q + i + 2)));
+  }
+  double la[2], lb[2];
+  _mm_storeu_pd(la, a);
+  _mm_storeu_pd(lb, b);
+  s0 = la[0]; s1 = la[1]; s2 = lb[0]; s3 = lb[1];
+  #else
+  s0 = s1 = s2 = s3 = 0.0;
+  for (; i + 4 <= n; i += 4) {
+    s0 += p[i]*q[i]; s1 += p[i+1]*q[i+1]; s2 += p[i+2]*q[i+2]; s3 += p[i+3]*q[i+3];
+  }
+  #endif
+  double s = (s0 + s2) + (s1 + s3);
+  for (; i < n; i++) { s += p[i]*q[i]; }
+  return s;
+}
+
+#if defined(KK_UVECTOR_AVX)
+__attribute__((target("avx")))
+static double kk_f64_sum_avx(const double* p, kk_ssize_t n) {
+  kk_ssize_t i = 0;
+  __m256d a = _mm256_setzero_pd();
+  for (; i + 4 <= n; i += 4) {
+    a = _mm256_add_pd(a, _mm256_loadu_pd(p + i));
+  }
+  double la[4];
+  _mm256_storeu_pd(la, a);
+  double s = (la[0] + la[2]) + (la[1] + la[3]);
+  for (; i < n; i++) { s += p[i]; }
+  return s;
+}
+
+__attribute__((target("avx")))
+static double kk_f64_dot_avx(const double* p, const double* q, kk_ssize_t n) {
+  kk_ssize_t i = 0;
+  __m256d a = _mm256_setzero_pd();
+  for (; i + 4 <= n; i += 4) {
+    a = _mm256_add_pd(a, _mm256_mul_pd(_mm256_loadu_pd(p + i), _mm256_loadu_pd(q + i)));  // no fma: same rounding as SSE2
+  }
+  double la[4];
+  _mm256_storeu_pd(la, a);
+  double s = (la[0] + la[2]) + (la[1] + la[3]);
+  for (; i < n; i++) { s += p[i]*q[i]; }
+  return s;
+}
+#endif
+
+static struct {
+  double (*sum)(const double* p, kk_ssize_t n);
+  double (*dot)(const double* p, const double* q, kk_ssize_t n);
+} kk_f64_kernels = { &kk_f64_sum_generic, &kk_f64_dot_generic };
+
+// Called once from `kklib_init` to select the kernels for this cpu.
+void kk_uvector_init(void) {
+#if defined(KK_UVECTOR_AVX)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx")) {
+    kk_f64_kernels.sum = &kk_f64_sum_avx;
+    kk_f64_kernels.dot = &kk_f64_dot_avx;
+  }
+#endif
+}
+
+static double kk_f64_sum(const double* p, kk_ssize_t n) {
+  return kk_f64_kernels.sum(p, n);
+}
+
+static double kk_f64_dot(const double* p, const double* q, kk_ssize_t n) {
+  return kk_f64_kernels.dot(p, q, n);
+}
+
+// Bytes are summed 16 at a time with `psadbw`
+static int64_t kk_u8_sum(const uint8_t* p, kk_ssize_t n) {
+  kk_ssize_t i = 0;
+  uint64_t s = 0;
+  #if defined(KK_UVECTOR_SSE2)
+  const __m128i zero = _mm_setzero_si128();
+  __m128i acc = zero;
+  for (; i + 16 <= n; i += 16) {
+    acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(p + i)), zero));
+  }
+  uint64_t lanes[2];
+  _mm_storeu_si128((__m128i*)lanes, acc);
+  s = lanes[0] + lanes[1];
+  #endif
+  for (; i < n; i++) { s += p[i]; }
+  return (int64_t)s;
+}
+
+// Integer sums wrap around (and are vectorized by the C compiler)
+static int64_t kk_i64_sum(const int64_t* p, kk_ssize_t n) {
+  uint64_t s = 0;
+  for (kk_ssize_t i = 0; i < n; i++) { s += (uint64_t)p[i]; }
+  return (int64_t)s;
+}
+
+static int64_t kk_i32_sum(const int32_t* p, kk_ssize_t n) {
+  uint64_t s = 0;
+  for (kk_ssize_t i = 0; i < n; i++) { s += (uint64_t)(int64_t)p[i]; }
+  return (int64_t)s;
+}
+
+static int64_t kk_i64_dot(const int64_t* p, const int64_t* q, kk_ssize_t n) {
+  uint64_t s = 0;
+  for (kk_ssize_t i = 0; i < n; i++) { s += (uint64_t)p[i] * (uint64_t)q[i]; }
+  return (int64_t)s;
+}
+
+static int64_t kk_i32_dot(const int32_t* p, const int32_t* q, kk_ssize_t n) {
+  uint64_t s = 0;
+  for (kk_ssize_t i = 0; i < n; i++) { s += (uint64_t)((int64_t)p[i] * (int64_t)q[i]); }
+  return (int64_t)s;
+}
+
+static int64_t kk_u8_dot(const uint8_t* p, const uint8_t* q, kk_ssize_t n) {
+  uint64_t s = 0;
+  for (kk_ssize_t i = 0; i < n; i++) { s += (uint32_t)p[i] * (uint32_t)q[i]; }
+  return (int64_t)s;
+}
+
+
+/*--------------------------------------------------------------------------------------------------
+  Kernels for each element type. Element-wise arithmetic on integers wraps around
+  (computed on the unsigned type `utp`).
+--------------------------------------------------------------------------------------------------*/
+
+#define kk_uvector_define(name,tp,utp,sumtp,elemkind,boxname) \
+  kk_uvector_t kk_uvector_##name##_alloc(kk_ssize_t length, tp x, kk_context_t* ctx) { \
+    kk_uvector_t v = kk_uvector_alloc(elemkind, length, ctx); \
+    tp* p = kk_uvector_##name##_buf_borrow(v); \
+    for (kk_ssize_t i = 0; i < v->length; i++) { p[i] = x; } \
+    return v; \
+  } \
+  kk_uvector_t kk_uvector_##name##_from_vector(kk_vector_t vec, kk_context_t* ctx) { \
+    kk_ssize_t len; \
+    const kk_box_t* src = kk_vector_buf_borrow(vec, &len); \
+    kk_uvector_t v = kk_uvector_alloc(elemkind, len, ctx); \
+    tp* p = kk_uvector_##name##_buf_borrow(v); \
+    for (kk_ssize_t i = 0; i < len; i++) { p[i] = kk_##boxname##_unbox(src[i], NULL /* borrow */); } \
+    kk_vector_drop(vec, ctx); \
+    return v; \
+  } \
+  kk_vector_t kk_uvector_##name##_to_vector(kk_uvector_t v, kk_context_t* ctx) { \
+    kk_box_t* dest; \
+    const kk_ssize_t len = v->length; \
+    kk_vector_t vec = kk_vector_alloc_uninit(len, &dest, ctx); \
+    const tp* p = kk_uvector_##name##_buf_borrow(v); \
+    for (kk_ssize_t i = 0; i < len; i++) { dest[i] = kk_##boxname##_box(p[i], ctx); } \
+    kk_uvector_drop(v, ctx); \
+    return vec; \
+  } \
+  sumtp kk_uvector_##name##_sum(kk_uvector_t v, kk_context_t* ctx) { \
+    const sumtp s = kk_##name##_sum(kk_uvector_##name##_buf_borrow(v), v->length); \
+    kk_uvector_drop(v, ctx); \
+    return s; \
+  } \
+  sumtp kk_uvector_##name##_dot(kk_uvector_t v, kk_uvector_t w, kk_context_t* ctx) { \
+    const kk_ssize_t n = (v->length < w->length ? v->length : w->length); \
+    const sumtp s = kk_##name##_dot(kk_uvector_##name##_buf_borrow(v), kk_uvector_##name##_buf_borrow(w), n); \
+    kk_uvector_drop(v, ctx); \
+    kk_uvector_drop(w, ctx); \
+    return s; \
+  } \
+  kk_uvector_t kk_uvector_##name##_add(kk_uvector_t v, kk_uvector_t w, kk_context_t* ctx) { \
+    const kk_ssize_t n = (v->length < w->length ? v->length : w->length); \
+    v = kk_uvector_unique(v, ctx); \
+    v->length = n; \
+    tp* p = kk_uvector_##name##_buf_borrow(v); \
+    const tp* q = kk_uvector_##name##_buf_borrow(w); \
+    for (kk_ssize_t i = 0; i < n; i++) { p[i] = (tp)((utp)p[i] + (utp)q[i]); } \
+    kk_uvector_drop(w, ctx); \
+    return v; \
+  } \
+  kk_uvector_t kk_uvector_##name##_mul(kk_uvector_t v, kk_uvector_t w, kk_context_t* ctx) { \
+    const kk_ssize_t n = (v->length < w->length ? v->length : w->length); \
+    v = kk_uvector_unique(v, ctx); \
+    v->length = n; \
+    tp* p = kk_uvector_##name##_buf_borrow(v); \
+    const tp* q = kk_uvector_##name##_buf_borrow(w); \
+    for (kk_ssize_t i = 0; i < n; i++) { p[i] = (tp)((utp)p[i] * (utp)q[i]); } \
+    kk_uvector_drop(w, ctx); \
+    return v; \
+  } \
+  kk_uvector_t kk_uvector_##name##_scale(kk_uvector_t v, tp x, kk_context_t* ctx) { \
+    v = kk_uvector_unique(v, ctx); \
+    tp* p = kk_uvector_##name##_buf_borrow(v); \
+    for (kk_ssize_t i = 0; i < v->length; i++) { p[i] = (tp)((utp)p[i] * (utp)x); } \
+    return v; \
+  }
+
+kk_uvector_define(f64, double,  double,   double,  KK_UVECTOR_F64, double)
+kk_uvector_define(i64, int64_t, uint64_t, int64_t, KK_UVECTOR_I64, int64)
+kk_uvector_define(i32, int32_t, uint32_t, int64_t, KK_UVECTOR_I32, int32)
+kk_uvector_define(u8,  uint8_t, uint32_t, int64_t, KK_UVECTOR_U8,  uint8)
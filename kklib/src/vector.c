@@ -15,33 +15,137 @@ void kk_vector_init_borrow(kk_vector_t _v, kk_ssize_t start, kk_box_t def, kk_co
   kk_assert_internal(start >= 0);
   kk_ssize_t length;
   kk_box_t* v = kk_vector_buf_borrow(_v, &length);
-  // inline kk_box_dup and kk_box_drop for better performance
-  if (kk_box_is_ptr(def)) {
-    kk_block_t* b = kk_ptr_unbox(def);
-    for (kk_ssize_t i = start; i < length; i++) {
-      kk_block_dup(b);   // todo: dup with `length` in one go?
-      v[i] = def;
+  if (start >= length) {
+    kk_box_drop(def, ctx);
+    return;
+  }
+  kk_box_dupn(def, length - start - 1);  // add all references at once (and `def` itself is the last one)
+  for (kk_ssize_t i = start; i < length; i++) {
+    v[i] = def;
+  }
+}
+
+// Copy `n` elements, duplicating runs of the same element in one go
+static void kk_vector_copy_dup(kk_box_t* dest, const kk_box_t* src, kk_ssize_t n) {
+  kk_ssize_t i = 0;
+  while (i < n) {
+    const kk_box_t x = src[i];
+    kk_ssize_t j = i + 1;
+    while (j < n && kk_box_eq(src[j], x)) { j++; }
+    kk_box_dupn(x, j - i);
+    for (; i < j; i++) {
+      dest[i] = x;
     }
-    kk_box_drop(def,ctx);
   }
-  else {
-    for (kk_ssize_t i = start; i < length; i++) {
-      v[i] = def;
+}
+
+// The byte size of a vector block with room for `cap` elements
+static kk_ssize_t kk_vector_block_size(kk_ssize_t cap) {
+  return kk_ssizeof(struct kk_vector_large_s) + (cap - 1)*kk_ssizeof(kk_box_t);
+}
+
+// The capacity to reserve when growing a vector to `len` elements: growing by 1.5x
+// makes repeated pushes copy each element a constant number of times (amortized).
+static kk_ssize_t kk_vector_grow_capacity(kk_ssize_t oldlen, kk_ssize_t len) {
+  kk_assert_internal(len > oldlen);
+  const kk_ssize_t cap = oldlen + oldlen/2;
+  return (cap < len ? (len < 4 ? 4 : len) : cap);
+}
+
+// The number of elements that fit in the allocation of a (unique) vector.
+// The capacity is not stored in the vector itself (a field after the header would be scanned),
+// but given by the usable size of the allocation; extra room is never scanned.
+static kk_ssize_t kk_vector_capacity_borrow(kk_vector_large_t v, kk_ssize_t len) {
+  #if KK_MALLOC_USABLE_SIZE
+  if (!kk_block_is_arena(&v->_base._block)) {
+    const kk_ssize_t size = (kk_ssize_t)kk_malloc_usable_size(v);
+    return 1 + (size - kk_ssizeof(struct kk_vector_large_s)) / kk_ssizeof(kk_box_t);
+  }
+  #endif
+  return len;
+}
+
+// Set the length of a vector block (that has room for at least `len > 0` elements)
+static void kk_vector_set_len(kk_vector_large_t v, kk_ssize_t len) {
+  kk_assert_internal(len > 0);
+  v->_base.large_scan_fsize = kk_int_box(len + 1);
+}
+
+// Allocate an uninitialized vector of length `len` with room for `cap` elements (`0 < len <= cap`)
+static kk_vector_large_t kk_vector_alloc_cap(kk_ssize_t len, kk_ssize_t cap, kk_context_t* ctx) {
+  kk_assert_internal(len > 0 && len <= cap);
+  return (kk_vector_large_t)kk_block_large_alloc(kk_vector_block_size(cap), len + 1 /* kk_large_scan_fsize */, KK_TAG_VECTOR, ctx);
+}
+
+// Grow or shrink a unique vector to `newlen > 0` elements without initializing new elements;
+// shrinking first drops the elements that are cut off. Growing is in place if there is room
+// in the allocation (or if the allocator can extend it), and reserves extra capacity otherwise.
+static kk_vector_large_t kk_vector_resize_unique(kk_vector_large_t v, kk_ssize_t len, kk_ssize_t newlen, kk_context_t* ctx) {
+  kk_assert_internal(kk_block_is_unique(&v->_base._block) && newlen > 0);
+  if (newlen <= len) {
+    for (kk_ssize_t i = newlen; i < len; i++) {
+      kk_box_drop(v->vec[i], ctx);
+    }
+    if (newlen < len/2) {
+      // give back memory (the allocator may shrink in place)
+      v = (kk_vector_large_t)kk_block_realloc(&v->_base._block, kk_vector_block_size(newlen), ctx);
     }
   }
+  else if (newlen > kk_vector_capacity_borrow(v, len)) {
+    const kk_ssize_t cap = kk_vector_grow_capacity(len, newlen);
+    v = (kk_vector_large_t)kk_block_realloc(&v->_base._block, kk_vector_block_size(cap), ctx);
+  }
+  if (v == NULL) kk_fatal_error(ENOMEM, "unable to resize a vector");
+  kk_vector_set_len(v, newlen);
+  return v;
 }
 
 kk_vector_t kk_vector_realloc(kk_vector_t vec, kk_ssize_t newlen, kk_box_t def, kk_context_t* ctx) {
   kk_ssize_t len;
   kk_box_t* src = kk_vector_buf_borrow(vec, &len);
-  if (len == newlen) return vec;
+  if (len == newlen) {
+    kk_box_drop(def, ctx);
+    return vec;
+  }
+  if (len > 0 && newlen > 0 && kk_datatype_is_unique(vec)) {
+    // resize in place: the elements are moved (if the allocation moves at all)
+    kk_vector_large_t v = kk_vector_resize_unique(kk_vector_as_large_borrow(vec), len, newlen, ctx);
+    kk_vector_t vdest = kk_datatype_from_base(&v->_base);
+    kk_vector_init_borrow(vdest, len, def, ctx);  // set extra entries to default value
+    return vdest;
+  }
   kk_box_t* dest;
   kk_vector_t vdest = kk_vector_alloc_uninit(newlen, &dest, ctx);
   const kk_ssize_t n = (len > newlen ? newlen : len);
-  for (kk_ssize_t i = 0; i < n; i++) {
-    dest[i] = kk_box_dup(src[i]);
+  if (kk_datatype_is_unique(vec)) {
+    // move the elements and free the old vector shallowly
+    if (n > 0) { memcpy(dest, src, (size_t)n * sizeof(kk_box_t)); }
+    for (kk_ssize_t i = n; i < len; i++) {
+      kk_box_drop(src[i], ctx);
+    }
+    kk_block_free(vec.ptr, ctx);
+  }
+  else {
+    kk_vector_copy_dup(dest, src, n);
+    kk_vector_drop(vec, ctx);
   }
   kk_vector_init_borrow(vdest, n, def, ctx); // set extra entries to default value
-  kk_vector_drop(vec, ctx);
   return vdest;
-}
\ No newline at end of file
+}
+
+kk_vector_t kk_vector_push(kk_vector_t vec, kk_box_t x, kk_context_t* ctx) {
+  kk_ssize_t len;
+  kk_box_t* src = kk_vector_buf_borrow(vec, &len);
+  kk_vector_large_t v;
+  if (len > 0 && kk_datatype_is_unique(vec)) {
+    v = kk_vector_resize_unique(kk_vector_as_large_borrow(vec), len, len + 1, ctx);
+  }
+  else {
+    // copy into a fresh vector with room to grow
+    v = kk_vector_alloc_cap(len + 1, kk_vector_grow_capacity(len, len + 1), ctx);
+    kk_vector_copy_dup(&v->vec[0], src, len);
+    kk_vector_drop(vec, ctx);
+  }
+  v->vec[len] = x;
+  return kk_datatype_from_base(&v->_base);
+}
@@ -0,0 +1,336 @@
+/*---------------------------------------------------------------------------
+  Copyright 2020-2021, Microsoft Research, Daan Leijen.
+
+  This is free software; you can redistribute it and/or modify it under the
+  terms of the Apache License, Version 2.0. A copy of the License can be
+  found in the LICENSE file at the root of this distribution.
+---------------------------------------------------------------------------*/
+
+/*---------------------------------------------------------------------------
+  Microbenchmarks of kklib primitives.
+
+  Each benchmark runs an inner loop of `iters` iterations. We first calibrate
+  `iters` such that one run takes at least `--target=<ms>` milliseconds, and then
+  time `--runs=<n>` runs; reported are the minimum, median and mean time per
+  iteration in nanoseconds. The results are written as JSON (to stdout, or the
+  file given by `--out=<file>`) so they can be compared between commits.
+
+  Usage: kklib-bench [--filter=<substring>] [--out=<file>] [--runs=<n>] [--target=<ms>] [--quick]
+---------------------------------------------------------------------------*/
+#define __USE_MINGW_ANSI_STDIO 1  // so %z is valid on mingw
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "kklib.h"
+
+#ifdef KK_DEBUG_FULL
+#define BENCH_DEBUG  1
+#else
+#define BENCH_DEBUG  0
+#endif
+
+// results are accumulated into this sink so loops cannot be optimized away
+static volatile uint64_t bench_sink;
+
+typedef void (bench_fun_t)(size_t iters, void* arg, kk_context_t* ctx);
+
+static double bench_now(kk_context_t* ctx) {
+  double frac = 0.0;
+  double secs = kk_timer_ticks(&frac, ctx);
+  return (secs + frac);
+}
+
+static double bench_time(bench_fun_t* fun, size_t iters, void* arg, kk_context_t* ctx) {
+  double start = bench_now(ctx);
+  fun(iters, arg, ctx);
+  return (bench_now(ctx) - start);
+}
+
+static int bench_cmp_double(const void* p, const void* q) {
+  double x = *((const double*)p);
+  double y = *((const double*)q);
+  return (x < y ? -1 : (x > y ? 1 : 0));
+}
+
+
+/*---------------------------------------------------------------------------
+  Integers
+---------------------------------------------------------------------------*/
+
+typedef struct bench_int_arg_s {
+  kk_integer_t x;
+  kk_integer_t y;
+} bench_int_arg_t;
+
+static void bench_int_add(size_t iters, void* arg, kk_context_t* ctx) {
+  bench_int_arg_t* a = (bench_int_arg_t*)arg;
+  for (size_t i = 0; i < iters; i++) {
+    kk_integer_t z = kk_integer_add(kk_integer_dup(a->x), kk_integer_dup(a->y), ctx);
+    bench_sink += (uint64_t)z.value;
+    kk_integer_drop(z, ctx);
+  }
+}
+
+static void bench_int_mul(size_t iters, void* arg, kk_context_t* ctx) {
+  bench_int_arg_t* a = (bench_int_arg_t*)arg;
+  for (size_t i = 0; i < iters; i++) {
+    kk_integer_t z = kk_integer_mul(kk_integer_dup(a->x), kk_integer_dup(a->y), ctx);
+    bench_sink += (uint64_t)z.value;
+    kk_integer_drop(z, ctx);
+  }
+}
+
+static void bench_int_div(size_t iters, void* arg, kk_context_t* ctx) {
+  bench_int_arg_t* a = (bench_int_arg_t*)arg;
+  for (size_t i = 0; i < iters; i++) {
+    kk_integer_t z = kk_integer_div(kk_integer_dup(a->x), kk_integer_dup(a->y), ctx);
+    bench_sink += (uint64_t)z.value;
+    kk_integer_drop(z, ctx);
+  }
+}
+
+static void bench_int_show(size_t iters, void* arg, kk_context_t* ctx) {
+  bench_int_arg_t* a = (bench_int_arg_t*)arg;
+  for (size_t i = 0; i < iters; i++) {
+    kk_string_t s = kk_integer_to_string(kk_integer_dup(a->x), ctx);
+    bench_sink += (uint64_t)kk_string_len_borrow(s);
+    kk_string_drop(s, ctx);
+  }
+}
+
+// a positive integer with `digits` decimal digits
+static kk_integer_t bench_integer(kk_ssize_t digits, uint64_t seed, kk_context_t* ctx) {
+  char* s = (char*)kk_malloc(digits + 1, ctx);
+  for (kk_ssize_t i = 0; i < digits; i++) {
+    seed = (seed * KU64(6364136223846793005)) + KU64(1442695040888963407);
+    s[i] = (char)('0' + ((seed >> 33) % 10));
+  }
+  s[0] = '7';
+  s[digits] = 0;
+  kk_integer_t x = kk_integer_from_str(s, ctx);
+  kk_free(s);
+  return x;
+}
+
+
+/*---------------------------------------------------------------------------
+  Reference counting
+---------------------------------------------------------------------------*/
+
+static void bench_dup_drop(size_t iters, void* arg, kk_context_t* ctx) {
+  kk_block_t* b = (kk_block_t*)arg;
+  for (size_t i = 0; i < iters; i++) {
+    kk_block_drop(kk_block_dup(b), ctx);
+  }
+}
+
+static void bench_alloc_drop(size_t iters, void* arg, kk_context_t* ctx) {
+  KK_UNUSED(arg);
+  for (size_t i = 0; i < iters; i++) {
+    kk_block_t* b = kk_block_alloc(kk_ssizeof(kk_block_t) + kk_ssizeof(kk_box_t), 0, KK_TAG_BOX, ctx);
+    bench_sink += (uint64_t)(uintptr_t)b;
+    kk_block_drop(b, ctx);
+  }
+}
+
+
+/*---------------------------------------------------------------------------
+  Strings
+---------------------------------------------------------------------------*/
+
+typedef struct bench_str_arg_s {
+  kk_string_t str;
+  kk_string_t pat;
+} bench_str_arg_t;
+
+static void bench_str_index_of(size_t iters, void* arg, kk_context_t* ctx) {
+  bench_str_arg_t* a = (bench_str_arg_t*)arg;
+  for (size_t i = 0; i < iters; i++) {
+    bench_sink += (uint64_t)kk_string_index_of1(kk_string_dup(a->str), kk_string_dup(a->pat), ctx);
+  }
+}
+
+static void bench_str_count(size_t iters, void* arg, kk_context_t* ctx) {
+  KK_UNUSED(ctx);
+  bench_str_arg_t* a = (bench_str_arg_t*)arg;
+  for (size_t i = 0; i < iters; i++) {
+    bench_sink += (uint64_t)kk_string_count_borrow(a->str);
+  }
+}
+
+// `n` bytes of text made of `unit`, ending with `last`
+static kk_string_t bench_text(kk_ssize_t n, const char* unit, const char* last, kk_context_t* ctx) {
+  const kk_ssize_t ulen = (kk_ssize_t)strlen(unit);
+  const kk_ssize_t llen = (kk_ssize_t)strlen(last);
+  char* s = (char*)kk_malloc(n + llen + 1, ctx);
+  kk_ssize_t i = 0;
+  while (i + ulen <= n) {
+    memcpy(s + i, unit, (size_t)ulen);
+    i += ulen;
+  }
+  memcpy(s + i, last, (size_t)llen + 1);
+  kk_string_t str = kk_string_alloc_dup_valid_utf8(s, ctx);
+  kk_free(s);
+  return str;
+}
+
+
+/*---------------------------------------------------------------------------
+  Boxing and random numbers
+---------------------------------------------------------------------------*/
+
+static void bench_double_box(size_t iters, void* arg, kk_context_t* ctx) {
+  KK_UNUSED(arg);
+  double d = 1.5;
+  for (size_t i = 0; i < iters; i++) {
+    kk_box_t b = kk_double_box(d, ctx);
+    d = kk_double_unbox(b, ctx) + 0.25;
+  }
+  bench_sink += (uint64_t)d;
+}
+
+static void bench_srandom_uint32(size_t iters, void* arg, kk_context_t* ctx) {
+  KK_UNUSED(arg);
+  uint32_t x = 0;
+  for (size_t i = 0; i < iters; i++) {
+    x ^= kk_srandom_uint32(ctx);
+  }
+  bench_sink += x;
+}
+
+static void bench_srandom_range(size_t iters, void* arg, kk_context_t* ctx) {
+  KK_UNUSED(arg);
+  int32_t x = 0;
+  for (size_t i = 0; i < iters; i++) {
+    x ^= kk_srandom_range_int32(0, 1000, ctx);
+  }
+  bench_sink += (uint64_t)x;
+}
+
+static void bench_srandom_double(size_t iters, void* arg, kk_context_t* ctx) {
+  KK_UNUSED(arg);
+  double x = 0.0;
+  for (size_t i = 0; i < iters; i++) {
+    x += kk_srandom_double(ctx);
+  }
+  bench_sink += (uint64_t)x;
+}
+
+
+/*---------------------------------------------------------------------------
+  Driver
+---------------------------------------------------------------------------*/
+
+typedef struct bench_options_s {
+  const char* filter;
+  int         runs;
+  double      target;   // minimal seconds per run
+  FILE*       out;
+  bool        first;
+} bench_options_t;
+
+static void bench_run(bench_options_t* opts, const char* name, bench_fun_t* fun, void* arg, kk_context_t* ctx) {
+  if (opts->filter != NULL && strstr(name, opts->filter) == NULL) return;
+  // calibrate
+  size_t iters = 1;
+  double t = bench_time(fun, iters, arg, ctx);
+  while (t < opts->target && iters < (SIZE_MAX/4)) {
+    size_t scale = (t <= 0.0 ? 8 : (size_t)(1.2 * opts->target / t) + 1);
+    if (scale > 8) scale = 8;
+    if (scale < 2) scale = 2;
+    iters *= scale;
+    t = bench_time(fun, iters, arg, ctx);
+  }
+  // measure
+  double ns[64];
+  const int runs = (opts->runs > 64 ? 64 : opts->runs);
+  double total = 0.0;
+  for (int i = 0; i < runs; i++) {
+    ns[i] = 1.0e9 * bench_time(fun, iters, arg, ctx) / (double)iters;
+    total += ns[i];
+  }
+  qsort(ns, (size_t)runs, sizeof(double), &bench_cmp_double);
+  const double median = ((runs % 2) == 1 ? ns[runs/2] : (ns[runs/2 - 1] + ns[runs/2]) / 2.0);
+  fprintf(opts->out, "%s\n    { \"name\": \"%s\", \"iters\": %zu, \"runs\": %d, \"min_ns\": %.3f, \"median_ns\": %.3f, \"mean_ns\": %.3f }",
+          (opts->first ? "" : ","), name, iters, runs, ns[0], median, total / runs);
+  opts->first = false;
+  fprintf(stderr, "%-28s %12.2f ns/op (min %.2f)\n", name, median, ns[0]);
+}
+
+static void bench_ints(bench_options_t* opts, const char* suffix, kk_integer_t x, kk_integer_t y, kk_context_t* ctx) {
+  bench_int_arg_t arg = { x, y };
+  char name[64];
+  snprintf(name, sizeof(name), "int-add-%s", suffix);
+  bench_run(opts, name, &bench_int_add, &arg, ctx);
+  snprintf(name, sizeof(name), "int-mul-%s", suffix);
+  bench_run(opts, name, &bench_int_mul, &arg, ctx);
+  snprintf(name, sizeof(name), "int-div-%s", suffix);
+  bench_run(opts, name, &bench_int_div, &arg, ctx);
+  snprintf(name, sizeof(name), "int-show-%s", suffix);
+  bench_run(opts, name, &bench_int_show, &arg, ctx);
+  kk_integer_drop(x, ctx);
+  kk_integer_drop(y, ctx);
+}
+
+int main(int argc, char** argv) {
+  kk_context_t* ctx = kk_get_context();
+  bench_options_t opts = { NULL, 11, 0.02, stdout, true };
+  const char* fname = NULL;
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    if (strncmp(arg, "--filter=", 9) == 0) { opts.filter = arg + 9; }
+    else if (strncmp(arg, "--out=", 6) == 0) { fname = arg + 6; }
+    else if (strncmp(arg, "--runs=", 7) == 0) { opts.runs = atoi(arg + 7); }
+    else if (strncmp(arg, "--target=", 9) == 0) { opts.target = atof(arg + 9) / 1000.0; }
+    else if (strcmp(arg, "--quick") == 0) { opts.runs = 3; opts.target = 0.001; }
+    else {
+      fprintf(stderr, "usage: %s [--filter=<substring>] [--out=<file>] [--runs=<n>] [--target=<ms>] [--quick]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (opts.runs < 1) opts.runs = 1;
+  if (fname != NULL) {
+    opts.out = fopen(fname, "w");
+    if (opts.out == NULL) {
+      fprintf(stderr, "unable to open: %s\n", fname);
+      return 1;
+    }
+  }
+  fprintf(opts.out, "{\n  \"bits\": %d,\n  \"debug\": %d,\n  \"runs\": %d,\n  \"target_ms\": %.3f,\n  \"results\": [",
+          (int)(8*KK_INTPTR_SIZE), BENCH_DEBUG, opts.runs, 1000.0*opts.target);
+
+  // integers: small ints stay on the fast path, the others go through `kk_integer_*_generic`
+  bench_ints(&opts, "small", kk_integer_from_small(12345), kk_integer_from_small(-678), ctx);
+  bench_ints(&opts, "overflow", kk_integer_from_int(KK_SMALLINT_MAX, ctx), kk_integer_from_int(KK_SMALLINT_MAX - 1, ctx), ctx);
+  bench_ints(&opts, "big100", bench_integer(200, 1, ctx), bench_integer(100, 2, ctx), ctx);
+  bench_ints(&opts, "big1000", bench_integer(2000, 3, ctx), bench_integer(1000, 4, ctx), ctx);
+
+  // reference counting: a unique block is the fast path, a thread shared one uses atomics
+  kk_block_t* b = kk_block_alloc(kk_ssizeof(kk_block_t) + kk_ssizeof(kk_box_t), 0, KK_TAG_BOX, ctx);
+  bench_run(&opts, "block-dup-drop", &bench_dup_drop, b, ctx);
+  kk_block_mark_shared(b, ctx);
+  bench_run(&opts, "block-dup-drop-shared", &bench_dup_drop, b, ctx);
+  kk_block_drop(b, ctx);
+  bench_run(&opts, "block-alloc-drop", &bench_alloc_drop, NULL, ctx);
+
+  // strings
+  bench_str_arg_t sarg = { bench_text(64*1024, "the quick brown fox jumps over the lazy dog. ", "needle", ctx),
+                           kk_string_alloc_dup_valid_utf8("needle", ctx) };
+  bench_run(&opts, "string-index-of-64k", &bench_str_index_of, &sarg, ctx);
+  bench_run(&opts, "string-count-ascii-64k", &bench_str_count, &sarg, ctx);
+  kk_string_drop(sarg.str, ctx);
+  sarg.str = bench_text(64*1024, "de gr\xC3\xBC" "ne k\xC3\xA4" "fer \xE2\x82\xAC \xF0\x9F\x98\x80 ", "needle", ctx);
+  bench_run(&opts, "string-count-utf8-64k", &bench_str_count, &sarg, ctx);
+  kk_string_drop(sarg.str, ctx);
+  kk_string_drop(sarg.pat, ctx);
+
+  // boxing and random numbers
+  bench_run(&opts, "double-box", &bench_double_box, NULL, ctx);
+  bench_run(&opts, "srandom-uint32", &bench_srandom_uint32, NULL, ctx);
+  bench_run(&opts, "srandom-range-int32", &bench_srandom_range, NULL, ctx);
+  bench_run(&opts, "srandom-double", &bench_srandom_double, NULL, ctx);
+
+  fprintf(opts.out, "\n  ]\n}\n");
+  if (opts.out != stdout) { fclose(opts.out); }
+  return 0;
+}
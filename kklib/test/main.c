@@ -13,6 +13,11 @@
 #include <limits.h>
 #include <float.h>
 #include <inttypes.h>
+#if !defined(WIN32)
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
 
 #pragma GCC diagnostic ignored "-Wunused-function"
 #pragma GCC diagnostic ignored "-Woverlength-strings"
@@ -564,6 +569,1892 @@ static void test_ovf(kk_context_t* ctx) {
   printf("\nint-inc-dec: %6.3fs\n", (double)end/1000.0);
 }
 
+// A binary tree to test (incremental) freeing of large structures
+struct __tree_node_s {
+  kk_block_t _block;
+  kk_box_t   left;
+  kk_box_t   right;
+};
+
+static kk_box_t tree_build(int depth, kk_context_t* ctx) {
+  if (depth <= 0) return kk_int_box(0);
+  struct __tree_node_s* t = kk_block_alloc_as(struct __tree_node_s, 2, (kk_tag_t)1, ctx);
+  t->left = tree_build(depth-1, ctx);
+  t->right = tree_build(depth-1, ctx);
+  return kk_ptr_box(&t->_block);
+}
+
+#if !defined(WIN32)
+#include <pthread.h>
+
+// A new thread uses the global budget, and a drop is finished by any later allocation
+static void* free_budget_thread(void* arg) {
+  kk_context_t* ctx = kk_get_context();
+  kk_ssize_t* budget = (kk_ssize_t*)arg;
+  *budget = ctx->free_budget;
+  kk_box_drop(tree_build(16, ctx), ctx);
+  if (ctx->delayed_free == NULL) *budget = -1;
+  while (ctx->delayed_free != NULL) {
+    struct __tree_node_s* n = kk_block_as(struct __tree_node_s*, kk_block_alloc(kk_ssizeof(struct __tree_node_s), 2, (kk_tag_t)1, ctx));
+    n->left = n->right = kk_int_box(0);
+    kk_block_drop(&n->_block, ctx);
+  }
+  kk_free_context();
+  return NULL;
+}
+#endif
+
+// Measure the worst-case pause when dropping a large tree (and allocating afterwards)
+static void test_free_budget_run(kk_ssize_t budget, kk_context_t* ctx) {
+  const int depth = 20;  // about 1M nodes
+  const kk_ssize_t saved_budget = ctx->free_budget;
+  ctx->free_budget = budget;
+  kk_box_t t = tree_build(depth, ctx);
+  kk_timer_t start = kk_timer_start();
+  kk_box_drop(t, ctx);
+  kk_usecs_t max_pause = kk_timer_end(start);
+  kk_usecs_t drop_pause = max_pause;
+  kk_ssize_t allocs = 0;
+  while (ctx->delayed_free != NULL) {
+    start = kk_timer_start();
+    kk_box_t x = tree_build(1, ctx);  // allocation continues freeing
+    kk_usecs_t pause = kk_timer_end(start);
+    if (pause > max_pause) max_pause = pause;
+    kk_box_drop(x, ctx);
+    allocs++;
+  }
+  ctx->free_budget = saved_budget;
+  printf("free budget %6zd: drop: %6ldus, worst pause: %6ldus, allocations to finish: %zd\n",
+         budget, (long)drop_pause, (long)max_pause, allocs);
+}
+
+static kk_ssize_t tree_count_shared(kk_box_t t) {
+  if (!kk_box_is_ptr(t)) return 0;
+  struct __tree_node_s* n = (struct __tree_node_s*)kk_ptr_unbox(t);
+  return (kk_block_is_thread_shared(&n->_block) ? 1 : 0) + tree_count_shared(n->left) + tree_count_shared(n->right);
+}
+
+static void test_mark_shared(kk_context_t* ctx) {
+  kk_box_t t = tree_build(10, ctx);
+  kk_box_t u = kk_box_dup(t);
+  kk_box_mark_shared(t, ctx);
+  kk_block_t* root = kk_ptr_unbox(t);
+  printf("mark shared: %zd of %d nodes shared, root refcount: 0x%x\n", tree_count_shared(t), (1<<10)-1, (unsigned)root->header.refcount);
+  assert(tree_count_shared(t) == (1<<10)-1);
+  assert(root->header.refcount == KU32(0x80000001));
+  kk_box_mark_shared(t, ctx);                   // marking again is a no-op
+  assert(root->header.refcount == KU32(0x80000001));
+  kk_box_drop(u, ctx);
+  assert(root->header.refcount == KU32(0x80000000));
+  kk_box_drop(t, ctx);                          // frees the tree
+}
+
+// Count the nodes of a tree in a parallel task
+struct __fun_tree_count_s {
+  struct kk_function_s _base;
+  kk_box_t tree;
+};
+
+static kk_ssize_t tree_count(kk_box_t t) {
+  if (!kk_box_is_ptr(t)) return 0;
+  struct __tree_node_s* n = (struct __tree_node_s*)kk_ptr_unbox(t);
+  return 1 + tree_count(n->left) + tree_count(n->right);
+}
+
+static kk_box_t __fun_tree_count(kk_function_t fself, kk_context_t* ctx) {
+  struct __fun_tree_count_s* self = kk_function_as(struct __fun_tree_count_s*, fself);
+  kk_box_t t = kk_box_dup(self->tree);
+  kk_function_drop(fself, ctx);
+  kk_box_t res = kk_int_box(tree_count(t));
+  kk_box_drop(t, ctx);
+  return res;
+}
+
+static kk_function_t new_fun_tree_count(kk_box_t tree, kk_context_t* ctx) {
+  struct __fun_tree_count_s* f = kk_function_alloc_as(struct __fun_tree_count_s, 2, ctx);
+  f->_base.fun = kk_cfun_ptr_box(&__fun_tree_count, ctx);
+  f->tree = tree;
+  return &f->_base;
+}
+
+static void test_tasks(kk_context_t* ctx) {
+  const int depth = 16;
+  const kk_ssize_t n = 64;
+  kk_task_set_worker_count(4);   // use multiple workers even on a single core
+  kk_box_t t = tree_build(depth, ctx);
+  kk_box_t futures[64];
+  for (kk_ssize_t i = 0; i < n; i++) {
+    futures[i] = kk_task_spawn(new_fun_tree_count(kk_box_dup(t), ctx), ctx);
+  }
+  kk_ssize_t total = 0;
+  for (kk_ssize_t i = 0; i < n; i++) {
+    total += kk_int_unbox(kk_task_await(futures[i], ctx));
+  }
+  kk_box_drop(t, ctx);
+  printf("tasks: %zd workers, total count: %zd (expected %zd)\n", kk_task_worker_count(ctx), total, n*((1<<depth)-1));
+  assert(total == n*((1<<depth)-1));
+  // a top-level value is frozen by its module initialization (as generated by the compiler),
+  // so tasks can use it without writing its reference counts
+  kk_box_t g = tree_build(depth, ctx);
+  kk_box_drop(kk_box_freeze(kk_box_dup(g), ctx), ctx);
+  for (kk_ssize_t i = 0; i < n; i++) {
+    futures[i] = kk_task_spawn(new_fun_tree_count(kk_box_dup(g), ctx), ctx);
+  }
+  total = 0;
+  for (kk_ssize_t i = 0; i < n; i++) {
+    total += kk_int_unbox(kk_task_await(futures[i], ctx));
+  }
+  assert(total == n*((1<<depth)-1));
+  assert(kk_block_is_frozen(kk_ptr_unbox(g)) && kk_block_refcount(kk_ptr_unbox(g)) == KU32(0xE0000000));
+  kk_box_drop(g, ctx);  // no effect
+}
+
+#if KK_STATS
+// Check allocation and free counts of a tree, and reuse of a freed node
+static void test_stats(kk_context_t* ctx) {
+  const int depth = 10;
+  const kk_stats_t st0 = ctx->stats;
+  kk_box_t t = tree_build(depth, ctx);
+  kk_box_drop(t, ctx);
+  kk_box_t u = tree_build(1, ctx);
+  kk_reuse_t r = kk_block_drop_reuse(kk_ptr_unbox(u), ctx);
+  struct __tree_node_s* v = (struct __tree_node_s*)kk_block_alloc_at(r, sizeof(struct __tree_node_s), 2, (kk_tag_t)2, ctx);
+  v->left = kk_int_box(0);
+  v->right = kk_int_box(0);
+  kk_box_drop(kk_ptr_box(&v->_block), ctx);
+  const int64_t allocs = ctx->stats.allocs[1] - st0.allocs[1];
+  const int64_t frees  = ctx->stats.frees[1] - st0.frees[1];
+  const int64_t reuses = ctx->stats.reuses - st0.reuses;
+  printf("stats: tag 1 allocs: %lld, frees: %lld, reuses: %lld\n", (long long)allocs, (long long)frees, (long long)reuses);
+  assert(allocs == (1<<depth));
+  assert(frees == (1<<depth));
+  assert(reuses == 1);
+  assert(ctx->stats.allocs[2] - st0.allocs[2] == 1 && ctx->stats.frees[2] - st0.frees[2] == 1);
+}
+#endif
+
+// Freed small blocks are reused from the free cache, and the cache stays below the water mark
+static void test_free_cache(kk_context_t* ctx) {
+#if KK_FREE_CACHE
+  kk_box_t t = tree_build(1, ctx);
+  kk_block_t* root = kk_ptr_unbox(t);
+  assert(root->header.size_class == sizeof(struct __tree_node_s)/8);
+  kk_box_drop(t, ctx);
+  kk_box_t u = tree_build(1, ctx);
+  assert(kk_ptr_unbox(u) == root);
+  kk_box_drop(u, ctx);
+  kk_timer_t start = kk_timer_start();
+  for (int i = 0; i < 1000; i++) {
+    kk_box_drop(tree_build(8, ctx), ctx);
+  }
+  kk_usecs_t elapsed = kk_timer_end(start);
+  kk_ssize_t cached = 0;
+  for (kk_ssize_t bin = 0; bin <= KK_FREE_CACHE_BINS; bin++) {
+    assert(ctx->free_cache_count[bin] <= KK_FREE_CACHE_MAX);
+    cached += ctx->free_cache_count[bin];
+  }
+  printf("free cache: %zd blocks cached, build and drop: %ldus\n", cached, (long)elapsed);
+#else
+  KK_UNUSED(ctx);
+#endif
+}
+
+// Vector initialization with a shared default value increments the reference count in one step
+static void test_vector_dupn(kk_context_t* ctx) {
+  const kk_ssize_t n = 10000000;
+  kk_box_t def = tree_build(1, ctx);
+  kk_block_t* blk = kk_ptr_unbox(def);
+  kk_timer_t start = kk_timer_start();
+  kk_vector_t v = kk_vector_alloc(n, kk_box_dup(def), ctx);
+  kk_usecs_t elapsed = kk_timer_end(start);
+  printf("vector dupn: init %zd elements: %ldus, refcount: %u\n", n, (long)elapsed, (unsigned)blk->header.refcount);
+  assert(blk->header.refcount == (uint32_t)n);
+  v = kk_vector_realloc(v, n/2, kk_box_dup(def), ctx);   // unique: moves and drops the rest
+  assert(blk->header.refcount == (uint32_t)(n/2));
+  kk_vector_t w = kk_vector_realloc(kk_vector_dup(v), n, kk_box_dup(def), ctx);  // shared: copies
+  assert(blk->header.refcount == (uint32_t)(n + n/2));
+  kk_vector_drop(w, ctx);
+  kk_vector_drop(v, ctx);
+  assert(blk->header.refcount == 0);
+  // pushing to a unique vector grows in place with amortized capacity
+  const kk_ssize_t pushes = 100000;
+  kk_ssize_t moves = 0;
+  v = kk_vector_empty();
+  for (kk_ssize_t i = 0; i < pushes; i++) {
+    kk_block_t* prev = (kk_datatype_is_ptr(v) ? v.ptr : NULL);
+    v = kk_vector_push(v, kk_box_dup(def), ctx);
+    if (v.ptr != prev) moves++;
+  }
+  printf("vector push: %zd elements, %zd reallocations\n", pushes, moves);
+  assert(kk_vector_len_borrow(v) == pushes && blk->header.refcount == (uint32_t)pushes);
+  assert(moves < 64);
+  w = kk_vector_push(kk_vector_dup(v), kk_box_dup(def), ctx);   // shared: copies
+  assert(w.ptr != v.ptr && kk_vector_len_borrow(w) == pushes + 1 && kk_vector_len_borrow(v) == pushes);
+  kk_vector_drop(w, ctx);
+  kk_vector_drop(v, ctx);
+  assert(blk->header.refcount == 0);
+  // overflow into the atomic range, and becoming sticky
+  blk->header.refcount = KU32(0x7FFFFFF0);
+  kk_block_dupn(blk, 0x20);
+  assert(blk->header.refcount == KU32(0x80000010));
+  kk_block_dupn(blk, 0x7FFFFFFF);
+  assert(blk->header.refcount == KU32(0xD0000000));
+  kk_block_dupn(blk, 1);
+  assert(blk->header.refcount == KU32(0xD0000000));
+  blk->header.refcount = 0;
+  kk_box_drop(def, ctx);
+}
+
+// Visit all nodes with a dup and drop on each (as a lookup does when descending)
+static kk_ssize_t tree_walk(kk_box_t t, kk_context_t* ctx) {
+  if (!kk_box_is_ptr(t)) return 0;
+  struct __tree_node_s* n = (struct __tree_node_s*)kk_ptr_unbox(t);
+  kk_box_t l = kk_box_dup(n->left);
+  kk_box_t r = kk_box_dup(n->right);
+  kk_ssize_t count = 1 + tree_walk(l, ctx) + tree_walk(r, ctx);
+  kk_box_drop(l, ctx);
+  kk_box_drop(r, ctx);
+  return count;
+}
+
+static kk_usecs_t test_freeze_walk(kk_box_t t, kk_context_t* ctx) {
+  kk_timer_t start = kk_timer_start();
+  for (int i = 0; i < 20; i++) {
+    tree_walk(t, ctx);
+  }
+  return kk_timer_end(start);
+}
+
+static kk_box_t frozen_tree;  // frozen values live for the rest of the process
+
+// Compare walking a regular, a thread shared, and a frozen tree
+static void test_freeze(kk_context_t* ctx) {
+  const int depth = 16;
+  kk_box_t t = tree_build(depth, ctx);
+  kk_usecs_t t_plain = test_freeze_walk(t, ctx);
+  kk_box_mark_shared(t, ctx);
+  kk_usecs_t t_shared = test_freeze_walk(t, ctx);
+  kk_block_t* root = kk_ptr_unbox(t);
+  frozen_tree = kk_box_freeze(t, ctx);
+  assert(kk_block_is_frozen(root) && kk_block_is_thread_shared(root));
+  kk_usecs_t t_frozen = test_freeze_walk(frozen_tree, ctx);
+  assert(root->header.refcount == KU32(0xE0000000));
+  kk_box_drop(t, ctx);                 // no effect
+  assert(kk_block_is_frozen(root));
+  assert(tree_walk(frozen_tree, ctx) == (1<<depth)-1);
+  printf("freeze: walk regular: %ldus, shared: %ldus, frozen: %ldus\n", (long)t_plain, (long)t_shared, (long)t_frozen);
+}
+
+// Drop a large tree on the reclaimer thread while parts of it are still in use
+static void test_reclaim(kk_context_t* ctx) {
+  const int depth = 20;
+  const kk_ssize_t saved_threshold = ctx->reclaim_threshold;
+  ctx->reclaim_threshold = 10000;
+  kk_box_t t = tree_build(depth, ctx);
+  struct __tree_node_s* root = (struct __tree_node_s*)kk_ptr_unbox(t);
+  kk_box_t live = kk_box_dup(((struct __tree_node_s*)kk_ptr_unbox(root->left))->right);  // still referenced
+  kk_box_t shared = kk_box_dup(((struct __tree_node_s*)kk_ptr_unbox(root->right))->left);
+  kk_box_mark_shared(shared, ctx);                                                           // thread shared
+  kk_timer_t start = kk_timer_start();
+  kk_box_drop(t, ctx);
+  kk_usecs_t drop_pause = kk_timer_end(start);
+  kk_reclaim_context_done(ctx);        // wait for the reclaimer and apply passed back decrements
+  assert(tree_count(live) == (1<<(depth-2))-1);
+  assert(tree_count(shared) == (1<<(depth-2))-1);
+  assert(kk_block_refcount(kk_ptr_unbox(live)) == 0);
+  assert(kk_block_refcount(kk_ptr_unbox(shared)) == KU32(0x80000000));
+  kk_box_drop(live, ctx);
+  kk_box_drop(shared, ctx);
+  // explicitly on the reclaimer thread
+  ctx->reclaim_threshold = 0;
+  t = tree_build(depth, ctx);
+  start = kk_timer_start();
+  kk_box_drop_reclaim(t, ctx);
+  kk_usecs_t explicit_pause = kk_timer_end(start);
+  kk_reclaim_context_done(ctx);
+  ctx->reclaim_threshold = saved_threshold;
+  printf("reclaim: drop with threshold: %ldus, explicit: %ldus\n", (long)drop_pause, (long)explicit_pause);
+}
+
+// Sample allocations and write a pprof profile
+static void test_heapprof(kk_context_t* ctx) {
+  // write the profile to the temporary directory
+  const char* tmpdir = getenv("TMPDIR");
+  if (tmpdir == NULL || tmpdir[0] == 0) tmpdir = getenv("TEMP");
+  #ifdef WIN32
+  if (tmpdir == NULL || tmpdir[0] == 0) tmpdir = ".";
+  #else
+  if (tmpdir == NULL || tmpdir[0] == 0) tmpdir = "/tmp";
+  #endif
+  char fname[1024];
+  snprintf(fname, sizeof(fname), "%s/kklib-test-heap.pb.out", tmpdir);
+  kk_heapprof_enable(fname, 4096);
+  ctx->heap_sample_countdown = kk_heapprof_countdown();
+  kk_box_t t = tree_build(16, ctx);   // about 1.5MiB
+  kk_box_drop(t, ctx);
+  bool ok = kk_heapprof_dump();
+  assert(ok); KK_UNUSED_RELEASE(ok);
+  FILE* f = fopen(fname, "rb");
+  assert(f != NULL);
+  fseek(f, 0, SEEK_END);
+  long len = ftell(f);
+  fclose(f);
+  printf("heap profile: %ld bytes\n", len);
+  assert(len > 0);
+  remove(fname);
+  // and turn profiling off again for the remaining tests
+  kk_heapprof_disable();
+  ctx->heap_sample_countdown = kk_heapprof_countdown();
+  assert(ctx->heap_sample_countdown == KK_SSIZE_MAX);
+}
+
+// Build and drop temporary trees in an arena, and copy a result out
+static void test_arena(kk_context_t* ctx) {
+  const int depth = 18;
+  kk_timer_t start = kk_timer_start();
+  for (int i = 0; i < 4; i++) {
+    kk_box_t t = tree_build(depth, ctx);
+    kk_box_drop(t, ctx);
+  }
+  kk_usecs_t t_heap = kk_timer_end(start);
+  start = kk_timer_start();
+  for (int i = 0; i < 4; i++) {
+    kk_arena_enter(ctx);
+    kk_box_t t = tree_build(depth, ctx);
+    KK_UNUSED(t);                          // released with the arena
+    kk_box_t none = kk_arena_leave(kk_box_null, ctx);
+    KK_UNUSED(none);
+  }
+  kk_usecs_t t_arena = kk_timer_end(start);
+  // a result that refers to an older tree and to a shared arena subtree
+  kk_box_t old = tree_build(4, ctx);
+  kk_arena_enter(ctx);
+  kk_box_t sub = tree_build(6, ctx);
+  struct __tree_node_s* n = kk_block_alloc_as(struct __tree_node_s, 2, 1, ctx);
+  assert(kk_block_is_arena(&n->_block));
+  n->left = kk_box_dup(sub);
+  n->right = kk_box_dup(old);
+  struct __tree_node_s* m = kk_block_alloc_as(struct __tree_node_s, 2, 1, ctx);
+  m->left = kk_ptr_box(&n->_block);
+  m->right = sub;
+  kk_box_t garbage = tree_build(10, ctx);
+  kk_box_drop(garbage, ctx);
+  kk_box_t res = kk_arena_leave(kk_ptr_box(&m->_block), ctx);
+  assert(!kk_block_is_arena(kk_ptr_unbox(res)));
+  assert(tree_count(res) == 1 + 1 + (1<<6)-1 + (1<<4)-1 + (1<<6)-1);
+  struct __tree_node_s* mres = (struct __tree_node_s*)kk_ptr_unbox(res);
+  struct __tree_node_s* nres = (struct __tree_node_s*)kk_ptr_unbox(mres->left);
+  assert(kk_ptr_unbox(mres->right) == kk_ptr_unbox(nres->left));   // sharing is kept
+  assert(kk_block_refcount(kk_ptr_unbox(mres->right)) == 1);
+  assert(kk_block_refcount(kk_ptr_unbox(old)) == 1);                // the copy and `old`
+  kk_box_drop(res, ctx);
+  assert(kk_block_refcount(kk_ptr_unbox(old)) == 0);
+  kk_box_drop(old, ctx);
+  // a large result spanning many chunks, inside an outer arena whose blocks are shared (not copied)
+  kk_arena_enter(ctx);
+  old = tree_build(4, ctx);
+  kk_arena_enter(ctx);
+  n = kk_block_alloc_as(struct __tree_node_s, 2, 1, ctx);
+  n->left = tree_build(depth - 2, ctx);
+  n->right = kk_box_dup(old);
+  start = kk_timer_start();
+  res = kk_arena_leave(kk_ptr_box(&n->_block), ctx);
+  kk_usecs_t t_copy = kk_timer_end(start);
+  assert(kk_block_is_arena(kk_ptr_unbox(res)));   // copied into the outer arena
+  nres = (struct __tree_node_s*)kk_ptr_unbox(res);
+  assert(kk_ptr_unbox(nres->right) == kk_ptr_unbox(old));
+  KK_UNUSED_RELEASE(nres);
+  assert(tree_count(res) == 1 + (1<<(depth-2))-1 + (1<<4)-1);
+  kk_box_drop(old, ctx);
+  res = kk_arena_leave(res, ctx);
+  assert(!kk_block_is_arena(kk_ptr_unbox(res)));
+  assert(tree_count(res) == 1 + (1<<(depth-2))-1 + (1<<4)-1);
+  kk_box_drop(res, ctx);
+  // keep an arena alive after leaving
+  kk_arena_enter(ctx);
+  kk_box_t kept = tree_build(8, ctx);
+  kk_arena_t* arena = kk_arena_leave_keep(ctx);
+  assert(tree_count(kept) == (1<<8)-1);
+  kk_box_drop(kept, ctx);
+  kk_arena_free(arena, ctx);
+  // pending frees of a kept arena are finished before it is released
+  kk_arena_enter(ctx);
+  kept = tree_build(8, ctx);
+  arena = kk_arena_leave_keep(ctx);
+  const kk_ssize_t budget = ctx->free_budget;
+  ctx->free_budget = 10;
+  kk_box_drop(kept, ctx);
+  assert(ctx->delayed_free != NULL);
+  kk_arena_free(arena, ctx);
+  assert(ctx->delayed_free == NULL);
+  ctx->free_budget = budget;
+  printf("arena: build and drop on the heap: %ldus, in an arena: %ldus, copy out %d nodes: %ldus\n", (long)t_heap, (long)t_arena, (1<<(depth-2)), (long)t_copy);
+}
+
+static kk_integer_t random_integer(kk_ssize_t digits, uint64_t* seed, kk_context_t* ctx) {
+  char* s = (char*)kk_malloc(digits + 1, ctx);
+  for (kk_ssize_t i = 0; i < digits; i++) {
+    *seed = (*seed * KU64(6364136223846793005)) + KU64(1442695040888963407);
+    s[i] = (char)('0' + ((*seed >> 33) % 10));
+  }
+  s[0] = '7';
+  s[digits] = 0;
+  kk_integer_t x = kk_integer_from_str(s, ctx);
+  kk_free(s);
+  return x;
+}
+
+// check `x*y` modulo a few primes so each multiplication tier is verified independently
+static void test_mul_tiers(kk_context_t* ctx) {
+  // `(10^k - 1)^2 == 10^2k - 2*10^k + 1` has all digits at the maximum so every carry is exercised
+  for (kk_intx_t k = 18; k <= 18*40; k += 18*13) {
+    kk_integer_t x = kk_integer_dec(kk_integer_mul_pow10(kk_integer_one, kk_integer_from_int(k, ctx), ctx), ctx);
+    kk_integer_t y = kk_integer_dec(kk_integer_mul_pow10(kk_integer_from_small(3), kk_integer_from_int(k, ctx), ctx), ctx);
+    kk_integer_t expect = kk_integer_add(kk_integer_sub(kk_integer_mul_pow10(kk_integer_one, kk_integer_from_int(2*k, ctx), ctx),
+                                                        kk_integer_mul_pow10(kk_integer_from_small(2), kk_integer_from_int(k, ctx), ctx), ctx), kk_integer_one, ctx);
+    bool eq = kk_integer_eq(kk_integer_mul(kk_integer_dup(x), kk_integer_dup(x), ctx), expect, ctx);
+    assert(eq);
+    // and `(10^k - 1)*(3*10^k - 1) == 3*10^2k - 4*10^k + 1`
+    expect = kk_integer_add(kk_integer_sub(kk_integer_mul_pow10(kk_integer_from_small(3), kk_integer_from_int(2*k, ctx), ctx),
+                                           kk_integer_mul_pow10(kk_integer_from_small(4), kk_integer_from_int(k, ctx), ctx), ctx), kk_integer_one, ctx);
+    eq = kk_integer_eq(kk_integer_mul(x, y, ctx), expect, ctx);
+    assert(eq); KK_UNUSED_RELEASE(eq);
+  }
+  const kk_ssize_t sizes[] = { 500, 1000, 3000, 20000, 1000000 };
+  const char* primes[] = { "1000000000000000003", "999999999999999989", "170141183460469231731687303715884105727" };
+  uint64_t seed = 42;
+  for (size_t i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++) {
+    for (size_t j = (i == 0 ? 0 : i - 1); j <= i; j++) {
+      kk_integer_t x = random_integer(sizes[i], &seed, ctx);
+      kk_integer_t y = kk_integer_neg(random_integer(sizes[j], &seed, ctx), ctx);
+      kk_timer_t start = kk_timer_start();
+      kk_integer_t z = kk_integer_mul(kk_integer_dup(x), kk_integer_dup(y), ctx);
+      kk_usecs_t elapsed = kk_timer_end(start);
+      printf("multiply %zd x %zd decimal digits: %ldus\n", sizes[i], sizes[j], (long)elapsed);
+      for (size_t k = 0; k < sizeof(primes)/sizeof(primes[0]); k++) {
+        kk_integer_t p = kk_integer_from_str(primes[k], ctx);
+        kk_integer_t xm = kk_integer_mod(kk_integer_dup(x), kk_integer_dup(p), ctx);
+        kk_integer_t ym = kk_integer_mod(kk_integer_dup(y), kk_integer_dup(p), ctx);
+        kk_integer_t expect = kk_integer_mod(kk_integer_mul(xm, ym, ctx), kk_integer_dup(p), ctx);
+        kk_integer_t zm = kk_integer_mod(kk_integer_dup(z), p, ctx);
+        bool eq = kk_integer_eq(zm, expect, ctx);
+        assert(eq); KK_UNUSED_RELEASE(eq);
+      }
+      kk_integer_drop(x, ctx);
+      kk_integer_drop(y, ctx);
+      kk_integer_drop(z, ctx);
+    }
+  }
+}
+
+static void test_pow(kk_context_t* ctx) {
+  const kk_intx_t exps[] = { 0, 1, 2, 3, 7, 8, 13, 100, 255, 256, 1000, 4097 };
+  kk_integer_t x = kk_integer_from_str("-123456789012345678901234567", ctx);
+  for (size_t i = 0; i < sizeof(exps)/sizeof(exps[0]); i++) {
+    kk_integer_t expect = kk_integer_one;
+    for (kk_intx_t k = 0; k < exps[i]; k++) {
+      expect = kk_integer_mul(expect, kk_integer_dup(x), ctx);
+    }
+    kk_integer_t z = kk_integer_pow(kk_integer_dup(x), kk_integer_from_int(exps[i], ctx), ctx);
+    bool eq = kk_integer_eq(z, expect, ctx);
+    assert(eq); KK_UNUSED_RELEASE(eq);
+  }
+  kk_integer_drop(x, ctx);
+  kk_timer_t start = kk_timer_start();
+  kk_integer_t z = kk_integer_pow(kk_integer_from_small(3), kk_integer_from_int(2000000, ctx), ctx);
+  kk_usecs_t elapsed = kk_timer_end(start);
+  printf("pow: 3^2000000: %ldus\n", (long)elapsed);
+  kk_integer_t m = kk_integer_mod(z, kk_integer_from_int(1000000007, ctx), ctx);  // == pow(3,2000000,1000000007)
+  bool eq = kk_integer_eq(m, kk_integer_from_int(961835147, ctx), ctx);
+  assert(eq); KK_UNUSED_RELEASE(eq);
+}
+
+static void test_hex_roundtrip(kk_context_t* ctx) {
+  // 16^2000 - 1 is 2000 'f' digits
+  kk_integer_t x = kk_integer_dec(kk_integer_pow(kk_integer_from_small(16), kk_integer_from_small(2000), ctx), ctx);
+  kk_string_t s = kk_integer_to_hex_string(x, false, ctx);
+  const char* cs = kk_string_cbuf_borrow(s, NULL);
+  assert(strlen(cs) == 2000 && strspn(cs, "f") == 2000);
+  kk_string_drop(s, ctx);
+  const kk_ssize_t sizes[] = { 30, 1000, 10000, 100000 };
+  uint64_t seed = 7;
+  for (size_t i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++) {
+    x = random_integer(sizes[i], &seed, ctx);
+    kk_timer_t start = kk_timer_start();
+    s = kk_integer_to_hex_string(kk_integer_dup(x), true, ctx);
+    kk_usecs_t t_show = kk_timer_end(start);
+    start = kk_timer_start();
+    kk_integer_t y;
+    bool ok = kk_integer_hex_parse(kk_string_cbuf_borrow(s, NULL), &y, ctx);
+    kk_usecs_t t_parse = kk_timer_end(start);
+    printf("hex: %zd decimal digits: show %ldus, parse %ldus\n", sizes[i], (long)t_show, (long)t_parse);
+    bool eq = ok && kk_integer_eq(x, y, ctx);
+    assert(eq); KK_UNUSED_RELEASE(eq);
+    kk_string_drop(s, ctx);
+  }
+}
+
+static kk_integer_t parse_integer(const char* s, kk_context_t* ctx) {
+  kk_integer_t x;
+  const bool ok = kk_integer_parse(s, &x, ctx);
+  assert(ok);
+  return x;
+}
+
+// Parse decimal and hexadecimal numbers of every length, with underscores, fractions and exponents
+static void test_integer_parse(kk_context_t* ctx) {
+  char buf[256];
+  char alt[256];
+  uint64_t seed = 5;
+  for (int len = 1; len <= 60; len++) {
+    for (int i = 0; i < len; i++) {
+      seed = seed*6364136223846793005ULL + 1442695040888963407ULL;
+      buf[i] = (char)('0' + (i == 0 && len > 1 ? 1 + (seed >> 33) % 9 : (seed >> 33) % 10));
+    }
+    buf[len] = 0;
+    // round trip, and negative
+    kk_string_t str = kk_integer_to_string(parse_integer(buf, ctx), ctx);
+    assert(strcmp(kk_string_cbuf_borrow(str, NULL), buf) == 0);
+    kk_string_drop(str, ctx);
+    alt[0] = '-'; strcpy(alt + 1, buf);
+    str = kk_integer_to_string(parse_integer(alt, ctx), ctx);
+    assert(strcmp(kk_string_cbuf_borrow(str, NULL), (len == 1 && buf[0] == '0' ? "0" : alt)) == 0);
+    kk_string_drop(str, ctx);
+    kk_integer_t x = parse_integer(buf, ctx);
+    // with underscores
+    int n = 0;
+    for (int i = 0; i < len; i++) {
+      if (i > 0 && (len - i) % 3 == 0) alt[n++] = '_';
+      alt[n++] = buf[i];
+    }
+    alt[n] = 0;
+    bool eq = kk_integer_eq(parse_integer(alt, ctx), kk_integer_dup(x), ctx);
+    assert(eq);
+    // as a fraction with an exponent: `d.ddd000e<k>` with `k` greater than the fraction digits
+    const int frac = len / 2;
+    n = snprintf(alt, sizeof(alt), "%.*s.%s000e%d", len - frac, buf, buf + (len - frac), frac + 7);
+    assert(n > 0 && n < (int)sizeof(alt));
+    kk_integer_t y = kk_integer_mul_pow10(kk_integer_dup(x), kk_integer_from_small(7), ctx);
+    if (frac > 0) {
+      eq = kk_integer_eq(parse_integer(alt, ctx), kk_integer_dup(y), ctx);
+      assert(eq);
+    }
+    kk_integer_drop(y, ctx);
+    // hexadecimal
+    kk_integer_t h = kk_integer_zero;
+    n = snprintf(alt, sizeof(alt), "0x");
+    for (int i = 0; i < len; i++) {
+      const int hd = (buf[i] - '0' + i) % 16;
+      alt[n++] = (char)(hd < 10 ? '0' + hd : (i % 2 == 0 ? 'a' : 'A') + hd - 10);
+      if (i % 5 == 4 && i + 1 < len) alt[n++] = '_';
+      h = kk_integer_add(kk_integer_mul(h, kk_integer_from_small(16), ctx), kk_integer_from_small(hd), ctx);
+    }
+    alt[n] = 0;
+    kk_integer_t z;
+    eq = kk_integer_hex_parse(alt, &z, ctx) && kk_integer_eq(z, kk_integer_dup(h), ctx);
+    assert(eq);
+    eq = kk_integer_parse(alt, &z, ctx) && kk_integer_eq(z, h, ctx);
+    assert(eq); KK_UNUSED_RELEASE(eq);
+    kk_integer_drop(x, ctx);
+  }
+  // invalid numbers
+  const char* invalid[] = { "", "-", "12a", "1_", "_1", "1__2", "0x", "0xg", "1.5", "12 ", "123456789012345678901234567890x", "1e", "0x12_" };
+  for (size_t i = 0; i < sizeof(invalid)/sizeof(invalid[0]); i++) {
+    kk_integer_t x;
+    const bool ok = kk_integer_parse(invalid[i], &x, ctx);
+    assert(!ok); KK_UNUSED_RELEASE(ok);
+  }
+}
+
+// check `x == q*y + r` with `|r| < |y|` for each division path (long, top digits, blocks)
+static void test_div_large(kk_context_t* ctx) {
+  const kk_ssize_t sizes[][2] = { { 5000, 4000 }, { 15000, 12000 }, { 30000, 15000 }, { 100000, 12000 }, { 40000, 39000 } };
+  uint64_t seed = 11;
+  for (size_t i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++) {
+    kk_integer_t x = random_integer(sizes[i][0], &seed, ctx);
+    kk_integer_t y = random_integer(sizes[i][1], &seed, ctx);
+    if (i % 2 == 1) { x = kk_integer_neg(x, ctx); }
+    if (i % 3 == 1) { y = kk_integer_neg(y, ctx); }
+    kk_integer_t r;
+    kk_timer_t start = kk_timer_start();
+    kk_integer_t q = kk_integer_cdiv_cmod(kk_integer_dup(x), kk_integer_dup(y), &r, ctx);
+    kk_usecs_t elapsed = kk_timer_end(start);
+    printf("divide %zd / %zd decimal digits: %ldus\n", sizes[i][0], sizes[i][1], (long)elapsed);
+    const bool sign_ok = kk_integer_is_zero(kk_integer_dup(r), ctx) || kk_integer_is_neg(kk_integer_dup(r), ctx) == kk_integer_is_neg(kk_integer_dup(x), ctx);
+    const bool rem_ok = kk_integer_lt(kk_integer_abs(kk_integer_dup(r), ctx), kk_integer_abs(kk_integer_dup(y), ctx), ctx);
+    kk_integer_t z = kk_integer_add(kk_integer_mul(q, y, ctx), r, ctx);
+    const bool eq = kk_integer_eq(z, x, ctx);
+    assert(sign_ok && rem_ok && eq); KK_UNUSED_RELEASE(sign_ok); KK_UNUSED_RELEASE(rem_ok); KK_UNUSED_RELEASE(eq);
+  }
+}
+
+// compare conversion from (q)utf-8 against decoding per code point, and check that qutf-8 and qutf-16 round-trip
+static void test_utf8(kk_context_t* ctx) {
+  const uint8_t bytes[] = { 'a', 0x80, 0x8F, 0x90, 0x9F, 0xA0, 0xAD, 0xAE, 0xBF, 0xC0, 0xC2, 0xDF, 0xE0, 0xED, 0xEF, 0xF0, 0xF3, 0xF4, 0xF5, 0xFF };
+  const char* seqs[] = { "abcdefgh", "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\x98\x80", "\xF3\xAE\x82\x80", "\xED\x9F\xBF", "\xEF\xBF\xBD", "\xF4\x8F\xBF\xBF" };
+  const uint16_t units[] = { 'a', 0x7F, 0x80, 0x7FF, 0x800, 0xD7FF, 0xD800, 0xDB79, 0xDBFF, 0xDC00, 0xDE80, 0xDFFF, 0xE000, 0xFFFF };
+  uint8_t buf[512];
+  uint8_t expect[4*512];
+  uint16_t wbuf[256];
+  uint64_t seed = 13;
+  for (int iter = 0; iter < 20000; iter++) {
+    // mostly valid utf-8 with a few random bytes
+    kk_ssize_t len = 0;
+    const kk_ssize_t n = (kk_ssize_t)(iter % 300);
+    while (len < n) {
+      seed = (seed * KU64(6364136223846793005)) + KU64(1442695040888963407);
+      const uint32_t r = (uint32_t)(seed >> 33);
+      if (r % 8 == 0) {
+        buf[len++] = bytes[(r/8) % sizeof(bytes)];
+      }
+      else {
+        const char* seq = seqs[(r/8) % (sizeof(seqs)/sizeof(seqs[0]))];
+        for (; *seq != 0 && len < n; seq++) { buf[len++] = (uint8_t)*seq; }
+      }
+    }
+    buf[len] = 0;
+    for (int identity = 0; identity <= 1; identity++) {
+      kk_ssize_t elen = 0;
+      kk_ssize_t ecount = 0;
+      for (const uint8_t* p = buf; p < buf + len; ecount++) {
+        kk_ssize_t count;
+        kk_char_t ch = kk_utf8_read_validate(p, &count, NULL, identity != 0);
+        p += count;
+        kk_utf8_write(ch, expect + elen, &count);
+        elen += count;
+      }
+      kk_string_t str = (identity ? kk_string_alloc_from_qutf8n(len, (const char*)buf, ctx) : kk_string_alloc_from_utf8n(len, (const char*)buf, ctx));
+      kk_ssize_t slen;
+      const uint8_t* sbuf = kk_string_buf_borrow(str, &slen);
+      assert(slen == elen && memcmp(sbuf, expect, (size_t)elen) == 0);
+      assert(kk_string_count_borrow(str) == ecount);
+      if (identity) {
+        bool should_free;
+        const char* qbuf = kk_string_to_qutf8_borrow(str, &should_free, ctx);
+        assert(strlen(qbuf) == (size_t)len && memcmp(qbuf, buf, (size_t)len) == 0);
+        if (should_free) kk_free(qbuf);
+      }
+      kk_string_drop(str, ctx);
+    }
+    // random utf-16 with lone surrogate halves
+    const kk_ssize_t wlen = (kk_ssize_t)(iter % 200);
+    for (kk_ssize_t i = 0; i < wlen; i++) {
+      seed = (seed * KU64(6364136223846793005)) + KU64(1442695040888963407);
+      const uint32_t r = (uint32_t)(seed >> 33);
+      wbuf[i] = (r % 4 != 0 ? (uint16_t)('a' + r % 26) : units[(r/4) % (sizeof(units)/sizeof(units[0]))]);
+    }
+    kk_string_t str = kk_string_alloc_from_qutf16n(wlen, wbuf, ctx);
+    uint16_t* wstr = kk_string_to_qutf16_borrow(str, ctx);
+    assert(memcmp(wstr, wbuf, (size_t)wlen * sizeof(uint16_t)) == 0 && wstr[wlen] == 0);
+    kk_free(wstr);
+    kk_string_drop(str, ctx);
+  }
+}
+
+// compare `kk_memmem` and `kk_memrmem` with a naive search, for short (filtered) and long (two-way) patterns
+static const uint8_t* naive_memmem(const uint8_t* s, kk_ssize_t n, const uint8_t* pat, kk_ssize_t m, bool reverse) {
+  if (m <= 0 || m > n) return NULL;
+  for (kk_ssize_t i = 0; i <= n - m; i++) {
+    const uint8_t* p = (reverse ? s + (n - m - i) : s + i);
+    if (memcmp(p, pat, (size_t)m) == 0) return p;
+  }
+  return NULL;
+}
+
+static void test_memsearch(kk_context_t* ctx) {
+  uint8_t text[1200];
+  uint8_t pat[150];
+  uint64_t seed = 17;
+  for (int iter = 0; iter < 20000; iter++) {
+    seed = (seed * KU64(6364136223846793005)) + KU64(1442695040888963407);
+    const uint32_t r = (uint32_t)(seed >> 33);
+    const int alpha = 1 + (int)(r % 3);   // small alphabets give many (periodic) matches
+    const kk_ssize_t n = (kk_ssize_t)(r % 1200);
+    const kk_ssize_t m = 1 + (kk_ssize_t)((r / 1200) % (iter % 2 == 0 ? 8 : 150));
+    for (kk_ssize_t i = 0; i < n; i++) {
+      seed = (seed * KU64(6364136223846793005)) + KU64(1442695040888963407);
+      text[i] = (uint8_t)('a' + (seed >> 33) % (uint64_t)alpha);
+    }
+    // take the pattern from the text half of the time
+    for (kk_ssize_t i = 0; i < m; i++) {
+      seed = (seed * KU64(6364136223846793005)) + KU64(1442695040888963407);
+      pat[i] = (iter % 4 < 2 && m < n ? text[n/3 + i] : (uint8_t)('a' + (seed >> 33) % (uint64_t)alpha));
+    }
+    assert(kk_memmem(text, n, pat, m) == naive_memmem(text, n, pat, m, false));
+    assert(kk_memrmem(text, n, pat, m) == naive_memmem(text, n, pat, m, true));
+  }
+  // many false candidates for the byte filter so we continue with two-way at some point
+  uint8_t* big = (uint8_t*)kk_malloc(20000, ctx);
+  for (int iter = 0; iter < 100; iter++) {
+    seed = (seed * KU64(6364136223846793005)) + KU64(1442695040888963407);
+    const uint32_t r = (uint32_t)(seed >> 33);
+    const kk_ssize_t n = 5000 + (kk_ssize_t)(r % 15000);
+    const kk_ssize_t m = 2 + (kk_ssize_t)((r / 15000) % 140);
+    for (kk_ssize_t i = 0; i < n; i++) {
+      seed = (seed * KU64(6364136223846793005)) + KU64(1442695040888963407);
+      big[i] = ((seed >> 33) % 64 == 0 ? 'b' : 'a');
+    }
+    memset(pat, 'a', (size_t)m);
+    pat[(r / 7) % (uint32_t)(m - 1)] = 'b';
+    if (iter % 3 == 0) { memcpy(pat, big + (iter % 2 == 0 ? 100 : n - m - 100), (size_t)m); }
+    assert(kk_memmem(big, n, pat, m) == naive_memmem(big, n, pat, m, false));
+    assert(kk_memrmem(big, n, pat, m) == naive_memmem(big, n, pat, m, true));
+  }
+  kk_free(big);
+  // `a^59 b a` in `a^n`, and a match at the very start and end
+  const kk_ssize_t n = 100000;
+  big = (uint8_t*)kk_malloc(n, ctx);
+  memset(big, 'a', (size_t)n);
+  memset(pat, 'a', 61);
+  pat[59] = 'b';
+  assert(kk_memmem(big, n, pat, 61) == NULL && kk_memrmem(big, n, pat, 61) == NULL);
+  big[59] = 'b';
+  big[n - 2] = 'b';
+  assert(kk_memmem(big, n, pat, 61) == big);
+  assert(kk_memrmem(big, n, pat, 61) == big + n - 61);
+  kk_free(big);
+}
+
+// appending to a unique string is in place, so this is linear
+static void test_string_builder(kk_context_t* ctx) {
+  const kk_ssize_t n = 200000;
+  kk_timer_t start = kk_timer_start();
+  kk_string_t s = kk_string_empty();
+  for (kk_ssize_t i = 0; i < n; i++) {
+    s = kk_string_cat(s, kk_string_alloc_from_utf8("ab", ctx), ctx);
+  }
+  kk_usecs_t elapsed = kk_timer_end(start);
+  printf("string: %zd appends: %ldus\n", n, (long)elapsed);
+  kk_ssize_t len;
+  const uint8_t* p = kk_string_buf_borrow(s, &len);
+  assert(len == 2*n && p[len] == 0 && p[0] == 'a' && p[len-1] == 'b' && kk_string_count_borrow(s) == 2*n);
+  // a shared left side is not updated
+  kk_string_t t = kk_string_cat(kk_string_dup(s), kk_string_alloc_from_utf8("c", ctx), ctx);
+  assert(kk_string_buf_borrow(s, NULL)[2*n] == 0 && kk_string_buf_borrow(t, NULL)[2*n] == 'c');
+  kk_string_drop(t, ctx);
+  // appending a string to itself
+  s = kk_string_cat(s, kk_string_dup(s), ctx);
+  assert(kk_string_count_borrow(s) == 4*n);
+  kk_string_drop(s, ctx);
+  // builder
+  kk_string_builder_t sb = kk_string_builder_empty();
+  for (kk_char_t ch = 'a'; ch <= 'z'; ch++) {
+    kk_string_builder_append_char(&sb, ch, ctx);
+    kk_string_builder_append_char(&sb, 0x1F600, ctx);
+  }
+  kk_string_builder_append_valid_utf8(&sb, "!", ctx);
+  s = kk_string_builder_finish(&sb);
+  assert(kk_string_count_borrow(s) == 53 && kk_string_buf_borrow(s, NULL)[0] == 'a' && kk_string_buf_borrow(s, NULL)[5] == 'b');
+  kk_string_drop(s, ctx);
+  // as used by `string-builder` in std/core
+  s = kk_string_empty();
+  for (kk_ssize_t i = 0; i < n; i++) {
+    s = kk_string_builder_cat(s, kk_string_alloc_from_utf8("x", ctx), ctx);
+    s = kk_string_builder_cat_char(s, 0xE9, ctx);
+  }
+  assert(kk_string_count_borrow(s) == 2*n && kk_string_len_borrow(s) == 3*n);
+  kk_string_drop(s, ctx);
+  // join
+  kk_box_t* parts;
+  kk_vector_t v = kk_vector_alloc_uninit(3, &parts, ctx);
+  parts[0] = kk_string_box(kk_string_alloc_from_utf8("x", ctx));
+  parts[1] = kk_string_box(kk_string_empty());
+  parts[2] = kk_string_box(kk_string_alloc_from_utf8("yz", ctx));
+  s = kk_string_join_with(kk_vector_dup(v), kk_string_alloc_from_utf8(", ", ctx), ctx);
+  assert(strcmp(kk_string_cbuf_borrow(s, NULL), "x, , yz") == 0);
+  kk_string_drop(s, ctx);
+  s = kk_string_join(v, ctx);
+  assert(strcmp(kk_string_cbuf_borrow(s, NULL), "xyz") == 0);
+  kk_string_drop(s, ctx);
+}
+
+// Single ascii character strings are static and not allocated
+static void test_string_ascii1(kk_context_t* ctx) {
+  #if KK_STATS
+  const kk_stats_t st0 = ctx->stats;
+  #endif
+  kk_string_t sa = kk_string_from_char('a', ctx);
+  kk_string_t sb = kk_string_alloc_dupn_valid_utf8(1, (const uint8_t*)"a", ctx);
+  kk_ssize_t len;
+  const uint8_t* p = kk_string_buf_borrow(sa, &len);
+  assert(kk_datatype_eq(sa.bytes, sb.bytes) && len == 1 && p[0] == 'a' && p[1] == 0 && kk_string_count_borrow(sa) == 1);
+  assert(!kk_datatype_is_unique(sa.bytes));
+  // a copy to update in place is a fresh allocation
+  kk_string_t u = kk_string_to_upper(kk_string_dup(sa), ctx);
+  assert(!kk_datatype_eq(sa.bytes, u.bytes) && kk_string_buf_borrow(u, NULL)[0] == 'A' && p[0] == 'a');
+  kk_string_t sc = kk_string_cat(kk_string_dup(sa), kk_string_dup(sb), ctx);
+  assert(strcmp(kk_string_cbuf_borrow(sc, NULL), "aa") == 0 && p[1] == 0);
+  kk_string_drop(sc, ctx);
+  kk_string_drop(u, ctx);
+  kk_string_drop(sb, ctx);
+  kk_string_drop(sa, ctx);
+  kk_string_t e = kk_string_from_char(0x20AC, ctx);
+  assert(kk_string_len_borrow(e) == 3);
+  kk_string_drop(e, ctx);
+  #if KK_STATS
+  const kk_ssize_t small = kk_stats_tag_index(KK_TAG_BYTES_SMALL);
+  printf("stats: small string allocs: %lld, static: %lld\n", (long long)(ctx->stats.allocs[small] - st0.allocs[small]),
+         (long long)(ctx->stats.bytes_static - st0.bytes_static));
+  assert(ctx->stats.bytes_static - st0.bytes_static == 2);
+  assert(ctx->stats.allocs[small] - st0.allocs[small] == 3);  // the upper case copy, "aa", and the euro sign
+  #endif
+}
+
+// The ascii case conversion, trim, and case insensitive comparison kernels at every length and offset
+static void test_string_ascii_kernels(kk_context_t* ctx) {
+  // includes the bytes around the letter ranges, and an `e` acute
+  const char* parts[16] = { "a", "Z", "@", "[", "`", "{", " ", "\t", "\n", "\r", "q", "\xC3\xA9", "M", "x", "0", "9" };
+  char buf[128];
+  char ref[128];
+  for (int len = 0; len < 80; len++) {
+    int n = 0;
+    for (int i = 0; n < len; i++) {
+      const char* part = parts[(i*7 + len) % 16];
+      if (n + (int)strlen(part) > len) part = "k";
+      for (; *part != 0; part++) { buf[n++] = *part; }
+    }
+    buf[len] = 0;
+    for (int upper = 0; upper <= 1; upper++) {
+      for (int i = 0; i <= len; i++) {
+        const uint8_t ch = (uint8_t)buf[i];
+        ref[i] = (char)(upper ? (ch >= 'a' && ch <= 'z' ? ch - 32 : ch) : (ch >= 'A' && ch <= 'Z' ? ch + 32 : ch));
+      }
+      kk_string_t shared = kk_string_alloc_from_utf8(buf, ctx);
+      kk_string_t t = (upper ? kk_string_to_upper(kk_string_dup(shared), ctx) : kk_string_to_lower(kk_string_dup(shared), ctx));
+      assert(strcmp(kk_string_cbuf_borrow(t, NULL), ref) == 0 && strcmp(kk_string_cbuf_borrow(shared, NULL), buf) == 0);
+      assert(kk_datatype_eq(t.bytes, shared.bytes) == (strcmp(ref, buf) == 0));  // only copy if there is a change
+      assert(kk_string_icmp_borrow(t, shared) == 0);
+      kk_string_drop(t, ctx);
+      kk_string_t u = (upper ? kk_string_to_upper(shared, ctx) : kk_string_to_lower(shared, ctx));  // in place
+      assert(strcmp(kk_string_cbuf_borrow(u, NULL), ref) == 0);
+      kk_string_drop(u, ctx);
+    }
+    // trim
+    int lo = 0;
+    while (lo < len && (buf[lo] == ' ' || buf[lo] == '\t' || buf[lo] == '\n' || buf[lo] == '\r')) lo++;
+    int hi = len;
+    while (hi > lo && (buf[hi-1] == ' ' || buf[hi-1] == '\t' || buf[hi-1] == '\n' || buf[hi-1] == '\r')) hi--;
+    kk_string_t l = kk_string_trim_left(kk_string_alloc_from_utf8(buf, ctx), ctx);
+    kk_string_t r = kk_string_trim_right(kk_string_alloc_from_utf8(buf, ctx), ctx);
+    kk_ssize_t llen, rlen;
+    const uint8_t* lp = kk_string_buf_borrow(l, &llen);
+    kk_string_buf_borrow(r, &rlen);
+    assert(llen == len - lo && memcmp(lp, buf + lo, (size_t)llen) == 0 && rlen == hi);
+    kk_string_drop(l, ctx);
+    kk_string_drop(r, ctx);
+  }
+  // white space runs longer than a vector
+  kk_string_t w = kk_string_trim_right(kk_string_trim_left(kk_string_alloc_from_utf8(" \t\n\r                      x y                  \r\n", ctx), ctx), ctx);
+  assert(strcmp(kk_string_cbuf_borrow(w, NULL), "x y") == 0);
+  kk_string_drop(w, ctx);
+  // case insensitive comparison with a difference at each position
+  for (int len = 1; len < 70; len++) {
+    for (int i = 0; i < len; i++) { buf[i] = (char)('a' + (i % 26)); ref[i] = (char)('A' + (i % 26)); }
+    buf[len] = ref[len] = 0;
+    kk_string_t sl = kk_string_alloc_from_utf8(buf, ctx);
+    kk_string_t su = kk_string_alloc_from_utf8(ref, ctx);
+    assert(kk_string_icmp_borrow(sl, su) == 0);
+    kk_string_drop(su, ctx);
+    for (int i = 0; i < len; i++) {
+      const char ch = ref[i];
+      ref[i] = '[';   // just after 'Z', but before 'a' to 'z' if lowered
+      su = kk_string_alloc_from_utf8(ref, ctx);
+      assert(kk_string_icmp_borrow(sl, su) == 1 && kk_string_icmp_borrow(su, sl) == -1);
+      kk_string_drop(su, ctx);
+      ref[i] = ch;
+    }
+    kk_string_drop(sl, ctx);
+  }
+}
+
+// Reference replacement of the leftmost (and then longest) pattern occurrences
+static size_t replace_many_ref(const char* s, int count, const char** pats, const char** reps, char* out) {
+  size_t n = 0;
+  while (*s != 0) {
+    int best = -1;
+    for (int i = 0; i < count; i++) {
+      const size_t len = strlen(pats[i]);
+      if (len > 0 && strncmp(s, pats[i], len) == 0 && (best < 0 || len > strlen(pats[best]))) best = i;
+    }
+    if (best < 0) { out[n++] = *s++; continue; }
+    strcpy(out + n, reps[best]);
+    n += strlen(reps[best]);
+    s += strlen(pats[best]);
+  }
+  out[n] = 0;
+  return n;
+}
+
+static kk_vector_t string_vector(int count, const char** strs, kk_context_t* ctx) {
+  kk_box_t* v;
+  kk_vector_t vec = kk_vector_alloc_uninit(count, &v, ctx);
+  for (int i = 0; i < count; i++) { v[i] = kk_string_box(kk_string_alloc_from_utf8(strs[i], ctx)); }
+  return vec;
+}
+
+// Repeat, and replace single and many patterns in shared and unique strings
+static void test_string_replace(kk_context_t* ctx) {
+  for (int n = 0; n < 40; n++) {
+    kk_string_t r = kk_string_repeat(kk_string_alloc_from_utf8("abc", ctx), n, ctx);
+    kk_ssize_t len;
+    const uint8_t* p = kk_string_buf_borrow(r, &len);
+    assert(len == 3*n && p[len] == 0);
+    for (int i = 0; i < len; i++) { assert(p[i] == "abc"[i%3]); }
+    kk_string_drop(r, ctx);
+  }
+  kk_string_t r = kk_string_repeat(kk_string_alloc_from_utf8("x", ctx), 1000, ctx);
+  assert(kk_string_len_borrow(r) == 1000 && kk_string_buf_borrow(r, NULL)[999] == 'x');
+  kk_string_drop(r, ctx);
+
+  const char* pats[] = { "ab", "aba", "b", "cab", "bcab", "aaaa" };
+  const char* reps[] = { "X", "YY", "", "ZZZZ", "b", "aaaa" };
+  char text[256];
+  char ref[2048];
+  uint64_t seed = 9;
+  for (int k = 0; k < 300; k++) {
+    const int len = k % 97;
+    for (int i = 0; i < len; i++) {
+      seed = seed*6364136223846793005ULL + 1442695040888963407ULL;
+      text[i] = "abc"[(seed >> 33) % 3];
+    }
+    text[len] = 0;
+    // single patterns: in place (unique) and copied (shared)
+    for (int i = 0; i < 6; i++) {
+      replace_many_ref(text, 1, &pats[i], &reps[i], ref);
+      kk_string_t shared = kk_string_alloc_from_utf8(text, ctx);
+      kk_string_t t = kk_string_replace_all(kk_string_dup(shared), kk_string_alloc_from_utf8(pats[i], ctx), kk_string_alloc_from_utf8(reps[i], ctx), ctx);
+      assert(strcmp(kk_string_cbuf_borrow(t, NULL), ref) == 0 && strcmp(kk_string_cbuf_borrow(shared, NULL), text) == 0);
+      kk_string_drop(t, ctx);
+      t = kk_string_replace_all(shared, kk_string_alloc_from_utf8(pats[i], ctx), kk_string_alloc_from_utf8(reps[i], ctx), ctx);
+      assert(strcmp(kk_string_cbuf_borrow(t, NULL), ref) == 0 && kk_string_len_borrow(t) == (kk_ssize_t)strlen(ref));
+      kk_string_drop(t, ctx);
+    }
+    // many patterns in one pass
+    const int count = 1 + k % 6;
+    replace_many_ref(text, count, pats, reps, ref);
+    kk_string_t t = kk_string_replace_many(kk_string_alloc_from_utf8(text, ctx), string_vector(count, pats, ctx), string_vector(count, reps, ctx), ctx);
+    assert(strcmp(kk_string_cbuf_borrow(t, NULL), ref) == 0);
+    kk_string_drop(t, ctx);
+  }
+  // a template
+  const char* keys[] = { "{name}", "{n}", "{names}" };
+  const char* vals[] = { "koka", "42", "effects" };
+  kk_string_t t = kk_string_replace_many(kk_string_alloc_from_utf8("{name} has {n} {names}: {names}{name}{", ctx), string_vector(3, keys, ctx), string_vector(3, vals, ctx), ctx);
+  assert(strcmp(kk_string_cbuf_borrow(t, NULL), "koka has 42 effects: effectskoka{") == 0);
+  kk_string_drop(t, ctx);
+}
+
+// Interned strings are canonical and frozen, and hashes are cached
+static void test_string_intern(kk_context_t* ctx) {
+  kk_string_t s1 = kk_string_alloc_from_utf8("identifier_one", ctx);
+  kk_string_t s2 = kk_string_cat(kk_string_alloc_from_utf8("identifier_", ctx), kk_string_alloc_from_utf8("one", ctx), ctx);
+  const uint32_t h = kk_string_hash_borrow(s1);
+  assert(h != 0 && h == kk_string_hash_borrow(s2) && kk_bytes_cached_hash_borrow(s1.bytes) == h);
+  assert(kk_string_is_eq_borrow(s1, s2) && !kk_datatype_eq(s1.bytes, s2.bytes));
+  kk_string_t i1 = kk_string_intern(kk_string_dup(s1), ctx);
+  kk_string_t i2 = kk_string_intern(s2, ctx);
+  assert(kk_datatype_eq(i1.bytes, i2.bytes) && kk_block_is_frozen(kk_datatype_as_ptr(i1.bytes)));
+  // an update in place clears the cached hash
+  s1 = kk_string_to_upper(s1, ctx);
+  assert(kk_bytes_cached_hash_borrow(s1.bytes) == 0 && kk_string_hash_borrow(s1) != h);
+  assert(!kk_string_is_eq_borrow(s1, i1));
+  kk_string_drop(s1, ctx);
+  // many distinct strings, and short strings
+  char buf[32];
+  for (int i = 0; i < 2000; i++) {
+    snprintf(buf, sizeof(buf), "%s%d", (i % 2 == 0 ? "id" : "long_identifier_"), i/2);
+    kk_string_t t = kk_string_intern(kk_string_alloc_from_utf8(buf, ctx), ctx);
+    kk_string_t u = kk_string_intern(kk_string_alloc_from_utf8(buf, ctx), ctx);
+    assert(kk_datatype_eq(t.bytes, u.bytes) && strcmp(kk_string_cbuf_borrow(t, NULL), buf) == 0);
+  }
+  kk_string_t sa = kk_string_intern(kk_string_alloc_from_utf8("a", ctx), ctx);
+  kk_string_t sc = kk_string_from_char('a', ctx);
+  kk_string_t i3 = kk_string_intern(kk_string_alloc_from_utf8("identifier_one", ctx), ctx);
+  assert(kk_datatype_eq(sa.bytes, sc.bytes) && kk_datatype_eq(i1.bytes, i3.bytes));
+}
+
+// Large parts of a split are views on the parent string
+static void test_string_view(kk_context_t* ctx) {
+  const kk_ssize_t partlen = 2*KK_BYTES_VIEW_MIN;
+  uint8_t* p;
+  kk_string_t s = kk_unsafe_string_alloc_buf(3*(partlen + 1), &p, ctx);
+  for (kk_ssize_t i = 0; i < 3; i++) {
+    kk_memset(p + i*(partlen + 1), 'a' + (int)i, partlen);
+    p[i*(partlen + 1) + partlen] = (i < 2 ? '\n' : ' ');
+  }
+  kk_vector_t v = kk_string_splitv(kk_string_dup(s), kk_string_alloc_from_utf8("\n", ctx), ctx);
+  kk_ssize_t n;
+  kk_box_t* parts = kk_vector_buf_borrow(v, &n);
+  assert(n == 3);
+  for (kk_ssize_t i = 0; i < n; i++) {
+    kk_string_t t = kk_string_unbox(parts[i]);
+    kk_ssize_t len;
+    const uint8_t* q = kk_string_buf_borrow(t, &len);
+    assert(kk_bytes_is_view_borrow(t.bytes) && q == p + i*(partlen + 1) && len == partlen + (i == 2 ? 1 : 0));
+    assert(q[0] == 'a' + i && q[len-1] == (i == 2 ? ' ' : 'a' + i));
+  }
+  // a view keeps the string alive
+  kk_string_drop(s, ctx);
+  kk_string_t t = kk_string_unbox(kk_box_dup(parts[1]));
+  kk_vector_drop(v, ctx);
+  // a view of a view points into the original string, and short parts are copied
+  kk_string_t u = kk_string_alloc_view(t, 1, partlen - 1, ctx);
+  kk_string_t w = kk_string_alloc_view(t, 1, 10, ctx);
+  assert(kk_bytes_is_view_borrow(u.bytes) && !kk_bytes_is_view_borrow(w.bytes) && kk_string_len_borrow(w) == 10);
+  assert(kk_datatype_eq(kk_datatype_as_assert(kk_bytes_view_t, u.bytes, KK_TAG_BYTES_RAW)->parent,
+                        kk_datatype_as_assert(kk_bytes_view_t, t.bytes, KK_TAG_BYTES_RAW)->parent));
+  kk_string_drop(w, ctx);
+  // C strings are copied
+  bool should_free;
+  const char* cs = kk_string_to_qutf8_borrow(u, &should_free, ctx);
+  assert(should_free && (kk_ssize_t)strlen(cs) == partlen - 1);
+  kk_free(cs);
+  // comparing with a C string stops at the end of the view
+  char* bs = (char*)kk_malloc(partlen, ctx);
+  kk_memset(bs, 'b', partlen - 1); bs[partlen - 1] = 0;
+  assert(kk_string_cmp_cstr_borrow(u, bs) == 0);
+  bs[partlen - 2] = 0;
+  assert(kk_string_cmp_cstr_borrow(u, bs) > 0);
+  kk_free(bs);
+  u = kk_string_ensure_terminated(u, ctx);
+  assert(!kk_bytes_is_view_borrow(u.bytes) && kk_string_buf_borrow(u, NULL)[partlen - 1] == 0);
+  const bool eq = kk_string_is_eq(kk_string_dup(u), kk_string_alloc_view(t, 1, partlen - 1, ctx), ctx);
+  assert(eq); KK_UNUSED_RELEASE(eq);
+  kk_string_drop(u, ctx);
+  kk_string_drop(t, ctx);
+  // a part of a string in an arena is a copy and stays valid after leaving the arena
+  kk_arena_enter(ctx);
+  s = kk_unsafe_string_alloc_buf(2*partlen + 1, &p, ctx);
+  kk_memset(p, 'x', partlen);
+  p[partlen] = '\n';
+  kk_memset(p + partlen + 1, 'y', partlen);
+  v = kk_string_splitv(s, kk_string_alloc_from_utf8("\n", ctx), ctx);
+  parts = kk_vector_buf_borrow(v, &n);
+  assert(n == 2);
+  kk_box_t part = kk_box_dup(parts[1]);
+  kk_vector_drop(v, ctx);
+  t = kk_string_unbox(kk_arena_leave(part, ctx));
+  kk_ssize_t len;
+  const uint8_t* q = kk_string_buf_borrow(t, &len);
+  assert(!kk_bytes_is_view_borrow(t.bytes) && len == partlen && q[0] == 'y' && q[len-1] == 'y');
+  KK_UNUSED_RELEASE(q);
+  kk_string_drop(t, ctx);
+}
+
+static void test_double_show(kk_context_t* ctx) {
+  uint64_t x = 0x9E3779B97F4A7C15UL;
+  for (int i = 0; i < 20000; i++) {
+    x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+    double d;
+    if (i % 2 == 0) { memcpy(&d, &x, sizeof(d)); }
+               else { d = (double)(int64_t)(x % 2000000) / (double)(1 + (x >> 40) % 1000); }
+    if (!isfinite(d)) continue;
+    // the shortest representation round-trips
+    kk_string_t s = kk_double_show(d, -17, ctx);
+    kk_ssize_t len;
+    const char* cs = kk_string_cbuf_borrow(s, &len);
+    assert(strtod(cs, NULL) == d && kk_double_parse(cs, len) == d);
+    kk_string_drop(s, ctx);
+    // and explicit precisions are the same as `printf`
+    for (int prec = 0; prec <= 20; prec += 4) {
+      char buf[512];
+      snprintf(buf, sizeof(buf), "%.*f", prec, d);
+      s = kk_double_show_fixed(d, prec, ctx);
+      assert(strcmp(buf, kk_string_cbuf_borrow(s, NULL)) == 0);
+      kk_string_drop(s, ctx);
+      snprintf(buf, sizeof(buf), "%.*e", prec, d);
+      char* e = strchr(buf, 'e');
+      if (atoi(e + 1) == 0) *e = 0;
+      s = kk_double_show_exp(d, prec, ctx);
+      assert(strcmp(buf, kk_string_cbuf_borrow(s, NULL)) == 0);
+      kk_string_drop(s, ctx);
+      if (prec > 0 && prec <= 16) {
+        snprintf(buf, sizeof(buf), "%.*g", prec, d);
+        e = strchr(buf, 'e');
+        if (e != NULL && atoi(e + 1) == 0) *e = 0;
+        s = kk_double_show(d, -prec, ctx);
+        assert(strcmp(buf, kk_string_cbuf_borrow(s, NULL)) == 0);
+        kk_string_drop(s, ctx);
+      }
+    }
+  }
+  kk_string_t s = kk_double_show(0.1, -17, ctx);
+  assert(strcmp(kk_string_cbuf_borrow(s, NULL), "0.1") == 0);
+  kk_string_drop(s, ctx);
+  s = kk_double_show(5e-324, -17, ctx);
+  assert(strcmp(kk_string_cbuf_borrow(s, NULL), "5e-324") == 0);
+  kk_string_drop(s, ctx);
+}
+
+// Read a large file; valid utf-8 is mapped read-only and only copied when updated
+static void test_read_text_file(kk_context_t* ctx) {
+  const char* fname = "kklib-test-read.txt";
+  const kk_ssize_t len = 2*KK_OS_MMAP_MIN + 13;
+  for (int invalid = 0; invalid <= 1; invalid++) {
+    FILE* f = fopen(fname, "wb");
+    assert(f != NULL);
+    for (kk_ssize_t i = 0; i < len; i++) { fputc((invalid && i == len/2 ? 0xFF : 'a' + (int)(i % 26)), f); }
+    fclose(f);
+    kk_string_t content;
+    int err = kk_os_read_text_file(kk_string_alloc_from_utf8(fname, ctx), &content, ctx);
+    assert(err == 0);
+    kk_ssize_t n;
+    const uint8_t* p = kk_string_buf_borrow(content, &n);
+    assert(kk_datatype_has_tag(content.bytes, KK_TAG_BYTES_RAW) == !invalid);
+    assert(n == len + (invalid ? 3 : 0) && p[0] == 'a' && p[n-1] == 'a' + ((len - 1) % 26) && p[n] == 0);
+    content = kk_string_to_upper(content, ctx);
+    p = kk_string_buf_borrow(content, &n);
+    assert(!kk_datatype_has_tag(content.bytes, KK_TAG_BYTES_RAW) && p[0] == 'A' && p[n-1] == 'A' + ((len - 1) % 26));
+    KK_UNUSED_RELEASE(p);
+    kk_string_drop(content, ctx);
+  }
+  remove(fname);
+}
+
+// Copy a file over a longer existing one (which must be truncated)
+static void test_copy_file(kk_context_t* ctx) {
+  const char* src = "kklib-test-copy.txt";
+  const char* dst = "kklib-test-copy2.txt";
+  const kk_ssize_t len = 3*1024*1024 + 7;
+  FILE* f = fopen(dst, "wb");
+  assert(f != NULL);
+  for (kk_ssize_t i = 0; i < len + 100; i++) { fputc('x', f); }
+  fclose(f);
+  f = fopen(src, "wb");
+  assert(f != NULL);
+  for (kk_ssize_t i = 0; i < len; i++) { fputc('a' + (int)((i*7) % 26), f); }
+  fclose(f);
+  int err = kk_os_copy_file(kk_string_alloc_from_utf8(src, ctx), kk_string_alloc_from_utf8(dst, ctx), true, ctx);
+  assert(err == 0);
+  f = fopen(dst, "rb");
+  assert(f != NULL);
+  kk_ssize_t n = 0;
+  int ch;
+  while ((ch = fgetc(f)) != EOF) {
+    assert(ch == 'a' + (int)((n*7) % 26));
+    n++;
+  }
+  fclose(f);
+  assert(n == len);
+  remove(src);
+  remove(dst);
+}
+
+// Buffered printing (with an embedded zero) to a redirected stdout
+static void test_print(kk_context_t* ctx) {
+#if !defined(WIN32)
+  const char* fname = "kklib-test-print.txt";
+  kk_stdout_flush(ctx);
+  fflush(stdout);
+  const int saved = dup(1);
+  const int fd = open(fname, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+  assert(saved >= 0 && fd >= 0);
+  dup2(fd, 1); close(fd);
+  for (int i = 0; i < 10000; i++) {
+    kk_print(kk_string_alloc_from_utf8("x", ctx), ctx);
+    kk_println(kk_string_alloc_dupn_valid_utf8(3, (const uint8_t*)"a\0b", ctx), ctx);
+  }
+  const off_t unflushed = lseek(1, 0, SEEK_CUR);  // all still buffered
+  kk_stdout_flush(ctx);
+  printf("end");  // stdio after a flush stays in order
+  fflush(stdout);
+  dup2(saved, 1); close(saved);
+  FILE* f = fopen(fname, "rb");
+  assert(f != NULL);
+  kk_ssize_t n = 0;
+  int ch;
+  while ((ch = fgetc(f)) != EOF) {
+    if (n < 50000) { assert(ch == "xa\0b\n"[n % 5]); }
+    else { assert(ch == "end"[n - 50000]); }
+    n++;
+  }
+  fclose(f);
+  assert(n == 50003 && unflushed == 0);
+  remove(fname);
+  KK_UNUSED_RELEASE(unflushed);
+#else
+  KK_UNUSED(ctx);
+#endif
+}
+
+// Stream a child process with small chunks (that must end at code point boundaries)
+static void test_process(kk_context_t* ctx) {
+#if !defined(WIN32)
+  kk_os_process_t* p;
+  int err = kk_os_process_spawn(kk_string_alloc_from_utf8("cat; echo done >&2; exit 3", ctx), KK_OS_PROCESS_STDIN|KK_OS_PROCESS_STDOUT|KK_OS_PROCESS_STDERR, &p, ctx);
+  assert(err == 0);
+  kk_string_builder_t input = kk_string_builder_empty();
+  for (int i = 0; i < 2000; i++) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%d: \xC3\xA9t\xE2\x82\xAC\xF0\x9F\x98\x80\n", i);
+    kk_string_builder_append_buf(&input, kk_sstrlen(buf), (const uint8_t*)buf, ctx);
+  }
+  kk_ssize_t inlen;
+  const uint8_t* inbuf = kk_bytes_buf_borrow(input.buf, &inlen);
+  err = kk_os_process_write(p, kk_string_alloc_dupn_valid_utf8(inlen, inbuf, ctx), ctx);
+  assert(err == 0);
+  err = kk_os_process_close_input(p);
+  assert(err == 0);
+  kk_string_builder_t out = kk_string_builder_empty();
+  kk_string_builder_t errout = kk_string_builder_empty();
+  while (true) {
+    int from;
+    kk_string_t chunk;
+    err = kk_os_process_read(p, 5, &from, &chunk, ctx);
+    assert(err == 0);
+    if (from == 0) break;
+    kk_ssize_t n;
+    const uint8_t* cbuf = kk_string_buf_borrow(chunk, &n);
+    assert(n > 0 && n <= 5 && (cbuf[0] & 0xC0) != 0x80);
+    kk_string_builder_append_buf((from == 1 ? &out : &errout), n, cbuf, ctx);
+    kk_string_drop(chunk, ctx);
+  }
+  int exitcode;
+  err = kk_os_process_wait(p, &exitcode);
+  assert(err == 0 && exitcode == 3);
+  kk_os_process_free(p, NULL);
+  kk_ssize_t outlen, errlen;
+  const uint8_t* outbuf = kk_bytes_buf_borrow(out.buf, &outlen);
+  const uint8_t* errbuf = kk_bytes_buf_borrow(errout.buf, &errlen);
+  assert(outlen == inlen && memcmp(outbuf, inbuf, (size_t)inlen) == 0);
+  assert(errlen == 5 && memcmp(errbuf, "done\n", 5) == 0);
+  kk_bytes_drop(input.buf, ctx);
+  kk_bytes_drop(out.buf, ctx);
+  kk_bytes_drop(errout.buf, ctx);
+  // collected output
+  kk_string_t output;
+  err = kk_os_run_command(kk_string_alloc_from_utf8("printf 'h\xC3\xA9llo'", ctx), &output, ctx);
+  assert(err == 0 && strcmp(kk_string_cbuf_borrow(output, NULL), "h\xC3\xA9llo") == 0);
+  kk_string_drop(output, ctx);
+  KK_UNUSED_RELEASE(err); KK_UNUSED_RELEASE(outbuf); KK_UNUSED_RELEASE(errbuf);
+#else
+  KK_UNUSED(ctx);
+#endif
+}
+
+// Walk a directory tree sequentially and in parallel
+static void test_walk(kk_context_t* ctx) {
+#if !defined(WIN32)
+  const char* root = "kklib-test-walk";
+  char path[256];
+  mkdir(root, 0755);
+  for (int i = 0; i < 10; i++) {
+    snprintf(path, sizeof(path), "%s/d%d", root, i);
+    mkdir(path, 0755);
+    for (int j = 0; j < 10; j++) {
+      snprintf(path, sizeof(path), "%s/d%d/e%d", root, i, j);
+      mkdir(path, 0755);
+      for (int k = 0; k < 5; k++) {
+        snprintf(path, sizeof(path), "%s/d%d/e%d/f%d.txt", root, i, j, k);
+        FILE* f = fopen(path, "wb");
+        assert(f != NULL);
+        fclose(f);
+      }
+    }
+  }
+  for (int threads = 0; threads <= 4; threads += 4) {
+    for (kk_ssize_t depth = 0; depth <= 2; depth += 2) {
+      kk_os_walk_t* w;
+      int err = kk_os_walk_open(kk_string_alloc_from_utf8("kklib-test-walk/", ctx), threads, depth, &w, ctx);
+      assert(err == 0);
+      kk_ssize_t files = 0, dirs = 0;
+      while (true) {
+        kk_string_t p;
+        int kind;
+        err = kk_os_walk_next(w, &p, &kind, ctx);
+        assert(err == 0);
+        if (kind == KK_OS_WALK_DONE) break;
+        const char* cp = kk_string_cbuf_borrow(p, NULL);
+        assert(strncmp(cp, "kklib-test-walk/d", 17) == 0);
+        if (kind == KK_OS_WALK_FILE) { files++; assert(strstr(cp, ".txt") != NULL); }
+        else if (kind == KK_OS_WALK_DIR) dirs++;
+        kk_string_drop(p, ctx);
+      }
+      kk_os_walk_free(w, NULL);
+      assert(depth == 0 ? (dirs == 10 && files == 0) : (dirs == 110 && files == 500));
+      KK_UNUSED_RELEASE(err);
+    }
+  }
+  // stop early
+  kk_os_walk_t* w;
+  int err = kk_os_walk_open(kk_string_alloc_from_utf8(root, ctx), 4, 100, &w, ctx);
+  kk_string_t p;
+  int kind;
+  assert(err == 0);
+  err = kk_os_walk_next(w, &p, &kind, ctx);
+  assert(err == 0 && kind != KK_OS_WALK_DONE);
+  kk_string_drop(p, ctx);
+  kk_os_walk_free(w, NULL);
+  err = kk_os_walk_open(kk_string_alloc_from_utf8("kklib-test-walk-none", ctx), 0, 100, &w, ctx);
+  assert(err != 0);
+  KK_UNUSED_RELEASE(err);
+  kk_os_run_system(kk_string_alloc_from_utf8("rm -rf kklib-test-walk", ctx), ctx);
+#else
+  KK_UNUSED(ctx);
+#endif
+}
+
+// Continuation compositions: extending, moving to a larger class, moving out, and pooling
+struct __fun_digit_s {
+  struct kk_function_s _base;
+  kk_box_t digit;   // 9 yields
+};
+
+static kk_box_t __fun_digit(kk_function_t fself, kk_box_t x, kk_context_t* ctx) {
+  const kk_intx_t d = kk_int_unbox(kk_function_as(struct __fun_digit_s*, fself)->digit);
+  kk_function_drop(fself, ctx);
+  if (d == 9) { ctx->yielding = KK_YIELD_NORMAL; }
+  return kk_int_box(10*kk_int_unbox(x) + d);
+}
+
+static kk_function_t new_fun_digit(kk_intx_t d, kk_context_t* ctx) {
+  struct __fun_digit_s* f = kk_function_alloc_as(struct __fun_digit_s, 2, ctx);
+  f->_base.fun = kk_cfun_ptr_box(&__fun_digit, ctx);
+  f->digit = kk_int_box(d);
+  return &f->_base;
+}
+
+static kk_intx_t kcompose_call(kk_function_t f, kk_intx_t x, kk_context_t* ctx) {
+  return kk_int_unbox(kk_function_call(kk_box_t, (kk_function_t, kk_box_t, kk_context_t*), f, (f, kk_int_box(x), ctx)));
+}
+
+static void test_kcompose(kk_context_t* ctx) {
+  kk_function_t conts[KK_YIELD_CONT_MAX];
+  conts[0] = new_fun_digit(1, ctx);
+  conts[1] = new_fun_digit(2, ctx);
+  kk_function_t comp = kk_function_compose(conts, 2, ctx);   // the smallest class
+  kk_block_t* small = &comp->_block;
+  // extending a unique composition beyond its capacity moves it to a larger block and pools the small one
+  const int32_t pooled0 = ctx->cont_pool_count[0];
+  conts[0] = comp;
+  for (int i = 1; i <= 3; i++) { conts[i] = new_fun_digit(2 + i, ctx); }
+  comp = kk_function_compose(conts, 4, ctx);
+  assert(&comp->_block != small && ctx->cont_pool_count[0] == pooled0 + 1);
+  // a shared composition dups its continuations
+  assert(kcompose_call(kk_function_dup(comp), 0, ctx) == 12345);
+  // a unique one moves them out and returns its block to the pool
+  const int32_t pooled2 = ctx->cont_pool_count[2];
+  assert(kcompose_call(comp, 0, ctx) == 12345);
+  assert(ctx->cont_pool_count[2] == pooled2 + 1);
+  // a composition of the same class reuses the pooled block
+  conts[0] = new_fun_digit(1, ctx);
+  conts[1] = new_fun_digit(2, ctx);
+  comp = kk_function_compose(conts, 2, ctx);
+  assert(&comp->_block == small && ctx->cont_pool_count[0] == pooled0);
+  kk_function_drop(comp, ctx);
+  // yielding halfway keeps the remaining continuations in the same block
+  conts[0] = new_fun_digit(1, ctx);
+  conts[1] = new_fun_digit(9, ctx);
+  conts[2] = new_fun_digit(3, ctx);
+  conts[3] = new_fun_digit(4, ctx);
+  comp = kk_function_compose(conts, 4, ctx);
+  ctx->yield.conts_count = 0;
+  kk_box_drop(kk_function_call(kk_box_t, (kk_function_t, kk_box_t, kk_context_t*), comp, (comp, kk_int_box(0), ctx)), ctx);
+  assert(ctx->yielding == KK_YIELD_NORMAL && ctx->yield.conts_count == 1 && ctx->yield.conts[0] == comp);
+  ctx->yielding = KK_YIELD_NONE;
+  ctx->yield.conts_count = 0;
+  assert(kcompose_call(comp, 19, ctx) == 1934);
+  KK_UNUSED_RELEASE(small); KK_UNUSED_RELEASE(pooled0); KK_UNUSED_RELEASE(pooled2);
+}
+
+// Update thread-shared references concurrently from parallel tasks
+struct __fun_ref_update_s {
+  struct kk_function_s _base;
+  kk_box_t refs;   // a vector of references
+};
+
+static kk_box_t __fun_ref_inc(kk_function_t fself, kk_box_t x, kk_context_t* ctx) {
+  kk_function_drop(fself, ctx);
+  return kk_integer_box(kk_integer_add(kk_integer_unbox(x), kk_integer_one, ctx));
+}
+
+static kk_function_t new_fun_ref_inc(kk_context_t* ctx) {
+  kk_define_static_function(f, __fun_ref_inc, ctx)
+  return kk_function_dup(f);
+}
+
+#define REF_UPDATES  (2000)
+
+static kk_box_t __fun_ref_update(kk_function_t fself, kk_context_t* ctx) {
+  struct __fun_ref_update_s* self = kk_function_as(struct __fun_ref_update_s*, fself);
+  kk_vector_t v = kk_vector_unbox(kk_box_dup(self->refs), ctx);
+  kk_function_drop(fself, ctx);
+  kk_box_t* refs = kk_vector_buf_borrow(v, NULL);
+  for (int i = 0; i < REF_UPDATES; i++) {
+    kk_integer_drop(kk_ref_fetch_add(kk_ref_unbox(kk_box_dup(refs[0]), ctx), kk_integer_one, ctx), ctx);
+    kk_integer_drop(kk_ref_fetch_add(kk_ref_unbox(kk_box_dup(refs[1]), ctx), kk_integer_one, ctx), ctx);
+    kk_ref_modify(kk_ref_unbox(kk_box_dup(refs[2]), ctx), new_fun_ref_inc(ctx), ctx);
+    // concurrent readers and writers of heap values
+    kk_string_t s = kk_string_unbox(kk_ref_get(kk_ref_unbox(kk_box_dup(refs[3]), ctx), ctx));
+    assert(kk_string_len_borrow(s) == 5);
+    kk_ref_set(kk_ref_unbox(kk_box_dup(refs[3]), ctx), kk_string_box(s), ctx);
+    kk_ref_vector_assign(kk_ref_unbox(kk_box_dup(refs[4]), ctx), kk_integer_from_small(i%4),
+                         kk_string_box(kk_string_alloc_dup_valid_utf8("world", ctx)), ctx);
+    // concurrent element readers (the vector is copied on assignment, so elements stay alive)
+    kk_vector_t w = kk_vector_unbox(kk_ref_get(kk_ref_unbox(kk_box_dup(refs[4]), ctx), ctx), ctx);
+    kk_box_t e = kk_box_dup(kk_vector_buf_borrow(w, NULL)[(i+1)%4]);
+    kk_vector_drop(w, ctx);
+    assert(kk_box_is_null(e) || kk_string_len_borrow(kk_string_unbox(e)) == 5);
+    kk_box_drop(e, ctx);
+  }
+  kk_vector_drop(v, ctx);
+  return kk_box_null;
+}
+
+static void test_ref_shared(kk_context_t* ctx) {
+  const kk_ssize_t n = 4;
+  kk_box_t* refs;
+  kk_vector_t v = kk_vector_alloc_uninit(5, &refs, ctx);
+  refs[0] = kk_ref_box(kk_ref_alloc(kk_integer_box(kk_integer_zero), ctx), ctx);
+  refs[1] = kk_ref_box(kk_ref_alloc(kk_integer_box(kk_integer_from_int64(KI64(1)<<62, ctx)), ctx), ctx);   // not a small int
+  refs[2] = kk_ref_box(kk_ref_alloc(kk_integer_box(kk_integer_zero), ctx), ctx);
+  refs[3] = kk_ref_box(kk_ref_alloc(kk_string_box(kk_string_alloc_dup_valid_utf8("hello", ctx)), ctx), ctx);
+  refs[4] = kk_ref_box(kk_ref_alloc(kk_vector_box(kk_vector_alloc(4, kk_box_null, ctx), ctx), ctx), ctx);
+  kk_box_t vb = kk_vector_box(v, ctx);
+  kk_box_mark_shared(vb, ctx);
+  kk_task_set_worker_count(n);
+  kk_box_t futures[4];
+  for (kk_ssize_t i = 0; i < n; i++) {
+    struct __fun_ref_update_s* f = kk_function_alloc_as(struct __fun_ref_update_s, 2, ctx);
+    f->_base.fun = kk_cfun_ptr_box(&__fun_ref_update, ctx);
+    f->refs = kk_box_dup(vb);
+    futures[i] = kk_task_spawn(&f->_base, ctx);
+  }
+  for (kk_ssize_t i = 0; i < n; i++) {
+    kk_box_drop(kk_task_await(futures[i], ctx), ctx);
+  }
+  kk_integer_t c0 = kk_integer_unbox(kk_ref_get(kk_ref_unbox(kk_box_dup(refs[0]), ctx), ctx));
+  kk_integer_t c1 = kk_integer_unbox(kk_ref_get(kk_ref_unbox(kk_box_dup(refs[1]), ctx), ctx));
+  kk_integer_t c2 = kk_integer_unbox(kk_ref_get(kk_ref_unbox(kk_box_dup(refs[2]), ctx), ctx));
+  c1 = kk_integer_sub(c1, kk_integer_from_int64(KI64(1)<<62, ctx), ctx);
+  const kk_ssize_t n0 = kk_integer_clamp_ssize_t(c0, ctx);
+  const kk_ssize_t n1 = kk_integer_clamp_ssize_t(c1, ctx);
+  const kk_ssize_t n2 = kk_integer_clamp_ssize_t(c2, ctx);
+  printf("ref shared: fetch-add %zd, big fetch-add %zd, modify %zd (expected %zd)\n", n0, n1, n2, n*REF_UPDATES);
+  assert(n0 == n*REF_UPDATES && n1 == n*REF_UPDATES && n2 == n*REF_UPDATES);
+  kk_box_drop(vb, ctx);
+}
+
+// Unboxed vectors: bulk kernels against scalar loops, in-place updates when unique
+static void test_uvector(kk_context_t* ctx) {
+  const kk_ssize_t n = 1003;  // not a multiple of the vector width
+  kk_uvector_t v = kk_uvector_f64_alloc(n, 0.0, ctx);
+  kk_uvector_t w = kk_uvector_i32_alloc(n, 0, ctx);
+  kk_uvector_t u = kk_uvector_u8_alloc(n, 0, ctx);
+  double fsum = 0.0;
+  int64_t isum = 0, usum = 0;
+  for (kk_ssize_t i = 0; i < n; i++) {
+    v = kk_uvector_f64_set(v, i, (double)(i % 17), ctx);   // exact sums
+    w = kk_uvector_i32_set(w, i, (int32_t)(i - 500), ctx);
+    u = kk_uvector_u8_set(u, i, (uint8_t)(i * 7), ctx);
+    fsum += (double)(i % 17);
+    isum += (i - 500);
+    usum += (uint8_t)(i * 7);
+  }
+  const double fs = kk_uvector_f64_sum(kk_uvector_dup(v), ctx);
+  const int64_t is = kk_uvector_i32_sum(kk_uvector_dup(w), ctx);
+  const int64_t us = kk_uvector_u8_sum(kk_uvector_dup(u), ctx);
+  const double fd = kk_uvector_f64_dot(kk_uvector_dup(v), kk_uvector_dup(v), ctx);
+  printf("uvector: f64 sum %.1f, dot %.1f, i32 sum %" PRId64 ", u8 sum %" PRId64 "\n", fs, fd, is, us);
+  assert(fs == fsum && is == isum && us == usum);
+  KK_UNUSED_RELEASE(fd);
+
+  // shared updates copy, unique ones are in place
+  kk_uvector_t v2 = kk_uvector_f64_set(kk_uvector_dup(v), 0, 42.0, ctx);
+  assert(v2 != v && kk_uvector_f64_buf_borrow(v)[0] == 0.0);
+  kk_uvector_t v3 = kk_uvector_f64_set(v2, 1, 43.0, ctx);
+  assert(v3 == v2);
+  v3 = kk_uvector_f64_add(v3, kk_uvector_dup(v), ctx);
+  assert(v3 == v2 && kk_uvector_f64_buf_borrow(v3)[0] == 42.0 && kk_uvector_f64_buf_borrow(v3)[2] == 4.0);
+  const int cmp = kk_uvector_cmp(kk_uvector_dup(v), kk_uvector_dup(v3), ctx);
+  assert(cmp < 0); KK_UNUSED_RELEASE(cmp);
+  kk_uvector_drop(v3, ctx);
+
+  // `map` (in std/core) makes the vector unique once and then assigns in place
+  kk_uvector_t v4 = kk_uvector_unique(kk_uvector_dup(v), ctx);
+  assert(v4 != v);
+  for (kk_ssize_t i = 0; i < n; i++) {
+    const double x = kk_uvector_f64_at(kk_uvector_dup(v4), i, ctx);
+    kk_uvector_f64_unsafe_assign(kk_uvector_dup(v4), i, x + 1.0, ctx);
+  }
+  const double fs4 = kk_uvector_f64_sum(kk_uvector_unique(v4, ctx), ctx);
+  assert(fs4 == fsum + (double)n && kk_uvector_f64_buf_borrow(v)[0] == 0.0); KK_UNUSED_RELEASE(fs4);
+
+  // round trip through a boxed vector
+  kk_vector_t bv = kk_uvector_i32_to_vector(kk_uvector_dup(w), ctx);
+  kk_uvector_t w2 = kk_uvector_i32_from_vector(bv, ctx);
+  const bool eq = kk_uvector_eq(kk_uvector_dup(w), w2, ctx);
+  assert(eq); KK_UNUSED_RELEASE(eq);
+
+  // doubles compare with `==`: a NaN is never equal
+  kk_uvector_t v5 = kk_uvector_copy(kk_uvector_dup(v), ctx);
+  const bool eq5 = kk_uvector_eq(kk_uvector_dup(v), kk_uvector_dup(v5), ctx);
+  v5 = kk_uvector_f64_set(v5, n - 2, NAN, ctx);
+  const bool neq5 = kk_uvector_eq(kk_uvector_dup(v5), v5, ctx);
+  assert(eq5 && !neq5); KK_UNUSED_RELEASE(eq5); KK_UNUSED_RELEASE(neq5);
+
+  kk_uvector_drop(v, ctx);
+  kk_uvector_drop(w, ctx);
+  kk_uvector_drop(u, ctx);
+}
+
+// Bulk chacha20 generation agrees with the block at a time generator, and splitting is deterministic
+static void test_random_bulk(kk_context_t* ctx) {
+  uint8_t key[32] = { 0 };
+  kk_random_ctx_t r1, r2;
+  kk_chacha_init(&r1, key, 0);
+  kk_chacha_init(&r2, key, 0);
+  uint32_t bulk[1000];
+  uint32_t single[1000];
+  kk_chacha_fill(&r1, bulk, kk_ssizeof(bulk));
+  for (kk_ssize_t i = 0; i < 1000; i += 16) {
+    kk_chacha_fill(&r2, single + i, (i + 16 <= 1000 ? 16 : 1000 - i) * kk_ssizeof(uint32_t));   // one block at a time
+  }
+  assert(bulk[0] == KU32(0xADE0B876) && bulk[1] == KU32(0x903DF1A0));  // known keystream of a zero key and nonce
+  assert(memcmp(bulk, single, sizeof(bulk)) == 0);
+  kk_random_ctx_t c1, c2;
+  kk_chacha_split(&r1, &c1);
+  kk_chacha_split(&r2, &c2);
+  kk_chacha_fill(&c1, bulk, 64);
+  kk_chacha_fill(&c2, single, 64);
+  assert(memcmp(bulk, single, 64) == 0);
+
+  const kk_ssize_t n = 10000000;
+  double* ds = (double*)kk_malloc(n * kk_ssizeof(double), ctx);
+  kk_timer_t start = kk_timer_start();
+  kk_srandom_fill_double(ds, n, ctx);
+  kk_usecs_t elapsed = kk_timer_end(start);
+  double sum = 0.0;
+  for (kk_ssize_t i = 0; i < n; i++) {
+    assert(ds[i] >= 0.0 && ds[i] < 1.0);
+    sum += ds[i];
+  }
+  printf("random bulk: %zd doubles: %ldus, mean %.4f\n", n, (long)elapsed, sum / (double)n);
+  assert(sum / (double)n > 0.49 && sum / (double)n < 0.51);
+  kk_free(ds);
+
+  kk_sfc_ctx_t sfc;
+  kk_sfc_init(42, &sfc);
+  kk_sfc_fill(&sfc, bulk, 1000);
+  kk_pcg_ctx_t pcg;
+  kk_pcg_init(42, 1, &pcg);
+  kk_pcg_fill(&pcg, single, 1000);
+  assert(bulk[0] != bulk[1] && single[0] != single[1]);
+}
+
+// The per call cost of the timer (using the time stamp counter if available) against the OS clock
+static void test_timer_cost(kk_context_t* ctx) {
+  const kk_ssize_t n = 1000000;
+  double frac;
+  double t0 = kk_timer_ticks(&frac, ctx) + frac;
+  double u0 = kk_time_unix_now(&frac, ctx) + frac;
+  double last = t0;
+  for (kk_ssize_t i = 0; i < n; i++) {
+    const double t = kk_timer_ticks(&frac, ctx) + frac;
+    assert(t >= last);
+    last = t;
+  }
+  double t1 = kk_timer_ticks(&frac, ctx) + frac;
+  for (kk_ssize_t i = 0; i < n; i++) {
+    kk_time_unix_now(&frac, ctx);
+  }
+  double t2 = kk_timer_ticks(&frac, ctx) + frac;
+  double u2 = kk_time_unix_now(&frac, ctx) + frac;
+  printf("timer: %s, resolution %.3gs, per call: %.1fns (os clock: %.1fns), drift %.3gs\n",
+         (kk_timer_is_tsc(ctx) ? "tsc" : "os"), kk_timer_resolution(ctx),
+         1.0e9*(t1 - t0)/(double)n, 1.0e9*(t2 - t1)/(double)n, (t2 - t0) - (u2 - u0));
+  assert(fabs((t2 - t0) - (u2 - u0)) < 0.01);
+  KK_UNUSED_RELEASE(last);
+}
+
+// Boxing doubles of different ranges into a vector, counting heap allocated boxes (see `box.h` for the encodings)
+static void test_double_box(kk_context_t* ctx) {
+  const kk_ssize_t n = 1000000;
+  const kk_ssize_t rounds = 5;
+  static const char* names[3] = { "signed [-1e6,1e6]", "wide range", "with nan/inf" };
+  double* ds = (double*)kk_malloc(n * kk_ssizeof(double), ctx);
+  kk_sfc_ctx_t rnd;
+  kk_sfc_init(1, &rnd);
+  for (int kind = 0; kind < 3; kind++) {
+    for (kk_ssize_t i = 0; i < n; i++) {
+      uint32_t r[2];
+      kk_sfc_fill(&rnd, r, 2);
+      const double x = ((double)r[0] / 4294967296.0) * 2.0 - 1.0;
+      if (kind == 0)      ds[i] = x * 1.0e6;
+      else if (kind == 1) ds[i] = x * pow(10.0, (double)((int)(r[1] % 601) - 300));
+      else                ds[i] = ((r[1] % 16) == 0 ? (r[1] & 16 ? HUGE_VAL : -HUGE_VAL) : ((r[1] % 16) == 1 ? nan("") : x));
+    }
+    kk_box_t* buf;
+    kk_vector_t v = kk_vector_alloc_uninit(n, &buf, ctx);
+    for (kk_ssize_t i = 0; i < n; i++) { buf[i] = kk_box_null; }
+    kk_ssize_t heap = 0;
+    double sum = 0.0;
+    kk_timer_t start = kk_timer_start();
+    for (kk_ssize_t r = 0; r < rounds; r++) {
+      for (kk_ssize_t i = 0; i < n; i++) {
+        kk_box_drop(buf[i], ctx);
+        buf[i] = kk_double_box(ds[i], ctx);
+      }
+      for (kk_ssize_t i = 0; i < n; i++) {
+        const double d = kk_double_unbox(buf[i], NULL /* borrow */);
+        if (isfinite(d)) sum += d;
+      }
+    }
+    kk_usecs_t elapsed = kk_timer_end(start);
+    for (kk_ssize_t i = 0; i < n; i++) {
+      if (kk_box_is_ptr(buf[i])) heap++;
+      const double d = kk_double_unbox(buf[i], NULL);
+      assert(memcmp(&d, &ds[i], sizeof(d)) == 0 || (isnan(d) && isnan(ds[i])));
+    }
+    start = kk_timer_start();
+    kk_vector_drop(v, ctx);
+    kk_usecs_t dropped = kk_timer_end(start);
+    printf("double box: %s: %zdx %zd box/unbox: %ldus, drop: %ldus, heap boxes: %zd (%s)\n", names[kind], rounds, n,
+           (long)elapsed, (long)dropped, heap, (sum != 0.0 ? "ok" : "zero"));
+  }
+  kk_free(ds);
+}
+
+// Hardware performance counters are either unavailable (-1) or increase with work
+static void test_perf_counters(kk_context_t* ctx) {
+  const bool available = kk_perf_start();
+  kk_perf_counters_t c0;
+  kk_perf_read(&c0);
+  volatile uint64_t x = 1;
+  for (int i = 0; i < 1000000; i++) { x = x*6364136223846793005ULL + 1; }
+  kk_perf_counters_t c1;
+  kk_perf_read(&c1);
+  printf("perf counters: %s", (available ? "" : "not available, "));
+  for (int i = 0; i < KK_PERF_EVENT_COUNT; i++) {
+    assert((c0.events[i] < 0) == (c1.events[i] < 0));
+    assert(c1.events[i] >= c0.events[i]);
+    if (c1.events[i] >= 0) printf("%s: %lld, ", kk_perf_event_name((kk_perf_event_t)i), (long long)(c1.events[i] - c0.events[i]));
+  }
+  printf("page reclaims: %lld\n", (long long)c1.page_reclaims);
+  if (c1.events[KK_PERF_INSTRUCTIONS] >= 0) {
+    assert(c1.events[KK_PERF_INSTRUCTIONS] - c0.events[KK_PERF_INSTRUCTIONS] >= 1000000);
+  }
+  assert(c1.page_faults >= c0.page_faults);
+  KK_UNUSED(ctx);
+}
+
+// Parse allocator options (without mimalloc only the NUMA binding is applied)
+static void test_mem_options(kk_context_t* ctx) {
+  bool ok = kk_mem_options("numa=1");
+  assert(ok && kk_mem_is_tuned());
+  ok = kk_mem_options("numa=1,no-such-option");
+  assert(!ok); KK_UNUSED_RELEASE(ok);
+  char json[256];
+  FILE* f = tmpfile();
+  assert(f != NULL);
+  kk_mem_print_json(f);
+  rewind(f);
+  size_t n = fread(json, 1, sizeof(json)-1, f);
+  json[n] = 0;
+  fclose(f);
+  assert(strstr(json, "\"numa_nodes\":1") != NULL);
+  printf("mem options: %s\n", json);
+  KK_UNUSED(ctx);
+}
+
+// Write and read a file with small stream buffers
+static void test_stream(kk_context_t* ctx) {
+  const char* fname = "kklib-test-stream.txt";
+  kk_os_stream_t* s;
+  int err = kk_os_stream_open(kk_string_alloc_from_utf8(fname, ctx), true, false, 64, &s, ctx);
+  assert(err == 0);
+  for (int i = 0; i < 1000; i++) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "line %d: \xC3\xA9t\xC3\xA9%s", i, (i % 2 == 0 ? "\n" : "\r\n"));
+    err = kk_os_stream_write(s, kk_string_alloc_from_utf8(buf, ctx), ctx);
+    assert(err == 0);
+  }
+  err = kk_os_stream_write(s, kk_string_alloc_from_utf8("last", ctx), ctx);
+  assert(err == 0);
+  err = kk_os_stream_close(s, ctx);
+  assert(err == 0);
+  kk_os_stream_free(s, NULL);
+  // lines; the buffer of a dropped line is reused
+  err = kk_os_stream_open(kk_string_alloc_from_utf8(fname, ctx), false, false, 64, &s, ctx);
+  assert(err == 0);
+  const uint8_t* prev = NULL;
+  int reused = 0;
+  for (int i = 0; i <= 1000; i++) {
+    kk_string_t line;
+    bool eof;
+    err = kk_os_stream_read_line(s, &line, &eof, ctx);
+    assert(err == 0 && !eof);
+    char buf[64];
+    if (i < 1000) { snprintf(buf, sizeof(buf), "line %d: \xC3\xA9t\xC3\xA9", i); }
+             else { strcpy(buf, "last"); }
+    assert(strcmp(kk_string_cbuf_borrow(line, NULL), buf) == 0);
+    const uint8_t* p = kk_string_buf_borrow(line, NULL);
+    if (p == prev) reused++;
+    prev = p;
+    kk_string_drop(line, ctx);
+  }
+  assert(reused > 900);
+  kk_string_t line;
+  bool eof;
+  err = kk_os_stream_read_line(s, &line, &eof, ctx);
+  assert(err == 0 && eof);
+  kk_os_stream_free(s, NULL);
+  // chunks end at a code point boundary
+  err = kk_os_stream_open(kk_string_alloc_from_utf8(fname, ctx), false, false, 64, &s, ctx);
+  assert(err == 0);
+  kk_string_builder_t sb = kk_string_builder_empty();
+  do {
+    err = kk_os_stream_read(s, 13, &line, ctx);
+    assert(err == 0 && kk_string_len_borrow(line) <= 13);
+    assert(kk_utf8_is_valid(kk_string_cbuf_borrow(line, NULL)));
+    eof = kk_string_is_empty_borrow(line);
+    kk_string_builder_append(&sb, line, ctx);
+  } while (!eof);
+  kk_os_stream_free(s, NULL);
+  kk_string_t all;
+  err = kk_os_read_text_file(kk_string_alloc_from_utf8(fname, ctx), &all, ctx);
+  assert(err == 0);
+  const bool eq = kk_string_is_eq(kk_string_builder_finish(&sb), all, ctx);
+  assert(eq); KK_UNUSED_RELEASE(eq); KK_UNUSED_RELEASE(err);
+  remove(fname);
+}
+
+// Continuation of an asynchronous operation that records its result
+typedef struct async_result_s {
+  int64_t     result;
+  kk_string_t data;
+  int         order;
+} async_result_t;
+
+struct __fun_async_done_s {
+  struct kk_function_s _base;
+  async_result_t* res;
+  int*            counter;
+};
+
+static kk_box_t __fun_async_done(kk_function_t fself, kk_box_t result, kk_box_t data, kk_context_t* ctx) {
+  struct __fun_async_done_s* self = kk_function_as(struct __fun_async_done_s*, fself);
+  async_result_t* res = self->res;
+  res->result = kk_integer_clamp64(kk_integer_unbox(result), ctx);
+  res->data = kk_string_unbox(data);
+  res->order = (*self->counter)++;
+  kk_function_drop(fself, ctx);
+  return kk_unit_box(kk_Unit);
+}
+
+static kk_function_t new_fun_async_done(async_result_t* res, int* counter, kk_context_t* ctx) {
+  struct __fun_async_done_s* f = kk_function_alloc_as(struct __fun_async_done_s, 0, ctx);
+  f->_base.fun = kk_cfun_ptr_box(&__fun_async_done, ctx);
+  f->res = res;
+  f->counter = counter;
+  return &f->_base;
+}
+
+static void test_async(kk_context_t* ctx) {
+#if !defined(WIN32)
+  const char* fname = "kklib-test-async.txt";
+  FILE* f = fopen(fname, "wb");
+  assert(f != NULL);
+  for (int i = 0; i < 100; i++) { fprintf(f, "%04d", i); }
+  fclose(f);
+  int fd = open(fname, O_RDONLY);
+  assert(fd >= 0);
+  int fds[2];
+  int err = pipe(fds);
+  assert(err == 0);
+  // a batch of reads at different offsets, a pipe write and read, and a sleep
+  int counter = 0;
+  async_result_t res[12];
+  kk_async_sleep(20, new_fun_async_done(&res[11], &counter, ctx), ctx);
+  for (int i = 0; i < 8; i++) {
+    kk_async_read(fd, 4, 4*(10*i + 1), new_fun_async_done(&res[i], &counter, ctx), ctx);
+  }
+  kk_async_read(fds[0], 16, -1, new_fun_async_done(&res[8], &counter, ctx), ctx);
+  kk_async_write(fds[1], kk_string_alloc_from_utf8("hello", ctx), -1, new_fun_async_done(&res[9], &counter, ctx), ctx);
+  kk_async_read(fd, 8, 4*98, new_fun_async_done(&res[10], &counter, ctx), ctx);
+  assert(kk_async_pending(ctx) == 12);
+  kk_timer_t start = kk_timer_start();
+  kk_async_run(ctx);
+  kk_usecs_t elapsed = kk_timer_end(start);
+  assert(kk_async_pending(ctx) == 0 && counter == 12 && elapsed >= 15000);
+  for (int i = 0; i < 8; i++) {
+    char buf[8];
+    snprintf(buf, sizeof(buf), "%04d", 10*i + 1);
+    assert(res[i].result == 4 && strcmp(kk_string_cbuf_borrow(res[i].data, NULL), buf) == 0);
+  }
+  assert(res[8].result == 5 && strcmp(kk_string_cbuf_borrow(res[8].data, NULL), "hello") == 0);
+  assert(res[9].result == 5 && kk_string_is_empty_borrow(res[9].data));
+  assert(res[10].result == 8 && strcmp(kk_string_cbuf_borrow(res[10].data, NULL), "00980099") == 0);
+  assert(res[11].result == 0 && res[11].order == 11);
+  // errors are negative
+  kk_string_drop(res[0].data, ctx);
+  kk_async_read(-1, 4, 0, new_fun_async_done(&res[0], &counter, ctx), ctx);
+  kk_async_run(ctx);
+  assert(res[0].result == -EBADF);
+  for (int i = 0; i < 12; i++) { kk_string_drop(res[i].data, ctx); }
+  close(fds[0]);
+  close(fds[1]);
+  close(fd);
+  remove(fname);
+  printf("async: io_uring: %s, elapsed: %ldus\n", (kk_async_uses_io_uring(ctx) ? "yes" : "no"), (long)elapsed);
+#else
+  KK_UNUSED(ctx);
+#endif
+}
+
+static void test_free_budget(kk_context_t* ctx) {
+  test_free_budget_run(0, ctx);
+  test_free_budget_run(10000, ctx);
+  test_free_budget_run(1000, ctx);
+#if !defined(WIN32)
+  kk_free_set_budget(1000);
+  kk_ssize_t budget = 0;
+  pthread_t thread;
+  pthread_create(&thread, NULL, &free_budget_thread, &budget);
+  pthread_join(thread, NULL);
+  kk_free_set_budget(0);
+  assert(budget == 1000 && ctx->free_budget == 0);
+  KK_UNUSED_RELEASE(budget);
+#endif
+}
+
+// Library state of a context is freed when the context is freed (here on thread termination)
+static int context_local_key;
+static kk_ssize_t context_local_freed;
+
+static void context_local_free(void* data, kk_context_t* ctx) {
+  context_local_freed++;
+  kk_free(data);
+  KK_UNUSED(ctx);
+}
+
+#if !defined(WIN32)
+static void* context_local_thread(void* arg) {
+  kk_context_t* ctx = kk_get_context();
+  bool ok = (kk_context_local_get(&context_local_key, ctx) == NULL);
+  ok = ok && kk_context_local_set(&context_local_key, kk_malloc(64, ctx), &context_local_free, ctx);
+  ok = ok && (kk_context_local_get(&context_local_key, ctx) != NULL);
+  *((bool*)arg) = ok;
+  kk_free_context();
+  return NULL;
+}
+#endif
+
+static void test_context_local(kk_context_t* ctx) {
+  void* data = kk_malloc(64, ctx);
+  bool ok = kk_context_local_set(&context_local_key, data, &context_local_free, ctx);
+  assert(ok && kk_context_local_get(&context_local_key, ctx) == data);
+#if !defined(WIN32)
+  pthread_t thread;
+  ok = false;
+  pthread_create(&thread, NULL, &context_local_thread, &ok);
+  pthread_join(thread, NULL);
+  assert(ok && context_local_freed == 1);
+#endif
+  // the main context frees `data` at exit
+  KK_UNUSED_RELEASE(ok);
+}
+
 int main() {
   kk_context_t* ctx = kk_get_context();
   /*
@@ -585,6 +2476,48 @@ int main() {
   test_ovf(ctx);
   */
   test_count10(ctx);
+  test_mul_tiers(ctx);
+  test_pow(ctx);
+  test_hex_roundtrip(ctx);
+  test_integer_parse(ctx);
+  test_div_large(ctx);
+  test_utf8(ctx);
+  test_memsearch(ctx);
+  test_string_builder(ctx);
+  test_string_ascii1(ctx);
+  test_string_ascii_kernels(ctx);
+  test_string_replace(ctx);
+  test_string_intern(ctx);
+  test_string_view(ctx);
+  test_double_show(ctx);
+  test_read_text_file(ctx);
+  test_copy_file(ctx);
+  test_print(ctx);
+  test_process(ctx);
+  test_walk(ctx);
+  test_kcompose(ctx);
+  test_ref_shared(ctx);
+  test_uvector(ctx);
+  test_random_bulk(ctx);
+  test_timer_cost(ctx);
+  test_double_box(ctx);
+  test_perf_counters(ctx);
+  test_mem_options(ctx);
+  test_stream(ctx);
+  test_async(ctx);
+  test_free_budget(ctx);
+  test_context_local(ctx);
+  test_mark_shared(ctx);
+  test_tasks(ctx);
+  test_free_cache(ctx);
+  test_vector_dupn(ctx);
+  test_freeze(ctx);
+  test_reclaim(ctx);
+  test_arena(ctx);
+  test_heapprof(ctx);
+#if KK_STATS
+  test_stats(ctx);
+#endif
   // test_popcount();
   // test_bitcount();
   // test_random(ctx);
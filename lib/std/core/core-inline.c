@@ -8,18 +8,19 @@
 ---------------------------------------------------------------------------*/
 
 kk_std_core__list kk_vector_to_list(kk_vector_t v, kk_std_core__list tail, kk_context_t* ctx) {
-  // todo: avoid boxed_dup if v is unique
   kk_ssize_t n;
   kk_box_t* p = kk_vector_buf_borrow(v, &n);
   if (n <= 0) {
     kk_vector_drop(v,ctx);
     return tail;
   }
+  // if the vector is unique we move the elements out (and free the vector shallowly)
+  const bool unique = kk_datatype_is_unique(v);
   kk_std_core__list nil  = kk_std_core__new_Nil(ctx);
   struct kk_std_core_Cons* cons = NULL;
   kk_std_core__list list = kk_std_core__new_Nil(ctx);
   for( kk_ssize_t i = 0; i < n; i++ ) {
-    kk_std_core__list hd = kk_std_core__new_Cons(kk_reuse_null,kk_box_dup(p[i]), nil, ctx);
+    kk_std_core__list hd = kk_std_core__new_Cons(kk_reuse_null,(unique ? p[i] : kk_box_dup(p[i])), nil, ctx);
     if (cons==NULL) {
       list = hd;
     }
@@ -29,31 +30,68 @@ kk_std_core__list kk_vector_to_list(kk_vector_t v, kk_std_core__list tail, kk_co
     cons = kk_std_core__as_Cons(hd);
   }
   cons->tail = tail;
-  kk_vector_drop(v,ctx);
+  if (unique) {
+    kk_block_free(v.ptr,ctx);
+  }
+  else {
+    kk_vector_drop(v,ctx);
+  }
   return list;
 }
 
+// initial number of elements reserved when converting a list to a vector
+#ifndef KK_LIST_TO_VECTOR_CHUNK
+#define KK_LIST_TO_VECTOR_CHUNK  (16)
+#endif
+
 kk_vector_t kk_list_to_vector(kk_std_core__list xs, kk_context_t* ctx) {
-  // todo: avoid boxed_dup if xs is unique
-  // find the length
+  if (!kk_std_core__is_Cons(xs)) {
+    kk_std_core__list_drop(xs,ctx);
+    return kk_vector_empty();
+  }
+  // visit the list once, growing the vector in chunks (in place if possible)
+  kk_ssize_t cap;
+  kk_vector_t v = kk_vector_alloc(KK_LIST_TO_VECTOR_CHUNK, kk_box_null, ctx);  // unused entries must be initialized
+  kk_box_t* p = kk_vector_buf_borrow(v, &cap);
   kk_ssize_t len = 0;
+  // as long as the list is unique, move the heads out and free the cells
+  while (kk_std_core__is_Cons(xs) && kk_datatype_is_unique(xs)) {
+    struct kk_std_core_Cons* cons = kk_std_core__as_Cons(xs);
+    if (len >= cap) {
+      v = kk_vector_realloc(v, 2*cap, kk_box_null, ctx);
+      p = kk_vector_buf_borrow(v, &cap);
+    }
+    p[len++] = cons->head;
+    kk_std_core__list tl = cons->tail;
+    kk_datatype_free(xs,ctx);
+    xs = tl;
+  }
+  // the rest is shared: duplicate the heads (runs of the same element in one go)
   kk_std_core__list ys = xs;
+  kk_box_t   run = kk_box_null;
+  kk_ssize_t runlen = 0;
   while (kk_std_core__is_Cons(ys)) {
     struct kk_std_core_Cons* cons = kk_std_core__as_Cons(ys);
-    len++;
-    ys = cons->tail;
-  }
-  // alloc the vector and copy
-  kk_box_t* p;
-  kk_vector_t v = kk_vector_alloc_uninit(len, &p, ctx);  
-  ys = xs;
-  for( kk_ssize_t i = 0; i < len; i++) {
-    struct kk_std_core_Cons* cons = kk_std_core__as_Cons(ys);
+    if (len >= cap) {
+      v = kk_vector_realloc(v, 2*cap, kk_box_null, ctx);
+      p = kk_vector_buf_borrow(v, &cap);
+    }
+    const kk_box_t x = cons->head;
+    p[len++] = x;
+    if (kk_box_eq(x, run)) {
+      runlen++;
+    }
+    else {
+      if (runlen > 0) { kk_box_dupn(run, runlen); }
+      run = x;
+      runlen = 1;
+    }
     ys = cons->tail;
-    p[i] = kk_box_dup(cons->head);
   }
-  kk_std_core__list_drop(xs,ctx);  // todo: drop while visiting?
-  return v;
+  if (runlen > 0) { kk_box_dupn(run, runlen); }
+  kk_std_core__list_drop(xs,ctx);  
+  // and trim the extra elements
+  return kk_vector_realloc(v, len, kk_box_null, ctx);
 }
 
 kk_vector_t kk_vector_init( kk_ssize_t n, kk_function_t init, kk_context_t* ctx) {
@@ -98,6 +136,10 @@ kk_std_core__list kk_string_to_list(kk_string_t s, kk_context_t* ctx) {
 
 kk_string_t kk_string_from_list(kk_std_core__list cs, kk_context_t* ctx) {
   // TODO: optimize for short strings to write directly into a local buffer?
+  if (!kk_std_core__is_Cons(cs)) {
+    kk_std_core__list_drop(cs,ctx);
+    return kk_string_empty();
+  }
   // find total UTF8 length
   kk_ssize_t len = 0;
   kk_std_core__list xs = cs;
@@ -109,7 +151,19 @@ kk_string_t kk_string_from_list(kk_std_core__list cs, kk_context_t* ctx) {
   // allocate and copy the characters
   uint8_t* p;
   kk_string_t s = kk_unsafe_string_alloc_buf(len,&p,ctx);  // must be initialized
+  // as long as the list is unique, free the cells while visiting (characters are not reference counted)
   xs = cs;
+  while (kk_std_core__is_Cons(xs) && kk_datatype_is_unique(xs)) {
+    struct kk_std_core_Cons* cons = kk_std_core__as_Cons(xs);
+    kk_ssize_t count;
+    kk_utf8_write( kk_char_unbox(cons->head,ctx), p, &count );
+    p += count;
+    kk_std_core__list tl = cons->tail;
+    kk_datatype_free(xs,ctx);
+    xs = tl;
+  }
+  // and copy the shared rest
+  cs = xs;
   while (kk_std_core__is_Cons(xs)) {
     struct kk_std_core_Cons* cons = kk_std_core__as_Cons(xs);
     kk_ssize_t count;
@@ -118,7 +172,7 @@ kk_string_t kk_string_from_list(kk_std_core__list cs, kk_context_t* ctx) {
     xs = cons->tail;
   }
   kk_assert_internal(*p == 0 && (p - kk_string_buf_borrow(s,NULL)) == len);
-  kk_std_core__list_drop(cs,ctx);  // todo: drop while visiting?
+  kk_std_core__list_drop(cs,ctx);
   return s;
 }
 
@@ -153,17 +207,14 @@ kk_integer_t kk_slice_count( kk_std_core__sslice sslice, kk_context_t* ctx ) {
 }
 
 kk_string_t kk_slice_to_string( kk_std_core__sslice  sslice, kk_context_t* ctx ) {
-  const uint8_t* start;
-  const uint8_t* end;
-  kk_sslice_start_end_borrow(sslice, &start, &end);
   // is it the full string?
   if (sslice.start == 0 && sslice.len == kk_string_len_borrow(sslice.str)) {
     // TODO: drop sslice and dup sslice.str?
     return sslice.str;
   }
   else {
-    // if not, we copy len bytes
-    kk_string_t s = kk_string_alloc_dupn_valid_utf8(sslice.len, start, ctx);
+    // if not, we copy len bytes (or use a view for a large slice)
+    kk_string_t s = kk_string_alloc_view(sslice.str, sslice.start, sslice.len, ctx);
     kk_std_core__sslice_drop(sslice,ctx);
     return s;
   }
@@ -217,18 +268,19 @@ kk_std_core_types__maybe kk_slice_next( struct kk_std_core_Sslice slice, kk_cont
 struct kk_std_core_Sslice kk_slice_extend( struct kk_std_core_Sslice slice, kk_integer_t count, kk_context_t* ctx ) {
   kk_ssize_t cnt = kk_integer_clamp(count,ctx);
   if (cnt==0 || (slice.len <= 0 && cnt<0)) return slice;
+  const uint8_t* sstart;
   const uint8_t* s0;
   const uint8_t* s1;
-  kk_sslice_start_end_borrow(slice,&s0,&s1);
+  const uint8_t* send;
+  kk_sslice_start_end_borrowx(slice,&s0,&s1,&sstart,&send);
   const uint8_t* t  = s1;
   if (cnt >= 0) {
-    do {
+    while (cnt > 0 && t < send) {  // bounded by the length as a view is not zero terminated
       t = kk_utf8_next(t);
       cnt--;
-    } while (cnt > 0 && *t != 0);
+    }
   }
   else {  // cnt < 0
-    const uint8_t* sstart = s0 - slice.start;
     do {
       t = kk_utf8_prev(t);
       cnt++;
@@ -283,11 +335,15 @@ struct kk_std_core_Sslice kk_slice_advance( struct kk_std_core_Sslice slice, kk_
 }
 
 struct kk_std_core_Sslice kk_slice_common_prefix( kk_string_t str1, kk_string_t str2, kk_integer_t iupto, kk_context_t* ctx ) {
-  const uint8_t* s1 = kk_string_buf_borrow(str1,NULL);
-  const uint8_t* s2 = kk_string_buf_borrow(str2,NULL);
+  kk_ssize_t len1;
+  const uint8_t* s1 = kk_string_buf_borrow(str1,&len1);
+  kk_ssize_t len2;
+  const uint8_t* s2 = kk_string_buf_borrow(str2,&len2);
   kk_ssize_t upto = kk_integer_clamp_ssize_t(iupto,ctx);
+  if (upto > len1) upto = len1;
+  if (upto > len2) upto = len2;
   kk_ssize_t count;
-  for(count = 0; count < upto && *s1 != 0 && *s2 != 0; count++, s1++, s2++ ) {
+  for(count = 0; count < upto; count++, s1++, s2++ ) {
     if (*s1 != *s2) break;
   }
   kk_string_drop(str2,ctx);
@@ -325,6 +381,7 @@ kk_std_core__error kk_error_from_errno( int err, kk_context_t* ctx ) {
 
 
 kk_unit_t kk_assert_fail( kk_string_t msg, kk_context_t* ctx ) {
+  msg = kk_string_ensure_terminated(msg,ctx);
   kk_fatal_error(EINVAL, "assertion failed: %s\n", kk_string_cbuf_borrow(msg,NULL));
   kk_string_drop(msg,ctx);
   return kk_Unit;
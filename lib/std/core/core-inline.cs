@@ -72,6 +72,16 @@ public static class Primitive
   }
 
 
+  //---------------------------------------
+  // References
+  //---------------------------------------
+  public static BigInteger RefFetchAdd<H>(Ref<H,BigInteger> r, BigInteger delta) {
+    BigInteger x = r.Value;
+    r.Set(x + delta);
+    return x;
+  }
+
+
   //---------------------------------------
   // Arrays
   //---------------------------------------
@@ -89,6 +99,13 @@ public static class Primitive
     return a;
   }
 
+  public static A[] VectorPush<A>(A[] v, A x) {
+    A[] w = new A[v.Length + 1];
+    Array.Copy(v, w, v.Length);
+    w[v.Length] = x;
+    return w;
+  }
+
   public static __std_core._list<A> VList<A>(A[] v, __std_core._list<A> tail) {
     __std_core._list<A> xs = tail;
     for (int i = v.Length - 1; i >= 0; i--) {
@@ -114,6 +131,74 @@ public static class Primitive
   }
 
 
+  //---------------------------------------
+  // Unboxed vectors are plain arrays (and `set` copies)
+  //---------------------------------------
+  public static A[] UVectorCopy<A>(A[] v) {
+    return (A[])v.Clone();
+  }
+
+  public static A[] UVectorSet<A>(A[] v, int i, A x) {
+    A[] w = (A[])v.Clone();
+    w[i] = x;
+    return w;
+  }
+
+  public static double UVectorSum(double[] v) {
+    double sum = 0.0;
+    for (int i = 0; i < v.Length; i++) { sum += v[i]; }
+    return sum;
+  }
+
+  public static long UVectorSum(long[] v) {
+    long sum = 0;
+    for (int i = 0; i < v.Length; i++) { sum += v[i]; }
+    return sum;
+  }
+
+  public static long UVectorSum(int[] v) {
+    long sum = 0;
+    for (int i = 0; i < v.Length; i++) { sum += v[i]; }
+    return sum;
+  }
+
+  public static double UVectorDot(double[] v, double[] w) {
+    double sum = 0.0;
+    for (int i = 0; i < v.Length && i < w.Length; i++) { sum += v[i]*w[i]; }
+    return sum;
+  }
+
+  public static long UVectorDot(long[] v, long[] w) {
+    long sum = 0;
+    for (int i = 0; i < v.Length && i < w.Length; i++) { sum += v[i]*w[i]; }
+    return sum;
+  }
+
+  public static long UVectorDot(int[] v, int[] w) {
+    long sum = 0;
+    for (int i = 0; i < v.Length && i < w.Length; i++) { sum += (long)v[i]*w[i]; }
+    return sum;
+  }
+
+  public static bool UVectorEq<A>(A[] v, A[] w) {
+    if (v.Length != w.Length) return false;
+    EqualityComparer<A> eq = EqualityComparer<A>.Default;
+    for (int i = 0; i < v.Length; i++) {
+      if (!eq.Equals(v[i], w[i])) return false;
+    }
+    return true;
+  }
+
+  public static int UVectorCmp<A>(A[] v, A[] w) {
+    Comparer<A> cmp = Comparer<A>.Default;
+    for (int i = 0; i < v.Length && i < w.Length; i++) {
+      int c = cmp.Compare(v[i], w[i]);
+      if (c != 0) return c;
+    }
+    return v.Length.CompareTo(w.Length);
+  }
+
+
   //---------------------------------------
   // Dictionary
   //---------------------------------------
@@ -188,6 +273,28 @@ public static class Primitive
     return count;
   }
 
+  public static string ReplaceMany(string s, string[] pats, string[] reps) {
+    StringBuilder sb = new StringBuilder("");
+    int i = 0;
+    while (i < s.Length) {
+      int best = -1;
+      for (int j = 0; j < pats.Length; j++) {
+        string p = pats[j];
+        if (p.Length > 0 && i + p.Length <= s.Length && (best < 0 || p.Length > pats[best].Length) &&
+            String.CompareOrdinal(s, i, p, 0, p.Length) == 0) best = j;
+      }
+      if (best < 0) {
+        sb.Append(s[i]);
+        i++;
+      }
+      else {
+        sb.Append(reps[best]);
+        i += pats[best].Length;
+      }
+    }
+    return sb.ToString();
+  }
+
   public static string Repeat(string s, int n) {
     if (n <= 0 || String.IsNullOrEmpty(s)) return "";
     StringBuilder sb = new StringBuilder("");
@@ -21,6 +21,7 @@ static inline kk_std_core_types__order kk_int_as_order(int i,kk_context_t* ctx)
 
 static inline kk_std_core_types__maybe kk_integer_xparse( kk_string_t s, bool hex, kk_context_t* ctx ) {
   kk_integer_t i;
+  s = kk_string_ensure_terminated(s,ctx);
   bool ok = (hex ? kk_integer_hex_parse(kk_string_cbuf_borrow(s,NULL),&i,ctx) : kk_integer_parse(kk_string_cbuf_borrow(s,NULL),&i,ctx) );
   kk_string_drop(s,ctx);
   return (ok ? kk_std_core_types__new_Just(kk_integer_box(i),ctx) : kk_std_core_types__new_Nothing(ctx));
@@ -42,8 +43,12 @@ static inline kk_integer_t kk_string_cmp_int(kk_string_t s1, kk_string_t s2, kk_
   return kk_integer_from_small( kk_string_cmp(s1,s2,ctx) );
 }
 
-kk_string_t  kk_string_join(kk_vector_t v, kk_context_t* ctx);
-kk_string_t  kk_string_join_with(kk_vector_t v, kk_string_t sep, kk_context_t* ctx);
+static inline kk_integer_t kk_string_hash_int(kk_string_t s, kk_context_t* ctx) {
+  const uint32_t h = kk_string_hash_borrow(s);
+  kk_string_drop(s,ctx);
+  return kk_integer_from_int32( (int32_t)(h >> 1), ctx );
+}
+
 kk_string_t  kk_string_replace_all(kk_string_t str, kk_string_t pattern, kk_string_t repl, kk_context_t* ctx);
 static inline kk_integer_t kk_string_count_pattern(kk_string_t str, kk_string_t pattern, kk_context_t* ctx) {
   kk_integer_t count = kk_integer_from_ssize_t( kk_string_count_pattern_borrow(str,pattern), ctx );
@@ -19,7 +19,7 @@ else if (typeof process !== undefined) {
 
 
 /*------------------------------------------------
-  Number formatting
+  String helpers
 ------------------------------------------------*/
 
 function _string_repeat(s,n) {
@@ -35,6 +35,34 @@ function _string_repeat(s,n) {
   return res;
 }
 
+// Replace at each position the longest matching pattern (in a single pass)
+function _string_replace_many(s,pats,reps) {
+  let res = "";
+  let i = 0;
+  let start = 0;
+  while (i < s.length) {
+    let best = -1;
+    for (let j = 0; j < pats.length; j++) {
+      const p = pats[j];
+      if (p.length > 0 && (best < 0 || p.length > pats[best].length) && s.startsWith(p,i)) best = j;
+    }
+    if (best < 0) {
+      i++;
+    }
+    else {
+      res += s.substring(start,i) + reps[best];
+      i += pats[best].length;
+      start = i;
+    }
+  }
+  return (start===0 ? s : res + s.substring(start));
+}
+
+
+/*------------------------------------------------
+  Number formatting
+------------------------------------------------*/
+
 function _trimzeros(s) {
   return s.replace(/\.?0+$/,"");
 }
@@ -264,6 +292,58 @@ function _vector_at( v, i ) {
 }
 
 
+/*------------------------------------------------
+  unboxed vectors are plain arrays (and `set` copies)
+------------------------------------------------*/
+function _uvector_alloc(n, x) {
+  var a = new Array(n > 0 ? n : 0);
+  for(var i = 0; i < a.length; i++) {
+    a[i] = x;
+  }
+  return a;
+}
+
+function _uvector_set(v, i, x) {
+  var w = v.slice();
+  w[i] = x;
+  return w;
+}
+
+function _uvector_sum(v) {
+  var sum = 0;
+  for(var i = 0; i < v.length; i++) {
+    sum += v[i];
+  }
+  return sum;
+}
+
+function _uvector_dot(v, w) {
+  var sum = 0;
+  var n = Math.min(v.length, w.length);
+  for(var i = 0; i < n; i++) {
+    sum += v[i]*w[i];
+  }
+  return sum;
+}
+
+function _uvector_eq(v, w) {
+  if (v.length !== w.length) return false;
+  for(var i = 0; i < v.length; i++) {
+    if (v[i] !== w[i]) return false;
+  }
+  return true;
+}
+
+function _uvector_cmp(v, w) {
+  var n = Math.min(v.length, w.length);
+  for(var i = 0; i < n; i++) {
+    if (v[i] < w[i]) return -1;
+    if (v[i] > w[i]) return 1;
+  }
+  return (v.length < w.length ? -1 : (v.length > w.length ? 1 : 0));
+}
+
+
 /*------------------------------------------------
   General javascript helpers
 ------------------------------------------------*/
@@ -95,6 +95,16 @@ function _string_count(s) {
   return count;
 }
 
+// FNV-1a hash over the utf-16 code units
+function _string_hash(s) {
+  var h = 0x811C9DC5;
+  for(var i = 0; i < s.length; i++) {
+    h ^= s.charCodeAt(i);
+    h = Math.imul(h, 0x01000193);
+  }
+  return (h >>> 1);
+}
+
 // Convert a vector of code points back to a string
 function _chars_to_string( v ) {
   var s = "";
@@ -61,19 +61,38 @@ kk_std_core_hnd__ev kk_ev_none(kk_context_t* ctx) {
 }
 
 
+/*---------------------------------------------------------------------------
+  Tags are interned (with `kk_string_intern`) when they are created by `.new-htag` (once
+  per effect at module initialization) so equal tags share the same string. This way we can
+  find evidence by comparing pointers instead of tag names. The evidence vector is sorted by tag name
+  (as the compiler assumes for statically resolved indices) so we use a binary search on
+  the names to find an insertion point.
+---------------------------------------------------------------------------*/
+
+// Return the first index with a tag that is not less than `tagname`.
+static kk_ssize_t kk_evv_lower_bound( kk_std_core_hnd__ev* vec, kk_ssize_t len, kk_string_t tagname ) {
+  kk_ssize_t lo = 0;
+  kk_ssize_t hi = len;
+  while (lo < hi) {
+    const kk_ssize_t mid = lo + (hi - lo)/2;
+    if (kk_string_cmp_borrow(tagname, kk_std_core_hnd__as_Ev(vec[mid])->htag.tagname) <= 0) hi = mid;
+                                                                                       else lo = mid + 1;
+  }
+  return lo;
+}
+
 kk_ssize_t kk_evv_index( struct kk_std_core_hnd_Htag htag, kk_context_t* ctx ) {
   // todo: drop htag?
   kk_ssize_t len;
   kk_std_core_hnd__ev single;
   kk_std_core_hnd__ev* vec = kk_evv_as_vec(ctx->evv,&len,&single);
   for(kk_ssize_t i = 0; i < len; i++) {
-    struct kk_std_core_hnd_Ev* ev = kk_std_core_hnd__as_Ev(vec[i]);
-    if (kk_string_cmp_borrow(htag.tagname,ev->htag.tagname) <= 0) return i; // break on insertion point
+    if (kk_string_ptr_eq_borrow(htag.tagname, kk_std_core_hnd__as_Ev(vec[i])->htag.tagname)) return i;  // interned
   }
   //string_t evvs = kk_evv_show(dup_datatype_as(kk_evv_t,ctx->evv),ctx);
   //fatal_error(EFAULT,"cannot find tag '%s' in: %s", string_cbuf_borrow(htag.htag), string_cbuf_borrow(evvs));
   //drop_string_t(evvs,ctx);
-  return len;
+  return kk_evv_lower_bound(vec, len, htag.tagname);  // insertion point
 }
 
 kk_std_core_hnd__ev kk_evv_lookup( struct kk_std_core_hnd_Htag htag, kk_context_t* ctx ) {
@@ -148,11 +167,10 @@ kk_evv_t kk_evv_insert(kk_evv_t evvd, kk_std_core_hnd__ev evd, kk_context_t* ctx
     ev->cfc = cfc; // update in place
     kk_evv_vector_t vec2 = kk_evv_vector_alloc(n+1, cfc, ctx);
     kk_std_core_hnd__ev* const evv2 = kk_evv_vector_buf(vec2, NULL);
+    const kk_ssize_t pos = kk_evv_lower_bound(evv1, n, ev->htag.tagname);
     kk_ssize_t i;
-    for (i = 0; i < n; i++) {
-      struct kk_std_core_hnd_Ev* ev1 = kk_std_core_hnd__as_Ev(evv1[i]);
-      if (kk_string_cmp_borrow(ev->htag.tagname, ev1->htag.tagname) <= 0) break;
-      evv2[i] = kk_std_core_hnd__ev_dup(&ev1->_base);
+    for (i = 0; i < pos; i++) {
+      evv2[i] = kk_std_core_hnd__ev_dup(evv1[i]);
     }
     evv2[i] = evd;
     for (; i < n; i++) {
@@ -237,75 +255,10 @@ kk_string_t kk_evv_show(kk_evv_t evv, kk_context_t* ctx) {
 
 
 /*-----------------------------------------------------------------------
-  Compose continuations
+  Continuations are composed by `kk_function_compose` and `kk_yield_extend`
+  (see `kklib/src/compose.c`)
 -----------------------------------------------------------------------*/
 
-struct kcompose_fun_s {
-  struct kk_function_s _base;
-  kk_box_t      count;
-  kk_function_t conts[1];
-};
-
-// kleisli composition of continuations
-static kk_box_t kcompose( kk_function_t fself, kk_box_t x, kk_context_t* ctx) {
-  struct kcompose_fun_s* self = kk_function_as(struct kcompose_fun_s*,fself);
-  kk_intx_t count = kk_int_unbox(self->count);
-  kk_function_t* conts = &self->conts[0];
-  // call each continuation in order
-  for(kk_intx_t i = 0; i < count; i++) {
-    // todo: take uniqueness of fself into account to avoid dup_function
-    kk_function_t f = kk_function_dup(conts[i]);
-    x = kk_function_call(kk_box_t, (kk_function_t, kk_box_t, kk_context_t*), f, (f, x, ctx));
-    if (kk_yielding(ctx)) {
-      // if yielding, `yield_next` all continuations that still need to be done
-      while(++i < count) {
-        // todo: if fself is unique, we could copy without dup?
-        kk_yield_extend(kk_function_dup(conts[i]),ctx);
-      }
-      kk_function_drop(fself,ctx);
-      kk_box_drop(x,ctx);     // still drop even though we yield as it may release a boxed value type?
-      return kk_box_any(ctx); // return yielding
-    }
-  }
-  kk_function_drop(fself,ctx);
-  return x;
-}
-
-static kk_function_t new_kcompose( kk_function_t* conts, kk_ssize_t count, kk_context_t* ctx ) {
-  if (count==0) return kk_function_id(ctx);
-  if (count==1) return conts[0];
-  struct kcompose_fun_s* f = kk_block_as(struct kcompose_fun_s*,
-                               kk_block_alloc(kk_ssizeof(struct kcompose_fun_s) - kk_ssizeof(kk_function_t) + (count*kk_ssizeof(kk_function_t)),
-                                 2 + count /* scan size */, KK_TAG_FUNCTION, ctx));
-  f->_base.fun = kk_cfun_ptr_box(&kcompose,ctx);
-  f->count = kk_int_box(count);
-  kk_memcpy(f->conts, conts, count * kk_ssizeof(kk_function_t));
-  return (&f->_base);
-}
-
-/*-----------------------------------------------------------------------
-  Yield extension
------------------------------------------------------------------------*/
-
-kk_box_t kk_yield_extend( kk_function_t next, kk_context_t* ctx ) {
-  kk_yield_t* yield = &ctx->yield;
-  kk_assert_internal(kk_yielding(ctx));  // cannot extend if not yielding
-  if (kk_unlikely(kk_yielding_final(ctx))) {
-    // todo: can we optimize this so `next` is never allocated in the first place?
-    kk_function_drop(next,ctx); // ignore extension if never resuming
-  }
-  else {
-    if (kk_unlikely(yield->conts_count >= KK_YIELD_CONT_MAX)) {
-      // alloc a function to compose all continuations in the array
-      kk_function_t comp = new_kcompose( yield->conts, yield->conts_count, ctx );
-      yield->conts[0] = comp;
-      yield->conts_count = 1;
-    }
-    yield->conts[yield->conts_count++] = next;
-  }
-  return kk_box_any(ctx);
-}
-
 // cont_apply: \x -> f(cont,x)
 struct cont_apply_fun_s {
   struct kk_function_s _base;
@@ -337,7 +290,7 @@ kk_box_t kk_yield_cont( kk_function_t f, kk_context_t* ctx ) {
     kk_function_drop(f,ctx); // ignore extension if never resuming
   }
   else {
-    kk_function_t cont = new_kcompose(yield->conts, yield->conts_count, ctx);
+    kk_function_t cont = kk_function_compose(yield->conts, yield->conts_count, ctx);
     yield->conts_count = 1;
     yield->conts[0] = kk_new_cont_apply(f, cont, ctx);
   }
@@ -384,7 +337,7 @@ struct kk_std_core_hnd_yld_s kk_yield_prompt( struct kk_std_core_hnd_Marker m, k
     return (ctx->yielding == KK_YIELD_FINAL ? kk_std_core_hnd__new_YieldingFinal(ctx) : kk_std_core_hnd__new_Yielding(ctx));
   }
   else {
-    kk_function_t cont = (ctx->yielding == KK_YIELD_FINAL ? fun_fatal_resume_final(ctx) : new_kcompose(yield->conts, yield->conts_count, ctx));
+    kk_function_t cont = (ctx->yielding == KK_YIELD_FINAL ? fun_fatal_resume_final(ctx) : kk_function_compose(yield->conts, yield->conts_count, ctx));
     kk_function_t clause = yield->clause;
     ctx->yielding = KK_YIELD_NONE;
     #ifndef NDEBUG
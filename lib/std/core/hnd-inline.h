@@ -127,7 +127,6 @@ kk_unit_t       kk_evv_guard(kk_evv_t evv, kk_context_t* ctx);
 kk_evv_t        kk_evv_swap_create( kk_vector_t indices, kk_context_t* ctx );
 kk_box_t        kk_fatal_resume_final(kk_context_t* ctx);
 kk_box_t        kk_yield_cont( kk_function_t next, kk_context_t* ctx );
-kk_box_t        kk_yield_extend( kk_function_t next, kk_context_t* ctx );
 kk_box_t        kk_yield_final( struct kk_std_core_hnd_Marker m, kk_function_t clause, kk_context_t* ctx );
 kk_function_t   kk_yield_to( struct kk_std_core_hnd_Marker m, kk_function_t clause, kk_context_t* ctx );
 struct kk_std_core_hnd_yld_s  kk_yield_prompt( struct kk_std_core_hnd_Marker m, kk_context_t* ctx );
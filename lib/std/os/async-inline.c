@@ -0,0 +1,38 @@
+/*---------------------------------------------------------------------------
+  Copyright 2021, Microsoft Research, Daan Leijen.
+
+  This is free software; you can redistribute it and/or modify it under the
+  terms of the Apache License, Version 2.0. A copy of the License can be
+  found in the LICENSE file at the root of this distribution.
+---------------------------------------------------------------------------*/
+
+static kk_unit_t kk_async_sleep_int( kk_integer_t msecs, kk_function_t cb, kk_context_t* ctx ) {
+  kk_async_sleep(kk_integer_clamp64(msecs,ctx),cb,ctx);
+  return kk_Unit;
+}
+
+static kk_unit_t kk_async_read_int( kk_integer_t fd, kk_integer_t max, kk_integer_t offset, kk_function_t cb, kk_context_t* ctx ) {
+  kk_async_read(kk_integer_clamp32(fd,ctx),kk_integer_clamp_ssize_t(max,ctx),kk_integer_clamp64(offset,ctx),cb,ctx);
+  return kk_Unit;
+}
+
+static kk_unit_t kk_async_write_int( kk_integer_t fd, kk_string_t content, kk_integer_t offset, kk_function_t cb, kk_context_t* ctx ) {
+  kk_async_write(kk_integer_clamp32(fd,ctx),content,kk_integer_clamp64(offset,ctx),cb,ctx);
+  return kk_Unit;
+}
+
+static kk_unit_t kk_async_run_unit( kk_context_t* ctx ) {
+  kk_async_run(ctx);
+  return kk_Unit;
+}
+
+static kk_integer_t kk_os_fd_open_int( kk_string_t path, bool writable, kk_context_t* ctx ) {
+  int fd;
+  const int err = kk_os_fd_open(path,writable,&fd,ctx);
+  return kk_integer_from_int(err != 0 ? -err : fd, ctx);
+}
+
+static kk_unit_t kk_os_fd_close_unit( kk_integer_t fd, kk_context_t* ctx ) {
+  kk_os_fd_close(kk_integer_clamp32(fd,ctx));
+  return kk_Unit;
+}
@@ -25,3 +25,20 @@ static kk_std_core__error kk_os_list_directory_prim( kk_string_t dir, kk_context
   if (err != 0) return kk_error_from_errno(err,ctx);
            else return kk_error_ok(kk_vector_box(contents,ctx),ctx);
 }
+
+static kk_std_core__error kk_os_walk_open_error( kk_string_t dir, kk_integer_t threads, kk_integer_t max_depth, kk_context_t* ctx ) {
+  kk_os_walk_t* w;
+  const int err = kk_os_walk_open(dir,kk_integer_clamp_ssize_t(threads,ctx),kk_integer_clamp_ssize_t(max_depth,ctx),&w,ctx);
+  if (err != 0) return kk_error_from_errno(err,ctx);
+           else return kk_error_ok(kk_cptr_raw_box(&kk_os_walk_free,w,ctx),ctx);
+}
+
+static kk_std_core__error kk_os_walk_next_error( kk_box_t bw, kk_context_t* ctx ) {
+  kk_string_t path;
+  int kind;
+  const int err = kk_os_walk_next((kk_os_walk_t*)kk_cptr_raw_unbox(bw),&path,&kind,ctx);
+  kk_box_drop(bw,ctx);
+  if (err != 0) return kk_error_from_errno(err,ctx);
+  kk_std_core_types__tuple2_ res = kk_std_core_types__new_dash__lp__comma__rp_( kk_integer_box(kk_integer_from_int(kind,ctx)), kk_string_box(path), ctx);
+  return kk_error_ok(kk_std_core_types__tuple2__box(res,ctx),ctx);
+}
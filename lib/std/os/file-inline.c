@@ -18,3 +18,53 @@ static kk_std_core__error kk_os_write_text_file_error( kk_string_t path, kk_stri
   if (err != 0) return kk_error_from_errno(err,ctx);
            else return kk_error_ok(kk_unit_box(kk_Unit),ctx);
 }
+
+/*---------------------------------------------------------------------------
+  Buffered streams
+---------------------------------------------------------------------------*/
+
+static kk_std_core__error kk_os_stream_open_error( kk_string_t path, bool writable, bool append, kk_integer_t bufsize, kk_context_t* ctx ) {
+  kk_os_stream_t* s;
+  const int err = kk_os_stream_open(path,writable,append,kk_integer_clamp_ssize_t(bufsize,ctx),&s,ctx);
+  if (err != 0) return kk_error_from_errno(err,ctx);
+           else return kk_error_ok(kk_cptr_raw_box(&kk_os_stream_free,s,ctx),ctx);
+}
+
+static kk_std_core__error kk_os_stream_read_error( kk_box_t bs, kk_integer_t max, kk_context_t* ctx ) {
+  kk_string_t chunk;
+  const int err = kk_os_stream_read((kk_os_stream_t*)kk_cptr_raw_unbox(bs),kk_integer_clamp_ssize_t(max,ctx),&chunk,ctx);
+  kk_box_drop(bs,ctx);
+  if (err != 0) return kk_error_from_errno(err,ctx);
+           else return kk_error_ok(kk_string_box(chunk),ctx);
+}
+
+static kk_std_core__error kk_os_stream_read_line_error( kk_box_t bs, kk_context_t* ctx ) {
+  kk_string_t line;
+  bool eof;
+  const int err = kk_os_stream_read_line((kk_os_stream_t*)kk_cptr_raw_unbox(bs),&line,&eof,ctx);
+  kk_box_drop(bs,ctx);
+  if (err != 0) return kk_error_from_errno(err,ctx);
+  if (eof) return kk_error_ok(kk_std_core_types__maybe_box(kk_std_core_types__new_Nothing(ctx),ctx),ctx);
+      else return kk_error_ok(kk_std_core_types__maybe_box(kk_std_core_types__new_Just(kk_string_box(line),ctx),ctx),ctx);
+}
+
+static kk_std_core__error kk_os_stream_write_error( kk_box_t bs, kk_string_t content, kk_context_t* ctx ) {
+  const int err = kk_os_stream_write((kk_os_stream_t*)kk_cptr_raw_unbox(bs),content,ctx);
+  kk_box_drop(bs,ctx);
+  if (err != 0) return kk_error_from_errno(err,ctx);
+           else return kk_error_ok(kk_unit_box(kk_Unit),ctx);
+}
+
+static kk_std_core__error kk_os_stream_flush_error( kk_box_t bs, kk_context_t* ctx ) {
+  const int err = kk_os_stream_flush((kk_os_stream_t*)kk_cptr_raw_unbox(bs));
+  kk_box_drop(bs,ctx);
+  if (err != 0) return kk_error_from_errno(err,ctx);
+           else return kk_error_ok(kk_unit_box(kk_Unit),ctx);
+}
+
+static kk_std_core__error kk_os_stream_close_error( kk_box_t bs, kk_context_t* ctx ) {
+  const int err = kk_os_stream_close((kk_os_stream_t*)kk_cptr_raw_unbox(bs),ctx);
+  kk_box_drop(bs,ctx);
+  if (err != 0) return kk_error_from_errno(err,ctx);
+           else return kk_error_ok(kk_unit_box(kk_Unit),ctx);
+}
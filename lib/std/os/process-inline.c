@@ -17,3 +17,48 @@ static kk_integer_t kk_os_run_system_prim( kk_string_t cmd, kk_context_t* ctx )
   const int exitcode = kk_os_run_system(cmd,ctx);
   return kk_integer_from_int(exitcode,ctx);
 }
+
+/*---------------------------------------------------------------------------
+  Processes
+---------------------------------------------------------------------------*/
+
+static kk_std_core__error kk_os_process_spawn_error( kk_string_t cmd, bool pipe_stdin, bool pipe_stderr, kk_context_t* ctx ) {
+  kk_os_process_t* p;
+  const int pipes = KK_OS_PROCESS_STDOUT | (pipe_stdin ? KK_OS_PROCESS_STDIN : 0) | (pipe_stderr ? KK_OS_PROCESS_STDERR : 0);
+  kk_stdout_flush(ctx);  // the child may share our stdout
+  const int err = kk_os_process_spawn(cmd,pipes,&p,ctx);
+  if (err != 0) return kk_error_from_errno(err,ctx);
+           else return kk_error_ok(kk_cptr_raw_box(&kk_os_process_free,p,ctx),ctx);
+}
+
+static kk_std_core__error kk_os_process_write_error( kk_box_t bp, kk_string_t input, kk_context_t* ctx ) {
+  const int err = kk_os_process_write((kk_os_process_t*)kk_cptr_raw_unbox(bp),input,ctx);
+  kk_box_drop(bp,ctx);
+  if (err != 0) return kk_error_from_errno(err,ctx);
+           else return kk_error_ok(kk_unit_box(kk_Unit),ctx);
+}
+
+static kk_std_core__error kk_os_process_close_input_error( kk_box_t bp, kk_context_t* ctx ) {
+  const int err = kk_os_process_close_input((kk_os_process_t*)kk_cptr_raw_unbox(bp));
+  kk_box_drop(bp,ctx);
+  if (err != 0) return kk_error_from_errno(err,ctx);
+           else return kk_error_ok(kk_unit_box(kk_Unit),ctx);
+}
+
+static kk_std_core__error kk_os_process_read_error( kk_box_t bp, kk_integer_t max, kk_context_t* ctx ) {
+  int from;
+  kk_string_t chunk;
+  const int err = kk_os_process_read((kk_os_process_t*)kk_cptr_raw_unbox(bp),kk_integer_clamp_ssize_t(max,ctx),&from,&chunk,ctx);
+  kk_box_drop(bp,ctx);
+  if (err != 0) return kk_error_from_errno(err,ctx);
+  kk_std_core_types__tuple2_ res = kk_std_core_types__new_dash__lp__comma__rp_( kk_integer_box(kk_integer_from_int(from,ctx)), kk_string_box(chunk), ctx);
+  return kk_error_ok(kk_std_core_types__tuple2__box(res,ctx),ctx);
+}
+
+static kk_std_core__error kk_os_process_wait_error( kk_box_t bp, kk_context_t* ctx ) {
+  int exitcode;
+  const int err = kk_os_process_wait((kk_os_process_t*)kk_cptr_raw_unbox(bp),&exitcode);
+  kk_box_drop(bp,ctx);
+  if (err != 0) return kk_error_from_errno(err,ctx);
+           else return kk_error_ok(kk_integer_box(kk_integer_from_int(exitcode,ctx)),ctx);
+}
@@ -20,7 +20,6 @@
 
 static pcre2_general_context* gen_ctx;
 static pcre2_compile_context* cmp_ctx;
-static pcre2_match_context*   match_ctx; 
 
 static void* kk_pcre2_malloc( PCRE2_SIZE size, void* data ) {
   return kk_malloc( kk_to_ssize_t(size), kk_get_context() );  
@@ -32,7 +31,6 @@ static void kk_pcre2_free( void* p, void* data ) {
 static void kk_regex_custom_init( kk_context_t* ctx ) {
   gen_ctx = pcre2_general_context_create( &kk_pcre2_malloc, &kk_pcre2_free, NULL );
   if (gen_ctx != NULL) {
-    match_ctx = pcre2_match_context_create( gen_ctx );
     cmp_ctx = pcre2_compile_context_create( gen_ctx );
     if (cmp_ctx != NULL) {
       pcre2_set_newline( cmp_ctx, PCRE2_NEWLINE_ANYCRLF );
@@ -41,15 +39,13 @@ static void kk_regex_custom_init( kk_context_t* ctx ) {
   }
 }
 
+// The per context state is freed with each context (see `kk_regex_thread_free`); this is safe after
+// the general context is freed as each pcre2 object keeps a copy of the memory functions.
 static void kk_regex_custom_done( kk_context_t* ctx ) {
   if (cmp_ctx != NULL) {
     pcre2_compile_context_free(cmp_ctx);
     cmp_ctx = NULL;
   }
-  if (match_ctx != NULL) {
-    pcre2_match_context_free(match_ctx);
-    match_ctx = NULL;
-  }
   if (gen_ctx != NULL) {
     pcre2_general_context_free(gen_ctx);
     gen_ctx = NULL;
@@ -57,32 +53,198 @@ static void kk_regex_custom_done( kk_context_t* ctx ) {
 }
 
 
+/* -----------------------------------------------------------------------
+  Compiled regular expressions are reference counted: they are shared
+  between the (per thread) compile cache and the boxed regex values. 
+  A regex value can be used from another thread than the one that created it.
+------------------------------------------------------------------------*/
+
+typedef struct kk_regex_s {
+  _Atomic(int32_t) rc;        // number of references from the cache and from boxed values
+  uint32_t         options;   // compile options
+  uint32_t         gcount;    // number of groups (including the full match)
+  kk_ssize_t       patlen;
+  uint8_t*         pat;       // copy of the pattern for the cache lookup 
+  pcre2_code*      re;
+} kk_regex_t;
+
+static void kk_regex_release( kk_regex_t* rx ) {
+  if (rx == NULL) return;
+  if (kk_atomic_dec32_acq_rel(&rx->rc) != 1) return;
+  pcre2_code_free(rx->re);
+  kk_free(rx->pat);
+  kk_free(rx);
+}
+
+static kk_regex_t* kk_regex_acquire( kk_regex_t* rx ) {
+  kk_atomic_inc32_relaxed(&rx->rc);
+  return rx;
+}
+
+
+/* -----------------------------------------------------------------------
+  Per context state: a least-recently-used cache of compiled expressions,
+  the match data that is reused between matches, and the match context 
+  with the JIT stack. It is a context local value so it is freed when the
+  context of a (worker) thread is freed.
+------------------------------------------------------------------------*/
+
+#ifndef KK_REGEX_CACHE_SIZE
+#define KK_REGEX_CACHE_SIZE      (32)
+#endif
+#ifndef KK_REGEX_JIT_STACK_MIN
+#define KK_REGEX_JIT_STACK_MIN   (32*1024)
+#endif
+#ifndef KK_REGEX_JIT_STACK_MAX
+#define KK_REGEX_JIT_STACK_MAX   (1024*1024)
+#endif
+
+typedef struct kk_regex_thread_s {
+  kk_regex_t*          cache[KK_REGEX_CACHE_SIZE];   // most recently used first
+  pcre2_match_data*    match_data;
+  uint32_t             match_count;                  // number of ovector pairs in `match_data`
+  pcre2_match_context* match_ctx;
+  pcre2_jit_stack*     jit_stack;
+} kk_regex_thread_t;
+
+static int kk_regex_thread_key;  // its address identifies the state in the context
+
+static void kk_regex_thread_free( void* p, kk_context_t* ctx ) {
+  kk_regex_thread_t* t = (kk_regex_thread_t*)p;
+  for (int i = 0; i < KK_REGEX_CACHE_SIZE; i++) {
+    kk_regex_release(t->cache[i]);
+    t->cache[i] = NULL;
+  }
+  if (t->match_data != NULL) {
+    pcre2_match_data_free(t->match_data);
+    t->match_data = NULL;
+    t->match_count = 0;
+  }
+  if (t->match_ctx != NULL) {
+    pcre2_match_context_free(t->match_ctx);
+    t->match_ctx = NULL;
+  }
+  if (t->jit_stack != NULL) {
+    pcre2_jit_stack_free(t->jit_stack);
+    t->jit_stack = NULL;
+  }
+  kk_free(t);
+}
+
+// Return the state of this context (or NULL if out of memory)
+static kk_regex_thread_t* kk_regex_thread( kk_context_t* ctx ) {
+  kk_regex_thread_t* t = (kk_regex_thread_t*)kk_context_local_get( &kk_regex_thread_key, ctx );
+  if (t == NULL) {
+    t = (kk_regex_thread_t*)kk_zalloc( kk_ssizeof(kk_regex_thread_t), ctx );
+    if (t != NULL && !kk_context_local_set( &kk_regex_thread_key, t, &kk_regex_thread_free, ctx )) {
+      kk_free(t);
+      t = NULL;
+    }
+  }
+  return t;
+}
+
+// Return match data with room for at least `gcount` groups
+static pcre2_match_data* kk_regex_match_data( kk_regex_thread_t* t, uint32_t gcount ) {
+  if (t->match_data == NULL || t->match_count < gcount) {
+    if (t->match_data != NULL) pcre2_match_data_free(t->match_data);
+    const uint32_t count = (gcount < 16 ? 16 : gcount);
+    t->match_data  = pcre2_match_data_create(count, gen_ctx);
+    t->match_count = (t->match_data == NULL ? 0 : count);
+  }
+  return t->match_data;
+}
+
+// Return the match context of this thread; the JIT stack grows up to `KK_REGEX_JIT_STACK_MAX`
+// (instead of the default 32KiB on the machine stack)
+static pcre2_match_context* kk_regex_match_context( kk_regex_thread_t* t ) {
+  if (t->match_ctx == NULL) {
+    t->match_ctx = pcre2_match_context_create(gen_ctx);
+    if (t->match_ctx != NULL) {
+      t->jit_stack = pcre2_jit_stack_create(KK_REGEX_JIT_STACK_MIN, KK_REGEX_JIT_STACK_MAX, gen_ctx);
+      if (t->jit_stack != NULL) pcre2_jit_stack_assign(t->match_ctx, NULL, t->jit_stack);
+    }
+  }
+  return t->match_ctx;
+}
+
+static kk_regex_t* kk_regex_cache_lookup( kk_regex_thread_t* t, const uint8_t* pat, kk_ssize_t patlen, uint32_t options ) {
+  for (int i = 0; i < KK_REGEX_CACHE_SIZE; i++) {
+    kk_regex_t* rx = t->cache[i];
+    if (rx == NULL) break;
+    if (rx->options == options && rx->patlen == patlen && memcmp(rx->pat, pat, kk_to_size_t(patlen)) == 0) {
+      // move to the front
+      memmove(&t->cache[1], &t->cache[0], kk_to_size_t(i) * sizeof(kk_regex_t*));
+      t->cache[0] = rx;
+      return rx;
+    }
+  }
+  return NULL;
+}
+
+static void kk_regex_cache_insert( kk_regex_thread_t* t, kk_regex_t* rx ) {
+  kk_regex_release(t->cache[KK_REGEX_CACHE_SIZE-1]);  // evict the least recently used
+  memmove(&t->cache[1], &t->cache[0], (KK_REGEX_CACHE_SIZE-1) * sizeof(kk_regex_t*));
+  t->cache[0] = kk_regex_acquire(rx);
+}
+
+
 /* -----------------------------------------------------------------------
   Compile
 ------------------------------------------------------------------------*/
 
-static void kk_regex_free( void* pre, kk_block_t* b ) {
-  pcre2_code* re = (pcre2_code*)pre;
-  //kk_info_message( "free regex at %p\n", re );
-  if (re != NULL) pcre2_code_free(re);
+static void kk_regex_free( void* prx, kk_block_t* b ) {
+  //kk_info_message( "free regex at %p\n", prx );
+  kk_regex_release((kk_regex_t*)prx);
 }
 
 #define KK_REGEX_OPTIONS  (PCRE2_ALT_BSUX | PCRE2_EXTRA_ALT_BSUX | PCRE2_MATCH_UNSET_BACKREF /* javascript compat */ \
                           | PCRE2_NEVER_BACKSLASH_C | PCRE2_NEVER_UCP | PCRE2_UTF /* utf-8 safety */ \
                           )
 
+static kk_regex_t* kk_regex_compile( const uint8_t* cpat, kk_ssize_t len, uint32_t options, kk_context_t* ctx ) {
+  PCRE2_SIZE errofs = 0;
+  int        errnum = 0;
+  pcre2_code* re = pcre2_compile( cpat, (PCRE2_SIZE)len, options, &errnum, &errofs, cmp_ctx);
+  //kk_info_message( "create regex: err:%i, at %p\n", (re==NULL ? 0 : errnum), re );
+  if (re == NULL) return NULL;
+  pcre2_jit_compile( re, PCRE2_JIT_COMPLETE );  // on failure (or no JIT support) we use the interpreter
+  uint32_t capcount = 0;
+  pcre2_pattern_info( re, PCRE2_INFO_CAPTURECOUNT, &capcount );
+  kk_regex_t* rx = (kk_regex_t*)kk_malloc( kk_ssizeof(kk_regex_t), ctx );
+  uint8_t* pat   = (uint8_t*)kk_malloc( len + 1, ctx );
+  if (rx == NULL || pat == NULL) {
+    kk_free(rx); kk_free(pat);
+    pcre2_code_free(re);
+    return NULL;
+  }
+  memcpy(pat, cpat, kk_to_size_t(len) + 1);
+  kk_atomic_store_relaxed(&rx->rc, 1);
+  rx->options = options;
+  rx->gcount  = capcount + 1;
+  rx->patlen  = len;
+  rx->pat     = pat;
+  rx->re      = re;
+  return rx;
+}
+
 static kk_box_t kk_regex_create( kk_string_t pat, bool ignore_case, bool multi_line, kk_context_t* ctx ) {
   kk_ssize_t len;
   const uint8_t* cpat = kk_string_buf_borrow( pat, &len );
-  PCRE2_SIZE errofs = 0;
-  int        errnum = 0;
   uint32_t   options = KK_REGEX_OPTIONS;
   if (ignore_case) options |= PCRE2_CASELESS;
   if (multi_line)  options |= PCRE2_MULTILINE;
-  pcre2_code* re = pcre2_compile( cpat, PCRE2_ZERO_TERMINATED, options, &errnum, &errofs, cmp_ctx);
-  //kk_info_message( "create regex: err:%i, at %p\n", (re==NULL ? 0 : errnum), re );
+  kk_regex_thread_t* t = kk_regex_thread(ctx);
+  kk_regex_t* rx = (t == NULL ? NULL : kk_regex_cache_lookup( t, cpat, len, options ));
+  if (rx != NULL) {
+    kk_regex_acquire(rx);
+  }
+  else {
+    rx = kk_regex_compile( cpat, len, options, ctx );
+    if (rx != NULL && t != NULL) kk_regex_cache_insert(t, rx);
+  }
   kk_string_drop(pat,ctx);
-  return kk_cptr_raw_box( &kk_regex_free, re, ctx );
+  return kk_cptr_raw_box( &kk_regex_free, rx, ctx );
 }
 
 
@@ -98,19 +260,21 @@ static void kk_match_data_free( void* pmd, kk_block_t* b ) {
 }
 */
 
-static kk_std_core__list kk_regex_exec_ex( pcre2_code* re, pcre2_match_data* match_data, 
-                                           kk_string_t str_borrow, const uint8_t* cstr, kk_ssize_t len, bool allow_empty, 
+// Match at `start`; the subject is only checked for valid UTF-8 if `utf_check` is set.
+static kk_std_core__list kk_regex_exec_ex( kk_regex_t* rx, pcre2_match_data* match_data, pcre2_match_context* match_ctx,
+                                           kk_string_t str_borrow, const uint8_t* cstr, kk_ssize_t len, bool allow_empty, bool utf_check,
                                            kk_ssize_t start, kk_ssize_t* mstart, kk_ssize_t* end, int* res, kk_context_t* ctx ) 
 {
   // match
   kk_std_core__list hd  = kk_std_core__new_Nil(ctx);
   uint32_t options = 0;
   if (!allow_empty) options |= (PCRE2_NOTEMPTY_ATSTART | PCRE2_ANCHORED);
-  int rc = pcre2_match( re, cstr, len, start, options, match_data, match_ctx );
+  if (!utf_check)   options |= PCRE2_NO_UTF_CHECK;
+  int rc = pcre2_match( rx->re, cstr, len, start, options, match_data, match_ctx );
   if (res != NULL) *res = rc;    
   if (rc > 0) {    
-    // extract captures
-    uint32_t    gcount = pcre2_get_ovector_count(match_data);
+    // extract captures (the match data may have room for more groups than the regex has)
+    uint32_t    gcount = rx->gcount;
     PCRE2_SIZE* groups = pcre2_get_ovector_pointer(match_data);
     for( uint32_t i = gcount; i > 0; ) {
       i--;
@@ -132,23 +296,20 @@ static kk_std_core__list kk_regex_exec_ex( pcre2_code* re, pcre2_match_data* mat
 static kk_std_core__list kk_regex_exec( kk_box_t bre, kk_string_t str, kk_ssize_t start, kk_context_t* ctx ) 
 {
   // unpack
-  pcre2_match_data* match_data = NULL;
   kk_std_core__list res = kk_std_core__new_Nil(ctx);
-  pcre2_code* re = (pcre2_code*)kk_cptr_raw_unbox(bre);
-  if (re == NULL) goto done;    
-  match_data = pcre2_match_data_create_from_pattern(re, gen_ctx);
+  kk_regex_t* rx = (kk_regex_t*)kk_cptr_raw_unbox(bre);
+  if (rx == NULL) goto done;    
+  kk_regex_thread_t* t = kk_regex_thread(ctx);
+  if (t == NULL) goto done;
+  pcre2_match_data* match_data = kk_regex_match_data(t, rx->gcount);
   if (match_data==NULL) goto done;  
   kk_ssize_t len;
   const uint8_t* cstr = kk_string_buf_borrow(str, &len );  
 
   // and match
-  res = kk_regex_exec_ex( re, match_data, str, cstr, len, true, start, NULL, NULL, NULL, ctx );
+  res = kk_regex_exec_ex( rx, match_data, kk_regex_match_context(t), str, cstr, len, true, true, start, NULL, NULL, NULL, ctx );
 
 done:  
-  if (match_data != NULL) {
-    //kk_info_message( "free match data: %p\n", match_data );
-    pcre2_match_data_free(match_data);
-  }
   kk_string_drop(str,ctx);
   kk_box_drop(bre,ctx);
   return res;
@@ -157,25 +318,29 @@ done:
 static kk_std_core__list kk_regex_exec_all( kk_box_t bre, kk_string_t str, kk_ssize_t start, kk_ssize_t atmost, kk_context_t* ctx ) {
   // unpack
   if (atmost < 0) atmost = KK_SSIZE_MAX;
-  pcre2_match_data* match_data = NULL;
   kk_std_core__list res = kk_std_core__new_Nil(ctx);
-  pcre2_code* re = (pcre2_code*)kk_cptr_raw_unbox(bre);
-  if (re == NULL) goto done;    
-  match_data = pcre2_match_data_create_from_pattern(re, gen_ctx);
+  kk_regex_t* rx = (kk_regex_t*)kk_cptr_raw_unbox(bre);
+  if (rx == NULL) goto done;    
+  kk_regex_thread_t* t = kk_regex_thread(ctx);
+  if (t == NULL) goto done;
+  pcre2_match_data* match_data = kk_regex_match_data(t, rx->gcount);
   if (match_data==NULL) goto done;  
+  pcre2_match_context* match_ctx = kk_regex_match_context(t);
   kk_ssize_t len;
   const uint8_t* cstr = kk_string_buf_borrow(str, &len );  
 
   // and match
   kk_std_core__list* tail = NULL;
   bool allow_empty = true;
+  bool utf_check = true;
   int rc = 1;    
   kk_ssize_t next = start;
   while( rc > 0 && start < len && atmost > 0) {
     atmost--;
     rc = 0;
     kk_ssize_t mstart = start;
-    kk_std_core__list cap = kk_regex_exec_ex( re, match_data, str, cstr, len, allow_empty, start, &mstart, &next, &rc, ctx );
+    kk_std_core__list cap = kk_regex_exec_ex( rx, match_data, match_ctx, str, cstr, len, allow_empty, utf_check, start, &mstart, &next, &rc, ctx );
+    utf_check = false;  // the subject only needs to be checked once
     if (rc > 0) {
       // found a match; 
       // push string up to match, and the actual matched regex
@@ -207,10 +372,6 @@ static kk_std_core__list kk_regex_exec_all( kk_box_t bre, kk_string_t str, kk_ss
             else *tail = cons;  
 
 done:  
-  if (match_data != NULL) {
-    //kk_info_message( "free match data: %p\n", match_data );
-    pcre2_match_data_free(match_data);
-  }
   kk_string_drop(str,ctx);
   kk_box_drop(bre,ctx);
   return res;
@@ -99,7 +99,8 @@ genModule buildType sourceDir penv platform newtypes enableReuse enableSpecializ
 
         emitToInit $ vcat $ [text "static bool _kk_initialized = false;"
                             ,text "if (_kk_initialized) return;"
-                            ,text "_kk_initialized = true;"]
+                            ,text "_kk_initialized = true;"
+                            ,text "kk_startup_enter" <.> parens (dquotes (string (showName (coreProgName core)))) <.> semi]
                             ++ map initImport (coreProgImports core)
                             ++ 
                             [text "#if defined(KK_CUSTOM_INIT)"
@@ -125,6 +126,7 @@ genModule buildType sourceDir penv platform newtypes enableReuse enableSpecializ
         genTypeDefs (coreProgTypeDefs core)
         emitToH (linebreak <.> text "// value declarations")
         genTopGroups (coreProgDefs core)
+        emitToInit $ text "kk_startup_leave();"
 
         genMain (coreProgName core) mbMain
 
@@ -360,7 +362,8 @@ genTopDefDecl genSig inlineC def@(Def name tp defBody vis sort inl rng comm)
                                 emitToInit (block doc)  -- must be scoped to avoid name clashes
                                 case genDupDropCall False {-drop-} tp (ppName name) of 
                                   []   -> return ()
-                                  docs -> emitToDone (hcat docs <.> semi)
+                                  docs -> do emitToInit (vcat (map (<.> semi) (genFreezeCall tp (ppName name))))
+                                             emitToDone (hcat docs <.> semi)
                                 let decl = ppType tp <+> ppName name <.> unitSemi tp
                                 -- if (isPublic vis) -- then do
                                 -- always public since inlined definitions can refer to it (sin16 in std/num/ddouble)
@@ -756,7 +759,7 @@ genUnbox name info dataRepr
                   , ppName name <+> text "_unbox;"
                   , text "kk_valuetype_unbox_" <.> arguments [ppName name, text "_p", text "_unbox", text "_x"] <.> semi  -- borrowing
                   , text "if (_ctx!=NULL && _p!=NULL)" <+> block (
-                      text "if (kk_basetype_is_unique(_p)) { kk_basetype_free(_p); } else" <+> block (
+                      text "if (kk_basetype_is_unique(_p)) { kk_basetype_free(_p,_ctx); } else" <+> block (
                         vcat [ppName name <.> text "_dup(_unbox);"
                              ,text "kk_basetype_decref" <.> arguments [text "_p"] <.> semi]
                       )
@@ -800,10 +803,10 @@ genIsUnique name info dataRepr
 genFree :: Name -> DataInfo -> DataRepr -> Asm ()
 genFree name info dataRepr
   = emitToH $
-    text "static inline void" <+> ppName name <.> text "_free" <.> tupled [ppName name <+> text "_x"] <+> block (
+    text "static inline void" <+> ppName name <.> text "_free" <.> parameters [ppName name <+> text "_x"] <+> block (
       (if (dataReprMayHaveSingletons dataRepr)
-        then text "kk_datatype_free(_x)"
-        else text "kk_basetype_free(_x)"
+        then text "kk_datatype_free" <.> arguments [text "_x"]
+        else text "kk_basetype_free" <.> arguments [text "_x"]
       ) <.> semi)
 
 genDecRef :: Name -> DataInfo -> DataRepr -> Asm ()
@@ -940,6 +943,15 @@ genDupDropCall :: Bool -> Type -> Doc -> [Doc]
 genDupDropCall isDup tp arg = if (isDup) then genDupDropCallX "dup" tp (parens arg)
                                          else genDupDropCallX "drop" tp (arguments [arg])
 
+-- Freeze a top-level value once it is initialized (see `kk_box_freeze`): it is immortal and
+-- thread shared, so parallel tasks can use it without racing on its reference counts.
+genFreezeCall :: Type -> Doc -> [Doc]
+genFreezeCall tp arg
+  = case cType tp of
+      CPrim val | not (val `elem` ["kk_integer_t","kk_string_t","kk_vector_t","kk_ref_t","kk_box_t"])
+        -> []  -- not boxable (and not reference counted)
+      _ -> [text "kk_box_drop" <.> arguments [text "kk_box_freeze" <.> arguments [genBoxCall "box" False tp (genDupCall tp arg)]]]
+
 genIsUniqueCall :: Type -> Doc -> [Doc]
 genIsUniqueCall tp arg  = case genDupDropCallX "is_unique" tp (parens arg) of
                             -- [call] -> [text "kk_likely" <.> parens call]
@@ -0,0 +1,69 @@
+// The binary trees benchmark of the Computer Language Benchmark Game where the
+// trees of each depth are allocated and checked on a separate thread.
+#include <iostream>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+struct Node {
+  Node* left;
+  Node* right;
+  Node(Node* l, Node* r) : left(l), right(r) { }
+  ~Node() {
+    delete left;
+    delete right;
+  }
+};
+
+static Node* make(int depth) {
+  if (depth > 0) return new Node(make(depth - 1), make(depth - 1));
+            else return new Node(nullptr, nullptr);
+}
+
+static long check(const Node* t) {
+  if (t->left == nullptr) return 1;
+  return check(t->left) + check(t->right) + 1;
+}
+
+static long sum_trees(long iterations, int depth) {
+  long total = 0;
+  for (long i = 0; i < iterations; i++) {
+    Node* t = make(depth);
+    total += check(t);
+    delete t;
+  }
+  return total;
+}
+
+int main(int argc, char** argv) {
+  int n = 20;
+  if (argc == 2) {
+    n = atoi(argv[1]);
+  }
+  const int min_depth = 4;
+  const int max_depth = (min_depth + 2 > n ? min_depth + 2 : n);
+  const int stretch   = max_depth + 1;
+  {
+    Node* t = make(stretch);
+    std::cout << "stretch tree of depth " << stretch << "\t check: " << check(t) << "\n";
+    delete t;
+  }
+  Node* long_lived = make(max_depth);
+  const int count = (max_depth - min_depth)/2 + 1;
+  std::vector<long> results(count);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < count; i++) {
+    threads.emplace_back([&results, i, min_depth, max_depth]() {
+      const int depth = min_depth + 2*i;
+      results[i] = sum_trees(1L << (max_depth - depth + min_depth), depth);
+    });
+  }
+  for (auto& t : threads) { t.join(); }
+  for (int i = 0; i < count; i++) {
+    const int depth = min_depth + 2*i;
+    std::cout << (1L << (max_depth - depth + min_depth)) << "\t trees of depth " << depth << "\t check: " << results[i] << "\n";
+  }
+  std::cout << "long lived tree of depth " << max_depth << "\t check: " << check(long_lived) << "\n";
+  delete long_lived;
+  return 0;
+}
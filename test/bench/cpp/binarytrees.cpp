@@ -0,0 +1,57 @@
+// The binary trees benchmark of the Computer Language Benchmark Game,
+// using plain new/delete for each node.
+#include <iostream>
+#include <cstdlib>
+
+struct Node {
+  Node* left;
+  Node* right;
+  Node(Node* l, Node* r) : left(l), right(r) { }
+  ~Node() {
+    delete left;
+    delete right;
+  }
+};
+
+static Node* make(int depth) {
+  if (depth > 0) return new Node(make(depth - 1), make(depth - 1));
+            else return new Node(nullptr, nullptr);
+}
+
+static long check(const Node* t) {
+  if (t->left == nullptr) return 1;
+  return check(t->left) + check(t->right) + 1;
+}
+
+static long sum_trees(long iterations, int depth) {
+  long total = 0;
+  for (long i = 0; i < iterations; i++) {
+    Node* t = make(depth);
+    total += check(t);
+    delete t;
+  }
+  return total;
+}
+
+int main(int argc, char** argv) {
+  int n = 20;
+  if (argc == 2) {
+    n = atoi(argv[1]);
+  }
+  const int min_depth = 4;
+  const int max_depth = (min_depth + 2 > n ? min_depth + 2 : n);
+  const int stretch   = max_depth + 1;
+  {
+    Node* t = make(stretch);
+    std::cout << "stretch tree of depth " << stretch << "\t check: " << check(t) << "\n";
+    delete t;
+  }
+  Node* long_lived = make(max_depth);
+  for (int depth = min_depth; depth <= max_depth; depth += 2) {
+    const long iterations = 1L << (max_depth - depth + min_depth);
+    std::cout << iterations << "\t trees of depth " << depth << "\t check: " << sum_trees(iterations, depth) << "\n";
+  }
+  std::cout << "long lived tree of depth " << max_depth << "\t check: " << check(long_lived) << "\n";
+  delete long_lived;
+  return 0;
+}
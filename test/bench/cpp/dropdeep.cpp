@@ -0,0 +1,77 @@
+// Build large structures (a long list, a deep right spine, and a balanced tree)
+// and free each of them in one go. The list and spine are freed with a loop
+// as a recursive destructor would overflow the stack.
+#include <iostream>
+
+struct Cell {
+  long* head;
+  Cell* tail;
+};
+
+struct Node {
+  Node* left;
+  long  value;
+  Node* right;
+};
+
+static Cell* make_list(long n) {
+  Cell* xs = nullptr;
+  for (; n > 0; n--) {
+    xs = new Cell{ new long(n), xs };
+  }
+  return xs;
+}
+
+static void free_list(Cell* xs) {
+  while (xs != nullptr) {
+    Cell* next = xs->tail;
+    delete xs->head;
+    delete xs;
+    xs = next;
+  }
+}
+
+static Node* make_spine(long n) {
+  Node* t = nullptr;
+  for (; n > 0; n--) {
+    t = new Node{ nullptr, n, t };
+  }
+  return t;
+}
+
+static void free_spine(Node* t) {
+  while (t != nullptr) {
+    Node* next = t->right;
+    delete t;
+    t = next;
+  }
+}
+
+static Node* make_tree(int depth) {
+  if (depth <= 0) return nullptr;
+  return new Node{ make_tree(depth - 1), depth, make_tree(depth - 1) };
+}
+
+static void free_tree(Node* t) {
+  if (t == nullptr) return;
+  free_tree(t->left);
+  free_tree(t->right);
+  delete t;
+}
+
+int main() {
+  long total = 0;
+  for (int i = 0; i < 20; i++) {
+    Cell* xs = make_list(1000000);
+    total += *xs->head;
+    free_list(xs);
+    Node* s = make_spine(1000000);
+    total += s->value;
+    free_spine(s);
+    Node* t = make_tree(20);
+    total += t->value;
+    free_tree(t);
+  }
+  std::cout << total << "\n";
+  return 0;
+}
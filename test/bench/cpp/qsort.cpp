@@ -0,0 +1,76 @@
+// Sort many pseudo random arrays in place with the same quicksort as the other versions.
+#include <iostream>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+
+typedef int32_t elem;
+
+static uint32_t bad_rand(uint32_t seed) {
+  return seed * 1664525u + 1013904223u;
+}
+
+static std::vector<elem> mk_random_array(uint32_t seed, int n) {
+  std::vector<elem> a(n);
+  for (int i = 0; i < n; i++) {
+    a[i] = (elem)(seed & 0x7FFFFFFF);
+    seed = bad_rand(seed);
+  }
+  return a;
+}
+
+static void check_sorted(const std::vector<elem>& a) {
+  for (size_t i = 1; i < a.size(); i++) {
+    if (a[i-1] > a[i]) {
+      std::cerr << "array is not sorted\n";
+      exit(1);
+    }
+  }
+}
+
+static void swap(std::vector<elem>& a, int i, int j) {
+  elem x = a[i];
+  a[i] = a[j];
+  a[j] = x;
+}
+
+static int partition(std::vector<elem>& a, int lo, int hi) {
+  int mid = (lo + hi) / 2;
+  if (a[mid] < a[lo]) swap(a, lo, mid);
+  if (a[hi] < a[lo])  swap(a, lo, hi);
+  if (a[mid] < a[hi]) swap(a, mid, hi);
+  const elem pivot = a[hi];
+  int i = lo;
+  for (int j = lo; j < hi; j++) {
+    if (a[j] < pivot) {
+      swap(a, i, j);
+      i++;
+    }
+  }
+  swap(a, i, hi);
+  return i;
+}
+
+static void qsort_aux(std::vector<elem>& a, int lo, int hi) {
+  if (lo < hi) {
+    int mid = partition(a, lo, hi);
+    qsort_aux(a, lo, mid);
+    qsort_aux(a, mid + 1, hi);
+  }
+}
+
+int main(int argc, char** argv) {
+  int n = 400;
+  if (argc == 2) {
+    n = atoi(argv[1]);
+  }
+  for (int k = 0; k < n; k++) {
+    for (int i = 0; i < n; i++) {
+      std::vector<elem> a = mk_random_array((uint32_t)i, i);
+      qsort_aux(a, 0, i - 1);
+      check_sorted(a);
+    }
+  }
+  std::cout << "sorted\n";
+  return 0;
+}
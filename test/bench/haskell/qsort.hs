@@ -70,7 +70,10 @@ qsort as = do
 
 main :: IO ()
 main = do
-  [n] <- getArgs >>= mapM readIO
+  args <- getArgs
+  let n = case args of
+            [a] -> read a
+            _   -> 400
   forM_ [0..n-1] $ \_ ->
     forM_ [0..n-1] $ \i -> do
       let xs = mkRandomArray (toEnum i) i
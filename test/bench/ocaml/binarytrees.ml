@@ -0,0 +1,33 @@
+(* The binary trees benchmark of the Computer Language Benchmark Game *)
+type tree = Node of tree * tree | Tip
+
+let rec make depth =
+  if depth > 0 then Node (make (depth - 1), make (depth - 1)) else Node (Tip, Tip)
+
+let rec check t =
+  match t with
+  | Node (l, r) -> check l + check r + 1
+  | Tip -> 0
+
+let sum_trees iterations depth =
+  let total = ref 0 in
+  for _ = 1 to iterations do
+    total := !total + check (make depth)
+  done;
+  !total
+
+let main n =
+  let min_depth = 4 in
+  let max_depth = max (min_depth + 2) n in
+  let stretch = max_depth + 1 in
+  Printf.printf "stretch tree of depth %d\t check: %d\n" stretch (check (make stretch));
+  let long_lived = make max_depth in
+  let depth = ref min_depth in
+  while !depth <= max_depth do
+    let iterations = 1 lsl (max_depth - !depth + min_depth) in
+    Printf.printf "%d\t trees of depth %d\t check: %d\n" iterations !depth (sum_trees iterations !depth);
+    depth := !depth + 2
+  done;
+  Printf.printf "long lived tree of depth %d\t check: %d\n" max_depth (check long_lived);;
+
+main (if Array.length Sys.argv > 1 then int_of_string Sys.argv.(1) else 20);;
@@ -62,4 +62,4 @@ let main n =
     done
   done;;
 
-main (int_of_string Sys.argv.(1))
+main (if Array.length Sys.argv > 1 then int_of_string Sys.argv.(1) else 400)
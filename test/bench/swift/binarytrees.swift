@@ -37,9 +37,9 @@ func createTree(_ depth: Int) -> TreeNode? {
 
 let n: Int
 if CommandLine.argc > 1 {
-    n = Int(CommandLine.arguments[1]) ?? 10
+    n = Int(CommandLine.arguments[1]) ?? 20
 } else {
-    n = 10
+    n = 20
 }
 let minDepth = 4
 let maxDepth = (n > minDepth + 2) ? n : minDepth + 2
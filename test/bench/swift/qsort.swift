@@ -64,7 +64,7 @@ func qsort(_ a: inout Array<Elem>) {
 }
 
 
-let n = Int(CommandLine.arguments[1])!
+let n = CommandLine.argc > 1 ? Int(CommandLine.arguments[1])! : 400
 for _ in 0..<n {
     for i in 0..<n {
         var xs = mkRandomArray(UInt32(i), i)